@@ -72,8 +72,19 @@ enum display_type {
 // 页面摘要字符数量
 #define DIGEST_NUM 50
 
-// 通用回收池字符上限
-#define RECYCLE_POOL_LIMIT 1500
+// 字形图集（全书共用的字形位图缓存，PSRAM）容量与字形数上限
+#define GLYPH_ATLAS_BYTES (768 * 1024)
+#define GLYPH_ATLAS_MAX_GLYPHS 6144
+// 目录等 UI 文本最多钉住的字形数，保证页面窗口总能放下
+#define GLYPH_ATLAS_UI_PIN_LIMIT 1024
+// 字形合并读取（GlyphFetchService）：按位图偏移排序后，间隙不超过 MAX_GAP 的相邻字形合并为一次读取，
+// 单次读取不超过 MAX_READ；周边页的字形交给专用 I/O 任务异步读入图集
+#define ENABLE_GLYPH_FETCH_TASK 1 // 设为0时周边页仍同步构建（合并读取照常生效）
+#define GLYPH_FETCH_MAX_GAP 1024
+#define GLYPH_FETCH_MAX_READ (32 * 1024)
+#define GLYPH_FETCH_QUEUE_LEN 4
+// 竖排旋转/镜像后的字形变体（4bpp 覆盖度，PSRAM）缓存条数；标点与西文字母数字都会用到
+#define GLYPH_VARIANT_CACHE_ENTRIES 160
 
 // 定时
 #define IDLE_PWR_WAIT_MIN 30 // 10min go to poweroff
@@ -83,6 +94,47 @@ enum display_type {
 #define BATCH_DELAY 20
 #define PAGES_DELAY 20
 
+// Wi-Fi 传输模式的 HTTP 服务器（api/http_core）：固定连接池，独立任务轮转推进所有连接。
+// lwIP 总共只有 LWIP_MAX_SOCKETS(10) 个 socket，监听占 1 个；每连接的收发缓冲放在 PSRAM
+#define HTTP_MAX_CONNECTIONS 5
+#define HTTP_IO_BUFFER (16 * 1024)
+#define HTTP_HEADER_BUFFER 2048
+#define HTTP_POLL_MS 20
+#define HTTP_TASK_STACK 12288
+// 上传写卡流水线（device/sd_write_pipeline）：每个上传 N 个 PSRAM 缓冲轮流接收，写满交给 SD 写入任务；
+// 写入任务经内部 DMA 缓冲按 DMA_CHUNK（扇区整数倍）分段写卡
+#define UPLOAD_PIPELINE_BUFFERS 3
+#define UPLOAD_PIPELINE_BUFFER_SIZE (64 * 1024)
+#define UPLOAD_PIPELINE_DMA_CHUNK (16 * 1024)
+#define UPLOAD_PIPELINE_QUEUE_LEN (HTTP_MAX_CONNECTIONS * UPLOAD_PIPELINE_BUFFERS)
+// 缓冲全部在排队写卡时接收方最多等 STALL_WAIT_MS，仍无空闲缓冲即回 503 让客户端稍后重试（不占住 HTTP 任务）；
+// 收尾时等待在途缓冲写完最多 IDLE_TIMEOUT_MS，超时按写卡失败处理
+#define UPLOAD_PIPELINE_STALL_WAIT_MS 250
+#define UPLOAD_PIPELINE_IDLE_TIMEOUT_MS 10000
+#define UPLOAD_PIPELINE_TASK_STACK 4096
+// 目录排序索引（device/dir_index）：/list 分页用的按名排序索引，外部归并排序生成 /bookmarks/<目录>.dix。
+// 每 RUN_ENTRIES 项在内存中排成一个有序段，一次最多归并 MERGE_FANIN 段；每 CHECKPOINT 项记录一个文件偏移
+#define DIR_INDEX_RUN_ENTRIES 128
+#define DIR_INDEX_MERGE_FANIN 8
+#define DIR_INDEX_CHECKPOINT 16
+// USB 大容量存储的扇区缓存（device/msc_sector_cache）：PSRAM 行缓存（FAT/目录等反复读取的小块）、
+// 顺序读预读窗口、写聚合窗口（均以 512 字节扇区计）；读写卡经内部 DMA 缓冲按 DMA_SECTORS 分段。
+// WRITE_BACK 为 0（默认）时所有写都直写卡；为 1 时 FAT 区写回、顺序写聚合，写入空闲 IDLE_MS 或脏数据
+// 驻留 MAX_MS 后落盘。主机把本设备当作直写盘，写回模式下未弹出就拔线会丢失最多这段时间内已应答的写入，
+// 因此默认关闭；SYNCHRONIZE CACHE、弹出与退出按钮都会先落盘
+#define MSC_CACHE_LINES 64
+#define MSC_CACHE_LINE_SECTORS 8
+#define MSC_READAHEAD_SECTORS 256
+#define MSC_WRITE_GATHER_SECTORS 256
+#define MSC_CACHE_DMA_SECTORS 64
+#define MSC_CACHE_WRITE_BACK 0
+#define MSC_CACHE_FLUSH_IDLE_MS 200
+#define MSC_CACHE_FLUSH_MAX_MS 1000
+#define MSC_CACHE_FLUSH_POLL_MS 50
+// 压缩书籍（text/lz_book）：每个打开的解压视图在 PSRAM 中缓存的解压块数（块大小由打包时决定，默认 32KB）。
+// 至少 2 块，页面跨块或 read_text_page 向前回退时不必重解
+#define LZBOOK_CACHE_BLOCKS 2
+
 // 文件管理最大返回数量 - 主菜单文件列表限制
 #define MAX_MAIN_MENU_FILE_COUNT 99
 
@@ -132,6 +184,20 @@ extern bool enterDebug;
 // 字形预读窗口控制
 #define ENABLE_GLYPH_READ_WINDOW 0  // 禁用预读窗口（设为1启用）
 
+// 全文检索索引（.sidx）：分页索引完成后由后台索引循环继续构建
+#define ENABLE_SEARCH_INDEX 1  // 设为0关闭后台构建（查询仍可使用已有索引）
+
+// 每本书的子集字体（/bookmarks/<safe>.subset.bin）：分页完成后按 .pgg 的全书码点从当前字体抽取，阅读时整体载入 PSRAM
+#define ENABLE_FONT_SUBSET 1   // 设为0关闭后台构建（已有子集仍会挂载）
+#define FONT_SUBSET_MAX_BYTES (2 * 1024 * 1024) // 超过该大小不生成/不挂载
+
+// 字频排列字体（头部布局标志 FONT_LAYOUT_FLAG_FREQUENCY）：流式加载时把常用字位图前缀常驻 PSRAM
+#define ENABLE_FONT_HOT_PREFIX 1
+#define FONT_HOT_PREFIX_MAX_BYTES (1024 * 1024) // 热区上限（生成器标注更小时取标注值）
+
+// 页起点表（PagePositionStore）：加载分页时可用 PSRAM 低于该值，则已封口的块溢出到 SD（/bookmarks/_page_spill_N.pgs）
+#define PAGE_STORE_PSRAM_MIN_FREE (256 * 1024)
+
 // ====== B测试预读窗口开关 ======
 // 用于对比有无预读窗口的性能差异
 #define ENABLE_PREREAD_WINDOW_IN_B_TEST 0  // 设为1使用预读窗口，设为0使用直接读r
@@ -4,55 +4,87 @@
 #include <SPIFFS.h>
 
 // Helper to add common CORS headers for JSON endpoints
-static inline void add_cors_headers(WebServer& server) {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS, DELETE");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type, X-Requested-With");
+static inline void add_cors_headers(HttpResponse& res) {
+    res.setHeader("Access-Control-Allow-Origin", "*");
+    res.setHeader("Access-Control-Allow-Methods", "GET, POST, PUT, OPTIONS, DELETE");
+    res.setHeader("Access-Control-Allow-Headers", "Content-Type, X-Requested-With, Range");
+    res.setHeader("Access-Control-Expose-Headers", "Content-Range, Accept-Ranges");
 }
 
-void ApiRouter::registerRoutes(WebServer& server, WiFiHotspotManager& mgr) {
+// OPTIONS 预检：只回 CORS 头
+static void on_preflight(HttpRequest&, HttpResponse& res) {
+    add_cors_headers(res);
+    res.send(204);
+}
+
+void ApiRouter::registerRoutes(HttpServerCore& server, WiFiHotspotManager& mgr) {
     // Root (可选)：仍可返回内置/模板页面，便于本地调试
-    server.on("/", [&](){ mgr.handleRoot(); });
+    server.on("/", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ mgr.handleRoot(req, res); });
 
     // 文件列表（保持与前端兼容的路径）
-    server.on("/list", [&](){ add_cors_headers(server); mgr.handleFileList(""); });
-    server.on("/list/book", [&](){ add_cors_headers(server); mgr.handleFileList("book"); });
-    server.on("/list/font", [&](){ add_cors_headers(server); mgr.handleFileList("font"); });
-    server.on("/list/image", [&](){ add_cors_headers(server); mgr.handleFileList("image"); });
-    server.on("/list/screenshot", [&](){ add_cors_headers(server); mgr.handleFileList("screenshot"); });
+    server.on("/list", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleFileList(req, res, ""); });
+    server.on("/list/book", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleFileList(req, res, "book"); });
+    server.on("/list/font", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleFileList(req, res, "font"); });
+    server.on("/list/image", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleFileList(req, res, "image"); });
+    server.on("/list/screenshot", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleFileList(req, res, "screenshot"); });
 
     // OPTIONS 预检支持（Chrome 扩展场景下某些 fetch 可能触发）
-    server.on("/list", HTTP_OPTIONS, [&](){ add_cors_headers(server); server.send(204); });
-    server.on("/list/book", HTTP_OPTIONS, [&](){ add_cors_headers(server); server.send(204); });
-    server.on("/list/font", HTTP_OPTIONS, [&](){ add_cors_headers(server); server.send(204); });
-    server.on("/list/image", HTTP_OPTIONS, [&](){ add_cors_headers(server); server.send(204); });
-    server.on("/list/screenshot", HTTP_OPTIONS, [&](){ add_cors_headers(server); server.send(204); });
-
-    // 上传：GET 提示、POST 实际上传（回调在 mgr.handleFileUploadPost 中完成响应）
-    server.on("/upload", HTTP_GET, [&](){
-        add_cors_headers(server);
-        mgr.handleFileUpload();
+    server.on("/list", HTTP_M_OPTIONS, on_preflight);
+    server.on("/list/book", HTTP_M_OPTIONS, on_preflight);
+    server.on("/list/font", HTTP_M_OPTIONS, on_preflight);
+    server.on("/list/image", HTTP_M_OPTIONS, on_preflight);
+    server.on("/list/screenshot", HTTP_M_OPTIONS, on_preflight);
+
+    // 上传：GET 提示、POST 实际上传（数据块在上传回调中流式写入，结束后由完成回调应答）
+    server.on("/upload", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){
+        add_cors_headers(res);
+        mgr.handleFileUpload(req, res);
     });
-    server.on("/upload", HTTP_POST,
-        [](){ /* 响应在上传回调中发送 */ },
-        [&](){ mgr.handleFileUploadPost(); }
+    server.on("/upload", HTTP_M_POST,
+        [&mgr](HttpRequest& req, HttpResponse& res){ mgr.handleFileUploadDone(req, res); },
+        [&mgr](HttpRequest& req, HttpResponse& res, HttpUpload& upload){ mgr.handleFileUploadPost(req, res, upload); }
     );
 
     // 允许跨域预检
-    server.on("/upload", HTTP_OPTIONS, [&](){
-        add_cors_headers(server);
-        server.send(204);
-    });
+    server.on("/upload", HTTP_M_OPTIONS, on_preflight);
+
+    // 断点续传上传：init 取得上传 ID 与已确认偏移 -> 逐块 PUT（带 CRC32）-> commit
+    server.on("/upload/init", HTTP_M_POST, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleUploadInit(req, res); });
+    server.on("/upload/status", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleUploadStatus(req, res); });
+    server.on("/upload/chunk", HTTP_M_PUT | HTTP_M_POST,
+        [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleUploadChunkDone(req, res); },
+        [&mgr](HttpRequest& req, HttpResponse& res, HttpUpload& upload){
+            if (upload.status == HTTP_UPLOAD_START) add_cors_headers(res);
+            mgr.handleUploadChunk(req, res, upload);
+        }
+    );
+    server.on("/upload/commit", HTTP_M_POST, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleUploadCommit(req, res); });
+    server.on("/upload/abort", HTTP_M_POST | HTTP_M_DELETE, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleUploadAbort(req, res); });
+    server.on("/upload/init", HTTP_M_OPTIONS, on_preflight);
+    server.on("/upload/status", HTTP_M_OPTIONS, on_preflight);
+    server.on("/upload/chunk", HTTP_M_OPTIONS, on_preflight);
+    server.on("/upload/commit", HTTP_M_OPTIONS, on_preflight);
+    server.on("/upload/abort", HTTP_M_OPTIONS, on_preflight);
+
+    // 书库同步：POST 清单（每行 大小\tCRC32\t文件名），返回设备上缺失/不同/待比对的文件名
+    server.on("/sync", HTTP_M_POST,
+        [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleSyncDone(req, res); },
+        [&mgr](HttpRequest& req, HttpResponse& res, HttpUpload& upload){
+            if (upload.status == HTTP_UPLOAD_START) add_cors_headers(res);
+            mgr.handleSync(req, res, upload);
+        }
+    );
+    server.on("/sync", HTTP_M_OPTIONS, on_preflight);
 
     // 删除与下载
-    server.on("/delete", [&](){ add_cors_headers(server); mgr.handleFileDelete(); });
-    server.on("/delete", HTTP_OPTIONS, [&](){ add_cors_headers(server); server.send(204); });
-    server.on("/download", [&](){ add_cors_headers(server); mgr.handleFileDownload(); });
-    server.on("/download", HTTP_OPTIONS, [&](){ add_cors_headers(server); server.send(204); });
+    server.on("/delete", HTTP_M_GET | HTTP_M_POST | HTTP_M_DELETE, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleFileDelete(req, res); });
+    server.on("/delete", HTTP_M_OPTIONS, on_preflight);
+    server.on("/download", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){ add_cors_headers(res); mgr.handleFileDownload(req, res); });
+    server.on("/download", HTTP_M_OPTIONS, on_preflight);
 
     // 同步时间：独立实现（保持原逻辑），返回文本但带上 CORS 允许跨域
-    server.on("/sync_time", HTTP_POST, [&](){
-        String body = server.arg("plain");
+    server.on("/sync_time", HTTP_M_POST, [](HttpRequest& req, HttpResponse& res){
+        String body = req.body.c_str();
 
         // try to extract a numeric timestamp
         long long ts = 0;
@@ -83,7 +115,7 @@ void ApiRouter::registerRoutes(WebServer& server, WiFiHotspotManager& mgr) {
             }
         }
 
-    add_cors_headers(server);
+        add_cors_headers(res);
 
         if (ts > 0) {
             struct timeval tv; tv.tv_sec = (time_t)ts; tv.tv_usec = 0; settimeofday(&tv, nullptr);
@@ -97,20 +129,17 @@ void ApiRouter::registerRoutes(WebServer& server, WiFiHotspotManager& mgr) {
 
             time_t now = tv.tv_sec; struct tm local_tm; localtime_r(&now, &local_tm);
             char local_buf[64]; strftime(local_buf, sizeof(local_buf), "%Y-%m-%d %H:%M:%S LOCAL", &local_tm);
-            server.send(200, "text/plain", String("Time synced: ") + String(ts) + " (" + String(local_buf) + ")");
+            res.send(200, "text/plain", (String("Time synced: ") + String(ts) + " (" + String(local_buf) + ")").c_str());
         } else {
-            server.send(400, "text/plain", "Invalid timestamp");
+            res.send(400, "text/plain", "Invalid timestamp");
         }
     });
 
-    server.on("/sync_time", HTTP_OPTIONS, [&](){
-        add_cors_headers(server);
-        server.send(204);
-    });
+    server.on("/sync_time", HTTP_M_OPTIONS, on_preflight);
 
     // Heartbeat endpoint for frontend health checks
-    server.on("/heartbeat", HTTP_GET, [&](){
-        add_cors_headers(server);
+    server.on("/heartbeat", HTTP_M_GET, [](HttpRequest&, HttpResponse& res){
+        add_cors_headers(res);
 
         // Default values for webapp when /version is missing or unreadable
         String hw = "M5Stack PaperS3";
@@ -136,22 +165,32 @@ void ApiRouter::registerRoutes(WebServer& server, WiFiHotspotManager& mgr) {
         }
 
         String payload = String("{\"status\":\"ok\",\"hw\":\"") + hw + String("\",\"firmware\":\"") + firmware + String("\",\"version\":\"") + version + String("\"}");
-        server.send(200, "application/json", payload);
+        res.send(200, "application/json", payload.c_str());
     });
 
-    server.on("/heartbeat", HTTP_OPTIONS, [&](){
-        add_cors_headers(server);
-        server.send(204);
-    });
+    server.on("/heartbeat", HTTP_M_OPTIONS, on_preflight);
 
     // Reading records API endpoint
-    server.on("/api/reading_records", HTTP_GET, [&](){
-        add_cors_headers(server);
-        mgr.handleReadingRecords();
+    server.on("/api/reading_records", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){
+        add_cors_headers(res);
+        mgr.handleReadingRecords(req, res);
     });
 
-    server.on("/api/reading_records", HTTP_OPTIONS, [&](){
-        add_cors_headers(server);
-        server.send(204);
+    server.on("/api/reading_records", HTTP_M_OPTIONS, on_preflight);
+
+    // Transfer statistics: HTTP core counters and SD write pipeline throughput/stalls
+    server.on("/api/transfer_status", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){
+        add_cors_headers(res);
+        mgr.handleTransferStatus(req, res);
     });
+
+    server.on("/api/transfer_status", HTTP_M_OPTIONS, on_preflight);
+
+    // In-book search over the currently opened book (.sidx index)
+    server.on("/api/search", HTTP_M_GET, [&mgr](HttpRequest& req, HttpResponse& res){
+        add_cors_headers(res);
+        mgr.handleSearch(req, res);
+    });
+
+    server.on("/api/search", HTTP_M_OPTIONS, on_preflight);
 }
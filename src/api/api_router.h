@@ -1,21 +1,23 @@
 #pragma once
 
-#include <WebServer.h>
+#include "api/http_core.h"
 
 class WiFiHotspotManager;
 
 /**
  * ApiRouter
- * 负责将对外提供的 HTTP API 端点挂载到给定的 WebServer。
+ * 负责将对外提供的 HTTP API 端点挂载到给定的 HttpServerCore（事件驱动、多连接并发）。
  * 这些端点覆盖 template.html 目前使用的功能：
  * - 列表：/list, /list/book, /list/font, /list/image (JSON 流式响应)
  * - 上传：/upload (GET 引导、POST 实际上传)
  * - 删除：/delete (JSON)
  * - 下载：/download (文件流)
  * - 同步时间：/sync_time (POST JSON)
+ * - 书库同步：/sync (POST 清单，JSON 流式返回差异)
+ * - 书内搜索：/api/search (当前打开的书)
  * 说明：端点路径保持兼容，便于前端复用；实现细节委托给 WiFiHotspotManager 现有私有处理函数。
  */
 class ApiRouter {
 public:
-    static void registerRoutes(WebServer& server, WiFiHotspotManager& mgr);
+    static void registerRoutes(HttpServerCore& server, WiFiHotspotManager& mgr);
 };
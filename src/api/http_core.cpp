@@ -0,0 +1,1452 @@
+#include "http_core.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <chrono>
+
+#if defined(ESP_PLATFORM)
+#include "lwip/sockets.h"
+#include "esp_rom_crc.h"
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const std::string s_empty;
+
+static uint32_t now_ms()
+{
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool would_block()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+static void set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, (flags < 0 ? 0 : flags) | O_NONBLOCK);
+}
+
+static char lower_ascii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool iequals_prefix(const std::string &s, const char *prefix)
+{
+    size_t n = strlen(prefix);
+    if (s.size() < n)
+        return false;
+    for (size_t i = 0; i < n; ++i)
+        if (lower_ascii(s[i]) != lower_ascii(prefix[i]))
+            return false;
+    return true;
+}
+
+static std::string trim(const std::string &s)
+{
+    size_t b = 0, e = s.size();
+    while (b < e && (s[b] == ' ' || s[b] == '\t'))
+        b++;
+    while (e > b && (s[e - 1] == ' ' || s[e - 1] == '\t' || s[e - 1] == '\r'))
+        e--;
+    return s.substr(b, e - b);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static std::string url_decode(const char *s, size_t n, bool plus_is_space)
+{
+    std::string out;
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        char c = s[i];
+        if (c == '%' && i + 2 < n)
+        {
+            int hi = hex_value(s[i + 1]), lo = hex_value(s[i + 2]);
+            if (hi >= 0 && lo >= 0)
+            {
+                out.push_back((char)((hi << 4) | lo));
+                i += 2;
+                continue;
+            }
+        }
+        out.push_back((plus_is_space && c == '+') ? ' ' : c);
+    }
+    return out;
+}
+
+// a=1&b=2 形式（查询串与 urlencoded 表单共用）
+static void parse_form(const std::string &s, HttpKeyValues &out)
+{
+    size_t pos = 0;
+    while (pos < s.size())
+    {
+        size_t amp = s.find('&', pos);
+        if (amp == std::string::npos)
+            amp = s.size();
+        if (amp > pos)
+        {
+            size_t eq = s.find('=', pos);
+            if (eq == std::string::npos || eq > amp)
+                out.emplace_back(url_decode(s.data() + pos, amp - pos, true), std::string());
+            else
+                out.emplace_back(url_decode(s.data() + pos, eq - pos, true),
+                                 url_decode(s.data() + eq + 1, amp - eq - 1, true));
+        }
+        pos = amp + 1;
+    }
+}
+
+// Content-Type / Content-Disposition 的 ;key=value 参数（值可带引号）
+static std::string header_param(const std::string &value, const char *key)
+{
+    size_t pos = value.find(';');
+    size_t klen = strlen(key);
+    while (pos != std::string::npos)
+    {
+        size_t next = value.find(';', pos + 1);
+        std::string part = trim(value.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1));
+        if (part.size() > klen && part[klen] == '=' && iequals_prefix(part, key))
+        {
+            std::string v = part.substr(klen + 1);
+            if (v.size() >= 2 && v.front() == '"' && v.back() == '"')
+                v = v.substr(1, v.size() - 2);
+            return v;
+        }
+        pos = next;
+    }
+    return std::string();
+}
+
+const char *http_method_name(uint8_t method)
+{
+    switch (method)
+    {
+    case HTTP_M_GET: return "GET";
+    case HTTP_M_POST: return "POST";
+    case HTTP_M_PUT: return "PUT";
+    case HTTP_M_DELETE: return "DELETE";
+    case HTTP_M_OPTIONS: return "OPTIONS";
+    case HTTP_M_HEAD: return "HEAD";
+    default: return "?";
+    }
+}
+
+const char *http_status_text(int status)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 416: return "Range Not Satisfiable";
+    case 422: return "Unprocessable Entity";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 507: return "Insufficient Storage";
+    default: return "";
+    }
+}
+
+static uint8_t parse_method(const std::string &m)
+{
+    if (m == "GET") return HTTP_M_GET;
+    if (m == "POST") return HTTP_M_POST;
+    if (m == "PUT") return HTTP_M_PUT;
+    if (m == "DELETE") return HTTP_M_DELETE;
+    if (m == "OPTIONS") return HTTP_M_OPTIONS;
+    if (m == "HEAD") return HTTP_M_HEAD;
+    return 0;
+}
+
+static bool parse_uint64(const std::string &s, size_t b, size_t e, int64_t *out)
+{
+    if (b >= e || e - b > 18)
+        return false;
+    int64_t v = 0;
+    for (size_t i = b; i < e; ++i)
+    {
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    *out = v;
+    return true;
+}
+
+int http_parse_range(const std::string &value, int64_t size, int64_t *first, int64_t *last)
+{
+    std::string v = trim(value);
+    if (!iequals_prefix(v, "bytes="))
+        return 0;
+    size_t b = 6, e = v.size();
+    while (b < e && v[b] == ' ')
+        b++;
+    // 多段区间需要 multipart/byteranges，这里按规范退回整份响应
+    if (v.find(',', b) != std::string::npos)
+        return 0;
+    size_t dash = v.find('-', b);
+    if (dash == std::string::npos)
+        return 0;
+
+    int64_t a = 0, z = 0;
+    if (dash == b)
+    {
+        // 后缀区间：最后 n 个字节
+        if (!parse_uint64(v, dash + 1, e, &z))
+            return 0;
+        if (z == 0 || size <= 0)
+            return -1;
+        *first = z >= size ? 0 : size - z;
+        *last = size - 1;
+        return 1;
+    }
+    if (!parse_uint64(v, b, dash, &a))
+        return 0;
+    if (dash + 1 == e)
+        z = size - 1;
+    else if (!parse_uint64(v, dash + 1, e, &z) || z < a)
+        return 0;
+    if (a >= size)
+        return -1;
+    *first = a;
+    *last = z >= size ? size - 1 : z;
+    return 1;
+}
+
+uint32_t http_crc32(uint32_t crc, const uint8_t *buf, size_t len)
+{
+#if defined(ESP_PLATFORM)
+    // ROM 实现：内部做首尾取反，链式调用与 zlib 一致
+    return esp_rom_crc32_le(crc, buf, len);
+#else
+    static uint32_t table[256];
+    static bool ready = false;
+    if (!ready)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        ready = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// HttpRequest / HttpResponse
+
+const std::string &HttpRequest::arg(const char *name) const
+{
+    for (const auto &kv : args)
+        if (kv.first == name)
+            return kv.second;
+    return s_empty;
+}
+
+bool HttpRequest::hasArg(const char *name) const
+{
+    for (const auto &kv : args)
+        if (kv.first == name)
+            return true;
+    return false;
+}
+
+const std::string &HttpRequest::header(const char *lower_name) const
+{
+    for (const auto &kv : headers)
+        if (kv.first == lower_name)
+            return kv.second;
+    return s_empty;
+}
+
+int HttpStringSource::read(uint8_t *buf, size_t cap)
+{
+    size_t n = data_.size() - pos_;
+    if (n > cap)
+        n = cap;
+    memcpy(buf, data_.data() + pos_, n);
+    pos_ += n;
+    return (int)n;
+}
+
+void HttpResponse::setHeader(const std::string &name, const std::string &value)
+{
+    for (auto &kv : headers_)
+    {
+        if (kv.first == name)
+        {
+            kv.second = value;
+            return;
+        }
+    }
+    headers_.emplace_back(name, value);
+}
+
+void HttpResponse::send(int status, const char *content_type, std::string body)
+{
+    if (sent())
+        return;
+    status_ = status;
+    content_type_ = content_type ? content_type : "";
+    length_ = (int64_t)body.size();
+    if (!body.empty())
+        source_.reset(new HttpStringSource(std::move(body)));
+}
+
+void HttpResponse::stream(int status, const char *content_type, std::unique_ptr<HttpBodySource> source, int64_t length)
+{
+    if (sent())
+        return;
+    status_ = status;
+    content_type_ = content_type ? content_type : "";
+    source_ = std::move(source);
+    length_ = source_ ? length : 0;
+}
+
+void HttpResponse::reset()
+{
+    status_ = 0;
+    content_type_.clear();
+    headers_.clear();
+    source_.reset();
+    length_ = 0;
+    close_ = false;
+}
+
+// ---------------------------------------------------------------------------
+// multipart/form-data 流式解析
+// 分隔符统一按 "\r\n--boundary" 匹配（起始处预置 "\r\n"），匹配用单字节状态推进：
+// 分隔符只有首字节是 '\r'，失配时已匹配部分原样作为数据输出即可，数据段直接指向接收缓冲区上报。
+
+class HttpServerCore::Multipart
+{
+public:
+    Multipart(const std::string &boundary, const HttpUploadHandler *handler, HttpRequest *req, HttpResponse *res)
+        : delim_("\r\n--" + boundary), handler_(handler), req_(req), res_(res)
+    {
+        match_ = 2; // 请求体以 "--boundary" 开头，视为前面已有 "\r\n"
+        upload_.contentLength = req->content_length;
+    }
+
+    void feed(const uint8_t *data, size_t len);
+    void abort();
+    bool done() const { return state_ == MP_DONE; }
+    bool failed() const { return state_ == MP_ERROR; }
+
+private:
+    enum State : uint8_t { MP_PREAMBLE, MP_AFTER_DELIM, MP_HEADERS, MP_DATA, MP_DONE, MP_ERROR };
+
+    size_t scan(const uint8_t *data, size_t len, size_t i);
+    void emit(const uint8_t *p, size_t n);
+    void startPart();
+    void endPart();
+    void dispatch(HttpUploadStatus status, const uint8_t *buf = nullptr, size_t n = 0);
+
+    std::string delim_;
+    const HttpUploadHandler *handler_;
+    HttpRequest *req_;
+    HttpResponse *res_;
+    State state_ = MP_PREAMBLE;
+    size_t match_ = 0;
+    char tail_[2];
+    uint8_t tail_len_ = 0;
+    std::string part_headers_;
+    bool part_is_file_ = false;
+    std::string field_value_;
+    HttpUpload upload_;
+};
+
+void HttpServerCore::Multipart::dispatch(HttpUploadStatus status, const uint8_t *buf, size_t n)
+{
+    upload_.status = status;
+    upload_.buf = buf;
+    upload_.currentSize = n;
+    if (status == HTTP_UPLOAD_WRITE)
+        upload_.totalSize += n;
+    if (*handler_)
+        (*handler_)(*req_, *res_, upload_);
+}
+
+void HttpServerCore::Multipart::feed(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && state_ != MP_DONE && state_ != MP_ERROR && !res_->sent())
+    {
+        switch (state_)
+        {
+        case MP_PREAMBLE:
+        case MP_DATA:
+            i = scan(data, len, i);
+            break;
+        case MP_AFTER_DELIM:
+            tail_[tail_len_++] = (char)data[i++];
+            if (tail_len_ == 2)
+            {
+                if (tail_[0] == '-' && tail_[1] == '-')
+                    state_ = MP_DONE;
+                else if (tail_[0] == '\r' && tail_[1] == '\n')
+                {
+                    state_ = MP_HEADERS;
+                    part_headers_.clear();
+                }
+                else
+                    state_ = MP_ERROR;
+            }
+            break;
+        case MP_HEADERS:
+            part_headers_.push_back((char)data[i++]);
+            if (part_headers_.size() >= 4 && part_headers_.compare(part_headers_.size() - 4, 4, "\r\n\r\n") == 0)
+                startPart();
+            else if (part_headers_.size() > 2048)
+                state_ = MP_ERROR;
+            break;
+        default:
+            i = len;
+            break;
+        }
+    }
+}
+
+size_t HttpServerCore::Multipart::scan(const uint8_t *data, size_t len, size_t i)
+{
+    size_t run = i;            // 待输出数据的起点
+    size_t match_at = 0;       // 本块内候选分隔符的起点
+    size_t held = match_;      // 上一块末尾暂存（尚未输出）的已匹配字节
+    while (i < len)
+    {
+        if (data[i] == (uint8_t)delim_[match_])
+        {
+            if (match_ == 0)
+                match_at = i;
+            match_++;
+            i++;
+            if (match_ == delim_.size())
+            {
+                // held > 0 时分隔符从上一块开始，本块在它之前没有数据
+                if (held == 0)
+                    emit(data + run, match_at - run);
+                match_ = 0;
+                if (state_ == MP_DATA)
+                    endPart();
+                state_ = MP_AFTER_DELIM;
+                tail_len_ = 0;
+                return i;
+            }
+            continue;
+        }
+        if (match_ > 0)
+        {
+            // 失配：已匹配部分是普通数据；当前字节按分隔符首字节重新检查
+            if (held > 0)
+            {
+                emit(reinterpret_cast<const uint8_t *>(delim_.data()), held);
+                held = 0;
+            }
+            match_ = 0;
+            continue;
+        }
+        i++;
+    }
+    if (match_ == 0)
+        emit(data + run, len - run);
+    else if (held == 0)
+        emit(data + run, match_at - run); // 块尾的部分匹配暂存，等下一块确认
+    return len;
+}
+
+void HttpServerCore::Multipart::emit(const uint8_t *p, size_t n)
+{
+    if (n == 0 || state_ != MP_DATA)
+        return; // 前导区（preamble）直接丢弃
+    if (part_is_file_)
+    {
+        if (!res_->sent())
+            dispatch(HTTP_UPLOAD_WRITE, p, n);
+    }
+    else if (field_value_.size() + n <= 4096)
+    {
+        field_value_.append(reinterpret_cast<const char *>(p), n);
+    }
+}
+
+void HttpServerCore::Multipart::startPart()
+{
+    std::string disposition, type;
+    size_t pos = 0;
+    while (pos < part_headers_.size())
+    {
+        size_t eol = part_headers_.find("\r\n", pos);
+        if (eol == std::string::npos)
+            eol = part_headers_.size();
+        std::string line = part_headers_.substr(pos, eol - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos)
+        {
+            std::string name = line.substr(0, colon);
+            if (iequals_prefix(name, "content-disposition") && name.size() == 19)
+                disposition = trim(line.substr(colon + 1));
+            else if (iequals_prefix(name, "content-type") && name.size() == 12)
+                type = trim(line.substr(colon + 1));
+        }
+        pos = eol + 2;
+    }
+    upload_.name = header_param(disposition, "name");
+    upload_.type = type;
+    part_is_file_ = disposition.find("filename=") != std::string::npos;
+    field_value_.clear();
+    state_ = MP_DATA;
+    if (part_is_file_)
+    {
+        upload_.filename = header_param(disposition, "filename");
+        upload_.totalSize = 0;
+        dispatch(HTTP_UPLOAD_START);
+    }
+}
+
+void HttpServerCore::Multipart::endPart()
+{
+    if (part_is_file_)
+    {
+        part_is_file_ = false;
+        if (!res_->sent())
+            dispatch(HTTP_UPLOAD_END);
+    }
+    else if (!upload_.name.empty())
+    {
+        req_->args.emplace_back(upload_.name, field_value_);
+    }
+    field_value_.clear();
+}
+
+void HttpServerCore::Multipart::abort()
+{
+    if (part_is_file_)
+    {
+        part_is_file_ = false;
+        dispatch(HTTP_UPLOAD_ABORTED);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// 连接
+
+enum ConnState : uint8_t
+{
+    CONN_FREE,
+    CONN_READ_HEAD,
+    CONN_READ_BODY,
+    CONN_SEND,
+    CONN_LINGER,
+};
+
+struct HttpServerCore::Conn
+{
+    int id = 0;                   // 连接池槽位
+    int fd = -1;
+    ConnState state = CONN_FREE;
+    uint32_t last_ms = 0;
+    bool idle = true;             // 等待新请求（使用 keep-alive 空闲超时）
+
+    char *head = nullptr;         // 请求头缓冲（也暂存流水线中的下一条请求）
+    size_t head_len = 0;
+    uint8_t *io = nullptr;        // 请求体接收 / 响应发送缓冲
+    size_t out_pos = 0, out_len = 0;
+
+    HttpRequest req;
+    HttpResponse res;
+    Route *route = nullptr;
+    int64_t body_left = 0;
+    std::unique_ptr<Multipart> multipart;
+    bool raw_upload = false;      // 非 multipart 请求体交给上传回调
+    bool raw_open = false;
+    HttpUpload raw;
+
+    int64_t send_left = 0;        // 定长响应剩余字节
+    bool body_pending = false;    // 数据源上次返回 HTTP_BODY_PENDING：下一轮 poll 再拉取，不等可写
+    bool chunked = false;
+    bool body_done = false;       // 响应体已全部进入发送缓冲
+    bool keep_alive = false;
+    bool linger = false;          // 发送完后半关闭并丢弃剩余请求体
+};
+
+HttpServerCore::HttpServerCore() {}
+
+HttpServerCore::~HttpServerCore()
+{
+    end();
+}
+
+void HttpServerCore::on(const char *path, uint8_t methods, HttpHandler handler, HttpUploadHandler upload)
+{
+    Route r;
+    r.path = path;
+    r.methods = methods;
+    r.handler = std::move(handler);
+    r.upload = std::move(upload);
+    routes_.push_back(std::move(r));
+}
+
+void HttpServerCore::onNotFound(HttpHandler handler)
+{
+    not_found_ = std::move(handler);
+}
+
+HttpServerCore::Route *HttpServerCore::findRoute(const std::string &path, uint8_t method, bool *path_known)
+{
+    *path_known = false;
+    for (auto &r : routes_)
+    {
+        if (r.path != path)
+            continue;
+        *path_known = true;
+        // HEAD 复用 GET 路由（prepareResponse 中丢弃正文）
+        if (r.methods & (method == HTTP_M_HEAD ? (HTTP_M_HEAD | HTTP_M_GET) : method))
+            return &r;
+    }
+    return nullptr;
+}
+
+bool HttpServerCore::begin(const Config &config)
+{
+    end();
+    config_ = config;
+    if (config_.max_connections == 0)
+        config_.max_connections = 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(config_.port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, config_.max_connections) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    socklen_t alen = sizeof(addr);
+    bound_port_ = config_.port;
+    if (getsockname(fd, (struct sockaddr *)&addr, &alen) == 0)
+        bound_port_ = ntohs(addr.sin_port);
+    set_nonblocking(fd);
+
+    conns_ = new Conn[config_.max_connections];
+    for (uint8_t i = 0; i < config_.max_connections; ++i)
+    {
+        size_t bytes = config_.header_buffer + config_.io_buffer;
+        void *mem = config_.alloc ? config_.alloc(bytes) : malloc(bytes);
+        if (!mem)
+        {
+            listen_fd_ = fd;
+            end();
+            return false;
+        }
+        conns_[i].id = i;
+        conns_[i].head = static_cast<char *>(mem);
+        conns_[i].io = reinterpret_cast<uint8_t *>(conns_[i].head + config_.header_buffer);
+    }
+    listen_fd_ = fd;
+    stats_ = Stats();
+    return true;
+}
+
+void HttpServerCore::end()
+{
+    if (conns_)
+    {
+        for (uint8_t i = 0; i < config_.max_connections; ++i)
+        {
+            Conn &c = conns_[i];
+            if (c.fd >= 0)
+                closeConn(c);
+            if (c.head)
+            {
+                if (config_.release)
+                    config_.release(c.head);
+                else
+                    free(c.head);
+            }
+        }
+        delete[] conns_;
+        conns_ = nullptr;
+    }
+    if (listen_fd_ >= 0)
+    {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+void HttpServerCore::abortUpload(Conn &c)
+{
+    if (c.state != CONN_READ_BODY)
+        return;
+    if (c.multipart)
+        c.multipart->abort();
+    if (c.raw_upload && c.raw_open)
+    {
+        c.raw_open = false;
+        c.raw.status = HTTP_UPLOAD_ABORTED;
+        c.raw.buf = nullptr;
+        c.raw.currentSize = 0;
+        c.route->upload(c.req, c.res, c.raw);
+    }
+}
+
+void HttpServerCore::closeConn(Conn &c)
+{
+    abortUpload(c);
+    if (c.fd >= 0)
+    {
+        close(c.fd);
+        if (stats_.active > 0)
+            stats_.active--;
+    }
+    c.fd = -1;
+    c.state = CONN_FREE;
+    c.head_len = 0;
+    c.req = HttpRequest();
+    c.res.reset();
+    c.multipart.reset();
+    c.route = nullptr;
+}
+
+void HttpServerCore::resetForNextRequest(Conn &c)
+{
+    c.state = CONN_READ_HEAD;
+    c.idle = true;
+    c.req = HttpRequest();
+    c.res.reset();
+    c.multipart.reset();
+    c.route = nullptr;
+    c.body_left = 0;
+    c.raw_upload = false;
+    c.raw_open = false;
+    c.out_pos = c.out_len = 0;
+    c.linger = false;
+}
+
+void HttpServerCore::acceptClients()
+{
+    for (;;)
+    {
+        Conn *slot = nullptr;
+        for (uint8_t i = 0; i < config_.max_connections; ++i)
+        {
+            if (conns_[i].state == CONN_FREE)
+            {
+                slot = &conns_[i];
+                break;
+            }
+        }
+        if (!slot)
+            return; // 连接池已满：留在 backlog 中，等有空槽再 accept
+
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+        int fd = accept(listen_fd_, (struct sockaddr *)&peer, &plen);
+        if (fd < 0)
+            return;
+        set_nonblocking(fd);
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        slot->fd = fd;
+        slot->head_len = 0;
+        resetForNextRequest(*slot);
+        slot->last_ms = now_ms();
+        stats_.accepted++;
+        stats_.active++;
+        if (stats_.active > stats_.peak_active)
+            stats_.peak_active = stats_.active;
+    }
+}
+
+bool HttpServerCore::parseHead(Conn &c, size_t head_end)
+{
+    HttpRequest &req = c.req;
+    req = HttpRequest();
+    req.conn_id = c.id;
+
+    const char *p = c.head;
+    const char *end = c.head + head_end;
+    const char *eol = strstr(p, "\r\n");
+    if (!eol || eol > end)
+        return false;
+
+    // 请求行：METHOD SP target SP HTTP/1.x
+    std::string line(p, eol - p);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1)
+        return false;
+    std::string method = line.substr(0, sp1);
+    std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::string version = line.substr(sp2 + 1);
+    req.method = parse_method(method);
+    req.keep_alive = (version == "HTTP/1.1");
+
+    size_t q = target.find('?');
+    std::string raw_path = target.substr(0, q);
+    req.path = url_decode(raw_path.data(), raw_path.size(), false);
+    if (q != std::string::npos)
+    {
+        req.query = target.substr(q + 1);
+        parse_form(req.query, req.args);
+    }
+
+    p = eol + 2;
+    while (p < end)
+    {
+        eol = strstr(p, "\r\n");
+        if (!eol || eol == p || eol > end)
+            break;
+        const char *colon = (const char *)memchr(p, ':', eol - p);
+        if (colon)
+        {
+            std::string name(p, colon - p);
+            for (char &ch : name)
+                ch = lower_ascii(ch);
+            req.headers.emplace_back(name, trim(std::string(colon + 1, eol - colon - 1)));
+        }
+        p = eol + 2;
+    }
+
+    const std::string &conn_hdr = req.header("connection");
+    if (iequals_prefix(conn_hdr, "close"))
+        req.keep_alive = false;
+    else if (iequals_prefix(conn_hdr, "keep-alive"))
+        req.keep_alive = true;
+
+    const std::string &cl = req.header("content-length");
+    if (!cl.empty())
+    {
+        char *endp = nullptr;
+        long long v = strtoll(cl.c_str(), &endp, 10);
+        if (v < 0 || (endp && *endp))
+            return false;
+        req.content_length = v;
+    }
+    return true;
+}
+
+void HttpServerCore::processHead(Conn &c)
+{
+    while (c.state == CONN_READ_HEAD && c.head_len > 0)
+    {
+        c.head[c.head_len < config_.header_buffer ? c.head_len : config_.header_buffer - 1] = '\0';
+        char *term = nullptr;
+        for (size_t i = 0; i + 3 < c.head_len; ++i)
+        {
+            if (c.head[i] == '\r' && c.head[i + 1] == '\n' && c.head[i + 2] == '\r' && c.head[i + 3] == '\n')
+            {
+                term = c.head + i;
+                break;
+            }
+        }
+        if (!term)
+        {
+            if (c.head_len >= config_.header_buffer - 1)
+            {
+                c.res.send(431, "text/plain", "Request header too large");
+                c.res.closeAfter();
+                c.head_len = 0;
+                prepareResponse(c);
+            }
+            return;
+        }
+
+        size_t head_end = (size_t)(term - c.head) + 4;
+        c.idle = false;
+        stats_.requests++;
+        if (!parseHead(c, head_end))
+        {
+            c.res.send(400, "text/plain", "Bad request");
+            c.res.closeAfter();
+            c.head_len = 0;
+            prepareResponse(c);
+            return;
+        }
+
+        // 请求头之后已收到的字节：先用作请求体，其余留给下一条请求
+        size_t extra = c.head_len - head_end;
+        memmove(c.head, c.head + head_end, extra);
+        c.head_len = extra;
+
+        beginBody(c);
+        if (c.state == CONN_READ_BODY && c.head_len > 0)
+        {
+            size_t n = c.head_len;
+            if ((int64_t)n > c.body_left)
+                n = (size_t)c.body_left;
+            // 请求体可能交给回调直接引用，先挪到 io 缓冲区
+            memcpy(c.io, c.head, n);
+            memmove(c.head, c.head + n, c.head_len - n);
+            c.head_len -= n;
+            feedBody(c, c.io, n);
+        }
+    }
+}
+
+void HttpServerCore::beginBody(Conn &c)
+{
+    HttpRequest &req = c.req;
+    if (req.method == 0)
+    {
+        c.res.send(501, "text/plain", "Method not implemented");
+        c.res.closeAfter();
+        prepareResponse(c);
+        return;
+    }
+    const std::string &te = req.header("transfer-encoding");
+    if (!te.empty() && !iequals_prefix(te, "identity"))
+    {
+        // 分块请求体暂不支持（浏览器上传均带 Content-Length）
+        c.res.send(411, "text/plain", "Length required");
+        c.res.closeAfter();
+        prepareResponse(c);
+        return;
+    }
+
+    bool path_known = false;
+    c.route = findRoute(req.path, req.method, &path_known);
+    if (!c.route && path_known)
+    {
+        c.res.send(405, "text/plain", "Method not allowed");
+    }
+
+    c.body_left = req.content_length > 0 ? req.content_length : 0;
+    c.multipart.reset();
+    c.raw_upload = false;
+    c.raw_open = false;
+
+    if (c.route && c.route->upload && c.body_left > 0)
+    {
+        const std::string &ct = req.header("content-type");
+        if (iequals_prefix(ct, "multipart/form-data"))
+        {
+            std::string boundary = header_param(ct, "boundary");
+            if (boundary.empty() || boundary.size() > 70 || boundary.find_first_of("\r\n") != std::string::npos)
+            {
+                c.res.send(400, "text/plain", "Bad multipart boundary");
+            }
+            else
+            {
+                c.multipart.reset(new Multipart(boundary, &c.route->upload, &c.req, &c.res));
+            }
+        }
+        else
+        {
+            c.raw_upload = true;
+            c.raw = HttpUpload();
+            c.raw.type = ct;
+            c.raw.contentLength = req.content_length;
+        }
+    }
+    else if (c.body_left > (int64_t)config_.max_inline_body)
+    {
+        c.res.send(413, "text/plain", "Payload too large");
+    }
+    else if (c.body_left > 0)
+    {
+        req.body.reserve((size_t)c.body_left);
+    }
+
+    c.state = CONN_READ_BODY;
+    c.last_ms = now_ms();
+    if (c.res.sent() && c.body_left > 0)
+    {
+        // 已提前应答：不再读取请求体，发完后半关闭并丢弃剩余数据
+        c.res.closeAfter();
+        prepareResponse(c);
+        return;
+    }
+    if (c.body_left == 0)
+        finishRequest(c);
+}
+
+void HttpServerCore::feedBody(Conn &c, const uint8_t *data, size_t len)
+{
+    stats_.bytes_in += len;
+    c.body_left -= (int64_t)len;
+
+    if (c.multipart)
+    {
+        c.multipart->feed(data, len);
+        if (c.multipart->failed() && !c.res.sent())
+            c.res.send(400, "text/plain", "Malformed multipart body");
+    }
+    else if (c.raw_upload)
+    {
+        if (!c.raw_open)
+        {
+            c.raw_open = true;
+            c.raw.status = HTTP_UPLOAD_START;
+            c.raw.buf = nullptr;
+            c.raw.currentSize = 0;
+            c.route->upload(c.req, c.res, c.raw);
+        }
+        if (!c.res.sent())
+        {
+            c.raw.status = HTTP_UPLOAD_WRITE;
+            c.raw.buf = data;
+            c.raw.currentSize = len;
+            c.raw.totalSize += len;
+            c.route->upload(c.req, c.res, c.raw);
+        }
+    }
+    else if (!c.res.sent())
+    {
+        c.req.body.append(reinterpret_cast<const char *>(data), len);
+    }
+
+    if (c.res.sent() && c.body_left > 0)
+    {
+        abortUpload(c);
+        c.res.closeAfter();
+        prepareResponse(c);
+        return;
+    }
+    if (c.body_left <= 0)
+        finishRequest(c);
+}
+
+void HttpServerCore::finishRequest(Conn &c)
+{
+    HttpRequest &req = c.req;
+    if (c.multipart)
+    {
+        if (!c.multipart->done())
+        {
+            c.multipart->abort();
+            if (!c.res.sent())
+                c.res.send(400, "text/plain", "Truncated multipart body");
+        }
+    }
+    else if (c.raw_upload && !c.res.sent())
+    {
+        if (!c.raw_open)
+        {
+            c.raw.status = HTTP_UPLOAD_START;
+            c.route->upload(c.req, c.res, c.raw);
+        }
+        c.raw_open = false;
+        if (!c.res.sent())
+        {
+            c.raw.status = HTTP_UPLOAD_END;
+            c.raw.buf = nullptr;
+            c.raw.currentSize = 0;
+            c.route->upload(c.req, c.res, c.raw);
+        }
+    }
+    else if (!req.body.empty() && iequals_prefix(req.header("content-type"), "application/x-www-form-urlencoded"))
+    {
+        parse_form(req.body, req.args);
+    }
+    c.raw_open = false;
+    c.multipart.reset();
+
+    if (!c.res.sent())
+    {
+        if (c.route)
+        {
+            if (c.route->handler)
+                c.route->handler(req, c.res);
+        }
+        else if (not_found_)
+        {
+            not_found_(req, c.res);
+        }
+        else
+        {
+            c.res.send(404, "text/plain", "Not found");
+        }
+    }
+    if (!c.res.sent())
+        c.res.send(500, "text/plain", "No response");
+    prepareResponse(c);
+}
+
+// 追加响应头，缓冲区不够时返回 false
+static bool append_str(uint8_t *buf, size_t cap, size_t &len, const char *s, size_t n)
+{
+    if (len + n > cap)
+        return false;
+    memcpy(buf + len, s, n);
+    len += n;
+    return true;
+}
+
+static bool append_str(uint8_t *buf, size_t cap, size_t &len, const std::string &s)
+{
+    return append_str(buf, cap, len, s.data(), s.size());
+}
+
+void HttpServerCore::prepareResponse(Conn &c)
+{
+    HttpResponse &res = c.res;
+    bool head_only = c.req.method == HTTP_M_HEAD || res.status_ == 204 || res.status_ == 304;
+    if (head_only)
+        res.source_.reset();
+
+    c.linger = c.body_left > 0;
+    c.keep_alive = c.req.keep_alive && !res.close_ && !c.linger;
+    c.chunked = res.source_ && res.length_ < 0;
+    c.send_left = res.source_ ? res.length_ : 0;
+    c.body_done = !res.source_;
+    c.body_pending = false;
+    c.state = CONN_SEND;
+    c.last_ms = now_ms();
+
+    size_t cap = config_.io_buffer;
+    size_t len = 0;
+    char line[96];
+    int n = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", res.status_, http_status_text(res.status_));
+    bool ok = append_str(c.io, cap, len, line, (size_t)n);
+    if (!res.content_type_.empty())
+    {
+        ok = ok && append_str(c.io, cap, len, "Content-Type: ", 14);
+        ok = ok && append_str(c.io, cap, len, res.content_type_);
+        ok = ok && append_str(c.io, cap, len, "\r\n", 2);
+    }
+    for (const auto &kv : res.headers_)
+    {
+        ok = ok && append_str(c.io, cap, len, kv.first);
+        ok = ok && append_str(c.io, cap, len, ": ", 2);
+        ok = ok && append_str(c.io, cap, len, kv.second);
+        ok = ok && append_str(c.io, cap, len, "\r\n", 2);
+    }
+    if (c.chunked)
+    {
+        ok = ok && append_str(c.io, cap, len, "Transfer-Encoding: chunked\r\n", 28);
+    }
+    else if (res.status_ != 204 && res.status_ != 304 && res.length_ >= 0)
+    {
+        // HEAD 也给出实际长度
+        n = snprintf(line, sizeof(line), "Content-Length: %lld\r\n", (long long)res.length_);
+        ok = ok && append_str(c.io, cap, len, line, (size_t)n);
+    }
+    const char *conn_hdr = c.keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    ok = ok && append_str(c.io, cap, len, conn_hdr, strlen(conn_hdr));
+    if (!ok)
+    {
+        // 响应头超出缓冲：放弃该连接
+        stats_.errors++;
+        closeConn(c);
+        return;
+    }
+    c.out_pos = 0;
+    c.out_len = len;
+    if (!fillOutput(c))
+        closeConn(c);
+}
+
+bool HttpServerCore::fillOutput(Conn &c)
+{
+    if (c.body_done)
+        return true;
+    HttpBodySource *src = c.res.source_.get();
+    size_t cap = config_.io_buffer;
+    if (c.chunked)
+    {
+        // 预留块头（最多 8 位十六进制 + CRLF）与块尾 CRLF，以及结束块 "0\r\n\r\n"
+        const size_t prefix = 10;
+        if (c.out_len + prefix + 2 + 5 + 64 > cap)
+            return true; // 先把已有内容发出去
+        size_t room = cap - c.out_len - prefix - 2 - 5;
+        int n = src->read(c.io + c.out_len + prefix, room);
+        if (n == HTTP_BODY_PENDING)
+        {
+            c.body_pending = true;
+            c.last_ms = now_ms(); // 数据源仍在工作，不算空闲
+            return true;
+        }
+        if (n < 0)
+            return false;
+        if (n == 0)
+        {
+            memcpy(c.io + c.out_len, "0\r\n\r\n", 5);
+            c.out_len += 5;
+            c.body_done = true;
+            return true;
+        }
+        char hex[12];
+        int hl = snprintf(hex, sizeof(hex), "%x\r\n", (unsigned)n);
+        // 块头右对齐到数据前，保证数据无需移动
+        size_t start = c.out_len + prefix - (size_t)hl;
+        if (start != c.out_len)
+        {
+            memmove(c.io + c.out_len + (size_t)hl, c.io + c.out_len + prefix, (size_t)n);
+        }
+        memcpy(c.io + c.out_len, hex, (size_t)hl);
+        c.out_len += (size_t)hl + (size_t)n;
+        memcpy(c.io + c.out_len, "\r\n", 2);
+        c.out_len += 2;
+        return true;
+    }
+
+    if (c.send_left <= 0)
+    {
+        c.body_done = true;
+        return true;
+    }
+    size_t room = cap - c.out_len;
+    if (room == 0)
+        return true;
+    if ((int64_t)room > c.send_left)
+        room = (size_t)c.send_left;
+    int n = src->read(c.io + c.out_len, room);
+    if (n == HTTP_BODY_PENDING)
+    {
+        c.body_pending = true;
+        c.last_ms = now_ms();
+        return true;
+    }
+    if (n <= 0)
+        return false; // 数据源提前结束，声明的 Content-Length 无法兑现
+    c.out_len += (size_t)n;
+    c.send_left -= n;
+    if (c.send_left <= 0)
+        c.body_done = true;
+    return true;
+}
+
+void HttpServerCore::onReadable(Conn &c)
+{
+    if (c.state == CONN_READ_HEAD)
+    {
+        size_t room = config_.header_buffer - 1 - c.head_len;
+        ssize_t n = recv(c.fd, c.head + c.head_len, room, 0);
+        if (n == 0 || (n < 0 && !would_block()))
+        {
+            closeConn(c);
+            return;
+        }
+        if (n < 0)
+            return;
+        c.head_len += (size_t)n;
+        c.last_ms = now_ms();
+        processHead(c);
+        return;
+    }
+    if (c.state == CONN_READ_BODY)
+    {
+        size_t room = config_.io_buffer;
+        if ((int64_t)room > c.body_left)
+            room = (size_t)c.body_left;
+        ssize_t n = recv(c.fd, c.io, room, 0);
+        if (n == 0 || (n < 0 && !would_block()))
+        {
+            closeConn(c); // 请求体未收完：上传回调会收到 ABORTED
+            return;
+        }
+        if (n < 0)
+            return;
+        c.last_ms = now_ms();
+        feedBody(c, c.io, (size_t)n);
+        return;
+    }
+    if (c.state == CONN_LINGER)
+    {
+        uint8_t sink[512];
+        ssize_t n = recv(c.fd, sink, sizeof(sink), 0);
+        if (n == 0 || (n < 0 && !would_block()))
+            closeConn(c);
+    }
+}
+
+void HttpServerCore::onWritable(Conn &c)
+{
+    if (c.out_pos >= c.out_len)
+    {
+        c.out_pos = c.out_len = 0;
+        if (!fillOutput(c))
+        {
+            stats_.errors++;
+            closeConn(c);
+            return;
+        }
+    }
+    if (c.out_pos < c.out_len)
+    {
+        ssize_t n = send(c.fd, c.io + c.out_pos, c.out_len - c.out_pos, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (!would_block())
+                closeConn(c);
+            return;
+        }
+        c.out_pos += (size_t)n;
+        stats_.bytes_out += (uint64_t)n;
+        c.last_ms = now_ms();
+    }
+    if (c.out_pos < c.out_len || !c.body_done)
+        return;
+
+    // 响应发送完毕
+    if (c.keep_alive)
+    {
+        resetForNextRequest(c);
+        processHead(c); // 流水线中已收到的下一条请求
+    }
+    else if (c.linger)
+    {
+        shutdown(c.fd, SHUT_WR);
+        c.state = CONN_LINGER;
+        c.res.reset();
+        c.req.context.reset();
+    }
+    else
+    {
+        closeConn(c);
+    }
+}
+
+void HttpServerCore::checkTimeouts(uint32_t now)
+{
+    for (uint8_t i = 0; i < config_.max_connections; ++i)
+    {
+        Conn &c = conns_[i];
+        if (c.state == CONN_FREE)
+            continue;
+        uint32_t limit = config_.io_timeout_ms;
+        if (c.state == CONN_LINGER)
+            limit = config_.linger_ms;
+        else if (c.state == CONN_READ_HEAD && c.idle && c.head_len == 0)
+            limit = config_.idle_timeout_ms;
+        if (now - c.last_ms > limit)
+        {
+            if (c.state != CONN_LINGER && !(c.state == CONN_READ_HEAD && c.idle))
+                stats_.timeouts++;
+            closeConn(c);
+        }
+    }
+}
+
+bool HttpServerCore::poll(uint32_t timeout_ms)
+{
+    if (listen_fd_ < 0)
+        return false;
+
+    fd_set rfds, wfds;
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    int maxfd = -1;
+    bool has_free = false;
+    bool has_pending = false;
+    for (uint8_t i = 0; i < config_.max_connections; ++i)
+    {
+        Conn &c = conns_[i];
+        switch (c.state)
+        {
+        case CONN_FREE:
+            has_free = true;
+            break;
+        case CONN_READ_HEAD:
+        case CONN_READ_BODY:
+        case CONN_LINGER:
+            FD_SET(c.fd, &rfds);
+            maxfd = c.fd > maxfd ? c.fd : maxfd;
+            break;
+        case CONN_SEND:
+            if (c.body_pending && c.out_pos >= c.out_len)
+            {
+                // 数据源在分段工作：不等可写（否则 select 立即返回、空转），select 之后直接再拉一次
+                has_pending = true;
+                break;
+            }
+            FD_SET(c.fd, &wfds);
+            maxfd = c.fd > maxfd ? c.fd : maxfd;
+            break;
+        }
+    }
+    if (has_free)
+    {
+        FD_SET(listen_fd_, &rfds);
+        maxfd = listen_fd_ > maxfd ? listen_fd_ : maxfd;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    int ready = maxfd >= 0 ? select(maxfd + 1, &rfds, &wfds, nullptr, &tv) : 0;
+    if (ready > 0)
+    {
+        for (uint8_t i = 0; i < config_.max_connections; ++i)
+        {
+            Conn &c = conns_[i];
+            if (c.state == CONN_FREE)
+                continue;
+            int fd = c.fd;
+            if (FD_ISSET(fd, &wfds) && c.state == CONN_SEND)
+                onWritable(c);
+            else if (FD_ISSET(fd, &rfds) && c.fd == fd)
+                onReadable(c);
+        }
+        if (has_free && FD_ISSET(listen_fd_, &rfds))
+            acceptClients();
+    }
+    if (has_pending)
+    {
+        // 每轮 poll 给每个分段数据源一步；其间 select 已照常服务了其它连接
+        for (uint8_t i = 0; i < config_.max_connections; ++i)
+        {
+            Conn &c = conns_[i];
+            if (c.state != CONN_SEND || !c.body_pending)
+                continue;
+            c.body_pending = false;
+            onWritable(c);
+        }
+    }
+    checkTimeouts(now_ms());
+    return ready > 0;
+}
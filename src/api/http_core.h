@@ -0,0 +1,222 @@
+#pragma once
+
+// HttpServerCore：事件驱动的小型 HTTP/1.1 服务器内核
+// - 只依赖 POSIX socket（设备上由 lwIP 提供，主机上即 Linux socket），不依赖 Arduino，
+//   因此可以在 tools/httpd 中编译为 Linux 程序做本地压测
+// - 固定大小的连接池，每个连接一个状态机（读请求头 -> 读请求体 -> 发送响应 -> keep-alive/关闭），
+//   由 poll() 在单个任务中用 select() 轮转推进，一个慢速上传/下载不会阻塞其它请求
+// - 响应体通过 HttpBodySource 分段拉取：文件直接读入连接的发送缓冲区再发出（sendfile 式），
+//   长度未知时使用 chunked 编码
+// - multipart/form-data 上传按块流式解析，以 HttpUpload 事件交给路由的上传回调（与 WebServer 的 upload() 语义一致）
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// 方法掩码（避免与 WebServer/http_parser 的 HTTP_GET 等枚举重名）
+enum HttpMethodMask : uint8_t
+{
+    HTTP_M_GET = 0x01,
+    HTTP_M_POST = 0x02,
+    HTTP_M_PUT = 0x04,
+    HTTP_M_DELETE = 0x08,
+    HTTP_M_OPTIONS = 0x10,
+    HTTP_M_HEAD = 0x20,
+    HTTP_M_ANY = 0xFF,
+};
+
+const char *http_method_name(uint8_t method);
+const char *http_status_text(int status);
+
+// 解析单段 Range 请求头（bytes=a-b / bytes=a- / bytes=-n），size 为资源长度。
+// 返回 1：区间有效，写入 [*first, *last]；0：没有 Range 或按规范忽略（多段、非 bytes、语法错误），回 200 全量；
+// -1：区间不可满足，应回 416
+int http_parse_range(const std::string &value, int64_t size, int64_t *first, int64_t *last);
+
+// CRC-32（IEEE 802.3，与 zlib crc32() 一致），可分段累计：crc = http_crc32(crc, buf, n)，初值 0
+uint32_t http_crc32(uint32_t crc, const uint8_t *buf, size_t len);
+
+using HttpKeyValues = std::vector<std::pair<std::string, std::string>>;
+
+// 路由回调可挂在请求上的私有状态（例如上传会话），连接关闭或请求结束时随请求一起析构
+class HttpRequestContext
+{
+public:
+    virtual ~HttpRequestContext() {}
+};
+
+struct HttpRequest
+{
+    uint8_t method = 0;      // HTTP_M_*
+    std::string path;        // 已做百分号解码，不含查询串
+    std::string query;       // 原始查询串
+    HttpKeyValues args;      // 查询参数 + urlencoded 表单 + multipart 普通字段
+    HttpKeyValues headers;   // 名称统一为小写
+    int64_t content_length = -1;
+    std::string body;        // 没有上传回调时缓存的请求体（不超过 Config::max_inline_body）
+    bool keep_alive = true;
+    int conn_id = -1;        // 连接池槽位
+    std::unique_ptr<HttpRequestContext> context;
+
+    const std::string &arg(const char *name) const;
+    bool hasArg(const char *name) const;
+    const std::string &header(const char *lower_name) const;
+};
+
+enum HttpUploadStatus
+{
+    HTTP_UPLOAD_START,
+    HTTP_UPLOAD_WRITE,
+    HTTP_UPLOAD_END,
+    HTTP_UPLOAD_ABORTED,
+};
+
+// 上传事件：multipart 的每个文件字段依次产生 START、若干 WRITE、END；
+// 非 multipart 的请求体作为一个无文件名的字段整体上报
+struct HttpUpload
+{
+    HttpUploadStatus status = HTTP_UPLOAD_START;
+    std::string name;           // 表单字段名
+    std::string filename;       // 客户端文件名（非 multipart 时为空）
+    std::string type;           // 字段 Content-Type
+    const uint8_t *buf = nullptr;
+    size_t currentSize = 0;     // 本次 WRITE 的字节数
+    size_t totalSize = 0;       // 本字段累计字节数
+    int64_t contentLength = -1; // 整个请求体长度（文件大小的上界，START 时即可用于预检）
+};
+
+// 响应体数据源：每次把下一段写入 buf，返回字节数；0 表示结束，<0 表示出错（连接会被关闭）。
+// 返回 HTTP_BODY_PENDING 表示本次暂无输出（数据源做了一小段耗时工作），HTTP 任务先服务其它连接，下一轮再来拉取。
+static const int HTTP_BODY_PENDING = -2;
+
+class HttpBodySource
+{
+public:
+    virtual ~HttpBodySource() {}
+    virtual int read(uint8_t *buf, size_t cap) = 0;
+};
+
+class HttpStringSource : public HttpBodySource
+{
+public:
+    explicit HttpStringSource(std::string data) : data_(std::move(data)) {}
+    int read(uint8_t *buf, size_t cap) override;
+
+private:
+    std::string data_;
+    size_t pos_ = 0;
+};
+
+class HttpResponse
+{
+public:
+    void setHeader(const std::string &name, const std::string &value);
+    // 一次性响应（正文在内存中；调用方可 std::move 进来避免复制）
+    void send(int status, const char *content_type = nullptr, std::string body = std::string());
+    // 流式响应：length < 0 时使用 Transfer-Encoding: chunked
+    void stream(int status, const char *content_type, std::unique_ptr<HttpBodySource> source, int64_t length = -1);
+    // 处理完后关闭连接（不做 keep-alive）
+    void closeAfter() { close_ = true; }
+
+    bool sent() const { return status_ != 0; }
+    int status() const { return status_; }
+
+private:
+    friend class HttpServerCore;
+    void reset();
+
+    int status_ = 0;
+    std::string content_type_;
+    HttpKeyValues headers_;
+    std::unique_ptr<HttpBodySource> source_;
+    int64_t length_ = 0;
+    bool close_ = false;
+};
+
+using HttpHandler = std::function<void(HttpRequest &, HttpResponse &)>;
+using HttpUploadHandler = std::function<void(HttpRequest &, HttpResponse &, HttpUpload &)>;
+
+class HttpServerCore
+{
+public:
+    struct Config
+    {
+        uint16_t port = 80;
+        uint8_t max_connections = 4;     // 连接池大小（设备上受 LWIP_MAX_SOCKETS 限制）
+        size_t header_buffer = 2048;     // 请求行 + 请求头上限
+        size_t io_buffer = 8192;         // 每连接收发缓冲区（文件分段读取大小）
+        size_t max_inline_body = 16384;  // 无上传回调时允许缓存的请求体上限
+        uint32_t idle_timeout_ms = 5000; // keep-alive 空闲超时
+        uint32_t io_timeout_ms = 30000;  // 请求头/请求体/发送过程中无进展的超时
+        uint32_t linger_ms = 1000;       // 提前应答（如 413）后继续丢弃请求体的时间，避免 RST 吞掉响应
+        // 分配连接缓冲区（设备上放 PSRAM）；为空时使用 malloc/free
+        void *(*alloc)(size_t) = nullptr;
+        void (*release)(void *) = nullptr;
+    };
+
+    struct Stats
+    {
+        uint32_t accepted = 0;
+        uint32_t requests = 0;
+        uint32_t active = 0;
+        uint32_t peak_active = 0;
+        uint32_t timeouts = 0;
+        uint32_t errors = 0;
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+    };
+
+    HttpServerCore();
+    ~HttpServerCore();
+
+    // 路由：path 精确匹配（不含查询串），methods 为 HTTP_M_* 掩码
+    void on(const char *path, uint8_t methods, HttpHandler handler, HttpUploadHandler upload = nullptr);
+    void onNotFound(HttpHandler handler);
+
+    bool begin(const Config &config);
+    // 推进所有连接，最多等待 timeout_ms；返回本轮是否有进展
+    bool poll(uint32_t timeout_ms);
+    void end();
+
+    bool running() const { return listen_fd_ >= 0; }
+    uint16_t port() const { return bound_port_; } // 实际端口（Config::port 为 0 时由系统分配）
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Route
+    {
+        std::string path;
+        uint8_t methods;
+        HttpHandler handler;
+        HttpUploadHandler upload;
+    };
+    struct Conn;
+    class Multipart;
+
+    Route *findRoute(const std::string &path, uint8_t method, bool *path_known);
+    void acceptClients();
+    void closeConn(Conn &c);
+    void resetForNextRequest(Conn &c);
+    void abortUpload(Conn &c);
+    void onReadable(Conn &c);
+    void onWritable(Conn &c);
+    void processHead(Conn &c);
+    bool parseHead(Conn &c, size_t head_end);
+    void beginBody(Conn &c);
+    void feedBody(Conn &c, const uint8_t *data, size_t len);
+    void finishRequest(Conn &c);
+    void prepareResponse(Conn &c);
+    bool fillOutput(Conn &c);
+    void checkTimeouts(uint32_t now);
+
+    Config config_;
+    int listen_fd_ = -1;
+    uint16_t bound_port_ = 0;
+    std::vector<Route> routes_;
+    HttpHandler not_found_;
+    Conn *conns_ = nullptr;
+    Stats stats_;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <FS.h>
+#include "api/http_core.h"
+
+// 以 fs::File（SD / SPIFFS）为响应体：HTTP 任务每次把下一段直接读进连接的发送缓冲区，
+// 发送完再读下一段，不在内存中整体缓存文件。文件随数据源析构关闭。
+// limit >= 0 时最多输出 limit 字节（Range 请求：调用方先 seek 到区间起点）。
+class HttpFileSource : public HttpBodySource
+{
+public:
+    explicit HttpFileSource(fs::File file, int64_t limit = -1) : file_(file), remaining_(limit) {}
+    ~HttpFileSource() override
+    {
+        if (file_)
+            file_.close();
+    }
+
+    int read(uint8_t *buf, size_t cap) override
+    {
+        if (remaining_ >= 0 && (int64_t)cap > remaining_)
+            cap = (size_t)remaining_;
+        if (cap == 0)
+            return 0;
+        int n = (int)file_.read(buf, cap);
+        if (n > 0 && remaining_ >= 0)
+            remaining_ -= n;
+        return n;
+    }
+
+private:
+    fs::File file_;
+    int64_t remaining_;
+};
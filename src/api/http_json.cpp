@@ -0,0 +1,207 @@
+#include "api/http_json.h"
+#include <cstdio>
+#include <cstring>
+
+void HttpJsonWriter::separator()
+{
+    if (after_key_)
+    {
+        after_key_ = false;
+        return;
+    }
+    if (depth_ == 0)
+        return;
+    uint32_t bit = 1u << ((depth_ - 1) & 31);
+    if (nonempty_ & bit)
+        put(',');
+    nonempty_ |= bit;
+}
+
+void HttpJsonWriter::put(const char *s, size_t len)
+{
+    // 溢出串里还有未取走的内容时继续追加到溢出串，保持输出顺序
+    if (overflow_pos_ < overflow_.size())
+    {
+        overflow_.append(s, len);
+        return;
+    }
+    if (len > sizeof(stage_) - tail_ && head_ > 0)
+    {
+        memmove(stage_, stage_ + head_, tail_ - head_);
+        tail_ -= head_;
+        head_ = 0;
+    }
+    size_t n = sizeof(stage_) - tail_;
+    if (n > len)
+        n = len;
+    memcpy(stage_ + tail_, s, n);
+    tail_ += n;
+    if (n < len)
+    {
+        overflow_.clear();
+        overflow_pos_ = 0;
+        overflow_.append(s + n, len - n);
+    }
+}
+
+void HttpJsonWriter::putEscaped(const char *s, size_t len)
+{
+    put('"');
+    size_t run = 0; // 无需转义的连续片段整段写入
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        if (i > run)
+            put(s + run, i - run);
+        run = i + 1;
+        switch (c)
+        {
+        case '"':
+            put("\\\"", 2);
+            break;
+        case '\\':
+            put("\\\\", 2);
+            break;
+        case '\n':
+            put("\\n", 2);
+            break;
+        case '\r':
+            put("\\r", 2);
+            break;
+        case '\t':
+            put("\\t", 2);
+            break;
+        default:
+        {
+            char esc[7];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            put(esc, 6);
+            break;
+        }
+        }
+    }
+    if (len > run)
+        put(s + run, len - run);
+    put('"');
+}
+
+void HttpJsonWriter::beginObject()
+{
+    separator();
+    put('{');
+    depth_++;
+    nonempty_ &= ~(1u << ((depth_ - 1) & 31));
+}
+
+void HttpJsonWriter::endObject()
+{
+    if (depth_ > 0)
+        depth_--;
+    put('}');
+}
+
+void HttpJsonWriter::beginArray()
+{
+    separator();
+    put('[');
+    depth_++;
+    nonempty_ &= ~(1u << ((depth_ - 1) & 31));
+}
+
+void HttpJsonWriter::endArray()
+{
+    if (depth_ > 0)
+        depth_--;
+    put(']');
+}
+
+void HttpJsonWriter::key(const char *k)
+{
+    separator();
+    putEscaped(k, strlen(k));
+    put(':');
+    after_key_ = true;
+}
+
+void HttpJsonWriter::value(const char *s)
+{
+    if (!s)
+    {
+        null();
+        return;
+    }
+    value(s, strlen(s));
+}
+
+void HttpJsonWriter::value(const char *s, size_t len)
+{
+    separator();
+    putEscaped(s, len);
+}
+
+void HttpJsonWriter::value(long long v)
+{
+    separator();
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%lld", v);
+    put(num, (size_t)n);
+}
+
+void HttpJsonWriter::value(bool v)
+{
+    separator();
+    if (v)
+        put("true", 4);
+    else
+        put("false", 5);
+}
+
+void HttpJsonWriter::null()
+{
+    separator();
+    put("null", 4);
+}
+
+size_t HttpJsonWriter::drain(uint8_t *buf, size_t cap)
+{
+    size_t n = tail_ - head_;
+    if (n > cap)
+        n = cap;
+    memcpy(buf, stage_ + head_, n);
+    head_ += n;
+    if (head_ == tail_)
+        head_ = tail_ = 0;
+
+    size_t rest = overflow_.size() - overflow_pos_;
+    if (n < cap && rest > 0)
+    {
+        size_t m = cap - n < rest ? cap - n : rest;
+        memcpy(buf + n, overflow_.data() + overflow_pos_, m);
+        overflow_pos_ += m;
+        n += m;
+        if (overflow_pos_ == overflow_.size())
+        {
+            // 释放溢出串占用的堆内存，恢复只用暂存缓冲
+            std::string().swap(overflow_);
+            overflow_pos_ = 0;
+        }
+    }
+    return n;
+}
+
+int HttpJsonSource::read(uint8_t *buf, size_t cap)
+{
+    size_t n = 0;
+    while (n < cap)
+    {
+        n += writer_.drain(buf + n, cap - n);
+        if (n == cap || done_)
+            break;
+        done_ = !step_(writer_);
+        if (!done_ && writer_.pending() == 0)
+            return n > 0 ? (int)n : HTTP_BODY_PENDING; // 生成器让出
+    }
+    return (int)n;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "api/http_core.h"
+
+// JSON 响应的暂存缓冲大小：生成器每步写出的一小段（列表中的一项、一组统计）先落在这里，
+// 等 HTTP 任务拉取时再复制进连接的发送缓冲区
+#ifndef HTTP_JSON_STAGE_SIZE
+#define HTTP_JSON_STAGE_SIZE 1024
+#endif
+
+// 流式 JSON 写入器：键名与字符串值自动转义，数组/对象内的逗号自动补齐。
+// 输出先写入固定大小的暂存缓冲；单步写出超过暂存容量时才借用溢出串（随即被 drain 取走）。
+class HttpJsonWriter
+{
+public:
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    // 对象成员的键；紧随其后的一个值（或 begin*）属于该键
+    void key(const char *k);
+    void key(const std::string &k) { key(k.c_str()); }
+
+    void value(const char *s);
+    void value(const char *s, size_t len);
+    void value(const std::string &s) { value(s.data(), s.size()); }
+    void value(long long v);
+    void value(int v) { value((long long)v); }
+    void value(long v) { value((long long)v); }
+    void value(unsigned v) { value((long long)v); }
+    void value(unsigned long v) { value((long long)v); }
+    void value(unsigned long long v) { value((long long)v); }
+    void value(bool v);
+    void null();
+
+    // key + value 的简写
+    template <typename T>
+    void field(const char *k, const T &v)
+    {
+        key(k);
+        value(v);
+    }
+
+    // 已待发送的字节数；drain 取出至多 cap 字节（按写入顺序）
+    size_t pending() const { return (tail_ - head_) + (overflow_.size() - overflow_pos_); }
+    size_t drain(uint8_t *buf, size_t cap);
+
+private:
+    void separator();
+    void put(const char *s, size_t len);
+    void put(char c) { put(&c, 1); }
+    void putEscaped(const char *s, size_t len);
+
+    char stage_[HTTP_JSON_STAGE_SIZE];
+    size_t head_ = 0;
+    size_t tail_ = 0;
+    std::string overflow_;
+    size_t overflow_pos_ = 0;
+    uint32_t nonempty_ = 0; // 第 i 位：第 i 层容器已有元素（再写需要逗号）
+    uint8_t depth_ = 0;
+    bool after_key_ = false;
+};
+
+// 以生成器驱动的 JSON 响应体：暂存缓冲取空后才调用一次 step 写出下一段，
+// 因此内存占用只有暂存缓冲与生成器自身的迭代状态，与响应总长度无关。
+// step 返回 false 表示输出已完整（本次写出的内容仍会发送）。配合 res.stream(..., -1) 以 chunked 发送。
+// step 返回 true 却未写出任何内容时视为让出：本次拉取就此结束（返回 HTTP_BODY_PENDING），
+// 耗时的生成器（检索、哈希）可借此每步只做一小段工作，不独占 HTTP 任务。
+class HttpJsonSource : public HttpBodySource
+{
+public:
+    using Step = std::function<bool(HttpJsonWriter &)>;
+
+    explicit HttpJsonSource(Step step) : step_(std::move(step)) {}
+    int read(uint8_t *buf, size_t cap) override;
+
+private:
+    HttpJsonWriter writer_;
+    Step step_;
+    bool done_ = false;
+};
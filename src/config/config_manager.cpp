@@ -695,6 +695,7 @@ bool config_set_current_file(const char *file_path)
 }
 
 #include "text/book_handle.h"
+#include "ui/index_display.h"
 #include <SPIFFS.h>
 
 BookHandle *config_update_current_book(const char *file_path, int16_t area_w, int16_t area_h, float fsize)
@@ -774,6 +775,8 @@ BookHandle *config_update_current_book(const char *file_path, int16_t area_w, in
             std::atomic_store(&__g_current_book_shared, new_sp);
             // reset autoread when switching to a new book
             autoread = false;
+            // 书签列表页码属于旧书，换书后从第一页开始
+            tag_reset_page();
 #if DBG_CONFIG_MANAGER
             Serial.printf("[CONFIG] 成功切换到新书籍: %s\n", file_path);
 #endif
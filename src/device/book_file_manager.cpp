@@ -1,6 +1,7 @@
 #include "book_file_manager.h"
 #include "globals.h"
 #include "text/font_buffer.h"
+#include "text/lz_book.h"
 #include <algorithm>
 #include <cctype>
 #include "readpaper.h"
@@ -49,15 +50,19 @@ void BookFileManager::refreshCache() {
     scanBooks();
 }
 
+std::string BookFileManager::bookPath(const std::string& bookName) {
+    std::string plain = "/book/" + bookName + ".txt";
+    if (EfficientFileScanner::fileExists(plain)) return plain;
+    std::string packed = plain + ".lz";
+    return EfficientFileScanner::fileExists(packed) ? packed : plain;
+}
+
 bool BookFileManager::bookExists(const std::string& bookName) {
-    // 构建完整文件路径
-    std::string fullPath = "/book/" + bookName + ".txt";
-    return EfficientFileScanner::fileExists(fullPath);
+    return EfficientFileScanner::fileExists(bookPath(bookName));
 }
 
 size_t BookFileManager::getBookSize(const std::string& bookName) {
-    std::string fullPath = "/book/" + bookName + ".txt";
-    return EfficientFileScanner::getFileSize(fullPath);
+    return EfficientFileScanner::getFileSize(bookPath(bookName));
 }
 
 void BookFileManager::clearCache() {
@@ -84,8 +89,8 @@ void BookFileManager::scanBooks() {
     
     cachedBookNames.clear();
     
-    // 使用高效文件扫描器扫描.txt文件
-    std::vector<FileInfo> txtFiles = EfficientFileScanner::scanDirectory("/book", ".txt");
+    // 使用高效文件扫描器扫描.txt文件（含压缩存放的 .txt.lz）
+    std::vector<FileInfo> txtFiles = EfficientFileScanner::scanDirectory("/book", BOOK_FILE_EXTENSIONS);
     
     // 检查扫描结果是否有效
     bool scanSuccess = true;
@@ -101,8 +106,9 @@ void BookFileManager::scanBooks() {
         }
         
         if (!fileInfo.isDirectory && !fileInfo.name.empty()) {
-            // 移除.txt扩展名
-            std::string bookName = removeExtension(fileInfo.name);
+            // 移除.txt / .txt.lz扩展名
+            std::string bookName = lz_book_name(fileInfo.name) ? book_name_stem(fileInfo.name)
+                                                                : removeExtension(fileInfo.name);
             if (!bookName.empty() && bookName.length() <= 255) { // 支持最长 255 字符的书名显示
                 cachedBookNames.push_back(bookName);
             }
@@ -158,6 +164,8 @@ void BookFileManager::scanBooks() {
             }
             return na < nb;
         });
+        // 同名的 .txt 与 .txt.lz 只列一次（bookPath 优先打开 .txt）
+        cachedBookNames.erase(std::unique(cachedBookNames.begin(), cachedBookNames.end()), cachedBookNames.end());
     }
 }
 
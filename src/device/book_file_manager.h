@@ -5,6 +5,9 @@
 #include <vector>
 #include <string>
 
+// /book 下的书籍文件：纯文本 .txt 与压缩存放的 .txt.lz（EfficientFileScanner / DirIndex 的扩展名过滤写法）
+#define BOOK_FILE_EXTENSIONS ".txt|.txt.lz"
+
 // 书籍文件管理器 - 专门处理书籍文件的高效扫描和缓存
 class BookFileManager {
 public:
@@ -14,8 +17,11 @@ public:
     // 获取指定页面的书籍列表（分页支持）
     static std::vector<std::string> getBookList(int page, int perPage);
     
-    // 获取所有书籍名称（去除.txt扩展名）
+    // 获取所有书籍名称（去除.txt / .txt.lz扩展名）
     static std::vector<std::string> getAllBookNames();
+
+    // 书名对应的文件路径（/book/<名>.txt，不存在而有 /book/<名>.txt.lz 时返回后者）
+    static std::string bookPath(const std::string& bookName);
     
     // 刷新缓存
     static void refreshCache();
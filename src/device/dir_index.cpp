@@ -0,0 +1,668 @@
+#include "dir_index.h"
+#include "globals.h"
+#include "readpaper.h"
+#include "test/per_file_debug.h"
+#include "device/safe_fs.h"
+#include "text/book_handle.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// .dix 文件：头部 | 条目记录（已排序）| 检查点表（每 DIR_INDEX_CHECKPOINT 项一个记录偏移）
+// 条目记录：u32 大小 | u8 标志（bit0 目录）| u8 名字长度 | 名字（UTF-8，不含结尾 0）
+static const uint8_t DIX_MAGIC[4] = {'D', 'I', 'X', '1'};
+static const size_t DIX_RECORD_HEAD = 6;
+static const size_t DIX_IO_BUFFER = 512; // 不小于最长记录（6 + 255）
+
+struct DixHeader
+{
+    uint8_t magic[4];
+    uint32_t count;
+    uint32_t signature;
+    uint32_t table_offset;
+    uint32_t table_count;
+};
+
+struct DixEntry
+{
+    std::string name;
+    uint32_t size = 0;
+    bool dir = false;
+};
+
+struct DixRun
+{
+    uint32_t offset;
+    uint32_t count;
+};
+
+// 已用过的目录索引（本次开机内）；gen 在失效时递增，重建期间发生的失效不会被误标为有效
+struct DixSlot
+{
+    std::string dir;
+    std::string ext;
+    bool valid = false;
+    bool stale = false; // 已知失效：跳过签名比对直接重建
+    uint32_t count = 0;
+    uint32_t gen = 0;
+};
+
+static std::mutex s_lock;
+static std::vector<DixSlot> s_slots;
+
+// 与 /list 原有排序一致：ASCII 大小写不敏感；仅大小写不同时按原字节，保证全序
+static int dix_name_cmp(const std::string &a, const std::string &b)
+{
+    size_t n = a.size() < b.size() ? a.size() : b.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        unsigned char ca = (unsigned char)a[i], cb = (unsigned char)b[i];
+        if (ca >= 'A' && ca <= 'Z')
+            ca += 32;
+        if (cb >= 'A' && cb <= 'Z')
+            cb += 32;
+        if (ca != cb)
+            return ca < cb ? -1 : 1;
+    }
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    return a.compare(b);
+}
+
+static bool dix_ends_with(const std::string &name, const char *ext, size_t len)
+{
+    if (name.length() < len)
+        return false;
+    for (size_t i = 0; i < len; ++i)
+    {
+        char c = name[name.length() - len + i];
+        char e = ext[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 32;
+        if (e >= 'A' && e <= 'Z')
+            e += 32;
+        if (c != e)
+            return false;
+    }
+    return true;
+}
+
+// ext 可以是以 '|' 分隔的多个扩展名（如书籍的 ".txt|.txt.lz"），匹配任意一个即可
+static bool dix_has_ext(const std::string &name, const std::string &ext)
+{
+    size_t start = 0;
+    while (start <= ext.length())
+    {
+        size_t bar = ext.find('|', start);
+        size_t end = bar == std::string::npos ? ext.length() : bar;
+        if (end > start && dix_ends_with(name, ext.c_str() + start, end - start))
+            return true;
+        if (bar == std::string::npos)
+            break;
+        start = bar + 1;
+    }
+    return false;
+}
+
+static uint32_t dix_entry_hash(const std::string &name, uint32_t size, bool dir)
+{
+    uint32_t h = 2166136261u;
+    for (unsigned char c : name)
+    {
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= size;
+    h *= 16777619u;
+    h ^= dir ? 1u : 0u;
+    h *= 16777619u;
+    return h;
+}
+
+// 遍历目录中符合过滤条件的条目（过滤规则与 EfficientFileScanner 相同：有扩展名时只要文件）。
+// 签名与遍历顺序无关；内存不足时中止并返回 false，避免生成不完整的索引
+static bool dix_walk(const std::string &dirPath, const std::string &ext, uint32_t &count, uint32_t &signature,
+                     const std::function<bool(DixEntry &)> &fn)
+{
+    count = 0;
+    signature = 0;
+    if (g_disable_sd_access)
+        return false;
+    File dir = SDW::SD.open(dirPath.c_str());
+    if (!dir || !dir.isDirectory())
+    {
+        if (dir)
+            dir.close();
+        return false;
+    }
+    dir.rewindDirectory();
+    DixEntry e;
+    bool ok = true;
+    while (true)
+    {
+        if (ESP.getFreeHeap() < 4096)
+        {
+            ok = false;
+            break;
+        }
+        File entry = dir.openNextFile();
+        if (!entry)
+            break;
+        const char *namePtr = entry.name();
+        if (!namePtr || !*namePtr)
+        {
+            entry.close();
+            continue;
+        }
+        const char *slash = strrchr(namePtr, '/');
+        e.name = slash ? slash + 1 : namePtr;
+        if (e.name.length() > 255) // 支持最长 255 字符的文件名（LFN 上限）
+            e.name.resize(255);
+        e.dir = entry.isDirectory();
+        e.size = e.dir ? 0 : (uint32_t)entry.size();
+        entry.close();
+
+        if (e.dir ? !ext.empty() : !(ext.empty() || dix_has_ext(e.name, ext)))
+            continue;
+        count++;
+        signature += dix_entry_hash(e.name, e.size, e.dir);
+        if (fn && !fn(e))
+        {
+            ok = false;
+            break;
+        }
+        if (count % 16 == 0)
+            yield();
+    }
+    dir.close();
+    signature += count * 0x9E3779B1u;
+    return ok;
+}
+
+// 顺序读取一段记录；多个游标可以共用同一个 File（每次补充缓冲前先 seek）
+struct DixCursor
+{
+    File *file = nullptr;
+    uint32_t pos = 0;       // 缓冲末尾对应的文件偏移
+    uint32_t remaining = 0; // 尚未读出的记录数
+    uint8_t buf[DIX_IO_BUFFER];
+    size_t len = 0;
+    size_t off = 0;
+
+    void begin(File *f, uint32_t offset, uint32_t count)
+    {
+        file = f;
+        pos = offset;
+        remaining = count;
+        len = off = 0;
+    }
+
+    bool ensure(size_t need)
+    {
+        if (len - off >= need)
+            return true;
+        memmove(buf, buf + off, len - off);
+        len -= off;
+        off = 0;
+        if (!file->seek(pos))
+            return false;
+        int n = (int)file->read(buf + len, sizeof(buf) - len);
+        if (n > 0)
+        {
+            pos += (uint32_t)n;
+            len += (size_t)n;
+        }
+        return len >= need;
+    }
+
+    bool next(DixEntry &e)
+    {
+        if (remaining == 0 || !ensure(DIX_RECORD_HEAD))
+            return false;
+        const uint8_t *p = buf + off;
+        uint32_t size;
+        memcpy(&size, p, 4);
+        bool dir = (p[4] & 1) != 0;
+        size_t name_len = p[5];
+        if (!ensure(DIX_RECORD_HEAD + name_len))
+            return false;
+        e.size = size;
+        e.dir = dir;
+        e.name.assign(reinterpret_cast<const char *>(buf + off + DIX_RECORD_HEAD), name_len);
+        off += DIX_RECORD_HEAD + name_len;
+        remaining--;
+        return true;
+    }
+};
+
+// 写入缓冲：小记录攒满一块再写卡；offset() 为下一字节的文件偏移
+class DixWriter
+{
+public:
+    DixWriter(File &f, uint32_t base) : file_(f), offset_(base) {}
+    ~DixWriter() { flush(); }
+
+    bool put(const void *data, size_t n)
+    {
+        if (len_ + n > sizeof(buf_) && !flush())
+            return false;
+        offset_ += (uint32_t)n;
+        if (n > sizeof(buf_))
+        {
+            // 检查点表等大块直接写
+            if (file_.write(static_cast<const uint8_t *>(data), n) != n)
+                ok_ = false;
+            return ok_;
+        }
+        memcpy(buf_ + len_, data, n);
+        len_ += n;
+        return true;
+    }
+
+    bool put(const DixEntry &e)
+    {
+        uint8_t head[DIX_RECORD_HEAD];
+        memcpy(head, &e.size, 4);
+        head[4] = e.dir ? 1 : 0;
+        head[5] = (uint8_t)e.name.size();
+        return put(head, sizeof(head)) && put(e.name.data(), e.name.size());
+    }
+
+    bool flush()
+    {
+        if (len_ == 0)
+            return ok_;
+        if (file_.write(buf_, len_) != len_)
+            ok_ = false;
+        len_ = 0;
+        return ok_;
+    }
+
+    uint32_t offset() const { return offset_; }
+    bool ok() const { return ok_; }
+
+private:
+    File &file_;
+    uint32_t offset_;
+    uint8_t buf_[DIX_IO_BUFFER];
+    size_t len_ = 0;
+    bool ok_ = true;
+};
+
+// 多路归并 runs（同一文件中的若干有序段），按序交给 emit
+static bool dix_merge(File &in, const DixRun *runs, size_t n, const std::function<bool(const DixEntry &)> &emit)
+{
+    std::vector<DixCursor> cursors(n);
+    std::vector<DixEntry> heads(n);
+    std::vector<bool> live(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        cursors[i].begin(&in, runs[i].offset, runs[i].count);
+        live[i] = cursors[i].next(heads[i]);
+    }
+    while (true)
+    {
+        // 段数不超过 DIR_INDEX_MERGE_FANIN，线性挑最小即可
+        int best = -1;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (live[i] && (best < 0 || dix_name_cmp(heads[i].name, heads[best].name) < 0))
+                best = (int)i;
+        }
+        if (best < 0)
+            break;
+        if (!emit(heads[best]))
+            return false;
+        live[best] = cursors[best].next(heads[best]);
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (cursors[i].remaining != 0)
+            return false; // 段没有读完：读卡出错
+    }
+    return true;
+}
+
+static bool dix_build(const std::string &dirPath, const std::string &ext, const std::string &indexPath, DixHeader &header)
+{
+#if DBG_FILE_MANAGER
+    unsigned long startTime = millis();
+#endif
+    if (!ensureBookmarksFolder())
+        return false;
+
+    std::string runPath[2] = {indexPath + ".r0", indexPath + ".r1"};
+    std::vector<DixRun> runs;
+    uint32_t count = 0, signature = 0;
+
+    // 1) 分段排序：每 DIR_INDEX_RUN_ENTRIES 项排好序写成一个有序段
+    {
+        File f = SDW::SD.open(runPath[0].c_str(), "w");
+        if (!f)
+            return false;
+        DixWriter w(f, 0);
+        std::vector<DixEntry> batch;
+        batch.reserve(DIR_INDEX_RUN_ENTRIES);
+        auto flush_batch = [&]() {
+            std::sort(batch.begin(), batch.end(), [](const DixEntry &a, const DixEntry &b) {
+                return dix_name_cmp(a.name, b.name) < 0;
+            });
+            runs.push_back({w.offset(), (uint32_t)batch.size()});
+            for (const DixEntry &e : batch)
+                w.put(e);
+            batch.clear();
+            return w.ok();
+        };
+        bool ok = dix_walk(dirPath, ext, count, signature, [&](DixEntry &e) {
+            batch.push_back(std::move(e));
+            e = DixEntry();
+            return batch.size() < DIR_INDEX_RUN_ENTRIES || flush_batch();
+        });
+        if (ok && !batch.empty())
+            ok = flush_batch();
+        ok = w.flush() && ok;
+        f.close();
+        if (!ok)
+        {
+            SDW::SD.remove(runPath[0].c_str());
+            return false;
+        }
+    }
+
+    // 2) 段数过多时分组归并，直到一次可以归并完
+    int src = 0;
+    bool ok = true;
+    while (ok && runs.size() > DIR_INDEX_MERGE_FANIN)
+    {
+        File in = SDW::SD.open(runPath[src].c_str(), "r");
+        File out = SDW::SD.open(runPath[src ^ 1].c_str(), "w");
+        ok = in && out;
+        std::vector<DixRun> merged;
+        if (ok)
+        {
+            DixWriter w(out, 0);
+            for (size_t i = 0; ok && i < runs.size(); i += DIR_INDEX_MERGE_FANIN)
+            {
+                size_t n = std::min<size_t>(DIR_INDEX_MERGE_FANIN, runs.size() - i);
+                DixRun r{w.offset(), 0};
+                ok = dix_merge(in, &runs[i], n, [&](const DixEntry &e) {
+                    r.count++;
+                    return w.put(e);
+                });
+                merged.push_back(r);
+                yield();
+            }
+            ok = w.flush() && ok;
+        }
+        if (in)
+            in.close();
+        if (out)
+            out.close();
+        runs.swap(merged);
+        src ^= 1;
+    }
+
+    // 3) 最后一趟归并直接写出索引（先写 .tmp，完成后替换）
+    std::string tmp = SafeFS::tmpPathFor(indexPath);
+    if (ok)
+    {
+        File in = SDW::SD.open(runPath[src].c_str(), "r");
+        File out = SDW::SD.open(tmp.c_str(), "w");
+        ok = in && out;
+        if (ok)
+        {
+            memcpy(header.magic, DIX_MAGIC, 4);
+            header.count = count;
+            header.signature = signature;
+            header.table_offset = 0;
+            header.table_count = 0;
+            ok = out.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header)) == sizeof(header);
+
+            std::vector<uint32_t> table;
+            table.reserve(count / DIR_INDEX_CHECKPOINT + 1);
+            uint32_t written = 0;
+            DixWriter w(out, sizeof(header));
+            if (ok)
+            {
+                ok = dix_merge(in, runs.data(), runs.size(), [&](const DixEntry &e) {
+                    if (written % DIR_INDEX_CHECKPOINT == 0)
+                        table.push_back(w.offset());
+                    written++;
+                    return w.put(e);
+                });
+            }
+            ok = ok && written == count;
+            header.table_offset = w.offset();
+            header.table_count = (uint32_t)table.size();
+            if (ok && !table.empty())
+                ok = w.put(table.data(), table.size() * sizeof(uint32_t));
+            ok = w.flush() && ok;
+            if (ok)
+                ok = out.seek(0) && out.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header)) == sizeof(header);
+        }
+        if (in)
+            in.close();
+        if (out)
+        {
+            out.flush();
+            out.close();
+        }
+    }
+
+    SDW::SD.remove(runPath[0].c_str());
+    if (SDW::SD.exists(runPath[1].c_str()))
+        SDW::SD.remove(runPath[1].c_str());
+    if (ok)
+        ok = SafeFS::promoteTmpToFinal(tmp, indexPath);
+    if (!ok && SDW::SD.exists(tmp.c_str()))
+        SDW::SD.remove(tmp.c_str());
+
+#if DBG_FILE_MANAGER
+    Serial.printf("[DirIndex] 重建 %s%s: %s，%u 项，%u 段，耗时 %lu ms\n", dirPath.c_str(), ext.c_str(),
+                  ok ? "成功" : "失败", (unsigned)count, (unsigned)((count + DIR_INDEX_RUN_ENTRIES - 1) / DIR_INDEX_RUN_ENTRIES),
+                  millis() - startTime);
+#endif
+    return ok;
+}
+
+static bool dix_read_header(File &f, DixHeader &header)
+{
+    if (!f || !f.seek(0) || f.read(reinterpret_cast<uint8_t *>(&header), sizeof(header)) != sizeof(header))
+        return false;
+    if (memcmp(header.magic, DIX_MAGIC, 4) != 0)
+        return false;
+    uint32_t expect_table = (header.count + DIR_INDEX_CHECKPOINT - 1) / DIR_INDEX_CHECKPOINT;
+    return header.table_count == expect_table &&
+           (size_t)header.table_offset + header.table_count * sizeof(uint32_t) == f.size();
+}
+
+// 确保索引可用：本次开机已确认有效直接返回；否则比对签名，不一致（或已知失效）则重建
+static bool dix_prepare(const std::string &dirPath, const std::string &ext, const std::string &indexPath)
+{
+    uint32_t gen = 0;
+    bool stale = false;
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        auto it = std::find_if(s_slots.begin(), s_slots.end(), [&](const DixSlot &s) { return s.dir == dirPath && s.ext == ext; });
+        if (it == s_slots.end())
+        {
+            DixSlot slot;
+            slot.dir = dirPath;
+            slot.ext = ext;
+            s_slots.push_back(slot);
+            it = s_slots.end() - 1;
+        }
+        if (it->valid)
+            return true;
+        gen = it->gen;
+        stale = it->stale;
+    }
+
+    DixHeader header;
+    bool ok = false;
+    if (!stale && SDW::SD.exists(indexPath.c_str()))
+    {
+        File f = SDW::SD.open(indexPath.c_str(), "r");
+        bool have = dix_read_header(f, header);
+        if (f)
+            f.close();
+        uint32_t count = 0, signature = 0;
+        ok = have && dix_walk(dirPath, ext, count, signature, nullptr) &&
+             count == header.count && signature == header.signature;
+#if DBG_FILE_MANAGER
+        Serial.printf("[DirIndex] 校验 %s%s: %s\n", dirPath.c_str(), ext.c_str(), ok ? "一致" : "不一致");
+#endif
+    }
+    if (!ok)
+        ok = dix_build(dirPath, ext, indexPath, header);
+    if (!ok)
+        return false;
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    for (DixSlot &s : s_slots)
+    {
+        if (s.dir == dirPath && s.ext == ext && s.gen == gen)
+        {
+            s.valid = true;
+            s.stale = false;
+            s.count = header.count;
+        }
+    }
+    return true;
+}
+
+std::string DirIndex::indexFileName(const std::string &dirPath, const std::string &extension)
+{
+    // 复用书签文件名的安全化规则：/book -> /bookmarks/_book.dix，/book + .txt -> /bookmarks/_book.txt.dix
+    std::string bm = getBookmarkFileName(dirPath);
+    size_t dot = bm.find_last_of('.');
+    std::string stem = (dot != std::string::npos) ? bm.substr(0, dot) : bm;
+    std::string ext = extension;
+    std::replace(ext.begin(), ext.end(), '|', '+'); // FAT 文件名不允许 '|'
+    return stem + ext + ".dix";
+}
+
+struct DirIndex::Reader::Cursor
+{
+    File file;
+    DixCursor records;
+};
+
+DirIndex::Reader::Reader() {}
+
+DirIndex::Reader::~Reader()
+{
+    close();
+}
+
+bool DirIndex::Reader::open(const std::string &dirPath, const std::string &extension, size_t start)
+{
+    close();
+    if (g_disable_sd_access)
+        return false;
+    std::string indexPath = indexFileName(dirPath, extension);
+
+    // 索引文件可能被“清理残存”删掉：打开失败时作废一次并重建
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (!dix_prepare(dirPath, extension, indexPath))
+            return false;
+        File f = SDW::SD.open(indexPath.c_str(), "r");
+        DixHeader header;
+        if (!dix_read_header(f, header))
+        {
+            if (f)
+                f.close();
+            invalidate(dirPath);
+            continue;
+        }
+
+        total_ = header.count;
+        dir_ = dirPath;
+        cursor_.reset(new Cursor());
+        cursor_->file = f;
+        DixCursor &rc = cursor_->records;
+        if (start >= total_)
+        {
+            rc.begin(&cursor_->file, header.table_offset, 0);
+            return true;
+        }
+        // 检查点定位，再跳过不足一个检查点间隔的记录
+        uint32_t cp = (uint32_t)(start / DIR_INDEX_CHECKPOINT);
+        uint32_t offset = 0;
+        if (!f.seek(header.table_offset + cp * sizeof(uint32_t)) ||
+            f.read(reinterpret_cast<uint8_t *>(&offset), sizeof(offset)) != sizeof(offset))
+        {
+            close();
+            return false;
+        }
+        rc.begin(&cursor_->file, offset, (uint32_t)(total_ - (size_t)cp * DIR_INDEX_CHECKPOINT));
+        DixEntry skip;
+        for (size_t i = (size_t)cp * DIR_INDEX_CHECKPOINT; i < start; ++i)
+        {
+            if (!rc.next(skip))
+            {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool DirIndex::Reader::next(FileInfo &out)
+{
+    if (!cursor_)
+        return false;
+    DixEntry e;
+    if (!cursor_->records.next(e))
+        return false;
+    out.name = std::move(e.name);
+    out.path = dir_ + "/" + out.name;
+    out.size = e.size;
+    out.isDirectory = e.dir;
+    return true;
+}
+
+void DirIndex::Reader::close()
+{
+    if (cursor_)
+    {
+        if (cursor_->file)
+            cursor_->file.close();
+        cursor_.reset();
+    }
+    total_ = 0;
+}
+
+void DirIndex::invalidate(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    for (DixSlot &s : s_slots)
+    {
+        // 目录本身，或路径位于该目录之下（子目录的变化也可能改变上层列表）
+        bool hit = path == s.dir || s.dir == "/" ||
+                   (path.size() > s.dir.size() && path.compare(0, s.dir.size(), s.dir) == 0 && path[s.dir.size()] == '/');
+        if (hit)
+        {
+            s.valid = false;
+            s.stale = true;
+            s.gen++;
+        }
+    }
+}
+
+void DirIndex::invalidateAll()
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    for (DixSlot &s : s_slots)
+    {
+        s.valid = false;
+        s.stale = true;
+        s.gen++;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "efficient_file_scanner.h"
+#include <memory>
+#include <string>
+
+// 目录排序索引：目录条目按文件名（ASCII 不区分大小写）排好序，持久化在 /bookmarks/<目录>[.<扩展名>].dix。
+// 分页列表只需按检查点定位再顺序读出一页，I/O 与内存都只和每页条数有关，不再把整个目录读进内存排序。
+// 索引由外部归并排序生成：每 DIR_INDEX_RUN_ENTRIES 项在内存中排成一个有序段写入临时文件，再多路归并。
+// 有效性：开机后首次使用时遍历目录比对签名（条目数 + 名字/大小散列），之后依赖显式失效
+// （上传、删除、截图、清理残存），失效后在下次使用时重建。
+class DirIndex {
+public:
+    // 顺序读取某个目录索引中的条目（持有一个打开的索引文件，析构时关闭）
+    class Reader {
+    public:
+        Reader();
+        ~Reader();
+
+        // 打开 dirPath 的索引（extension 非空时只含该扩展名的文件，不含目录；可用 '|' 分隔多个扩展名），定位到第 start 项；
+        // 索引缺失或失效时先重建。失败返回 false（SD 不可用、目录不存在或内存不足）
+        bool open(const std::string& dirPath, const std::string& extension, size_t start);
+        // 读出下一项；到末尾或出错返回 false
+        bool next(FileInfo& out);
+        // 索引中的条目总数
+        size_t total() const { return total_; }
+        void close();
+
+    private:
+        struct Cursor;
+        std::unique_ptr<Cursor> cursor_;
+        std::string dir_;
+        size_t total_ = 0;
+    };
+
+    // 使 path（目录本身或其中的文件）所在目录的索引失效
+    static void invalidate(const std::string& path);
+    // 使所有索引失效（例如清理了 /bookmarks）
+    static void invalidateAll();
+
+    // 索引文件路径
+    static std::string indexFileName(const std::string& dirPath, const std::string& extension);
+};
@@ -30,6 +30,50 @@ std::vector<FileInfo> EfficientFileScanner::scanDirectory(const std::string& dir
     return results;
 }
 
+bool EfficientFileScanner::forEachEntry(const std::string& dirPath, const std::string& extension,
+                                        const std::function<bool(const FileInfo&, time_t)>& fn) {
+    if (g_disable_sd_access) return false;
+    File dir = SDW::SD.open(dirPath.c_str());
+    if (!dir || !dir.isDirectory()) {
+        if (dir) dir.close();
+        return false;
+    }
+
+    std::string base = dirPath;
+    if (!base.empty() && base.back() == '/') base.pop_back();
+    FileInfo info;
+    int seen = 0;
+    while (true) {
+        File entry = dir.openNextFile();
+        if (!entry) break;
+
+        const char* namePtr = entry.name();
+        if (!namePtr || strlen(namePtr) == 0) {
+            entry.close();
+            continue;
+        }
+        info.name = getFileName(namePtr);
+        info.isDirectory = entry.isDirectory();
+        info.size = info.isDirectory ? 0 : entry.size();
+        time_t mtime = entry.getLastWrite();
+        entry.close();
+
+        bool include = info.isDirectory ? extension.empty()
+                                        : (extension.empty() || hasExtension(info.name, extension));
+        if (include) {
+            info.path = base + "/" + info.name;
+            if (!fn(info, mtime)) break;
+        }
+
+        // 每处理10个条目让出CPU控制权，防止watchdog超时
+        if (++seen % 10 == 0) {
+            yield();
+        }
+    }
+    dir.close();
+    return true;
+}
+
 int EfficientFileScanner::countFiles(const std::string& dirPath, const std::string& extension) {
 #if DBG_FILE_MANAGER
     Serial.printf("[EFS] 计数文件: %s, 扩展名: %s\n", dirPath.c_str(), extension.c_str());
@@ -163,6 +207,13 @@ size_t EfficientFileScanner::getFileSize(const std::string& filePath) {
 
 bool EfficientFileScanner::hasExtension(const std::string& filename, const std::string& extension) {
     if (extension.empty()) return true;
+
+    // 以 '|' 分隔的多个扩展名（如书籍的 ".txt|.txt.lz"）：匹配任意一个即可
+    size_t bar = extension.find('|');
+    if (bar != std::string::npos) {
+        return hasExtension(filename, extension.substr(0, bar)) ||
+               (bar + 1 < extension.length() && hasExtension(filename, extension.substr(bar + 1)));
+    }
     
     if (filename.length() < extension.length()) return false;
     
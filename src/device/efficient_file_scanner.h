@@ -4,6 +4,8 @@
 #include <SPIFFS.h>
 #include <vector>
 #include <string>
+#include <functional>
+#include <ctime>
 
 // 文件信息结构体 - 只包含基本信息，无需打开文件
 struct FileInfo {
@@ -34,6 +36,11 @@ public:
                                                    int page, int perPage, 
                                                    const std::string& extension = "");
     
+    // 逐项遍历目录（规则同 scanDirectory，但不设数量上限、不保存结果）：回调另得到修改时间，
+    // 返回 false 提前结束。目录打不开时返回 false
+    static bool forEachEntry(const std::string& dirPath, const std::string& extension,
+                             const std::function<bool(const FileInfo&, time_t)>& fn);
+
     // 检查文件是否存在（不打开文件）
     static bool fileExists(const std::string& filePath);
     
@@ -41,7 +48,7 @@ public:
     static size_t getFileSize(const std::string& filePath);
     
 private:
-    // 检查文件扩展名
+    // 检查文件扩展名（extension 可以是以 '|' 分隔的多个扩展名，匹配任意一个即可）
     static bool hasExtension(const std::string& filename, const std::string& extension);
     
     // 从完整路径获取文件名
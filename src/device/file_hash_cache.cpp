@@ -0,0 +1,267 @@
+#include "file_hash_cache.h"
+#include "globals.h"
+#include "test/per_file_debug.h"
+#include "device/safe_fs.h"
+#include "api/http_core.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// .filehash：魔数 | u32 条目数 | 条目（按键升序）。条目：u64 路径键 | u32 大小 | u32 修改时间 | u32 CRC
+static const char *HASH_FILE = "/bookmarks/.filehash";
+static const uint8_t HASH_MAGIC[4] = {'F', 'H', 'C', '1'};
+static const size_t HASH_RECORD = 20;
+static const size_t HASH_MAX_ENTRIES = 20000;
+static const size_t HASH_READ_CHUNK = 16 * 1024;
+
+struct HashEntry
+{
+    uint64_t key;
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t crc;
+};
+
+// 条目数上千时整块超过 16KB，malloc 自动落在 PSRAM
+static std::vector<HashEntry> s_entries;
+static bool s_loaded = false;
+static bool s_dirty = false;
+
+static uint64_t path_key(const std::string &path)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : path)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static void ensure_loaded()
+{
+    if (s_loaded || g_disable_sd_access)
+        return;
+    s_loaded = true;
+    s_entries.clear();
+
+    SafeFS::restoreFromTmpIfNeeded(HASH_FILE);
+    File f = SDW::SD.open(HASH_FILE, "r");
+    if (!f)
+        return;
+    uint8_t head[8];
+    uint32_t count = 0;
+    if (f.read(head, sizeof(head)) == sizeof(head) && memcmp(head, HASH_MAGIC, 4) == 0)
+        count = get_u32(head + 4);
+    if (count > HASH_MAX_ENTRIES || f.size() != sizeof(head) + (size_t)count * HASH_RECORD)
+        count = 0; // 损坏：当作空缓存，之后按需重算
+    s_entries.reserve(count);
+    uint8_t rec[HASH_RECORD];
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (f.read(rec, sizeof(rec)) != sizeof(rec))
+            break;
+        HashEntry e;
+        memcpy(&e.key, rec, 8);
+        e.size = get_u32(rec + 8);
+        e.mtime = get_u32(rec + 12);
+        e.crc = get_u32(rec + 16);
+        s_entries.push_back(e);
+    }
+    f.close();
+    std::sort(s_entries.begin(), s_entries.end(), [](const HashEntry &a, const HashEntry &b) { return a.key < b.key; });
+#if DBG_WIFI_HOTSPOT
+    Serial.printf("[FileHash] loaded %u entries\n", (unsigned)s_entries.size());
+#endif
+}
+
+static std::vector<HashEntry>::iterator lower(uint64_t key)
+{
+    return std::lower_bound(s_entries.begin(), s_entries.end(), key,
+                            [](const HashEntry &e, uint64_t k) { return e.key < k; });
+}
+
+bool FileHashCache::cached(const std::string &path, uint32_t size, uint32_t mtime, uint32_t &crc)
+{
+    ensure_loaded();
+    uint64_t key = path_key(path);
+    auto it = lower(key);
+    if (it == s_entries.end() || it->key != key || it->size != size || it->mtime != mtime)
+        return false;
+    crc = it->crc;
+    return true;
+}
+
+// 未算完的文件：大文件一次算不完时记下断点，下一次 /sync 接着读
+struct HashPartial
+{
+    uint64_t key;
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t offset;
+    uint32_t crc;
+};
+static HashPartial s_partial = {};
+static bool s_partial_valid = false;
+
+FileHashCache::Progress FileHashCache::compute(const std::string &path, uint32_t size, uint32_t mtime,
+                                               uint32_t budget_ms, uint32_t &crc)
+{
+    if (g_disable_sd_access)
+        return Progress::Failed;
+    uint64_t key = path_key(path);
+    uint32_t c = 0;
+    uint32_t total = 0;
+    if (s_partial_valid && s_partial.key == key && s_partial.size == size && s_partial.mtime == mtime)
+    {
+        c = s_partial.crc;
+        total = s_partial.offset;
+    }
+    s_partial_valid = false;
+
+    File f = SDW::SD.open(path.c_str(), "r");
+    if (!f)
+        return Progress::Failed;
+    if (total > 0 && !f.seek(total))
+    {
+        f.close();
+        return Progress::Failed;
+    }
+
+    // 内部 DMA 缓冲让 FATFS 对齐的整簇读直接落进来；内存紧张时退回小缓冲
+    size_t cap = HASH_READ_CHUNK;
+    uint8_t *buf = static_cast<uint8_t *>(heap_caps_malloc(cap, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+    if (!buf)
+    {
+        cap = 2048;
+        buf = static_cast<uint8_t *>(malloc(cap));
+    }
+    if (!buf)
+    {
+        f.close();
+        return Progress::Failed;
+    }
+
+    uint32_t t0 = millis();
+    bool ok = true;
+    bool done = false;
+    while (millis() - t0 < budget_ms)
+    {
+        int n = f.read(buf, cap);
+        if (n < 0)
+        {
+            ok = false;
+            break;
+        }
+        if (n == 0)
+        {
+            done = true;
+            break;
+        }
+        c = http_crc32(c, buf, (size_t)n);
+        total += (uint32_t)n;
+    }
+    heap_caps_free(buf);
+    f.close();
+    // 读到的长度与目录项不符说明文件在变化中，不记入缓存
+    if (!ok || total > size || (done && total != size))
+        return Progress::Failed;
+    if (!done)
+    {
+        s_partial = HashPartial{key, size, mtime, total, c};
+        s_partial_valid = true;
+#if DBG_WIFI_HOTSPOT
+        Serial.printf("[FileHash] %s: %u/%u bytes hashed, pending\n", path.c_str(), (unsigned)total, (unsigned)size);
+#endif
+        return Progress::Pending;
+    }
+
+    crc = c;
+    record(path, size, mtime, c);
+    return Progress::Done;
+}
+
+void FileHashCache::record(const std::string &path, uint32_t size, uint32_t mtime, uint32_t crc)
+{
+    ensure_loaded();
+    uint64_t key = path_key(path);
+    auto it = lower(key);
+    if (it != s_entries.end() && it->key == key)
+    {
+        it->size = size;
+        it->mtime = mtime;
+        it->crc = crc;
+    }
+    else
+    {
+        if (s_entries.size() >= HASH_MAX_ENTRIES)
+            return;
+        s_entries.insert(it, HashEntry{key, size, mtime, crc});
+    }
+    s_dirty = true;
+}
+
+void FileHashCache::forget(const std::string &path)
+{
+    ensure_loaded();
+    uint64_t key = path_key(path);
+    auto it = lower(key);
+    if (it != s_entries.end() && it->key == key)
+    {
+        s_entries.erase(it);
+        s_dirty = true;
+    }
+}
+
+void FileHashCache::save()
+{
+    if (!s_dirty || g_disable_sd_access)
+        return;
+    if (!SDW::SD.exists("/bookmarks"))
+        SDW::SD.mkdir("/bookmarks");
+    bool ok = SafeFS::safeWrite(HASH_FILE, [](File &f) {
+        uint8_t head[8];
+        memcpy(head, HASH_MAGIC, 4);
+        put_u32(head + 4, (uint32_t)s_entries.size());
+        if (f.write(head, sizeof(head)) != sizeof(head))
+            return false;
+        // 攒满一块再写，避免每条 20 字节一次 FATFS 调用
+        uint8_t block[HASH_RECORD * 64];
+        size_t fill = 0;
+        for (const HashEntry &e : s_entries)
+        {
+            uint8_t *rec = block + fill;
+            memcpy(rec, &e.key, 8);
+            put_u32(rec + 8, e.size);
+            put_u32(rec + 12, e.mtime);
+            put_u32(rec + 16, e.crc);
+            fill += HASH_RECORD;
+            if (fill == sizeof(block))
+            {
+                if (f.write(block, fill) != fill)
+                    return false;
+                fill = 0;
+            }
+        }
+        return fill == 0 || f.write(block, fill) == fill;
+    });
+    if (ok)
+        s_dirty = false;
+#if DBG_WIFI_HOTSPOT
+    Serial.printf("[FileHash] saved %u entries: %s\n", (unsigned)s_entries.size(), ok ? "ok" : "failed");
+#endif
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// 书库文件的内容散列缓存：CRC-32（与断点续传的块校验同一算法，见 http_crc32），持久化在 /bookmarks/.filehash。
+// 以完整路径为键，同时记下计算时的文件大小与修改时间，两者都与当前文件一致才算命中，
+// 因此经 USB 拷贝等途径改写过的文件会自动重算。/sync 比对清单时靠它避免反复整文件读取。
+// 只在 HTTP 任务中使用（上传、删除、同步），不加锁。
+class FileHashCache {
+public:
+    // 缓存命中时给出 CRC，不读文件
+    static bool cached(const std::string& path, uint32_t size, uint32_t mtime, uint32_t& crc);
+    enum class Progress { Done, Pending, Failed };
+    // 分段读取计算 CRC，最多占用 budget_ms 毫秒：读完记入缓存并返回 Done；没读完返回 Pending，
+    // 进度（偏移 + 累计 CRC）留在内存，下次对同一文件（大小、修改时间不变）调用时从断点继续。
+    // 只保留一个文件的进度，换算别的文件时丢弃。文件打不开、读取出错或长度不符返回 Failed
+    static Progress compute(const std::string& path, uint32_t size, uint32_t mtime, uint32_t budget_ms, uint32_t& crc);
+    // 已知 CRC（例如上传时边收边算）：直接记入
+    static void record(const std::string& path, uint32_t size, uint32_t mtime, uint32_t crc);
+    // 文件被删除或以未知内容替换
+    static void forget(const std::string& path);
+    // 有修改时原子写回（SafeFS）；同步一批文件后调用一次即可
+    static void save();
+};
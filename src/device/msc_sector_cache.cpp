@@ -0,0 +1,594 @@
+#include "msc_sector_cache.h"
+#include "readpaper.h"
+#include "tasks/task_priorities.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+static const uint32_t SECTOR = 512;
+static const uint32_t NO_LBA = 0xFFFFFFFFu;
+
+struct CacheLine
+{
+    uint32_t base;  // 行首扇区（MSC_CACHE_LINE_SECTORS 对齐）
+    uint32_t used;  // LRU 时间戳
+    bool valid;
+    bool dirty;
+};
+
+struct CacheStats
+{
+    uint32_t reads;       // 读请求
+    uint32_t line_hits;   // 行缓存命中的片段
+    uint32_t line_fills;  // 整行载入
+    uint32_t ra_hits;     // 预读窗口命中的片段
+    uint32_t ra_fills;    // 预读窗口填充
+    uint32_t writes;      // 写请求
+    uint32_t meta_writes; // 写回到 FAT 区缓存行的写请求
+    uint32_t gathered;    // 并入写聚合窗口的写请求
+    uint32_t direct;      // 直写卡的写请求
+    uint32_t sd_writes;   // 实际写卡命令（聚合窗口 / 脏行落盘 / 直写）
+    uint32_t errors;
+};
+
+static msc_sector_io_fn s_io = nullptr;
+static uint32_t s_sectors = 0;
+static bool s_ready = false;
+static SemaphoreHandle_t s_lock = nullptr;
+static TaskHandle_t s_flusher = nullptr;
+static uint8_t *s_dma = nullptr; // 内部 DMA 中转，MSC_CACHE_DMA_SECTORS 扇区
+
+static CacheLine s_lines[MSC_CACHE_LINES];
+static uint8_t *s_line_data = nullptr; // PSRAM，MSC_CACHE_LINES 行
+static uint32_t s_tick = 0;
+static uint32_t s_dirty_lines = 0;
+
+static uint8_t *s_ra = nullptr; // 预读窗口 [s_ra_lba, s_ra_lba + s_ra_count)
+static uint32_t s_ra_lba = 0;
+static uint32_t s_ra_count = 0;
+static uint32_t s_next_read = NO_LBA; // 上一次读请求的终点，用于判断顺序读
+
+static uint8_t *s_wg = nullptr; // 写聚合窗口 [s_wg_lba, s_wg_lba + s_wg_count)
+static uint32_t s_wg_lba = 0;
+static uint32_t s_wg_count = 0;
+
+// FAT 区 [s_meta_begin, s_meta_end) 与分区起点（引导扇区被改写时重新解析）
+static uint32_t s_part_lba = 0;
+static uint32_t s_meta_begin = 0;
+static uint32_t s_meta_end = 0;
+
+static uint32_t s_last_write_ms = 0;
+static uint32_t s_dirty_since_ms = 0;
+// 已向主机应答成功、落盘时却写失败（替换脏行、后台落盘等调用方不检查返回值的路径），
+// 留到下一次 msc_cache_flush 报告
+static bool s_lost_write = false;
+static CacheStats s_stats{};
+
+static inline bool overlaps(uint32_t a, uint32_t an, uint32_t b, uint32_t bn)
+{
+    return an > 0 && bn > 0 && a < b + bn && b < a + an;
+}
+
+static inline uint8_t *line_ptr(int i)
+{
+    return s_line_data + (size_t)i * MSC_CACHE_LINE_SECTORS * SECTOR;
+}
+
+static inline uint32_t line_len(uint32_t base)
+{
+    uint32_t rest = s_sectors - base;
+    return rest < MSC_CACHE_LINE_SECTORS ? rest : MSC_CACHE_LINE_SECTORS;
+}
+
+static inline bool has_dirty()
+{
+    return s_dirty_lines > 0 || s_wg_count > 0;
+}
+
+// 即将产生脏数据：记下最早的时间点，供后台任务判断最长驻留
+static inline void note_dirty()
+{
+    if (!has_dirty())
+        s_dirty_since_ms = millis();
+}
+
+// PSRAM <-> 卡：经内部 DMA 缓冲分段
+static bool dev_io(uint32_t lba, uint8_t *data, uint32_t count, bool write)
+{
+    if (!s_dma)
+        return s_io(lba, data, count, write);
+    while (count > 0)
+    {
+        uint32_t n = count < MSC_CACHE_DMA_SECTORS ? count : MSC_CACHE_DMA_SECTORS;
+        if (write)
+            memcpy(s_dma, data, (size_t)n * SECTOR);
+        if (!s_io(lba, s_dma, n, write))
+            return false;
+        if (!write)
+            memcpy(data, s_dma, (size_t)n * SECTOR);
+        lba += n;
+        data += (size_t)n * SECTOR;
+        count -= n;
+    }
+    return true;
+}
+
+static bool wg_flush()
+{
+    if (s_wg_count == 0)
+        return true;
+    bool ok = dev_io(s_wg_lba, s_wg, s_wg_count, true);
+    s_stats.sd_writes++;
+    if (!ok)
+    {
+        s_stats.errors++;
+        s_lost_write = true;
+        Serial.printf("[MSC_CACHE] Write-gather flush failed: lba=%u count=%u\n", (unsigned)s_wg_lba, (unsigned)s_wg_count);
+    }
+    // 失败也丢弃：主机已得到成功应答，保留只会在之后反复重试同一段；由 s_lost_write 报告
+    s_wg_count = 0;
+    return ok;
+}
+
+static bool line_writeback(int i)
+{
+    CacheLine &l = s_lines[i];
+    if (!l.dirty)
+        return true;
+    bool ok = dev_io(l.base, line_ptr(i), line_len(l.base), true);
+    s_stats.sd_writes++;
+    if (!ok)
+    {
+        s_stats.errors++;
+        s_lost_write = true;
+        Serial.printf("[MSC_CACHE] Line writeback failed: lba=%u\n", (unsigned)l.base);
+    }
+    l.dirty = false;
+    s_dirty_lines--;
+    return ok;
+}
+
+static bool flush_locked()
+{
+    bool ok = wg_flush();
+    for (int i = 0; i < MSC_CACHE_LINES && s_dirty_lines > 0; ++i)
+    {
+        if (s_lines[i].valid && s_lines[i].dirty)
+            ok = line_writeback(i) && ok;
+    }
+    return ok;
+}
+
+static int line_find(uint32_t base)
+{
+    for (int i = 0; i < MSC_CACHE_LINES; ++i)
+    {
+        if (s_lines[i].valid && s_lines[i].base == base)
+            return i;
+    }
+    return -1;
+}
+
+// 从卡载入一行；替换最久未用的行（优先空行与干净行，全部是脏行时先把被替换的行落盘）
+static int line_load(uint32_t base)
+{
+    int victim = -1;
+    int victim_dirty = -1;
+    for (int i = 0; i < MSC_CACHE_LINES; ++i)
+    {
+        const CacheLine &l = s_lines[i];
+        if (!l.valid)
+        {
+            victim = i;
+            break;
+        }
+        if (l.dirty)
+        {
+            if (victim_dirty < 0 || l.used < s_lines[victim_dirty].used)
+                victim_dirty = i;
+        }
+        else if (victim < 0 || l.used < s_lines[victim].used)
+        {
+            victim = i;
+        }
+    }
+    if (victim < 0)
+    {
+        victim = victim_dirty;
+        line_writeback(victim);
+    }
+
+    uint32_t n = line_len(base);
+    // 写聚合窗口里的数据比卡上新，载入前先落盘
+    if (overlaps(base, n, s_wg_lba, s_wg_count))
+        wg_flush();
+
+    CacheLine &l = s_lines[victim];
+    l.valid = false;
+    if (!dev_io(base, line_ptr(victim), n, false))
+    {
+        s_stats.errors++;
+        return -1;
+    }
+    l.base = base;
+    l.valid = true;
+    l.dirty = false;
+    l.used = ++s_tick;
+    s_stats.line_fills++;
+    return victim;
+}
+
+// 把写入的数据覆盖到与之重叠的缓存副本（行缓存与预读窗口）
+static void patch_copies(uint32_t lba, const uint8_t *buf, uint32_t count, bool lines)
+{
+    if (overlaps(lba, count, s_ra_lba, s_ra_count))
+    {
+        uint32_t from = lba > s_ra_lba ? lba : s_ra_lba;
+        uint32_t to = lba + count < s_ra_lba + s_ra_count ? lba + count : s_ra_lba + s_ra_count;
+        memcpy(s_ra + (size_t)(from - s_ra_lba) * SECTOR, buf + (size_t)(from - lba) * SECTOR, (size_t)(to - from) * SECTOR);
+    }
+    if (!lines)
+        return;
+    uint32_t first = lba - lba % MSC_CACHE_LINE_SECTORS;
+    for (uint32_t base = first; base < lba + count; base += MSC_CACHE_LINE_SECTORS)
+    {
+        int i = line_find(base);
+        if (i < 0)
+            continue;
+        uint32_t from = lba > base ? lba : base;
+        uint32_t end = base + line_len(base);
+        uint32_t to = lba + count < end ? lba + count : end;
+        memcpy(line_ptr(i) + (size_t)(from - base) * SECTOR, buf + (size_t)(from - lba) * SECTOR, (size_t)(to - from) * SECTOR);
+    }
+}
+
+// 从 lba 起填充预读窗口；脏行比卡上新，填充后覆盖进窗口
+static bool ra_fill(uint32_t lba)
+{
+    uint32_t n = s_sectors - lba;
+    if (n > MSC_READAHEAD_SECTORS)
+        n = MSC_READAHEAD_SECTORS;
+    if (overlaps(lba, n, s_wg_lba, s_wg_count))
+        wg_flush();
+
+    s_ra_count = 0;
+    if (!dev_io(lba, s_ra, n, false))
+    {
+        s_stats.errors++;
+        return false;
+    }
+    s_ra_lba = lba;
+    s_ra_count = n;
+    s_stats.ra_fills++;
+    for (int i = 0; i < MSC_CACHE_LINES && s_dirty_lines > 0; ++i)
+    {
+        const CacheLine &l = s_lines[i];
+        if (l.valid && l.dirty && overlaps(l.base, line_len(l.base), lba, n))
+            patch_copies(l.base, line_ptr(i), line_len(l.base), false);
+    }
+    return true;
+}
+
+static inline uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool is_boot_sector(const uint8_t *b)
+{
+    if (b[510] != 0x55 || b[511] != 0xAA || (b[0] != 0xEB && b[0] != 0xE9))
+        return false;
+    return memcmp(b + 3, "EXFAT   ", 8) == 0 || rd16(b + 0x0B) == SECTOR;
+}
+
+// 解析 FAT 区范围：MBR 第一个分区（或无分区表的整卡）的保留区 + FAT 表（+ FAT12/16 根目录）。
+// 无法识别时 FAT 区为空，所有写都按普通数据处理
+static void detect_layout(uint8_t *b)
+{
+    s_part_lba = 0;
+    s_meta_begin = s_meta_end = 0;
+    if (!s_io(0, b, 1, false))
+        return;
+    if (!is_boot_sector(b))
+    {
+        if (b[510] != 0x55 || b[511] != 0xAA)
+            return;
+        const uint8_t *entry = b + 0x1BE;
+        uint32_t part = rd32(entry + 8);
+        if (entry[4] == 0 || part == 0 || part >= s_sectors)
+            return;
+        if (!s_io(part, b, 1, false) || !is_boot_sector(b))
+            return;
+        s_part_lba = part;
+    }
+
+    uint64_t end;
+    if (memcmp(b + 3, "EXFAT   ", 8) == 0)
+    {
+        end = (uint64_t)s_part_lba + rd32(b + 0x50) + (uint64_t)rd32(b + 0x54) * b[0x6E];
+    }
+    else
+    {
+        uint32_t fat_size = rd16(b + 0x16);
+        if (fat_size == 0)
+            fat_size = rd32(b + 0x24);
+        uint32_t root_sectors = ((uint32_t)rd16(b + 0x11) * 32 + SECTOR - 1) / SECTOR;
+        end = (uint64_t)s_part_lba + rd16(b + 0x0E) + (uint64_t)b[0x10] * fat_size + root_sectors;
+    }
+    if (end <= s_part_lba || end > s_sectors)
+        return;
+    s_meta_begin = s_part_lba;
+    s_meta_end = (uint32_t)end;
+}
+
+static void flusher_entry(void *)
+{
+    for (;;)
+    {
+        vTaskDelay(pdMS_TO_TICKS(MSC_CACHE_FLUSH_POLL_MS));
+        if (xSemaphoreTake(s_lock, portMAX_DELAY) != pdTRUE)
+            continue;
+        if (has_dirty())
+        {
+            uint32_t now = millis();
+            if (now - s_last_write_ms >= MSC_CACHE_FLUSH_IDLE_MS || now - s_dirty_since_ms >= MSC_CACHE_FLUSH_MAX_MS)
+                flush_locked();
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+bool msc_cache_begin(uint32_t sector_count, msc_sector_io_fn io)
+{
+    s_io = io;
+    s_sectors = sector_count;
+    if (s_ready)
+        return true;
+
+    if (!s_lock)
+        s_lock = xSemaphoreCreateMutex();
+    // 内部 RAM 紧张时退回直接对 PSRAM 读写（驱动内部逐扇区中转，仍比没有缓存快）
+    if (!s_dma)
+        s_dma = static_cast<uint8_t *>(heap_caps_malloc((size_t)MSC_CACHE_DMA_SECTORS * SECTOR, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+    s_line_data = static_cast<uint8_t *>(heap_caps_aligned_alloc(64, (size_t)MSC_CACHE_LINES * MSC_CACHE_LINE_SECTORS * SECTOR, MALLOC_CAP_SPIRAM));
+    s_ra = static_cast<uint8_t *>(heap_caps_aligned_alloc(64, (size_t)MSC_READAHEAD_SECTORS * SECTOR, MALLOC_CAP_SPIRAM));
+#if MSC_CACHE_WRITE_BACK
+    s_wg = static_cast<uint8_t *>(heap_caps_aligned_alloc(64, (size_t)MSC_WRITE_GATHER_SECTORS * SECTOR, MALLOC_CAP_SPIRAM));
+#endif
+    bool ok = s_lock && s_line_data && s_ra;
+#if MSC_CACHE_WRITE_BACK
+    ok = ok && s_wg;
+    if (ok && xTaskCreatePinnedToCore(flusher_entry, "MscFlush", 3072, nullptr, PRIO_MSC_FLUSH, &s_flusher, 0) != pdPASS)
+    {
+        s_flusher = nullptr;
+        ok = false;
+    }
+#endif
+    if (!ok)
+    {
+        Serial.println("[MSC_CACHE] Not enough memory, using direct sector access");
+        heap_caps_free(s_line_data);
+        heap_caps_free(s_ra);
+        heap_caps_free(s_wg);
+        s_line_data = s_ra = s_wg = nullptr;
+        return false;
+    }
+
+    memset(s_lines, 0, sizeof(s_lines));
+    s_stats = CacheStats{};
+    s_lost_write = false;
+    uint8_t sector[SECTOR];
+    detect_layout(s_dma ? s_dma : sector);
+    s_ready = true;
+    Serial.printf("[MSC_CACHE] lines=%u x %u sectors, readahead=%u, write_back=%d, fat_region=[%u,%u)\n",
+                  (unsigned)MSC_CACHE_LINES, (unsigned)MSC_CACHE_LINE_SECTORS, (unsigned)MSC_READAHEAD_SECTORS,
+                  (int)MSC_CACHE_WRITE_BACK, (unsigned)s_meta_begin, (unsigned)s_meta_end);
+    return true;
+}
+
+bool msc_cache_read(uint32_t lba, uint8_t *buf, uint32_t count)
+{
+    if (!s_ready)
+        return s_io(lba, buf, count, false);
+    if (count == 0 || lba >= s_sectors || count > s_sectors - lba)
+        return false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.reads++;
+    bool sequential = lba == s_next_read;
+    s_next_read = lba + count;
+    bool ok = true;
+    while (count > 0)
+    {
+        uint32_t n;
+        if (overlaps(lba, 1, s_ra_lba, s_ra_count))
+        {
+            // 预读窗口与脏行保持一致（填充时覆盖、写入时就地更新），可直接复制
+            n = s_ra_lba + s_ra_count - lba;
+            if (n > count)
+                n = count;
+            memcpy(buf, s_ra + (size_t)(lba - s_ra_lba) * SECTOR, (size_t)n * SECTOR);
+            s_stats.ra_hits++;
+        }
+        else
+        {
+            uint32_t base = lba - lba % MSC_CACHE_LINE_SECTORS;
+            int i = line_find(base);
+            if (i < 0 && (sequential || count > MSC_CACHE_LINE_SECTORS))
+            {
+                // 顺序读（或一次请求超过一行）：整段预读，下一轮从窗口复制
+                if (ra_fill(lba))
+                    continue;
+            }
+            if (i < 0)
+            {
+                i = line_load(base);
+                if (i < 0)
+                {
+                    ok = false;
+                    break;
+                }
+            }
+            else
+            {
+                s_stats.line_hits++;
+            }
+            s_lines[i].used = ++s_tick;
+            n = base + line_len(base) - lba;
+            if (n > count)
+                n = count;
+            memcpy(buf, line_ptr(i) + (size_t)(lba - base) * SECTOR, (size_t)n * SECTOR);
+        }
+        lba += n;
+        buf += (size_t)n * SECTOR;
+        count -= n;
+    }
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+bool msc_cache_write(uint32_t lba, const uint8_t *buf, uint32_t count)
+{
+    if (!s_ready)
+        return s_io(lba, const_cast<uint8_t *>(buf), count, true);
+    if (count == 0 || lba >= s_sectors || count > s_sectors - lba)
+        return false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.writes++;
+    s_last_write_ms = millis();
+    // 引导扇区被改写（重新格式化）：写完后全部落盘并重新解析 FAT 区
+    bool boot = overlaps(lba, count, 0, 1) || overlaps(lba, count, s_part_lba, 1);
+    bool ok = true;
+
+#if MSC_CACHE_WRITE_BACK
+    // 只有完全落在 FAT 区外的写才聚合：FAT 区的新数据只在缓存行里，聚合窗口不能再带一份旧的
+    bool gather = !boot && !overlaps(lba, count, s_meta_begin, s_meta_end - s_meta_begin);
+    if (!boot && lba >= s_meta_begin && lba + count <= s_meta_end)
+    {
+        // FAT 区：只改缓存行并标脏（行不在缓存时先整行载入，落盘时整行写回）
+        s_stats.meta_writes++;
+        patch_copies(lba, buf, count, false);
+        uint32_t left = count;
+        uint32_t at = lba;
+        const uint8_t *src = buf;
+        while (left > 0)
+        {
+            uint32_t base = at - at % MSC_CACHE_LINE_SECTORS;
+            uint32_t n = base + line_len(base) - at;
+            if (n > left)
+                n = left;
+            int i = line_find(base);
+            if (i < 0)
+                i = line_load(base);
+            if (i < 0)
+            {
+                // 载入失败：这一段直写
+                ok = s_io(at, const_cast<uint8_t *>(src), n, true) && ok;
+            }
+            else
+            {
+                memcpy(line_ptr(i) + (size_t)(at - base) * SECTOR, src, (size_t)n * SECTOR);
+                s_lines[i].used = ++s_tick;
+                if (!s_lines[i].dirty)
+                {
+                    note_dirty();
+                    s_lines[i].dirty = true;
+                    s_dirty_lines++;
+                }
+            }
+            at += n;
+            src += (size_t)n * SECTOR;
+            left -= n;
+        }
+        xSemaphoreGive(s_lock);
+        return ok;
+    }
+#endif
+
+    // 普通写：先更新缓存中的副本（脏行随后整行落盘，写入的是同样的新数据）
+    patch_copies(lba, buf, count, true);
+#if MSC_CACHE_WRITE_BACK
+    if (gather && s_wg_count > 0 && lba == s_wg_lba + s_wg_count && s_wg_count + count <= MSC_WRITE_GATHER_SECTORS)
+    {
+        memcpy(s_wg + (size_t)s_wg_count * SECTOR, buf, (size_t)count * SECTOR);
+        s_wg_count += count;
+        s_stats.gathered++;
+    }
+    else
+    {
+        ok = wg_flush();
+        if (gather && count < MSC_WRITE_GATHER_SECTORS)
+        {
+            note_dirty();
+            memcpy(s_wg, buf, (size_t)count * SECTOR);
+            s_wg_lba = lba;
+            s_wg_count = count;
+            s_stats.gathered++;
+        }
+        else
+        {
+            ok = s_io(lba, const_cast<uint8_t *>(buf), count, true) && ok;
+            s_stats.direct++;
+            s_stats.sd_writes++;
+        }
+    }
+    if (s_wg_count == MSC_WRITE_GATHER_SECTORS)
+        ok = wg_flush() && ok;
+#else
+    ok = s_io(lba, const_cast<uint8_t *>(buf), count, true);
+    s_stats.direct++;
+    s_stats.sd_writes++;
+#endif
+    if (!ok)
+        s_stats.errors++;
+
+    if (boot)
+    {
+        ok = flush_locked() && ok;
+        uint8_t sector[SECTOR];
+        detect_layout(s_dma ? s_dma : sector);
+    }
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+bool msc_cache_flush()
+{
+    if (!s_ready)
+        return true;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = flush_locked() && !s_lost_write;
+    s_lost_write = false;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+bool msc_cache_dirty()
+{
+    if (!s_ready)
+        return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool dirty = has_dirty();
+    xSemaphoreGive(s_lock);
+    return dirty;
+}
+
+void msc_cache_log_stats()
+{
+    if (!s_ready)
+        return;
+    Serial.printf("[MSC_CACHE] reads=%u line_hits=%u line_fills=%u ra_hits=%u ra_fills=%u writes=%u meta=%u gathered=%u direct=%u sd_writes=%u errors=%u\n",
+                  (unsigned)s_stats.reads, (unsigned)s_stats.line_hits, (unsigned)s_stats.line_fills,
+                  (unsigned)s_stats.ra_hits, (unsigned)s_stats.ra_fills, (unsigned)s_stats.writes,
+                  (unsigned)s_stats.meta_writes, (unsigned)s_stats.gathered, (unsigned)s_stats.direct,
+                  (unsigned)s_stats.sd_writes, (unsigned)s_stats.errors);
+}
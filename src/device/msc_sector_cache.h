@@ -0,0 +1,37 @@
+#pragma once
+// USB 大容量存储的扇区缓存（PSRAM）：TinyUSB 每次只递来 EP 缓冲大小（几 KB）的读写请求，
+// 逐个直接转成 sdmmc 命令时 SD 卡的时间大多花在命令开销上，FAT 表与目录扇区还被主机反复读取。
+//
+// - 行缓存：MSC_CACHE_LINES 行、每行 MSC_CACHE_LINE_SECTORS 扇区（按行对齐），LRU 替换；
+//   非顺序的小读请求整行载入，FAT/目录扇区的重复读取在这里命中
+// - 预读窗口：请求起点紧接上一次读的终点即视为顺序读，从该点一次读入 MSC_READAHEAD_SECTORS 扇区，
+//   之后的小块顺序读直接从窗口复制
+// - 写回（MSC_CACHE_WRITE_BACK）：落在 FAT 区（保留区 + FAT 表 + FAT12/16 根目录，启动时从引导扇区解析）
+//   的写只改缓存行并标脏，反复改写同一 FAT 扇区只落盘一次；其余写入与上一次写首尾相接时聚合进
+//   写聚合窗口，凑满或不再相接时整段写卡。写入空闲 MSC_CACHE_FLUSH_IDLE_MS、或脏数据驻留超过
+//   MSC_CACHE_FLUSH_MAX_MS 后由后台任务落盘；主机发 SYNCHRONIZE CACHE、弹出、停止前全部落盘
+// - 关闭写回时所有写都直写卡；无论哪种模式，缓存中的副本都随写入就地更新
+//
+// SD 读写经一块内部 DMA 缓冲按 MSC_CACHE_DMA_SECTORS 分段（SDMMC 不能直接对 PSRAM 做 DMA）。
+// 接口可被 USB 回调、后台落盘任务与弹出等待任务并发调用，内部以互斥锁串行化。
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 扇区读写后端：count 个 512 字节扇区，buf 为 DMA 可用内存；成功返回 true
+typedef bool (*msc_sector_io_fn)(uint32_t lba, uint8_t *buf, uint32_t count, bool write);
+
+// 分配缓存并启动后台落盘任务；sector_count 为卡的总扇区数。
+// 内存不足时返回 false，此后读写直接转给后端（与没有缓存时相同）
+bool msc_cache_begin(uint32_t sector_count, msc_sector_io_fn io);
+
+bool msc_cache_read(uint32_t lba, uint8_t *buf, uint32_t count);
+bool msc_cache_write(uint32_t lba, const uint8_t *buf, uint32_t count);
+
+// 把所有脏数据写到卡上。本次任何一段写失败、或自上次调用以来有已应答的写在落盘时失败
+// （替换脏行、后台落盘）都返回 false，报告后清除
+bool msc_cache_flush();
+// 是否还有未落盘的数据
+bool msc_cache_dirty();
+
+void msc_cache_log_stats();
@@ -98,6 +98,34 @@ namespace SafeFS
         return false;
     }
 
+    // Promote a large, already-verified tmp file (e.g. a resumable upload) without copying it.
+    // promoteTmpToFinal() copies when the destination exists, which takes minutes for tens of MB.
+    // Here the old destination is parked at <final>.bak, tmp is renamed into place, then the
+    // backup is dropped; if the second rename fails the backup is moved back.
+    inline bool promoteLargeTmpToFinal(const std::string &tmp, const std::string &final)
+    {
+        File src = SDW::SD.open(tmp.c_str(), "r");
+        if (!src)
+            return false;
+        src.close();
+
+        if (!SDW::SD.exists(final.c_str()))
+            return SDW::SD.rename(tmp.c_str(), final.c_str());
+
+        const std::string bak = final + ".bak";
+        if (SDW::SD.exists(bak.c_str()))
+            SDW::SD.remove(bak.c_str());
+        if (!SDW::SD.rename(final.c_str(), bak.c_str()))
+            return false;
+        if (!SDW::SD.rename(tmp.c_str(), final.c_str()))
+        {
+            SDW::SD.rename(bak.c_str(), final.c_str());
+            return false;
+        }
+        SDW::SD.remove(bak.c_str());
+        return true;
+    }
+
     // Safely write a file using a writer functor. The writer should return true on success.
     // The function creates <path>.tmp, invokes writer(file), flushes, closes, then promotes tmp -> final.
     inline bool safeWrite(const std::string &path, const std::function<bool(File &)> &writer)
@@ -0,0 +1,294 @@
+#include "sd_write_pipeline.h"
+#include "tasks/task_priorities.h"
+#include "test/per_file_debug.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+// 所有流水线共用的写入任务、作业队列与内部 DMA 中转缓冲（首次上传时创建，此后常驻）
+static QueueHandle_t s_jobs = nullptr;
+static TaskHandle_t s_writer = nullptr;
+static uint8_t *s_dma = nullptr;
+static SdWritePipeline::Stats s_stats{};
+
+SdWritePipeline::~SdWritePipeline()
+{
+    if (active())
+        abort();
+}
+
+bool SdWritePipeline::ensureWriter()
+{
+    if (!s_dma)
+    {
+        // 内部 RAM 紧张时退回直接写 PSRAM 缓冲（仍是大块写，只是驱动内部逐扇区中转）
+        s_dma = static_cast<uint8_t *>(heap_caps_malloc(UPLOAD_PIPELINE_DMA_CHUNK, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+    }
+    if (!s_jobs)
+    {
+        s_jobs = xQueueCreate(UPLOAD_PIPELINE_QUEUE_LEN, sizeof(Job));
+        if (!s_jobs)
+            return false;
+    }
+    if (!s_writer)
+    {
+        // 与 HTTP 任务同在核心0：HTTP 任务大部分时间阻塞在 select()，写卡期间正好让出
+        if (xTaskCreatePinnedToCore(writerEntry, "SdWriter", UPLOAD_PIPELINE_TASK_STACK, nullptr, PRIO_SD_WRITER, &s_writer, 0) != pdPASS)
+        {
+            s_writer = nullptr;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SdWritePipeline::begin(fs::File file)
+{
+    if (active() || !file || !ensureWriter())
+        return false;
+
+    free_ = xQueueCreate(UPLOAD_PIPELINE_BUFFERS, sizeof(uint8_t));
+    if (!free_)
+        return false;
+    for (uint8_t i = 0; i < UPLOAD_PIPELINE_BUFFERS; ++i)
+    {
+        bufs_[i] = static_cast<uint8_t *>(heap_caps_aligned_alloc(64, UPLOAD_PIPELINE_BUFFER_SIZE, MALLOC_CAP_SPIRAM));
+        if (!bufs_[i])
+        {
+            release();
+            return false;
+        }
+        xQueueSend(free_, &i, 0);
+    }
+
+    file_ = file;
+    cur_ = -1;
+    fill_ = 0;
+    queued_ = 0;
+    error_ = false;
+    busy_ = false;
+    start_ms_ = millis();
+    s_stats.active++;
+    return true;
+}
+
+bool SdWritePipeline::acquire()
+{
+    uint8_t idx = 0;
+    if (xQueueReceive(free_, &idx, 0) != pdTRUE)
+    {
+        // 所有缓冲都在排队写卡：SD 跟不上网络。只短暂等待，HTTP 任务还要服务其他连接
+        uint32_t t0 = millis();
+        bool ok = xQueueReceive(free_, &idx, pdMS_TO_TICKS(UPLOAD_PIPELINE_STALL_WAIT_MS)) == pdTRUE;
+        s_stats.stalls++;
+        s_stats.stall_ms += millis() - t0;
+        if (!ok)
+        {
+            busy_ = true;
+            s_stats.busy++;
+            return false;
+        }
+    }
+    cur_ = idx;
+    fill_ = 0;
+    return true;
+}
+
+bool SdWritePipeline::submitCurrent()
+{
+    Job job{this, (uint8_t)cur_, (uint32_t)fill_};
+    cur_ = -1;
+    fill_ = 0;
+    // 作业队列长度不小于所有流水线的缓冲总数时不会阻塞；万一满了就等写入任务取走
+    return xQueueSend(s_jobs, &job, portMAX_DELAY) == pdTRUE;
+}
+
+SdWritePipeline::Status SdWritePipeline::write(const uint8_t *data, size_t len)
+{
+    if (!active() || busy_)
+        return busy_ ? Status::Busy : Status::Failed;
+    while (len > 0)
+    {
+        if (error_)
+            return Status::Failed;
+        if (cur_ < 0 && !acquire())
+            return Status::Busy;
+        size_t n = UPLOAD_PIPELINE_BUFFER_SIZE - fill_;
+        if (n > len)
+            n = len;
+        memcpy(bufs_[cur_] + fill_, data, n);
+        fill_ += n;
+        data += n;
+        len -= n;
+        queued_ += n;
+        if (fill_ == UPLOAD_PIPELINE_BUFFER_SIZE && !submitCurrent())
+        {
+            error_ = true;
+            return Status::Failed;
+        }
+    }
+    return error_ ? Status::Failed : Status::Ok;
+}
+
+bool SdWritePipeline::waitIdle()
+{
+    // 在途的缓冲全部回到空闲队列（写入任务按顺序处理，不会永远不还；出错后它只跳过不写）
+    uint32_t t0 = millis();
+    while (uxQueueMessagesWaiting(free_) < UPLOAD_PIPELINE_BUFFERS)
+    {
+        if (millis() - t0 >= UPLOAD_PIPELINE_IDLE_TIMEOUT_MS)
+            break;
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    if (uxQueueMessagesWaiting(free_) == UPLOAD_PIPELINE_BUFFERS)
+        return true;
+
+    // 超时：按失败处理，写入任务跳过本流水线余下的缓冲。正在写的那一段仍引用缓冲与文件，
+    // 必须等它返回后才能释放（只剩一次写卡调用）
+    Serial.printf("[SdWriter] Error: buffers not written within %ums\n", (unsigned)UPLOAD_PIPELINE_IDLE_TIMEOUT_MS);
+    error_ = true;
+    while (uxQueueMessagesWaiting(free_) < UPLOAD_PIPELINE_BUFFERS)
+        vTaskDelay(pdMS_TO_TICKS(2));
+    return false;
+}
+
+bool SdWritePipeline::finish()
+{
+    if (!active())
+        return false;
+    if (cur_ >= 0)
+    {
+        if (fill_ > 0 && !error_)
+        {
+            if (!submitCurrent())
+                error_ = true;
+        }
+        if (cur_ >= 0)
+        {
+            uint8_t idx = (uint8_t)cur_;
+            xQueueSend(free_, &idx, 0);
+            cur_ = -1;
+        }
+    }
+    bool ok = waitIdle() && !error_;
+    file_.flush();
+    file_.close();
+    if (ok)
+    {
+        s_stats.completed++;
+        s_stats.last_bytes = (uint32_t)queued_;
+        s_stats.last_ms = millis() - start_ms_;
+    }
+    else
+    {
+        s_stats.errors++;
+    }
+#if DBG_WIFI_HOTSPOT
+    Serial.printf("[SdWriter] %s: %u bytes in %ums\n", ok ? "done" : "failed", (unsigned)queued_, (unsigned)(millis() - start_ms_));
+#endif
+    release();
+    return ok;
+}
+
+void SdWritePipeline::abort()
+{
+    if (!active())
+        return;
+    error_ = true; // 写入任务见到后不再写本流水线排队的缓冲
+    if (cur_ >= 0)
+    {
+        uint8_t idx = (uint8_t)cur_;
+        xQueueSend(free_, &idx, 0);
+        cur_ = -1;
+    }
+    waitIdle();
+    file_.close();
+    release();
+}
+
+void SdWritePipeline::release()
+{
+    for (auto &buf : bufs_)
+    {
+        if (buf)
+            heap_caps_free(buf);
+        buf = nullptr;
+    }
+    if (free_)
+    {
+        vQueueDelete(free_);
+        free_ = nullptr;
+        if (s_stats.active > 0)
+            s_stats.active--;
+    }
+}
+
+// 把一个 PSRAM 缓冲写进文件：经内部 DMA 缓冲分段（段长为扇区整数倍），每段一次 write
+static bool write_burst(fs::File &file, const uint8_t *src, size_t len)
+{
+    if (!s_dma)
+        return file.write(src, len) == len;
+    while (len > 0)
+    {
+        size_t n = len < UPLOAD_PIPELINE_DMA_CHUNK ? len : UPLOAD_PIPELINE_DMA_CHUNK;
+        memcpy(s_dma, src, n);
+        if (file.write(s_dma, n) != n)
+            return false;
+        src += n;
+        len -= n;
+    }
+    return true;
+}
+
+void SdWritePipeline::writerEntry(void *arg)
+{
+    (void)arg;
+    writerLoop();
+}
+
+void SdWritePipeline::writerLoop()
+{
+    for (;;)
+    {
+        Job job;
+        if (xQueueReceive(s_jobs, &job, portMAX_DELAY) != pdTRUE || !job.owner)
+            continue;
+        SdWritePipeline *p = job.owner;
+        if (!p->error_)
+        {
+            uint32_t t0 = millis();
+            bool ok = write_burst(p->file_, p->bufs_[job.index], job.len);
+            uint32_t dt = millis() - t0;
+            s_stats.bursts++;
+            s_stats.sd_busy_ms += dt;
+            if (dt > s_stats.sd_max_ms)
+                s_stats.sd_max_ms = dt;
+            if (ok)
+            {
+                s_stats.bytes += job.len;
+            }
+            else
+            {
+#if DBG_WIFI_HOTSPOT
+                Serial.printf("[SdWriter] write failed: %u bytes\n", (unsigned)job.len);
+#endif
+                p->error_ = true;
+            }
+        }
+        // 归还缓冲放在最后：owner 在全部归还前不会释放缓冲或关闭文件
+        xQueueSend(p->free_, &job.index, portMAX_DELAY);
+    }
+}
+
+SdWritePipeline::Stats SdWritePipeline::getStats()
+{
+    return s_stats;
+}
+
+void SdWritePipeline::logStats()
+{
+    Serial.printf("[SdWriter] completed=%u errors=%u busy=%u bytes=%llu bursts=%u sd_busy=%ums sd_max=%ums stalls=%u stall=%ums\n",
+                  (unsigned)s_stats.completed, (unsigned)s_stats.errors, (unsigned)s_stats.busy,
+                  (unsigned long long)s_stats.bytes, (unsigned)s_stats.bursts, (unsigned)s_stats.sd_busy_ms,
+                  (unsigned)s_stats.sd_max_ms, (unsigned)s_stats.stalls, (unsigned)s_stats.stall_ms);
+}
@@ -0,0 +1,88 @@
+#pragma once
+// 上传写卡流水线：HTTP 任务把收到的数据复制进 N 个 PSRAM 大缓冲中的一个，写满即交给 SD 写入任务，
+// 自己马上换下一个空闲缓冲继续接收；写入任务按扇区整数倍分段把缓冲写进文件。
+// 网络接收与 FAT 写入由此重叠，只有 N 个缓冲都在排队写卡时接收方才需要等待（记为一次 stall）。
+//
+// - 每个上传一个 SdWritePipeline（begin / write / finish），所有流水线共用一个写入任务，按提交顺序写
+// - SDMMC 不能从 PSRAM 做 DMA（驱动会退化为经 512 字节中转逐扇区写），写入任务先把数据分段复制进
+//   一块内部 DMA 缓冲再整段写；文件偏移保持扇区对齐时 FATFS 直接多扇区写卡
+
+#include <FS.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "readpaper.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+class SdWritePipeline
+{
+public:
+    SdWritePipeline() = default;
+    ~SdWritePipeline();
+    SdWritePipeline(const SdWritePipeline &) = delete;
+    SdWritePipeline &operator=(const SdWritePipeline &) = delete;
+
+    enum class Status
+    {
+        Ok,
+        Busy,  // 缓冲全部在排队写卡，等了 UPLOAD_PIPELINE_STALL_WAIT_MS 仍无空闲：调用方应 abort 并回 503
+        Failed // 之前某段写卡失败
+    };
+
+    // 接管已打开（并已 seek 到写入位置）的文件；缓冲或写入任务不可用时返回 false，文件仍由调用方处理
+    bool begin(fs::File file);
+    // 复制进当前缓冲。返回 Busy 时本段数据可能只复制了一部分，流水线不能再继续使用
+    Status write(const uint8_t *data, size_t len);
+    // 写出剩余数据，等待在途的缓冲写完后 flush/close；任何一段写失败或等待超时返回 false
+    bool finish();
+    // 放弃：丢弃未写的缓冲，等待正在写的一段结束后关闭文件
+    void abort();
+
+    bool active() const { return free_ != nullptr; }
+    size_t bytesQueued() const { return queued_; }
+
+    struct Stats
+    {
+        uint32_t active;        // 进行中的流水线
+        uint32_t completed;     // finish 成功的次数
+        uint32_t errors;        // 写卡失败 / 收尾等待超时
+        uint32_t busy;          // 因无空闲缓冲而回 503 的次数
+        uint64_t bytes;         // 写入 SD 的字节
+        uint32_t bursts;        // 写入任务处理的缓冲数
+        uint32_t sd_busy_ms;    // 写卡累计耗时
+        uint32_t sd_max_ms;     // 单个缓冲最长写卡耗时
+        uint32_t stalls;        // 接收方等待空闲缓冲的次数
+        uint32_t stall_ms;      // 累计等待时间
+        uint32_t last_bytes;    // 最近一次完成的流水线：字节数与 begin 到 finish 的耗时
+        uint32_t last_ms;
+    };
+    static Stats getStats();
+    static void logStats();
+
+private:
+    struct Job
+    {
+        SdWritePipeline *owner;
+        uint8_t index;
+        uint32_t len;
+    };
+
+    static bool ensureWriter();
+    static void writerEntry(void *arg);
+    static void writerLoop();
+    bool acquire();
+    bool submitCurrent();
+    bool waitIdle();
+    void release();
+
+    fs::File file_;
+    uint8_t *bufs_[UPLOAD_PIPELINE_BUFFERS] = {};
+    QueueHandle_t free_ = nullptr; // 空闲缓冲的下标；写入任务写完一段即放回
+    int cur_ = -1;                 // 正在填充的缓冲，-1 表示尚未取得
+    size_t fill_ = 0;
+    size_t queued_ = 0;
+    uint32_t start_ms_ = 0;
+    volatile bool error_ = false;
+    bool busy_ = false;
+};
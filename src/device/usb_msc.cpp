@@ -1,4 +1,5 @@
 #include "usb_msc.h"
+#include "msc_sector_cache.h"
 #include "SD/SDWrapper.h"
 #include "papers3.h"
 #include <Arduino.h>
@@ -6,6 +7,7 @@
 // Arduino ESP32 USB MSC (requires Arduino ESP32 core 3.x+)
 #include "USB.h"
 #include "USBMSC.h"
+#include "tusb.h"
 
 // ESP-IDF SDMMC low-level access for multi-sector operations
 #include "esp_vfs_fat.h"
@@ -21,17 +23,40 @@ static sdmmc_card_t* g_card = nullptr;
 static bool g_unmounted_sdmmc_for_msc = false;
 // Count of pending write operations (SCSI WRITE commands being processed)
 static volatile int g_pending_writes = 0;
+// Set by usb_msc_stop(): new writes are refused so the final flush sees everything
+static volatile bool g_stopping = false;
+
+// SCSI opcodes not in TinyUSB's scsi_cmd_type_t
+static const uint8_t SCSI_OP_SYNCHRONIZE_CACHE_10 = 0x35;
+static const uint8_t SCSI_OP_SYNCHRONIZE_CACHE_16 = 0x91;
+
+// Sector backend for the PSRAM cache (msc_sector_cache): raw multi-sector access via sdmmc
+static bool sd_sector_io(uint32_t lba, uint8_t *buf, uint32_t count, bool write)
+{
+    if (!g_card) return false;
+    esp_err_t err = write ? sdmmc_write_sectors(g_card, buf, lba, count)
+                          : sdmmc_read_sectors(g_card, buf, lba, count);
+    return err == ESP_OK;
+}
 
 // Callbacks for TinyUSB MSC
 static int32_t onWrite(uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize)
 {
     if (!g_card) return -1;
-    // Track pending writes so we can delay shutdown until writes finish
+    // Track pending writes so we can delay shutdown until writes finish.
+    // Count first, then check the flag: usb_msc_stop() sets the flag before
+    // waiting for the count, so every write is either refused or waited for.
     ++g_pending_writes;
+    if (g_stopping)
+    {
+        --g_pending_writes;
+        return -1;
+    }
     int32_t result = -1;
 
-    // Write complete sectors directly to SD card via sdmmc
-    if (sdmmc_write_sectors(g_card, buffer, lba, bufsize / 512) == ESP_OK)
+    // Complete sectors go through the sector cache (write-through, or write-back
+    // for FAT-region and sequential writes; dirty data is flushed before stop)
+    if (msc_cache_write(lba, buffer, bufsize / 512))
     {
         result = (int32_t)bufsize;
     }
@@ -44,14 +69,34 @@ static int32_t onRead(uint32_t lba, uint32_t offset, void *buffer, uint32_t bufs
 {
     if (!g_card) return -1;
     
-    // Read complete sectors directly from SD card via sdmmc
-    if (sdmmc_read_sectors(g_card, (uint8_t*)buffer, lba, bufsize / 512) == ESP_OK)
+    // Read complete sectors through the sector cache (line cache + sequential read-ahead)
+    if (msc_cache_read(lba, (uint8_t*)buffer, bufsize / 512))
     {
         return bufsize;
     }
     return -1;
 }
 
+// Arduino's USBMSC defines tud_msc_scsi_cb and answers every command it does not
+// know with ILLEGAL REQUEST. The link step wraps it (-Wl,--wrap=tud_msc_scsi_cb in
+// platformio.ini) so SYNCHRONIZE CACHE writes back the sector cache before the
+// host is told the data is on the card; other commands go to the original.
+extern "C" int32_t __real_tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, uint16_t bufsize);
+
+extern "C" int32_t __wrap_tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, uint16_t bufsize)
+{
+    if (scsi_cmd[0] == SCSI_OP_SYNCHRONIZE_CACHE_10 || scsi_cmd[0] == SCSI_OP_SYNCHRONIZE_CACHE_16)
+    {
+        if (msc_cache_flush())
+            return 0;
+        Serial.println("[USB_MSC] SYNCHRONIZE CACHE: flush FAILED");
+        // MEDIUM ERROR / WRITE ERROR
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+        return -1;
+    }
+    return __real_tud_msc_scsi_cb(lun, scsi_cmd, buffer, bufsize);
+}
+
 static bool onStartStop(uint8_t power_condition, bool start, bool load_eject)
 {
     Serial.printf("[USB_MSC] StartStop: power=%d start=%d eject=%d\n", 
@@ -60,22 +105,13 @@ static bool onStartStop(uint8_t power_condition, bool start, bool load_eject)
     if (load_eject)
     {
         // Host is ejecting/unmounting the drive - report media removed to host,
-        // then start a background task to wait for outstanding writes (or timeout)
-        // before stopping MSC and rebooting. Do NOT block the USB callback here.
+        // then stop MSC from a background task (waits for outstanding writes,
+        // flushes the cache, reboots). Do NOT block the USB callback here.
         Serial.println("[USB_MSC] Host ejected drive - reporting media removed, waiting for writes to finish...");
         msc.mediaPresent(false);
 
         // Background waiter task
         auto eject_waiter = [](void* /*param*/) {
-            const int timeout_ms = 5000; // wait up to 5s for pending writes
-            int waited = 0;
-            while (g_pending_writes > 0 && waited < timeout_ms)
-            {
-                vTaskDelay(pdMS_TO_TICKS(100));
-                waited += 100;
-            }
-            Serial.printf("[USB_MSC] Eject waiter: pending_writes=%d, waited=%d ms\n", g_pending_writes, waited);
-            // Now perform a full stop (will reboot)
             usb_msc_stop();
             // Should not reach here because usb_msc_stop() restarts the MCU
             vTaskDelete(NULL);
@@ -281,6 +317,9 @@ bool usb_msc_start()
                   ((uint64_t)g_card->csd.capacity) * g_card->csd.sector_size / (1024 * 1024),
                   g_card->csd.capacity);
 
+    // PSRAM sector cache in front of the card; falls back to direct access if allocation fails
+    msc_cache_begin(g_card->csd.capacity, sd_sector_io);
+
     // Initialize USB MSC
     USB.begin();
     
@@ -300,6 +339,28 @@ bool usb_msc_start()
 
 void usb_msc_stop()
 {
+    if (g_active)
+    {
+        // Refuse new writes and tell the host the medium is gone, then wait for
+        // writes already inside onWrite to finish before the final flush
+        g_stopping = true;
+        msc.mediaPresent(false);
+        const int timeout_ms = 5000;
+        int waited = 0;
+        while (g_pending_writes > 0 && waited < timeout_ms)
+        {
+            vTaskDelay(pdMS_TO_TICKS(20));
+            waited += 20;
+        }
+        Serial.printf("[USB_MSC] Stop: pending_writes=%d, waited=%d ms\n", g_pending_writes, waited);
+
+        // Write back whatever the cache still holds (FAT sectors, gathered data)
+        // before the reboot; the host has already been told these writes succeeded
+        bool ok = msc_cache_flush();
+        Serial.printf("[USB_MSC] Cache flush before stop: %s\n", ok ? "ok" : "FAILED");
+        msc_cache_log_stats();
+    }
+
     // Reboot after stopping
     delay(200);
     ESP.restart();
@@ -9,7 +9,8 @@ bool usb_msc_init();
 // Start presenting the SD card as USB MSC. Returns true if started.
 bool usb_msc_start();
 
-// Stop MSC and restore normal operation.
+// Stop MSC: refuse new writes, wait for in-flight ones, flush the sector cache,
+// then reboot (does not return). Every exit from MSC mode must go through here.
 void usb_msc_stop();
 
 // Poll helper (if needed by main loop)
@@ -19,4 +20,4 @@ void usb_msc_poll();
 bool usb_msc_is_active();
 
 // When unmounted by host this callback will request a device reboot
-// The module will call ESP.restart() when host unmounts (implemented internally).
+// The module calls usb_msc_stop() from a background task when the host unmounts.
@@ -10,12 +10,24 @@
 #include "current_book.h"
 #include "SD/SDWrapper.h"
 #include "api/api_router.h"
+#include "api/http_file_source.h"
+#include "api/http_json.h"
+#include "device/safe_fs.h"
+#include "device/sd_write_pipeline.h"
+#include "device/dir_index.h"
+#include "device/file_hash_cache.h"
+#include "tasks/task_priorities.h"
 #include "internal_fs.h"
 #include <SPIFFS.h>
 #include "text/book_handle.h"
 #include "text/tags_handle.h"
+#include "text/book_search.h"
+#include "text/font_subset.h"
+#include "text/lz_book.h"
 #include <set>
 #include <map>
+#include <algorithm>
+#include <memory>
 #include "ui/ui_lock_screen.h"
 
 extern GlobalConfig g_config;
@@ -44,7 +56,8 @@ static std::string normalize_real_path(const std::string &p) {
 WiFiHotspotManager* g_wifi_hotspot = nullptr;
 
 WiFiHotspotManager::WiFiHotspotManager() 
-    : webServer(nullptr), running(false), uploadInProgress(false) {
+    : httpServer(nullptr), httpTask(nullptr), httpTaskExited(xSemaphoreCreateBinary()), httpStopRequested(false),
+      running(false), activeUploads(0) {
     // 初始化SPIFFS用于读取模板
     if (!InternalFS::begin(true)) {
 #if DBG_WIFI_HOTSPOT
@@ -59,9 +72,14 @@ WiFiHotspotManager::WiFiHotspotManager()
 
 WiFiHotspotManager::~WiFiHotspotManager() {
     stop();
-    if (webServer) {
-        delete webServer;
-        webServer = nullptr;
+    // stop() 已等到 HTTP 任务确认退出，此后没有任何代码再访问 httpServer
+    if (httpServer) {
+        delete httpServer;
+        httpServer = nullptr;
+    }
+    if (httpTaskExited) {
+        vSemaphoreDelete(httpTaskExited);
+        httpTaskExited = nullptr;
     }
 }
 
@@ -168,23 +186,18 @@ bool WiFiHotspotManager::start(const char* ssid, const char* password) {
     Serial.printf("[WIFI_HOTSPOT] IP地址: %s\n", getIPAddress().c_str());
 #endif
 
-    // 创建并配置Web服务器
-    if (!webServer) {
-        webServer = new WebServer(80);
-        // 注意：ESP32 WebServer不支持keepAlive方法
-        // 设置较小的缓冲区以减少内存使用
+    // 创建并启动Web服务器（独立任务）
+    if (!startHttpServer()) {
+#if DBG_WIFI_HOTSPOT
+        Serial.printf("[WIFI_HOTSPOT] 错误: Web服务器启动失败\n");
+#endif
+        WiFi.softAPdisconnect(true);
+        WiFi.mode(WIFI_OFF);
+        return false;
     }
 
-    // 配置路由改为通过 API 路由器统一注册（头文件在顶部包含）
-    ApiRouter::registerRoutes(*webServer, *this);
-    webServer->on("/favicon.ico", [this]() { webServer->send(204); }); // 避免404报错
-    webServer->onNotFound([this]() { handleNotFound(); });
-
-    // 启动Web服务器
-    webServer->begin();
-
 #if DBG_WIFI_HOTSPOT
-    Serial.printf("[WIFI_HOTSPOT] Web服务器启动成功，端口: 80\n");
+    Serial.printf("[WIFI_HOTSPOT] Web服务器启动成功，端口: 80，连接池: %d\n", HTTP_MAX_CONNECTIONS);
     Serial.printf("[WIFI_HOTSPOT] 访问地址: http://%s\n", getIPAddress().c_str());
 #endif
 
@@ -201,10 +214,8 @@ void WiFiHotspotManager::stop() {
     Serial.printf("[WIFI_HOTSPOT] 正在停止WiFi热点和Web服务器...\n");
 #endif
 
-    // 停止Web服务器
-    if (webServer) {
-        webServer->stop();
-    }
+    // 停止Web服务器（等待 HTTP 任务关闭所有连接后退出）
+    stopHttpServer();
 
     // 停止热点
     WiFi.softAPdisconnect(true);
@@ -221,37 +232,73 @@ bool WiFiHotspotManager::isRunning() const {
     return running;
 }
 
-void WiFiHotspotManager::handleClient() {
-    if (!webServer || !running) {
-        return;
+// 连接缓冲区放 PSRAM，内部 RAM 留给 lwIP 与 Wi-Fi 驱动
+static void* http_buffer_alloc(size_t bytes) {
+    return heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+bool WiFiHotspotManager::startHttpServer() {
+    if (httpTask || !httpTaskExited) {
+        return false; // 上一次的 HTTP 任务尚未退出
     }
-    
-    // 检查内存状态
-    size_t freeHeap = ESP.getFreeHeap();
-    if (freeHeap < 32768) { // 提高到32KB，LWIP需要更多内存
-#if DBG_WIFI_HOTSPOT
-        Serial.printf("[WIFI_HOTSPOT] 内存不足，跳过客户端处理: %u bytes\n", freeHeap);
-#endif
-        return;
+    if (!httpServer) {
+        httpServer = new HttpServerCore();
+        // 路由只注册一次，热点重复启停时复用
+        ApiRouter::registerRoutes(*httpServer, *this);
+        httpServer->on("/favicon.ico", HTTP_M_GET, [](HttpRequest&, HttpResponse& res) { res.send(204); }); // 避免404报错
+        httpServer->onNotFound([this](HttpRequest& req, HttpResponse& res) { handleNotFound(req, res); });
     }
-    
-    // 如果正在上传文件，跳过处理以避免LWIP pbuf冲突
-    if (isUploadInProgress()) {
-#if DBG_WIFI_HOTSPOT
-        Serial.printf("[WIFI_HOTSPOT] 上传进行中，跳过客户端处理以避免网络冲突\n");
-#endif
+
+    HttpServerCore::Config cfg;
+    cfg.port = 80;
+    cfg.max_connections = HTTP_MAX_CONNECTIONS;
+    cfg.header_buffer = HTTP_HEADER_BUFFER;
+    cfg.io_buffer = HTTP_IO_BUFFER;
+    cfg.alloc = http_buffer_alloc;
+    cfg.release = heap_caps_free;
+    if (!httpServer->begin(cfg)) {
+        return false;
+    }
+
+    httpStopRequested = false;
+    xSemaphoreTake(httpTaskExited, 0); // 丢弃上一次任务留下的信号
+    // 与 Wi-Fi 协议栈同在核心0，核心1 留给排版与绘制
+    if (xTaskCreatePinnedToCore(httpTaskEntry, "HttpServer", HTTP_TASK_STACK, this, PRIO_HTTP, &httpTask, 0) != pdPASS) {
+        httpTask = nullptr;
+        httpServer->end();
+        return false;
+    }
+    return true;
+}
+
+void WiFiHotspotManager::httpTaskEntry(void* arg) {
+    WiFiHotspotManager* self = static_cast<WiFiHotspotManager*>(arg);
+    while (!self->httpStopRequested) {
+        // 内部 RAM 过低时暂停收发，lwIP 分配 pbuf 失败比多等一轮更糟
+        if (ESP.getFreeHeap() < 32768) {
+            vTaskDelay(pdMS_TO_TICKS(HTTP_POLL_MS));
+            continue;
+        }
+        self->httpServer->poll(HTTP_POLL_MS);
+    }
+    // 在本任务内关闭所有连接：未完成的上传收到 ABORTED，临时文件随上传会话清理
+    self->httpServer->end();
+    self->httpTask = nullptr;
+    // 最后一步：给出信号后 self 可能随即被析构，之后不得再访问任何成员
+    xSemaphoreGive(self->httpTaskExited);
+    vTaskDelete(NULL);
+}
+
+void WiFiHotspotManager::stopHttpServer() {
+    if (!httpTask) {
         return;
     }
-    
-    // 在处理客户端请求前让出CPU，防止与定时器冲突
-    yield();
-    
-    // 处理客户端请求 - 移除中断禁用，因为这会导致看门狗超时
-    // WebServer库和LWIP已经有适当的保护机制
-    webServer->handleClient();
-    
-    // 处理完成后再次让出CPU
-    yield();
+    httpStopRequested = true;
+    // 等 HTTP 任务确认退出（正在进行的 SD 读写需要先返回）。不能超时放行：
+    // 调用方随后可能析构 httpServer，而任务仍在 poll/end 中使用它
+    while (xSemaphoreTake(httpTaskExited, pdMS_TO_TICKS(2000)) != pdTRUE) {
+        Serial.printf("[WIFI_HOTSPOT] 警告: HTTP 任务仍未退出，继续等待\n");
+    }
 }
 
 const char* WiFiHotspotManager::getSSID() const {
@@ -277,10 +324,77 @@ int WiFiHotspotManager::getConnectedClients() const {
 }
 
 bool WiFiHotspotManager::isUploadInProgress() const {
-    return uploadInProgress;
+    return activeUploads > 0;
+}
+
+// 预压缩静态资源：构建 SPIFFS 镜像时 tools/web_assets.py 为网页资源生成 <名>.gz 与 <名>.etag（内容散列），
+// 原文件保留给不接受 gzip 的客户端。命中时直接把 .gz 流式发出（Content-Encoding: gzip），
+// 带 ETag 与 Cache-Control: no-cache：浏览器每次打开都带 If-None-Match 询问，内容未变只回 304，不再重发页面。
+// 没有 .etag（手工放入的 .gz）时以 .gz 的 CRC-32 代替。结果按路径缓存到重启（SPIFFS 只随固件镜像更新）
+struct StaticAsset {
+    bool present = false;
+    std::string etag; // 含引号
+};
+
+static const StaticAsset& static_asset(const String& path) {
+    static std::map<std::string, StaticAsset> s_assets;
+    auto it = s_assets.find(path.c_str());
+    if (it != s_assets.end()) return it->second;
+
+    StaticAsset& a = s_assets[path.c_str()];
+    String gz = path + ".gz";
+    if (!SPIFFS.exists(gz)) return a;
+    String hash;
+    File ef = SPIFFS.open(path + ".etag", "r");
+    if (ef) {
+        hash = ef.readStringUntil('\n');
+        hash.trim();
+        ef.close();
+    }
+    if (hash.length() == 0) {
+        File f = SPIFFS.open(gz, "r");
+        if (!f) return a;
+        uint8_t buf[512];
+        uint32_t crc = 0;
+        int n;
+        while ((n = f.read(buf, sizeof(buf))) > 0) crc = http_crc32(crc, buf, (size_t)n);
+        f.close();
+        char hex[9];
+        snprintf(hex, sizeof(hex), "%08x", (unsigned)crc);
+        hash = hex;
+    }
+    a.etag = std::string("\"") + hash.c_str() + "\"";
+    a.present = true;
+#if DBG_WIFI_HOTSPOT
+    Serial.printf("[WIFI_HOTSPOT] 预压缩资源 %s.gz, ETag %s\n", path.c_str(), a.etag.c_str());
+#endif
+    return a;
+}
+
+// 客户端接受 gzip 且 SPIFFS 有预压缩版本时发出（或回 304）并返回 true；否则由调用方按原文件处理
+static bool serve_precompressed(HttpRequest& req, HttpResponse& res, const String& path, const char* contentType) {
+    if (req.header("accept-encoding").find("gzip") == std::string::npos) return false;
+    const StaticAsset& a = static_asset(path);
+    if (!a.present) return false;
+
+    res.setHeader("ETag", a.etag);
+    res.setHeader("Cache-Control", "no-cache");
+    res.setHeader("Vary", "Accept-Encoding");
+    const std::string& inm = req.header("if-none-match");
+    if (!inm.empty() && (inm == "*" || inm.find(a.etag) != std::string::npos)) {
+        res.send(304);
+        return true;
+    }
+    File file = SPIFFS.open(path + ".gz", "r");
+    if (!file) return false;
+    res.setHeader("Content-Encoding", "gzip");
+    int64_t size = (int64_t)file.size();
+    res.stream(200, contentType, std::unique_ptr<HttpBodySource>(new HttpFileSource(file)), size);
+    return true;
 }
 
-void WiFiHotspotManager::handleRoot() {
+void WiFiHotspotManager::handleRoot(HttpRequest& req, HttpResponse& res) {
+    if (serve_precompressed(req, res, "/template.html", "text/html; charset=utf-8")) return;
 #if DBG_WIFI_HOTSPOT
     Serial.println("[WIFI_HOTSPOT] handleRoot() 开始");
 #endif
@@ -288,13 +402,125 @@ void WiFiHotspotManager::handleRoot() {
 #if DBG_WIFI_HOTSPOT
     Serial.printf("[WIFI_HOTSPOT] 生成HTML完成，大小: %d bytes\n", html.length());
 #endif
-    webServer->send(200, "text/html; charset=utf-8", html);
+    res.send(200, "text/html; charset=utf-8", std::string(html.c_str(), html.length()));
 #if DBG_WIFI_HOTSPOT
     Serial.println("[WIFI_HOTSPOT] handleRoot() 完成");
 #endif
 }
 
-void WiFiHotspotManager::handleFileList(String category) {
+// /list 的流式生成状态：条目来自目录排序索引（device/dir_index），
+// 在 HTTP 任务拉取响应体时逐项读出并写出，不再把整个目录读进内存
+struct FileListStream {
+    DirIndex::Reader reader;
+    bool useReader = false;
+    std::vector<FileInfo> files; // 索引不可用时退回整目录扫描
+    size_t next = 0;
+    std::string dir;
+    bool isBook = false;
+    bool paginate = false;
+    int total = 0;
+    int page = 0;
+    int perPage = 0;
+    int limit = 0;
+    // 当前打开的书 / 当前字体（真实路径），用于 isCurrent
+    bool hasCurrent = false;
+    std::string curReal;
+    bool curUseSpiffs = false;
+
+    bool started = false;
+    int count = 0;
+};
+
+static bool has_txt_ext(const std::string &fname) {
+    if (lz_book_name(fname)) return true; // 压缩存放的书
+    if (fname.length() < 4) return false;
+    std::string ext = fname.substr(fname.length() - 4);
+    for (char &c : ext) {
+        if (c >= 'A' && c <= 'Z') c += 32;
+    }
+    return ext == ".txt";
+}
+
+// 显示用文件名：超过 60 字节截断为 57 字节 + "..."，截断点退到 UTF-8 字符边界
+static std::string display_file_name(const std::string &name) {
+    if (name.length() <= 60) return name;
+    size_t cut = 57;
+    while (cut > 0 && ((unsigned char)name[cut] & 0xC0) == 0x80) cut--;
+    return name.substr(0, cut) + "...";
+}
+
+static bool file_list_next(FileListStream &st, FileInfo &out) {
+    if (st.useReader) return st.reader.next(out);
+    if (st.next >= st.files.size()) return false;
+    out = std::move(st.files[st.next++]);
+    return true;
+}
+
+static bool file_list_step(FileListStream &st, HttpJsonWriter &w) {
+    if (!st.started) {
+        st.started = true;
+        if (st.paginate) {
+            // 分页时返回包含元数据的 JSON 对象；否则为纯数组（向后兼容）
+            w.beginObject();
+            w.field("total", st.total);
+            w.field("page", st.page);
+            w.field("perPage", st.perPage);
+            w.key("files");
+        }
+        w.beginArray();
+        return true;
+    }
+
+    FileInfo fileInfo;
+    while (st.count < st.limit && file_list_next(st, fileInfo)) {
+        if (ESP.getFreeHeap() < 4096) break;
+
+        // For book category, only return .txt / .txt.lz files (skip .idx and other formats)
+        if (st.isBook && !fileInfo.isDirectory && !has_txt_ext(fileInfo.name)) continue;
+
+        // fullPath: the real full path exposed to client for actions (not truncated)
+        std::string fullPath = st.dir + "/" + fileInfo.name;
+
+        bool isCurrent = false;
+        if (st.hasCurrent) {
+            std::string item_real;
+            bool item_use_spiffs = false;
+            resolve_fake_path(fullPath, item_real, item_use_spiffs);
+            item_real = normalize_real_path(item_real);
+            isCurrent = (st.curReal == item_real && st.curUseSpiffs == item_use_spiffs);
+        }
+
+        // Determine whether a same-name (without extension) .idx file exists
+        // 只查本页条目（每项一次 exists），不再为整个目录建 .idx 集合
+        bool isIdxed = false;
+        if (st.isBook && !fileInfo.isDirectory) {
+            size_t dot = fileInfo.name.find_last_of('.');
+            std::string stem = (dot == std::string::npos) ? fileInfo.name : fileInfo.name.substr(0, dot);
+            isIdxed = SDW::SD.exists((st.dir + "/" + stem + ".idx").c_str());
+        }
+
+        w.beginObject();
+        w.field("name", display_file_name(fileInfo.name));
+        w.field("type", fileInfo.isDirectory ? "dir" : "file");
+        w.field("size", (unsigned long long)fileInfo.size);
+        w.field("isCurrent", isCurrent ? 1 : 0);
+        w.field("isIdxed", isIdxed ? 1 : 0);
+        w.field("path", fullPath);
+        w.endObject();
+        st.count++;
+        return true;
+    }
+
+    w.endArray();
+    if (st.paginate) w.endObject();
+    st.reader.close();
+#if DBG_WIFI_HOTSPOT
+    Serial.printf("[WIFI_HOTSPOT] /list 响应完成，%d 项，剩余内存: %d bytes\n", st.count, ESP.getFreeHeap());
+#endif
+    return false;
+}
+
+void WiFiHotspotManager::handleFileList(HttpRequest& req, HttpResponse& res, String category) {
     // 检查内存状态
     if (ESP.getFreeHeap() < 10240) {
 #if DBG_WIFI_HOTSPOT
@@ -316,8 +542,8 @@ void WiFiHotspotManager::handleFileList(String category) {
     }
 
     // 解析分页参数（可选，默认返回全部以保持向后兼容）
-    int page = webServer->hasArg("page") ? webServer->arg("page").toInt() : 0;
-    int perPage = webServer->hasArg("perPage") ? webServer->arg("perPage").toInt() : 0;
+    int page = req.hasArg("page") ? atoi(req.arg("page").c_str()) : 0;
+    int perPage = req.hasArg("perPage") ? atoi(req.arg("perPage").c_str()) : 0;
     bool usePagination = (page > 0 && perPage > 0);
 
 #if DBG_WIFI_HOTSPOT
@@ -326,261 +552,83 @@ void WiFiHotspotManager::handleFileList(String category) {
 #endif
 
     // 采用路由层统一添加 CORS 头，避免重复
-    webServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
-    webServer->send(200, "application/json", "");
-    
+    std::shared_ptr<FileListStream> st = std::make_shared<FileListStream>();
+    st->dir = path.c_str();
+    st->isBook = (path == "/book");
+    st->paginate = usePagination;
+    st->page = page;
+    st->perPage = perPage;
+
+    // 使用运行时配置限制，且受编译期上限保护
+    size_t runtimeLimit = (size_t)g_config.main_menu_file_count;
+    size_t cap = (size_t)MAX_MAIN_MENU_FILE_COUNT;
+    st->limit = (int)(runtimeLimit < cap ? runtimeLimit : cap);
+
     if (SDW::SD.exists(path.c_str())) {
         unsigned long startTime = millis();
         (void)startTime; // avoid unused-variable when DBG_WIFI_HOTSPOT==0
-        std::string stdPath = path.c_str();
-        yield();
-
-        // 如果使用分页，先获取总数（轻量级操作）
-        int totalFiles = 0;
-        if (usePagination) {
-            // For book category, only count .txt files
-            std::string extension = (path == "/book") ? ".txt" : "";
-            totalFiles = EfficientFileScanner::countFiles(stdPath, extension);
-#if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] 文件总数: %d, 耗时: %lu ms\n", totalFiles, millis() - startTime);
-#endif
-        }
-
-        // 根据是否分页选择扫描方式
-        std::vector<FileInfo> files;
-        if (usePagination) {
-            // For pagination, scan entire directory with extension filter (so we can sort),
-            // then slice the requested page from the sorted result.
-            std::string extension = (path == "/book") ? ".txt" : "";
-            std::vector<FileInfo> allFiles = EfficientFileScanner::scanDirectory(stdPath, extension);
-            // Sort by filename (case-insensitive)
-            std::sort(allFiles.begin(), allFiles.end(), [](const FileInfo &a, const FileInfo &b) {
-                std::string A = a.name; std::string B = b.name;
-                for (char &c : A) if ((unsigned char)c >= 'A' && (unsigned char)c <= 'Z') c = c - 'A' + 'a';
-                for (char &c : B) if ((unsigned char)c >= 'A' && (unsigned char)c <= 'Z') c = c - 'A' + 'a';
-                return A < B;
-            });
-            // totalFiles should reflect filtered count (already computed above for usePagination path,
-            // but recompute to be safe)
-            totalFiles = (int)allFiles.size();
-            int startIndex = (page - 1) * perPage;
-            for (int i = startIndex; i < startIndex + perPage && i < (int)allFiles.size(); ++i) {
-                files.push_back(allFiles[i]);
-            }
+        const std::string &stdPath = st->dir;
+        // For book category, pagination only counts .txt / .txt.lz files
+        std::string extension = (usePagination && st->isBook) ? BOOK_FILE_EXTENSIONS : "";
+        size_t startIndex = usePagination ? (size_t)(page - 1) * (size_t)perPage : 0;
+
+        // 排序索引：定位到页首，之后每项顺序读出（索引缺失或失效时这里重建）。
+        // 根目录条目少且 readpaper.cfg 等文件经常改写，直接扫描
+        st->useReader = path != "/" && st->reader.open(stdPath, extension, startIndex);
+        if (st->useReader) {
+            st->total = (int)st->reader.total();
         } else {
-            // Non-paginated: scan all entries and sort before iterating/filtering
-            files = EfficientFileScanner::scanDirectory(stdPath);
-            std::sort(files.begin(), files.end(), [](const FileInfo &a, const FileInfo &b) {
+            // 索引不可用（例如内存不足）：退回整目录扫描排序
+            auto byName = [](const FileInfo &a, const FileInfo &b) {
                 std::string A = a.name; std::string B = b.name;
                 for (char &c : A) if ((unsigned char)c >= 'A' && (unsigned char)c <= 'Z') c = c - 'A' + 'a';
                 for (char &c : B) if ((unsigned char)c >= 'A' && (unsigned char)c <= 'Z') c = c - 'A' + 'a';
                 return A < B;
-            });
+            };
+            std::vector<FileInfo> allFiles = EfficientFileScanner::scanDirectory(stdPath, extension);
+            std::sort(allFiles.begin(), allFiles.end(), byName);
+            st->total = (int)allFiles.size();
+            for (size_t i = startIndex; i < allFiles.size(); ++i) {
+                if (usePagination && i >= startIndex + (size_t)perPage) break;
+                st->files.push_back(std::move(allFiles[i]));
+            }
         }
         yield();
 #if DBG_WIFI_HOTSPOT
-        Serial.printf("[WIFI_HOTSPOT] 扫描完成，返回 %d 个文件，耗时: %lu ms，剩余内存: %d bytes\n", 
-                     (int)files.size(), millis() - startTime, ESP.getFreeHeap());
-#endif
-
-        // Optimization: for book category, only scan .idx files (not all files)
-        // This avoids scanning txt/epub files twice and uses efficient lookup
-        std::set<std::string> idxStems; // stems of files that have corresponding .idx
-        if (path == "/book") {
-            // Efficient: only iterate directory once looking for .idx files
-            File dir = SDW::SD.open(stdPath.c_str());
-            if (dir && dir.isDirectory()) {
-                dir.rewindDirectory();
-                while (true) {
-                    if (ESP.getFreeHeap() < 4096) break;
-                    File entry = dir.openNextFile();
-                    if (!entry) break;
-                    
-                    const char* namePtr = entry.name();
-                    if (namePtr && strlen(namePtr) > 4) {
-                        std::string fname = std::string(namePtr);
-                        // Only process .idx files
-                        if (fname.length() >= 4 && fname.substr(fname.length() - 4) == ".idx") {
-                            std::string stem = fname.substr(0, fname.length() - 4);
-                            idxStems.insert(stem);
-                        }
-                    }
-                    entry.close();
-                    
-                    // Yield every 5 files
-                    if (idxStems.size() % 5 == 0) yield();
-                }
-                dir.close();
-            }
-#if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] 找到 %d 个 .idx 文件，耗时: %lu ms\n", 
-                         (int)idxStems.size(), millis() - startTime);
+        Serial.printf("[WIFI_HOTSPOT] %s 就绪，共 %d 项，耗时: %lu ms，剩余内存: %d bytes\n", 
+                     st->useReader ? "排序索引" : "目录扫描", st->total, millis() - startTime, ESP.getFreeHeap());
 #endif
-        }
 
-        // 如果使用分页，返回包含元数据的 JSON 对象
-        if (usePagination) {
-            webServer->sendContent("{\"total\":");
-            webServer->sendContent(String(totalFiles));
-            webServer->sendContent(",\"page\":");
-            webServer->sendContent(String(page));
-            webServer->sendContent(",\"perPage\":");
-            webServer->sendContent(String(perPage));
-            webServer->sendContent(",\"files\":[");
-        } else {
-            // 向后兼容：返回纯数组
-            webServer->sendContent("[");
+        // isCurrent：当前打开的书，或配置的字体（g_config.fontset 可能是 "default" 或真实路径）
+        std::string cur_fp;
+        if (st->isBook && g_current_book) {
+            cur_fp = g_current_book->filePath();
+        } else if (path == "/font" && g_config.fontset[0] == '/') {
+            cur_fp = g_config.fontset;
         }
-        
-        bool first = true;
-
-        // 使用运行时配置限制，且受编译期上限保护
-        size_t runtimeLimit = (size_t)g_config.main_menu_file_count;
-        size_t cap = (size_t)MAX_MAIN_MENU_FILE_COUNT;
-        int effectiveLimit = (int)(runtimeLimit < cap ? runtimeLimit : cap);
-
-        int count = 0;
-        for (const auto& fileInfo : files) {
-            if (count >= effectiveLimit) break;
-            if (ESP.getFreeHeap() < 4096) break;
-            
-            // For book category, only return .txt files (skip .idx and other formats)
-            if (path == "/book" && !fileInfo.isDirectory) {
-                std::string fname = fileInfo.name;
-                // Check if file has .txt extension (case-insensitive)
-                bool isTxt = false;
-                if (fname.length() >= 4) {
-                    std::string ext = fname.substr(fname.length() - 4);
-                    // Simple lowercase conversion
-                    for (char& c : ext) {
-                        if (c >= 'A' && c <= 'Z') c += 32;
-                    }
-                    isTxt = (ext == ".txt");
-                }
-                // Skip non-txt files (including .idx)
-                if (!isTxt) continue;
-            }
-            
-            std::string safeFileName = fileInfo.name;
-            // fullPath: the real full path exposed to client for actions (not truncated)
-            std::string fullPath = stdPath + "/" + fileInfo.name;
-            size_t pos = 0;
-            while ((pos = safeFileName.find("\"", pos)) != std::string::npos) {
-                safeFileName.replace(pos, 1, "\\\"");
-                pos += 2;
-            }
-            // escape fullPath as well for JSON inclusion
-            pos = 0;
-            std::string escapedFullPath = fullPath;
-            while ((pos = escapedFullPath.find("\"", pos)) != std::string::npos) {
-                escapedFullPath.replace(pos, 1, "\\\"");
-                pos += 2;
-            }
-            pos = 0;
-            while ((pos = safeFileName.find("\\", pos)) != std::string::npos) {
-                safeFileName.replace(pos, 1, "\\\\");
-                pos += 2;
-            }
-            if (safeFileName.length() > 60) {
-                safeFileName = safeFileName.substr(0, 57) + "...";
-            }
-            char jsonItem[512];
-            // Determine if this file equals the currently opened book or currently used font (isCurrent)
-            int isCurrent = 0;
-            if (path == "/book" && g_current_book) {
-                std::string cur_fp = g_current_book->filePath();
-                std::string cur_real;
-                bool cur_use_spiffs = false;
-                resolve_fake_path(cur_fp, cur_real, cur_use_spiffs);
-                cur_real = normalize_real_path(cur_real);
-
-                // construct fake path for this file (same format used by client: /book/NAME)
-                std::string item_fake = stdPath + "/" + fileInfo.name;
-                std::string item_real;
-                bool item_use_spiffs = false;
-                resolve_fake_path(item_fake, item_real, item_use_spiffs);
-                item_real = normalize_real_path(item_real);
-
-                if (cur_real == item_real && cur_use_spiffs == item_use_spiffs) {
-                    isCurrent = 1;
-                }
-            }
-            else if (path == "/font") {
-                // Compare with configured fontset (g_config.fontset). It may be "default" or a real path.
-                std::string cfg_fp = std::string(g_config.fontset);
-                if (!cfg_fp.empty() && cfg_fp[0] == '/') {
-                    std::string cur_real;
-                    bool cur_use_spiffs = false;
-                    resolve_fake_path(cfg_fp, cur_real, cur_use_spiffs);
-                    cur_real = normalize_real_path(cur_real);
-
-                    std::string item_fake = stdPath + "/" + fileInfo.name;
-                    std::string item_real;
-                    bool item_use_spiffs = false;
-                    resolve_fake_path(item_fake, item_real, item_use_spiffs);
-                    item_real = normalize_real_path(item_real);
-
-                    if (cur_real == item_real && cur_use_spiffs == item_use_spiffs) {
-                        isCurrent = 1;
-                    }
-                }
-            }
-
-            // Determine whether a same-name (without extension) .idx file exists
-            // Use pre-built lookup set for O(1) check instead of filesystem exists()
-            int isIdxed = 0;
-            if (path == "/book" && !fileInfo.isDirectory) {
-                // derive stem (name without extension)
-                std::string fname = fileInfo.name;
-                size_t dot = fname.find_last_of('.');
-                std::string stem = (dot == std::string::npos) ? fname : fname.substr(0, dot);
-                // Fast O(log n) lookup in pre-built set (no filesystem calls)
-                if (idxStems.find(stem) != idxStems.end()) {
-                    isIdxed = 1;
-                }
-            }
-
-            int written = snprintf(jsonItem, sizeof(jsonItem), 
-                        "%s{\"name\":\"%s\",\"type\":\"%s\",\"size\":%d,\"isCurrent\":%d,\"isIdxed\":%d,\"path\":\"%s\"}",
-                        first ? "" : ",",
-                        safeFileName.c_str(), 
-                        fileInfo.isDirectory ? "dir" : "file",
-                        (int)fileInfo.size,
-                        isCurrent,
-                        isIdxed,
-                        escapedFullPath.c_str());
-            if (written > 0 && written < (int)sizeof(jsonItem)) {
-                webServer->sendContent(jsonItem);
-                first = false;
-                yield();
-            }
-            count++;
+        if (!cur_fp.empty()) {
+            resolve_fake_path(cur_fp, st->curReal, st->curUseSpiffs);
+            st->curReal = normalize_real_path(st->curReal);
+            st->hasCurrent = true;
         }
     }
-    
-    // 根据分页模式返回不同的结束标记
-    if (usePagination) {
-        webServer->sendContent("]}"); // 结束 files 数组和根对象
-    } else {
-        webServer->sendContent("]"); // 结束数组（向后兼容）
-    }
-    
-    webServer->sendContent("");
-    webServer->client().flush();
-#if DBG_WIFI_HOTSPOT
-    Serial.printf("[WIFI_HOTSPOT] /list 响应完成，剩余内存: %d bytes\n", ESP.getFreeHeap());
-#endif
+
+    // 条目由 HTTP 任务逐项写出（chunked），内存占用与文件数无关
+    res.stream(200, "application/json", std::unique_ptr<HttpBodySource>(new HttpJsonSource([st](HttpJsonWriter &w) {
+        return file_list_step(*st, w);
+    })), -1);
 }
 
-void WiFiHotspotManager::handleFileUpload() {
+void WiFiHotspotManager::handleFileUpload(HttpRequest& req, HttpResponse& res) {
+    (void)req;
     String html = generateUploadForm();
-    webServer->send(200, "text/html; charset=utf-8", html);
+    res.send(200, "text/html; charset=utf-8", std::string(html.c_str(), html.length()));
 }
 
-void WiFiHotspotManager::handleFileDelete() {
-    String path = webServer->arg("path");
+void WiFiHotspotManager::handleFileDelete(HttpRequest& req, HttpResponse& res) {
+    String path = req.arg("path").c_str();
     if (path.isEmpty()) {
-        webServer->send(400, "application/json", String("{\"ok\":false,\"message\":\"Missing path parameter\"}"));
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Missing path parameter\"}");
         return;
     }
 
@@ -607,13 +655,16 @@ void WiFiHotspotManager::handleFileDelete() {
 #if DBG_WIFI_HOTSPOT
             Serial.printf("[WIFI_HOTSPOT] Deny deletion of currently opened book: %s\n", path.c_str());
 #endif
-            webServer->send(400, "application/json", String("{\"ok\":false,\"message\":\"Cannot delete currently opened book\"}"));
+            res.send(400, "application/json", "{\"ok\":false,\"message\":\"Cannot delete currently opened book\"}");
             return;
         }
     }
     
     if (SDW::SD.remove(path.c_str())) {
-        webServer->send(200, "application/json", String("{\"ok\":true,\"message\":\"File deleted successfully\"}"));
+        res.send(200, "application/json", "{\"ok\":true,\"message\":\"File deleted successfully\"}");
+        DirIndex::invalidate(path.c_str());
+        FileHashCache::forget(path.c_str());
+        FileHashCache::save();
         // 如果删除的是字体目录下的文件，刷新全局字体列表
         if (path.startsWith("/font/")) {
             font_list_scan();
@@ -652,6 +703,9 @@ void WiFiHotspotManager::handleFileDelete() {
 
             // 3) 删除 tags 文件（位于 SD /bookmarks，下同）
             (void)clearTagsForFile(canonical_fp);
+            // 全文检索索引 (.sidx)
+            (void)clearSearchIndexForFile(canonical_fp);
+            (void)clearFontSubsetForFile(canonical_fp);
 
             // 4) 删除同目录的 .idx 侧车文件（位于 SD，例如 /book/xxx.idx）
             // real_fp 示例： "/book/xxx.txt"，将其扩展名替换为 .idx
@@ -715,20 +769,20 @@ void WiFiHotspotManager::handleFileDelete() {
             }
         }
     } else {
-        webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Failed to delete file\"}"));
+        res.send(500, "application/json", "{\"ok\":false,\"message\":\"Failed to delete file\"}");
     }
 }
 
-void WiFiHotspotManager::handleFileDownload() {
-    String path = webServer->arg("path");
+void WiFiHotspotManager::handleFileDownload(HttpRequest& req, HttpResponse& res) {
+    String path = req.arg("path").c_str();
     if (path.isEmpty()) {
-        webServer->send(400, "application/json", String("{\"ok\":false,\"message\":\"Missing path parameter\"}"));
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Missing path parameter\"}");
         return;
     }
     // Normalize path and determine filename for Content-Disposition
     String norm = String(normalize_real_path(path.c_str()).c_str());
     if (norm.length() == 0) {
-        webServer->send(400, "application/json", String("{\"ok\":false,\"message\":\"Invalid path parameter\"}"));
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Invalid path parameter\"}");
         return;
     }
 
@@ -748,55 +802,66 @@ void WiFiHotspotManager::handleFileDownload() {
 
     if (!file || file.isDirectory()) {
         if (file) file.close();
-        webServer->send(404, "application/json", String("{\"ok\":false,\"message\":\"File not found\"}"));
+        res.send(404, "application/json", "{\"ok\":false,\"message\":\"File not found\"}");
         return;
     }
 
     // Set appropriate content type and Content-Disposition so browser saves with correct filename
+    // 文件由 HTTP 任务分段读入发送缓冲区，发送完毕随数据源关闭
     String contentType = getContentType(norm);
     String disposition = "attachment; filename=\"" + filename + "\"";
-    webServer->sendHeader("Content-Type", contentType);
-    webServer->sendHeader("Content-Disposition", disposition);
-    webServer->streamFile(file, contentType);
-    file.close();
+    res.setHeader("Content-Disposition", disposition.c_str());
+    res.setHeader("Accept-Ranges", "bytes");
+    int64_t fileSize = (int64_t)file.size();
+
+    // Range：断点续传下载只发送请求的区间（206）
+    int64_t first = 0, last = 0;
+    int range = http_parse_range(req.header("range"), fileSize, &first, &last);
+    if (range < 0) {
+        file.close();
+        res.setHeader("Content-Range", "bytes */" + std::to_string(fileSize));
+        res.send(416, "application/json", "{\"ok\":false,\"message\":\"Range not satisfiable\"}");
+        return;
+    }
+    if (range > 0 && file.seek((uint32_t)first)) {
+        int64_t len = last - first + 1;
+        res.setHeader("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(fileSize));
+        res.stream(206, contentType.c_str(), std::unique_ptr<HttpBodySource>(new HttpFileSource(file, len)), len);
+        return;
+    }
+    res.stream(200, contentType.c_str(), std::unique_ptr<HttpBodySource>(new HttpFileSource(file)), fileSize);
 }
 
-// Helper function to parse a .rec file and return JSON object for a single book
-static void parseRecFileToJson(const std::string &rec_file_path, const std::string &book_path, String &jsonOutput) {
-    jsonOutput = "{";
-    jsonOutput += "\"book_path\":\"" + String(book_path.c_str()) + "\",";
-    
-    // Extract book name from path
-    size_t lastSlash = book_path.find_last_of("/");
-    std::string bookName = (lastSlash != std::string::npos) ? book_path.substr(lastSlash + 1) : book_path;
-    jsonOutput += "\"book_name\":\"" + String(bookName.c_str()) + "\",";
-    
+// 单本书 .rec 的统计结果（解析在生成器取到这本书时进行，一次只保留一本）
+struct RecSummary {
+    const char *error = nullptr;
+    int totalHours = 0;
+    int totalMinutes = 0;
+    std::map<std::string, int32_t> hourlyRecords;
+    std::map<std::string, int32_t> dailySummary;
+    std::map<std::string, int32_t> monthlySummary;
+    // Time period distribution (same logic as ui_time_rec.cpp)
+    int32_t morning_mins = 0;   // 04:00-12:00
+    int32_t afternoon_mins = 0; // 12:00-20:00
+    int32_t night_mins = 0;     // 20:00-04:00
+    int32_t unknown_mins = 0;   // Format errors
+};
+
+// Helper function to parse a .rec file (and the .bm total time) for a single book
+static void loadRecSummary(const std::string &rec_file_path, const std::string &book_path, RecSummary &out) {
     if (!SDW::SD.exists(rec_file_path.c_str())) {
-        jsonOutput += "\"error\":\"Record file not found\",";
-        jsonOutput += "\"total_hours\":0,\"total_minutes\":0,";
-        jsonOutput += "\"hourly_records\":{},";
-        jsonOutput += "\"daily_summary\":{},";
-        jsonOutput += "\"monthly_summary\":{}";
-        jsonOutput += "}";
+        out.error = "Record file not found";
         return;
     }
     
     File rf = SDW::SD.open(rec_file_path.c_str(), "r");
     if (!rf) {
-        jsonOutput += "\"error\":\"Failed to open record file\",";
-        jsonOutput += "\"total_hours\":0,\"total_minutes\":0,";
-        jsonOutput += "\"hourly_records\":{},";
-        jsonOutput += "\"daily_summary\":{},";
-        jsonOutput += "\"monthly_summary\":{}";
-        jsonOutput += "}";
+        out.error = "Failed to open record file";
         return;
     }
     
     // Get total time from .bm file (bookmark file) instead of .rec file
     // This matches the device-side ui_time_rec logic
-    int totalHours = 0;
-    int totalMinutes = 0;
-    
     std::string bm_file_path = getBookmarkFileName(book_path);
     
 #if DBG_WIFI_HOTSPOT
@@ -822,14 +887,14 @@ static void parseRecFileToJson(const std::string &rec_file_path, const std::stri
                     value.trim();
                     
                     if (key == "readhour") {
-                        totalHours = value.toInt();
+                        out.totalHours = value.toInt();
 #if DBG_WIFI_HOTSPOT
-                        Serial.printf("[WIFI_HOTSPOT] Found readhour=%d\n", totalHours);
+                        Serial.printf("[WIFI_HOTSPOT] Found readhour=%d\n", out.totalHours);
 #endif
                     } else if (key == "readmin") {
-                        totalMinutes = value.toInt();
+                        out.totalMinutes = value.toInt();
 #if DBG_WIFI_HOTSPOT
-                        Serial.printf("[WIFI_HOTSPOT] Found readmin=%d\n", totalMinutes);
+                        Serial.printf("[WIFI_HOTSPOT] Found readmin=%d\n", out.totalMinutes);
 #endif
                     }
                 }
@@ -850,19 +915,6 @@ static void parseRecFileToJson(const std::string &rec_file_path, const std::stri
         rf.readStringUntil('\n');
     }
     
-    jsonOutput += "\"total_hours\":" + String(totalHours) + ",";
-    jsonOutput += "\"total_minutes\":" + String(totalMinutes) + ",";
-    
-    // Parse hourly records
-    std::map<std::string, int32_t> hourlyRecords;
-    std::map<std::string, int32_t> dailySummary;
-    std::map<std::string, int32_t> monthlySummary;
-    
-    // Time period distribution (same logic as ui_time_rec.cpp)
-    int32_t morning_mins = 0;   // 04:00-12:00
-    int32_t afternoon_mins = 0; // 12:00-20:00
-    int32_t night_mins = 0;     // 20:00-04:00
-    int32_t unknown_mins = 0;   // Format errors
     
     while (rf.available()) {
         String line = rf.readStringUntil('\n');
@@ -895,98 +947,203 @@ static void parseRecFileToJson(const std::string &rec_file_path, const std::stri
             std::string timestamp = ts.c_str();
             // 仅处理格式正确的时间戳（YYYYMMDDHH = 10位）
             if (timestamp.length() == 10 && mins >= 0) {
-                hourlyRecords[timestamp] = mins;
+                out.hourlyRecords[timestamp] = mins;
                 
                 // Aggregate by day (YYYYMMDD)
                 std::string day = timestamp.substr(0, 8);
-                dailySummary[day] += mins;
+                out.dailySummary[day] += mins;
                 
                 // Aggregate by month (YYYYMM)
                 std::string month = timestamp.substr(0, 6);
-                monthlySummary[month] += mins;
+                out.monthlySummary[month] += mins;
                 
                 // Calculate time period distribution
                 // Extract hour (last 2 digits)
                 int hour = atoi(timestamp.substr(8, 2).c_str());
                 
                 if (hour >= 4 && hour < 12) {
-                    morning_mins += mins;
+                    out.morning_mins += mins;
                 } else if (hour >= 12 && hour < 20) {
-                    afternoon_mins += mins;
+                    out.afternoon_mins += mins;
                 } else { // 20:00-04:00 (20-23, 0-3)
-                    night_mins += mins;
+                    out.night_mins += mins;
                 }
             } else {
                 // Format error, count as unknown
-                unknown_mins += mins;
+                out.unknown_mins += mins;
             }
         }
     }
     rf.close();
+}
+
+// Try different path prefixes to find the .rec file
+static void resolveRecPath(const std::string &bookPath, std::string &recPath, std::string &actualBookPath) {
+    actualBookPath = bookPath;
     
-    // Build hourly_records JSON
-    jsonOutput += "\"hourly_records\":{";
-    bool first = true;
-    for (const auto& entry : hourlyRecords) {
-        if (!first) jsonOutput += ",";
-        jsonOutput += "\"" + String(entry.first.c_str()) + "\":" + String(entry.second);
-        first = false;
-    }
-    jsonOutput += "},";
-    
-    // Build daily_summary JSON
-    jsonOutput += "\"daily_summary\":{";
-    first = true;
-    for (const auto& entry : dailySummary) {
-        if (!first) jsonOutput += ",";
-        jsonOutput += "\"" + String(entry.first.c_str()) + "\":" + String(entry.second);
-        first = false;
-    }
-    jsonOutput += "},";
-    
-    // Build monthly_summary JSON
-    jsonOutput += "\"monthly_summary\":{";
-    first = true;
-    for (const auto& entry : monthlySummary) {
-        if (!first) jsonOutput += ",";
-        jsonOutput += "\"" + String(entry.first.c_str()) + "\":" + String(entry.second);
-        first = false;
-    }
-    jsonOutput += "},";
-    
-    // Add time period distribution (04-12, 12-20, 20-04, unknown)
-    // Based on actual hourly records sum, not bm file total
-    int32_t actual_total_mins = morning_mins + afternoon_mins + night_mins + unknown_mins;
-    jsonOutput += "\"time_distribution\":{";
-    jsonOutput += "\"morning_04_12\":" + String(morning_mins) + ",";
-    jsonOutput += "\"afternoon_12_20\":" + String(afternoon_mins) + ",";
-    jsonOutput += "\"night_20_04\":" + String(night_mins) + ",";
-    jsonOutput += "\"unknown\":" + String(unknown_mins) + ",";
-    jsonOutput += "\"total_from_records\":" + String(actual_total_mins);
-    jsonOutput += "}";
-    
-    jsonOutput += "}";
+    // If path doesn't have /sd/ or /spiffs/ prefix, try both
+    if (bookPath.find("/sd/") != 0 && bookPath.find("/spiffs/") != 0) {
+        // Try /sd prefix first (most common for books)
+        std::string sdPath = "/sd" + bookPath;
+        std::string sdRecPath = getRecordFileName(sdPath);
+        
+#if DBG_WIFI_HOTSPOT
+        Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", sdRecPath.c_str());
+#endif
+        
+        if (SDW::SD.exists(sdRecPath.c_str())) {
+            recPath = sdRecPath;
+            actualBookPath = sdPath;
+        } else {
+            // Try /spiffs prefix
+            std::string spiffsPath = "/spiffs" + bookPath;
+            std::string spiffsRecPath = getRecordFileName(spiffsPath);
+            
+#if DBG_WIFI_HOTSPOT
+            Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", spiffsRecPath.c_str());
+#endif
+            
+            if (SDW::SD.exists(spiffsRecPath.c_str())) {
+                recPath = spiffsRecPath;
+                actualBookPath = spiffsPath;
+            } else {
+                // Try without prefix as last resort
+                recPath = getRecordFileName(bookPath);
+                
+#if DBG_WIFI_HOTSPOT
+                Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", recPath.c_str());
+#endif
+            }
+        }
+    } else {
+        recPath = getRecordFileName(bookPath);
+        
+#if DBG_WIFI_HOTSPOT
+        Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", recPath.c_str());
+#endif
+    }
+}
+
+// /api/reading_records 的流式生成状态：每次取一本书解析其 .rec，
+// 三张统计表逐项写出，内存中只保留当前这本书的统计
+struct ReadingRecordsStream {
+    std::vector<std::string> bookPaths;
+    size_t next = 0;
+    int processed = 0;
+    int phase = 0; // 0 头部；1 下一本书；2/3/4 hourly/daily/monthly 表项
+    RecSummary cur;
+    std::map<std::string, int32_t>::const_iterator it;
+};
+
+static const std::map<std::string, int32_t> &rec_table(const RecSummary &s, int phase) {
+    if (phase == 2) return s.hourlyRecords;
+    if (phase == 3) return s.dailySummary;
+    return s.monthlySummary;
+}
+
+static const char *const REC_TABLE_KEYS[] = {"hourly_records", "daily_summary", "monthly_summary"};
+
+static bool reading_records_step(ReadingRecordsStream &st, HttpJsonWriter &w) {
+    if (st.phase == 0) {
+        w.beginObject();
+        w.field("total", (int)st.bookPaths.size());
+        w.key("records");
+        w.beginArray();
+        st.phase = 1;
+        return true;
+    }
+
+    if (st.phase == 1) {
+        if (st.next >= st.bookPaths.size() || ESP.getFreeHeap() < 4096) {
+#if DBG_WIFI_HOTSPOT
+            if (st.next < st.bookPaths.size()) {
+                Serial.printf("[WIFI_HOTSPOT] 内存不足，停止处理，已处理 %d/%d\n", st.processed, (int)st.bookPaths.size());
+            }
+            Serial.printf("[WIFI_HOTSPOT] /api/reading_records 完成，处理了 %d/%d 本书\n", st.processed, (int)st.bookPaths.size());
+#endif
+            w.endArray();
+            w.field("processed", st.processed);
+            w.endObject();
+            return false;
+        }
+
+        std::string recPath, actualBookPath;
+        resolveRecPath(st.bookPaths[st.next], recPath, actualBookPath);
+        st.cur = RecSummary();
+        loadRecSummary(recPath, actualBookPath, st.cur);
+
+        // Extract book name from path
+        size_t lastSlash = actualBookPath.find_last_of("/");
+        std::string bookName = (lastSlash != std::string::npos) ? actualBookPath.substr(lastSlash + 1) : actualBookPath;
+
+        w.beginObject();
+        w.field("book_path", actualBookPath);
+        w.field("book_name", bookName);
+        if (st.cur.error) w.field("error", st.cur.error);
+        w.field("total_hours", st.cur.totalHours);
+        w.field("total_minutes", st.cur.totalMinutes);
+        w.key(REC_TABLE_KEYS[0]);
+        w.beginObject();
+        st.phase = 2;
+        st.it = st.cur.hourlyRecords.begin();
+        return true;
+    }
+
+    // 统计表：每步写出一项
+    const std::map<std::string, int32_t> &table = rec_table(st.cur, st.phase);
+    if (st.it != table.end()) {
+        w.key(st.it->first);
+        w.value(st.it->second);
+        ++st.it;
+        return true;
+    }
+    w.endObject();
+    if (st.phase < 4) {
+        st.phase++;
+        w.key(REC_TABLE_KEYS[st.phase - 2]);
+        w.beginObject();
+        st.it = rec_table(st.cur, st.phase).begin();
+        return true;
+    }
+
+    if (!st.cur.error) {
+        // Add time period distribution (04-12, 12-20, 20-04, unknown)
+        // Based on actual hourly records sum, not bm file total
+        const RecSummary &s = st.cur;
+        w.key("time_distribution");
+        w.beginObject();
+        w.field("morning_04_12", s.morning_mins);
+        w.field("afternoon_12_20", s.afternoon_mins);
+        w.field("night_20_04", s.night_mins);
+        w.field("unknown", s.unknown_mins);
+        w.field("total_from_records", s.morning_mins + s.afternoon_mins + s.night_mins + s.unknown_mins);
+        w.endObject();
+    }
+    w.endObject();
+    st.cur = RecSummary();
+    st.next++;
+    st.processed++;
+    st.phase = 1;
+    return true;
 }
 
-void WiFiHotspotManager::handleReadingRecords() {
+void WiFiHotspotManager::handleReadingRecords(HttpRequest& req, HttpResponse& res) {
     // Parse query parameters
     // Supports: 
     // - /api/reading_records?book=/book/example.txt (single book)
     // - /api/reading_records?books=/book/a.txt,/book/b.txt (multiple books)
     // - /api/reading_records (all books with .rec files)
     
-    String bookParam = webServer->hasArg("book") ? webServer->arg("book") : "";
-    String booksParam = webServer->hasArg("books") ? webServer->arg("books") : "";
+    String bookParam = req.arg("book").c_str();
+    String booksParam = req.arg("books").c_str();
     
 #if DBG_WIFI_HOTSPOT
     Serial.printf("[WIFI_HOTSPOT] /api/reading_records request, book: %s, books: %s\n", 
                  bookParam.c_str(), booksParam.c_str());
 #endif
     
-    webServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
-    webServer->send(200, "application/json", "");
-    
-    std::vector<std::string> bookPaths;
+    std::shared_ptr<ReadingRecordsStream> st = std::make_shared<ReadingRecordsStream>();
+    std::vector<std::string> &bookPaths = st->bookPaths;
     
     // Single book query
     if (bookParam.length() > 0) {
@@ -1060,123 +1217,218 @@ void WiFiHotspotManager::handleReadingRecords() {
         }
     }
     
-    // Send response with progress info
-    int totalBooks = bookPaths.size();
-    webServer->sendContent("{\"total\":" + String(totalBooks) + ",");
-    webServer->sendContent("\"records\":[");
     
-    bool first = true;
-    int processed = 0;
+    // 逐本解析并写出（chunked），响应长度与书的数量、记录条数无关
+    res.stream(200, "application/json", std::unique_ptr<HttpBodySource>(new HttpJsonSource([st](HttpJsonWriter &w) {
+        return reading_records_step(*st, w);
+    })), -1);
+}
+
+void WiFiHotspotManager::handleNotFound(HttpRequest& req, HttpResponse& res) {
+    std::string message = "File Not Found\n\n";
+    message += "URI: " + req.path + "\n";
+    message += std::string("Method: ") + http_method_name(req.method) + "\n";
+    message += "Arguments: " + std::to_string(req.args.size()) + "\n";
     
-    for (const auto& bookPath : bookPaths) {
-        if (ESP.getFreeHeap() < 4096) {
-#if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] 内存不足，停止处理，已处理 %d/%d\n", processed, totalBooks);
-#endif
-            break;
-        }
-        
-        // Try different path prefixes to find the .rec file
-        std::string recPath;
-        std::string actualBookPath = bookPath;
-        
-        // If path doesn't have /sd/ or /spiffs/ prefix, try both
-        if (bookPath.find("/sd/") != 0 && bookPath.find("/spiffs/") != 0) {
-            // Try /sd prefix first (most common for books)
-            std::string sdPath = "/sd" + bookPath;
-            std::string sdRecPath = getRecordFileName(sdPath);
-            
+    for (const auto& kv : req.args) {
+        message += " " + kv.first + ": " + kv.second + "\n";
+    }
+    
+    res.send(404, "text/plain", std::move(message));
+}
+
+// 上传落盘后的刷新：内容散列、字体列表、书籍缓存（覆盖当前书时强制重建索引）、锁屏图片缓存。
+// crc 非空表示上传时已边收边算出整文件 CRC，直接记入散列缓存，/sync 比对时无需再读文件
+static void after_upload_finalized(const String& fullPath, const uint32_t* crc = nullptr) {
+    DirIndex::invalidate(fullPath.c_str());
+    File written = crc ? SDW::SD.open(fullPath.c_str(), "r") : File();
+    if (written) {
+        FileHashCache::record(fullPath.c_str(), (uint32_t)written.size(), (uint32_t)written.getLastWrite(), *crc);
+        written.close();
+    } else {
+        FileHashCache::forget(fullPath.c_str());
+    }
+    FileHashCache::save();
+
+    // 如果上传到字体目录，刷新全局字体列表
+    if (fullPath.startsWith("/font/")) {
+        font_list_scan();
+    }
+
+    // 如果上传到书籍目录，刷新书籍缓存并检测覆盖
+    if (fullPath.startsWith("/book/")) {
+        BookFileManager::refreshCache();
+
+        if (g_current_book) {
+            std::string cur_fp = g_current_book->filePath();
+            std::string cur_real;
+            bool cur_use_spiffs = false;
+            resolve_fake_path(cur_fp, cur_real, cur_use_spiffs);
+            cur_real = normalize_real_path(cur_real);
+
+            std::string up_fp = std::string(fullPath.c_str());
+            std::string up_real;
+            bool up_use_spiffs = false;
+            resolve_fake_path(up_fp, up_real, up_use_spiffs);
+            up_real = normalize_real_path(up_real);
+
 #if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", sdRecPath.c_str());
+            Serial.printf("[WIFI_HOTSPOT] normalized current='%s' (spiffs=%d) uploaded='%s' (spiffs=%d)\n",
+                          cur_real.c_str(), cur_use_spiffs, up_real.c_str(), up_use_spiffs);
 #endif
-            
-            if (SDW::SD.exists(sdRecPath.c_str())) {
-                recPath = sdRecPath;
-                actualBookPath = sdPath;
-            } else {
-                // Try /spiffs prefix
-                std::string spiffsPath = "/spiffs" + bookPath;
-                std::string spiffsRecPath = getRecordFileName(spiffsPath);
-                
+
+            if (cur_real == up_real && cur_use_spiffs == up_use_spiffs) {
 #if DBG_WIFI_HOTSPOT
-                Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", spiffsRecPath.c_str());
+                Serial.printf("[WIFI_HOTSPOT] 当前书籍已被覆盖，触发强制重建索引: %s\n", fullPath.c_str());
 #endif
-                
-                if (SDW::SD.exists(spiffsRecPath.c_str())) {
-                    recPath = spiffsRecPath;
-                    actualBookPath = spiffsPath;
-                } else {
-                    // Try without prefix as last resort
-                    recPath = getRecordFileName(bookPath);
-                    
-#if DBG_WIFI_HOTSPOT
-                    Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", recPath.c_str());
-#endif
-                }
+                extern void requestForceReindex();
+                requestForceReindex();
             }
-        } else {
-            recPath = getRecordFileName(bookPath);
-            
-#if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] Checking rec file: %s\n", recPath.c_str());
-#endif
         }
-        
-        String recordJson;
-        parseRecFileToJson(recPath, actualBookPath, recordJson);
-        
-        if (!first) {
-            webServer->sendContent(",");
+    }
+    // 如果上传到图片目录，清理锁屏图片缓存以便下次重新扫描
+    if (fullPath.startsWith("/image/")) {
+        lockscreen_image_cache_invalidate();
+    }
+}
+
+// 上传目标路径：tab 决定目录；tab=scback 不使用上传文件名，固定保存为 SD 根目录下的 /scback.png。
+// 书籍的 .txt.lz（tools/lzbook 或网页端打包）保留原名：内容是 RPLZ 二进制，经 USB 或其他工具看到的仍是 .lz
+static String upload_target_path(const String& tab, String filename) {
+    if (!filename.startsWith("/")) filename = "/" + filename;
+    String uploadDir = "/";
+    if (tab == "book") {
+        uploadDir = "/book/";
+    } else if (tab == "font") {
+        uploadDir = "/font/";
+    } else if (tab == "image") {
+        uploadDir = "/image/";
+    }
+    if (tab == "scback") {
+        filename = "/scback.png"; // 强制目标文件名
+    }
+    return uploadDir + filename.substring(1); // 去掉开头的/
+}
+
+// 单次上传的状态，挂在请求上（HttpRequest::context）：
+// 多个连接可以同时上传，各自持有写卡流水线；连接中断或请求结束时析构，未完成的临时文件随之删除
+struct UploadSession : public HttpRequestContext {
+    explicit UploadSession(volatile int* counter) : activeCounter(counter) { (*activeCounter)++; }
+    ~UploadSession() override {
+        pipe.abort(); // 等写入任务放下文件后再删临时文件
+        if (!finalized && tmpPath.length() && SDW::SD.exists(tmpPath.c_str())) {
+            SDW::SD.remove(tmpPath.c_str());
         }
-        webServer->sendContent(recordJson);
-        first = false;
-        processed++;
-        
-        yield();
+        (*activeCounter)--;
     }
-    
-    webServer->sendContent("],");
-    webServer->sendContent("\"processed\":" + String(processed));
-    webServer->sendContent("}");
-    webServer->sendContent(""); // 结束响应
-    
-#if DBG_WIFI_HOTSPOT
-    Serial.printf("[WIFI_HOTSPOT] /api/reading_records 完成，处理了 %d/%d 本书\n", processed, totalBooks);
-#endif
+
+    volatile int* activeCounter;
+    SdWritePipeline pipe;     // 接收与写卡重叠：数据进 PSRAM 缓冲，由 SD 写入任务落盘
+    String tab;
+    String fullPath;          // 完整文件路径
+    String tmpPath;           // 临时文件路径（写入期间使用）
+    size_t totalBytesWritten = 0; // 实际写入的字节数
+    uint32_t crc = 0;         // 已写入数据的 CRC-32（落盘后记入 FileHashCache）
+    unsigned long startTime = 0;  // 上传开始时间
+    bool finalized = false;   // 临时文件已改名为目标文件
+    std::string sidecarBook;  // 非空表示上传的是该书（/sd/book/...）的预索引文件
+    String sidecarExt;        // ".page" 或 ".complete"
+};
+
+// 上传结果统一以 JSON 返回并关闭连接（与旧实现一致，客户端据此重新建连）
+static void send_upload_result(HttpResponse& res, int code, const char* json) {
+    res.closeAfter();
+    res.setHeader("Access-Control-Allow-Origin", "*");
+    res.send(code, "application/json", json);
 }
 
-void WiFiHotspotManager::handleNotFound() {
-    String message = "File Not Found\n\n";
-    message += "URI: " + webServer->uri() + "\n";
-    message += "Method: " + String(webServer->method() == HTTP_GET ? "GET" : "POST") + "\n";
-    message += "Arguments: " + String(webServer->args()) + "\n";
-    
-    for (uint8_t i = 0; i < webServer->args(); i++) {
-        message += " " + webServer->argName(i) + ": " + webServer->arg(i) + "\n";
+// ---------------------------------------------------------------------------
+// 预索引侧车文件：/upload?tab=book&sidecar=<书籍文件名>
+// tools/preindex 在电脑上生成的 .page / .complete 按扩展名写到 /bookmarks/<净化后的书籍路径>.<扩展名>，
+// 与后台索引任务的产物同名，书籍打开时即为已完成索引。先传 .page（校验 BPG1 头并清掉旧的进度、字形集合、
+// 完成标记），再传 .complete（要求 .page 已就绪）。当前打开的书由后台索引任务写这些文件，拒绝上传。
+
+static bool is_current_book(const std::string& canonical_fp) {
+    if (!g_current_book) return false;
+    std::string cur_real, up_real;
+    bool cur_spiffs = false, up_spiffs = false;
+    resolve_fake_path(g_current_book->filePath(), cur_real, cur_spiffs);
+    resolve_fake_path(canonical_fp, up_real, up_spiffs);
+    return cur_spiffs == up_spiffs && normalize_real_path(cur_real) == normalize_real_path(up_real);
+}
+
+static bool page_file_has_header(const char* path) {
+    File f = SDW::SD.open(path, "r");
+    if (!f) return false;
+    uint8_t hdr[12] = {0};
+    bool ok = f.read(hdr, sizeof(hdr)) == sizeof(hdr) && memcmp(hdr, "BPG1", 4) == 0;
+    uint32_t count = 0;
+    memcpy(&count, hdr + 8, sizeof(count));
+    f.close();
+    return ok && count > 0;
+}
+
+// 校验参数并给出目标路径；失败时返回 HTTP 状态码并填好 JSON
+static int sidecar_target(const String& book, const String& filename, UploadSession* session, String& target, const char*& json) {
+    if (book.length() == 0 || book.indexOf('/') >= 0 || book.indexOf("..") >= 0) {
+        json = "{\"ok\":false,\"message\":\"Invalid sidecar book name\"}";
+        return 400;
     }
-    
-    webServer->send(404, "text/plain", message);
+    int dot = filename.lastIndexOf('.');
+    String ext = dot >= 0 ? filename.substring(dot) : String("");
+    ext.toLowerCase();
+    if (ext != ".page" && ext != ".complete") {
+        json = "{\"ok\":false,\"message\":\"Sidecar must be a .page or .complete file\"}";
+        return 400;
+    }
+    String real = String("/book/") + book;
+    if (!SDW::SD.exists(real.c_str())) {
+        json = "{\"ok\":false,\"message\":\"Book not found - upload the book first\"}";
+        return 404;
+    }
+    std::string canonical = std::string("/sd") + real.c_str();
+    if (is_current_book(canonical)) {
+        json = "{\"ok\":false,\"message\":\"Book is currently open - close it before uploading its index\"}";
+        return 409;
+    }
+    // 与 .bm 同一净化规则：把书签文件名的扩展名换掉
+    std::string bm = getBookmarkFileName(canonical);
+    std::string stem = bm.substr(0, bm.find_last_of('.'));
+    if (ext == ".complete" && !page_file_has_header((stem + ".page").c_str())) {
+        json = "{\"ok\":false,\"message\":\"Upload the .page file before .complete\"}";
+        return 409;
+    }
+    target = String(stem.c_str()) + ext;
+    session->sidecarBook = canonical;
+    session->sidecarExt = ext;
+    return 0;
 }
 
-void WiFiHotspotManager::handleFileUploadPost() {
-    HTTPUpload& upload = webServer->upload();
-    
-    static File uploadFile;
-    static String uploadTab = "";
-    static String uploadDir = "/";  // 默认上传目录
-    static String fullPath = "";    // 完整文件路径
-    static String tmpPath = "";     // 临时文件路径（写入期间使用）
-    static unsigned long lastWriteTime = 0;
-    static size_t totalBytesWritten = 0; // 实际写入的字节数
-    static unsigned long uploadStartTime = 0; // 上传开始时间
+// .page 落盘后：旧的进度/字形集合/完成标记属于上一次索引，一并删除；
+// 书签记录的文件大小与当前书不符时设备会强制重建索引，也删掉（书已被替换，旧阅读位置无意义）
+static void after_sidecar_finalized(const UploadSession* session) {
+    if (session->sidecarExt != ".page") return;
+    std::string bm = getBookmarkFileName(session->sidecarBook);
+    std::string stem = bm.substr(0, bm.find_last_of('.'));
+    const char* stale[] = {".progress", ".progress.tmp", ".pgg", ".complete"};
+    for (const char* ext : stale) {
+        std::string p = stem + ext;
+        if (SDW::SD.exists(p.c_str())) SDW::SD.remove(p.c_str());
+    }
+    if (isFileModified(session->sidecarBook) && SDW::SD.exists(bm.c_str())) {
+        SDW::SD.remove(bm.c_str());
+    }
+}
+
+void WiFiHotspotManager::handleFileUploadPost(HttpRequest& req, HttpResponse& res, HttpUpload& upload) {
     const unsigned long UPLOAD_TIMEOUT = 300000; // 上传超时时间300秒（5分钟）支持大文件
-    
-    if (upload.status == UPLOAD_FILE_START) {
-        // 设置上传状态标志
-        uploadInProgress = true;
-        
-        String filename = upload.filename;
-        if (!filename.startsWith("/")) filename = "/" + filename;
+    UploadSession* session = static_cast<UploadSession*>(req.context.get());
+
+    if (upload.status == HTTP_UPLOAD_START) {
+        // 请求体长度是文件大小的上界，开始写入前即可做容量预检
+        size_t expectedSize = upload.contentLength > 0 ? (size_t)upload.contentLength : 0;
+
+        String filename = upload.filename.c_str();
         
         // 检查内存状况 - 只需要足够的缓冲区内存用于流式处理
         size_t freeHeap = ESP.getFreeHeap();
@@ -1184,386 +1436,1174 @@ void WiFiHotspotManager::handleFileUploadPost() {
 #if DBG_WIFI_HOTSPOT
             Serial.printf("[WIFI_HOTSPOT] 内存不足，拒绝上传: %u bytes (流式处理需要至少32KB)\n", freeHeap);
 #endif
-            webServer->sendHeader("Connection", "close");
-            webServer->sendHeader("Access-Control-Allow-Origin", "*");
-            webServer->send(507, "application/json", String("{\"ok\":false,\"message\":\"Insufficient memory for streaming upload - need at least 32KB free\"}"));
+            send_upload_result(res, 507, "{\"ok\":false,\"message\":\"Insufficient memory for streaming upload - need at least 32KB free\"}");
             return;
         }
         
-        // 重置状态变量
-        totalBytesWritten = 0;
-        uploadStartTime = millis();
-        
         // 检查文件大小限制 - 提升到50MB支持大文本文件
         const size_t maxFileSize = 50 * 1024 * 1024; // 50MB限制，支持大文本文件
-        if (upload.totalSize > maxFileSize) {
+        if (expectedSize > maxFileSize) {
 #if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] 文件过大: %u bytes (最大支持20MB)\n", upload.totalSize);
+            Serial.printf("[WIFI_HOTSPOT] 文件过大: %u bytes (最大支持50MB)\n", expectedSize);
 #endif
-            webServer->sendHeader("Connection", "close");
-            webServer->sendHeader("Access-Control-Allow-Origin", "*");
-            webServer->send(413, "application/json", String("{\"ok\":false,\"message\":\"File too large - maximum 20MB supported\"}"));
+            send_upload_result(res, 413, "{\"ok\":false,\"message\":\"File too large - maximum 20MB supported\"}");
             return;
         }
+
+        // 同一请求中的下一个文件字段会替换上一个会话（上一个已在 END 时完成）
+        req.context.reset(session = new UploadSession(&activeUploads));
+        session->startTime = millis();
         
         // 获取tab参数，确定上传目录
-        uploadTab = webServer->arg("tab");
-        uploadDir = "/";
-        if (uploadTab == "book") {
-            uploadDir = "/book/";
-        } else if (uploadTab == "font") {
-            uploadDir = "/font/";
-        } else if (uploadTab == "image") {
-            uploadDir = "/image/";
-        }
-
-        // 支持特殊 tab=scback：不使用上传文件名，而是强制保存为 SD 根目录下的 /scback.png
-        if (uploadTab == "scback") {
-            filename = "/scback.png"; // 强制目标文件名
+        session->tab = req.arg("tab").c_str();
+        session->fullPath = upload_target_path(session->tab, filename);
+        if (session->tab == "book" && req.hasArg("sidecar")) {
+            const char* json = nullptr;
+            int code = sidecar_target(req.arg("sidecar").c_str(), filename, session, session->fullPath, json);
+            if (code != 0) {
+                send_upload_result(res, code, json);
+                return;
+            }
         }
-
-        // 构建完整路径
-        fullPath = uploadDir + filename.substring(1); // 去掉开头的/
         
 #if DBG_WIFI_HOTSPOT
-        Serial.printf("[WIFI_HOTSPOT] 开始上传文件: %s (%u bytes)\n", fullPath.c_str(), upload.totalSize);
+        Serial.printf("[WIFI_HOTSPOT] 开始上传文件: %s (<= %u bytes, conn %d)\n", session->fullPath.c_str(), expectedSize, req.conn_id);
 #endif
         
         // 检查SD卡可用性
-    uint64_t cardSize = SDW::SD.cardSize() / (1024 * 1024); // MB
-    uint64_t usedBytes = SDW::SD.usedBytes() / (1024 * 1024); // MB
+        uint64_t cardSize = SDW::SD.cardSize() / (1024 * 1024); // MB
+        uint64_t usedBytes = SDW::SD.usedBytes() / (1024 * 1024); // MB
         uint64_t freeBytes = (SDW::SD.cardSize() - SDW::SD.usedBytes()) / (1024 * 1024); // MB
-    (void)cardSize; // might only be used in debug prints
-    (void)usedBytes; // might only be used in debug prints
+        (void)cardSize; // might only be used in debug prints
+        (void)usedBytes; // might only be used in debug prints
         
 #if DBG_WIFI_HOTSPOT
         Serial.printf("[WIFI_HOTSPOT] SD卡状态: 总计 %llu MB, 已用 %llu MB, 剩余 %llu MB\n", 
                     cardSize, usedBytes, freeBytes);
 #endif
         
-        if (freeBytes < (upload.totalSize / (1024 * 1024) + 10)) { // 预留10MB空间
+        if (freeBytes < (expectedSize / (1024 * 1024) + 10)) { // 预留10MB空间
 #if DBG_WIFI_HOTSPOT
             Serial.printf("[WIFI_HOTSPOT] SD卡空间不足，需要 %u MB，剩余 %llu MB\n", 
-                        (upload.totalSize / (1024 * 1024) + 1), freeBytes);
+                        (expectedSize / (1024 * 1024) + 1), freeBytes);
 #endif
-            webServer->sendHeader("Connection", "close");
-            webServer->sendHeader("Access-Control-Allow-Origin", "*");
-            webServer->send(507, "application/json", String("{\"ok\":false,\"message\":\"Insufficient storage space\"}"));
+            send_upload_result(res, 507, "{\"ok\":false,\"message\":\"Insufficient storage space\"}");
             return;
         }
         
         // 确保目录存在
-        String dirPath = fullPath.substring(0, fullPath.lastIndexOf('/'));
+        String dirPath = session->fullPath.substring(0, session->fullPath.lastIndexOf('/'));
         if (!SDW::SD.exists(dirPath.c_str())) {
             // 创建目录
             SDW::SD.mkdir(dirPath.c_str());
         }
         
         // 使用临时文件写入，上传完成后再重命名到目标路径，避免部分写入被认为存在
-        tmpPath = fullPath + ".tmp";
-        if (SDW::SD.exists(tmpPath.c_str())) {
-            SDW::SD.remove(tmpPath.c_str());
+        session->tmpPath = session->fullPath + ".tmp";
+        if (SDW::SD.exists(session->tmpPath.c_str())) {
+            SDW::SD.remove(session->tmpPath.c_str());
         }
 
-    uploadFile = SDW::SD.open(tmpPath, "w");
-        if (!uploadFile) {
+        File file = SDW::SD.open(session->tmpPath, "w");
+        if (!file) {
 #if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] 错误: 无法创建文件 %s\n", fullPath.c_str());
+            Serial.printf("[WIFI_HOTSPOT] 错误: 无法创建文件 %s\n", session->fullPath.c_str());
 #endif
-            webServer->sendHeader("Connection", "close");
-            webServer->sendHeader("Access-Control-Allow-Origin", "*");
-            webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Failed to create file\"}"));
+            send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Failed to create file\"}");
             return;
         }
-        
-        lastWriteTime = millis();
-        
-    } else if (upload.status == UPLOAD_FILE_WRITE) {
-        // 定期yielding防止看门狗超时和网络冲突
-        static unsigned long lastYieldTime = 0;
-        if (millis() - lastYieldTime > 20) { // 每20ms yield一次，防止看门狗超时
-            yield();
-            delay(1); // 短暂延迟让系统稳定
-            lastYieldTime = millis();
+        if (!session->pipe.begin(file)) {
+            file.close();
+#if DBG_WIFI_HOTSPOT
+            Serial.printf("[WIFI_HOTSPOT] 无法分配上传缓冲\n");
+#endif
+            send_upload_result(res, 507, "{\"ok\":false,\"message\":\"Insufficient memory for upload buffers\"}");
+            return;
         }
         
+    } else if (upload.status == HTTP_UPLOAD_WRITE) {
+        if (!session || res.sent()) {
+            return; // 已经应答了错误，丢弃剩余数据
+        }
+
         // 检查上传超时
-        if (millis() - uploadStartTime > UPLOAD_TIMEOUT) {
+        if (millis() - session->startTime > UPLOAD_TIMEOUT) {
 #if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] 上传超时，已用时: %lu ms\n", millis() - uploadStartTime);
+            Serial.printf("[WIFI_HOTSPOT] 上传超时，已用时: %lu ms\n", millis() - session->startTime);
 #endif
-            if (uploadFile) {
-                uploadFile.close();
-                if (SDW::SD.exists(tmpPath.c_str())) SDW::SD.remove(tmpPath.c_str());
-            }
-            webServer->sendHeader("Connection", "close");
-            webServer->sendHeader("Access-Control-Allow-Origin", "*");
-            webServer->send(408, "application/json", String("{\"ok\":false,\"message\":\"Upload timeout\"}"));
+            session->pipe.abort(); // 临时文件由会话析构删除
+            send_upload_result(res, 408, "{\"ok\":false,\"message\":\"Upload timeout\"}");
             return;
         }
         
-        if (uploadFile) {
-            // 检查可用内存 - 流式处理只需要基本缓冲区内存
-            size_t freeHeap = ESP.getFreeHeap();
-            if (freeHeap < 24576) { // 需要至少24KB内存用于缓冲区和网络处理
-#if DBG_WIFI_HOTSPOT
-                Serial.printf("[WIFI_HOTSPOT] 内存不足 (%u bytes)，暂停写入\n", freeHeap);
-#endif
-                delay(50); // 稍微延迟让系统恢复
-                yield(); // 让出CPU防止看门狗超时
+        if (session->pipe.active() && upload.currentSize > 0) {
+            // 复制进流水线缓冲立即返回；所有缓冲都在等待写卡时只短暂等待，仍无空闲就回 503
+            SdWritePipeline::Status st = session->pipe.write(upload.buf, upload.currentSize);
+            if (st != SdWritePipeline::Status::Ok) {
+#if DBG_WIFI_HOTSPOT
+                Serial.printf("[WIFI_HOTSPOT] 写入%s: 已接收 %u bytes\n", st == SdWritePipeline::Status::Busy ? "繁忙" : "失败",
+                              session->totalBytesWritten);
+#endif
+                session->pipe.abort();
+                if (st == SdWritePipeline::Status::Busy) {
+                    res.setHeader("Retry-After", "1");
+                    send_upload_result(res, 503, "{\"ok\":false,\"message\":\"SD card busy, retry later\"}");
+                } else {
+                    send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Write failed\"}");
+                }
                 return;
             }
             
-            // 写入数据 - 流式处理，每次只处理小块数据
-            if (upload.currentSize > 0) {
-                // 添加看门狗重置和CPU yielding
-                yield(); // 让出CPU
-                
-                size_t bytesToWrite = upload.currentSize;
-                size_t bytesWritten = uploadFile.write(upload.buf, bytesToWrite);
-                
-                if (bytesWritten != bytesToWrite) {
 #if DBG_WIFI_HOTSPOT
-                    Serial.printf("[WIFI_HOTSPOT] 写入失败: 期望 %u, 实际 %u\n", bytesToWrite, bytesWritten);
+            size_t before = session->totalBytesWritten;
 #endif
-                    uploadFile.close();
-                    if (SDW::SD.exists(tmpPath.c_str())) SDW::SD.remove(tmpPath.c_str());
-                    webServer->sendHeader("Connection", "close");
-                    webServer->sendHeader("Access-Control-Allow-Origin", "*");
-                    webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Write failed\"}"));
-                    return;
-                }
-                
-                totalBytesWritten += bytesWritten;
-                lastWriteTime = millis();
-                
-                // 优化刷新频率，减少IO开销
-                if (totalBytesWritten % (16 * 1024) == 0) { // 每16KB刷新一次，平衡性能和可靠性
-                    uploadFile.flush();
-                    yield(); // 让出CPU防止看门狗超时
-                    delay(2); // 稍长延迟让SD卡完成写入
-                }
-                
+            session->totalBytesWritten += upload.currentSize;
+            session->crc = http_crc32(session->crc, upload.buf, upload.currentSize);
+            
 #if DBG_WIFI_HOTSPOT
-                if (totalBytesWritten % (100 * 1024) == 0) { // 每100KB打印一次进度
-                    float progress = (float)totalBytesWritten / upload.totalSize * 100;
-                    Serial.printf("[WIFI_HOTSPOT] 上传进度: %.1f%% (%u/%u bytes), 内存: %u\n", 
-                                progress, totalBytesWritten, upload.totalSize, ESP.getFreeHeap());
-                    yield(); // 让出CPU
-                }
-#endif
+            if (before / (100 * 1024) != session->totalBytesWritten / (100 * 1024)) { // 每100KB打印一次进度
+                Serial.printf("[WIFI_HOTSPOT] 上传进度: %u/%lld bytes (conn %d), 内存: %u\n", 
+                            session->totalBytesWritten, (long long)upload.contentLength, req.conn_id, ESP.getFreeHeap());
             }
+#endif
         }
         
-    } else if (upload.status == UPLOAD_FILE_END) {
-        // 上传完成时的CPU yielding
-        yield(); 
-        
-            if (uploadFile) {
-                uploadFile.flush(); // 确保所有数据写入
-                uploadFile.close();
+    } else if (upload.status == HTTP_UPLOAD_END) {
+        if (!session || res.sent()) {
+            return;
+        }
+        String fullPath = session->fullPath;
+        String tmpPath = session->tmpPath;
 
-                // 文件验证前的内存检查和yielding
-            if (ESP.getFreeHeap() < 16384) {
+        if (!session->pipe.active()) {
 #if DBG_WIFI_HOTSPOT
-                Serial.printf("[WIFI_HOTSPOT] 内存不足，跳过文件验证\n");
+            Serial.printf("[WIFI_HOTSPOT] 上传结束但文件句柄无效\n");
 #endif
-                webServer->sendHeader("Connection", "close");
-                webServer->sendHeader("Access-Control-Allow-Origin", "*");
-                webServer->send(200, "application/json", String("{\"ok\":true,\"message\":\"File uploaded (verification skipped due to low memory)\"}"));
+            send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Invalid file handle\"}");
+            return;
+        }
+
+        // 写出剩余缓冲并等写入任务完成，确保所有数据写入
+        if (!session->pipe.finish()) {
+            send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Write failed\"}");
+            return;
+        }
+
+        // 文件验证前的内存检查
+        if (session->sidecarBook.empty() && ESP.getFreeHeap() < 16384) {
+#if DBG_WIFI_HOTSPOT
+            Serial.printf("[WIFI_HOTSPOT] 内存不足，跳过文件验证\n");
+#endif
+            // 只跳过大小校验；压缩书头校验与落盘后的刷新（目录索引、散列缓存、书籍/字体列表、覆盖当前书重建索引）照常
+            if (session->tab == "book" && lz_book_name(fullPath.c_str()) && !lz_book_valid(tmpPath.c_str())) {
+                send_upload_result(res, 400, "{\"ok\":false,\"message\":\"Corrupted compressed book (RPLZ)\"}");
                 return;
             }
-            
-            yield(); // 让出CPU
-            
-            // 验证文件完整性 - 使用更宽松的检查
-            // 由于写入的是临时文件，先验证临时文件再重命名
-            File verifyFile = SDW::SD.open(tmpPath.c_str(), "r");
-            if (verifyFile) {
-                size_t actualFileSize = verifyFile.size();
-                verifyFile.close();
-
-                // 允许小幅差异（最多1%或1KB，取较小值），因为multipart传输可能有边界字符差异
-                size_t tolerance = std::min((size_t)(upload.totalSize * 0.01), (size_t)1024);
-                size_t sizeDiff = (actualFileSize > upload.totalSize) ?
-                                 (actualFileSize - upload.totalSize) :
-                                 (upload.totalSize - actualFileSize);
-
-                if (sizeDiff > tolerance) {
-#if DBG_WIFI_HOTSPOT
-                    Serial.printf("[WIFI_HOTSPOT] 文件大小差异过大: 期望 %u, 实际 %u, 差异 %u (容忍度 %u)\n",
-                                  upload.totalSize, actualFileSize, sizeDiff, tolerance);
-#endif
-                    if (SDW::SD.exists(tmpPath.c_str())) SDW::SD.remove(tmpPath.c_str());
-                    webServer->sendHeader("Connection", "close");
-                    webServer->sendHeader("Access-Control-Allow-Origin", "*");
-                    webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"File size mismatch, upload corrupted\"}"));
-                    return;
-                }
+            if (SDW::SD.exists(fullPath.c_str())) SDW::SD.remove(fullPath.c_str());
+            if (!SDW::SD.rename(tmpPath.c_str(), fullPath.c_str())) {
+                send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Failed to finalize uploaded file\"}");
+                return;
+            }
+            session->finalized = true;
+            send_upload_result(res, 200, "{\"ok\":true,\"message\":\"File uploaded (verification skipped due to low memory)\"}");
+            after_upload_finalized(fullPath, &session->crc);
+            return;
+        }
+        
+        // 验证文件完整性 - 使用更宽松的检查
+        // 由于写入的是临时文件，先验证临时文件再重命名
+        File verifyFile = SDW::SD.open(tmpPath.c_str(), "r");
+        if (!verifyFile) {
+#if DBG_WIFI_HOTSPOT
+            Serial.printf("[WIFI_HOTSPOT] 无法验证上传文件: %s\n", fullPath.c_str());
+#endif
+            send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Cannot verify uploaded file\"}");
+            return;
+        }
+        size_t actualFileSize = verifyFile.size();
+        verifyFile.close();
 
+        // 允许小幅差异（最多1%或1KB，取较小值），因为multipart传输可能有边界字符差异
+        size_t tolerance = std::min((size_t)(upload.totalSize * 0.01), (size_t)1024);
+        size_t sizeDiff = (actualFileSize > upload.totalSize) ?
+                         (actualFileSize - upload.totalSize) :
+                         (upload.totalSize - actualFileSize);
+
+        if (sizeDiff > tolerance) {
 #if DBG_WIFI_HOTSPOT
-                unsigned long uploadTime = millis() - uploadStartTime;
-                float speed = actualFileSize / (uploadTime / 1000.0) / 1024.0; // KB/s
-                Serial.printf("[WIFI_HOTSPOT] 文件上传完成: %s, 大小: %u bytes, 耗时: %lu ms, 速度: %.1f KB/s\n",
-                            fullPath.c_str(), actualFileSize, uploadTime, speed);
+            Serial.printf("[WIFI_HOTSPOT] 文件大小差异过大: 期望 %u, 实际 %u, 差异 %u (容忍度 %u)\n",
+                          upload.totalSize, actualFileSize, sizeDiff, tolerance);
 #endif
+            send_upload_result(res, 500, "{\"ok\":false,\"message\":\"File size mismatch, upload corrupted\"}");
+            return;
+        }
 
-                // 验证成功，准备覆盖原有文件。如果直接删除失败，使用备份路径暂存旧文件。
-                bool backupUsed = false;
-                String backupPath = "";
-                auto ensureOverwriteSlot = [&]() -> bool {
-                    if (!SDW::SD.exists(fullPath.c_str())) return true;
-                    if (SDW::SD.remove(fullPath.c_str())) return true;
-                    backupPath = fullPath + String(".upload.bak");
-                    int attempt = 0;
-                    while (SDW::SD.exists(backupPath.c_str()) && attempt < 5) {
-                        backupPath = fullPath + String(".upload.bak") + String(++attempt);
-                    }
-                    if (SDW::SD.rename(fullPath.c_str(), backupPath.c_str())) {
-                        backupUsed = true;
-                        return true;
-                    }
-                    backupPath = "";
-                    backupUsed = false;
+        if (session->sidecarExt == ".page" && !page_file_has_header(tmpPath.c_str())) {
+            send_upload_result(res, 400, "{\"ok\":false,\"message\":\"Not a page index file (BPG1)\"}");
+            return;
+        }
+        if (session->sidecarExt == ".complete") {
+            // 预索引只在分页设置（字体、字号、行高、显示区域、竖排、繁简、编码）与设备一致时采用；
+            // 否则连同已上传的 .page 一起丢弃，书籍打开时在设备上正常分页
+            std::string built = readCompleteFingerprint(tmpPath.c_str());
+            std::string want = paginateFingerprintForBook(session->sidecarBook);
+            if (built.empty() || built != want) {
+                removeIndexFilesForBookForPath(session->sidecarBook);
+                res.closeAfter();
+                res.setHeader("Access-Control-Allow-Origin", "*");
+                res.stream(409, "application/json", std::unique_ptr<HttpBodySource>(new HttpJsonSource([built, want](HttpJsonWriter& w) {
+                    w.beginObject();
+                    w.field("ok", false);
+                    w.field("message", built.empty() ? "Index has no settings fingerprint - rebuild it with the current tools/preindex"
+                                                     : "Index was built with different settings - rebuild it to match the device");
+                    w.field("built", built);
+                    w.field("device", want);
+                    w.endObject();
                     return false;
-                };
+                })), -1);
+                return;
+            }
+        }
+        if (session->sidecarBook.empty() && session->tab == "book" && lz_book_name(fullPath.c_str()) &&
+            !lz_book_valid(tmpPath.c_str())) {
+            send_upload_result(res, 400, "{\"ok\":false,\"message\":\"Corrupted compressed book (RPLZ)\"}");
+            return;
+        }
 
-                if (!ensureOverwriteSlot()) {
 #if DBG_WIFI_HOTSPOT
-                    Serial.printf("[WIFI_HOTSPOT] 无法覆盖已有文件: %s\n", fullPath.c_str());
+        unsigned long uploadTime = millis() - session->startTime;
+        float speed = actualFileSize / (uploadTime / 1000.0) / 1024.0; // KB/s
+        Serial.printf("[WIFI_HOTSPOT] 文件上传完成: %s, 大小: %u bytes, 耗时: %lu ms, 速度: %.1f KB/s\n",
+                    fullPath.c_str(), actualFileSize, uploadTime, speed);
 #endif
-                    if (SDW::SD.exists(tmpPath.c_str())) SDW::SD.remove(tmpPath.c_str());
-                    webServer->sendHeader("Connection", "close");
-                    webServer->sendHeader("Access-Control-Allow-Origin", "*");
-                    webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Cannot overwrite existing file\"}"));
-                    return;
-                }
 
-                bool renamed = SDW::SD.rename(tmpPath.c_str(), fullPath.c_str());
-                if (!renamed) {
-                    // 无法重命名，尝试恢复备份并返回错误
-                    if (backupUsed && backupPath.length()) {
-                        if (!SDW::SD.exists(fullPath.c_str())) {
-                            SDW::SD.rename(backupPath.c_str(), fullPath.c_str());
-                        } else {
-                            SDW::SD.remove(backupPath.c_str());
-                        }
-                    }
-                    if (SDW::SD.exists(tmpPath.c_str())) SDW::SD.remove(tmpPath.c_str());
-                    webServer->sendHeader("Connection", "close");
-                    webServer->sendHeader("Access-Control-Allow-Origin", "*");
-                    webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Failed to finalize uploaded file\"}"));
-                    return;
-                }
+        // 验证成功，准备覆盖原有文件。如果直接删除失败，使用备份路径暂存旧文件。
+        bool backupUsed = false;
+        String backupPath = "";
+        auto ensureOverwriteSlot = [&]() -> bool {
+            if (!SDW::SD.exists(fullPath.c_str())) return true;
+            if (SDW::SD.remove(fullPath.c_str())) return true;
+            backupPath = fullPath + String(".upload.bak");
+            int attempt = 0;
+            while (SDW::SD.exists(backupPath.c_str()) && attempt < 5) {
+                backupPath = fullPath + String(".upload.bak") + String(++attempt);
+            }
+            if (SDW::SD.rename(fullPath.c_str(), backupPath.c_str())) {
+                backupUsed = true;
+                return true;
+            }
+            backupPath = "";
+            backupUsed = false;
+            return false;
+        };
+
+        if (!ensureOverwriteSlot()) {
+#if DBG_WIFI_HOTSPOT
+            Serial.printf("[WIFI_HOTSPOT] 无法覆盖已有文件: %s\n", fullPath.c_str());
+#endif
+            send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Cannot overwrite existing file\"}");
+            return;
+        }
 
-                if (backupUsed && backupPath.length() && SDW::SD.exists(backupPath.c_str())) {
+        bool renamed = SDW::SD.rename(tmpPath.c_str(), fullPath.c_str());
+        if (!renamed) {
+            // 无法重命名，尝试恢复备份并返回错误
+            if (backupUsed && backupPath.length()) {
+                if (!SDW::SD.exists(fullPath.c_str())) {
+                    SDW::SD.rename(backupPath.c_str(), fullPath.c_str());
+                } else {
                     SDW::SD.remove(backupPath.c_str());
                 }
+            }
+            send_upload_result(res, 500, "{\"ok\":false,\"message\":\"Failed to finalize uploaded file\"}");
+            return;
+        }
+        session->finalized = true;
 
-                // 发送成功响应，添加CORS头
-                webServer->sendHeader("Connection", "close");
-                webServer->sendHeader("Access-Control-Allow-Origin", "*");
-                webServer->send(200, "application/json", String("{\"ok\":true,\"message\":\"File uploaded successfully\"}"));
+        if (backupUsed && backupPath.length() && SDW::SD.exists(backupPath.c_str())) {
+            SDW::SD.remove(backupPath.c_str());
+        }
 
-                // 如果上传到字体目录，刷新全局字体列表
-                if (fullPath.startsWith("/font/")) {
-                    font_list_scan();
-                }
+        // 成功响应（CORS 头），在本回调返回后由 HTTP 内核发出
+        send_upload_result(res, 200, "{\"ok\":true,\"message\":\"File uploaded successfully\"}");
+
+        if (session->sidecarBook.empty()) {
+            after_upload_finalized(fullPath, &session->crc);
+        } else {
+            after_sidecar_finalized(session);
+        }
+        
+    } else if (upload.status == HTTP_UPLOAD_ABORTED) {
+        // 连接中断：客户端已经收不到应答，只需清理；临时文件由会话析构删除，已有的目标文件保持不变
+#if DBG_WIFI_HOTSPOT
+        Serial.printf("[WIFI_HOTSPOT] 文件上传被中止: %s (已写入 %u bytes)\n",
+                      session ? session->fullPath.c_str() : "", session ? session->totalBytesWritten : 0);
+#endif
+        req.context.reset();
+    }
+}
 
-                // 如果上传到书籍目录，刷新书籍缓存并检测覆盖
-                if (fullPath.startsWith("/book/")) {
-                    BookFileManager::refreshCache();
+void WiFiHotspotManager::handleFileUploadDone(HttpRequest& req, HttpResponse& res) {
+    (void)req;
+    // 上传回调已经给出结果时不会走到这里；请求里没有文件字段才需要兜底
+    send_upload_result(res, 400, "{\"ok\":false,\"message\":\"No file uploaded\"}");
+}
+
+// ---------------------------------------------------------------------------
+// 断点续传上传
+// 每个上传 ID 在 /.uploads 下对应 <id>.part（已收数据）与 <id>.meta（tab、文件名、总长、已确认偏移）。
+// 块按 offset 顺序追加，CRC 校验通过后才推进 meta 中的已确认偏移（经 SafeFS 原子写入），
+// 因此连接中断、掉电后都能从已确认偏移继续；全部收齐后 commit 改名到目标路径。
+
+static const char* RESUMABLE_DIR = "/.uploads";
+static const size_t RESUMABLE_CHUNK = 256 * 1024;      // 建议块大小（init 返回给客户端）
+static const size_t RESUMABLE_MAX_CHUNK = 1024 * 1024; // 单块上限
+static const size_t RESUMABLE_MAX_SIZE = 50 * 1024 * 1024;
+
+struct ResumableMeta {
+    String tab;
+    String name;
+    size_t size = 0;
+    size_t committed = 0; // 已校验落盘的字节数（下一块的 offset）
+};
+
+// 同一 ID 同时只允许一个块在写（仅在 HTTP 任务中访问）
+static std::set<std::string> s_busy_upload_ids;
+
+static String resumable_path(const String& id, const char* ext) {
+    return String(RESUMABLE_DIR) + "/" + id + ext;
+}
 
-                    if (g_current_book) {
-                        std::string cur_fp = g_current_book->filePath();
-                        std::string cur_real;
-                        bool cur_use_spiffs = false;
-                        resolve_fake_path(cur_fp, cur_real, cur_use_spiffs);
-                        cur_real = normalize_real_path(cur_real);
+static bool valid_upload_id(const String& id) {
+    if (id.length() != 8) return false;
+    for (size_t i = 0; i < id.length(); ++i) {
+        if (!isxdigit((unsigned char)id[i])) return false;
+    }
+    return true;
+}
 
-                        std::string up_fp = std::string(fullPath.c_str());
-                        std::string up_real;
-                        bool up_use_spiffs = false;
-                        resolve_fake_path(up_fp, up_real, up_use_spiffs);
-                        up_real = normalize_real_path(up_real);
+static bool valid_upload_name(const String& name) {
+    return name.length() > 0 && name.length() <= 200 && name.indexOf('/') < 0 &&
+           name.indexOf('\\') < 0 && name.indexOf("..") < 0;
+}
+
+static bool load_resumable_meta(const String& id, ResumableMeta& meta) {
+    std::string path = resumable_path(id, ".meta").c_str();
+    SafeFS::restoreFromTmpIfNeeded(path);
+    File f = SDW::SD.open(path.c_str(), "r");
+    if (!f) return false;
+    meta.tab = f.readStringUntil('\n');
+    meta.name = f.readStringUntil('\n');
+    meta.size = (size_t)f.readStringUntil('\n').toInt();
+    meta.committed = (size_t)f.readStringUntil('\n').toInt();
+    f.close();
+    return meta.name.length() > 0 && meta.size > 0 && meta.committed <= meta.size;
+}
+
+static bool save_resumable_meta(const String& id, const ResumableMeta& meta) {
+    return SafeFS::safeWrite(resumable_path(id, ".meta").c_str(), [&](File& f) {
+        f.printf("%s\n%s\n%u\n%u\n", meta.tab.c_str(), meta.name.c_str(), (unsigned)meta.size, (unsigned)meta.committed);
+        return true;
+    });
+}
+
+static void remove_resumable(const String& id) {
+    String part = resumable_path(id, ".part");
+    String meta = resumable_path(id, ".meta");
+    if (SDW::SD.exists(part.c_str())) SDW::SD.remove(part.c_str());
+    if (SDW::SD.exists(meta.c_str())) SDW::SD.remove(meta.c_str());
+}
+
+// 同一目标文件的旧版本（大小或修改时间不同，ID 不同）已不可能续传，清掉以免占用 SD 空间
+static void purge_stale_uploads(const String& tab, const String& name, const String& keepId) {
+    std::vector<String> stale;
+    File dir = SDW::SD.open(RESUMABLE_DIR, "r");
+    if (!dir || !dir.isDirectory()) return;
+    while (true) {
+        File entry = dir.openNextFile();
+        if (!entry) break;
+        String fname = entry.name();
+        entry.close();
+        int slash = fname.lastIndexOf('/');
+        if (slash >= 0) fname = fname.substring(slash + 1);
+        if (!fname.endsWith(".meta")) continue;
+        String id = fname.substring(0, fname.length() - 5);
+        if (id == keepId || !valid_upload_id(id)) continue;
+        ResumableMeta meta;
+        if (load_resumable_meta(id, meta) && meta.tab == tab && meta.name == name) {
+            stale.push_back(id);
+        }
+    }
+    dir.close();
+    for (const auto& id : stale) remove_resumable(id);
+}
+
+static void send_resumable_state(HttpResponse& res, int code, const String& id, const ResumableMeta& meta, const char* message = nullptr) {
+    char json[224];
+    snprintf(json, sizeof(json), "{\"ok\":%s,\"id\":\"%s\",\"offset\":%u,\"size\":%u,\"chunk\":%u%s%s%s}",
+             code == 200 ? "true" : "false", id.c_str(), (unsigned)meta.committed, (unsigned)meta.size,
+             (unsigned)RESUMABLE_CHUNK, message ? ",\"message\":\"" : "", message ? message : "", message ? "\"" : "");
+    res.send(code, "application/json", json);
+}
+
+void WiFiHotspotManager::handleUploadInit(HttpRequest& req, HttpResponse& res) {
+    String tab = req.arg("tab").c_str();
+    String name = req.arg("name").c_str();
+    long long size = atoll(req.arg("size").c_str());
+    if (tab == "scback") name = "scback.png";
+
+    if (!valid_upload_name(name) || size <= 0) {
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Invalid name or size\"}");
+        return;
+    }
+    if ((size_t)size > RESUMABLE_MAX_SIZE) {
+        res.send(413, "application/json", "{\"ok\":false,\"message\":\"File too large - maximum 50MB supported\"}");
+        return;
+    }
+
+    // ID 由目标与文件属性决定：浏览器刷新后对同一文件重新 init 仍得到同一 ID，从而续传
+    String key = tab + "\n" + name + "\n" + String((unsigned long)size) + "\n" + String(req.arg("mtime").c_str());
+    char idBuf[9];
+    snprintf(idBuf, sizeof(idBuf), "%08x", (unsigned)http_crc32(0, (const uint8_t*)key.c_str(), key.length()));
+    String id = idBuf;
+
+    ResumableMeta meta;
+    bool resume = load_resumable_meta(id, meta) && meta.tab == tab && meta.name == name && meta.size == (size_t)size;
+    if (resume) {
+        // .part 比已确认偏移短（例如被手动删除）时从头开始
+        File part = SDW::SD.open(resumable_path(id, ".part").c_str(), "r");
+        size_t partSize = part ? part.size() : 0;
+        if (part) part.close();
+        if (partSize < meta.committed) resume = false;
+    }
+
+    if (!resume) {
+        uint64_t freeMB = (SDW::SD.cardSize() - SDW::SD.usedBytes()) / (1024 * 1024);
+        if (freeMB < ((uint64_t)size / (1024 * 1024) + 10)) { // 预留10MB空间
+            res.send(507, "application/json", "{\"ok\":false,\"message\":\"Insufficient storage space\"}");
+            return;
+        }
+        if (!SDW::SD.exists(RESUMABLE_DIR)) SDW::SD.mkdir(RESUMABLE_DIR);
+        meta.tab = tab;
+        meta.name = name;
+        meta.size = (size_t)size;
+        meta.committed = 0;
+        String part = resumable_path(id, ".part");
+        if (SDW::SD.exists(part.c_str())) SDW::SD.remove(part.c_str());
+        if (!save_resumable_meta(id, meta)) {
+            res.send(500, "application/json", "{\"ok\":false,\"message\":\"Failed to create upload session\"}");
+            return;
+        }
+        purge_stale_uploads(tab, name, id);
+    }
 
 #if DBG_WIFI_HOTSPOT
-                        Serial.printf("[WIFI_HOTSPOT] normalized current='%s' (spiffs=%d) uploaded='%s' (spiffs=%d)\n",
-                                      cur_real.c_str(), cur_use_spiffs, up_real.c_str(), up_use_spiffs);
+    Serial.printf("[WIFI_HOTSPOT] 续传会话 %s: %s/%s, %u/%u bytes%s\n", id.c_str(), tab.c_str(), name.c_str(),
+                  (unsigned)meta.committed, (unsigned)meta.size, resume ? " (续传)" : "");
 #endif
+    send_resumable_state(res, 200, id, meta);
+}
+
+void WiFiHotspotManager::handleUploadStatus(HttpRequest& req, HttpResponse& res) {
+    String id = req.arg("id").c_str();
+    ResumableMeta meta;
+    if (!valid_upload_id(id) || !load_resumable_meta(id, meta)) {
+        res.send(404, "application/json", "{\"ok\":false,\"message\":\"Unknown upload id\"}");
+        return;
+    }
+    send_resumable_state(res, 200, id, meta);
+}
+
+// 一个块的写入状态：析构时关闭文件并释放 ID；未校验通过的数据留在 .part 尾部，下一块从已确认偏移覆盖
+struct ChunkSession : public HttpRequestContext {
+    ChunkSession(volatile int* counter, const String& uploadId) : activeCounter(counter), id(uploadId) {
+        (*activeCounter)++;
+        s_busy_upload_ids.insert(id.c_str());
+    }
+    ~ChunkSession() override {
+        pipe.abort();
+        s_busy_upload_ids.erase(id.c_str());
+        (*activeCounter)--;
+    }
+
+    volatile int* activeCounter;
+    String id;
+    ResumableMeta meta;
+    SdWritePipeline pipe;
+    size_t expected = 0;
+    size_t written = 0;
+    uint32_t crc = 0;
+    uint32_t expectedCrc = 0;
+};
+
+void WiFiHotspotManager::handleUploadChunk(HttpRequest& req, HttpResponse& res, HttpUpload& upload) {
+    ChunkSession* session = static_cast<ChunkSession*>(req.context.get());
+
+    if (upload.status == HTTP_UPLOAD_START) {
+        String id = req.arg("id").c_str();
+        ResumableMeta meta;
+        if (!valid_upload_id(id) || !load_resumable_meta(id, meta)) {
+            res.send(404, "application/json", "{\"ok\":false,\"message\":\"Unknown upload id\"}");
+            return;
+        }
+        if (s_busy_upload_ids.count(id.c_str())) {
+            send_resumable_state(res, 409, id, meta, "Upload id busy");
+            return;
+        }
+        long long offset = atoll(req.arg("offset").c_str());
+        if (!req.hasArg("offset") || offset != (long long)meta.committed) {
+            send_resumable_state(res, 409, id, meta, "Offset mismatch");
+            return;
+        }
+        if (upload.contentLength <= 0 || !req.hasArg("crc")) {
+            send_resumable_state(res, 400, id, meta, "Missing chunk body or crc");
+            return;
+        }
+        if ((size_t)upload.contentLength > RESUMABLE_MAX_CHUNK || meta.committed + (size_t)upload.contentLength > meta.size) {
+            send_resumable_state(res, 413, id, meta, "Chunk too large");
+            return;
+        }
+
+        req.context.reset(session = new ChunkSession(&activeUploads, id));
+        session->meta = meta;
+        session->expected = (size_t)upload.contentLength;
+        session->expectedCrc = (uint32_t)strtoul(req.arg("crc").c_str(), nullptr, 16);
 
-                        if (cur_real == up_real && cur_use_spiffs == up_use_spiffs) {
+        String part = resumable_path(id, ".part");
+        File file = SDW::SD.open(part.c_str(), meta.committed == 0 ? "w" : "r+");
+        if (!file || (meta.committed > 0 && !file.seek(meta.committed))) {
+            if (file) file.close();
 #if DBG_WIFI_HOTSPOT
-                            Serial.printf("[WIFI_HOTSPOT] 当前书籍已被覆盖，触发强制重建索引: %s\n", fullPath.c_str());
+            Serial.printf("[WIFI_HOTSPOT] 无法打开续传文件 %s @%u\n", part.c_str(), (unsigned)meta.committed);
 #endif
-                            extern void requestForceReindex();
-                            requestForceReindex();
-                        }
-                    }
-                }
-                // 如果上传到图片目录，清理锁屏图片缓存以便下次重新扫描
-                if (fullPath.startsWith("/image/")) {
-                    lockscreen_image_cache_invalidate();
-                }
+            send_resumable_state(res, 500, id, meta, "Failed to open partial file");
+            return;
+        }
+        if (!session->pipe.begin(file)) {
+            file.close();
+            send_resumable_state(res, 507, id, meta, "Insufficient memory for upload buffers");
+            return;
+        }
+
+    } else if (upload.status == HTTP_UPLOAD_WRITE) {
+        if (!session || res.sent() || !session->pipe.active()) {
+            return;
+        }
+        SdWritePipeline::Status st = session->pipe.write(upload.buf, upload.currentSize);
+        if (st != SdWritePipeline::Status::Ok) {
+            // 本块作废（offset 不前进），客户端按 Retry-After 重传同一块即可
+            session->pipe.abort();
+            if (st == SdWritePipeline::Status::Busy) {
+                res.setHeader("Retry-After", "1");
+                send_resumable_state(res, 503, session->id, session->meta, "SD card busy, retry later");
             } else {
+                send_resumable_state(res, 500, session->id, session->meta, "Write failed");
+            }
+            return;
+        }
+        session->crc = http_crc32(session->crc, upload.buf, upload.currentSize);
+        session->written += upload.currentSize;
+
+    } else if (upload.status == HTTP_UPLOAD_END) {
+        if (!session || res.sent() || !session->pipe.active()) {
+            return;
+        }
+        if (!session->pipe.finish()) {
+            send_resumable_state(res, 500, session->id, session->meta, "Write failed");
+            return;
+        }
+
+        if (session->written != session->expected || session->crc != session->expectedCrc) {
 #if DBG_WIFI_HOTSPOT
-                Serial.printf("[WIFI_HOTSPOT] 无法验证上传文件: %s\n", fullPath.c_str());
+            Serial.printf("[WIFI_HOTSPOT] 续传块校验失败 %s @%u: crc %08x != %08x\n", session->id.c_str(),
+                          (unsigned)session->meta.committed, (unsigned)session->crc, (unsigned)session->expectedCrc);
 #endif
-                webServer->sendHeader("Connection", "close");
-                webServer->sendHeader("Access-Control-Allow-Origin", "*");
-                webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Cannot verify uploaded file\"}"));
-            }
-        } else {
+            send_resumable_state(res, 422, session->id, session->meta, "CRC mismatch");
+            return;
+        }
+
+        session->meta.committed += session->written;
+        if (!save_resumable_meta(session->id, session->meta)) {
+            session->meta.committed -= session->written;
+            send_resumable_state(res, 500, session->id, session->meta, "Failed to record progress");
+            return;
+        }
+        send_resumable_state(res, 200, session->id, session->meta);
+
+    } else if (upload.status == HTTP_UPLOAD_ABORTED) {
+        // 已确认偏移不变，客户端重新连上后通过 /upload/status 或 init 取得偏移继续
+        req.context.reset();
+    }
+}
+
+void WiFiHotspotManager::handleUploadChunkDone(HttpRequest& req, HttpResponse& res) {
+    (void)req;
+    res.send(400, "application/json", "{\"ok\":false,\"message\":\"Missing chunk body\"}");
+}
+
+void WiFiHotspotManager::handleUploadCommit(HttpRequest& req, HttpResponse& res) {
+    String id = req.arg("id").c_str();
+    ResumableMeta meta;
+    if (!valid_upload_id(id) || !load_resumable_meta(id, meta)) {
+        res.send(404, "application/json", "{\"ok\":false,\"message\":\"Unknown upload id\"}");
+        return;
+    }
+    if (s_busy_upload_ids.count(id.c_str())) {
+        send_resumable_state(res, 409, id, meta, "Upload id busy");
+        return;
+    }
+    if (meta.committed != meta.size) {
+        send_resumable_state(res, 409, id, meta, "Upload incomplete");
+        return;
+    }
+
+    String part = resumable_path(id, ".part");
+    File f = SDW::SD.open(part.c_str(), "r");
+    size_t partSize = f ? f.size() : 0;
+    if (f) f.close();
+    if (partSize != meta.size) {
+        // 数据文件与记录不一致（被外部改动），只能重新开始
+        meta.committed = 0;
+        save_resumable_meta(id, meta);
+        send_resumable_state(res, 409, id, meta, "Partial file corrupted, restart upload");
+        return;
+    }
+
+    if (meta.tab == "book" && lz_book_name(meta.name.c_str()) && !lz_book_valid(part.c_str())) {
+        remove_resumable(id);
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Corrupted compressed book (RPLZ)\"}");
+        return;
+    }
+
+    String fullPath = upload_target_path(meta.tab, meta.name);
+    String dirPath = fullPath.substring(0, fullPath.lastIndexOf('/'));
+    if (dirPath.length() && !SDW::SD.exists(dirPath.c_str())) {
+        SDW::SD.mkdir(dirPath.c_str());
+    }
+    if (!SafeFS::promoteLargeTmpToFinal(part.c_str(), fullPath.c_str())) {
 #if DBG_WIFI_HOTSPOT
-            Serial.printf("[WIFI_HOTSPOT] 上传结束但文件句柄无效\n");
+        Serial.printf("[WIFI_HOTSPOT] 续传提交失败: %s -> %s\n", part.c_str(), fullPath.c_str());
 #endif
-            webServer->sendHeader("Connection", "close");
-            webServer->sendHeader("Access-Control-Allow-Origin", "*");
-            webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Invalid file handle\"}"));
+        res.send(500, "application/json", "{\"ok\":false,\"message\":\"Failed to finalize uploaded file\"}");
+        return;
+    }
+    remove_resumable(id);
+
+#if DBG_WIFI_HOTSPOT
+    Serial.printf("[WIFI_HOTSPOT] 续传上传完成: %s (%u bytes)\n", fullPath.c_str(), (unsigned)meta.size);
+#endif
+    res.send(200, "application/json", "{\"ok\":true,\"message\":\"File uploaded successfully\"}");
+    after_upload_finalized(fullPath);
+}
+
+void WiFiHotspotManager::handleUploadAbort(HttpRequest& req, HttpResponse& res) {
+    String id = req.arg("id").c_str();
+    if (!valid_upload_id(id)) {
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Invalid upload id\"}");
+        return;
+    }
+    if (s_busy_upload_ids.count(id.c_str())) {
+        res.send(409, "application/json", "{\"ok\":false,\"message\":\"Upload id busy\"}");
+        return;
+    }
+    remove_resumable(id);
+    res.send(200, "application/json", "{\"ok\":true,\"message\":\"Upload discarded\"}");
+}
+
+// ---------------------------------------------------------------------------
+// 书库同步：POST /sync?tab=book|font|image，请求体为清单（text/plain，每行 "<大小>\t<CRC-32 十六进制>\t<文件名>"）。
+// 目标目录只遍历一次（名字键 + 大小 + 修改时间），清单边收边逐行比对：
+// 设备上没有 -> missing；大小不同 -> changed（压缩存放的书改比文件头里的原文大小与 CRC）；
+// 大小相同再比 CRC（先查 FileHashCache，未命中的记下，清单收完后再整文件读取）。
+// 读文件算 CRC 在 HTTP 内核拉取响应体时分步进行：每轮 poll 至多 SYNC_HASH_SLICE_MS，步与步之间
+// HTTP 任务照常服务其他连接。一个请求的总耗时受 SYNC_HASH_BUDGET_MS 限制（单个大文件也在读取中途停下），
+// 没算完的文件列入 pending，客户端稍后只把这些行再提交一次（已算出的散列已记入缓存，
+// 算到一半的文件从断点继续）。内存只与目录条目数、差异条目数和待算散列的文件数有关。
+
+static const uint32_t SYNC_HASH_BUDGET_MS = 4000;
+static const uint32_t SYNC_HASH_SLICE_MS = 150;
+static const size_t SYNC_MAX_LINE = 512;
+
+struct SyncDirEntry {
+    uint64_t key;
+    uint32_t size;
+    uint32_t mtime;
+    bool packed; // 书籍目录里 <名>.txt.lz 以 <名>.txt 登记的条目：按文件头记录的原文比对
+};
+
+struct SyncResult {
+    String tab;
+    uint32_t total = 0;
+    uint32_t unchanged = 0;
+    uint32_t hashed = 0;   // 本次整文件读取计算的个数
+    uint32_t invalid = 0;  // 格式不对或文件名不合法的行
+    std::string lists[3];  // missing / changed / pending，'\n' 分隔的文件名
+};
+
+static const char *const SYNC_LIST_KEYS[] = {"missing", "changed", "pending"};
+
+// 大小一致、缓存未命中，要读文件算 CRC 才能判定的条目
+struct SyncHashItem {
+    std::string name;
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t crc; // 清单里的 CRC
+};
+
+struct SyncSession : public HttpRequestContext {
+    std::shared_ptr<SyncResult> result = std::make_shared<SyncResult>();
+    std::string dir;                   // 目标目录（无结尾 /）
+    std::vector<SyncDirEntry> entries; // 按名字键升序
+    std::vector<SyncHashItem> toHash;  // 清单收完后在响应体生成器里分步计算
+    std::string line;                  // 跨数据块的半行
+    bool overlong = false;             // 当前行超长，丢弃到行尾
+};
+
+// FAT 文件名不区分大小写：ASCII 折叠成小写后再散列
+static uint64_t sync_name_key(const char* name, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)name[i];
+        if (c >= 'A' && c <= 'Z') c += 32;
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static const SyncDirEntry* sync_find(const SyncSession& s, uint64_t key) {
+    auto it = std::lower_bound(s.entries.begin(), s.entries.end(), key,
+                               [](const SyncDirEntry& e, uint64_t k) { return e.key < k; });
+    return (it != s.entries.end() && it->key == key) ? &*it : nullptr;
+}
+
+static void sync_check_line(SyncSession& s, std::string& line) {
+    SyncResult& r = *s.result;
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+    if (line.empty()) return;
+
+    size_t t1 = line.find('\t');
+    size_t t2 = t1 == std::string::npos ? t1 : line.find('\t', t1 + 1);
+    if (t2 == std::string::npos) {
+        r.invalid++;
+        return;
+    }
+    char* end = nullptr;
+    unsigned long long size = strtoull(line.c_str(), &end, 10);
+    bool ok = end == line.c_str() + t1 && t1 > 0;
+    uint32_t crc = (uint32_t)strtoul(line.c_str() + t1 + 1, &end, 16);
+    ok = ok && end == line.c_str() + t2 && t2 > t1 + 1;
+    String name = line.c_str() + t2 + 1;
+    if (!ok || size > 0xFFFFFFFFull || !valid_upload_name(name)) {
+        r.invalid++;
+        return;
+    }
+    r.total++;
+
+    int verdict = -1; // -1 一致；0 missing；1 changed
+    const SyncDirEntry* e = sync_find(s, sync_name_key(name.c_str(), name.length()));
+    if (!e) {
+        verdict = 0;
+    } else if (e->packed) {
+        // 压缩书 <名>.txt.lz：清单是原文的大小与 CRC，与文件头记录的比
+        std::string path = s.dir + "/" + name.c_str() + ".lz";
+        uint32_t rawSize = 0, rawCrc = 0;
+        bool same = lz_book_stat(path.c_str(), rawSize, rawCrc) && rawSize == (uint32_t)size && rawCrc == crc;
+        if (!same) verdict = 1;
+    } else if (e->size != (uint32_t)size) {
+        verdict = 1;
+    } else {
+        std::string path = s.dir + "/" + name.c_str();
+        uint32_t have = 0;
+        if (!FileHashCache::cached(path, e->size, e->mtime, have)) {
+            // 上传回调里不读文件：留给响应体生成器分步计算
+            s.toHash.push_back({name.c_str(), e->size, e->mtime, crc});
+            return;
+        } else if (have != crc) {
+            verdict = 1;
         }
-        
-    // 清除上传状态标志
-        uploadInProgress = false;
-        
-        // 重置状态变量
-        uploadTab = "";
-        fullPath = "";
-        totalBytesWritten = 0;
-        uploadStartTime = 0;
-    (void)lastWriteTime; // suppress unused-but-set warning
-        
-    } else if (upload.status == UPLOAD_FILE_ABORTED) {
-        // 处理上传中止情况
+    }
+
+    if (verdict < 0) {
+        r.unchanged++;
+        return;
+    }
+    r.lists[verdict].append(name.c_str(), name.length());
+    r.lists[verdict].push_back('\n');
+}
+
+// 结果流：先分步算完待定文件的 CRC，再写计数，最后逐个写出三张名单（每步一项）
+struct SyncResultStream {
+    std::shared_ptr<SyncResult> r;
+    std::string dir;
+    std::vector<SyncHashItem> items;
+    size_t item = 0;
+    uint32_t hashMs = 0;
+    bool hashing = true;
+    int phase = 0; // 0 头部；1..3 三张名单
+    size_t pos = 0;
+
+    // 客户端在计算途中断开：已算出的散列仍然有效，留给下一次同步
+    ~SyncResultStream() {
+        if (hashing) FileHashCache::save();
+    }
+};
+
+// 算一段：至多 SYNC_HASH_SLICE_MS（预算按读取进度检查，大文件算到一半也会停下，断点留给下一步或下次请求）。
+// 还有文件没判定时返回 true
+static bool sync_hash_slice(SyncResultStream& st) {
+    SyncResult& r = *st.r;
+    uint32_t t0 = millis();
+    while (st.item < st.items.size()) {
+        uint32_t used = millis() - t0;
+        if (used >= SYNC_HASH_SLICE_MS) return true;
+        const SyncHashItem& it = st.items[st.item];
+        int verdict = 2; // 总预算用完：pending
+        if (st.hashMs < SYNC_HASH_BUDGET_MS) {
+            uint32_t slice = SYNC_HASH_SLICE_MS - used;
+            if (slice > SYNC_HASH_BUDGET_MS - st.hashMs) slice = SYNC_HASH_BUDGET_MS - st.hashMs;
+            std::string path = st.dir + "/" + it.name;
+            uint32_t have = 0;
+            uint32_t t1 = millis();
+            FileHashCache::Progress p = FileHashCache::compute(path, it.size, it.mtime, slice, have);
+            st.hashMs += millis() - t1;
+            if (p == FileHashCache::Progress::Pending) {
+                if (st.hashMs < SYNC_HASH_BUDGET_MS) return true; // 同一文件下一步从断点继续
+            } else if (p == FileHashCache::Progress::Failed) {
+                verdict = 1; // 读失败按不同处理，让客户端重传
+            } else {
+                r.hashed++;
+                verdict = have != it.crc ? 1 : -1;
+            }
+        }
+        st.item++;
+        if (verdict < 0) {
+            r.unchanged++;
+            continue;
+        }
+        r.lists[verdict].append(it.name);
+        r.lists[verdict].push_back('\n');
+    }
+    return false;
+}
+
+static bool sync_result_step(SyncResultStream& st, HttpJsonWriter& w) {
+    const SyncResult& r = *st.r;
+    if (st.hashing) {
+        // 这一步不写输出：HttpJsonSource 让出，下一轮 poll 再继续
+        if (sync_hash_slice(st)) return true;
+        st.hashing = false;
+        FileHashCache::save();
 #if DBG_WIFI_HOTSPOT
-        Serial.printf("[WIFI_HOTSPOT] 文件上传被中止: %s (已写入 %u bytes)\n", fullPath.c_str(), totalBytesWritten);
+        Serial.printf("[WIFI_HOTSPOT] /sync %s: %u files, %u unchanged, missing %u bytes, hashed %u in %u ms\n",
+                      r.tab.c_str(), (unsigned)r.total, (unsigned)r.unchanged, (unsigned)r.lists[0].size(),
+                      (unsigned)r.hashed, (unsigned)st.hashMs);
 #endif
-        if (uploadFile) {
-            uploadFile.close();
+    }
+    if (st.phase == 0) {
+        w.beginObject();
+        w.field("ok", true);
+        w.field("tab", r.tab.c_str());
+        w.field("total", r.total);
+        w.field("unchanged", r.unchanged);
+        w.field("hashed", r.hashed);
+        w.field("invalid", r.invalid);
+        w.key(SYNC_LIST_KEYS[0]);
+        w.beginArray();
+        st.phase = 1;
+        return true;
+    }
+    const std::string& list = r.lists[st.phase - 1];
+    if (st.pos < list.size()) {
+        size_t nl = list.find('\n', st.pos);
+        w.value(list.data() + st.pos, nl - st.pos);
+        st.pos = nl + 1;
+        return true;
+    }
+    w.endArray();
+    if (st.phase == 3) {
+        w.endObject();
+        return false;
+    }
+    w.key(SYNC_LIST_KEYS[st.phase]);
+    w.beginArray();
+    st.phase++;
+    st.pos = 0;
+    return true;
+}
+
+void WiFiHotspotManager::handleSync(HttpRequest& req, HttpResponse& res, HttpUpload& upload) {
+    SyncSession* session = static_cast<SyncSession*>(req.context.get());
+
+    if (upload.status == HTTP_UPLOAD_START) {
+        String tab = req.hasArg("tab") ? String(req.arg("tab").c_str()) : String("book");
+        if (tab != "book" && tab != "font" && tab != "image") {
+            res.send(400, "application/json", "{\"ok\":false,\"message\":\"Invalid tab\"}");
+            return;
         }
-        if (SDW::SD.exists(fullPath)) {
-            SDW::SD.remove(fullPath); // 删除不完整的文件
+        req.context.reset(session = new SyncSession());
+        session->result->tab = tab;
+        session->dir = std::string("/") + tab.c_str();
+
+        // 目录不存在视为空书库：清单里的文件全部缺失
+        // 压缩书 <名>.txt.lz 另以 <名>.txt 登记，清单里的原文文件名也能对上；同名的 .txt 存在时以它为准
+        bool isBook = tab == "book";
+        EfficientFileScanner::forEachEntry(session->dir, "", [session, isBook](const FileInfo& info, time_t mtime) {
+            if (!info.isDirectory) {
+                session->entries.push_back({sync_name_key(info.name.data(), info.name.size()),
+                                            (uint32_t)info.size, (uint32_t)mtime, false});
+                if (isBook && lz_book_name(info.name)) {
+                    session->entries.push_back({sync_name_key(info.name.data(), info.name.size() - 3),
+                                                (uint32_t)info.size, (uint32_t)mtime, true});
+                }
+            }
+            return true;
+        });
+        std::sort(session->entries.begin(), session->entries.end(), [](const SyncDirEntry& a, const SyncDirEntry& b) {
+            return a.key != b.key ? a.key < b.key : (!a.packed && b.packed);
+        });
+        session->entries.erase(std::unique(session->entries.begin(), session->entries.end(),
+                                           [](const SyncDirEntry& a, const SyncDirEntry& b) { return a.key == b.key; }),
+                               session->entries.end());
+
+    } else if (upload.status == HTTP_UPLOAD_WRITE) {
+        if (!session || res.sent()) return;
+        const char* p = (const char*)upload.buf;
+        const char* end = p + upload.currentSize;
+        while (p < end) {
+            const char* nl = (const char*)memchr(p, '\n', end - p);
+            const char* stop = nl ? nl : end;
+            if (!session->overlong) {
+                session->line.append(p, stop - p);
+                if (session->line.size() > SYNC_MAX_LINE) {
+                    session->overlong = true;
+                    session->line.clear();
+                }
+            }
+            if (!nl) break;
+            if (session->overlong) session->result->invalid++;
+            else sync_check_line(*session, session->line);
+            session->line.clear();
+            session->overlong = false;
+            p = nl + 1;
         }
-        
-    // 清除上传状态标志
-    uploadInProgress = false;
-        
-        // 重置状态变量
-        uploadTab = "";
-        fullPath = "";
-        totalBytesWritten = 0;
-        uploadStartTime = 0;
-        
-    webServer->sendHeader("Connection", "close");
-    webServer->sendHeader("Access-Control-Allow-Origin", "*");
-    webServer->send(500, "application/json", String("{\"ok\":false,\"message\":\"Upload aborted\"}"));
 
-        // 如果上传目标在字体目录，刷新字体列表以移除可能的残留项
-        if (fullPath.startsWith("/font/")) {
-            font_list_scan();
+    } else if (upload.status == HTTP_UPLOAD_END) {
+        if (!session || res.sent()) return;
+        if (session->overlong) session->result->invalid++;
+        else sync_check_line(*session, session->line);
+        session->line.clear();
+
+        auto st = std::make_shared<SyncResultStream>();
+        st->r = session->result;
+        st->dir = session->dir;
+        st->items.swap(session->toHash);
+        res.stream(200, "application/json", std::unique_ptr<HttpBodySource>(new HttpJsonSource([st](HttpJsonWriter& w) {
+            return sync_result_step(*st, w);
+        })), -1);
+
+    } else if (upload.status == HTTP_UPLOAD_ABORTED) {
+        req.context.reset();
+    }
+}
+
+void WiFiHotspotManager::handleSyncDone(HttpRequest& req, HttpResponse& res) {
+    (void)req;
+    res.send(400, "application/json", "{\"ok\":false,\"message\":\"Missing manifest\"}");
+}
+
+// 传输状态：HTTP 内核的连接/流量计数与上传写卡流水线的吞吐、等待统计，用于判断瓶颈在网络还是 SD
+void WiFiHotspotManager::handleTransferStatus(HttpRequest& req, HttpResponse& res) {
+    (void)req;
+    HttpServerCore::Stats http = httpServer ? httpServer->stats() : HttpServerCore::Stats();
+    SdWritePipeline::Stats sd = SdWritePipeline::getStats();
+    unsigned lastKBps = sd.last_ms ? (unsigned)((uint64_t)sd.last_bytes * 1000 / 1024 / sd.last_ms) : 0;
+    unsigned sdKBps = sd.sd_busy_ms ? (unsigned)(sd.bytes * 1000 / 1024 / sd.sd_busy_ms) : 0;
+
+    char buf[640];
+    snprintf(buf, sizeof(buf),
+             "{\"ok\":true,\"uploads\":%d,"
+             "\"http\":{\"accepted\":%u,\"requests\":%u,\"active\":%u,\"peak\":%u,\"timeouts\":%u,\"errors\":%u,"
+             "\"bytesIn\":%llu,\"bytesOut\":%llu},"
+             "\"pipeline\":{\"active\":%u,\"completed\":%u,\"errors\":%u,\"bytes\":%llu,"
+             "\"lastBytes\":%u,\"lastMs\":%u,\"lastKBps\":%u,"
+             "\"bursts\":%u,\"sdBusyMs\":%u,\"sdMaxWriteMs\":%u,\"sdKBps\":%u,"
+             "\"stalls\":%u,\"stallMs\":%u,\"busy\":%u,\"buffers\":%u,\"bufferSize\":%u}}",
+             (int)activeUploads,
+             (unsigned)http.accepted, (unsigned)http.requests, (unsigned)http.active, (unsigned)http.peak_active,
+             (unsigned)http.timeouts, (unsigned)http.errors,
+             (unsigned long long)http.bytes_in, (unsigned long long)http.bytes_out,
+             (unsigned)sd.active, (unsigned)sd.completed, (unsigned)sd.errors, (unsigned long long)sd.bytes,
+             (unsigned)sd.last_bytes, (unsigned)sd.last_ms, lastKBps,
+             (unsigned)sd.bursts, (unsigned)sd.sd_busy_ms, (unsigned)sd.sd_max_ms, sdKBps,
+             (unsigned)sd.stalls, (unsigned)sd.stall_ms, (unsigned)sd.busy,
+             (unsigned)UPLOAD_PIPELINE_BUFFERS, (unsigned)UPLOAD_PIPELINE_BUFFER_SIZE);
+    res.send(200, "application/json", buf);
+}
+
+// 书内搜索：/api/search?q=<关键字>&max=<条数>[&from=<偏移>]，查当前打开的书。
+// 先查 .sidx 索引；索引不可用时从头、索引只建了一部分时从 coveredEnd 起用 BookTextScanner 顺序扫描。
+// 查索引与扫描都在 HTTP 内核拉取响应体时分步进行：每轮 poll 只做一步（扫描至多 SEARCH_SCAN_SLICE_MS），
+// 步与步之间 HTTP 任务照常服务其他连接。每个请求的扫描总时长至多 SEARCH_SCAN_BUDGET_MS，没扫完时返回 next，
+// 客户端带 from=next 再请求即可续扫（不再查索引）。命中附带页号（分页尚未覆盖时为 null）与一小段原文。
+static const int SEARCH_DEFAULT_HITS = 50;
+static const int SEARCH_MAX_HITS = 200;
+static const uint32_t SEARCH_SCAN_BUDGET_MS = 1000;
+static const uint32_t SEARCH_SCAN_SLICE_MS = 100;
+
+struct SearchResponse {
+    std::string book;
+    size_t fileSize = 0;
+    SearchIndexResult index;
+    bool scanned = false;
+    bool more = false;  // 顺序扫描尚未到达书尾
+    size_t next = 0;    // more 时的续扫起点
+    std::vector<SearchHit> hits;
+    std::vector<std::string> snippets;
+};
+
+// 一次检索请求的分步状态（由响应体生成器逐步推进）
+struct SearchJob {
+    enum Phase { INDEX, SCAN, SNIPPETS, REPLY, FAILED };
+    Phase phase = INDEX;
+    std::shared_ptr<BookHandle> book;
+    std::string query;
+    size_t maxHits = 0;
+    BookTextScanner scanner;
+    unsigned long scanStart = 0;  // 本请求扫描的起始时刻（总时长受 SEARCH_SCAN_BUDGET_MS 限制）
+    SearchResponse r;
+};
+
+static void write_search_response(const SearchResponse& r, HttpJsonWriter& w) {
+    w.beginObject();
+    w.field("ok", true);
+    w.field("book", r.book);
+    w.field("fileSize", (unsigned long long)r.fileSize);
+    w.field("indexed", r.index.used_index);
+    w.field("coveredEnd", (unsigned long long)r.index.covered_end);
+    w.field("truncated", r.index.truncated);
+    w.field("scanned", r.scanned);
+    w.key("next");
+    if (r.more) w.value((unsigned long long)r.next); else w.null();
+    w.key("hits");
+    w.beginArray();
+    for (size_t i = 0; i < r.hits.size(); ++i) {
+        const SearchHit& h = r.hits[i];
+        w.beginObject();
+        w.field("pos", (unsigned long long)h.file_pos);
+        w.key("page");
+        if (h.page_valid) w.value((unsigned long long)h.page_index + 1); else w.null();
+        w.field("text", i < r.snippets.size() ? r.snippets[i] : std::string());
+        w.endObject();
+    }
+    w.endArray();
+    w.endObject();
+}
+
+// 推进一步；不写出内容时 HttpJsonSource 让出，HTTP 任务下一轮 poll 再调用
+static bool search_step(SearchJob& job, HttpJsonWriter& w) {
+    SearchResponse& r = job.r;
+    switch (job.phase) {
+    case SearchJob::INDEX: {
+        r.index = searchBookIndex(job.book.get(), job.query, r.hits, job.maxHits);
+        size_t scanFrom = SIZE_MAX;
+        if (!r.index.used_index) scanFrom = 0;
+        else if (!r.index.truncated && r.index.covered_end < r.fileSize) scanFrom = r.index.covered_end;
+        if (scanFrom < r.fileSize && r.hits.size() < job.maxHits) {
+            if (scanFrom == 0 || job.scanner.begin(job.book.get(), job.query, scanFrom)) {
+                r.scanned = true;
+                job.scanStart = millis();
+                job.phase = SearchJob::SCAN;
+                return true;
+            }
+            job.phase = SearchJob::FAILED;
+            return true;
         }
+        job.scanner.reset();
+        job.phase = SearchJob::SNIPPETS;
+        return true;
+    }
+    case SearchJob::SCAN: {
+        // 取不到书籍文件锁（UI 正在翻页）时 step 不前进，下一轮 poll 再试
+        BookTextScanner::Status st = job.scanner.step(r.hits, SEARCH_SCAN_SLICE_MS, job.maxHits - r.hits.size());
+        if (st == BookTextScanner::Status::Error) {
+            job.phase = SearchJob::FAILED;
+            return true;
+        }
+        if (st == BookTextScanner::Status::More && r.hits.size() < job.maxHits &&
+            millis() - job.scanStart < SEARCH_SCAN_BUDGET_MS)
+            return true;
+        r.more = st == BookTextScanner::Status::More;
+        r.next = job.scanner.resumePos();
+        if (r.more && r.hits.size() >= job.maxHits) r.index.truncated = true;
+        job.scanner.reset();
+        job.phase = SearchJob::SNIPPETS;
+        return true;
+    }
+    case SearchJob::SNIPPETS:
+        readSearchSnippets(job.book.get(), r.hits, 0, r.snippets);
+        job.phase = SearchJob::REPLY;
+        return true;
+    case SearchJob::REPLY:
+#if DBG_WIFI_HOTSPOT
+        Serial.printf("[WIFI_HOTSPOT] /api/search q=%s indexed=%d covered=%u scanned=%d next=%d hits=%u\n",
+                      job.query.c_str(), r.index.used_index ? 1 : 0, (unsigned)r.index.covered_end, r.scanned ? 1 : 0,
+                      r.more ? (int)r.next : -1, (unsigned)r.hits.size());
+#endif
+        write_search_response(r, w);
+        return false;
+    case SearchJob::FAILED:
+    default:
+        // 状态行已发出，失败只能体现在 JSON 里
+        w.beginObject();
+        w.field("ok", false);
+        w.field("message", "Failed to read book");
+        w.endObject();
+        return false;
     }
 }
 
+void WiFiHotspotManager::handleSearch(HttpRequest& req, HttpResponse& res) {
+    const std::string& q = req.arg("q");
+    if (q.empty()) {
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Missing q parameter\"}");
+        return;
+    }
+    int maxHits = req.hasArg("max") ? atoi(req.arg("max").c_str()) : SEARCH_DEFAULT_HITS;
+    if (maxHits <= 0) maxHits = SEARCH_DEFAULT_HITS;
+    if (maxHits > SEARCH_MAX_HITS) maxHits = SEARCH_MAX_HITS;
+
+    std::shared_ptr<BookHandle> book = std::atomic_load(&__g_current_book_shared);
+    if (!book || book->isClosing()) {
+        res.send(404, "application/json", "{\"ok\":false,\"message\":\"No book is open\"}");
+        return;
+    }
+
+    std::shared_ptr<SearchJob> job = std::make_shared<SearchJob>();
+    job->book = book;
+    job->query = q;
+    job->maxHits = (size_t)maxHits;
+    job->r.book = book->filePath();
+    job->r.fileSize = book->getFileSize();
+
+    // 查询能否扫描（例如 GBK 书中无法映射的字符）在这里先判定，以便直接回 400；
+    // 续扫请求跳过索引，从 from 开始
+    size_t scanFrom = req.hasArg("from") ? (size_t)strtoull(req.arg("from").c_str(), nullptr, 10) : 0;
+    if (scanFrom < job->r.fileSize && !job->scanner.begin(book.get(), q, scanFrom)) {
+        res.send(400, "application/json", "{\"ok\":false,\"message\":\"Query cannot be searched\"}");
+        return;
+    }
+    if (req.hasArg("from")) {
+        job->r.scanned = scanFrom < job->r.fileSize;
+        job->phase = job->r.scanned ? SearchJob::SCAN : SearchJob::SNIPPETS;
+        job->scanStart = millis();
+    }
+
+    res.stream(200, "application/json", std::unique_ptr<HttpBodySource>(new HttpJsonSource([job](HttpJsonWriter &w) {
+        return search_step(*job, w);
+    })), -1);
+}
+
 String WiFiHotspotManager::formatFileSize(size_t bytes) {
     if (bytes < 1024) {
         return String(bytes) + " B";
@@ -1591,23 +2631,24 @@ String WiFiHotspotManager::getContentType(String filename) {
     return "application/octet-stream";
 }
 
-bool WiFiHotspotManager::handleFileRead(String path) {
+bool WiFiHotspotManager::handleFileRead(HttpRequest& req, HttpResponse& res, String path) {
     if (path.endsWith("/")) path += "index.htm";
     String contentType = getContentType(path);
-    // 优先 SPIFFS
+    // 优先 SPIFFS：有构建时生成的 .gz 就发压缩版本
+    if (serve_precompressed(req, res, path, contentType.c_str())) return true;
     if (SPIFFS.exists(path)) {
         File file = SPIFFS.open(path, "r");
         if (file && !file.isDirectory()) {
-            webServer->streamFile(file, contentType);
-            file.close();
+            size_t size = file.size();
+            res.stream(200, contentType.c_str(), std::unique_ptr<HttpBodySource>(new HttpFileSource(file)), (int64_t)size);
             return true;
         }
     }
     // 再查 SD 卡
     File file = SDW::SD.open(path, "r");
     if (file && !file.isDirectory()) {
-        webServer->streamFile(file, contentType);
-        file.close();
+        size_t size = file.size();
+        res.stream(200, contentType.c_str(), std::unique_ptr<HttpBodySource>(new HttpFileSource(file)), (int64_t)size);
         return true;
     }
     return false;
@@ -1,18 +1,23 @@
 #pragma once
 
 #include <WiFi.h>
-#include <WebServer.h>
 #include <FS.h>
 #include <SD.h>
 #include <SPIFFS.h>
 #include <M5Unified.h>
 #include <nvs_flash.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "api/http_core.h"
 
 /**
  * @brief WiFi热点和Web服务器管理器
  * 
  * 提供WiFi热点功能和Web文件管理服务器
  * 用于在WIRE CONNECT状态下进行文件上传和管理
+ * Web 服务器使用 HttpServerCore（api/http_core.h），在独立任务中并发处理多个连接，
+ * 不再依赖主循环轮询 handleClient()
  */
 class WiFiHotspotManager {
 public:
@@ -45,11 +50,6 @@ public:
      */
     bool isRunning() const;
 
-    /**
-     * @brief 处理Web服务器请求（需要在主循环中定期调用）
-     */
-    void handleClient();
-
     /**
      * @brief 获取热点SSID
      * @return SSID字符串
@@ -76,7 +76,7 @@ public:
 
     /**
      * @brief 检查是否正在上传文件
-     * @return true 正在上传，false 未在上传
+     * @return true 至少有一个上传在进行，false 未在上传
      */
     bool isUploadInProgress() const;
 
@@ -89,26 +89,48 @@ private:
     static constexpr int DEFAULT_CHANNEL = 1;
     static constexpr int MAX_CONNECTIONS = 4;
     
-    WebServer* webServer;
+    HttpServerCore* httpServer;
+    TaskHandle_t httpTask;
+    SemaphoreHandle_t httpTaskExited; // HTTP 任务关闭全部连接、不再访问 httpServer 后给出
+    volatile bool httpStopRequested;
     bool running;
     String currentSSID;
     String currentPassword;
-    volatile bool uploadInProgress; // 上传状态标志
-
-    // Web服务器处理函数
-    void handleRoot();
-    void handleFileList(String category);
-    void handleFileUpload();
-    void handleFileDelete();
-    void handleFileDownload();
-    void handleNotFound();
-    void handleFileUploadPost();
-    void handleReadingRecords();
+    volatile int activeUploads; // 进行中的上传数（多个连接可同时上传）
+
+    static void httpTaskEntry(void* arg);
+    bool startHttpServer();
+    void stopHttpServer();
+
+    // Web服务器处理函数（在 HTTP 任务中调用）
+    void handleRoot(HttpRequest& req, HttpResponse& res);
+    void handleFileList(HttpRequest& req, HttpResponse& res, String category);
+    void handleFileUpload(HttpRequest& req, HttpResponse& res);
+    void handleFileDelete(HttpRequest& req, HttpResponse& res);
+    void handleFileDownload(HttpRequest& req, HttpResponse& res);
+    void handleNotFound(HttpRequest& req, HttpResponse& res);
+    void handleFileUploadPost(HttpRequest& req, HttpResponse& res, HttpUpload& upload);
+    void handleFileUploadDone(HttpRequest& req, HttpResponse& res);
+    void handleReadingRecords(HttpRequest& req, HttpResponse& res);
+    // 断点续传上传（/upload/init、/upload/status、/upload/chunk、/upload/commit、/upload/abort）
+    void handleUploadInit(HttpRequest& req, HttpResponse& res);
+    void handleUploadStatus(HttpRequest& req, HttpResponse& res);
+    void handleUploadChunk(HttpRequest& req, HttpResponse& res, HttpUpload& upload);
+    void handleUploadChunkDone(HttpRequest& req, HttpResponse& res);
+    void handleUploadCommit(HttpRequest& req, HttpResponse& res);
+    void handleUploadAbort(HttpRequest& req, HttpResponse& res);
+    // 书库同步（/sync）：清单在上传回调中边收边比对，结束时流式返回差异
+    void handleSync(HttpRequest& req, HttpResponse& res, HttpUpload& upload);
+    void handleSyncDone(HttpRequest& req, HttpResponse& res);
+    // 传输统计（/api/transfer_status）
+    void handleTransferStatus(HttpRequest& req, HttpResponse& res);
+    // 书内搜索（/api/search）：在当前打开的书中查找
+    void handleSearch(HttpRequest& req, HttpResponse& res);
 
     // 辅助函数
     String formatFileSize(size_t bytes);
     String getContentType(String filename);
-    bool handleFileRead(String path);
+    bool handleFileRead(HttpRequest& req, HttpResponse& res, String path);
     void sendDirectoryList(String path);
     
     // HTML页面生成
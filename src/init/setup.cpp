@@ -15,6 +15,7 @@
 #include "ui/ui_lock_screen.h"
 #include "config/config_manager.h"
 #include "text/book_handle.h"
+#include "text/glyph_atlas.h"
 #include "tasks/background_index_task.h"
 
 extern M5Canvas *g_canvas;
@@ -169,6 +170,9 @@ void setup()
     g_canvas = new M5Canvas(&M5.Display);
     g_canvas->createSprite(PAPER_S3_WIDTH, PAPER_S3_HEIGHT);
 
+    // 字形图集的互斥锁必须在任何可能渲染文字的任务启动前创建（不能在首次 lock 时懒创建）
+    g_glyph_atlas.init();
+
     // 初始化显示推送任务，使得 bin_font_flush_canvas 在 setup 阶段也能成功入队
     initializeDisplayPushTask();
  //   bin_font_clear_canvas();
@@ -110,10 +110,9 @@ extern "C"
         // Entry for interrupt monitoring - 主任务进入监控循环
         for (;;)
         {
-            // 仅在WIRE CONNECT状态时处理Web服务器请求
-            if (getCurrentSystemState() == STATE_WIRE_CONNECT && g_wifi_hotspot && g_wifi_hotspot->isRunning())
+            // WIRE CONNECT 状态的 Web 请求由 WiFiHotspotManager 的 HTTP 任务自行处理
+            if (getCurrentSystemState() == STATE_WIRE_CONNECT)
             {
-                g_wifi_hotspot->handleClient();
             }
             else if (getCurrentSystemState() == STATE_USB_CONNECT)
             {
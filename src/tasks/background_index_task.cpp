@@ -6,9 +6,13 @@
 #include "task_priorities.h"
 #include <Arduino.h>
 #include <vector>
+#include <algorithm>
 #include "device/safe_fs.h"
 #include "test/per_file_debug.h"
 #include "text/tags_handle.h"
+#include "text/book_search.h"
+#include "text/page_glyphs.h"
+#include "text/font_subset.h"
 
 // ----- Debug logging (compile-time switch) -----
 #ifndef BG_INDEX_DEBUG
@@ -20,6 +24,11 @@
 #define BGLOG(...) do { } while (0)
 #endif
 
+// Time budget for one full-text search index segment (same as a page-index segment)
+static const uint32_t SEARCH_INDEX_SEGMENT_BUDGET_MS = 50;
+// Time budget for one per-book subset font segment
+static const uint32_t FONT_SUBSET_SEGMENT_BUDGET_MS = 50;
+
 // Local helpers to manipulate page/progress/complete files from background task.
 // Forward declarations for local helpers used earlier in this file
 static bool patchPageFileCountLocal(const std::string &page_file, uint32_t count);
@@ -76,25 +85,133 @@ static void finalizeIndexArtifacts(BookHandle *bh)
     bh->markIndexingComplete();
 }
 
-// Append page offsets to an already-open page file handle.
+// Append page offsets to an already-open page file handle as one v2 record.
 // Important: keep SD critical section short and avoid extra open/close/flush per batch.
 static bool appendOffsetsToPageFile(File &pf, const std::vector<uint32_t> &offsets)
 {
     if (offsets.empty())
         return true;
 
-    for (uint32_t o : offsets)
-    {
-        pf.write((const uint8_t *)&o, sizeof(o));
-    }
-
     // Note: This approach means the page file's count field (at offset 8) will be stale
     // until patchPageFileCountLocal is called. That's acceptable since we update it
     // at the end of each batch and on completion.
-    
+    return PagePositionStore::appendRecord(pf, offsets.data(), offsets.size());
+}
+
+// Records can only be appended to a v2 .page. A v1 file (or a v2 file with a torn tail
+// left by a reset mid-append) is rewritten once from its valid content before appending.
+static bool ensurePackedPageFile(BookHandle *bh, const std::string &page_file)
+{
+    static std::string checked_file;
+    if (checked_file == page_file && !bh->pageFileNeedsRewrite())
+        return true;
+
+    PagePositionStore disk;
+    bool needs_rewrite = false;
+    bool ok = false;
+    File rf = SDW::SD.open(page_file.c_str(), "r");
+    if (rf)
+    {
+        ok = disk.loadFromPageFile(rf, needs_rewrite);
+        rf.close();
+    }
+    // Unreadable header: fall back to the in-memory positions if we have any
+    const PagePositionStore &src = ok ? disk : bh->getPagePositions();
+    if (!ok && src.empty())
+        return false;
+    if (!ok || needs_rewrite)
+    {
+        if (!SafeFS::safeWrite(page_file, [&](File &f) { return src.writePageFile(f); }))
+            return false;
+        BGLOG("[BgIndex] rewrote %s as v2: pages=%zu bytes=%zu\n", page_file.c_str(), src.size(), src.memoryBytes());
+    }
+    bh->clearPageFileNeedsRewrite();
+    checked_file = page_file;
     return true;
 }
 
+// ----- 每页字形集合（.pgg），随 .page 一起增量写入 -----
+// 只在 .pgg 恰好覆盖所有已分完的页时才续写；对不上（断电撕裂、进度回退、换了字体/繁简模式）
+// 就删掉并停写，阅读端回退为读正文提取字形，下次重建索引时重新生成。
+static std::string s_glyph_file;  // 最近一次校验的 .pgg
+static size_t s_glyph_pages = 0;  // 其中已记录的页数
+static bool s_glyph_ok = false;   // 是否继续写
+
+static void dropGlyphFile(const std::string &glyph_file)
+{
+    if (SDW::SD.exists(glyph_file.c_str()))
+        (void)SDW::SD.remove(glyph_file.c_str());
+    s_glyph_file = glyph_file;
+    s_glyph_pages = 0;
+    s_glyph_ok = false;
+    BGLOG("[BgIndex] glyph sidecar disabled: %s\n", glyph_file.c_str());
+}
+
+// 与新建 .page 同时新建空的 .pgg
+static void createGlyphFile(BookHandle *bh)
+{
+    std::string glyph_file = bh->getPageGlyphFileName();
+    File gf = SDW::SD.open(glyph_file.c_str(), "w");
+    bool ok = gf && PageGlyphIndex::writeHeader(gf, bh->getEffectiveZhConvMode(), PageGlyphIndex::currentFontTag());
+    if (gf)
+        gf.close();
+    if (!ok)
+    {
+        dropGlyphFile(glyph_file);
+        return;
+    }
+    s_glyph_file = glyph_file;
+    s_glyph_pages = 0;
+    s_glyph_ok = true;
+}
+
+// 续建时校验一次（同一文件只扫描一次 chunk 头），返回是否可以继续追加
+static bool ensureGlyphFile(BookHandle *bh)
+{
+    std::string glyph_file = bh->getPageGlyphFileName();
+    if (s_glyph_file == glyph_file && (!s_glyph_ok || SDW::SD.exists(glyph_file.c_str())))
+        return s_glyph_ok;
+
+    size_t pages = 0;
+    uint8_t conv = 0;
+    uint32_t tag = 0;
+    size_t done = bh->getTotalPages() > 0 ? bh->getTotalPages() - 1 : 0; // 最后一个页起点尚未分完
+    if (!PageGlyphIndex::countPages(glyph_file, pages, conv, tag) || pages != done ||
+        conv != bh->getEffectiveZhConvMode() || tag != PageGlyphIndex::currentFontTag())
+    {
+        dropGlyphFile(glyph_file);
+        return false;
+    }
+    s_glyph_file = glyph_file;
+    s_glyph_pages = pages;
+    s_glyph_ok = true;
+    return true;
+}
+
+// 追加一批字形集合：sets[0] 对应第 first_page 页，只写到 limit（不含）为止
+static void appendGlyphSets(File &gf, const std::vector<PageGlyphSet> &sets, size_t first_page, size_t limit)
+{
+    if (!s_glyph_ok || !gf)
+        return;
+    if (first_page > s_glyph_pages)
+    {
+        gf.close();
+        dropGlyphFile(s_glyph_file);
+        return;
+    }
+    size_t skip = s_glyph_pages - first_page; // 重做的页（上一段中途停下）已经写过
+    size_t end = std::min(sets.size(), limit > first_page ? limit - first_page : 0);
+    if (skip >= end)
+        return;
+    if (!PageGlyphIndex::appendChunk(gf, (uint32_t)s_glyph_pages, sets.data() + skip, end - skip))
+    {
+        gf.close();
+        dropGlyphFile(s_glyph_file);
+        return;
+    }
+    s_glyph_pages += end - skip;
+}
+
 static bool patchPageFileCountLocal(const std::string &page_file, uint32_t count)
 {
     // CRITICAL FIX: Use in-place update with r+ mode instead of copy-whole-file.
@@ -107,8 +224,8 @@ static bool patchPageFileCountLocal(const std::string &page_file, uint32_t count
     //   If reset occurs mid-write, only the count field may be corrupted (4 bytes)
     //   but the rest of the file (all page offsets) remain intact
     // 
-    // Recovery: if count field is corrupted, we can infer the correct count from file size:
-    //   count = (file_size - 12) / 4  (header is 12 bytes, each offset is 4 bytes)
+    // Recovery: if count field is corrupted, the loader ignores it and recounts from the
+    // records themselves (v1: (file_size - 12) / 4; v2: walk the record chain).
     
     File fh = SDW::SD.open(page_file.c_str(), "r+");
     if (!fh)
@@ -302,40 +419,13 @@ bool backgroundGeneratePageFileIncremental(BookHandle *bh)
                 BGLOG("[BgIndex] Loaded .page file: pages_before=%zu, pages_after=%zu\n", 
                       pages_before_load, pages_after_load);
                 
-                // If page_positions were loaded, set indexing_current_pos to last offset by reading the .page file tail
-                // Read last uint32 from binary page file
-                File pf_r = SDW::SD.open(page_file.c_str(), "r");
-                if (pf_r)
+                // Resume from the last loaded page start (the loader already dropped any torn tail)
+                if (bh->getTotalPages() > 0)
                 {
-                    // header: 4+1+3+4 = 12 bytes, then count*4 offsets
-                    pf_r.seek(0, SeekEnd);
-                    size_t pf_size = pf_r.position();
-                    if (pf_size >= 12 + 4)
-                    {
-                        // read count
-                        pf_r.seek(8);
-                        uint32_t count = 0;
-                        pf_r.read((uint8_t *)&count, sizeof(count));
-                        BGLOG("[BgIndex] .page file: size=%zu bytes, count_field=%u, loaded_pages=%zu\n",
-                              pf_size, count, pages_after_load);
-                        
-                        if (count > 0)
-                        {
-                            // read last offset
-                            size_t last_offset_pos = 12 + (count - 1) * 4;
-                            if (last_offset_pos + 4 <= pf_size)
-                            {
-                                pf_r.seek(last_offset_pos);
-                                uint32_t last_off = 0;
-                                pf_r.read((uint8_t *)&last_off, sizeof(last_off));
-                                bh->setIndexingCurrentPos((size_t)last_off);
-                                resume_from_progress = true;
-                                BGLOG("[BgIndex] Resume from .page file: last_offset=%u (pos %zu/%zu in file)\n",
-                                      last_off, last_offset_pos, pf_size);
-                            }
-                        }
-                    }
-                    pf_r.close();
+                    size_t last_off = bh->getPagePositions().back();
+                    bh->setIndexingCurrentPos(last_off);
+                    resume_from_progress = true;
+                    BGLOG("[BgIndex] Resume from .page file: last_offset=%zu pages=%zu\n", last_off, bh->getTotalPages());
                 }
             }
             else
@@ -384,19 +474,13 @@ bool backgroundGeneratePageFileIncremental(BookHandle *bh)
             indexing_file.close();
             return false;
         }
-        const uint8_t magic[4] = {'B', 'P', 'G', '1'};
-        wf.write(magic, 4);
-        uint8_t ver = 1;
-        wf.write((const uint8_t *)&ver, 1);
-        uint8_t reserved[3] = {0, 0, 0};
-        wf.write(reserved, 3);
-        uint32_t zero = 0;
-        wf.write((const uint8_t *)&zero, sizeof(zero)); // placeholder count
-        uint32_t p0 = 0;
-        wf.write((const uint8_t *)&p0, sizeof(p0));
+        PagePositionStore::writePageFileHeader(wf, 0); // placeholder count
+        const uint32_t p0 = 0;
+        PagePositionStore::appendRecord(wf, &p0, 1);
         wf.close();
         bh->appendPagePosition(0);
         bh->setIndexingCurrentPos(0);
+        createGlyphFile(bh);
     }
 
     // 记录本次工作循环的“读取起点”，用于在主循环里做无前进的收尾判断
@@ -405,6 +489,12 @@ bool backgroundGeneratePageFileIncremental(BookHandle *bh)
         bh->setLastIndexCycleStart(cycle_start);
     }
 
+    if (!ensurePackedPageFile(bh, page_file))
+    {
+        indexing_file.close();
+        return false;
+    }
+
     // Open for append binary once per segment (minimize FAT metadata churn)
     File pf = SDW::SD.open(page_file.c_str(), "a");
     if (!pf)
@@ -414,6 +504,15 @@ bool backgroundGeneratePageFileIncremental(BookHandle *bh)
         return false;
     }
 
+    // 字形集合与 .page 同一段内打开一次
+    File gf;
+    if (ensureGlyphFile(bh))
+    {
+        gf = SDW::SD.open(s_glyph_file.c_str(), "a");
+        if (!gf)
+            s_glyph_ok = false;
+    }
+
     bh->setIndexingInProgress(true);
 
     // Tune for responsiveness: smaller chunk and single batch keeps SD bus free more often
@@ -490,7 +589,9 @@ bool backgroundGeneratePageFileIncremental(BookHandle *bh)
         }
         
         // 【优化】持有锁时间尽可能短，立即执行分页并释放
-    BuildIndexResult br = build_book_page_index(indexing_file, bh->filePath(), area_w, area_h, font_size, enc, CHUNK_PAGES, start_pos, vertical, bh);
+        std::vector<PageGlyphSet> glyph_sets;
+    BuildIndexResult br = build_book_page_index(indexing_file, bh->filePath(), area_w, area_h, font_size, enc, CHUNK_PAGES, start_pos, vertical, bh,
+                                                s_glyph_ok ? &glyph_sets : nullptr);
         bh->releaseFileLockPublic();
         
         // 【优化】释放锁后立即让步，让翻页任务有机会执行
@@ -537,11 +638,19 @@ bool backgroundGeneratePageFileIncremental(BookHandle *bh)
         taskYIELD();
 
         // update in-memory positions
+        size_t pages_before = bh->getTotalPages(); // start_pos 是其中最后一项
         for (uint32_t o : offsets_to_write)
         {
             bh->appendPagePosition((size_t)o);
             total_new_pages++;
         }
+
+        // 本批分完的页从 start_pos 那页起；到达 EOF 时末页也已分完
+        if (s_glyph_ok && pages_before > 0)
+        {
+            size_t glyph_limit = br.reached_eof ? bh->getTotalPages() : bh->getTotalPages() - 1;
+            appendGlyphSets(gf, glyph_sets, pages_before - 1, glyph_limit);
+        }
         
         // Log actual page count after appending to memory
         BGLOG("[BgIndex] appended %zu offsets, pages_total=%zu\n", offsets_to_write.size(), bh->getTotalPages());
@@ -635,6 +744,12 @@ bool backgroundGeneratePageFileIncremental(BookHandle *bh)
     // Do not wait here; return control to caller quickly in main-loop driven mode
     }
 
+    if (gf)
+    {
+        gf.flush();
+        gf.close();
+    }
+
     if (pf)
     {
         // Flush once per segment to reduce long-latency FAT updates
@@ -701,9 +816,18 @@ bool runBackgroundIndexWorkCycle()
     }
 
     // Passive defense: if indexing is effectively complete (on-disk .complete marker exists),
-    // skip any work to avoid spurious post-complete indexing.
+    // skip any page-indexing work to avoid spurious post-complete indexing.
+    // The optional subset font and full-text search stages run only after pagination is done.
     if (local_bh && local_bh->isIndexingComplete())
     {
+#if ENABLE_FONT_SUBSET
+        if (!pending_force_reindex && backgroundBuildFontSubsetIncremental(local_bh, FONT_SUBSET_SEGMENT_BUDGET_MS))
+            return true;
+#endif
+#if ENABLE_SEARCH_INDEX
+        if (!pending_force_reindex)
+            return backgroundBuildSearchIndexIncremental(local_bh, SEARCH_INDEX_SEGMENT_BUDGET_MS);
+#endif
         return false;
     }
 
@@ -801,7 +925,7 @@ void requestForceReindex()
                 bool tag_saved = insertAutoTagForFile(g_current_book->filePath(), tp.file_pos);
                 if (tag_saved)
                 {
-                    // 刷新内存缓存，确保BookHandle中的cached_tags是最新的
+                    // 刷新内存缓存，确保BookHandle中的tag_index_是最新的
                     g_current_book->refreshTagsCache();
                 }
                 else
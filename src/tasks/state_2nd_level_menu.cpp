@@ -12,6 +12,7 @@
 #include "globals.h"
 #include "SD/SDWrapper.h"
 #include "device/efficient_file_scanner.h"
+#include "device/dir_index.h"
 #include "device/wifi_hotspot_manager.h"
 #include "device/usb_msc.h"
 #include <unordered_set>
@@ -29,6 +30,7 @@ extern GlobalConfig g_config;
 extern std::vector<FontFileInfo, PSRAMAllocator<FontFileInfo>> g_font_list;
 #include "text/tags_handle.h"
 #include "text/book_handle.h"
+#include "text/lz_book.h"
 
 // 定义全局二级菜单类型变量（默认 CLEAN_BOOKMARK）
 Main2ndLevelMenuType main_2nd_level_menu_type;
@@ -366,6 +368,7 @@ void StateMachineTask::handle2ndLevelMenuState(const SystemMessage_t *msg)
                 // 清理 /bookmarks 和 /screenshot 目录
                 cleanDirectory(bmDir);
                 cleanDirectory(ssDir);
+                DirIndex::invalidateAll();
 
                 // 删除根目录下的 history.list 和 readpaper.cfg 相关文件
                 const char *hist = "/history.list";
@@ -456,10 +459,13 @@ void StateMachineTask::handle2ndLevelMenuState(const SystemMessage_t *msg)
                                     else
                                         bookPath += c;
                                 }
+                                // 压缩书 <名>.txt.lz 的净化名只去掉了 .lz，还原后以 .txt 结尾
+                                std::string packedPath = bookPath + ".lz";
                                 bookPath += ".txt";
 
                                 // 检查 SD 卡上是否存在该书籍
-                                if (SDW::SD.exists(bookPath.c_str()))
+                                if (SDW::SD.exists(bookPath.c_str()) ||
+                                    (lz_book_name(packedPath) && SDW::SD.exists(packedPath.c_str())))
                                     has_owner = true;
                             }
                             // 检查是否有 _spiffs_ 前缀
@@ -553,6 +559,8 @@ void StateMachineTask::handle2ndLevelMenuState(const SystemMessage_t *msg)
                         }
                     }
                 }
+                // 孤立书签清理可能删掉了目录排序索引，/book 也可能少了 .idx
+                DirIndex::invalidateAll();
 
                 // Complete - show main menu
                 show_main_menu(g_canvas, false, 0, 0, false);
@@ -11,6 +11,8 @@
 #include "ui/ui_canvas_image.h"
 // for tag loading
 #include "text/tags_handle.h"
+// for tag list paging
+#include "ui/index_display.h"
 // for TOC display
 #include "ui/toc_display.h"
 // for screenshot
@@ -51,6 +53,25 @@ void StateMachineTask::handleIndexDisplayState(const SystemMessage_t *msg)
         // Touch handling: left area is the tag list, right area returns to reading menu
         int16_t tx = msg->data.touch.x;
         int16_t ty = msg->data.touch.y - 32;
+        int16_t raw_y = msg->data.touch.y; // preserve raw screen Y for pagination area check
+
+        // Pagination touch area at bottom: y in [920,960]
+        // x < 225 => previous page; 240 < x < 450 => next page
+        if (raw_y >= 900 && raw_y <= 960)
+        {
+            if (tx < 225)
+            {
+                tag_prev_page();
+                show_tag_ui(g_canvas, 1);
+                return;
+            }
+            if (tx > 240 && tx < 450)
+            {
+                tag_next_page();
+                show_tag_ui(g_canvas, 1);
+                return;
+            }
+        }
 
         // If touch on the right-side (outside the tag list), return to reading menu
         const int16_t TAG_AREA_W = 450; // must match show_tag_ui
@@ -96,12 +117,13 @@ void StateMachineTask::handleIndexDisplayState(const SystemMessage_t *msg)
         if (!g_current_book)
             break;
 
-        // Load tags for current book (small, safe call)
-        std::vector<TagEntry> tags = loadTagsForFile(g_current_book->filePath());
-        if ((size_t)row >= tags.size())
+        // Tags come from the in-memory index; account for the current list page
+        const std::vector<TagEntry> &tags = g_current_book->getCachedTags();
+        size_t tag_idx = (size_t)tag_get_current_page() * rows + (size_t)row;
+        if (tag_idx >= tags.size())
             break; // no tag at this row
 
-        size_t tag_pos = tags[row].position;
+        size_t tag_pos = tags[tag_idx].position;
 
         // If tag is beyond current indexing progress and indexing not complete, ignore click
         if (!g_current_book->isIndexingComplete() && tag_pos > g_current_book->getIndexingCurrentPos())
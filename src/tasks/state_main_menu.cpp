@@ -38,6 +38,7 @@
 #include "device/wifi_hotspot_manager.h"
 #include "text/text_handle.h"
 #include "text/book_handle.h"
+#include "device/book_file_manager.h"
 #include "ui/ui_control.h"
 #include "ui/ui_canvas_utils.h"
 #include "ui/ui_canvas_image.h"
@@ -182,7 +183,7 @@ void StateMachineTask::handleMainMenuState(const SystemMessage_t *msg)
                     if (book_path.empty())
                     {
                         // fallback to old behavior
-                        book_path = std::string("/sd/book/") + selected_book_name + ".txt";
+                        book_path = std::string("/sd") + BookFileManager::bookPath(selected_book_name);
                     }
 
                     // 使用 config_update_current_book 来创建新的 BookHandle
@@ -163,46 +163,20 @@ void StateMachineTask::handleReadingState(const SystemMessage_t *msg)
                                         size_t page_start = tp.file_pos;
                                         size_t page_end = SIZE_MAX;
 
-                                        // 计算页面结束位置
+                                        // 计算页面结束位置（直接取分页索引中的下一页起点，不再翻页读取文本）
                                         if (g_current_book->isPagesLoaded() && g_current_book->getTotalPages() > 0)
                                         {
                                                 size_t cur_idx = g_current_book->getCurrentPageIndex();
-                                                if (cur_idx + 1 < g_current_book->getTotalPages())
-                                                {
-                                                        // 获取下一页的开始位置（即当前页的结束位置）
-                                                        // 使用nextPage会改变当前页，所以直接计算
-                                                        // 假设页面是连续的，下一页开始位置就是当前页的file_pos + page_text.size()
-                                                        // 但更准确的方法是使用文件大小或getPagePositions
-                                                        // 这里先尝试翻到下一页获取位置，然后翻回来
-                                                        size_t saved_idx = cur_idx;
-                                                        TextPageResult next = g_current_book->nextPage();
-                                                        if (next.success)
-                                                        {
-                                                                page_end = next.file_pos;
-                                                                // 翻回原页面
-                                                                g_current_book->jumpToPage(saved_idx);
-                                                        }
-                                                }
-                                                else
-                                                {
-                                                        // 最后一页，使用文件大小
-                                                        page_end = g_current_book->getFileSize();
-                                                }
+                                                size_t next_start = g_current_book->getPageStart(cur_idx + 1);
+                                                page_end = (next_start != (size_t)-1) ? next_start : g_current_book->getFileSize();
                                         }
 
                                         // 查找当前页面范围内的第一个manual tag（不包括auto tag）
                                         size_t tag_to_delete = SIZE_MAX;
-                                        bool found = false;
-                                        for (const TagEntry &te : g_current_book->getCachedTags())
-                                        {
-                                                // 只删除manual tags，不删除auto tag
-                                                if (!te.is_auto && te.position >= page_start && te.position < page_end)
-                                                {
-                                                        tag_to_delete = te.position;
-                                                        found = true;
-                                                        break;
-                                                }
-                                        }
+                                        const TagEntry *hit = g_current_book->getTagIndex().findManualInRange(page_start, page_end);
+                                        bool found = (hit != nullptr);
+                                        if (found)
+                                                tag_to_delete = hit->position;
 
                                         if (found)
                                         {
@@ -4,6 +4,7 @@
 #include "ui/ui_canvas_utils.h"
 #include "ui/ui_canvas_image.h"
 #include "device/ui_display.h"
+#include "device/usb_msc.h"
 #include "test/per_file_debug.h"
 #include <cstring>
 // for screenshot
@@ -35,8 +36,8 @@ void StateMachineTask::handleUsbConnectState(const SystemMessage_t *msg)
             // Give a brief feedback
             ui_push_image_to_display_direct("/spiffs/wait.png", 240, 450);
             M5.Display.waitDisplay();
-            // Use ESP.restart() to reboot
-            ESP.restart();
+            // Flush the MSC sector cache and reboot (does not return)
+            usb_msc_stop();
         }
         break;
     }
@@ -42,45 +42,7 @@ void StateMachineTask::handleWireConnectState(const SystemMessage_t *msg)
     // 在处理消息前让出CPU控制权，防止watchdog超时
     yield();
 
-    // 处理Web服务器客户端请求 - 增加更多保护措施
-    if (g_wifi_hotspot && g_wifi_hotspot->isRunning())
-    {
-        // 检查内存状态
-        size_t freeHeap = ESP.getFreeHeap();
-        if (freeHeap < 32768)
-        { // 提高内存阈值到32KB
-#if DBG_STATE_MACHINE_TASK
-            sm_dbg_printf("内存不足 (%u bytes)，跳过Web服务器处理\n", freeHeap);
-#endif
-            // 内存不足时进行垃圾收集
-            yield();
-            delay(10);
-        }
-        else
-        {
-            // 检查是否正在上传文件，如果是则完全跳过处理
-            bool isUploading = g_wifi_hotspot->isUploadInProgress();
-
-            if (isUploading)
-            {
-#if DBG_STATE_MACHINE_TASK
-                sm_dbg_printf("文件上传进行中，完全跳过Web服务器处理以避免LWIP冲突\n");
-#endif
-                // 上传过程中不处理任何Web请求
-            }
-            else
-            {
-                // 非上传状态下正常处理，但添加更多保护
-                static unsigned long lastClientHandle = 0;
-                if (millis() - lastClientHandle > 200)
-                { // 降低处理频率到每200ms一次
-                    lastClientHandle = millis();
-                    g_wifi_hotspot->handleClient();
-                    yield();
-                }
-            }
-        }
-    }
+    // Web服务器请求由 WiFiHotspotManager 的 HTTP 任务并发处理，这里只处理状态消息
 
     // 无线连接状态处理逻辑
     switch (msg->type)
@@ -14,3 +14,15 @@
 
 // Display push should be high priority to keep UI responsive
 #define PRIO_DISPLAY 2
+
+// Glyph fetch I/O (neighbour-page prefetch): mostly blocked on SD, below UI work
+#define PRIO_GLYPH_FETCH 1
+
+// HTTP server in Wi-Fi transfer mode: mostly blocked in select() or on SD, same level as display push
+#define PRIO_HTTP 2
+
+// SD writer for Wi-Fi uploads: above the HTTP task so filled buffers drain before new ones are needed
+#define PRIO_SD_WRITER 3
+
+// USB MSC write-back flusher: wakes periodically and briefly, below the USB stack so host requests stay responsive
+#define PRIO_MSC_FLUSH 2
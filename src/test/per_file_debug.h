@@ -197,6 +197,27 @@
 #define DBG_CONFIG_MANAGER 0
 #endif
 #endif
+#ifndef DBG_BOOK_SEARCH
+#if DEBUGON
+#define DBG_BOOK_SEARCH 1
+#else
+#define DBG_BOOK_SEARCH 0
+#endif
+#endif
+#ifndef DBG_FONT_SUBSET
+#if DEBUGON
+#define DBG_FONT_SUBSET 1
+#else
+#define DBG_FONT_SUBSET 0
+#endif
+#endif
+#ifndef DBG_GLYPH_FETCH
+#if DEBUGON
+#define DBG_GLYPH_FETCH 1
+#else
+#define DBG_GLYPH_FETCH 0
+#endif
+#endif
 #ifndef DBG_SCREENSHOT
 #if DEBUGON
 #define DBG_SCREENSHOT 1
@@ -28,6 +28,11 @@
 // access per-book bookmark config
 #include "../text/book_handle.h"
 #include "text/font_buffer.h"
+#include "text/glyph_atlas.h"
+#include "text/font_subset.h"
+#include "text/glyph_fetch.h"
+#include "text/glyph_blit_canvas.h"
+#include "text/glyph_variants.h"
 
 extern GlobalConfig g_config;
 extern int8_t fontLoadLoc;
@@ -39,6 +44,9 @@ bool g_using_progmem_font = false; // 当前是否使用PROGMEM内置字体（
 // 全局字体文件访问互斥锁，防止索引任务和UI渲染并发访问导致seek位置混乱
 static SemaphoreHandle_t g_font_file_mutex = nullptr;
 
+// 字体加载/卸载计数：缺字占位替换依赖当前字体，页面排版缓存以此判断是否过期
+static uint32_t g_font_load_epoch = 0;
+
 // PSRAM 缓存：仅存储字体头文件数据（134字节）
 // 索引表会被解析到内存中的vector/map，不需要缓存原始字节
 struct FontHeaderCache
@@ -298,6 +306,94 @@ struct GlyphReadWindow
 
 static GlyphReadWindow g_glyph_read_window;
 
+// 字频排列字体的热区（头部第 133 字节带 FONT_LAYOUT_FLAG_FREQUENCY）：
+// 这类字体的位图按语料字频降序排列，常用字集中在字符表之后的连续区域。
+// 流式模式加载时把这段前缀整体读入 PSRAM，之后落在其中的字形读取不再访问 SD。
+struct FontHotPrefix
+{
+    uint8_t *buffer = nullptr;
+    uint32_t start = 0; // 文件偏移
+    uint32_t size = 0;
+
+    bool contains(uint32_t offset, uint32_t len) const
+    {
+        return buffer && offset >= start && (uint64_t)offset + len <= (uint64_t)start + size;
+    }
+
+    void cleanup()
+    {
+        if (buffer)
+            heap_caps_free(buffer);
+        buffer = nullptr;
+        start = 0;
+        size = 0;
+    }
+};
+
+static FontHotPrefix g_font_hot_prefix;
+static uint8_t g_font_layout_flags = 0; // 头部第 133 字节（样式名的结尾 NUL，旧字体恒为 0）
+static uint32_t g_font_hot_hint = 0;    // U+0000 条目的保留字段：生成器标注的热区字节数（0=未标注）
+
+// 把字频排列字体的位图前缀读入 PSRAM（仅流式 SD 字体；表后即为最常用字形）
+static void pin_font_hot_prefix()
+{
+    g_font_hot_prefix.cleanup();
+#if ENABLE_FONT_HOT_PREFIX
+    if (!(g_font_layout_flags & FONT_LAYOUT_FLAG_FREQUENCY) || !g_bin_font.fontFile)
+        return;
+
+    uint32_t table_end = 134 + g_bin_font.char_count * 20;
+    uint32_t file_size = g_bin_font.fontFile.size();
+    if (file_size <= table_end)
+        return;
+    uint32_t want = file_size - table_end;
+    if (g_font_hot_hint > 0 && g_font_hot_hint < want)
+        want = g_font_hot_hint;
+    if (want > FONT_HOT_PREFIX_MAX_BYTES)
+        want = FONT_HOT_PREFIX_MAX_BYTES;
+
+    // 给分页/图集留出余量，PSRAM 紧张时宁可不钉
+    if (heap_caps_get_free_size(MALLOC_CAP_SPIRAM) < want + PAGE_STORE_PSRAM_MIN_FREE)
+    {
+#if DBG_BIN_FONT_PRINT
+        Serial.printf("[FONT_LOAD] ⚠️  PSRAM 不足，跳过热区常驻 (%u 字节)\n", want);
+#endif
+        return;
+    }
+    uint8_t *buf = (uint8_t *)heap_caps_malloc(want, MALLOC_CAP_SPIRAM);
+    if (!buf)
+        return;
+
+    const uint32_t CHUNK = 32 * 1024;
+    for (uint32_t done = 0; done < want;)
+    {
+        uint32_t n = want - done < CHUNK ? want - done : CHUNK;
+        if (SDW::SD.readAtOffset(g_bin_font.fontFile, table_end + done, buf + done, n) != n)
+        {
+            heap_caps_free(buf);
+            return;
+        }
+        done += n;
+        esp_task_wdt_reset();
+    }
+    g_font_hot_prefix.buffer = buf;
+    g_font_hot_prefix.start = table_end;
+    g_font_hot_prefix.size = want;
+#if DBG_BIN_FONT_PRINT
+    Serial.printf("[FONT_LOAD] ✨ 字频热区已常驻 PSRAM: %u 字节 @ offset %u (标注 %u)\n", want, table_end,
+                  g_font_hot_hint);
+#endif
+#endif
+}
+
+bool bin_font_read_hot(uint32_t offset, uint8_t *dest, uint32_t size)
+{
+    if (!g_font_hot_prefix.contains(offset, size))
+        return false;
+    memcpy(dest, g_font_hot_prefix.buffer + (offset - g_font_hot_prefix.start), size);
+    return true;
+}
+
 // 检测是否为需要旋转的中文标点符号
 static bool is_chinese_punctuation(uint32_t unicode)
 {
@@ -430,9 +526,14 @@ static void render_v3_scaled(M5Canvas *canvas, uint16_t *bitmap,
     uint16_t fg_color = dark_mode ? 0xFFFF : 0x0000;
     uint16_t gray_out = dark_mode ? GREY_LEVEL_MID : GREY_MAP_COLOR;
 
+    // 每行先算进行缓冲（背景色表示不画），整行一次写入画布
+    std::vector<uint16_t> row(scaled_w > 0 ? scaled_w : 0);
+    GlyphBlitStyle style = {bg_color, true, bg_color, -1};
+
     // 遍历缩放后的每个像素
     for (int16_t sy = 0; sy < scaled_h; sy++)
     {
+        std::fill(row.begin(), row.end(), bg_color);
         for (int16_t sx = 0; sx < scaled_w; sx++)
         {
             // 计算原图对应区域的浮点坐标范围
@@ -513,12 +614,162 @@ static void render_v3_scaled(M5Canvas *canvas, uint16_t *bitmap,
                     continue;
                 }
 
-                canvas->drawPixel(canvas_x + sx, canvas_y + sy, output_color);
+                row[sx] = output_color;
+            }
+        }
+
+        if (!glyph_blit_canvas(canvas, canvas_x, canvas_y + sy, row.data(), scaled_w, 1, style))
+        {
+            for (int16_t sx = 0; sx < scaled_w; sx++)
+            {
+                if (row[sx] != bg_color)
+                    canvas->drawPixel(canvas_x + sx, canvas_y + sy, row[sx]);
             }
         }
     }
 }
 
+/**
+ * @brief 无缩放字形直接写入画布缓冲区
+ *
+ * V3 位图已是最终颜色（含灰度），背景色为 key；V2 位图 0xFFFF 为背景，其余统一画成 text_color。
+ * transparent=false 时背景像素也写入（与原 pushImage 路径一致）。
+ * 画布不是 4/8bpp 时返回 false，调用方走原来的逐像素路径。
+ */
+static bool blit_glyph(M5Canvas *canvas, int16_t x, int16_t y, const uint16_t *bitmap, int16_t w, int16_t h,
+                       bool transparent, bool dark, uint16_t text_color)
+{
+    GlyphBlitStyle style;
+    if (g_bin_font.version == 3)
+    {
+        style.key = FontColorMapper::get_background_color(dark);
+        style.key_color = style.key;
+        style.ink = -1;
+    }
+    else
+    {
+        style.key = 0xFFFF;
+        style.key_color = dark ? 0x0000 : 0xFFFF;
+        style.ink = text_color;
+    }
+    style.key_transparent = transparent;
+    return glyph_blit_canvas(canvas, x, y, bitmap, w, h, style);
+}
+
+// 当前字体对应的覆盖度解码方式
+static FontDecoder::CoverageCodec current_coverage_codec()
+{
+    if (g_bin_font.version == 3)
+        return FontDecoder::CODEC_V3;
+    return g_bin_font.format == FONT_FORMAT_1BIT ? FontDecoder::CODEC_V2_1BIT : FontDecoder::CODEC_V2_HUFFMAN;
+}
+
+// 覆盖度配色，与 blit_glyph 相同：V3 保留灰度，V2 非背景像素统一画成 text_color
+static void coverage_style(CoverageBlitStyle &style, bool transparent, bool dark, uint16_t text_color)
+{
+    if (g_bin_font.version == 3)
+    {
+        uint16_t gray = FontColorMapper::map_v3_color(FontColorMapper::PIXEL_GRAY, dark, false);
+        uint16_t black = FontColorMapper::map_v3_color(FontColorMapper::PIXEL_BLACK, dark, false);
+        for (int i = 0; i < 16; i++)
+            style.color[i] = i == FontDecoder::COVERAGE_V3_GRAY ? gray : black;
+    }
+    else
+    {
+        for (int i = 0; i < 16; i++)
+            style.color[i] = text_color;
+    }
+    style.color[0] = FontColorMapper::get_background_color(dark);
+    style.transparent_mask = transparent ? 0x0001 : 0x0000;
+}
+
+// 把原始数据解码为覆盖度放入任务内存池的位图缓冲；成功后由调用方 release_bitmap_buffer()
+static uint8_t *decode_glyph_coverage(MemoryPool *pool, const uint8_t *raw, const BinFontChar &glyph)
+{
+    size_t bytes = FontDecoder::coverage4_size(glyph.bitmapW, glyph.bitmapH);
+    uint8_t *cov = reinterpret_cast<uint8_t *>(pool->get_bitmap_buffer((bytes + 1) / 2));
+    if (!cov)
+        return nullptr;
+    if (!FontDecoder::decode_coverage4(current_coverage_codec(), raw, glyph.bitmap_size, cov, glyph.bitmapW,
+                                       glyph.bitmapH))
+    {
+        pool->release_bitmap_buffer();
+        return nullptr;
+    }
+    return cov;
+}
+
+/**
+ * @brief 无缩放字形：原始数据直接解码为 4bpp 覆盖度并写入画布缓冲区
+ *
+ * 不生成 RGB565 中间位图（工作缓冲只有其 1/4），也省掉解码后再逐像素转换的一遍。
+ * 画布不是 4/8bpp 时返回 false，调用方走原来的解码 + 绘制路径。
+ */
+static bool draw_glyph_packed(M5Canvas *canvas, int16_t x, int16_t y, const uint8_t *raw, const BinFontChar &glyph,
+                              bool transparent, bool dark, uint16_t text_color)
+{
+    if (!raw || glyph.bitmapW == 0 || glyph.bitmapH == 0 || !glyph_blit_canvas_ready(canvas))
+        return false;
+
+    MemoryPool *pool = MemoryPool::get_task_pool();
+    uint8_t *cov = decode_glyph_coverage(pool, raw, glyph);
+    if (!cov)
+        return false;
+    CoverageBlitStyle style;
+    coverage_style(style, transparent, dark, text_color);
+    bool ok = glyph_blit_canvas_coverage4(canvas, x, y, cov, glyph.bitmapW, glyph.bitmapH, style);
+    pool->release_bitmap_buffer();
+    return ok;
+}
+
+/**
+ * @brief 竖排旋转/镜像字形：解码为覆盖度后生成变体放入 g_glyph_variants，再从缓存写入画布
+ *
+ * 同一字体下之后再出现时直接命中缓存（见竖排循环），不再读取、解码和旋转。
+ */
+static bool draw_glyph_variant(M5Canvas *canvas, int16_t x, int16_t y, const uint8_t *raw, const BinFontChar &glyph,
+                               uint16_t unicode, uint8_t variant, const CoverageBlitStyle &style)
+{
+    if (!raw || glyph.bitmapW == 0 || glyph.bitmapH == 0)
+        return false;
+
+    MemoryPool *pool = MemoryPool::get_task_pool();
+    uint8_t *cov = decode_glyph_coverage(pool, raw, glyph);
+    if (!cov)
+        return false;
+    bool cached = g_glyph_variants.put(unicode, variant, cov, glyph.bitmapW, glyph.bitmapH);
+    pool->release_bitmap_buffer();
+    return cached && g_glyph_variants.blit(unicode, variant, canvas, x, y, style);
+}
+
+/**
+ * @brief 竖排字形左上角
+ *
+ * column_baseline_x 为列基准线（列右缘减一个字号），字形按 x_offset 对齐；旋转的字形原 Y 中心变成
+ * 新 X 中心，居中到字体框内。y 不含 y_offset，竖排只需从上到下排列。
+ */
+static void vertical_glyph_origin(const BinFontChar &glyph, uint32_t unicode, bool rotated, int16_t column_baseline_x,
+                                  float scale_factor, int16_t y, int16_t *out_x, int16_t *out_y)
+{
+    int16_t canvas_x = column_baseline_x + (int16_t)(glyph.x_offset * scale_factor);
+    if (rotated)
+    {
+        int16_t orig_center_y = glyph.bitmapH / 2;
+        int16_t font_center_x = (int16_t)(g_bin_font.font_size * scale_factor) / 2;
+        canvas_x = column_baseline_x + font_center_x - (int16_t)(orig_center_y * scale_factor);
+    }
+    if (needs_minor_shift(unicode))
+    {
+        // 句读标点向右偏移 25% 字号
+        int16_t shift_px = static_cast<int16_t>(std::lround(g_bin_font.font_size * scale_factor * 0.25f));
+        if (shift_px == 0 && g_bin_font.font_size > 0)
+            shift_px = 1;
+        canvas_x += shift_px;
+    }
+    *out_x = canvas_x;
+    *out_y = y;
+}
+
 // Helper: ensure a fixed-size UTF-8 buffer does not end with a truncated multi-byte sequence
 static void utf8_trim_tail(char *buf, size_t bufsize)
 {
@@ -871,6 +1122,17 @@ bool load_glyph_bitmap_smart(uint32_t offset, uint8_t *buffer, uint32_t size)
         }
         else
         {
+            // 当前书的子集字体已在 PSRAM 中时直接取
+            if (g_font_subset.read(offset, buffer, size))
+            {
+                return true;
+            }
+            // 字频排列字体的常用字前缀
+            if (bin_font_read_hot(offset, buffer, size))
+            {
+                return true;
+            }
+
             // 从SD卡文件读取（使用预读窗口优化）
             if (!g_bin_font.fontFile || !g_bin_font.fontFile.available())
             {
@@ -1182,9 +1444,18 @@ bool load_bin_font(const char *path)
     Serial.printf("[FONT] 开始加载字体: %s\n", path);
 #endif
 
+    // 先让预取任务退出：进行中的批次仍在读旧字体文件、子集与热区并写入图集，之后才能拆除它们
+    ++g_font_load_epoch;
+    g_glyph_fetch.cancel();
+
     // 卸载旧字体时会自动清理缓冲区
     // 这里显式清理以确保切换字体前状态干净
     g_font_buffer_manager.clearAll();
+    g_glyph_atlas.reset(); // 旧字体的字形全部作废，书名/TOC 等缓存随之失效
+    g_font_subset.detach();
+    g_font_hot_prefix.cleanup();
+    g_font_layout_flags = 0;
+    g_font_hot_hint = 0;
 
     if (strcmp(path, "default") == 0)
         path = "/spiffs/lite.bin";
@@ -1360,6 +1631,8 @@ bool load_bin_font(const char *path)
     {
         f.read((uint8_t *)g_bin_font.style_name, 64);
     }
+    // 样式名最后一字节被强制为结尾 NUL，生成器借它存放布局标志（旧固件忽略）
+    g_font_layout_flags = (uint8_t)g_bin_font.style_name[63];
     // 同样确保样式名以null结尾并修剪可能的截断UTF-8尾部
     g_bin_font.style_name[63] = '\0';
     utf8_trim_tail(g_bin_font.style_name, sizeof(g_bin_font.style_name));
@@ -1638,6 +1911,8 @@ bool load_bin_font(const char *path)
             offset += 4;
             idx.bitmap_size = *(uint32_t *)&chars_buffer[offset];
             offset += 4;
+            if (idx.unicode == 0 && i == 0)
+                g_font_hot_hint = *(uint32_t *)&chars_buffer[offset]; // 字频布局：热区字节数
             offset += 4; // 跳过 cached_bitmap 字段
 
             g_bin_font.index.push_back(idx);
@@ -1830,6 +2105,7 @@ bool load_bin_font(const char *path)
         Serial.printf("[FONT_LOAD] ✅ 流式模式已启用，字体文件保持打开状态\n");
         Serial.printf("[FONT_LOAD] 字体文件: %s, 大小: %u 字节\n", real_path, g_bin_font.fontFile.size());
 #endif
+        pin_font_hot_prefix();
     }
     else
     {
@@ -1903,9 +2179,6 @@ bool load_bin_font(const char *path)
     {
         buildCommonCharCache();
 
-        // 初始化通用回收池（空池）
-        initCommonRecyclePool();
-
         // 如果有当前打开的书籍，初始化其5页字体缓存
         if (g_current_book)
         {
@@ -2042,18 +2315,26 @@ bool load_bin_font(const char *path)
 
 void unload_bin_font()
 {
+    // 与 load_bin_font 相同：先等预取批次退出，再拆除它会用到的字体数据
+    ++g_font_load_epoch;
+    g_glyph_fetch.cancel();
+
     // 清理PSRAM缓存
     g_font_header_cache.cleanup();
     g_glyph_read_window.cleanup(); // 清理字形预读窗口
+    g_font_hot_prefix.cleanup();
+    g_font_layout_flags = 0;
+    g_font_hot_hint = 0;
 
     // 清理页面字体缓冲区
     g_font_buffer_manager.clearAll();
 
-    // 清理通用/书名/TOC/回收池缓存，防止残留旧字形位图
+    // 清理通用/书名/TOC缓存，并释放字形图集，防止残留旧字形位图
     g_common_char_cache.clear();
     clearBookNameCache();
     clearTocCache();
-    clearCommonRecyclePool();
+    g_glyph_atlas.reset();
+    g_font_subset.detach();
 
     // 清理任务局部临时 glyph 缓存
     if (g_temp_glyph_mutex)
@@ -2144,6 +2425,16 @@ SemaphoreHandle_t bin_font_get_file_mutex()
     return g_font_file_mutex;
 }
 
+uint32_t bin_font_get_load_epoch()
+{
+    return g_font_load_epoch;
+}
+
+bool bin_font_is_stream_mode()
+{
+    return g_font_stream_mode;
+}
+
 #include "text/line_handle.h"
 
 void bin_font_set_cursor(int16_t x, int16_t y)
@@ -2530,6 +2821,8 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
         const uint8_t *text_end = utf8 + display_text.length();
 
         int16_t column_start_y = effective_margin_top; // 记录当前列的开始y位置
+        // 同一列的字符基于统一的X基准线对齐（类似横排基于Y基线），只在换列时重算
+        int16_t column_baseline_x = x - (int16_t)(g_bin_font.font_size * scale_factor);
 
         while (utf8 < text_end)
         {
@@ -2563,6 +2856,7 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                 }
 
                 x -= column_spacing;                   // 向左移一列
+                column_baseline_x = x - (int16_t)(g_bin_font.font_size * scale_factor);
                 y = effective_margin_top;              // 重置到顶部
                 column_start_y = effective_margin_top; // 重置列开始位置
                 continue;
@@ -2586,10 +2880,30 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
             // 不要在渲染阶段再次判断换列！
             // read_text_page 已经处理了正确的断行，我们只需要按照换行符来换列
 
+            // 标点与西文旋转 90°；位置只取决于列基准线与字形自身，先算好供各绘制路径共用
+            bool is_rotated_punct = is_chinese_punctuation(unicode);
+            uint8_t variant = is_rotated_punct ? (uint8_t)(GlyphVariantCache::ROTATE_CW |
+                                                           (needs_horizontal_flip(unicode) ? GlyphVariantCache::FLIP_H : 0))
+                                               : 0;
+            int16_t glyph_x = 0, glyph_y = 0;
+            vertical_glyph_origin(*glyph, unicode, is_rotated_punct, column_baseline_x, scale_factor, y, &glyph_x, &glyph_y);
+
+            // 无缩放直接写画布：旋转变体已缓存时不再读取和解码
+            bool direct = target_canvas && scale_factor == 1.0f && glyph_blit_canvas_ready(target_canvas);
+            bool drawn_packed = false;
+            CoverageBlitStyle packed_style;
+            if (direct)
+            {
+                M5.Display.setColorDepth(fast_mode ? TEXT_COLORDEPTH : TEXT_COLORDEPTH_HIGH);
+                coverage_style(packed_style, !fast_mode, dark, text_color);
+                if (variant)
+                    drawn_packed = g_glyph_variants.blit((uint16_t)unicode, variant, target_canvas, glyph_x, glyph_y, packed_style);
+            }
+
             // 渲染字符（简化版本，类似于水平模式的逻辑）
             // 使用任务局部内存池（避免并发访问冲突）
             MemoryPool *task_pool = MemoryPool::get_task_pool();
-            uint8_t *raw_data = task_pool->get_raw_buffer(glyph->bitmap_size);
+            uint8_t *raw_data = drawn_packed ? nullptr : task_pool->get_raw_buffer(glyph->bitmap_size);
             uint16_t *char_bitmap = nullptr;
             bool bitmap_loaded = false;
             if (raw_data)
@@ -2597,10 +2911,8 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                 // 优先从缓存加载（仅SD卡字体）
                 if (!g_using_progmem_font && g_font_buffer_manager.isInitialized())
                 {
-                    const uint8_t *cached_bitmap = g_font_buffer_manager.getCharBitmap((uint16_t)unicode);
-                    if (cached_bitmap)
+                    if (g_font_buffer_manager.copyCharBitmap((uint16_t)unicode, raw_data, glyph->bitmap_size))
                     {
-                        memcpy(raw_data, cached_bitmap, glyph->bitmap_size);
                         bitmap_loaded = true;
                         cache_hits++;
 #if DBG_BIN_FONT_PRINT
@@ -2632,7 +2944,16 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                     bitmap_loaded = load_glyph_bitmap_smart(glyph->bitmap_offset, raw_data, glyph->bitmap_size);
                 }
 
-                char_bitmap = g_memory_pool.get_bitmap_buffer(glyph->bitmapW * glyph->bitmapH);
+                // 无缩放：解码为覆盖度直接写入画布；旋转的字形先放入变体缓存，下次出现直接命中
+                if (direct && bitmap_loaded)
+                {
+                    drawn_packed = variant ? draw_glyph_variant(target_canvas, glyph_x, glyph_y, raw_data, *glyph,
+                                                                (uint16_t)unicode, variant, packed_style)
+                                           : draw_glyph_packed(target_canvas, glyph_x, glyph_y, raw_data, *glyph,
+                                                               !fast_mode, dark, text_color);
+                }
+
+                char_bitmap = drawn_packed ? nullptr : g_memory_pool.get_bitmap_buffer(glyph->bitmapW * glyph->bitmapH);
                 if (char_bitmap && bitmap_loaded)
                 {
                     // 根据字体版本和格式选择解码器
@@ -2698,7 +3019,6 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                 // 竖排模式下，标点符号旋转后需要交换宽高
                 int16_t render_width = glyph->bitmapW;
                 int16_t render_height = glyph->bitmapH;
-                bool is_rotated_punct = is_chinese_punctuation(unicode);
                 if (is_rotated_punct)
                 {
                     // 旋转后宽高互换
@@ -2709,55 +3029,16 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                 // 垂直模式下的字符渲染 - 确保同一列的字符在X轴上对齐
                 int16_t scaled_width = (int16_t)(render_width * scale_factor);
                 int16_t scaled_height = (int16_t)(render_height * scale_factor);
-                (void)scaled_width;
-                (void)scaled_height;
-                (void)scaled_width;
-                (void)scaled_height;
-
-                // 关键修正：在竖排模式下，同一列的所有字符应该基于统一的X基准线对齐
-                // 类似于横排模式下基于Y基线对齐的原理
-                int16_t column_baseline_x = x - (int16_t)(g_bin_font.font_size * scale_factor); // 统一的列基准线
-
-                // 基于列基准线和字符的水平对齐偏移来计算最终X坐标
-                // 这样确保同一列的字符在X轴上对齐
-                int16_t char_offset_x = (int16_t)(glyph->x_offset * scale_factor);
-                int16_t canvas_x = column_baseline_x + char_offset_x; // 基于统一基准线对齐
 
-                // 标点符号旋转后需要居中对齐：原来的Y轴中心变成新的X轴中心
-                if (is_rotated_punct)
-                {
-                    // 原始字符的Y轴中心位置（相对于bitmapH）
-                    int16_t orig_center_y = glyph->bitmapH / 2;
-                    // 字体框的X轴中心位置
-                    int16_t font_center_x = (int16_t)(g_bin_font.font_size * scale_factor) / 2;
-                    // 旋转后，原Y中心变成新X中心，调整offset让它对齐字体框中心
-                    int16_t center_offset = font_center_x - (int16_t)(orig_center_y * scale_factor);
-                    canvas_x = column_baseline_x + center_offset;
-                }
-
-                if (needs_minor_shift(unicode))
-                {
-                    // 标点符号向左调整20%的字体大小
-//                    float shift_f = g_bin_font.font_size * scale_factor * 0.2f;
-                    float shift_f = g_bin_font.font_size * scale_factor * 0.25f;
-                    int16_t shift_px = static_cast<int16_t>(std::lround(shift_f));
-                    if (shift_px == 0 && g_bin_font.font_size > 0)
-                    {
-                        shift_px = 1;
-                    }
-                    canvas_x += shift_px;
-                }
-
-                // Y坐标不应该包含y_offset，因为y_offset是用于微调字符基线的
-                // 在竖排模式下，我们只需要简单的从上到下排列
-                // 重要：在竖排模式下，y是在逻辑坐标系中的值，需要应用margin_top偏移
-                int16_t canvas_y = y; // 补偿坐标转换差异
+                // 位置已在读取位图前按列基准线算好（vertical_glyph_origin）
+                int16_t canvas_x = glyph_x;
+                int16_t canvas_y = glyph_y;
 
 #if DBG_BIN_FONT_PRINT
                 if (unicode >= 0x4E00 && unicode <= 0x9FFF)
                 { // 仅对中文字符打印调试信息
-                    Serial.printf("[VERTICAL_ALIGN] 字符U+%04X: x=%d, baseline_x=%d, char_offset_x=%d, canvas_x=%d, y=%d, canvas_y=%d, margin_top=%d, margin_left=%d\n",
-                                  unicode, x, column_baseline_x, char_offset_x, canvas_x, y, canvas_y, margin_top, margin_left);
+                    Serial.printf("[VERTICAL_ALIGN] 字符U+%04X: x=%d, baseline_x=%d, canvas_x=%d, y=%d, canvas_y=%d, margin_top=%d, margin_left=%d\n",
+                                  unicode, x, column_baseline_x, canvas_x, y, canvas_y, margin_top, margin_left);
                 }
 #endif
 
@@ -2767,30 +3048,34 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                     M5.Display.setColorDepth(TEXT_COLORDEPTH);
                     if (scale_factor == 1.0f)
                     {
-                        // 无缩放：直接使用pushImage
-                        size_t pixels = (size_t)render_width * (size_t)render_height;
-
-                        if (g_bin_font.version == 3)
-                        {
-                            // V3字体：解码后已经是正确的颜色（包括灰度），直接渲染
-                            target_canvas->pushImage(canvas_x, canvas_y, render_width, render_height, char_bitmap);
-                        }
-                        else
+                        // 直接写入画布缓冲区（4/8bpp）；画布深度不支持时走原来的逐像素/pushImage 路径
+                        if (!blit_glyph(target_canvas, canvas_x, canvas_y, char_bitmap, render_width, render_height, false, dark, text_color))
                         {
-                            // V2字体：需要根据前景/背景转换颜色
-                            // ⚠️ 修复：不能复用内存池！char_bitmap 还在使用中！
-                            uint16_t *rgb_buf = new uint16_t[pixels];
-                            if (rgb_buf)
+                            // 无缩放：直接使用pushImage
+                            size_t pixels = (size_t)render_width * (size_t)render_height;
+
+                            if (g_bin_font.version == 3)
                             {
-                                // 填充RGB565缓冲
-                                for (size_t i = 0; i < pixels; ++i)
+                                // V3字体：解码后已经是正确的颜色（包括灰度），直接渲染
+                                target_canvas->pushImage(canvas_x, canvas_y, render_width, render_height, char_bitmap);
+                            }
+                            else
+                            {
+                                // V2字体：需要根据前景/背景转换颜色
+                                // ⚠️ 修复：不能复用内存池！char_bitmap 还在使用中！
+                                uint16_t *rgb_buf = new uint16_t[pixels];
+                                if (rgb_buf)
                                 {
-                                    uint16_t p = char_bitmap[i];
-                                    rgb_buf[i] = (p != 0xFFFF) ? text_color : dark ? 0x0000
-                                                                                   : 0xFFFF;
+                                    // 填充RGB565缓冲
+                                    for (size_t i = 0; i < pixels; ++i)
+                                    {
+                                        uint16_t p = char_bitmap[i];
+                                        rgb_buf[i] = (p != 0xFFFF) ? text_color : dark ? 0x0000
+                                                                                       : 0xFFFF;
+                                    }
+                                    target_canvas->pushImage(canvas_x, canvas_y, render_width, render_height, rgb_buf);
+                                    delete[] rgb_buf;
                                 }
-                                target_canvas->pushImage(canvas_x, canvas_y, render_width, render_height, rgb_buf);
-                                delete[] rgb_buf;
                             }
                         }
                     }
@@ -2834,28 +3119,32 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                     // 质量模式：需要正确处理缩放
                     if (scale_factor == 1.0f)
                     {
-                        // 无缩放：使用原始尺寸
-                        for (int16_t py = 0; py < render_height; py++)
+                        // 直接写入画布缓冲区（4/8bpp）；画布深度不支持时走原来的逐像素/pushImage 路径
+                        if (!blit_glyph(target_canvas, canvas_x, canvas_y, char_bitmap, render_width, render_height, true, dark, text_color))
                         {
-                            for (int16_t px = 0; px < render_width; px++)
+                            // 无缩放：使用原始尺寸
+                            for (int16_t py = 0; py < render_height; py++)
                             {
-                                uint16_t pixel = char_bitmap[py * render_width + px];
-
-                                if (g_bin_font.version == 3)
+                                for (int16_t px = 0; px < render_width; px++)
                                 {
-                                    // V3字体：直接使用解码后的颜色
-                                    uint16_t bg_color = FontColorMapper::get_background_color(dark);
-                                    if (pixel != bg_color)
+                                    uint16_t pixel = char_bitmap[py * render_width + px];
+
+                                    if (g_bin_font.version == 3)
                                     {
-                                        target_canvas->drawPixel(canvas_x + px, canvas_y + py, pixel);
+                                        // V3字体：直接使用解码后的颜色
+                                        uint16_t bg_color = FontColorMapper::get_background_color(dark);
+                                        if (pixel != bg_color)
+                                        {
+                                            target_canvas->drawPixel(canvas_x + px, canvas_y + py, pixel);
+                                        }
                                     }
-                                }
-                                else
-                                {
-                                    // V2字体
-                                    if (pixel != 0xFFFF)
+                                    else
                                     {
-                                        target_canvas->drawPixel(canvas_x + px, canvas_y + py, text_color);
+                                        // V2字体
+                                        if (pixel != 0xFFFF)
+                                        {
+                                            target_canvas->drawPixel(canvas_x + px, canvas_y + py, text_color);
+                                        }
                                     }
                                 }
                             }
@@ -3041,15 +3330,14 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
             uint8_t *raw_data = task_pool->get_raw_buffer(glyph->bitmap_size);
             uint16_t *char_bitmap = nullptr;
             bool bitmap_loaded = false;
+            bool drawn_packed = false;
             if (raw_data)
             {
                 // 优先从缓存加载（仅SD卡字体）
                 if (!g_using_progmem_font && g_font_buffer_manager.isInitialized())
                 {
-                    const uint8_t *cached_bitmap = g_font_buffer_manager.getCharBitmap((uint16_t)unicode);
-                    if (cached_bitmap)
+                    if (g_font_buffer_manager.copyCharBitmap((uint16_t)unicode, raw_data, glyph->bitmap_size))
                     {
-                        memcpy(raw_data, cached_bitmap, glyph->bitmap_size);
                         bitmap_loaded = true;
                         cache_hits++;
 #if DBG_BIN_FONT_PRINT
@@ -3081,7 +3369,15 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                     bitmap_loaded = load_glyph_bitmap_smart(glyph->bitmap_offset, raw_data, glyph->bitmap_size);
                 }
 
-                char_bitmap = g_memory_pool.get_bitmap_buffer(glyph->bitmapW * glyph->bitmapH);
+                // 无缩放：直接解码为 4bpp 覆盖度写入画布，不经 RGB565 中间位图
+                if (bitmap_loaded && target_canvas && scale_factor == 1.0f)
+                {
+                    M5.Display.setColorDepth(fast_mode ? TEXT_COLORDEPTH : TEXT_COLORDEPTH_HIGH);
+                    drawn_packed = draw_glyph_packed(target_canvas, x + glyph->x_offset, y + glyph->y_offset, raw_data,
+                                                     *glyph, !fast_mode, dark, text_color);
+                }
+
+                char_bitmap = drawn_packed ? nullptr : g_memory_pool.get_bitmap_buffer(glyph->bitmapW * glyph->bitmapH);
                 if (char_bitmap && bitmap_loaded)
                 {
                     // 根据字体版本和格式选择解码器
@@ -3138,62 +3434,66 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
 
                     if (scale_factor == 1.0f)
                     {
-                        // 无缩放：使用原始的高性能路径
-                        size_t pixels = (size_t)glyph->bitmapW * (size_t)glyph->bitmapH;
-
-                        if (g_bin_font.version == 3)
-                        {
-                            // V3字体：解码后已经是正确的颜色，直接渲染
-                            target_canvas->pushImage(canvas_x, canvas_y, glyph->bitmapW, glyph->bitmapH, char_bitmap);
-                        }
-                        else
+                        // 直接写入画布缓冲区（4/8bpp）；画布深度不支持时走原来的逐像素/pushImage 路径
+                        if (!blit_glyph(target_canvas, canvas_x, canvas_y, char_bitmap, glyph->bitmapW, glyph->bitmapH, false, dark, text_color))
                         {
-                            // V2字体：需要转换颜色
-                            uint16_t *rgb_buf = nullptr;
+                            // 无缩放：使用原始的高性能路径
+                            size_t pixels = (size_t)glyph->bitmapW * (size_t)glyph->bitmapH;
 
-                            // ⚠️ 修复：不能复用内存池！char_bitmap 还在使用中！
-                            // 直接使用 heap_caps_malloc 或 new
-                            rgb_buf = (uint16_t *)heap_caps_malloc(pixels * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
-                            if (!rgb_buf)
+                            if (g_bin_font.version == 3)
                             {
-                                // PSRAM 分配失败，尝试内部 SRAM
-                                rgb_buf = new uint16_t[pixels];
+                                // V3字体：解码后已经是正确的颜色，直接渲染
+                                target_canvas->pushImage(canvas_x, canvas_y, glyph->bitmapW, glyph->bitmapH, char_bitmap);
                             }
-
-                            if (rgb_buf)
+                            else
                             {
-                                // 填充 RGB565 缓冲：使用指定颜色或白色
-                                for (size_t i = 0; i < pixels; ++i)
+                                // V2字体：需要转换颜色
+                                uint16_t *rgb_buf = nullptr;
+
+                                // ⚠️ 修复：不能复用内存池！char_bitmap 还在使用中！
+                                // 直接使用 heap_caps_malloc 或 new
+                                rgb_buf = (uint16_t *)heap_caps_malloc(pixels * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+                                if (!rgb_buf)
                                 {
-                                    uint16_t p = char_bitmap[i];
-                                    rgb_buf[i] = (p != 0xFFFF) ? text_color : dark ? 0x0000
-                                                                                   : 0xFFFF;
+                                    // PSRAM 分配失败，尝试内部 SRAM
+                                    rgb_buf = new uint16_t[pixels];
                                 }
 
-                                // 一次性推送到 Canvas
-                                target_canvas->pushImage(canvas_x, canvas_y, glyph->bitmapW, glyph->bitmapH, rgb_buf);
-
-                                // 释放缓冲
-                                if (esp_ptr_external_ram(rgb_buf))
+                                if (rgb_buf)
                                 {
-                                    heap_caps_free(rgb_buf);
+                                    // 填充 RGB565 缓冲：使用指定颜色或白色
+                                    for (size_t i = 0; i < pixels; ++i)
+                                    {
+                                        uint16_t p = char_bitmap[i];
+                                        rgb_buf[i] = (p != 0xFFFF) ? text_color : dark ? 0x0000
+                                                                                       : 0xFFFF;
+                                    }
+
+                                    // 一次性推送到 Canvas
+                                    target_canvas->pushImage(canvas_x, canvas_y, glyph->bitmapW, glyph->bitmapH, rgb_buf);
+
+                                    // 释放缓冲
+                                    if (esp_ptr_external_ram(rgb_buf))
+                                    {
+                                        heap_caps_free(rgb_buf);
+                                    }
+                                    else
+                                    {
+                                        delete[] rgb_buf;
+                                    }
                                 }
                                 else
                                 {
-                                    delete[] rgb_buf;
-                                }
-                            }
-                            else
-                            {
-                                // 分配失败：回退到逐像素绘制以保证稳健性
-                                for (int16_t py = 0; py < glyph->bitmapH; py++)
-                                {
-                                    for (int16_t px = 0; px < glyph->bitmapW; px++)
+                                    // 分配失败：回退到逐像素绘制以保证稳健性
+                                    for (int16_t py = 0; py < glyph->bitmapH; py++)
                                     {
-                                        uint16_t pixel = char_bitmap[py * glyph->bitmapW + px];
-                                        if (pixel != 0xFFFF)
+                                        for (int16_t px = 0; px < glyph->bitmapW; px++)
                                         {
-                                            target_canvas->drawPixel(canvas_x + px, canvas_y + py, text_color);
+                                            uint16_t pixel = char_bitmap[py * glyph->bitmapW + px];
+                                            if (pixel != 0xFFFF)
+                                            {
+                                                target_canvas->drawPixel(canvas_x + px, canvas_y + py, text_color);
+                                            }
                                         }
                                     }
                                 }
@@ -3374,28 +3674,32 @@ void bin_font_print(const std::string &text, uint8_t font_size, uint8_t color, i
                     // 黑白二值化渲染：使用准确的灰度计算和门限判断
                     if (scale_factor == 1.0f)
                     {
-                        // 无缩放
-                        for (int16_t py = 0; py < glyph->bitmapH; py++)
+                        // 直接写入画布缓冲区（4/8bpp）；画布深度不支持时走原来的逐像素/pushImage 路径
+                        if (!blit_glyph(target_canvas, canvas_x, canvas_y, char_bitmap, glyph->bitmapW, glyph->bitmapH, true, dark, text_color))
                         {
-                            for (int16_t px = 0; px < glyph->bitmapW; px++)
+                            // 无缩放
+                            for (int16_t py = 0; py < glyph->bitmapH; py++)
                             {
-                                uint16_t pixel = char_bitmap[py * glyph->bitmapW + px];
-
-                                if (g_bin_font.version == 3)
+                                for (int16_t px = 0; px < glyph->bitmapW; px++)
                                 {
-                                    // V3字体：直接使用解码后的颜色（包括灰度）
-                                    uint16_t bg_color = FontColorMapper::get_background_color(dark);
-                                    if (pixel != bg_color)
+                                    uint16_t pixel = char_bitmap[py * glyph->bitmapW + px];
+
+                                    if (g_bin_font.version == 3)
                                     {
-                                        target_canvas->drawPixel(canvas_x + px, canvas_y + py, pixel);
+                                        // V3字体：直接使用解码后的颜色（包括灰度）
+                                        uint16_t bg_color = FontColorMapper::get_background_color(dark);
+                                        if (pixel != bg_color)
+                                        {
+                                            target_canvas->drawPixel(canvas_x + px, canvas_y + py, pixel);
+                                        }
                                     }
-                                }
-                                else
-                                {
-                                    // V2字体：二值化处理
-                                    if (pixel != 0xFFFF)
+                                    else
                                     {
-                                        target_canvas->drawPixel(canvas_x + px, canvas_y + py, text_color);
+                                        // V2字体：二值化处理
+                                        if (pixel != 0xFFFF)
+                                        {
+                                            target_canvas->drawPixel(canvas_x + px, canvas_y + py, text_color);
+                                        }
                                     }
                                 }
                             }
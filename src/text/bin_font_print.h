@@ -52,6 +52,10 @@ enum FontFormat {
     FONT_FORMAT_1BIT = 2      // generate_1bit_font_bin.py (1bit打包)
 };
 
+// 头部第 133 字节（样式名结尾 NUL）的布局标志
+// FREQUENCY：位图按语料字频降序排列（字符表仍按码点排序），U+0000 条目的保留字段为热区字节数
+#define FONT_LAYOUT_FLAG_FREQUENCY 0x01
+
 // 文本对齐方式枚举
 enum TextAlign {
     TEXT_ALIGN_LEFT = 0,    // 左对齐
@@ -65,6 +69,15 @@ bool load_bin_font(const char* path);
 // 卸载 bin font
 void unload_bin_font();
 
+// 字体加载/卸载次数（每次 load/unload 加一），供依赖当前字体的缓存判断是否过期
+uint32_t bin_font_get_load_epoch();
+
+// 当前字体是否为流式读取（按字形读 SD/PROGMEM，而非整体载入 PSRAM）
+bool bin_font_is_stream_mode();
+
+// 从字频排列字体的 PSRAM 热区读取位图（offset 为字体文件偏移）；不在热区内返回 false
+bool bin_font_read_hot(uint32_t offset, uint8_t *dest, uint32_t size);
+
 // 获取当前加载的字体名称
 const char* get_current_font_name();
 
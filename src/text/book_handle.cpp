@@ -23,8 +23,11 @@
 #include "device/safe_fs.h"
 // tag handling (auto/manual tags)
 #include "text/tags_handle.h"
+#include "text/lz_book.h"
+#include "text/text_paginate.h"
 // font buffer for page caching
 #include "text/font_buffer.h"
+#include "text/font_subset.h"
 #ifdef ESP_PLATFORM
 #include "esp_heap_caps.h"
 #endif
@@ -160,6 +163,11 @@ static std::string page_filename_for(const std::string &book_file_path)
     return std::string("/bookmarks/") + make_sanitized_base(book_file_path) + ".page";
 }
 
+static std::string page_glyph_filename_for(const std::string &book_file_path)
+{
+    return std::string("/bookmarks/") + make_sanitized_base(book_file_path) + ".pgg";
+}
+
 static std::string progress_filename_for(const std::string &book_file_path)
 {
     return std::string("/bookmarks/") + make_sanitized_base(book_file_path) + ".progress";
@@ -170,6 +178,16 @@ static std::string complete_filename_for(const std::string &book_file_path)
     return std::string("/bookmarks/") + make_sanitized_base(book_file_path) + ".complete";
 }
 
+// 页起点表在 PSRAM 不足时使用的溢出文件（BookHandle 析构时删除）。
+// 重新打开同一本书时新旧对象会短暂并存，因此按实例轮换文件名而不是按书名；
+// 异常断电残留的文件数量也因此有上限，下次使用时以 "w" 覆盖。
+static std::string next_page_spill_filename()
+{
+    static uint8_t seq = 0;
+    seq = (uint8_t)((seq + 1) % 4);
+    return std::string("/bookmarks/_page_spill_") + char('0' + seq) + ".pgs";
+}
+
 // Forward declaration for helper defined later in this file
 static bool page_file_valid_for(const std::string &book_file_path);
 
@@ -194,6 +212,7 @@ void removeIndexFilesForBookForPath(const std::string &book_file_path)
     std::string progress_file = std::string("/bookmarks/") + safe + ".progress";
     std::string complete_file = std::string("/bookmarks/") + safe + ".complete";
     std::string rec_file = std::string("/bookmarks/") + safe + ".rec";
+    std::string glyph_file = std::string("/bookmarks/") + safe + ".pgg";
 
     // Only remove the explicit index-related artifacts. Avoid sweeping /bookmarks
     // to prevent accidental deletion of unrelated user files (e.g. .bm or .tags).
@@ -210,6 +229,7 @@ void removeIndexFilesForBookForPath(const std::string &book_file_path)
     try_remove_if_exists(progress_file);
     try_remove_if_exists(complete_file);
     try_remove_if_exists(rec_file);
+    try_remove_if_exists(glyph_file);
 
     // also remove tmp variants created by SafeFS (if any)
     try_remove_if_exists(SafeFS::tmpPathFor(page_file));
@@ -249,6 +269,9 @@ BookHandle::BookHandle(const std::string &path, std::int16_t area_w_, std::int16
         return;
     }
 
+    page_positions.setSpillPath(next_page_spill_filename());
+    page_glyphs_.reset(page_glyph_filename_for(file_path));
+
     if (!open())
     {
 #if DBG_BOOK_HANDLE
@@ -275,7 +298,7 @@ BookHandle::BookHandle(const std::string &path, std::int16_t area_w_, std::int16
     {
         if (current_page_index >= page_positions.size())
             current_page_index = 0;
-        cur_pos = page_positions[current_page_index];
+        cur_pos = pageStart(current_page_index);
         last_page.success = false; // force reload on first render
 #if DBG_BOOK_HANDLE
         Serial.printf("[BH] BookHandle ctor: 无书签，同步 cur_pos -> %zu (index=%zu, total=%zu)\n",
@@ -353,7 +376,8 @@ bool BookHandle::open()
         // expected format: /sd/...
         if (p.rfind("/sd", 0) == 0)
             p = p.substr(3);
-        file_handle = SDW::SD.open(p.c_str(), "r");
+        // .txt.lz 压缩书在这里换成解压视图，之后的分页与渲染都按原文偏移
+        file_handle = lz_book_open(p.c_str());
     }
 
     if (!file_handle)
@@ -403,6 +427,15 @@ bool BookHandle::open()
     std::string complete_marker = getCompleteFileName();
     if (SDW::SD.exists(complete_marker.c_str()))
     {
+        // tools/preindex 生成的索引带设置指纹：上传后字体、竖排等设置变过就不再采用，删掉后在设备上重建
+        std::string built = readCompleteFingerprint(complete_marker);
+        if (!built.empty() && built != paginateFingerprintForBook(file_path))
+        {
+#if DBG_BOOK_HANDLE
+            Serial.printf("[BH:open] pre-index settings differ, reindexing: %s\n", built.c_str());
+#endif
+            removeIndexFilesForBookForPath(file_path);
+        }
         std::string progress_file = getProgressFileName();
         if (SDW::SD.exists(progress_file.c_str()))
         {
@@ -517,6 +550,9 @@ void BookHandle::close()
 {
     // 清理字体缓存
     g_font_buffer_manager.clearAll();
+    // 释放页面排版缓存
+    page_layouts_.clear();
+    current_layout_.reset();
 
     // 清理TOC字体缓存
     clearTocCache();
@@ -532,7 +568,7 @@ void BookHandle::close()
     clearIdxPSRAM();
 }
 
-// Load .idx positions into memory (best-effort into PSRAM). Returns true if any positions loaded.
+// Load .idx positions into idx_positions_ (PagePositionStore, block data in PSRAM). Returns true if any positions loaded.
 bool BookHandle::loadIdxToPSRAM()
 {
     if (!is_indexed_)
@@ -568,8 +604,7 @@ bool BookHandle::loadIdxToPSRAM()
     if (!idxf)
         return false;
 
-    std::vector<size_t> tmp;
-    std::vector<std::string> tmp_titles;
+    clearIdxPSRAM();
     auto trim_fn = [](std::string &s)
     {
         size_t a = 0;
@@ -616,8 +651,8 @@ bool BookHandle::loadIdxToPSRAM()
                 unsigned long long val = strtoull(cstr, &endptr, 10);
                 if (endptr != cstr)
                 {
-                    tmp.push_back((size_t)val);
-                    tmp_titles.push_back(title_str);
+                    idx_positions_.push_back((size_t)val);
+                    idx_titles_.push_back(title_str);
                 }
             }
             continue;
@@ -643,63 +678,19 @@ bool BookHandle::loadIdxToPSRAM()
         unsigned long long val = strtoull(cstr, &endptr, 10);
         if (endptr == cstr)
             continue;
-        tmp.push_back((size_t)val);
-        tmp_titles.push_back(title_field);
+        idx_positions_.push_back((size_t)val);
+        idx_titles_.push_back(title_field);
     }
     idxf.close();
 
-    if (tmp.empty())
-        return false;
-
-    // store into vector cache
-    idx_positions_psram_ = tmp;
-    idx_titles_psram_ = tmp_titles;
-
-#ifdef ESP_PLATFORM
-    // Try to allocate PSRAM-backed raw buffer (best-effort). If fails, keep vector only.
-    size_t bytes = tmp.size() * sizeof(size_t);
-    void *ptr = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (ptr)
-    {
-        memcpy(ptr, tmp.data(), bytes);
-        idx_positions_psram_ptr = (size_t *)ptr;
-        idx_positions_psram_count = tmp.size();
-        idx_psram_loaded_ = true;
-    }
-    else
-    {
-        // allocation failed; keep vector in normal heap
-        idx_positions_psram_ptr = nullptr;
-        idx_positions_psram_count = idx_positions_psram_.size();
-        idx_psram_loaded_ = false;
-    }
-#else
-    idx_positions_psram_ptr = nullptr;
-    idx_positions_psram_count = idx_positions_psram_.size();
-    idx_psram_loaded_ = false;
-#endif
-
-    return true;
+    return !idx_positions_.empty();
 }
 
 void BookHandle::clearIdxPSRAM()
 {
-    // free raw PSRAM buffer if allocated
-#ifdef ESP_PLATFORM
-    if (idx_positions_psram_ptr)
-    {
-        heap_caps_free(idx_positions_psram_ptr);
-        idx_positions_psram_ptr = nullptr;
-    }
-#else
-    (void)idx_positions_psram_ptr;
-#endif
-    idx_positions_psram_count = 0;
-    idx_psram_loaded_ = false;
-    // clear in-heap vector
-    idx_positions_psram_.clear();
-    idx_titles_psram_.clear();
-    idx_positions_psram_.shrink_to_fit();
+    idx_positions_.clear();
+    idx_titles_.clear();
+    idx_titles_.shrink_to_fit();
 }
 
 // 标记对象正在被关闭，供后台索引器安全退出
@@ -745,13 +736,8 @@ std::string BookHandle::getBookName() const
         filename = file_path; // 如果没有斜杠，使用整个路径
     }
 
-    // 去掉扩展名
-    size_t last_dot = filename.find_last_of('.');
-    if (last_dot != std::string::npos && last_dot > 0)
-    {
-        return filename.substr(0, last_dot);
-    }
-    return filename;
+    // 去掉扩展名（压缩存放的 .txt.lz 整个去掉）
+    return book_name_stem(filename);
 }
 
 bool BookHandle::isOpen() const { return (bool)file_handle; }
@@ -776,7 +762,7 @@ size_t BookHandle::getFileSize() const
     if (path.substr(0, 3) == "/sd")
     {
         path = path.substr(3); // 移除 /sd 前缀
-        temp_file = SDW::SD.open(path.c_str(), "r");
+        temp_file = lz_book_open(path.c_str());
     }
     if (path.substr(0, 7) == "/spiffs")
     {
@@ -857,7 +843,9 @@ TextPageResult BookHandle::nextPage()
     size_t desired_index = current_page_index + 1;
     size_t next_pos = 0;
     if (desired_index < page_positions.size())
-        next_pos = page_positions[desired_index];
+        next_pos = pageStart(desired_index);
+    if (next_pos == PagePositionStore::npos)
+        next_pos = 0; // 读不出页起点：按无效项处理，下面同步排版
 
     // If the next_pos is not greater than current cur_pos, it may be a stale/zero entry
     if (next_pos <= cur_pos)
@@ -874,7 +862,9 @@ TextPageResult BookHandle::nextPage()
                 vTaskDelay(pdMS_TO_TICKS(5));
                 if (desired_index < page_positions.size())
                 {
-                    next_pos = page_positions[desired_index];
+                    next_pos = pageStart(desired_index);
+                    if (next_pos == PagePositionStore::npos)
+                        next_pos = 0;
                     if (next_pos > cur_pos)
                         break;
                 }
@@ -891,30 +881,26 @@ TextPageResult BookHandle::nextPage()
             res.success = false;
             return res;
         }
-        size_t saved_pos = saveCurrentPosition();
-        // 使用全局 font_size 确保字体切换后立即生效
-        extern float font_size;
         // Calculate boundary for reading (next page start if exists)
         size_t tmp_max_pos = SIZE_MAX;
         if (pages_loaded && desired_index < page_positions.size() && desired_index + 1 < page_positions.size())
         {
-            tmp_max_pos = page_positions[desired_index + 1];
+            tmp_max_pos = pageStart(desired_index + 1);
         }
-        TextPageResult tmp = read_text_page(file_handle, file_path, cur_pos, area_w, area_h, font_size, encoding, false, getVerticalText(), tmp_max_pos);
-        restorePosition(saved_pos);
+        std::shared_ptr<const PageLayout> tmp = layoutPageLocked(cur_pos, tmp_max_pos);
         releaseFileLock();
-        if (tmp.success && tmp.page_end_pos > cur_pos)
+        if (tmp && tmp->page_end_pos > cur_pos)
         {
-            next_pos = tmp.page_end_pos;
+            next_pos = tmp->page_end_pos;
             // 如果检测到了编码，同步更新
             if (encoding == TextEncoding::AUTO_DETECT && g_text_state.encoding != TextEncoding::AUTO_DETECT)
             {
                 encoding = g_text_state.encoding;
             }
-            // insert into page_positions at desired_index
-            if (desired_index <= page_positions.size())
+            // append at desired_index (drop any stale entries from there on; positions must stay ascending)
+            if (desired_index <= page_positions.size() && page_positions.truncate(desired_index))
             {
-                page_positions.insert(page_positions.begin() + desired_index, next_pos);
+                page_positions.push_back(next_pos);
                 // persist minimal index progress (best-effort)
                 savePageFile();
             }
@@ -957,33 +943,25 @@ TextPageResult BookHandle::nextPage()
         return res;
     }
 
-    // 保存当前文件位置
-    size_t saved_pos = saveCurrentPosition();
-
-    // 使用全局 font_size 确保字体切换后立即生效
-    extern float font_size;
-
     // Determine next page boundary to limit reading
     size_t max_byte_pos = SIZE_MAX;
     if (pages_loaded && current_page_index < page_positions.size())
     {
         if (current_page_index + 1 < page_positions.size())
         {
-            max_byte_pos = page_positions[current_page_index + 1];
+            max_byte_pos = pageStart(current_page_index + 1);
         }
     }
 
-    res = read_text_page(file_handle, file_path, cur_pos, area_w, area_h, font_size, encoding, false, getVerticalText(), max_byte_pos);
-
-    // 恢复文件位置（如果需要）
-    restorePosition(saved_pos);
+    // 窗口内的页在构建字体缓存时通常已排版过，这里直接复用
+    std::shared_ptr<const PageLayout> layout = layoutPageLocked(cur_pos, max_byte_pos);
 
     // 释放文件锁
     releaseFileLock();
-    if (res.success)
+    if (layout)
     {
-        last_page = res;
-        updateCurrentDigest(res.page_text);
+        setCurrentLayout(layout);
+        res = last_page;
 
         // 如果之前是 AUTO_DETECT，现在已检测出具体编码，同步到 BookHandle
         if (encoding == TextEncoding::AUTO_DETECT && g_text_state.encoding != TextEncoding::AUTO_DETECT)
@@ -998,7 +976,7 @@ TextPageResult BookHandle::nextPage()
         if (current_page_index + 1 < page_positions.size())
         {
             // 不是最后一页，检查是否读到了下一页的起始位置
-            page_completed = (res.page_end_pos >= page_positions[current_page_index + 1]);
+            page_completed = (res.page_end_pos >= pageStart(current_page_index + 1));
         }
         else
         {
@@ -1017,6 +995,7 @@ TextPageResult BookHandle::nextPage()
     }
     else
     {
+        res.success = false;
         // 读取失败，回退页面索引
         current_page_index--;
 #if DBG_BOOK_HANDLE
@@ -1086,8 +1065,14 @@ TextPageResult BookHandle::prevPage()
 
     // 移动到上一页
     size_t old_page_index = current_page_index;
+    size_t prev_pos = pageStart(current_page_index - 1);
+    if (prev_pos == PagePositionStore::npos)
+    {
+        res.success = false;
+        return res;
+    }
     current_page_index--;
-    cur_pos = page_positions[current_page_index];
+    cur_pos = prev_pos;
     page_completed = false; // 重新加载页面
 
 #if DBG_BOOK_HANDLE
@@ -1114,33 +1099,25 @@ TextPageResult BookHandle::prevPage()
         return res;
     }
 
-    // 保存当前文件位置
-    size_t saved_pos = saveCurrentPosition();
-
-    // 使用全局 font_size 确保字体切换后立即生效
-    extern float font_size;
-
     // Determine next page boundary to limit reading
     size_t max_byte_pos = SIZE_MAX;
     if (pages_loaded && current_page_index < page_positions.size())
     {
         if (current_page_index + 1 < page_positions.size())
         {
-            max_byte_pos = page_positions[current_page_index + 1];
+            max_byte_pos = pageStart(current_page_index + 1);
         }
     }
 
-    res = read_text_page(file_handle, file_path, cur_pos, area_w, area_h, font_size, encoding, false, getVerticalText(), max_byte_pos);
-
-    // 恢复文件位置（如果需要）
-    restorePosition(saved_pos);
+    // 窗口内的页在构建字体缓存时通常已排版过，这里直接复用
+    std::shared_ptr<const PageLayout> layout = layoutPageLocked(cur_pos, max_byte_pos);
 
     // 释放文件锁
     releaseFileLock();
-    if (res.success)
+    if (layout)
     {
-        last_page = res;
-        updateCurrentDigest(res.page_text);
+        setCurrentLayout(layout);
+        res = last_page;
 
         // 如果之前是 AUTO_DETECT，现在已检测出具体编码，同步到 BookHandle
         if (encoding == TextEncoding::AUTO_DETECT && g_text_state.encoding != TextEncoding::AUTO_DETECT)
@@ -1155,7 +1132,7 @@ TextPageResult BookHandle::prevPage()
         if (current_page_index + 1 < page_positions.size())
         {
             // 不是最后一页，检查是否读到了下一页的起始位置
-            page_completed = (res.page_end_pos >= page_positions[current_page_index + 1]);
+            page_completed = (res.page_end_pos >= pageStart(current_page_index + 1));
         }
         else
         {
@@ -1178,6 +1155,7 @@ TextPageResult BookHandle::prevPage()
     }
     else
     {
+        res.success = false;
         // 读取失败，回退页面索引
         current_page_index++;
 #if DBG_BOOK_HANDLE
@@ -1213,9 +1191,6 @@ TextPageResult BookHandle::currentPage()
         return res;
     }
 
-    // 保存当前文件位置
-    size_t saved_pos = saveCurrentPosition();
-
     // 使用全局 font_size 而非成员变量，确保切换字体后立即生效
     extern float font_size;
     // 同步更新成员变量，确保后续保存书签时使用正确的值
@@ -1234,24 +1209,22 @@ TextPageResult BookHandle::currentPage()
         // If there's a next page, use its start position as the boundary
         if (current_page_index + 1 < page_positions.size())
         {
-            max_byte_pos = page_positions[current_page_index + 1];
+            max_byte_pos = pageStart(current_page_index + 1);
 #if DBG_BOOK_HANDLE
             Serial.printf("[BH] currentPage: limit reading to next page start %zu\n", max_byte_pos);
 #endif
         }
     }
 
-    res = read_text_page(file_handle, file_path, cur_pos, area_w, area_h, font_size, encoding, false, getVerticalText(), max_byte_pos);
-
-    // 恢复文件位置（如果需要）
-    restorePosition(saved_pos);
+    std::shared_ptr<const PageLayout> layout = layoutPageLocked(cur_pos, max_byte_pos);
 
     // 释放文件锁
     releaseFileLock();
-    if (res.success)
+    res.success = false;
+    if (layout)
     {
-        last_page = res;
-        updateCurrentDigest(res.page_text);
+        setCurrentLayout(layout);
+        res = last_page;
 
         // 如果之前是 AUTO_DETECT，现在已检测出具体编码，同步到 BookHandle
         // 避免下次翻页时重复检测，节省时间
@@ -1302,9 +1275,13 @@ bool BookHandle::jumpToPage(size_t page_index)
         return false;
     }
 
-    // 跳转到指定页面
+    // 跳转到指定页面；随机跳转后把目标页附近的块预热进热窗口，随后的前后翻页不再解码
+    page_positions.warm(page_index);
+    size_t target_pos = pageStart(page_index);
+    if (target_pos == PagePositionStore::npos)
+        return false; // 页起点读不出来（重新加载后也不在表内），不跳到猜测的位置
     current_page_index = page_index;
-    cur_pos = page_positions[current_page_index];
+    cur_pos = target_pos;
 
     // 清除缓存的页面，强制重新读取
     last_page.success = false;
@@ -1365,11 +1342,12 @@ bool BookHandle::jumpToPage(size_t page_index)
     return true;
 }
 
-void BookHandle::updateCurrentDigest(const std::string &page_text)
+// 页摘要：跳过空行，取前 DIGEST_NUM 个字符（至多 3 行），保证以完整 UTF-8 字符结尾
+static std::string make_page_digest(const std::string &page_text)
 {
-    current_digest.clear();
+    std::string current_digest;
     if (page_text.empty())
-        return;
+        return current_digest;
 
     // skip leading whitespace (spaces, tabs, newlines, CR, etc.)
     size_t n = page_text.size();
@@ -1377,7 +1355,7 @@ void BookHandle::updateCurrentDigest(const std::string &page_text)
     while (pos < n && std::isspace((unsigned char)page_text[pos]))
         ++pos;
     if (pos >= n)
-        return;
+        return current_digest;
 
     // approximate byte limit for DIGEST_NUM codepoints
     size_t max_bytes = std::min((size_t)DIGEST_NUM * 3, n);
@@ -1489,6 +1467,7 @@ void BookHandle::updateCurrentDigest(const std::string &page_text)
             }
         }
     }
+    return current_digest;
 }
 
 size_t BookHandle::getCurrentPageCharCount() const
@@ -1496,10 +1475,102 @@ size_t BookHandle::getCurrentPageCharCount() const
     if (last_render_char_count_ > 0)
         return last_render_char_count_;
     if (last_page.success)
+    {
+        if (current_layout_ && current_layout_->file_pos == last_page.file_pos)
+            return current_layout_->readable_chars;
         return count_readable_codepoints(last_page.page_text);
+    }
     return 0;
 }
 
+void BookHandle::setCurrentLayout(const std::shared_ptr<const PageLayout> &layout)
+{
+    current_layout_ = layout;
+    last_page = layout->toResult();
+    current_digest = layout->digest;
+}
+
+std::shared_ptr<const PageLayout> BookHandle::layoutPageLocked(size_t start, size_t max_byte_pos)
+{
+    // 使用全局 font_size 确保字体切换后立即生效
+    extern float font_size;
+    PageLayoutKey key;
+    key.file_pos = start;
+    key.max_byte_pos = max_byte_pos;
+    key.font_size = font_size;
+    key.font_epoch = bin_font_get_load_epoch();
+    key.encoding = (uint8_t)encoding;
+    key.zh_conv_mode = getEffectiveZhConvMode();
+    key.vertical = getVerticalText();
+    std::shared_ptr<const PageLayout> hit = page_layouts_.find(key);
+    if (hit)
+        return hit;
+
+    size_t saved_pos = saveCurrentPosition();
+    TextPageResult res = read_text_page(file_handle, file_path, start, area_w, area_h, font_size, encoding, false, getVerticalText(), max_byte_pos);
+    restorePosition(saved_pos);
+    if (!res.success)
+        return nullptr;
+
+    // 如果之前是 AUTO_DETECT，现在已检测出具体编码：同步到 BookHandle，并按检测后的编码登记，
+    // 否则之后的查找（key 中已是具体编码）永远不会命中这一项
+    if (encoding == TextEncoding::AUTO_DETECT && g_text_state.encoding != TextEncoding::AUTO_DETECT)
+    {
+        encoding = g_text_state.encoding;
+        key.encoding = (uint8_t)encoding;
+    }
+
+    std::shared_ptr<PageLayout> layout = std::make_shared<PageLayout>();
+    layout->file_pos = res.file_pos;
+    layout->page_end_pos = res.page_end_pos;
+    layout->text = std::move(res.page_text);
+    page_layout_analyze(*layout);
+    layout->readable_chars = count_readable_codepoints(layout->text);
+    layout->digest = make_page_digest(layout->text);
+    page_layouts_.put(key, layout);
+    return layout;
+}
+
+std::shared_ptr<const PageLayout> BookHandle::getPageLayout(size_t page_index)
+{
+    if (!pages_loaded || page_index >= page_positions.size())
+        return nullptr;
+    size_t start = pageStart(page_index);
+    if (start == PagePositionStore::npos)
+        return nullptr;
+    size_t max_byte_pos = page_index + 1 < page_positions.size() ? pageStart(page_index + 1) : SIZE_MAX;
+    if (!acquireFileLock(pdMS_TO_TICKS(5000)))
+        return nullptr;
+    std::shared_ptr<const PageLayout> layout = layoutPageLocked(start, max_byte_pos);
+    releaseFileLock();
+    return layout;
+}
+
+bool BookHandle::getPageGlyphs(size_t page_index, std::vector<uint16_t, PSRAMAllocator<uint16_t>> &out)
+{
+    out.clear();
+    if (!pages_loaded || page_index >= page_positions.size())
+        return false;
+    if (!acquireFileLock(pdMS_TO_TICKS(5000)))
+        return false;
+    // 后台索引仍在追加时，.pgg 比 .page 少最后一页；页数没变就不必重复打开文件扫描
+    if (page_index >= page_glyphs_.size() && page_glyphs_scanned_total_ != page_positions.size())
+    {
+        page_glyphs_scanned_total_ = page_positions.size();
+        page_glyphs_.refresh();
+    }
+    bool ok = page_glyphs_.usable(getEffectiveZhConvMode(), PageGlyphIndex::currentFontTag()) &&
+              page_glyphs_.read(page_index, out);
+    releaseFileLock();
+    return ok;
+}
+
+uint8_t BookHandle::getEffectiveZhConvMode() const
+{
+    extern GlobalConfig g_config;
+    return keep_org_ ? 0 : g_config.zh_conv_mode;
+}
+
 // Bookmark helpers
 bool ensureBookmarksFolder()
 {
@@ -2235,7 +2306,7 @@ bool BookHandle::loadBookmarkAndJump()
         // 确保使用正确的第一页位置
         if (!page_positions.empty())
         {
-            cur_pos = page_positions[0];
+            cur_pos = pageStart(0);
 #if DBG_BOOK_HANDLE
             Serial.printf("[BH] loadBookmarkAndJump: 已请求后台重建索引，设置第一页位置 %zu\n", cur_pos);
 #endif
@@ -2316,7 +2387,9 @@ bool BookHandle::loadBookmarkAndJump()
     {
         // 使用页面索引恢复位置
         current_page_index = cfg.current_page_index;
-        cur_pos = page_positions[current_page_index];
+        cur_pos = pageStart(current_page_index);
+        if (cur_pos == PagePositionStore::npos)
+            cur_pos = cfg.current_position; // 页起点读不出来：以书签记录的位置为准
         page_completed = cfg.page_completed;
 
 #if DBG_BOOK_HANDLE
@@ -2327,7 +2400,7 @@ bool BookHandle::loadBookmarkAndJump()
         if (cfg.current_position != cur_pos &&
             cfg.current_position >= cur_pos &&
             (current_page_index + 1 >= page_positions.size() ||
-             cfg.current_position < page_positions[current_page_index + 1]))
+             cfg.current_position < pageStart(current_page_index + 1)))
         {
             cur_pos = cfg.current_position;
 #if DBG_BOOK_HANDLE
@@ -2341,17 +2414,12 @@ bool BookHandle::loadBookmarkAndJump()
     {
         // 书签中的页面索引无效（或被检测为损坏），尝试根据位置查找最接近的页面
         current_page_index = 0;
-        for (size_t i = 0; i < page_positions.size(); i++)
-        {
-            if (page_positions[i] <= cfg.current_position)
-            {
-                current_page_index = i;
-            }
-            else
-            {
-                break;
-            }
-        }
+        size_t found_idx = 0;
+        bool found = page_positions.findLastAtOrBefore(cfg.current_position, found_idx);
+        if (!found && page_positions.readFailed() && reloadPagesAfterReadError())
+            found = page_positions.findLastAtOrBefore(cfg.current_position, found_idx);
+        if (found)
+            current_page_index = found_idx;
         cur_pos = cfg.current_position;
         page_completed = cfg.page_completed;
 
@@ -2481,7 +2549,7 @@ bool BookHandle::loadPage()
         if (page_positions.size() > 0)
         {
             Serial.printf("[BH] 首页位置: %zu, 末页位置: %zu\n",
-                          page_positions[0], page_positions[page_positions.size() - 1]);
+                          pageStart(0), pageStart(page_positions.size() - 1));
         }
 #endif
         return true;
@@ -2544,6 +2612,11 @@ std::string BookHandle::getPageFileName() const
     return page_filename_for(file_path);
 }
 
+std::string BookHandle::getPageGlyphFileName() const
+{
+    return page_glyph_filename_for(file_path);
+}
+
 // 获取总页数 - 智能检测索引完成后是否需要重新加载
 size_t BookHandle::getTotalPages() const
 {
@@ -2604,94 +2677,28 @@ bool BookHandle::loadPageFile()
     Serial.printf("[BH] loadPageFile: 尝试以二进制方式解析分页文件...\n");
 #endif
 
-    // 检查是否为我们自定义的二进制格式：magic 'BPG1' (4 bytes), version (1 byte), reserved(3), uint32_t count
+    // 二进制格式：magic 'BPG1' + version（v1 原始 u32 偏移 / v2 分块增量记录），见 page_index.h
     char magic[4] = {0};
-    if (file.readBytes(magic, 4) == 4)
+    if (file.readBytes(magic, 4) == 4 && magic[0] == 'B' && magic[1] == 'P' && magic[2] == 'G' && magic[3] == '1')
     {
-        if (magic[0] == 'B' && magic[1] == 'P' && magic[2] == 'G' && magic[3] == '1')
-        {
-            // binary format
-            uint8_t ver = 0;
-            if (file.readBytes((char *)&ver, 1) != 1)
-            {
-#if DBG_BOOK_HANDLE
-                Serial.println("[BH] loadPageFile: 无法读取版本字节，退回文本解析");
-#endif
-                file.close();
-                return false;
-            }
-            // skip 3 reserved bytes
-            file.seek(file.position() + 3);
-
-            uint32_t count = 0;
-            if (file.readBytes((char *)&count, sizeof(count)) != sizeof(count))
-            {
-#if DBG_BOOK_HANDLE
-                Serial.println("[BH] loadPageFile: 无法读取count，退回文本解析");
-#endif
-                file.close();
-                return false;
-            }
-
-            // 计算文件中实际的偏移量数量（从文件大小推断）
-            size_t cur_pos = file.position();
-            size_t total_size = file.size();
-            size_t remaining = (total_size > cur_pos) ? (total_size - cur_pos) : 0;
-            uint32_t actualCount = (uint32_t)(remaining / sizeof(uint32_t));
-
-            // 鲁棒性检查：如果 count 字段明显错误，使用推断值
-            // 情况1: count 为 0（增量写入时的占位符，或 patchCount 被复位中断）
-            // 情况2: count 明显过大（超过100万页，或超过文件实际容量）
-            // 情况3: count 与文件大小不匹配（count 被部分写入）
-            bool countIsStale = (count == 0) ||
-                                (count > 1000000) ||
-                                (count != actualCount);
-
-            if (countIsStale)
-            {
+        bool needs_rewrite = false;
+        bool ok = page_positions.loadFromPageFile(file, needs_rewrite);
+        file.close();
+        page_file_needs_rewrite_ = needs_rewrite;
 #if DBG_BOOK_HANDLE
-                Serial.printf("[BH] loadPageFile: count字段异常 (filed=%u, actual=%u)，从文件大小推断\n",
-                              count, actualCount);
+        Serial.printf("[BH] loadPageFile: 二进制解析%s，共 %zu 页，占用 %zu 字节%s\n", ok ? "完成" : "失败",
+                      page_positions.size(), page_positions.memoryBytes(), needs_rewrite ? "（需以v2重写）" : "");
 #endif
-                count = actualCount;
-
-                // 检查是否有非对齐的字节（可能表示写入被中断）
-                if (remaining % sizeof(uint32_t) != 0)
-                {
-#if DBG_BOOK_HANDLE
-                    Serial.printf("[BH] loadPageFile: 警告: 偏移量字节数不对齐 (remaining=%zu)，可能丢失最后一个偏移量\n",
-                                  remaining);
-#endif
-                }
-            }
-
-            // Read offsets (uint32_t) one by one
-            for (uint32_t i = 0; i < count; ++i)
-            {
-                uint32_t off = 0;
-                if (file.readBytes((char *)&off, sizeof(off)) != sizeof(off))
-                {
-#if DBG_BOOK_HANDLE
-                    Serial.printf("[BH] loadPageFile: 提前结束，已读取 %u/%u 项\n", i, count);
-#endif
-                    break;
-                }
-                page_positions.push_back((size_t)off);
-            }
-            file.close();
-#if DBG_BOOK_HANDLE
-            Serial.printf("[BH] loadPageFile: 二进制解析完成，共 %zu 页\n", page_positions.size());
-#endif
-            if (page_positions.empty())
-            {
-                page_positions.push_back(0);
-                tryInitializeFontCache();
-                return false;
-            }
-            pages_loaded = true;
+        if (!ok || page_positions.empty())
+        {
+            page_positions.clear();
+            page_positions.push_back(0);
             tryInitializeFontCache();
-            return true;
+            return false;
         }
+        pages_loaded = true;
+        tryInitializeFontCache();
+        return true;
     }
 
     // 退回到文本行解析（兼容老格式）
@@ -2780,6 +2787,7 @@ bool BookHandle::loadPageFile()
 #if DBG_BOOK_HANDLE
     Serial.printf("[BH] loadPageFile: 文本解析完成，共 %d 行，%zu 页\n", line_count, page_positions.size());
 #endif
+    page_file_needs_rewrite_ = true;
 
     if (page_positions.empty())
     {
@@ -3266,7 +3274,7 @@ void BookHandle::renderCurrentPage(float font_size_param, M5Canvas *canvas, bool
                 requestForceReindex();
                 current_page_index = 0;
                 if (!page_positions.empty())
-                    cur_pos = page_positions[0];
+                    cur_pos = pageStart(0);
                 else
                     cur_pos = 0;
                 last_page.success = false;
@@ -3286,7 +3294,10 @@ void BookHandle::renderCurrentPage(float font_size_param, M5Canvas *canvas, bool
 
     // 获取当前页内容进行渲染（避免复制大字符串）
     TextPageResult current = currentPage();
-    last_render_char_count_ = count_readable_codepoints(current.page_text);
+    if (current_layout_ && current_layout_->file_pos == current.file_pos)
+        last_render_char_count_ = current_layout_->readable_chars;
+    else
+        last_render_char_count_ = count_readable_codepoints(current.page_text);
     bin_font_clear_canvas(dark);
     display_print(current.page_text.c_str(), font_size_param, TFT_BLACK, TL_DATUM,
                   MARGIN_TOP, MARGIN_BOTTOM, MARGIN_LEFT, MARGIN_RIGHT, TFT_WHITE, true, dark);
@@ -3294,26 +3305,13 @@ void BookHandle::renderCurrentPage(float font_size_param, M5Canvas *canvas, bool
     // If this page contains any tag start positions, draw a small black dot at top-right
     // 【保护条件】只有在索引完全加载且有效时才检查和显示书签图标
     // page_positions.size() > 1 确保至少有两个页面边界（首页和至少一个后续页面）
-    if (g_canvas && pages_loaded && !cached_tags.empty() &&
+    if (g_canvas && pages_loaded && tag_index_.manualCount() > 0 &&
         current_page_index < page_positions.size() && page_positions.size() > 1)
     {
-        size_t page_start = page_positions[current_page_index];
-        size_t page_end = (current_page_index + 1 < page_positions.size()) ? page_positions[current_page_index + 1] : getFileSize();
-        bool has_tag_here = false;
-
+        size_t page_start = pageStart(current_page_index);
+        size_t page_end = (current_page_index + 1 < page_positions.size()) ? pageStart(current_page_index + 1) : getFileSize();
         // 检查当前页面范围内是否有manual tag（不显示auto tag图标）
-        for (const auto &t : cached_tags)
-        {
-            if (t.position >= page_start && t.position < page_end)
-            {
-                // 只有非自动书签才显示图标
-                if (!t.is_auto)
-                {
-                    has_tag_here = true;
-                    break;
-                }
-            }
-        }
+        bool has_tag_here = tag_index_.findManualInRange(page_start, page_end) != nullptr;
 
         if (has_tag_here)
         {
@@ -3469,7 +3467,7 @@ bool isFileModified(const std::string &book_file_path)
     {
         path = path.substr(3); // 移除 /sd 前缀
     }
-    File file = SDW::SD.open(path.c_str(), "r");
+    File file = lz_book_open(path.c_str());
     if (!file)
     {
         return true; // 文件无法打开，可能被删除或修改
@@ -3482,6 +3480,63 @@ bool isFileModified(const std::string &book_file_path)
     return (current_size != cfg.file_size);
 }
 
+std::string paginateFingerprintForBook(const std::string &book_file_path)
+{
+    std::string path = book_file_path;
+    if (path.substr(0, 3) == "/sd")
+    {
+        path = path.substr(3); // 移除 /sd 前缀
+    }
+    File file = lz_book_open(path.c_str());
+    if (!file)
+    {
+        return std::string();
+    }
+
+    PaginateOptions opt;
+    opt.area_width = PAPER_S3_WIDTH - MARGIN_LEFT - MARGIN_RIGHT;
+    opt.area_height = PAPER_S3_HEIGHT - MARGIN_TOP - MARGIN_BOTTOM;
+    opt.font_size = (float)get_font_size_from_file();
+    // 竖排与保留原文是每本书的设置；还没有书签的书按 BookHandle 的默认值（横排、保留原文）
+    BookmarkConfig cfg = loadBookmarkForFile(book_file_path);
+    extern GlobalConfig g_config;
+    opt.vertical = cfg.valid && cfg.verticalText;
+    opt.zh_conv_mode = (cfg.valid && !cfg.keepOrg) ? g_config.zh_conv_mode : 0;
+    if (cfg.valid && cfg.encoding != TextEncoding::AUTO_DETECT)
+    {
+        opt.encoding = cfg.encoding;
+    }
+    else
+    {
+        // 与 build_book_page_index 相同：按开头 1KB 检测
+        uint8_t detect_buffer[1024];
+        size_t detect_size = file.read(detect_buffer, sizeof(detect_buffer));
+        opt.encoding = detect_text_encoding(detect_buffer, detect_size);
+    }
+    file.close();
+    return paginate_fingerprint(opt, g_bin_font.family_name, g_bin_font.version, g_bin_font.char_count);
+}
+
+std::string readCompleteFingerprint(const std::string &complete_path)
+{
+    File f = SDW::SD.open(complete_path.c_str(), "r");
+    if (!f)
+    {
+        return std::string();
+    }
+    char buf[256];
+    size_t n = f.read((uint8_t *)buf, sizeof(buf) - 1);
+    f.close();
+    buf[n] = 0;
+    const char *line = strstr(buf, PAGINATE_SETTINGS_PREFIX);
+    if (!line)
+    {
+        return std::string();
+    }
+    line += sizeof(PAGINATE_SETTINGS_PREFIX) - 1;
+    return std::string(line, strcspn(line, "\r\n"));
+}
+
 // ==================== 安全文件访问实现 ====================
 
 File BookHandle::openFileForReading()
@@ -3495,19 +3550,19 @@ File BookHandle::openFileForReading()
     else if (path.substr(0, 3) == "/sd")
     {
         path = path.substr(3); // 移除 /sd 前缀
-        return SDW::SD.open(path.c_str(), "r");
+        return lz_book_open(path.c_str());
     }
     else
     {
-        return SDW::SD.open(path.c_str(), "r");
+        return lz_book_open(path.c_str());
     }
 }
 
 void BookHandle::refreshTagsCache()
 {
-    // Load tags for this file into cached_tags. loadTagsForFile does not throw;
+    // Load tags for this file into the sorted in-memory index. TagIndex::load does not throw;
     // avoid exceptions because build is compiled without -fexceptions.
-    cached_tags = loadTagsForFile(file_path);
+    tag_index_.load(file_path);
 }
 
 bool BookHandle::acquireFileLock(TickType_t timeout)
@@ -3661,6 +3716,17 @@ bool BookHandle::goToRandomToC()
     if (!hasToc())
         return false;
 
+    // Fast path: entry count and positions are already in idx_positions_
+    if (isIdxCached())
+    {
+        randomSeed(millis());
+        size_t pick = (size_t)random((int)idx_positions_.size());
+        size_t page_idx = 0;
+        if (findPageIndexForPosition(idx_positions_[pick], page_idx))
+            return jumpToPage(page_idx);
+        return false;
+    }
+
     // Quick check: ensure there's at least one entry
     TocEntry entry;
     if (!fetch_toc_entry(file_path, 0, entry))
@@ -3809,9 +3875,19 @@ static bool page_file_valid_for(const std::string &book_file_path)
             return false;
         }
 
-        // Validate file size: header (12 bytes) + count * 4 (offsets)
+        // v2 (packed records): sizes are variable; require at least one record header
+        uint8_t ver = 0;
+        pf.seek(4);
+        pf.read(&ver, 1);
         pf.seek(0, SeekEnd);
         size_t actual_size = pf.position();
+        if (ver == PAGE_FILE_VERSION_PACKED)
+        {
+            pf.close();
+            return actual_size >= PAGE_FILE_HEADER_SIZE + PAGE_RECORD_HEADER_SIZE;
+        }
+
+        // v1: header (12 bytes) + count * 4 (offsets)
         size_t expected_size = 12 + ((size_t)count) * 4;
         if (actual_size < expected_size)
         {
@@ -3859,6 +3935,9 @@ void BookHandle::requestStopIndexing()
 void BookHandle::clearPagePositions()
 {
     page_positions.clear();
+    // 重建索引时 .pgg 也随之重建
+    page_glyphs_.reset(page_glyph_filename_for(file_path));
+    page_glyphs_scanned_total_ = 0;
     pages_loaded = false;
     current_page_index = 0;
     cur_pos = 0;
@@ -3917,6 +3996,31 @@ void BookHandle::markIndexingComplete()
     }
 }
 
+// 页起点表的 SD 溢出层读失败：从 .page 重新加载（PagePositionStore 此后只用内存层），
+// 当前页号夹在新表范围内（.page 之后尚未落盘的页会在继续索引时补上）
+bool BookHandle::reloadPagesAfterReadError()
+{
+#if DBG_BOOK_HANDLE
+    Serial.printf("[BH] 页起点表读失败，从 .page 重新加载\n");
+#endif
+    pages_loaded = false;
+    bool ok = loadPageFile();
+    if (current_page_index >= page_positions.size())
+        current_page_index = page_positions.empty() ? 0 : page_positions.size() - 1;
+    return ok;
+}
+
+size_t BookHandle::pageStart(size_t index)
+{
+    size_t v;
+    if (page_positions.tryAt(index, v))
+        return v;
+    if (index < page_positions.size() && page_positions.readFailed() && reloadPagesAfterReadError() &&
+        page_positions.tryAt(index, v))
+        return v;
+    return PagePositionStore::npos;
+}
+
 // 查找给定文件偏移对应的页面索引（找到最大的 i 使 page_positions[i] <= file_pos）
 // 返回 true 且 out_index 有效时表示成功；若无法确定则返回 false
 bool BookHandle::findPageIndexForPosition(size_t file_pos, size_t &out_index)
@@ -3955,12 +4059,11 @@ bool BookHandle::findPageIndexForPosition(size_t file_pos, size_t &out_index)
                   pages_loaded ? 1 : 0, page_positions.size(), first_pos, last_pos, file_pos, indexing_current_pos);
 #endif
 
-    // Binary search for largest i where page_positions[i] <= file_pos
+    // Search for largest i where page_positions[i] <= file_pos
     size_t lo = 0;
-    size_t hi = page_positions.size(); // exclusive
 
     // If before first page start, return 0
-    if (file_pos < page_positions[0])
+    if (file_pos < pageStart(0))
     {
         out_index = 0;
         return true;
@@ -3986,22 +4089,18 @@ bool BookHandle::findPageIndexForPosition(size_t file_pos, size_t &out_index)
         out_index = page_positions.size() - 1;
 #if DBG_BOOK_HANDLE
         Serial.printf("[BH] findPageIndexForPosition: using last page index=%zu (page_pos=%zu) as fallback\n",
-                      out_index, page_positions[out_index]);
+                      out_index, pageStart(out_index));
 #endif
         return true;
     }
 
-    while (lo + 1 < hi)
-    {
-        size_t mid = (lo + hi) / 2;
-        if (page_positions[mid] <= file_pos)
-            lo = mid;
-        else
-            hi = mid;
-    }
+    // 块索引二分 + 解码单个块；溢出文件读失败时重新加载后再查一次
+    if (!page_positions.findLastAtOrBefore(file_pos, lo) &&
+        !(reloadPagesAfterReadError() && page_positions.findLastAtOrBefore(file_pos, lo)))
+        return false;
 
 #if DBG_BOOK_HANDLE
-    Serial.printf("[BH] findPageIndexForPosition: result index=%zu (page_pos=%zu)\n", lo, page_positions[lo]);
+    Serial.printf("[BH] findPageIndexForPosition: result index=%zu (page_pos=%zu)\n", lo, pageStart(lo));
 #endif
 
     out_index = lo;
@@ -4014,7 +4113,7 @@ size_t BookHandle::getPageStart(size_t page_index) const
         return (size_t)-1;
     if (page_index >= page_positions.size())
         return (size_t)-1;
-    return page_positions[page_index];
+    return page_positions.at(page_index); // 读失败时为 npos，即 (size_t)-1
 }
 
 // 尝试初始化字体缓存（当pages_loaded变成true时调用）
@@ -4048,6 +4147,9 @@ void BookHandle::tryInitializeFontCache()
         return;
     }
 
+    // 本书已有子集字体时先挂载（同一本书、同一字体只检查一次）
+    g_font_subset.attachForBook(file_path);
+
     // 初始化或与当前页面对齐缓存窗口
     if (!g_font_buffer_manager.isInitialized())
     {
@@ -7,6 +7,9 @@
 #include "text_handle.h"
 #include "readpaper.h"
 #include "text/tags_handle.h"
+#include "text/page_index.h"
+#include "text/page_layout.h"
+#include "text/page_glyphs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include <atomic>
@@ -54,6 +57,7 @@ public:
     bool loadPageFile();                 // 从文件加载分页信息
     bool savePageFile();                 // 保存分页信息到文件
     std::string getPageFileName() const; // 获取分页文件名
+    std::string getPageGlyphFileName() const; // 获取每页字形集合文件名（.pgg）
     size_t getTotalPages() const;  // 获取总页数（可能触发重新加载）
     size_t getCurrentPageIndex() const { return current_page_index; } // 获取当前页索引
     bool jumpToPage(size_t page_index);                               // 跳转到指定页
@@ -84,6 +88,9 @@ public:
 
     void clearPagePositions();
     void appendPagePosition(size_t pos);
+    const PagePositionStore &getPagePositions() const { return page_positions; }
+    bool pageFileNeedsRewrite() const { return page_file_needs_rewrite_; }
+    void clearPageFileNeedsRewrite() { page_file_needs_rewrite_ = false; }
     void setPagesLoaded(bool v) { pages_loaded = v; }
     bool isPagesLoaded() const { return pages_loaded; }
     
@@ -133,6 +140,8 @@ public:
     TextEncoding getEncoding() const { return encoding; }
     bool getShowLabel() const { return showlabel; }
     bool getKeepOrg() const { return keep_org_; }
+    // 实际生效的繁简模式（keepOrg 时不转换）
+    uint8_t getEffectiveZhConvMode() const;
     bool getDrawBottom() const { return draw_bottom_; }
     bool getVerticalText() const { return vertical_text_; }
     // 阅读时间（小时/分钟），用于记录最后阅读时间
@@ -187,6 +196,12 @@ public:
     bool findPageIndexForPosition(size_t file_pos, size_t &out_index);
     // 返回指定页索引的起始字节位置（若不存在则返回 (size_t)-1）
     size_t getPageStart(size_t page_index) const;
+    // 取得指定页的排版结果（文本、字形集合、摘要），不改变当前页；分页未加载或越界时返回 nullptr。
+    // 字体缓存构建与渲染共用，同一页在窗口内只读取、分析一次。
+    std::shared_ptr<const PageLayout> getPageLayout(size_t page_index);
+    // 从分页时生成的 .pgg 取指定页的码点集合（升序），不读取正文；
+    // 该页尚未记录，或记录时的字体/繁简模式与当前不符时返回 false，调用方改用 getPageLayout。
+    bool getPageGlyphs(size_t page_index, std::vector<uint16_t, PSRAMAllocator<uint16_t>> &out);
     // Jump to the page corresponding to a TOC entry index (0-based).
     // If the book has no TOC or the index is invalid, do nothing and return false.
     bool jumpToTocLine(size_t toc_index);
@@ -198,7 +213,9 @@ public:
     bool goToRandomPage();
     // Tags cache utilities
     void refreshTagsCache();
-    const std::vector<TagEntry> &getCachedTags() const { return cached_tags; }
+    const std::vector<TagEntry> &getCachedTags() const { return tag_index_.entries(); }
+    // 有序书签索引（O(log n) 区间查询，不访问 SD）
+    const TagIndex &getTagIndex() const { return tag_index_; }
     std::string getCompleteFileName() const;
     // Diagnostic id (stable for lifetime) used by bg-index/logging
     size_t getId() const;
@@ -263,8 +280,13 @@ private:
     // 当前页面摘要（前DIGEST_NUM个字符）
     std::string current_digest;
 
-    // 分页数组：存储每页的起始位置
-    std::vector<size_t> page_positions;
+    // 分页数组：存储每页的起始位置（分块增量编码，随机访问只解码一个块）
+    PagePositionStore page_positions;
+    // page_positions[index]；SD 溢出层读失败时从 .page 重新加载（改为驻留内存）后重试，仍失败返回 npos
+    size_t pageStart(size_t index);
+    bool reloadPagesAfterReadError();
+    // 载入的 .page 为 v1 或尾部损坏，需要由后台索引以 v2 重写
+    bool page_file_needs_rewrite_ = false;
     bool pages_loaded = false;
 
     // 锁屏时是否显示标签信息
@@ -272,7 +294,16 @@ private:
     // 如果在 open() 中因为原始文件缺失而回退到默认文件，跳过书签恢复（因为默认文件可能有不同的书签）
     bool skip_bookmark_on_open = false;
 
-    void updateCurrentDigest(const std::string &page_text);
+    // 最近若干页的排版结果；current_layout_ 为 last_page 对应的那一份
+    PageLayoutCache page_layouts_;
+    std::shared_ptr<const PageLayout> current_layout_;
+    // 每页字形集合（.pgg）；页数变化后才重新扫描文件新增部分
+    PageGlyphIndex page_glyphs_;
+    size_t page_glyphs_scanned_total_ = 0;
+    // 取得（或读取并登记）从 start 开始、以 max_byte_pos 为界的一页排版结果；调用方须持有文件锁
+    std::shared_ptr<const PageLayout> layoutPageLocked(size_t start, size_t max_byte_pos);
+    // 设为当前页：同步 last_page 与 current_digest
+    void setCurrentLayout(const std::shared_ptr<const PageLayout> &layout);
     // 是否保持原始组织（true: 跳过繁简转换）
     // 默认改为 true：书签配置中默认跳过繁简转换
     bool keep_org_ = true;
@@ -287,18 +318,13 @@ private:
     // 标记对象正在被关闭（供外部调用以便后台索引能安全退出）
     bool closing_ = false;
     // Cached tags for this book (kept in sync when opening or when tags are modified)
-    std::vector<TagEntry> cached_tags;
+    TagIndex tag_index_;
     // Whether a same-directory .idx file exists for this book (set during open())
     bool is_indexed_ = false;
-    // PSRAM-backed idx cache
-    // Primary in-heap cache (vector). If PSRAM allocation is available we may allocate
-    // a raw buffer and copy into it; idx_positions_psram_ptr will point to that buffer.
-    std::vector<size_t> idx_positions_psram_;
-    // Titles cache corresponding to idx_positions_psram_. Kept in heap (strings)
-    std::vector<std::string> idx_titles_psram_;
-    size_t *idx_positions_psram_ptr = nullptr; // raw PSRAM pointer (if allocated)
-    size_t idx_positions_psram_count = 0;
-    bool idx_psram_loaded_ = false;
+    // .idx 目录位置表，与 page_positions 共用 PagePositionStore（块数据在 PSRAM）
+    PagePositionStore idx_positions_;
+    // 目录标题，与 idx_positions_ 一一对应
+    std::vector<std::string> idx_titles_;
     // 最后阅读时间（小时/分钟），默认初始值为0
     std::int16_t readhour = 0;
     std::int16_t readmin = 0;
@@ -308,10 +334,10 @@ public:
     // Load/clear idx positions into PSRAM-backed cache
     bool loadIdxToPSRAM();                // load .idx into PSRAM or heap-backed cache
     void clearIdxPSRAM();                 // release PSRAM cache
-    const std::vector<size_t> &getIdxPositions() const { return idx_positions_psram_; }
-    const std::vector<std::string> &getIdxTitles() const { return idx_titles_psram_; }
-    // Consider idx cached when we have parsed positions (vector non-empty).
-    bool isIdxCached() const { return !idx_positions_psram_.empty(); }
+    const PagePositionStore &getIdxPositions() const { return idx_positions_; }
+    const std::vector<std::string> &getIdxTitles() const { return idx_titles_; }
+    // Consider idx cached when we have parsed positions (store non-empty).
+    bool isIdxCached() const { return !idx_positions_.empty(); }
     // Query whether a same-directory sidecar .toc file exists for this book
     bool hasToc() const;
 };
@@ -393,6 +419,10 @@ std::string getBookmarkFileName(const std::string &book_file_path);    // 获取
 std::string getRecordFileName(const std::string &book_file_path);      // 获取阅读记录文件名（.rec）
 // Remove index files (page/progress/complete) for a given book path. Public so UI can call it too.
 void removeIndexFilesForBookForPath(const std::string &book_file_path);
+// 按当前字体、显示区域与该书书签里的设置计算分页设置指纹（见 paginate_fingerprint）；书打不开返回空串
+std::string paginateFingerprintForBook(const std::string &book_file_path);
+// .complete 里 tools/preindex 记下的设置指纹；设备自己写的标记没有这一行，返回空串
+std::string readCompleteFingerprint(const std::string &complete_path);
 
 // 从 history.list 中删除指定书籍
 bool removeBookFromHistory(const std::string &book_path);
@@ -0,0 +1,1256 @@
+#include "book_search.h"
+#include <Arduino.h>
+#include <FS.h>
+#include <algorithm>
+#include <cstring>
+#include "../SD/SDWrapper.h"
+#include "device/safe_fs.h"
+#include "book_handle.h"
+#include "text_handle.h"
+#include "gbk_unicode_table.h"
+#include "bin_font_print.h" // PSRAMAllocator
+#include "test/per_file_debug.h"
+
+// .sidx 格式常量（见 book_search.h）
+static const char SIDX_MAGIC[4] = {'R', 'P', 'S', 'X'};
+static const char SIDX_RUN_MAGIC[4] = {'R', 'U', 'N', '1'};
+static const uint8_t SIDX_VERSION = 2;
+
+static const uint32_t SIDX_BLOCK_TARGET = 4096;      // 块在字符边界且无未完成单词时关闭
+static const uint32_t SIDX_BLOCK_HARD = 16384;       // 超长 ASCII 串时强制关块
+static const uint32_t SIDX_RUN_TARGET = 256 * 1024;  // 每个 run 覆盖的文本量
+static const uint32_t SIDX_MAX_BLOCKS_PER_RUN = 64;  // 块号以 u8 存储
+static const uint32_t SIDX_MAX_BUCKET_BITS = 13;      // 桶表按 run 的规模取 2^bits 个桶
+static const uint32_t SIDX_KEYS_PER_BUCKET = 16;     // 目标平均每桶的 (key, 块) 对数
+static const uint32_t SIDX_MAX_WORD_CHARS = 32;      // 超长单词只取前 32 字符参与哈希
+static const size_t SIDX_READ_CHUNK = 4096;
+static const size_t SIDX_MAX_QUERY_BYTES = 256;      // 保证一次匹配最多跨两个块
+static const size_t SIDX_MAX_QUERY_KEYS = 8;
+static const uint32_t SIDX_MAX_BUCKET_BYTES = 32 * 1024;
+
+#pragma pack(push, 1)
+struct SidxHeader
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t encoding;
+    uint16_t reserved0;
+    uint32_t book_size;
+    uint32_t text_committed;
+    uint32_t run_count;
+    uint32_t bytes_committed;
+    uint32_t complete;
+    uint32_t reserved1;
+};
+
+struct SidxRunHeader
+{
+    char magic[4];
+    uint32_t text_start;
+    uint32_t text_end;
+    uint32_t block_count;
+    uint32_t bucket_count;
+    uint32_t postings_bytes;
+    uint32_t run_bytes;
+    uint32_t reserved;
+};
+#pragma pack(pop)
+static_assert(sizeof(SidxHeader) == 32, "SidxHeader must stay 32 bytes");
+static_assert(sizeof(SidxRunHeader) == 32, "SidxRunHeader must stay 32 bytes");
+
+std::string getSearchIndexFileName(const std::string &book_file_path)
+{
+    // 与 .tags 相同：复用 getBookmarkFileName 的安全化规则，只替换后缀
+    std::string bm = getBookmarkFileName(book_file_path);
+    size_t dot = bm.find_last_of('.');
+    if (dot != std::string::npos)
+        return bm.substr(0, dot) + ".sidx";
+    return bm + ".sidx";
+}
+
+bool clearSearchIndexForFile(const std::string &book_file_path)
+{
+    std::string fn = getSearchIndexFileName(book_file_path);
+    bool ok = true;
+    if (SDW::SD.exists(fn.c_str()))
+        ok = SDW::SD.remove(fn.c_str());
+    std::string tmp = SafeFS::tmpPathFor(fn);
+    if (SDW::SD.exists(tmp.c_str()))
+        SDW::SD.remove(tmp.c_str());
+    return ok;
+}
+
+static bool readSidxHeader(File &f, SidxHeader &hdr)
+{
+    if (!f.seek(0))
+        return false;
+    if (f.read((uint8_t *)&hdr, sizeof(hdr)) != (int)sizeof(hdr))
+        return false;
+    return memcmp(hdr.magic, SIDX_MAGIC, 4) == 0 && hdr.version == SIDX_VERSION;
+}
+
+static bool loadSidxHeader(const std::string &sidx_file, SidxHeader &hdr)
+{
+    File f = SDW::SD.open(sidx_file.c_str(), "r");
+    if (!f)
+        return false;
+    bool ok = readSidxHeader(f, hdr);
+    f.close();
+    return ok;
+}
+
+bool isSearchIndexComplete(const std::string &book_file_path)
+{
+    SidxHeader hdr;
+    if (!loadSidxHeader(getSearchIndexFileName(book_file_path), hdr))
+        return false;
+    return hdr.complete != 0;
+}
+
+// ---------------------------------------------------------------------------
+// 字符解码与切分（建索引与查询共用）
+// ---------------------------------------------------------------------------
+
+// 解码 p 处的一个字符；字节不足以构成完整字符时返回 false（等待更多数据）
+static bool decodeBookChar(const uint8_t *p, size_t avail, TextEncoding enc, uint32_t &cp, size_t &len)
+{
+    if (avail == 0)
+        return false;
+    uint8_t b = p[0];
+    if (b < 0x80)
+    {
+        cp = b;
+        len = 1;
+        return true;
+    }
+    if (enc == TextEncoding::GBK)
+    {
+        if (b >= 0x81 && b <= 0xFE)
+        {
+            if (avail < 2)
+                return false;
+            uint16_t u = gbk_to_unicode_lookup((uint16_t)((b << 8) | p[1]));
+            cp = u ? u : 0xFFFD;
+            len = 2;
+            return true;
+        }
+        cp = 0xFFFD;
+        len = 1;
+        return true;
+    }
+
+    size_t need = 0;
+    if ((b & 0xE0) == 0xC0)
+        need = 2;
+    else if ((b & 0xF0) == 0xE0)
+        need = 3;
+    else if ((b & 0xF8) == 0xF0)
+        need = 4;
+    else
+    {
+        cp = 0xFFFD;
+        len = 1;
+        return true;
+    }
+    if (avail < need)
+    {
+        // 不完整的序列：若已到达的续字节非法则按单字节错误处理
+        for (size_t i = 1; i < avail; ++i)
+        {
+            if ((p[i] & 0xC0) != 0x80)
+            {
+                cp = 0xFFFD;
+                len = 1;
+                return true;
+            }
+        }
+        return false;
+    }
+    uint32_t v = b & (0x7F >> need);
+    for (size_t i = 1; i < need; ++i)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+        {
+            cp = 0xFFFD;
+            len = 1;
+            return true;
+        }
+        v = (v << 6) | (p[i] & 0x3F);
+    }
+    cp = v;
+    len = need;
+    return true;
+}
+
+static inline bool isAsciiAlnum(uint32_t cp)
+{
+    return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z');
+}
+
+// 参与 bigram 的“宽字符”：非 ASCII 且非空白/标点/BOM/替换符
+static inline bool isIndexedWide(uint32_t cp)
+{
+    if (cp < 0x80 || cp == 0xFFFD || cp == 0xFEFF || cp == 0x00A0)
+        return false;
+    if (cp >= 0x2000 && cp <= 0x206F) // 通用标点、各种空格
+        return false;
+    if (cp >= 0x3000 && cp <= 0x303F) // CJK 标点与全角空格
+        return false;
+    if ((cp >= 0xFF00 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20) ||
+        (cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65)) // 全角标点
+        return false;
+    return true;
+}
+
+static inline uint32_t mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// key 最高位区分 bigram(0) / ASCII 单词(1)；碰撞只会多出候选块，最终由原文校验剔除
+static inline uint32_t bigramKey(uint32_t a, uint32_t b)
+{
+    return mix32(a * 0x9E3779B1u ^ (b + 0x632BE5ABu)) & 0x7FFFFFFFu;
+}
+
+// 倒排表中存放的是 key 的再哈希（mix32 可逆，与 key 一一对应）：高位均匀，直接取作桶号，
+// 桶内按升序差分编码
+static inline uint32_t postingHash(uint32_t key)
+{
+    return mix32(key ^ 0xA5A5A5A5u);
+}
+
+static inline uint32_t bucketOf(uint32_t h, uint32_t bits)
+{
+    return bits ? h >> (32 - bits) : 0;
+}
+
+static inline uint32_t bucketBase(uint32_t bucket, uint32_t bits)
+{
+    return bits ? bucket << (32 - bits) : 0;
+}
+
+static const uint32_t FNV_OFFSET = 2166136261u;
+static const uint32_t FNV_PRIME = 16777619u;
+
+// 顺序切分器：跨 read/块/run 边界保持状态，emit(key, block, token_start)
+struct SearchTokenizer
+{
+    uint32_t prev_wide = 0;
+    uint32_t prev_block = 0;
+    uint32_t prev_start = 0;
+    uint32_t word_hash = FNV_OFFSET;
+    uint32_t word_len = 0;
+    uint32_t word_block = 0;
+    uint32_t word_start = 0;
+
+    void reset()
+    {
+        prev_wide = 0;
+        word_len = 0;
+        word_hash = FNV_OFFSET;
+    }
+
+    bool wordPending() const { return word_len > 0; }
+
+    template <typename Emit>
+    void flushWord(Emit &&emit)
+    {
+        if (word_len > 0)
+            emit(word_hash | 0x80000000u, word_block, word_start);
+        word_len = 0;
+        word_hash = FNV_OFFSET;
+    }
+
+    template <typename Emit>
+    void feed(uint32_t cp, uint32_t block, uint32_t pos, Emit &&emit)
+    {
+        if (cp < 0x80 && isAsciiAlnum(cp))
+        {
+            if (word_len == 0)
+            {
+                word_block = block;
+                word_start = pos;
+            }
+            if (word_len < SIDX_MAX_WORD_CHARS)
+            {
+                uint8_t c = (uint8_t)cp;
+                if (c >= 'A' && c <= 'Z')
+                    c = (uint8_t)(c - 'A' + 'a');
+                word_hash = (word_hash ^ c) * FNV_PRIME;
+            }
+            ++word_len;
+            prev_wide = 0;
+            return;
+        }
+        flushWord(emit);
+        if (isIndexedWide(cp))
+        {
+            if (prev_wide)
+                emit(bigramKey(prev_wide, cp), prev_block, prev_start);
+            prev_wide = cp;
+            prev_block = block;
+            prev_start = pos;
+        }
+        else
+        {
+            prev_wide = 0;
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------
+// 后台构建
+// ---------------------------------------------------------------------------
+
+using PairVec = std::vector<uint64_t, PSRAMAllocator<uint64_t>>;
+using ByteVec = std::vector<uint8_t, PSRAMAllocator<uint8_t>>;
+
+static void putVarint(ByteVec &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static bool getVarint(const uint8_t *p, size_t len, size_t &i, uint32_t &v)
+{
+    v = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7)
+    {
+        if (i >= len)
+            return false;
+        uint8_t b = p[i++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// (postingHash(key) << 8) | local_block：桶号取哈希高位，排序后即为“按桶、桶内按哈希、哈希内按块”的顺序
+static inline uint64_t makePair(uint32_t key, uint32_t local_block)
+{
+    return ((uint64_t)postingHash(key) << 8) | (local_block & 0xFF);
+}
+
+struct SearchBuildState
+{
+    std::string book_path;
+    std::string sidx_file;
+    bool active = false;
+    bool finished = false;
+    TextEncoding enc = TextEncoding::UTF8;
+    SidxHeader hdr{};
+
+    uint32_t scan_pos = 0;       // 下一个要从书籍读取的字节
+    uint32_t run_text_start = 0;
+    uint32_t block_bytes = 0;    // 当前块已含字节数
+    std::vector<uint32_t> block_starts;
+    SearchTokenizer tok;
+    PairVec pairs;
+
+    uint8_t carry[4];
+    size_t carry_len = 0;
+};
+
+static SearchBuildState s_build;
+
+static void resetBuildState()
+{
+    s_build.active = false;
+    s_build.finished = false;
+    s_build.book_path.clear();
+    s_build.sidx_file.clear();
+    s_build.block_starts.clear();
+    PairVec().swap(s_build.pairs);
+    s_build.carry_len = 0;
+    s_build.tok.reset();
+}
+
+static bool writeSidxHeaderInPlace(const std::string &sidx_file, const SidxHeader &hdr)
+{
+    File f = SDW::SD.open(sidx_file.c_str(), "r+");
+    if (!f)
+        return false;
+    bool ok = f.seek(0) && f.write((const uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr);
+    f.flush();
+    f.close();
+    return ok;
+}
+
+static void beginRun(uint32_t pos)
+{
+    s_build.run_text_start = pos;
+    s_build.block_starts.clear();
+    s_build.block_starts.push_back(pos);
+    s_build.block_bytes = 0;
+    s_build.pairs.clear();
+    s_build.tok.reset();
+}
+
+// 把当前 run 排序去重后追加到 .sidx，并提交头部。text_end 必须是字符边界。
+static bool commitRun(uint32_t text_end, bool is_last)
+{
+    PairVec &pairs = s_build.pairs;
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    // 桶表随 run 的规模伸缩：短 run（短书、书尾）不再背一张 32KB 的固定桶表
+    uint32_t bits = 0;
+    while (bits < SIDX_MAX_BUCKET_BITS && (pairs.size() >> bits) > SIDX_KEYS_PER_BUCKET)
+        ++bits;
+    const uint32_t bucket_count = 1u << bits;
+    std::vector<uint32_t> bucket_off(bucket_count + 1, 0);
+    ByteVec postings;
+    postings.reserve(pairs.size() + pairs.size() / 2 + 64);
+
+    uint32_t cur_bucket = 0;
+    uint32_t prev = 0;
+    size_t i = 0;
+    while (i < pairs.size())
+    {
+        uint32_t h = (uint32_t)(pairs[i] >> 8);
+        uint32_t bucket = bucketOf(h, bits);
+        if (cur_bucket <= bucket)
+        {
+            while (cur_bucket <= bucket)
+                bucket_off[cur_bucket++] = (uint32_t)postings.size();
+            prev = bucketBase(bucket, bits);
+        }
+        size_t j = i;
+        while (j < pairs.size() && (uint32_t)(pairs[j] >> 8) == h)
+            ++j;
+        putVarint(postings, h - prev);
+        prev = h;
+        postings.push_back((uint8_t)(j - i));
+        for (size_t k = i; k < j; ++k)
+            postings.push_back((uint8_t)(pairs[k] & 0xFF));
+        i = j;
+    }
+    while (cur_bucket <= bucket_count)
+        bucket_off[cur_bucket++] = (uint32_t)postings.size();
+
+    SidxRunHeader rh{};
+    memcpy(rh.magic, SIDX_RUN_MAGIC, 4);
+    rh.text_start = s_build.run_text_start;
+    rh.text_end = text_end;
+    rh.block_count = (uint32_t)s_build.block_starts.size();
+    rh.bucket_count = bucket_count;
+    rh.postings_bytes = (uint32_t)postings.size();
+    rh.run_bytes = (uint32_t)(sizeof(rh) + rh.block_count * 4 + (bucket_count + 1) * 4 + postings.size());
+
+    File f = SDW::SD.open(s_build.sidx_file.c_str(), "r+");
+    if (!f)
+        return false;
+    bool ok = f.seek(s_build.hdr.bytes_committed);
+    ok = ok && f.write((const uint8_t *)&rh, sizeof(rh)) == sizeof(rh);
+    ok = ok && f.write((const uint8_t *)s_build.block_starts.data(), rh.block_count * 4) == rh.block_count * 4;
+    ok = ok && f.write((const uint8_t *)bucket_off.data(), bucket_off.size() * 4) == bucket_off.size() * 4;
+    if (ok && !postings.empty())
+        ok = f.write(postings.data(), postings.size()) == postings.size();
+    f.flush();
+    f.close();
+    if (!ok)
+        return false;
+
+    // 数据落盘后再提交头部；中途掉电时尾部残留会被下一次从 bytes_committed 覆盖
+    SidxHeader nh = s_build.hdr;
+    nh.text_committed = text_end;
+    nh.run_count += 1;
+    nh.bytes_committed += rh.run_bytes;
+    nh.complete = is_last ? 1 : 0;
+    if (!writeSidxHeaderInPlace(s_build.sidx_file, nh))
+        return false;
+    s_build.hdr = nh;
+
+#if DBG_BOOK_SEARCH
+    Serial.printf("[SIDX] run#%u text=[%u,%u) blocks=%u keys_bytes=%u last=%d\n", (unsigned)nh.run_count,
+                  (unsigned)rh.text_start, (unsigned)rh.text_end, (unsigned)rh.block_count,
+                  (unsigned)rh.postings_bytes, is_last ? 1 : 0);
+#endif
+    return true;
+}
+
+static TextEncoding resolveEncoding(BookHandle *bh, File &f)
+{
+    TextEncoding enc = bh->getEncoding();
+    if (enc != TextEncoding::AUTO_DETECT)
+        return enc;
+    uint8_t buf[1024];
+    f.seek(0);
+    int n = f.read(buf, sizeof(buf));
+    return n > 0 ? detect_text_encoding(buf, (size_t)n) : TextEncoding::UTF8;
+}
+
+// 为当前书准备构建状态：读取/校验已有 .sidx，必要时新建
+static bool prepareBuildState(BookHandle *bh, File &book)
+{
+    resetBuildState();
+    s_build.book_path = bh->filePath();
+    s_build.sidx_file = getSearchIndexFileName(s_build.book_path);
+    s_build.enc = resolveEncoding(bh, book);
+    uint32_t book_size = (uint32_t)book.size();
+
+    SafeFS::restoreFromTmpIfNeeded(s_build.sidx_file);
+    SidxHeader hdr;
+    bool reuse = loadSidxHeader(s_build.sidx_file, hdr) && hdr.book_size == book_size &&
+                 hdr.encoding == (uint8_t)s_build.enc && hdr.text_committed <= book_size;
+    if (!reuse)
+    {
+        if (!ensureBookmarksFolder())
+            return false;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, SIDX_MAGIC, 4);
+        hdr.version = SIDX_VERSION;
+        hdr.encoding = (uint8_t)s_build.enc;
+        hdr.book_size = book_size;
+        hdr.bytes_committed = sizeof(SidxHeader);
+        if (!SafeFS::safeWrite(s_build.sidx_file, [&](File &f) {
+                return f.write((const uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr);
+            }))
+            return false;
+    }
+    s_build.hdr = hdr;
+    s_build.active = true;
+    s_build.finished = hdr.complete != 0;
+    s_build.scan_pos = hdr.text_committed;
+    beginRun(hdr.text_committed);
+    return true;
+}
+
+bool backgroundBuildSearchIndexIncremental(BookHandle *bh, uint32_t budget_ms)
+{
+    if (!bh || bh->isClosing())
+        return false;
+    if (s_build.active && s_build.book_path == bh->filePath() && s_build.finished)
+        return false;
+    if (!bh->tryAcquireFileLock(0))
+        return false;
+
+    File book = bh->openIndexingReadHandle();
+    if (!book)
+    {
+        bh->releaseFileLockPublic();
+        return false;
+    }
+
+    if (!s_build.active || s_build.book_path != bh->filePath())
+    {
+        if (!prepareBuildState(bh, book))
+        {
+            book.close();
+            bh->releaseFileLockPublic();
+            resetBuildState();
+            return false;
+        }
+        if (s_build.finished)
+        {
+            PairVec().swap(s_build.pairs);
+            book.close();
+            bh->releaseFileLockPublic();
+            return false;
+        }
+    }
+
+    const uint32_t book_size = s_build.hdr.book_size;
+    unsigned long t0 = millis();
+    bool did_work = false;
+    bool failed = false;
+    uint8_t buf[SIDX_READ_CHUNK + 4];
+
+    auto emit = [](uint32_t key, uint32_t block, uint32_t) { s_build.pairs.push_back(makePair(key, block)); };
+
+    while (!failed && s_build.scan_pos < book_size && (millis() - t0) < budget_ms && !bh->isClosing())
+    {
+        size_t carry = s_build.carry_len;
+        memcpy(buf, s_build.carry, carry);
+        if (!book.seek(s_build.scan_pos))
+        {
+            failed = true;
+            break;
+        }
+        int n = book.read(buf + carry, SIDX_READ_CHUNK);
+        if (n <= 0)
+        {
+            failed = true;
+            break;
+        }
+        uint32_t base = s_build.scan_pos - (uint32_t)carry;
+        s_build.scan_pos += (uint32_t)n;
+        bool at_eof = s_build.scan_pos >= book_size;
+        size_t avail = carry + (size_t)n;
+        size_t off = 0;
+
+        while (off < avail)
+        {
+            uint32_t cp;
+            size_t len;
+            if (!decodeBookChar(buf + off, avail - off, s_build.enc, cp, len))
+            {
+                if (!at_eof)
+                    break;
+                cp = 0xFFFD; // 文件以不完整字符结尾
+                len = 1;
+            }
+            uint32_t pos = base + (uint32_t)off;
+
+            bool soft = s_build.block_bytes >= SIDX_BLOCK_TARGET && !s_build.tok.wordPending();
+            bool hard = s_build.block_bytes >= SIDX_BLOCK_HARD;
+            if (soft || hard)
+            {
+                bool run_full = (pos - s_build.run_text_start) >= SIDX_RUN_TARGET;
+                if ((run_full && soft) || s_build.block_starts.size() >= SIDX_MAX_BLOCKS_PER_RUN)
+                {
+                    // 跨 run 的 bigram 归属前一字所在块，先补发再提交
+                    if (s_build.tok.prev_wide && isIndexedWide(cp))
+                        emit(bigramKey(s_build.tok.prev_wide, cp), s_build.tok.prev_block, 0);
+                    s_build.tok.flushWord(emit);
+                    if (!commitRun(pos, false))
+                    {
+                        failed = true;
+                        break;
+                    }
+                    beginRun(pos);
+                }
+                else
+                {
+                    s_build.block_starts.push_back(pos);
+                    s_build.block_bytes = 0;
+                }
+            }
+
+            s_build.tok.feed(cp, (uint32_t)s_build.block_starts.size() - 1, pos, emit);
+            s_build.block_bytes += (uint32_t)len;
+            off += len;
+        }
+
+        s_build.carry_len = avail - off;
+        memcpy(s_build.carry, buf + off, s_build.carry_len);
+        did_work = true;
+    }
+
+    if (!failed && s_build.scan_pos >= book_size && !s_build.finished)
+    {
+        s_build.tok.flushWord(emit);
+        if (commitRun(book_size, true))
+        {
+            s_build.finished = true;
+            PairVec().swap(s_build.pairs);
+        }
+        else
+        {
+            failed = true;
+        }
+        did_work = true;
+    }
+
+    book.close();
+    bh->releaseFileLockPublic();
+
+    if (failed)
+    {
+        // 丢弃内存中的半个 run，下次从已提交位置重新开始
+#if DBG_BOOK_SEARCH
+        Serial.printf("[SIDX] build failed at %u, will resume from %u\n", (unsigned)s_build.scan_pos,
+                      (unsigned)s_build.hdr.text_committed);
+#endif
+        resetBuildState();
+    }
+    return did_work;
+}
+
+// ---------------------------------------------------------------------------
+// 查询
+// ---------------------------------------------------------------------------
+
+struct QueryKey
+{
+    uint32_t key;
+    uint32_t start; // 在查询串（书籍编码）中的字节偏移
+};
+
+struct RunInfo
+{
+    uint32_t offset;
+    uint32_t block_base; // 全局块号
+    uint32_t block_count;
+    uint32_t bucket_count;
+    uint32_t bucket_bits;
+};
+
+// 把 UTF-8 查询转换为书籍编码；存在无法映射的字符时返回 false
+static bool encodeQueryForBook(const std::string &utf8, TextEncoding enc, std::string &out)
+{
+    if (enc != TextEncoding::GBK)
+    {
+        out = utf8;
+        return true;
+    }
+    out.clear();
+    const uint8_t *p = (const uint8_t *)utf8.data();
+    size_t n = utf8.size(), i = 0;
+    while (i < n)
+    {
+        uint32_t cp;
+        size_t len;
+        if (!decodeBookChar(p + i, n - i, TextEncoding::UTF8, cp, len) || cp == 0xFFFD)
+            return false;
+        i += len;
+        if (cp < 0x80)
+        {
+            out += (char)cp;
+            continue;
+        }
+        uint16_t g = cp <= 0xFFFF ? unicode_to_gbk_lookup((uint16_t)cp) : 0;
+        if (!g)
+            return false;
+        out += (char)(g >> 8);
+        out += (char)(g & 0xFF);
+    }
+    return true;
+}
+
+// 在字符边界 p 处比较查询（ASCII 大小写不敏感；GBK 双字节整体比较，避免误折叠尾字节）
+static bool matchQueryAt(const uint8_t *p, size_t avail, const std::string &q, TextEncoding enc)
+{
+    if (avail < q.size())
+        return false;
+    const uint8_t *s = (const uint8_t *)q.data();
+    size_t i = 0;
+    while (i < q.size())
+    {
+        uint8_t a = s[i];
+        if (a < 0x80)
+        {
+            uint8_t b = p[i];
+            if (a >= 'A' && a <= 'Z')
+                a = (uint8_t)(a - 'A' + 'a');
+            if (b >= 'A' && b <= 'Z')
+                b = (uint8_t)(b - 'A' + 'a');
+            if (a != b)
+                return false;
+            ++i;
+        }
+        else if (enc == TextEncoding::GBK && i + 1 < q.size())
+        {
+            if (p[i] != a || p[i + 1] != s[i + 1])
+                return false;
+            i += 2;
+        }
+        else
+        {
+            if (p[i] != a)
+                return false;
+            ++i;
+        }
+    }
+    return true;
+}
+
+// 读取某 run 中 key 的块集合；返回 false 表示无法确定（调用方按“全部块”保守处理）
+static bool readPostings(File &f, const RunInfo &run, uint32_t key, std::vector<uint8_t> &blocks, ByteVec &scratch)
+{
+    blocks.clear();
+    uint32_t h = postingHash(key);
+    uint32_t bucket = bucketOf(h, run.bucket_bits);
+    uint32_t table_off = run.offset + sizeof(SidxRunHeader) + run.block_count * 4;
+    uint32_t range[2];
+    if (!f.seek(table_off + bucket * 4) || f.read((uint8_t *)range, 8) != 8 || range[1] < range[0])
+        return false;
+    uint32_t len = range[1] - range[0];
+    if (len == 0)
+        return true;
+    if (len > SIDX_MAX_BUCKET_BYTES)
+        return false;
+    uint32_t postings_off = table_off + (run.bucket_count + 1) * 4;
+    scratch.resize(len);
+    if (!f.seek(postings_off + range[0]) || f.read(scratch.data(), len) != (int)len)
+        return false;
+    uint32_t cur = bucketBase(bucket, run.bucket_bits);
+    size_t i = 0;
+    while (i < len)
+    {
+        uint32_t delta;
+        if (!getVarint(scratch.data(), len, i, delta) || i >= len)
+            return false;
+        cur += delta;
+        uint8_t cnt = scratch[i++];
+        if (i + cnt > len)
+            return false;
+        if (cur == h)
+        {
+            blocks.assign(scratch.begin() + i, scratch.begin() + i + cnt);
+            return true;
+        }
+        if (cur > h)
+            break;
+        i += cnt;
+    }
+    return true;
+}
+
+SearchIndexResult searchBookIndex(BookHandle *bh, const std::string &utf8_query,
+                                  std::vector<SearchHit> &hits, size_t max_hits)
+{
+    SearchIndexResult res;
+    hits.clear();
+    if (!bh || utf8_query.empty() || max_hits == 0)
+        return res;
+
+    std::string sidx_file = getSearchIndexFileName(bh->filePath());
+    File idx = SDW::SD.open(sidx_file.c_str(), "r");
+    if (!idx)
+        return res;
+    SidxHeader hdr;
+    if (!readSidxHeader(idx, hdr) || hdr.book_size != (uint32_t)bh->getFileSize() || hdr.run_count == 0)
+    {
+        idx.close();
+        return res;
+    }
+    TextEncoding enc = (TextEncoding)hdr.encoding;
+
+    std::string q;
+    if (!encodeQueryForBook(utf8_query, enc, q) || q.size() > SIDX_MAX_QUERY_BYTES)
+    {
+        idx.close();
+        return res;
+    }
+
+    // 用同一切分器得到查询关键字（记录其在查询串中的起点）
+    std::vector<QueryKey> keys;
+    {
+        SearchTokenizer tok;
+        auto collect = [&](uint32_t key, uint32_t, uint32_t start) {
+            for (const auto &k : keys)
+                if (k.key == key)
+                    return;
+            if (keys.size() < SIDX_MAX_QUERY_KEYS)
+                keys.push_back({key, start});
+        };
+        const uint8_t *p = (const uint8_t *)q.data();
+        size_t off = 0;
+        while (off < q.size())
+        {
+            uint32_t cp;
+            size_t len;
+            if (!decodeBookChar(p + off, q.size() - off, enc, cp, len))
+                break;
+            tok.feed(cp, 0, (uint32_t)off, collect);
+            off += len;
+        }
+        tok.flushWord(collect);
+    }
+    if (keys.empty())
+    {
+        idx.close();
+        return res;
+    }
+    res.used_index = true;
+    res.covered_end = hdr.text_committed;
+    // 首个关键字不在查询开头时，匹配起点可能位于其前一块
+    bool lead = keys[0].start > 0;
+
+    // 读取全部 run 的块边界（全局块号）
+    std::vector<RunInfo> runs;
+    std::vector<uint32_t> block_starts;
+    uint32_t off = sizeof(SidxHeader);
+    for (uint32_t r = 0; r < hdr.run_count && off < hdr.bytes_committed; ++r)
+    {
+        SidxRunHeader rh;
+        if (!idx.seek(off) || idx.read((uint8_t *)&rh, sizeof(rh)) != (int)sizeof(rh) ||
+            memcmp(rh.magic, SIDX_RUN_MAGIC, 4) != 0 || rh.block_count == 0 ||
+            rh.block_count > SIDX_MAX_BLOCKS_PER_RUN || rh.bucket_count == 0 ||
+            rh.bucket_count > (1u << SIDX_MAX_BUCKET_BITS) || (rh.bucket_count & (rh.bucket_count - 1)) != 0)
+            break;
+        uint32_t bits = 0;
+        while ((1u << bits) < rh.bucket_count)
+            ++bits;
+        RunInfo ri{off, (uint32_t)block_starts.size(), rh.block_count, rh.bucket_count, bits};
+        size_t old = block_starts.size();
+        block_starts.resize(old + rh.block_count);
+        if (idx.read((uint8_t *)&block_starts[old], rh.block_count * 4) != (int)(rh.block_count * 4))
+        {
+            block_starts.resize(old);
+            break;
+        }
+        runs.push_back(ri);
+        off += rh.run_bytes;
+    }
+    if (runs.empty())
+    {
+        idx.close();
+        res.used_index = false;
+        return res;
+    }
+
+    // 候选块：首关键字所在块，且其余关键字出现在同块或下一块（run 末块不过滤）
+    std::vector<uint32_t> candidates;
+    std::vector<uint8_t> blocks;
+    ByteVec scratch;
+    for (const RunInfo &run : runs)
+    {
+        uint64_t cand = 0;
+        if (!readPostings(idx, run, keys[0].key, blocks, scratch))
+            cand = run.block_count >= 64 ? ~0ull : ((1ull << run.block_count) - 1);
+        for (uint8_t b : blocks)
+            if (b < run.block_count)
+                cand |= 1ull << b;
+        for (size_t k = 1; k < keys.size() && cand; ++k)
+        {
+            if (!readPostings(idx, run, keys[k].key, blocks, scratch))
+                continue;
+            uint64_t present = 0;
+            for (uint8_t b : blocks)
+                if (b < run.block_count)
+                    present |= 1ull << b;
+            uint64_t last = 1ull << (run.block_count - 1);
+            cand &= present | (present >> 1) | last;
+        }
+        for (uint32_t b = 0; b < run.block_count; ++b)
+        {
+            if (!(cand & (1ull << b)))
+                continue;
+            uint32_t g = run.block_base + b;
+            if (lead && g > 0)
+                candidates.push_back(g - 1);
+            candidates.push_back(g);
+        }
+    }
+    idx.close();
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+#if DBG_BOOK_SEARCH
+    Serial.printf("[SIDX] query bytes=%u keys=%u runs=%u candidates=%u\n", (unsigned)q.size(),
+                  (unsigned)keys.size(), (unsigned)runs.size(), (unsigned)candidates.size());
+#endif
+    if (candidates.empty())
+        return res;
+
+    // 原文校验：从块起点逐字符解码，只在字符边界上比较
+    bool word_head = isAsciiAlnum((uint8_t)q.front());
+    bool word_tail = isAsciiAlnum((uint8_t)q.back());
+    if (!bh->tryAcquireFileLock(pdMS_TO_TICKS(500)))
+        return res;
+    File book = bh->openIndexingReadHandle();
+    if (!book)
+    {
+        bh->releaseFileLockPublic();
+        return res;
+    }
+
+    ByteVec text;
+    for (uint32_t g : candidates)
+    {
+        if (hits.size() >= max_hits)
+        {
+            res.truncated = true;
+            break;
+        }
+        uint32_t start = block_starts[g];
+        uint32_t end = (g + 1 < block_starts.size()) ? block_starts[g + 1] : hdr.text_committed;
+        if (end <= start)
+            continue;
+        uint32_t read_end = std::min<uint32_t>(end + (uint32_t)q.size(), hdr.book_size);
+        text.resize(read_end - start);
+        if (!book.seek(start) || book.read(text.data(), text.size()) != (int)text.size())
+            break;
+
+        uint32_t prev_cp = 0;
+        size_t p = 0;
+        while (p < (size_t)(end - start))
+        {
+            uint32_t cp;
+            size_t len;
+            if (!decodeBookChar(&text[p], text.size() - p, enc, cp, len))
+                break;
+            if (matchQueryAt(&text[p], text.size() - p, q, enc))
+            {
+                bool ok = true;
+                if (word_head && isAsciiAlnum(prev_cp))
+                    ok = false;
+                size_t after = p + q.size();
+                if (ok && word_tail && after < text.size() && text[after] < 0x80 && isAsciiAlnum(text[after]))
+                    ok = false;
+                if (ok)
+                {
+                    SearchHit h;
+                    h.file_pos = start + p;
+                    h.page_index = 0;
+                    h.page_valid = false;
+                    hits.push_back(h);
+                    if (hits.size() >= max_hits)
+                        break;
+                }
+            }
+            prev_cp = cp;
+            p += len;
+        }
+    }
+    book.close();
+    bh->releaseFileLockPublic();
+
+    // 释放文件锁后再映射页号（findPageIndexForPosition 可能需要加载分页）
+    for (SearchHit &h : hits)
+    {
+        size_t page_idx = 0;
+        h.page_valid = bh->findPageIndexForPosition(h.file_pos, page_idx);
+        h.page_index = page_idx;
+    }
+    return res;
+}
+
+static const size_t SNIPPET_LEAD_BYTES = 24;
+
+bool readSearchSnippets(BookHandle *bh, const std::vector<SearchHit> &hits, size_t first,
+                        std::vector<std::string> &out, size_t max_bytes)
+{
+    size_t n = first < hits.size() ? hits.size() - first : 0;
+    if (n == 0)
+        return true;
+    if (!bh || bh->isClosing() || !bh->tryAcquireFileLock(pdMS_TO_TICKS(200)))
+    {
+        out.resize(out.size() + n);
+        return false;
+    }
+    File f = bh->openIndexingReadHandle();
+    if (!f)
+    {
+        bh->releaseFileLockPublic();
+        out.resize(out.size() + n);
+        return false;
+    }
+    TextEncoding enc = resolveEncoding(bh, f);
+    size_t file_size = (size_t)f.size();
+
+    std::string raw;
+    for (size_t k = first; k < hits.size(); ++k)
+    {
+        size_t pos = std::min(hits[k].file_pos, file_size);
+        size_t start = (enc != TextEncoding::GBK && pos > SNIPPET_LEAD_BYTES) ? pos - SNIPPET_LEAD_BYTES : pos;
+        size_t len = std::min(max_bytes, file_size - start);
+        raw.resize(len);
+        if (len == 0 || !f.seek(start) || f.read((uint8_t *)&raw[0], len) != (int)len)
+        {
+            out.push_back(std::string());
+            continue;
+        }
+        // 头部跳过半个 UTF-8 字符，尾部截到最后一个完整字符
+        const uint8_t *p = (const uint8_t *)raw.data();
+        size_t b = 0;
+        while (b < pos - start && (p[b] & 0xC0) == 0x80)
+            ++b;
+        size_t e = b;
+        uint32_t cp;
+        size_t cl;
+        while (e < len && decodeBookChar(p + e, len - e, enc, cp, cl))
+            e += cl;
+        std::string text = convert_to_utf8(raw.substr(b, e - b), enc);
+        for (char &c : text)
+            if (c == '\r' || c == '\n' || c == '\t')
+                c = ' ';
+        out.push_back(std::move(text));
+    }
+    f.close();
+    bh->releaseFileLockPublic();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// 顺序扫描（BMH）
+// ---------------------------------------------------------------------------
+
+static const size_t SCAN_WINDOW_BYTES = 16 * 1024;
+
+static inline uint8_t foldAscii(uint8_t b)
+{
+    return (b >= 'A' && b <= 'Z') ? (uint8_t)(b - 'A' + 'a') : b;
+}
+
+void BookTextScanner::reset()
+{
+    bh_ = nullptr;
+    pattern_.clear();
+    folded_.clear();
+    pos_ = end_ = sync_ = 0;
+    std::vector<uint8_t>().swap(buf_);
+    cancel_.store(false);
+}
+
+bool BookTextScanner::begin(BookHandle *bh, const std::string &utf8_query, size_t start_pos, size_t end_pos)
+{
+    reset();
+    if (!bh || utf8_query.empty())
+        return false;
+
+    enc_ = bh->getEncoding();
+    if (enc_ == TextEncoding::AUTO_DETECT)
+    {
+        // 尽量复用索引头里记录的编码，避免再读一次文件
+        SidxHeader hdr;
+        if (loadSidxHeader(getSearchIndexFileName(bh->filePath()), hdr) && hdr.encoding <= (uint8_t)TextEncoding::GBK)
+            enc_ = (TextEncoding)hdr.encoding;
+        else if (bh->tryAcquireFileLock(pdMS_TO_TICKS(200)))
+        {
+            File f = bh->openIndexingReadHandle();
+            enc_ = f ? resolveEncoding(bh, f) : TextEncoding::UTF8;
+            if (f)
+                f.close();
+            bh->releaseFileLockPublic();
+        }
+        else
+            enc_ = TextEncoding::UTF8;
+    }
+
+    if (!encodeQueryForBook(utf8_query, enc_, pattern_) || pattern_.empty() || pattern_.size() > SIDX_MAX_QUERY_BYTES)
+    {
+        pattern_.clear();
+        return false;
+    }
+
+    size_t m = pattern_.size();
+    folded_.resize(m);
+    for (size_t i = 0; i < m; ++i)
+        folded_[i] = (char)foldAscii((uint8_t)pattern_[i]);
+    for (int c = 0; c < 256; ++c)
+        shift_[c] = (uint16_t)m;
+    for (size_t i = 0; i + 1 < m; ++i)
+        shift_[(uint8_t)folded_[i]] = (uint16_t)(m - 1 - i);
+    // 大写字节与小写共享跳转距离（文本侧查表前同样折叠）
+    for (int c = 'A'; c <= 'Z'; ++c)
+        shift_[c] = shift_[c - 'A' + 'a'];
+
+    size_t file_size = bh->getFileSize();
+    bh_ = bh;
+    end_ = std::min(end_pos, file_size);
+    pos_ = sync_ = std::min(start_pos, end_);
+    return true;
+}
+
+// GBK：从已知边界 sync_ 按字符步进到 >= target（只看首字节判定单/双字节，不查表）
+void BookTextScanner::advanceSync(size_t target, const uint8_t *win, size_t win_start, size_t win_len)
+{
+    while (sync_ < target && sync_ >= win_start && sync_ - win_start < win_len)
+    {
+        uint8_t b = win[sync_ - win_start];
+        sync_ += (b >= 0x81 && b <= 0xFE) ? 2 : 1;
+    }
+}
+
+BookTextScanner::Status BookTextScanner::step(std::vector<SearchHit> &out, uint32_t budget_ms, size_t max_new_hits)
+{
+    if (!bh_ || pattern_.empty())
+        return Status::Error;
+    if (cancel_.load())
+        return Status::Cancelled;
+    if (pos_ >= end_)
+        return Status::Done;
+    if (bh_->isClosing())
+        return Status::Error;
+
+    // UI 持锁（翻页/渲染）时直接让出，下次再来
+    if (!bh_->tryAcquireFileLock(0))
+        return Status::More;
+    File f = bh_->openIndexingReadHandle();
+    if (!f)
+    {
+        bh_->releaseFileLockPublic();
+        return Status::Error;
+    }
+
+    const size_t m = pattern_.size();
+    const uint8_t *pf = (const uint8_t *)folded_.data();
+    const bool gbk = enc_ == TextEncoding::GBK;
+    if (buf_.size() < SCAN_WINDOW_BYTES)
+        buf_.resize(SCAN_WINDOW_BYTES);
+
+    size_t first_new = out.size();
+    size_t new_hits = 0;
+    bool failed = false;
+    unsigned long t0 = millis();
+
+    while (pos_ < end_ && new_hits < max_new_hits && !cancel_.load() && (millis() - t0) < budget_ms)
+    {
+        size_t ws = pos_;
+        size_t want = std::min(SCAN_WINDOW_BYTES, end_ - ws);
+        if (want < m)
+        {
+            pos_ = sync_ = end_;
+            break;
+        }
+        if (!f.seek(ws) || f.read(buf_.data(), want) != (int)want)
+        {
+            failed = true;
+            break;
+        }
+        const uint8_t *t = buf_.data();
+        size_t last = want - m; // 窗口内最后一个可能的起点
+        size_t next_pos = (ws + want >= end_) ? end_ : ws + last + 1;
+
+        size_t i = 0;
+        while (i <= last)
+        {
+            size_t j = m;
+            while (j > 0 && foldAscii(t[i + j - 1]) == pf[j - 1])
+                --j;
+            if (j == 0 && matchQueryAt(t + i, want - i, pattern_, enc_))
+            {
+                bool aligned = true;
+                if (gbk)
+                {
+                    advanceSync(ws + i, t, ws, want);
+                    aligned = sync_ == ws + i;
+                }
+                if (aligned)
+                {
+                    SearchHit h;
+                    h.file_pos = ws + i;
+                    h.page_index = 0;
+                    h.page_valid = false;
+                    out.push_back(h);
+                    if (++new_hits >= max_new_hits)
+                    {
+                        next_pos = ws + i + 1;
+                        break;
+                    }
+                }
+            }
+            i += shift_[t[i + m - 1]];
+        }
+
+        pos_ = next_pos;
+        if (gbk)
+            advanceSync(pos_, t, ws, want);
+    }
+
+    f.close();
+    bh_->releaseFileLockPublic();
+
+    // 释放文件锁后再映射页号
+    for (size_t k = first_new; k < out.size(); ++k)
+    {
+        size_t page_idx = 0;
+        out[k].page_valid = bh_->findPageIndexForPosition(out[k].file_pos, page_idx);
+        out[k].page_index = page_idx;
+    }
+
+    if (failed)
+        return Status::Error;
+    if (cancel_.load())
+        return Status::Cancelled;
+    if (pos_ >= end_)
+    {
+        std::vector<uint8_t>().swap(buf_);
+        return Status::Done;
+    }
+    return Status::More;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include "text_handle.h"
+
+class BookHandle;
+
+// 全文检索：n-gram 倒排索引（.sidx）
+//
+// 索引与分页无关（只依赖书籍原始字节与编码），因此换字体/重新分页时无需重建；
+// 书籍文件大小变化或书籍被删除时失效。
+//
+// 切分规则（建索引与查询使用同一套）：
+//   - 非 ASCII 可见字符（汉字、假名、全角字母等）：相邻两字构成 bigram
+//   - ASCII 字母/数字：按整词（小写）取哈希
+//   - 空白与标点只作为分隔符，不入索引
+// 文本按 ~4KB 的块登记，每 256KB 文本为一个独立 run（自带桶表），
+// run 写完即落盘，因此后台构建可以在任意 run 边界中断并续建。
+//
+// .sidx 格式（v2）：
+//   header(32B): "RPSX" | u8 version | u8 encoding | u16 reserved | u32 book_size | u32 text_committed
+//                | u32 run_count | u32 bytes_committed | u32 complete | u32 reserved
+//   run: header(32B) "RUN1" | u32 text_start | u32 text_end | u32 block_count | u32 bucket_count
+//        | u32 postings_bytes | u32 run_bytes | u32 reserved
+//        | u32 block_start[block_count] | u32 bucket_off[bucket_count + 1]
+//        | postings: { varint dh | u8 n | u8 local_block[n] } ...
+//   h = mix32(key ^ 0xA5A5A5A5)（可逆）；bucket_count = 2^bits 随 run 的规模取值（≤ 8192），桶号为 h 的高 bits 位；
+//   桶内按 h 升序，dh 为与前一项（桶内首项为桶起点 bucket << (32 - bits)）之差。
+
+struct SearchHit
+{
+    size_t file_pos;    // 匹配起点的文件字节偏移
+    size_t page_index;  // 所在页（findPageIndexForPosition 映射）
+    bool page_valid;    // page_index 是否有效（分页尚未覆盖该位置时为 false）
+};
+
+// 检索结果说明
+struct SearchIndexResult
+{
+    bool used_index = false;  // 索引可用且查询可被切分出关键字
+    bool truncated = false;   // 命中数达到 max_hits 上限
+    size_t covered_end = 0;   // 已被索引覆盖的文本终点；[covered_end, file_size) 需由调用方顺序扫描
+};
+
+// /bookmarks/<safe>.sidx
+std::string getSearchIndexFileName(const std::string &book_file_path);
+
+// 删除同名 .sidx（书籍删除时调用）
+bool clearSearchIndexForFile(const std::string &book_file_path);
+
+// 索引是否已覆盖整本书
+bool isSearchIndexComplete(const std::string &book_file_path);
+
+// 后台增量构建：在 budget_ms 内推进，返回是否做了有效工作。
+// 仅应在分页索引完成后由后台索引循环调用；内部以 tryAcquireFileLock(0) 让路给 UI。
+bool backgroundBuildSearchIndexIncremental(BookHandle *bh, uint32_t budget_ms);
+
+// 使用索引查询 utf8_query。命中按文件位置升序写入 hits（最多 max_hits 条）。
+// 查询中没有可检索关键字（例如只有单个汉字或只有标点）时 used_index=false，调用方应改用顺序扫描。
+// ASCII 大小写不敏感，且 ASCII 词按整词匹配。
+SearchIndexResult searchBookIndex(BookHandle *bh, const std::string &utf8_query,
+                                  std::vector<SearchHit> &hits, size_t max_hits);
+
+// 为 hits[first..] 各读一小段命中处原文（转为 UTF-8，换行折叠为空格），追加到 out，供结果列表显示。
+// UTF-8 书从命中前约 24 字节开始取，GBK 书从命中处开始（无法安全回退到字符边界）。
+// 取不到文件锁（UI 正在翻页）时为这些命中追加空串并返回 false。
+bool readSearchSnippets(BookHandle *bh, const std::vector<SearchHit> &hits, size_t first,
+                        std::vector<std::string> &out, size_t max_bytes = 96);
+
+// 顺序扫描（索引尚未建好时的回退检索）：直接在原始 GBK/UTF-8 字节上做 Boyer-Moore-Horspool，
+// 每次 step 只推进一个时间片，且用 tryAcquireFileLock(0) 取锁，取不到就让出，不阻塞翻页。
+// 子串语义（不要求整词），ASCII 大小写不敏感。命中按位置升序增量输出，可随时 cancel，
+// 之后用 resumePos() 作为新的 start_pos 重新 begin 即可续扫。
+class BookTextScanner
+{
+public:
+    enum class Status
+    {
+        More,      // 还有未扫描的范围
+        Done,      // 已扫到 end_pos
+        Cancelled, // 被 cancel() 打断
+        Error      // 查询无效或读取失败
+    };
+
+    // start_pos 须为字符边界（页起点、上一次的 resumePos() 或 SearchIndexResult::covered_end）
+    bool begin(BookHandle *bh, const std::string &utf8_query, size_t start_pos = 0, size_t end_pos = SIZE_MAX);
+    // 扫描至多 budget_ms，新命中追加到 out（单次最多 max_new_hits 条）
+    Status step(std::vector<SearchHit> &out, uint32_t budget_ms, size_t max_new_hits = 32);
+    // 可在其他任务中调用；下一次 step 在窗口之间检查
+    void cancel() { cancel_.store(true); }
+    // 下一个可能的匹配起点（GBK 下保证为字符边界）
+    size_t resumePos() const { return enc_ == TextEncoding::GBK ? sync_ : pos_; }
+    size_t endPos() const { return end_; }
+    bool isActive() const { return bh_ != nullptr; }
+    void reset();
+
+private:
+    void advanceSync(size_t target, const uint8_t *win, size_t win_start, size_t win_len);
+
+    BookHandle *bh_ = nullptr;
+    std::string pattern_;       // 书籍编码下的查询字节
+    std::string folded_;        // ASCII 折叠为小写后的查询字节（用于 BMH 预筛）
+    uint16_t shift_[256];
+    TextEncoding enc_ = TextEncoding::UTF8;
+    size_t pos_ = 0;            // 下一个窗口的起点（此前的匹配均已输出）
+    size_t end_ = 0;
+    size_t sync_ = 0;           // GBK：不小于 pos_ 的已知字符边界
+    std::vector<uint8_t> buf_;  // 读窗口
+    std::atomic<bool> cancel_{false};
+};
@@ -1,9 +1,11 @@
 #include "font_buffer.h"
+#include "glyph_atlas.h"
+#include "glyph_fetch.h"
 #include "text/book_handle.h"
 #include "text/text_handle.h"
 #include "text/bin_font_print.h"
 #include "SD/SDWrapper.h"
-#include <unordered_map>
+#include "readpaper.h"
 #include <algorithm>
 #include <Arduino.h>
 #include <SPIFFS.h>
@@ -20,9 +22,6 @@ PageFontCache g_bookname_char_cache;
 // TOC（目录）专用字体缓存
 PageFontCache g_toc_char_cache;
 
-// 通用回收池缓存（回收其他缓存释放的字符）
-PageFontCache g_common_recycle_pool;
-
 // 获取通用字符列表
 std::string getCommonCharList()
 {
@@ -40,7 +39,7 @@ std::string getCommonCharList()
 // ========== PageFontCache 实现 ==========
 
 PageFontCache::PageFontCache()
-    : buffer_(nullptr), header_(nullptr), index_area_(nullptr), bitmap_area_(nullptr)
+    : generation_(0)
 {
 }
 
@@ -51,147 +50,77 @@ PageFontCache::~PageFontCache()
 
 void PageFontCache::clear()
 {
-    if (buffer_)
+    // 图集已重置（换字体）时旧的钉住记录随之作废，无需也不能再释放
+    if (!chars_.empty() && generation_ == g_glyph_atlas.generation())
     {
-        // 在释放前，回收字符到通用回收池
-        recycleCharsToPool(this);
-
-        free(buffer_);
-        buffer_ = nullptr;
-        header_ = nullptr;
-        index_area_ = nullptr;
-        bitmap_area_ = nullptr;
+        for (uint16_t unicode : chars_)
+            g_glyph_atlas.release(unicode);
     }
+    chars_.clear();
     stats_ = {};
 }
 
-size_t PageFontCache::getCharCount() const
+bool PageFontCache::isValid() const
 {
-    if (!header_)
-        return 0;
-    return header_->char_count;
+    return !chars_.empty() && generation_ == g_glyph_atlas.generation();
 }
 
-size_t PageFontCache::getTotalSize() const
+size_t PageFontCache::getCharCount() const
 {
-    if (!header_)
-        return 0;
-    return header_->total_size;
+    return isValid() ? chars_.size() : 0;
 }
 
-// 从UTF-8文本中提取唯一的Unicode字符（返回使用 PSRAMAllocator 的向量）
-std::vector<uint16_t, PSRAMAllocator<uint16_t>> PageFontCache::extractUniqueChars(const std::string &page_text)
+size_t PageFontCache::getTotalSize() const
 {
-    std::unordered_set<uint16_t> unique_set;
-    std::vector<uint16_t, PSRAMAllocator<uint16_t>> result;
-
-    const uint8_t *p = reinterpret_cast<const uint8_t *>(page_text.c_str());
-    const uint8_t *end = p + page_text.size();
-
-    while (p < end)
+    size_t total = 0;
+    for (size_t i = 0; i < getCharCount(); i++)
     {
-        uint32_t unicode = 0;
-        int bytes = 0;
-
-        // 解析UTF-8字符
-        if (*p < 0x80)
-        {
-            // ASCII (1 byte)
-            unicode = *p;
-            bytes = 1;
-        }
-        else if ((*p & 0xE0) == 0xC0)
-        {
-            // 2 bytes
-            if (p + 1 < end)
-            {
-                unicode = ((*p & 0x1F) << 6) | (*(p + 1) & 0x3F);
-                bytes = 2;
-            }
-        }
-        else if ((*p & 0xF0) == 0xE0)
-        {
-            // 3 bytes
-            if (p + 2 < end)
-            {
-                unicode = ((*p & 0x0F) << 12) | ((*(p + 1) & 0x3F) << 6) | (*(p + 2) & 0x3F);
-                bytes = 3;
-            }
-        }
-        else if ((*p & 0xF8) == 0xF0)
-        {
-            // 4 bytes (但我们只支持BMP，这里忽略)
-            bytes = 4;
-        }
-
-        if (bytes > 0)
-        {
-            p += bytes;
-            // 只保留BMP字符（0x0000-0xFFFF）
-            if (unicode <= 0xFFFF && unicode > 0)
-            {
-                uint16_t unicode16 = static_cast<uint16_t>(unicode);
-                if (unique_set.insert(unicode16).second)
-                {
-                    result.push_back(unicode16);
-                }
-            }
-        }
-        else
-        {
-            // 解析失败，跳过
-            p++;
-        }
+        const CharGlyphInfo *info = g_glyph_atlas.find(chars_[i]);
+        if (info)
+            total += info->bitmap_size;
     }
-
-    // 按Unicode排序，便于后续二分查找
-    std::sort(result.begin(), result.end());
-    return result;
+    return total;
 }
 
-// 计算所需的缓冲区大小，并填充字形信息（chars/glyph_infos 使用 PSRAMAllocator）
-size_t PageFontCache::calculateBufferSize(const std::vector<uint16_t, PSRAMAllocator<uint16_t>> &chars,
-                                          std::vector<CharGlyphInfo, PSRAMAllocator<CharGlyphInfo>> &glyph_infos)
+bool PageFontCache::pinChars(const std::vector<uint16_t, PSRAMAllocator<uint16_t>> &sorted_chars, size_t limit)
 {
-    glyph_infos.clear();
-    glyph_infos.reserve(chars.size());
-
-    size_t bitmap_total_size = 0;
-
-    for (uint16_t unicode : chars)
-    {
-        // 从字体中查找字符信息
-        const BinFontChar *fc = find_char(unicode);
-        if (!fc)
-        {
-            // 字符不存在于字体中，跳过
-            continue;
-        }
-
-        CharGlyphInfo info;
-        info.unicode = unicode;
-        info.width = fc->width;
-        info.bitmapW = fc->bitmapW;
-        info.bitmapH = fc->bitmapH;
-        info.x_offset = fc->x_offset;
-        info.y_offset = fc->y_offset;
-        info.bitmap_size = fc->bitmap_size;
-        info.bitmap_offset = bitmap_total_size; // 累计偏移
-
-        glyph_infos.push_back(info);
-        bitmap_total_size += fc->bitmap_size;
+    uint32_t start_ms = millis();
+    std::vector<uint16_t, PSRAMAllocator<uint16_t>> pinned;
+    pinned.reserve(std::min(sorted_chars.size(), limit));
+    PageFontCacheStats stats{};
+    stats.unique_chars = sorted_chars.size();
+
+    // 先把缺的字形合并成少数几次大块读取放入图集，下面的 acquire 基本都能直接命中
+    uint32_t fetched = g_glyph_fetch.fetchNow(sorted_chars, limit);
+    stats.loaded_from_sd = fetched;
+
+    for (uint16_t unicode : sorted_chars)
+    {
+        if (pinned.size() >= limit)
+            break;
+        bool from_sd = false;
+        if (!g_glyph_atlas.acquire(unicode, &from_sd))
+            continue; // 字体中没有该字，或图集已满
+        pinned.push_back(unicode);
+        if (from_sd)
+            stats.loaded_from_sd++;
+        else
+            stats.reused_from_cache++;
     }
+    // 刚合并读入的字形在 acquire 看来已常驻，计回 SD 读取
+    stats.reused_from_cache -= std::min(stats.reused_from_cache, fetched);
 
-    // 计算总大小：头部 + 索引区 + 位图区
-    size_t header_size = sizeof(PageFontCacheHeader);
-    size_t index_size = glyph_infos.size() * sizeof(CharGlyphInfo);
-    size_t total_size = header_size + index_size + bitmap_total_size;
-
-    return total_size;
+    clear();
+    chars_.swap(pinned);
+    generation_ = g_glyph_atlas.generation();
+    stats.total_chars = chars_.size();
+    stats.build_ms = millis() - start_ms;
+    stats_ = stats;
+    return !chars_.empty();
 }
 
 // 构建页面字体缓存
-bool PageFontCache::build(BookHandle *book, size_t page_index)
+bool PageFontCache::build(BookHandle *book, size_t page_index, bool defer_io)
 {
     if (!book || !book->isOpen())
     {
@@ -208,277 +137,98 @@ bool PageFontCache::build(BookHandle *book, size_t page_index)
         return false;
     }
 
-    // 清理旧缓存
-    clear();
-
-    // 1. 读取页面内容（不触发缓存更新）
+    // 1. 页码检查
     size_t total_pages = book->getTotalPages();
     if (page_index >= total_pages)
     {
+        clear();
         Serial.printf("[FontCache] Error: Page index %u out of range (total=%u)\n",
                       (unsigned)page_index, (unsigned)total_pages);
         return false;
     }
 
-    // 【关键】：临时锁定缓存初始化，避免递归更新
-    extern FontBufferManager g_font_buffer_manager;
-    bool was_locked = g_font_buffer_manager.isInitializationLocked();
-    g_font_buffer_manager.setInitializationLocked(true);
-
-    TextPageResult page_result;
-    // 保存当前位置
-    size_t saved_page_index = book->getCurrentPageIndex();
-
-    // 临时跳转到目标页面（不触发缓存更新）
-    if (page_index != saved_page_index)
-    {
-        book->jumpToPage(page_index);
-    }
-    page_result = book->currentPage();
-
-    // 恢复原位置
-    if (page_index != saved_page_index)
-    {
-        book->jumpToPage(saved_page_index);
-    }
-
-    // 解除锁定
-    g_font_buffer_manager.setInitializationLocked(was_locked);
-
-    if (!page_result.success || page_result.page_text.empty())
+    // 2. 页面用到的唯一字符：优先取分页时记录的 .pgg（不读正文）；
+    //    尚未记录时取该页的排版结果（与渲染共用，窗口内每页只读取、分析一次）
+    std::vector<uint16_t, PSRAMAllocator<uint16_t>> sidecar_chars;
+    std::shared_ptr<const PageLayout> layout;
+    const std::vector<uint16_t, PSRAMAllocator<uint16_t>> *chars = &sidecar_chars;
+    if (!book->getPageGlyphs(page_index, sidecar_chars))
     {
-        Serial.printf("[FontCache] Error: Failed to read page %u\n", (unsigned)page_index);
-        return false;
+        layout = book->getPageLayout(page_index);
+        if (!layout || layout->text.empty())
+        {
+            clear();
+            Serial.printf("[FontCache] Error: Failed to read page %u\n", (unsigned)page_index);
+            return false;
+        }
+        chars = &layout->glyphs;
     }
-
-    // 2. 提取唯一字符（存放在 PSRAM）
-    std::vector<uint16_t, PSRAMAllocator<uint16_t>> unique_chars = extractUniqueChars(page_result.page_text);
+    const std::vector<uint16_t, PSRAMAllocator<uint16_t>> &unique_chars = *chars;
     if (unique_chars.empty())
     {
+        clear();
         Serial.printf("[FontCache] Warning: Page %u has no valid characters\n", (unsigned)page_index);
         return false;
     }
 
-    // 3. 计算所需缓冲区大小（glyph_infos 存放在 PSRAM）
-    std::vector<CharGlyphInfo, PSRAMAllocator<CharGlyphInfo>> glyph_infos;
-    size_t total_size = calculateBufferSize(unique_chars, glyph_infos);
-
-    if (glyph_infos.empty())
+    if (!g_bin_font.fontFile)
     {
-        Serial.printf("[FontCache] Warning: Page %u has no glyphs in font\n", (unsigned)page_index);
+        clear();
+        Serial.println("[FontCache] Error: Font file not open");
         return false;
     }
 
-    // 4. 分配缓冲区（使用PSRAM以节省内部DRAM）
-    buffer_ = static_cast<uint8_t *>(heap_caps_malloc(total_size, MALLOC_CAP_SPIRAM));
-    if (!buffer_)
+    // 3. 周边页：有字形要读 SD 时交给 I/O 任务，本次不钉住，等下次预取时字形已常驻再钉住
+    if (defer_io && g_glyph_fetch.countMissing(unique_chars) > 0 && g_glyph_fetch.submit(unique_chars))
     {
-        // PSRAM分配失败，尝试使用内部RAM
-        buffer_ = static_cast<uint8_t *>(malloc(total_size));
-        if (!buffer_)
-        {
-            Serial.printf("[FontCache] Error: Failed to allocate %u bytes for page %u\n",
-                          (unsigned)total_size, (unsigned)page_index);
-            return false;
-        }
 #if DBG_FONT_BUFFER
-        Serial.printf("[FontCache] Warning: Using internal RAM for page %u cache (%u bytes)\n",
-                      (unsigned)page_index, (unsigned)total_size);
+        Serial.printf("[FontCache] Page %u glyphs queued for async fetch\n", (unsigned)page_index);
 #endif
-    }
-
-    // 5. 初始化头部
-    header_ = reinterpret_cast<PageFontCacheHeader *>(buffer_);
-    header_->total_size = total_size;
-    header_->char_count = glyph_infos.size();
-    header_->index_offset = sizeof(PageFontCacheHeader);
-    header_->bitmap_offset = header_->index_offset + glyph_infos.size() * sizeof(CharGlyphInfo);
-
-    // 6. 填充索引区
-    index_area_ = reinterpret_cast<CharGlyphInfo *>(buffer_ + header_->index_offset);
-    memcpy(index_area_, glyph_infos.data(), glyph_infos.size() * sizeof(CharGlyphInfo));
-
-    // 7. 填充位图区
-    bitmap_area_ = buffer_ + header_->bitmap_offset;
-
-    // 从SD卡字体文件读取每个字符的位图数据
-    if (!g_bin_font.fontFile)
-    {
-        Serial.println("[FontCache] Error: Font file not open");
-        free(buffer_);
-        buffer_ = nullptr;
-        header_ = nullptr;
-        index_area_ = nullptr;
-        bitmap_area_ = nullptr;
         return false;
     }
 
-    // 构建位图区，优先复用其他页面缓存
-    stats_ = {}; // reset
-    uint32_t start_ms = millis();
-    stats_.unique_chars = glyph_infos.size();
-
-    // 获取字体文件互斥锁
-    extern SemaphoreHandle_t bin_font_get_file_mutex();
-    SemaphoreHandle_t mutex = bin_font_get_file_mutex();
-
-    for (size_t i = 0; i < glyph_infos.size(); i++)
+    // 4. 在图集中钉住本页字形：已常驻的直接复用，其余合并读取
+    if (!pinChars(unique_chars))
     {
-        const CharGlyphInfo &info = glyph_infos[i];
-
-        // 从字体中获取原始字符信息（包含文件偏移）
-        const BinFontChar *fc = find_char(info.unicode);
-        if (!fc || fc->bitmap_size == 0)
-        {
-            continue;
-        }
-
-        uint8_t *dest = bitmap_area_ + info.bitmap_offset;
-
-        // 尝试从其他缓存复用位图
-        const uint8_t *cached = g_font_buffer_manager.getCharBitmapAny(info.unicode);
-        // 避免使用当前正在构建的缓存中的未初始化数据
-        if (cached && !(cached >= buffer_ && cached < buffer_ + header_->total_size))
-        {
-            memcpy(dest, cached, fc->bitmap_size);
-            stats_.reused_from_cache++;
-            continue;
-        }
-
-        // 缓存未命中，从SD卡读取（使用互斥锁保护）
-        bool got_lock = false;
-        if (mutex != nullptr)
-        {
-            got_lock = (xSemaphoreTake(mutex, pdMS_TO_TICKS(100)) == pdTRUE);
-        }
-
-        size_t read_bytes = SDW::SD.readAtOffset(g_bin_font.fontFile,
-                                                 fc->bitmap_offset,
-                                                 dest,
-                                                 fc->bitmap_size);
-
-        if (got_lock)
-        {
-            xSemaphoreGive(mutex);
-        }
-
-        stats_.loaded_from_sd++;
-
-        if (read_bytes != fc->bitmap_size)
-        {
-            Serial.printf("[FontCache] Warning: Failed to read glyph for U+%04X (expected %u, got %u)\n",
-                          info.unicode, fc->bitmap_size, (unsigned)read_bytes);
-        }
+        Serial.printf("[FontCache] Warning: Page %u has no glyphs in font\n", (unsigned)page_index);
+        return false;
     }
 
-    stats_.build_ms = millis() - start_ms;
-    stats_.total_chars = header_->char_count;
-
 #if DBG_FONT_BUFFER
-    Serial.printf("[FontCache] Built cache for page %u: %u chars, %u bytes (reuse=%u, sd=%u, %ums)\n",
-                  (unsigned)page_index, (unsigned)glyph_infos.size(), (unsigned)total_size,
+    Serial.printf("[FontCache] Built cache for page %u: %u chars (reuse=%u, sd=%u, %ums)\n",
+                  (unsigned)page_index, (unsigned)chars_.size(),
                   (unsigned)stats_.reused_from_cache, (unsigned)stats_.loaded_from_sd,
                   (unsigned)stats_.build_ms);
-
 #endif
     return true;
 }
 
 bool PageFontCache::hasChar(uint16_t unicode) const
 {
-    if (!header_ || !index_area_)
+    if (!isValid())
         return false;
-
-    // 优化的二分查找（减少分支判断）
-    size_t count = header_->char_count;
-    size_t first = 0;
-    
-    while (count > 0)
-    {
-        size_t step = count >> 1;  // count / 2
-        size_t mid = first + step;
-        
-        if (index_area_[mid].unicode < unicode)
-        {
-            first = mid + 1;
-            count -= step + 1;
-        }
-        else
-        {
-            count = step;
-        }
-    }
-    
-    return (first < header_->char_count && index_area_[first].unicode == unicode);
+    return std::binary_search(chars_.begin(), chars_.end(), unicode);
 }
 
 const CharGlyphInfo *PageFontCache::getCharGlyphInfo(uint16_t unicode) const
 {
-    if (!header_ || !index_area_)
-        return nullptr;
-
-    // 优化的二分查找（减少分支判断）
-    size_t count = header_->char_count;
-    size_t first = 0;
-    
-    while (count > 0)
-    {
-        size_t step = count >> 1;  // count / 2
-        size_t mid = first + step;
-        
-        if (index_area_[mid].unicode < unicode)
-        {
-            first = mid + 1;
-            count -= step + 1;
-        }
-        else
-        {
-            count = step;
-        }
-    }
-    
-    return (first < header_->char_count && index_area_[first].unicode == unicode) ? &index_area_[first] : nullptr;
+    return hasChar(unicode) ? g_glyph_atlas.find(unicode) : nullptr;
 }
 
 const CharGlyphInfo *PageFontCache::getCharGlyphInfoByIndex(size_t index) const
 {
-    if (!header_ || !index_area_ || index >= header_->char_count)
+    if (index >= getCharCount())
     {
         return nullptr;
     }
-    return &index_area_[index];
-}
-
-const uint8_t *PageFontCache::getCharBitmap(uint16_t unicode) const
-{
-    const CharGlyphInfo *info = getCharGlyphInfo(unicode);
-    if (!info || !bitmap_area_)
-        return nullptr;
-
-    return bitmap_area_ + info->bitmap_offset;
+    return g_glyph_atlas.find(chars_[index]);
 }
 
 void PageFontCache::swapWith(PageFontCache &other)
 {
-    std::swap(buffer_, other.buffer_);
-    std::swap(header_, other.header_);
-    std::swap(index_area_, other.index_area_);
-    std::swap(bitmap_area_, other.bitmap_area_);
-}
-
-void PageFontCache::setCache(uint8_t *buffer, PageFontCacheHeader *header,
-                             CharGlyphInfo *index_area, uint8_t *bitmap_area,
-                             uint32_t build_ms, uint32_t loaded_from_sd,
-                             uint32_t unique_chars, uint32_t total_chars)
-{
-    buffer_ = buffer;
-    header_ = header;
-    index_area_ = index_area;
-    bitmap_area_ = bitmap_area;
-    stats_.build_ms = build_ms;
-    stats_.loaded_from_sd = loaded_from_sd;
-    stats_.unique_chars = unique_chars;
-    stats_.total_chars = total_chars;
+    chars_.swap(other.chars_);
+    std::swap(generation_, other.generation_);
+    std::swap(stats_, other.stats_);
 }
 
 // ========== FontBufferManager 实现 ==========
@@ -584,7 +334,8 @@ bool FontBufferManager::initialize(BookHandle *book, size_t current_page_index)
         }
 
         // 构建缓存
-        bool success = caches_[cache_idx].build(book, static_cast<size_t>(target_page));
+        // 只有当前页同步读取，周边页的字形交给 I/O 任务
+        bool success = caches_[cache_idx].build(book, static_cast<size_t>(target_page), offset != 0);
         if (success)
         {
             if (log_enabled_)
@@ -594,7 +345,7 @@ bool FontBufferManager::initialize(BookHandle *book, size_t current_page_index)
         else
         {
             if (log_enabled_)
-                Serial.printf("[FontBufferManager]   Cache[%d] (offset %+d, page %lld): FAILED\n",
+                Serial.printf("[FontBufferManager]   Cache[%d] (offset %+d, page %lld): QUEUED/FAILED\n",
                               cache_idx, offset, target_page);
         }
     }
@@ -715,117 +466,17 @@ const CharGlyphInfo *FontBufferManager::getCharGlyphInfo(uint16_t unicode, int p
     return caches_[cache_idx].getCharGlyphInfo(unicode);
 }
 
-const uint8_t *FontBufferManager::getCharBitmap(uint16_t unicode, int page_offset) const
+bool FontBufferManager::copyCharBitmap(uint16_t unicode, uint8_t *out, size_t size) const
 {
-    // 优化：优先查找最可能命中的页面缓存（快速路径）
-    if (initialized_ && isValidPageOffset(page_offset))
-    {
-        int cache_idx = getCacheIndex(page_offset);
-        const uint8_t *bmp = caches_[cache_idx].getCharBitmap(unicode);
-        if (bmp)
-        {
-            stats_.hits++;
-            return bmp;
-        }
-    }
-
-    // 查找通用缓存（高频字符）
-    if (g_common_char_cache.isValid())
-    {
-        const uint8_t *bmp = g_common_char_cache.getCharBitmap(unicode);
-        if (bmp)
-        {
-            stats_.hits++;
-            return bmp;
-        }
-    }
-
-    // 查找通用回收池
-    if (g_common_recycle_pool.isValid())
-    {
-        const uint8_t *bmp = g_common_recycle_pool.getCharBitmap(unicode);
-        if (bmp)
-        {
-            stats_.hits++;
-            return bmp;
-        }
-    }
-
-    // 查找TOC缓存
-    if (g_toc_char_cache.isValid())
-    {
-        const uint8_t *bmp = g_toc_char_cache.getCharBitmap(unicode);
-        if (bmp)
-        {
-            stats_.hits++;
-            return bmp;
-        }
-    }
-
-    // 查找书籍文件名缓存
-    if (g_bookname_char_cache.isValid())
+    // 页面窗口、通用/TOC/书名缓存以及近期页面释放的字形都在同一图集中
+    if (initialized_ && g_glyph_atlas.copyBitmap(unicode, out, size))
     {
-        const uint8_t *bmp = g_bookname_char_cache.getCharBitmap(unicode);
-        if (bmp)
-        {
-            stats_.hits++;
-            return bmp;
-        }
+        stats_.hits++;
+        return true;
     }
 
     stats_.misses++;
-    return nullptr;
-} // 从任意有效缓存中查找位图（用于构建新缓存时复用）
-const uint8_t *FontBufferManager::getCharBitmapAny(uint16_t unicode) const
-{
-    // 优先查找通用缓存
-    if (g_common_char_cache.isValid())
-    {
-        const uint8_t *bmp = g_common_char_cache.getCharBitmap(unicode);
-        if (bmp)
-            return bmp;
-    }
-
-    // 查找通用回收池
-    if (g_common_recycle_pool.isValid())
-    {
-        const uint8_t *bmp = g_common_recycle_pool.getCharBitmap(unicode);
-        if (bmp)
-            return bmp;
-    }
-
-    // 查找TOC缓存
-    if (g_toc_char_cache.isValid())
-    {
-        const uint8_t *bmp = g_toc_char_cache.getCharBitmap(unicode);
-        if (bmp)
-            return bmp;
-    }
-
-    // 查找书籍文件名缓存
-    if (g_bookname_char_cache.isValid())
-    {
-        const uint8_t *bmp = g_bookname_char_cache.getCharBitmap(unicode);
-        if (bmp)
-            return bmp;
-    }
-
-    if (!initialized_)
-        return nullptr;
-    // 优先当前窗口顺序：0, +/-1, +/-2
-    const int offsets[] = {0, -1, 1, -2, 2};
-    for (int off : offsets)
-    {
-        if (!isValidPageOffset(off))
-            continue;
-        int idx = getCacheIndex(off);
-        const uint8_t *bmp = caches_[idx].getCharBitmap(unicode);
-        if (bmp)
-        {
-            return bmp;
-        }
-    }
-    return nullptr;
+    return false;
 }
 
 void FontBufferManager::prefetchAround(BookHandle *book)
@@ -841,10 +492,10 @@ void FontBufferManager::prefetchAround(BookHandle *book)
         int idx = getCacheIndex(offset);
         if (caches_[idx].isValid())
             return;
-        caches_[idx].build(book, static_cast<size_t>(target_page));
+        caches_[idx].build(book, static_cast<size_t>(target_page), true);
     };
 
-    // 只补缺，不重建；顺序：邻近，再远端
+    // 只补缺，不重建；顺序：邻近，再远端（字形未常驻的页交给 I/O 任务，下次调用时再钉住）
     build_if_missing(-1);
     build_if_missing(+1);
     build_if_missing(-2);
@@ -875,44 +526,17 @@ void FontBufferManager::logStats() const
         Serial.printf("[FontBufferManager] Cache stats: hits=%u misses=%u initialized=%d current_page=%u\n",
                       (unsigned)stats_.hits, (unsigned)stats_.misses, initialized_ ? 1 : 0,
                       (unsigned)current_page_index_);
+        g_glyph_atlas.logStats();
     }
 }
 
 // ========== 通用字符缓存 ==========
 
-void buildCommonCharCache()
+// 从 UTF-8 文本中提取 BMP 码点，追加到 out（不去重；4 字节序列跳过）
+static void append_utf8_chars(const std::string &text, std::vector<uint16_t, PSRAMAllocator<uint16_t>> &out)
 {
-    extern bool g_using_progmem_font;
-    if (g_using_progmem_font)
-    {
-#if DBG_FONT_BUFFER
-        Serial.println("[CommonCache] Skip for PROGMEM font");
-#endif
-        return;
-    }
-
-    g_common_char_cache.clear();
-
-    std::string common_chars = getCommonCharList();
-    if (common_chars.empty())
-    {
-#if DBG_FONT_BUFFER
-        Serial.println("[CommonCache] No common chars to cache");
-#endif
-        return;
-    }
-
-#if DBG_FONT_BUFFER
-    Serial.printf("[CommonCache] Building cache for %u chars...\n", (unsigned)common_chars.size());
-#endif
-
-    uint32_t start_ms = millis();
-
-    // 1. 提取字符列表
-    std::unordered_set<uint16_t> unique_set;
-    std::vector<uint16_t, PSRAMAllocator<uint16_t>> unique_chars;
-    const uint8_t *p = reinterpret_cast<const uint8_t *>(common_chars.c_str());
-    const uint8_t *end = p + common_chars.size();
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(text.c_str());
+    const uint8_t *end = p + text.size();
 
     while (p < end)
     {
@@ -950,11 +574,7 @@ void buildCommonCharCache()
             p += bytes;
             if (unicode <= 0xFFFF && unicode > 0)
             {
-                uint16_t unicode16 = static_cast<uint16_t>(unicode);
-                if (unique_set.insert(unicode16).second)
-                {
-                    unique_chars.push_back(unicode16);
-                }
+                out.push_back(static_cast<uint16_t>(unicode));
             }
         }
         else
@@ -962,140 +582,68 @@ void buildCommonCharCache()
             p++;
         }
     }
+}
 
-    std::sort(unique_chars.begin(), unique_chars.end());
-
-    // 2. 计算缓冲区大小
-    std::vector<CharGlyphInfo, PSRAMAllocator<CharGlyphInfo>> glyph_infos;
-    glyph_infos.reserve(unique_chars.size());
-    size_t bitmap_total_size = 0;
+static void sort_unique_chars(std::vector<uint16_t, PSRAMAllocator<uint16_t>> &chars)
+{
+    std::sort(chars.begin(), chars.end());
+    chars.erase(std::unique(chars.begin(), chars.end()), chars.end());
+}
 
-    for (uint16_t unicode : unique_chars)
+void buildCommonCharCache()
+{
+    extern bool g_using_progmem_font;
+    if (g_using_progmem_font)
     {
-        const BinFontChar *fc = find_char(unicode);
-        if (!fc)
-            continue;
-
-        CharGlyphInfo info;
-        info.unicode = unicode;
-        info.width = fc->width;
-        info.bitmapW = fc->bitmapW;
-        info.bitmapH = fc->bitmapH;
-        info.x_offset = fc->x_offset;
-        info.y_offset = fc->y_offset;
-        info.bitmap_size = fc->bitmap_size;
-        info.bitmap_offset = bitmap_total_size;
-
-        glyph_infos.push_back(info);
-        bitmap_total_size += fc->bitmap_size;
+#if DBG_FONT_BUFFER
+        Serial.println("[CommonCache] Skip for PROGMEM font");
+#endif
+        return;
     }
 
-    if (glyph_infos.empty())
+    std::string common_chars = getCommonCharList();
+    if (common_chars.empty())
     {
+        g_common_char_cache.clear();
 #if DBG_FONT_BUFFER
-        Serial.println("[CommonCache] No glyphs found in font");
+        Serial.println("[CommonCache] No common chars to cache");
 #endif
         return;
     }
 
-    // 3. 分配缓冲区（使用PSRAM以节省内部DRAM）
-    size_t header_size = sizeof(PageFontCacheHeader);
-    size_t index_size = glyph_infos.size() * sizeof(CharGlyphInfo);
-    size_t total_size = header_size + index_size + bitmap_total_size;
+    std::vector<uint16_t, PSRAMAllocator<uint16_t>> unique_chars;
+    append_utf8_chars(common_chars, unique_chars);
+    sort_unique_chars(unique_chars);
 
-    uint8_t *buffer = static_cast<uint8_t *>(heap_caps_malloc(total_size, MALLOC_CAP_SPIRAM));
-    if (!buffer)
+    if (!g_common_char_cache.pinChars(unique_chars))
     {
-        // PSRAM分配失败，尝试使用内部RAM
-        buffer = static_cast<uint8_t *>(malloc(total_size));
-        if (!buffer)
-        {
-#if DBG_FONT_BUFFER
-            Serial.printf("[CommonCache] Failed to allocate %u bytes\n", (unsigned)total_size);
-#endif
-            return;
-        }
 #if DBG_FONT_BUFFER
-        Serial.printf("[CommonCache] Warning: Using internal RAM (%u bytes)\n", (unsigned)total_size);
+        Serial.println("[CommonCache] No glyphs found in font");
 #endif
+        return;
     }
 
-    // 4. 初始化结构
-    PageFontCacheHeader *header = reinterpret_cast<PageFontCacheHeader *>(buffer);
-    header->total_size = total_size;
-    header->char_count = glyph_infos.size();
-    header->index_offset = header_size;
-    header->bitmap_offset = header_size + index_size;
-
-    CharGlyphInfo *index_area = reinterpret_cast<CharGlyphInfo *>(buffer + header->index_offset);
-    memcpy(index_area, glyph_infos.data(), glyph_infos.size() * sizeof(CharGlyphInfo));
+#if DBG_FONT_BUFFER
+    Serial.printf("[CommonCache] Built: %u chars, %u bytes, %u ms\n",
+                  (unsigned)g_common_char_cache.getCharCount(), (unsigned)g_common_char_cache.getTotalSize(),
+                  (unsigned)g_common_char_cache.getBuildStats().build_ms);
+#endif
+}
 
-    uint8_t *bitmap_area = buffer + header->bitmap_offset;
+// ========== 书籍文件名字体缓存 ==========
 
-    // 5. 加载位图
-    extern BinFont g_bin_font;
-    extern SemaphoreHandle_t bin_font_get_file_mutex();
-    SemaphoreHandle_t mutex = bin_font_get_file_mutex();
-    uint32_t loaded_from_sd = 0;
+void clearBookNameCache()
+{
+    g_bookname_char_cache.clear();
+#if DBG_FONT_BUFFER
+    Serial.println("[BookNameCache] Cleared");
+#endif
+}
 
-    for (size_t i = 0; i < glyph_infos.size(); i++)
-    {
-        const CharGlyphInfo &info = glyph_infos[i];
-        const BinFontChar *fc = find_char(info.unicode);
-        if (!fc || fc->bitmap_size == 0)
-            continue;
-
-        uint8_t *dest = bitmap_area + info.bitmap_offset;
-
-        bool got_lock = false;
-        if (mutex != nullptr)
-        {
-            got_lock = (xSemaphoreTake(mutex, pdMS_TO_TICKS(100)) == pdTRUE);
-        }
-
-        size_t read_bytes = SDW::SD.readAtOffset(g_bin_font.fontFile,
-                                                 fc->bitmap_offset,
-                                                 dest,
-                                                 fc->bitmap_size);
-
-        if (got_lock)
-        {
-            xSemaphoreGive(mutex);
-        }
-
-        if (read_bytes == fc->bitmap_size)
-        {
-            loaded_from_sd++;
-        }
-    }
-
-    // 6. 设置到全局缓存
-    uint32_t build_ms = millis() - start_ms;
-    g_common_char_cache.setCache(buffer, header, index_area, bitmap_area,
-                                 build_ms, loaded_from_sd,
-                                 glyph_infos.size(), glyph_infos.size());
-
-#if DBG_FONT_BUFFER
-    Serial.printf("[CommonCache] Built: %u chars, %u bytes, %u ms\n",
-                  (unsigned)glyph_infos.size(), (unsigned)total_size,
-                  (unsigned)build_ms);
-#endif
-}
-
-// ========== 书籍文件名字体缓存 ==========
-
-void clearBookNameCache()
-{
-    g_bookname_char_cache.clear();
-#if DBG_FONT_BUFFER
-    Serial.println("[BookNameCache] Cleared");
-#endif
-}
-
-void addBookNamesToCache(const std::vector<std::string> &bookNames)
-{
-    extern bool g_using_progmem_font;
-    if (g_using_progmem_font)
+void addBookNamesToCache(const std::vector<std::string> &bookNames)
+{
+    extern bool g_using_progmem_font;
+    if (g_using_progmem_font)
     {
 #if DBG_FONT_BUFFER
         Serial.println("[BookNameCache] Skip for PROGMEM font");
@@ -1111,246 +659,52 @@ void addBookNamesToCache(const std::vector<std::string> &bookNames)
         return;
     }
 
-#if DBG_FONT_BUFFER
-    Serial.printf("[BookNameCache] Adding %u book names...\n", (unsigned)bookNames.size());
-#endif
-
-    uint32_t start_ms = millis();
-
-    // 1. 从现有缓存中提取已有字符
-    std::unordered_set<uint16_t> existing_chars;
-    if (g_bookname_char_cache.isValid())
-    {
-        size_t char_count = g_bookname_char_cache.getCharCount();
-        for (uint32_t i = 0; i < char_count; i++)
-        {
-            const CharGlyphInfo *glyph = g_bookname_char_cache.getCharGlyphInfoByIndex(i);
-            if (glyph)
-            {
-                existing_chars.insert(glyph->unicode);
-            }
-        }
-    }
-
-    // 2. 从书籍文件名中提取新字符
+    // 1. 从书籍文件名中提取字符
     std::vector<uint16_t, PSRAMAllocator<uint16_t>> new_chars;
     for (const auto &bookName : bookNames)
     {
-        const uint8_t *p = reinterpret_cast<const uint8_t *>(bookName.c_str());
-        const uint8_t *end = p + bookName.size();
-
-        while (p < end)
-        {
-            uint32_t unicode = 0;
-            int bytes = 0;
-
-            if (*p < 0x80)
-            {
-                unicode = *p;
-                bytes = 1;
-            }
-            else if ((*p & 0xE0) == 0xC0)
-            {
-                if (p + 1 < end)
-                {
-                    unicode = ((*p & 0x1F) << 6) | (*(p + 1) & 0x3F);
-                    bytes = 2;
-                }
-            }
-            else if ((*p & 0xF0) == 0xE0)
-            {
-                if (p + 2 < end)
-                {
-                    unicode = ((*p & 0x0F) << 12) | ((*(p + 1) & 0x3F) << 6) | (*(p + 2) & 0x3F);
-                    bytes = 3;
-                }
-            }
-            else if ((*p & 0xF8) == 0xF0)
-            {
-                bytes = 4;
-            }
-
-            if (bytes > 0)
-            {
-                p += bytes;
-                if (unicode <= 0xFFFF && unicode > 0)
-                {
-                    uint16_t unicode16 = static_cast<uint16_t>(unicode);
-                    if (existing_chars.insert(unicode16).second)
-                    {
-                        new_chars.push_back(unicode16);
-                    }
-                }
-            }
-            else
-            {
-                p++;
-            }
-        }
+        append_utf8_chars(bookName, new_chars);
     }
+    sort_unique_chars(new_chars);
 
-    // 3. 检查是否需要重建缓存（超过300字限制或有新字符）
-    bool need_rebuild = false;
-    if (existing_chars.size() > 300)
-    {
-        // 超过限制，保留最近的300字（简单策略：清空重建）
-#if DBG_FONT_BUFFER
-        Serial.printf("[BookNameCache] Size limit exceeded (%u > 300), rebuilding...\n",
-                      (unsigned)existing_chars.size());
-#endif
-        existing_chars.clear();
-        // 只保留新发现的字符（最多300个）
-        for (size_t i = 0; i < new_chars.size() && i < 300; i++)
-        {
-            existing_chars.insert(new_chars[i]);
-        }
-        new_chars.clear();
-        need_rebuild = true;
-    }
-    else if (!new_chars.empty())
+    // 2. 与已有字符合并；超过300字时只保留本次的字符（简单策略：清空重建）
+    size_t existing = g_bookname_char_cache.getCharCount();
+    std::vector<uint16_t, PSRAMAllocator<uint16_t>> all_chars;
+    all_chars.reserve(existing + new_chars.size());
+    for (size_t i = 0; i < existing; i++)
     {
-        need_rebuild = true;
+        const CharGlyphInfo *glyph = g_bookname_char_cache.getCharGlyphInfoByIndex(i);
+        if (glyph)
+            all_chars.push_back(glyph->unicode);
     }
+    all_chars.insert(all_chars.end(), new_chars.begin(), new_chars.end());
+    sort_unique_chars(all_chars);
 
-    if (!need_rebuild)
+    if (all_chars.size() == existing)
     {
 #if DBG_FONT_BUFFER
         Serial.println("[BookNameCache] No new chars, keeping existing cache");
 #endif
         return;
     }
-
-    // 4. 构建字符列表 (置于 PSRAM)
-    std::vector<uint16_t, PSRAMAllocator<uint16_t>> all_chars(existing_chars.begin(), existing_chars.end());
-    std::sort(all_chars.begin(), all_chars.end());
-
-    // 5. 计算缓冲区大小
-    std::vector<CharGlyphInfo, PSRAMAllocator<CharGlyphInfo>> glyph_infos;
-    glyph_infos.reserve(all_chars.size());
-    size_t bitmap_total_size = 0;
-
-    for (uint16_t unicode : all_chars)
-    {
-        const BinFontChar *fc = find_char(unicode);
-        if (!fc)
-            continue;
-
-        CharGlyphInfo info;
-        info.unicode = unicode;
-        info.width = fc->width;
-        info.bitmapW = fc->bitmapW;
-        info.bitmapH = fc->bitmapH;
-        info.x_offset = fc->x_offset;
-        info.y_offset = fc->y_offset;
-        info.bitmap_size = fc->bitmap_size;
-        info.bitmap_offset = bitmap_total_size;
-
-        glyph_infos.push_back(info);
-        bitmap_total_size += fc->bitmap_size;
-    }
-
-    if (glyph_infos.empty())
-    {
-#if DBG_FONT_BUFFER
-        Serial.println("[BookNameCache] No glyphs found in font");
-#endif
-        return;
-    }
-
-    // 6. 分配缓冲区（使用PSRAM以节省内部DRAM）
-    size_t header_size = sizeof(PageFontCacheHeader);
-    size_t index_size = glyph_infos.size() * sizeof(CharGlyphInfo);
-    size_t total_size = header_size + index_size + bitmap_total_size;
-
-    uint8_t *buffer = static_cast<uint8_t *>(heap_caps_malloc(total_size, MALLOC_CAP_SPIRAM));
-    if (!buffer)
+    if (all_chars.size() > 300)
     {
-        // PSRAM分配失败，尝试使用内部RAM
-        buffer = static_cast<uint8_t *>(malloc(total_size));
-        if (!buffer)
-        {
 #if DBG_FONT_BUFFER
-            Serial.printf("[BookNameCache] Failed to allocate %u bytes\n", (unsigned)total_size);
-#endif
-            return;
-        }
-#if DBG_FONT_BUFFER
-        Serial.printf("[BookNameCache] Warning: Using internal RAM (%u bytes)\n", (unsigned)total_size);
+        Serial.printf("[BookNameCache] Size limit exceeded (%u > 300), rebuilding...\n",
+                      (unsigned)all_chars.size());
 #endif
+        all_chars.swap(new_chars);
     }
 
-    // 7. 初始化结构
-    PageFontCacheHeader *header = reinterpret_cast<PageFontCacheHeader *>(buffer);
-    header->total_size = total_size;
-    header->char_count = glyph_infos.size();
-    header->index_offset = header_size;
-    header->bitmap_offset = header_size + index_size;
-
-    CharGlyphInfo *index_area = reinterpret_cast<CharGlyphInfo *>(buffer + header->index_offset);
-    memcpy(index_area, glyph_infos.data(), glyph_infos.size() * sizeof(CharGlyphInfo));
-
-    uint8_t *bitmap_area = buffer + header->bitmap_offset;
-
-    // 8. 加载位图（优先从其他缓存复用）
-    extern BinFont g_bin_font;
-    extern SemaphoreHandle_t bin_font_get_file_mutex();
-    SemaphoreHandle_t mutex = bin_font_get_file_mutex();
-    uint32_t reused = 0;
-    uint32_t loaded_from_sd = 0;
-
-    for (size_t i = 0; i < glyph_infos.size(); i++)
-    {
-        const CharGlyphInfo &info = glyph_infos[i];
-        const BinFontChar *fc = find_char(info.unicode);
-        if (!fc || fc->bitmap_size == 0)
-            continue;
-
-        uint8_t *dest = bitmap_area + info.bitmap_offset;
-
-        // 先尝试从其他缓存复用
-        const uint8_t *cached = g_font_buffer_manager.getCharBitmapAny(info.unicode);
-        if (cached)
-        {
-            memcpy(dest, cached, fc->bitmap_size);
-            reused++;
-        }
-        else
-        {
-            // 从SD加载
-            bool got_lock = false;
-            if (mutex != nullptr)
-            {
-                got_lock = (xSemaphoreTake(mutex, pdMS_TO_TICKS(100)) == pdTRUE);
-            }
-
-            size_t read_bytes = SDW::SD.readAtOffset(g_bin_font.fontFile,
-                                                     fc->bitmap_offset,
-                                                     dest,
-                                                     fc->bitmap_size);
-
-            if (got_lock)
-            {
-                xSemaphoreGive(mutex);
-            }
-
-            if (read_bytes == fc->bitmap_size)
-            {
-                loaded_from_sd++;
-            }
-        }
-    }
-
-    // 9. 清空旧缓存并设置新缓存
-    g_bookname_char_cache.clear();
-    uint32_t build_ms = millis() - start_ms;
-    g_bookname_char_cache.setCache(buffer, header, index_area, bitmap_area,
-                                   build_ms, loaded_from_sd,
-                                   glyph_infos.size(), glyph_infos.size());
+    // 3. 钉住新的字符集合（与旧集合重叠的字形直接沿用）
+    g_bookname_char_cache.pinChars(all_chars, 300);
 
 #if DBG_FONT_BUFFER
-    Serial.printf("[BookNameCache] Built: %u chars (%u reused, %u from SD), %u bytes, %u ms\n",
-                  (unsigned)glyph_infos.size(), (unsigned)reused, (unsigned)loaded_from_sd,
-                  (unsigned)total_size, (unsigned)build_ms);
+    Serial.printf("[BookNameCache] Built: %u chars (%u reused, %u from SD), %u ms\n",
+                  (unsigned)g_bookname_char_cache.getCharCount(),
+                  (unsigned)g_bookname_char_cache.getBuildStats().reused_from_cache,
+                  (unsigned)g_bookname_char_cache.getBuildStats().loaded_from_sd,
+                  (unsigned)g_bookname_char_cache.getBuildStats().build_ms);
 #endif
 }
 
@@ -1358,9 +712,6 @@ void addBookNamesToCache(const std::vector<std::string> &bookNames)
 
 void clearTocCache()
 {
-    // 在释放前，回收字符到通用回收池
-    recycleCharsToPool(&g_toc_char_cache);
-
     g_toc_char_cache.clear();
 #if DBG_FONT_BUFFER
     Serial.println("[TocCache] Cleared");
@@ -1393,8 +744,6 @@ void buildTocCharCache(const char *toc_file_path)
     // 清理旧缓存
     clearTocCache();
 
-    uint32_t start_ms = millis();
-
     // 1. 打开TOC文件并读取全部内容（TOC通常不大）
     File tocFile;
     bool use_spiffs = (strncmp(toc_file_path, "/spiffs/", 8) == 0);
@@ -1450,59 +799,9 @@ void buildTocCharCache(const char *toc_file_path)
     }
 
     // 2. 提取唯一字符（使用 PSRAM 分配器）
-    std::unordered_set<uint16_t> unique_set;
     std::vector<uint16_t, PSRAMAllocator<uint16_t>> unique_chars;
-    const uint8_t *p = reinterpret_cast<const uint8_t *>(toc_content.c_str());
-    const uint8_t *end = p + toc_content.size();
-
-    while (p < end)
-    {
-        uint32_t unicode = 0;
-        int bytes = 0;
-
-        if (*p < 0x80)
-        {
-            unicode = *p;
-            bytes = 1;
-        }
-        else if ((*p & 0xE0) == 0xC0)
-        {
-            if (p + 1 < end)
-            {
-                unicode = ((*p & 0x1F) << 6) | (*(p + 1) & 0x3F);
-                bytes = 2;
-            }
-        }
-        else if ((*p & 0xF0) == 0xE0)
-        {
-            if (p + 2 < end)
-            {
-                unicode = ((*p & 0x0F) << 12) | ((*(p + 1) & 0x3F) << 6) | (*(p + 2) & 0x3F);
-                bytes = 3;
-            }
-        }
-        else if ((*p & 0xF8) == 0xF0)
-        {
-            bytes = 4;
-        }
-
-        if (bytes > 0)
-        {
-            p += bytes;
-            if (unicode <= 0xFFFF && unicode > 0)
-            {
-                uint16_t unicode16 = static_cast<uint16_t>(unicode);
-                if (unique_set.insert(unicode16).second)
-                {
-                    unique_chars.push_back(unicode16);
-                }
-            }
-        }
-        else
-        {
-            p++;
-        }
-    }
+    append_utf8_chars(toc_content, unique_chars);
+    sort_unique_chars(unique_chars);
 
     if (unique_chars.empty())
     {
@@ -1512,34 +811,8 @@ void buildTocCharCache(const char *toc_file_path)
         return;
     }
 
-    std::sort(unique_chars.begin(), unique_chars.end());
-
-    // 3. 计算缓冲区大小
-    std::vector<CharGlyphInfo, PSRAMAllocator<CharGlyphInfo>> glyph_infos;
-    glyph_infos.reserve(unique_chars.size());
-    size_t bitmap_total_size = 0;
-
-    for (uint16_t unicode : unique_chars)
-    {
-        const BinFontChar *fc = find_char(unicode);
-        if (!fc)
-            continue;
-
-        CharGlyphInfo info;
-        info.unicode = unicode;
-        info.width = fc->width;
-        info.bitmapW = fc->bitmapW;
-        info.bitmapH = fc->bitmapH;
-        info.x_offset = fc->x_offset;
-        info.y_offset = fc->y_offset;
-        info.bitmap_size = fc->bitmap_size;
-        info.bitmap_offset = bitmap_total_size;
-
-        glyph_infos.push_back(info);
-        bitmap_total_size += fc->bitmap_size;
-    }
-
-    if (glyph_infos.empty())
+    // 3. 钉住TOC字形；超长目录只钉前 GLYPH_ATLAS_UI_PIN_LIMIT 个，给页面窗口留出空间，其余按需从SD读取
+    if (!g_toc_char_cache.pinChars(unique_chars, GLYPH_ATLAS_UI_PIN_LIMIT))
     {
 #if DBG_FONT_BUFFER
         Serial.println("[TocCache] No glyphs found in font for TOC chars");
@@ -1547,297 +820,11 @@ void buildTocCharCache(const char *toc_file_path)
         return;
     }
 
-    // 4. 分配缓冲区（使用PSRAM以节省内部DRAM）
-    size_t header_size = sizeof(PageFontCacheHeader);
-    size_t index_size = glyph_infos.size() * sizeof(CharGlyphInfo);
-    size_t total_size = header_size + index_size + bitmap_total_size;
-
-    uint8_t *buffer = static_cast<uint8_t *>(heap_caps_malloc(total_size, MALLOC_CAP_SPIRAM));
-    if (!buffer)
-    {
-        buffer = static_cast<uint8_t *>(malloc(total_size));
-        if (!buffer)
-        {
-#if DBG_FONT_BUFFER
-            Serial.printf("[TocCache] Failed to allocate %u bytes\n", (unsigned)total_size);
-#endif
-            return;
-        }
-#if DBG_FONT_BUFFER
-        Serial.printf("[TocCache] Warning: Using internal RAM (%u bytes)\n", (unsigned)total_size);
-#endif
-    }
-
-    // 5. 初始化结构
-    PageFontCacheHeader *header = reinterpret_cast<PageFontCacheHeader *>(buffer);
-    header->total_size = total_size;
-    header->char_count = glyph_infos.size();
-    header->index_offset = header_size;
-    header->bitmap_offset = header_size + index_size;
-
-    CharGlyphInfo *index_area = reinterpret_cast<CharGlyphInfo *>(buffer + header->index_offset);
-    memcpy(index_area, glyph_infos.data(), glyph_infos.size() * sizeof(CharGlyphInfo));
-
-    uint8_t *bitmap_area = buffer + header->bitmap_offset;
-
-    // 6. 加载位图（优先从其他缓存复用）
-    extern BinFont g_bin_font;
-    extern SemaphoreHandle_t bin_font_get_file_mutex();
-    SemaphoreHandle_t mutex = bin_font_get_file_mutex();
-    uint32_t reused = 0;
-    uint32_t loaded_from_sd = 0;
-
-    for (size_t i = 0; i < glyph_infos.size(); i++)
-    {
-        const CharGlyphInfo &info = glyph_infos[i];
-        const BinFontChar *fc = find_char(info.unicode);
-        if (!fc || fc->bitmap_size == 0)
-            continue;
-
-        uint8_t *dest = bitmap_area + info.bitmap_offset;
-
-        // 先尝试从其他缓存复用
-        const uint8_t *cached = g_font_buffer_manager.getCharBitmapAny(info.unicode);
-        if (cached)
-        {
-            memcpy(dest, cached, fc->bitmap_size);
-            reused++;
-        }
-        else
-        {
-            // 从SD加载
-            bool got_lock = false;
-            if (mutex != nullptr)
-            {
-                got_lock = (xSemaphoreTake(mutex, pdMS_TO_TICKS(100)) == pdTRUE);
-            }
-
-            size_t read_bytes = SDW::SD.readAtOffset(g_bin_font.fontFile,
-                                                     fc->bitmap_offset,
-                                                     dest,
-                                                     fc->bitmap_size);
-
-            if (got_lock)
-            {
-                xSemaphoreGive(mutex);
-            }
-
-            if (read_bytes == fc->bitmap_size)
-            {
-                loaded_from_sd++;
-            }
-        }
-    }
-
-    // 7. 设置到全局TOC缓存
-    uint32_t build_ms = millis() - start_ms;
-    g_toc_char_cache.setCache(buffer, header, index_area, bitmap_area,
-                              build_ms, loaded_from_sd,
-                              glyph_infos.size(), glyph_infos.size());
-
-#if DBG_FONT_BUFFER
-    Serial.printf("[TocCache] Built: %u chars (%u reused, %u from SD), %u bytes, %u ms\n",
-                  (unsigned)glyph_infos.size(), (unsigned)reused, (unsigned)loaded_from_sd,
-                  (unsigned)total_size, (unsigned)build_ms);
-#endif
-}
-
-// ========== 通用回收池缓存 ==========
-
-void clearCommonRecyclePool()
-{
-    g_common_recycle_pool.clear();
-#if DBG_FONT_BUFFER
-    Serial.println("[RecyclePool] Cleared");
-#endif
-}
-
-void initCommonRecyclePool()
-{
-    // 清空旧池（如果存在）
-    clearCommonRecyclePool();
-
-#if DBG_FONT_BUFFER
-    Serial.println("[RecyclePool] Initialized (empty pool ready)");
-#endif
-}
-
-void recycleCharsToPool(const PageFontCache *cache)
-{
-    extern bool g_using_progmem_font;
-    if (g_using_progmem_font)
-    {
-        return; // PROGMEM字体不需要回收池
-    }
-
-    if (!cache || !cache->isValid())
-    {
-        return; // 无效缓存，无需回收
-    }
-
-    // 使用全局宏定义的上限
-    const size_t pool_limit = RECYCLE_POOL_LIMIT;
-
-    // 1. 收集当前池中已有的字符
-    std::unordered_set<uint16_t> existing_chars;
-    if (g_common_recycle_pool.isValid())
-    {
-        size_t char_count = g_common_recycle_pool.getCharCount();
-        for (size_t i = 0; i < char_count; i++)
-        {
-            const CharGlyphInfo *glyph = g_common_recycle_pool.getCharGlyphInfoByIndex(i);
-            if (glyph)
-            {
-                existing_chars.insert(glyph->unicode);
-            }
-        }
-    }
-
-    // 2. 从待释放缓存中提取新字符（不在池中的）
-    std::vector<uint16_t, PSRAMAllocator<uint16_t>> new_chars;
-    size_t cache_char_count = cache->getCharCount();
-    for (size_t i = 0; i < cache_char_count; i++)
-    {
-        const CharGlyphInfo *glyph = cache->getCharGlyphInfoByIndex(i);
-        if (glyph && existing_chars.insert(glyph->unicode).second)
-        {
-            new_chars.push_back(glyph->unicode);
-        }
-    }
-
-    if (new_chars.empty())
-    {
-        return; // 没有新字符需要回收
-    }
-
-    // 3. 检查是否超出上限，超出则按Unicode从大到小淘汰
-    if (existing_chars.size() > pool_limit)
-    {
-        // 将所有字符按Unicode排序（从小到大）
-        std::vector<uint16_t, PSRAMAllocator<uint16_t>> all_chars(existing_chars.begin(), existing_chars.end());
-        std::sort(all_chars.begin(), all_chars.end());
-
-        // 保留前 pool_limit 个（Unicode最小的），丢弃后面的（Unicode大的）
-        existing_chars.clear();
-        for (size_t i = 0; i < pool_limit && i < all_chars.size(); i++)
-        {
-            existing_chars.insert(all_chars[i]);
-        }
-
-#if DBG_FONT_BUFFER
-        Serial.printf("[RecyclePool] Evicted %u chars (limit=%u)\n",
-                      (unsigned)(all_chars.size() - pool_limit),
-                      (unsigned)pool_limit);
-#endif
-    }
-
-    // 4. 构建新的回收池
-    std::vector<uint16_t, PSRAMAllocator<uint16_t>> final_chars(existing_chars.begin(), existing_chars.end());
-    std::sort(final_chars.begin(), final_chars.end());
-
-    // 5. 计算缓冲区大小
-    std::vector<CharGlyphInfo, PSRAMAllocator<CharGlyphInfo>> glyph_infos;
-    glyph_infos.reserve(final_chars.size());
-    size_t bitmap_total_size = 0;
-
-    for (uint16_t unicode : final_chars)
-    {
-        const BinFontChar *fc = find_char(unicode);
-        if (!fc)
-            continue;
-
-        CharGlyphInfo info;
-        info.unicode = unicode;
-        info.width = fc->width;
-        info.bitmapW = fc->bitmapW;
-        info.bitmapH = fc->bitmapH;
-        info.x_offset = fc->x_offset;
-        info.y_offset = fc->y_offset;
-        info.bitmap_size = fc->bitmap_size;
-        info.bitmap_offset = bitmap_total_size;
-
-        glyph_infos.push_back(info);
-        bitmap_total_size += fc->bitmap_size;
-    }
-
-    if (glyph_infos.empty())
-    {
-        return;
-    }
-
-    // 6. 分配缓冲区（使用PSRAM）
-    size_t header_size = sizeof(PageFontCacheHeader);
-    size_t index_size = glyph_infos.size() * sizeof(CharGlyphInfo);
-    size_t total_size = header_size + index_size + bitmap_total_size;
-
-    uint8_t *buffer = static_cast<uint8_t *>(heap_caps_malloc(total_size, MALLOC_CAP_SPIRAM));
-    if (!buffer)
-    {
-        buffer = static_cast<uint8_t *>(malloc(total_size));
-        if (!buffer)
-        {
-#if DBG_FONT_BUFFER
-            Serial.printf("[RecyclePool] Failed to allocate %u bytes\n", (unsigned)total_size);
-#endif
-            return;
-        }
-    }
-
-    // 7. 初始化结构
-    PageFontCacheHeader *header = reinterpret_cast<PageFontCacheHeader *>(buffer);
-    header->total_size = total_size;
-    header->char_count = glyph_infos.size();
-    header->index_offset = header_size;
-    header->bitmap_offset = header_size + index_size;
-
-    CharGlyphInfo *index_area = reinterpret_cast<CharGlyphInfo *>(buffer + header->index_offset);
-    memcpy(index_area, glyph_infos.data(), glyph_infos.size() * sizeof(CharGlyphInfo));
-
-    uint8_t *bitmap_area = buffer + header->bitmap_offset;
-
-    // 8. 复制位图（从旧池或待回收缓存）
-    uint32_t reused_from_old_pool = 0;
-    uint32_t reused_from_cache = 0;
-
-    for (size_t i = 0; i < glyph_infos.size(); i++)
-    {
-        const CharGlyphInfo &info = glyph_infos[i];
-        const BinFontChar *fc = find_char(info.unicode);
-        if (!fc || fc->bitmap_size == 0)
-            continue;
-
-        uint8_t *dest = bitmap_area + info.bitmap_offset;
-
-        // 先尝试从旧池复用
-        if (g_common_recycle_pool.isValid())
-        {
-            const uint8_t *old_bmp = g_common_recycle_pool.getCharBitmap(info.unicode);
-            if (old_bmp)
-            {
-                memcpy(dest, old_bmp, fc->bitmap_size);
-                reused_from_old_pool++;
-                continue;
-            }
-        }
-
-        // 从待回收缓存复用
-        const uint8_t *cache_bmp = cache->getCharBitmap(info.unicode);
-        if (cache_bmp)
-        {
-            memcpy(dest, cache_bmp, fc->bitmap_size);
-            reused_from_cache++;
-        }
-    }
-
-    // 9. 清空旧池并设置新池
-    g_common_recycle_pool.clear();
-    g_common_recycle_pool.setCache(buffer, header, index_area, bitmap_area,
-                                   0, 0,
-                                   glyph_infos.size(), glyph_infos.size());
-
 #if DBG_FONT_BUFFER
-    Serial.printf("[RecyclePool] Recycled: %u total chars (%u from old pool, %u from cache), %u bytes\n",
-                  (unsigned)glyph_infos.size(), (unsigned)reused_from_old_pool,
-                  (unsigned)reused_from_cache, (unsigned)total_size);
+    Serial.printf("[TocCache] Built: %u/%u chars (%u reused, %u from SD), %u ms\n",
+                  (unsigned)g_toc_char_cache.getCharCount(), (unsigned)unique_chars.size(),
+                  (unsigned)g_toc_char_cache.getBuildStats().reused_from_cache,
+                  (unsigned)g_toc_char_cache.getBuildStats().loaded_from_sd,
+                  (unsigned)g_toc_char_cache.getBuildStats().build_ms);
 #endif
 }
@@ -1,5 +1,5 @@
 #pragma once
-// 字体缓冲区管理 - 支持5页滑动窗口 + 通用字符缓存
+// 字体缓冲区管理 - 支持5页滑动窗口 + 通用字符缓存（位图统一存放在 GlyphAtlas）
 
 #include <cstdint>
 #include <cstddef>
@@ -14,7 +14,7 @@ class BookHandle;
 constexpr size_t FONT_CACHE_PAGE_COUNT = 5;  // 缓存5个页面：前2页、前1页、当前页、后1页、后2页
 constexpr size_t FONT_CACHE_CENTER_INDEX = 2; // 中心位置（当前页）在数组中的索引
 
-// 字符字形索引信息
+// 字符字形索引信息（条目由 GlyphAtlas 持有）
 struct CharGlyphInfo {
     uint16_t unicode;         // 字符的Unicode编码
     uint16_t width;           // 字符宽度
@@ -23,27 +23,20 @@ struct CharGlyphInfo {
     int8_t x_offset;          // X偏移
     int8_t y_offset;          // Y偏移
     uint32_t bitmap_size;     // 字形位图的字节数
-    uint32_t bitmap_offset;   // 字形位图在本缓冲区中的偏移量
-} __attribute__((packed));
-
-// 页面字体缓存池头部信息
-struct PageFontCacheHeader {
-    uint32_t total_size;      // 缓冲区总大小（包括头部、索引区、位图区）
-    uint32_t char_count;      // 包含的字符个数
-    uint32_t index_offset;    // 字符索引区的起始偏移（紧跟在头部之后）
-    uint32_t bitmap_offset;   // 位图数据区的起始偏移
+    uint32_t bitmap_offset;   // 字形位图在图集位图区中的偏移量
 } __attribute__((packed));
 
 // 页面缓存构建统计
 struct PageFontCacheStats {
     uint32_t build_ms = 0;           // 构建耗时
-    uint32_t reused_from_cache = 0;  // 从其他页面缓存复用的字形数
+    uint32_t reused_from_cache = 0;  // 已在图集中、直接复用的字形数
     uint32_t loaded_from_sd = 0;     // 从SD读取的字形数
     uint32_t total_chars = 0;        // 总字符数
     uint32_t unique_chars = 0;       // 去重后字符数
 };
 
-// 单个页面的字体缓存池
+// 单个页面（或一组 UI 文本）的字体缓存：只保存排序后的码点列表，
+// 位图由全局 GlyphAtlas 保存一份，本对象对其中的字形计数引用（钉住）直到 clear()
 class PageFontCache {
     // FontBufferManager 需要访问私有成员进行缓存交换
     friend class FontBufferManager;
@@ -57,9 +50,14 @@ public:
     PageFontCache& operator=(const PageFontCache&) = delete;
 
     // 构建页面字体缓存
-    bool build(BookHandle* book, size_t page_index);
+    // defer_io=true：有字形需要读 SD 时交给 GlyphFetchService 异步读入图集并返回 false（不钉住），
+    // 调用方稍后再 build 时即可直接钉住
+    bool build(BookHandle* book, size_t page_index, bool defer_io = false);
+
+    // 钉住一组码点（升序去重，最多 limit 个），替换当前内容；先钉新字再释放旧字，重叠部分不会被淘汰
+    bool pinChars(const std::vector<uint16_t, PSRAMAllocator<uint16_t>>& sorted_chars, size_t limit = SIZE_MAX);
     
-    // 清理缓存
+    // 清理缓存（解除钉住）
     void clear();
     
     // 查询字符是否在缓存中
@@ -71,35 +69,18 @@ public:
     // 按索引获取字形信息（用于遍历缓存中的所有字符）
     const CharGlyphInfo* getCharGlyphInfoByIndex(size_t index) const;
     
-    // 获取字符的位图数据（返回nullptr表示未找到）
-    const uint8_t* getCharBitmap(uint16_t unicode) const;
-    
-    // 获取缓存状态
-    bool isValid() const { return buffer_ != nullptr; }
+    // 获取缓存状态（图集重置后旧的钉住记录作废）
+    bool isValid() const;
     size_t getCharCount() const;
     size_t getTotalSize() const;
+    const PageFontCacheStats& getBuildStats() const { return stats_; }
     
     // 交换两个缓存的内容（用于滚动更新）
     void swapWith(PageFontCache& other);
     
-    // 设置缓存内容（用于通用缓存构建）
-    void setCache(uint8_t* buffer, PageFontCacheHeader* header,
-                  CharGlyphInfo* index_area, uint8_t* bitmap_area,
-                  uint32_t build_ms, uint32_t loaded_from_sd,
-                  uint32_t unique_chars, uint32_t total_chars);
-    
 private:
-    uint8_t* buffer_;                                 // 缓冲区指针
-    PageFontCacheHeader* header_;                     // 头部指针
-    CharGlyphInfo* index_area_;                       // 字符索引区指针
-    uint8_t* bitmap_area_;                            // 位图数据区指针
-    
-    // 辅助函数：从页面文本中提取唯一字符（使用 PSRAMAllocator 以降低内部 DRAM 压力）
-    std::vector<uint16_t, PSRAMAllocator<uint16_t>> extractUniqueChars(const std::string& page_text);
-
-    // 辅助函数：计算所需缓冲区大小（chars/glyph_infos 使用 PSRAM 分配器）
-    size_t calculateBufferSize(const std::vector<uint16_t, PSRAMAllocator<uint16_t>>& chars,
-                               std::vector<CharGlyphInfo, PSRAMAllocator<CharGlyphInfo>>& glyph_infos);
+    std::vector<uint16_t, PSRAMAllocator<uint16_t>> chars_; // 已钉住的码点（升序）
+    uint32_t generation_;                                    // 钉住时的图集代号
 
     PageFontCacheStats stats_{};
 };
@@ -137,11 +118,9 @@ public:
     // page_offset: 相对于当前页的偏移（-2到+2）
     const CharGlyphInfo* getCharGlyphInfo(uint16_t unicode, int page_offset = 0) const;
     
-    // 从指定页面偏移的缓存中获取字符位图
-    const uint8_t* getCharBitmap(uint16_t unicode, int page_offset = 0) const;
-
-    // 从任何已构建的缓存中查找位图（用于构建新缓存时复用，包括通用缓存）
-    const uint8_t* getCharBitmapAny(uint16_t unicode) const;
+    // 把图集中常驻的字符位图（不论被哪个页面/UI 缓存钉住）复制到 out，size 为字形的位图大小。
+    // 在图集锁内复制，不会读到正被另一核淘汰复用的单元；未命中时返回 false
+    bool copyCharBitmap(uint16_t unicode, uint8_t* out, size_t size) const;
 
     // 在不影响当前渲染的情况下补全周边缓存（仅构建缺失的 ±1/±2）
     void prefetchAround(BookHandle* book);
@@ -197,22 +176,9 @@ extern PageFontCache g_bookname_char_cache;
 // TOC（目录）专用字体缓存（用于书籍目录显示）
 extern PageFontCache g_toc_char_cache;
 
-// 通用回收池缓存（回收其他缓存释放的字符，上限1000字符）
-extern PageFontCache g_common_recycle_pool;
-
 // 构建通用字符缓存（在加载字体时调用）
 void buildCommonCharCache();
 
-// 初始化通用回收池（字体加载时调用，创建空池）
-void initCommonRecyclePool();
-
-// 从即将释放的缓存中回收字符到回收池（页面缓存释放前调用）
-// cache: 即将被释放的缓存对象
-void recycleCharsToPool(const PageFontCache* cache);
-
-// 清空通用回收池（字体卸载时调用）
-void clearCommonRecyclePool();
-
 // 获取通用字符列表
 std::string getCommonCharList();
 
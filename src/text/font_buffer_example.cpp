@@ -8,6 +8,7 @@
 #include "text/book_handle.h"
 #include "current_book.h"
 #include <Arduino.h>
+#include <vector>
 
 // ========== 基本使用示例 ==========
 
@@ -47,10 +48,10 @@ void example_basic_usage()
             Serial.printf("  Width: %u, BitmapW: %u, BitmapH: %u, Size: %u bytes\n",
                          info->width, info->bitmapW, info->bitmapH, info->bitmap_size);
             
-            // 获取字符的位图数据
-            const uint8_t* bitmap = g_font_buffer_manager.getCharBitmap(test_char, 0);
-            if (bitmap) {
-                Serial.printf("  Bitmap data available at address %p\n", bitmap);
+            // 复制字符的位图数据（图集锁内复制，不持有图集内部指针）
+            std::vector<uint8_t> bitmap(info->bitmap_size);
+            if (g_font_buffer_manager.copyCharBitmap(test_char, bitmap.data(), bitmap.size())) {
+                Serial.printf("  Bitmap data copied (%u bytes)\n", (unsigned)bitmap.size());
             }
         }
     }
@@ -217,9 +218,8 @@ void example_cleanup()
  *    g_font_buffer_manager.scrollUpdate(this, new_page_index, forward);
  * 
  * 3. 在字体渲染函数（如 bin_font_print）中优先从缓存查询：
- *    const uint8_t* cached_bitmap = g_font_buffer_manager.getCharBitmap(unicode, 0);
- *    if (cached_bitmap) {
- *        // 使用缓存的位图数据
+ *    if (g_font_buffer_manager.copyCharBitmap(unicode, raw_data, glyph->bitmap_size)) {
+ *        // 使用复制出的位图数据
  *    } else {
  *        // 回退到原有的SD卡读取方式
  *    }
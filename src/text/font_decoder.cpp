@@ -1,8 +1,10 @@
 #include "font_decoder.h"
 #include "font_color_mapper.h"
+#include "glyph_blit_canvas.h"
 #include "device/memory_pool.h"
 #include <M5Unified.h>
 #include "test/per_file_debug.h"
+#include <cstring>
 
 // 声明外部变量
 extern M5Canvas *g_canvas;
@@ -260,6 +262,199 @@ void FontDecoder::decode_bitmap_v3_transparent(const uint8_t* raw_data, uint32_t
     decode_bitmap_v3(raw_data, bitmap_size, bitmap, w, h, dark_mode, true);
 }
 
+// ==================== 4bpp 覆盖度解码（按字节查表） ====================
+
+// 霍夫曼查表：以接下来的 8bit 为索引，给出这 8bit 内能完整解出的像素（最多 8 个，每个 4bit 覆盖度，
+// 第一个在最低半字节）和消耗的位数。最长码字 6bit（V2 灰度），所以每次至少解出一个像素。
+struct HuffByteTable
+{
+    uint32_t levels[256];
+    uint8_t count[256];
+    uint8_t bits[256];
+};
+
+struct CoverageTables
+{
+    HuffByteTable v2;
+    HuffByteTable v3;
+    uint8_t mono[256][4]; // 1bit：一个字节的 8 个像素 -> 4 字节覆盖度
+
+    CoverageTables();
+};
+
+// 从 byte 的第 pos 位（高位在前）解一个码字；码字超出本字节时返回 false
+static bool huff_symbol(FontDecoder::CoverageCodec codec, uint8_t byte, int pos, uint8_t *level, int *len)
+{
+    if (pos >= 8)
+        return false;
+    if (((byte >> (7 - pos)) & 1) == 0)
+    {
+        *level = 0;
+        *len = 1;
+        return true;
+    }
+    if (pos + 2 > 8)
+        return false;
+    bool second = ((byte >> (6 - pos)) & 1) != 0;
+    if (codec == FontDecoder::CODEC_V3)
+    {
+        *level = second ? 15 : FontDecoder::COVERAGE_V3_GRAY;
+        *len = 2;
+        return true;
+    }
+    if (!second)
+    {
+        *level = 15;
+        *len = 2;
+        return true;
+    }
+    if (pos + 6 > 8)
+        return false;
+    *level = (byte >> (2 - pos)) & 0x0F; // 11xxxx：xxxx 即深度（decode_bitmap 里 15-xxxx 是亮度）
+    *len = 6;
+    return true;
+}
+
+static void build_huff_table(HuffByteTable &t, FontDecoder::CoverageCodec codec)
+{
+    for (int b = 0; b < 256; b++)
+    {
+        uint32_t levels = 0;
+        int n = 0, pos = 0, len = 0;
+        uint8_t level = 0;
+        while (n < 8 && huff_symbol(codec, (uint8_t)b, pos, &level, &len))
+        {
+            levels |= (uint32_t)level << (4 * n);
+            n++;
+            pos += len;
+        }
+        t.levels[b] = levels;
+        t.count[b] = (uint8_t)n;
+        t.bits[b] = (uint8_t)pos;
+    }
+}
+
+CoverageTables::CoverageTables()
+{
+    build_huff_table(v2, FontDecoder::CODEC_V2_HUFFMAN);
+    build_huff_table(v3, FontDecoder::CODEC_V3);
+    for (int b = 0; b < 256; b++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            uint8_t hi = ((b >> (7 - 2 * k)) & 1) ? 0 : 15; // 1=白
+            uint8_t lo = ((b >> (6 - 2 * k)) & 1) ? 0 : 15;
+            mono[b][k] = (uint8_t)((hi << 4) | lo);
+        }
+    }
+}
+
+// 首次使用时构建（约 5KB，常驻内部 RAM）
+static const CoverageTables &coverage_tables()
+{
+    static CoverageTables tables;
+    return tables;
+}
+
+static void decode_huffman_coverage4(const HuffByteTable &t, const uint8_t *raw_data, uint32_t bitmap_size,
+                                     uint8_t *out, int16_t w, int16_t h)
+{
+    const size_t stride = (size_t)((w + 1) / 2);
+    const uint64_t total_bits = (uint64_t)bitmap_size * 8;
+    uint64_t consumed = 0;
+    uint32_t acc = 0; // 左对齐的位缓冲
+    int nbits = 0;
+    uint32_t byte_pos = 0;
+    int16_t x = 0, y = 0;
+    uint8_t *row = out;
+
+    while (y < h && consumed < total_bits)
+    {
+        // 数据末尾之后补 0（解成白色），与逐位解码在数据耗尽后保持背景一致
+        while (nbits <= 24)
+        {
+            uint32_t b = byte_pos < bitmap_size ? raw_data[byte_pos] : 0;
+            byte_pos++;
+            acc |= b << (24 - nbits);
+            nbits += 8;
+        }
+        uint8_t idx = (uint8_t)(acc >> 24);
+        uint8_t n = t.count[idx];
+        uint32_t levels = t.levels[idx];
+        acc <<= t.bits[idx];
+        nbits -= t.bits[idx];
+        consumed += t.bits[idx];
+
+        if (levels == 0)
+        {
+            // 全是背景：只推进坐标（out 已清零）
+            x += n;
+            while (x >= w && y < h)
+            {
+                x -= w;
+                y++;
+                row += stride;
+            }
+            continue;
+        }
+        for (uint8_t k = 0; k < n && y < h; k++, levels >>= 4)
+        {
+            uint8_t level = levels & 0x0F;
+            if (level)
+                row[x >> 1] |= (x & 1) ? level : (uint8_t)(level << 4);
+            if (++x == w)
+            {
+                x = 0;
+                y++;
+                row += stride;
+            }
+        }
+    }
+}
+
+static void decode_1bit_coverage4(const uint8_t mono[256][4], const uint8_t *raw_data, uint32_t bitmap_size,
+                                  uint8_t *out, int16_t w, int16_t h)
+{
+    const size_t stride = (size_t)((w + 1) / 2);
+    const int bytes_per_row = (w + 7) / 8;
+    for (int16_t y = 0; y < h; y++)
+    {
+        uint8_t *row = out + y * stride;
+        size_t src = (size_t)y * bytes_per_row;
+        for (int xb = 0; xb < bytes_per_row; xb++, src++)
+        {
+            if (src >= bitmap_size)
+                return; // 数据不足：其余保持背景
+            size_t dst = (size_t)xb * 4;
+            size_t n = stride - dst < 4 ? stride - dst : 4;
+            memcpy(row + dst, mono[raw_data[src]], n);
+        }
+    }
+}
+
+bool FontDecoder::decode_coverage4(CoverageCodec codec, const uint8_t* raw_data, uint32_t bitmap_size,
+                                   uint8_t* out, int16_t w, int16_t h)
+{
+    if (!raw_data || !out || w <= 0 || h <= 0)
+        return false;
+    memset(out, 0, coverage4_size(w, h));
+
+    const CoverageTables &t = coverage_tables();
+    switch (codec)
+    {
+    case CODEC_V3:
+        decode_huffman_coverage4(t.v3, raw_data, bitmap_size, out, w, h);
+        return true;
+    case CODEC_V2_1BIT:
+        decode_1bit_coverage4(t.mono, raw_data, bitmap_size, out, w, h);
+        return true;
+    case CODEC_V2_HUFFMAN:
+        decode_huffman_coverage4(t.v2, raw_data, bitmap_size, out, w, h);
+        return true;
+    }
+    return false;
+}
+
 void FontDecoder::draw_bitmap_direct(int16_t x, int16_t y, int16_t w, int16_t h, 
                                     uint32_t bitmap_offset, uint32_t bitmap_size)
 {
@@ -403,6 +598,10 @@ void FontDecoder::draw_bitmap_transparent(int16_t x, int16_t y, int16_t w, int16
                                          const uint16_t* bitmap)
 {
     if (!g_canvas || !bitmap) return;
+
+    // 画布为 4/8bpp 时直接写缓冲区
+    GlyphBlitStyle style = {0xF81F, true, 0xF81F, -1};
+    if (glyph_blit_canvas(g_canvas, x, y, bitmap, w, h, style)) return;
     
     // 逐像素绘制，跳过透明像素
     for (int16_t py = 0; py < h; py++)
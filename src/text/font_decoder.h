@@ -36,6 +36,23 @@ public:
                                             uint16_t* bitmap, int16_t w, int16_t h,
                                             bool dark_mode);
     
+    // ---- 直接解码为 4bpp 覆盖度（不生成 RGB565 中间位图） ----
+    // 每像素 4bit 墨色深度：0=背景（白），15=全墨色（黑）；行优先，每行 (w+1)/2 字节，偶数 x 在高半字节。
+    // 缓冲区只有 RGB565 位图的 1/4；霍夫曼格式按字节查表，每次消耗 8bit 产出多个像素。
+    enum CoverageCodec
+    {
+        CODEC_V2_HUFFMAN = 0, // decode_bitmap：0=白, 10=黑, 11xxxx=4bit 灰度（xxxx 即深度）
+        CODEC_V2_1BIT = 1,    // decode_bitmap_1bit：1=白, 0=黑
+        CODEC_V3 = 2          // decode_bitmap_v3：0=白, 10=灰, 11=黑
+    };
+    static const uint8_t COVERAGE_V3_GRAY = 8; // V3 灰色像素的覆盖度
+
+    static size_t coverage4_size(int16_t w, int16_t h) { return (size_t)((w + 1) / 2) * (size_t)h; }
+
+    // out 至少 coverage4_size(w, h) 字节；返回 false 表示参数无效
+    static bool decode_coverage4(CoverageCodec codec, const uint8_t* raw_data, uint32_t bitmap_size,
+                                 uint8_t* out, int16_t w, int16_t h);
+
     static void draw_bitmap_direct(int16_t x, int16_t y, int16_t w, int16_t h, 
                                   uint32_t bitmap_offset, uint32_t bitmap_size);
                                   
@@ -0,0 +1,548 @@
+#include "font_subset.h"
+#include "text/book_handle.h"
+#include "text/bin_font_print.h"
+#include "text/page_glyphs.h"
+#include "device/chunked_font_cache.h"
+#include "device/safe_fs.h"
+#include "../SD/SDWrapper.h"
+#include "readpaper.h"
+#include "test/per_file_debug.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+
+FontSubsetOverlay g_font_subset;
+
+static const size_t SUBSET_FONT_HEADER_SIZE = 134; // 与 load_bin_font 相同：6 字节基础头 + 族名 64 + 样式名 64
+static const size_t SUBSET_CHAR_RECORD_SIZE = 20;
+static const size_t SUBSET_TRAILER_SIZE = 16;
+static const uint8_t SUBSET_TRAILER_MAGIC[4] = {'R', 'P', 'S', 'S'};
+static const uint8_t SUBSET_TRAILER_VERSION = 1;
+static const size_t SUBSET_COPY_CHUNK = 8 * 1024; // 拷贝位图时单次合并读取上限
+static const size_t SUBSET_CACHE_CHUNK_KB = 64;   // 载入 PSRAM 的分块大小（小块减少碎片）
+
+static_assert(sizeof(BinFontChar) == SUBSET_CHAR_RECORD_SIZE, "BinFontChar must match the 20-byte char record");
+
+struct SubsetTrailer
+{
+    uint8_t zh_conv_mode = 0;
+    uint32_t source_font_size = 0;
+    uint32_t source_char_count = 0;
+};
+
+std::string getFontSubsetFileName(const std::string &book_file_path)
+{
+    // 与 .sidx 相同：复用 getBookmarkFileName 的安全化规则，只替换后缀
+    std::string bm = getBookmarkFileName(book_file_path);
+    size_t dot = bm.find_last_of('.');
+    if (dot != std::string::npos)
+        return bm.substr(0, dot) + ".subset.bin";
+    return bm + ".subset.bin";
+}
+
+bool clearFontSubsetForFile(const std::string &book_file_path)
+{
+    std::string fn = getFontSubsetFileName(book_file_path);
+    if (g_font_subset.isActive())
+        g_font_subset.detach();
+    bool ok = true;
+    if (SDW::SD.exists(fn.c_str()))
+        ok = SDW::SD.remove(fn.c_str());
+    std::string tmp = SafeFS::tmpPathFor(fn);
+    if (SDW::SD.exists(tmp.c_str()))
+        SDW::SD.remove(tmp.c_str());
+    return ok;
+}
+
+static bool subset_font_available()
+{
+    return bin_font_is_stream_mode() && !g_using_progmem_font && g_bin_font.fontFile;
+}
+
+// 从当前字体文件读取 size 字节（与渲染共用字体文件互斥锁）
+static bool read_source_font(uint32_t offset, uint8_t *dest, uint32_t size)
+{
+    extern SemaphoreHandle_t bin_font_get_file_mutex();
+    SemaphoreHandle_t mutex = bin_font_get_file_mutex();
+    if (mutex != nullptr && xSemaphoreTake(mutex, pdMS_TO_TICKS(100)) != pdTRUE)
+        return false;
+    size_t n = SDW::SD.readAtOffset(g_bin_font.fontFile, offset, dest, size);
+    if (mutex != nullptr)
+        xSemaphoreGive(mutex);
+    return n == size;
+}
+
+// 子集文件头除 char_count 外须与当前字体逐字节相同（字号、版本、族名、样式名）
+static bool header_matches_source(const uint8_t *hdr)
+{
+    uint8_t src[SUBSET_FONT_HEADER_SIZE];
+    if (!read_source_font(0, src, sizeof(src)))
+        return false;
+    return memcmp(hdr + 4, src + 4, SUBSET_FONT_HEADER_SIZE - 4) == 0;
+}
+
+static bool read_trailer(File &f, SubsetTrailer &t)
+{
+    size_t size = f.size();
+    if (size < SUBSET_FONT_HEADER_SIZE + SUBSET_TRAILER_SIZE)
+        return false;
+    uint8_t buf[SUBSET_TRAILER_SIZE];
+    if (!f.seek(size - SUBSET_TRAILER_SIZE) || f.read(buf, sizeof(buf)) != sizeof(buf))
+        return false;
+    if (memcmp(buf, SUBSET_TRAILER_MAGIC, 4) != 0 || buf[4] != SUBSET_TRAILER_VERSION)
+        return false;
+    t.zh_conv_mode = buf[5];
+    memcpy(&t.source_font_size, buf + 8, 4);
+    memcpy(&t.source_char_count, buf + 12, 4);
+    return true;
+}
+
+static bool trailer_matches_source(const SubsetTrailer &t)
+{
+    return t.source_font_size == (uint32_t)g_bin_font.fontFile.size() && t.source_char_count == g_bin_font.char_count;
+}
+
+// 子集是否由当前字体、当前繁简模式生成（只看头与尾部，不逐字校验）
+static bool subset_up_to_date(const std::string &fn, uint8_t zh_conv_mode)
+{
+    File f = SDW::SD.open(fn.c_str(), "r");
+    if (!f)
+        return false;
+    uint8_t hdr[SUBSET_FONT_HEADER_SIZE];
+    SubsetTrailer t;
+    bool ok = f.read(hdr, sizeof(hdr)) == sizeof(hdr) && read_trailer(f, t);
+    f.close();
+    return ok && t.zh_conv_mode == zh_conv_mode && trailer_matches_source(t) && header_matches_source(hdr);
+}
+
+// ========== 后台构建 ==========
+
+enum class SubsetStage : uint8_t
+{
+    Idle,    // 尚未为当前书/字体做过检查
+    Collect, // 从 .pgg 汇总全书码点
+    Write,   // 逐段拷贝位图到 .tmp
+    Done     // 已生成、无需生成或放弃
+};
+
+struct SubsetBuildState
+{
+    std::string book_path;
+    std::string out_file;
+    uint32_t font_epoch = 0;
+    uint8_t zh_conv_mode = 0;
+    SubsetStage stage = SubsetStage::Idle;
+    size_t next_page = 0;
+    std::vector<uint32_t, PSRAMAllocator<uint32_t>> seen; // 65536 位
+    std::vector<BinFontChar, PSRAMAllocator<BinFontChar>> table; // bitmap_offset 为原字体中的偏移
+    size_t next_glyph = 0;
+    File out;
+};
+
+static SubsetBuildState s_sub;
+static PageGlyphIndex s_sub_pgg;
+
+static void resetSubsetState()
+{
+    if (s_sub.out)
+    {
+        s_sub.out.close();
+        SDW::SD.remove(SafeFS::tmpPathFor(s_sub.out_file).c_str());
+    }
+    s_sub.book_path.clear();
+    s_sub.out_file.clear();
+    s_sub.stage = SubsetStage::Idle;
+    s_sub.next_page = 0;
+    s_sub.next_glyph = 0;
+    std::vector<uint32_t, PSRAMAllocator<uint32_t>>().swap(s_sub.seen);
+    std::vector<BinFontChar, PSRAMAllocator<BinFontChar>>().swap(s_sub.table);
+    s_sub_pgg.reset(std::string());
+}
+
+// 放弃本书本字体下的构建（直到换书或换字体）
+static void finishSubset()
+{
+    if (s_sub.out)
+    {
+        s_sub.out.close();
+        SDW::SD.remove(SafeFS::tmpPathFor(s_sub.out_file).c_str());
+    }
+    std::vector<uint32_t, PSRAMAllocator<uint32_t>>().swap(s_sub.seen);
+    std::vector<BinFontChar, PSRAMAllocator<BinFontChar>>().swap(s_sub.table);
+    s_sub_pgg.reset(std::string());
+    s_sub.stage = SubsetStage::Done;
+}
+
+static void markSeen(uint16_t cp)
+{
+    s_sub.seen[cp >> 5] |= (1u << (cp & 31));
+}
+
+static bool prepareSubsetBuild(BookHandle *bh)
+{
+    s_sub.book_path = bh->filePath();
+    s_sub.out_file = getFontSubsetFileName(s_sub.book_path);
+    s_sub.font_epoch = bin_font_get_load_epoch();
+    s_sub.zh_conv_mode = bh->getEffectiveZhConvMode();
+
+    SafeFS::restoreFromTmpIfNeeded(s_sub.out_file);
+    if (subset_up_to_date(s_sub.out_file, s_sub.zh_conv_mode))
+        return false;
+
+    // 码点来源是 .pgg：必须覆盖全书，且与当前字体、繁简模式一致
+    s_sub_pgg.reset(bh->getPageGlyphFileName());
+    size_t pages = s_sub_pgg.refresh();
+    if (!s_sub_pgg.usable(s_sub.zh_conv_mode, PageGlyphIndex::currentFontTag()) || pages < bh->getTotalPages())
+    {
+#if DBG_FONT_SUBSET
+        Serial.printf("[SUBSET] %s: .pgg unusable (pages=%u/%u), skip\n", s_sub.book_path.c_str(),
+                      (unsigned)pages, (unsigned)bh->getTotalPages());
+#endif
+        return false;
+    }
+
+    s_sub.seen.assign(65536 / 32, 0);
+    for (uint16_t cp = 0x20; cp < 0x7F; ++cp)
+        markSeen(cp);
+    s_sub.next_page = 0;
+    s_sub.stage = SubsetStage::Collect;
+    return true;
+}
+
+// 码点汇总完成：生成字符表并写出文件头
+static bool beginSubsetWrite()
+{
+    s_sub.table.clear();
+    for (uint32_t cp = 0; cp < 65536; ++cp)
+    {
+        if (!(s_sub.seen[cp >> 5] & (1u << (cp & 31))))
+            continue;
+        const BinFontChar *fc = find_char(cp);
+        if (fc)
+            s_sub.table.push_back(*fc);
+    }
+    std::vector<uint32_t, PSRAMAllocator<uint32_t>>().swap(s_sub.seen);
+
+    uint64_t bitmap_bytes = 0;
+    for (const BinFontChar &c : s_sub.table)
+        bitmap_bytes += c.bitmap_size;
+    uint64_t total = SUBSET_FONT_HEADER_SIZE + (uint64_t)s_sub.table.size() * SUBSET_CHAR_RECORD_SIZE + bitmap_bytes +
+                     SUBSET_TRAILER_SIZE;
+
+    // 子集只有在明显小于原字体、且放得进 PSRAM 预算时才有意义
+    if (s_sub.table.empty() || s_sub.table.size() * 2 > g_bin_font.char_count || total > FONT_SUBSET_MAX_BYTES)
+    {
+#if DBG_FONT_SUBSET
+        Serial.printf("[SUBSET] %s: %u/%u glyphs, %u bytes, not worth a subset\n", s_sub.book_path.c_str(),
+                      (unsigned)s_sub.table.size(), (unsigned)g_bin_font.char_count, (unsigned)total);
+#endif
+        return false;
+    }
+
+    uint8_t hdr[SUBSET_FONT_HEADER_SIZE];
+    if (!read_source_font(0, hdr, sizeof(hdr)))
+        return false;
+    uint32_t count = (uint32_t)s_sub.table.size();
+    memcpy(hdr, &count, 4);
+
+    if (!ensureBookmarksFolder())
+        return false;
+    s_sub.out = SDW::SD.open(SafeFS::tmpPathFor(s_sub.out_file).c_str(), "w");
+    if (!s_sub.out)
+        return false;
+    if (s_sub.out.write(hdr, sizeof(hdr)) != sizeof(hdr))
+        return false;
+
+    uint32_t data_offset = (uint32_t)(SUBSET_FONT_HEADER_SIZE + s_sub.table.size() * SUBSET_CHAR_RECORD_SIZE);
+    for (const BinFontChar &src : s_sub.table)
+    {
+        BinFontChar rec = src;
+        rec.bitmap_offset = data_offset;
+        rec.cached_bitmap = src.bitmap_offset;
+        data_offset += src.bitmap_size;
+        if (s_sub.out.write((const uint8_t *)&rec, sizeof(rec)) != sizeof(rec))
+            return false;
+    }
+    s_sub.next_glyph = 0;
+    s_sub.stage = SubsetStage::Write;
+#if DBG_FONT_SUBSET
+    Serial.printf("[SUBSET] %s: writing %u glyphs, %u bytes\n", s_sub.book_path.c_str(), (unsigned)count,
+                  (unsigned)total);
+#endif
+    return true;
+}
+
+// 拷贝一段位图：原字体中首尾相接的字形合并为一次读取
+static bool copySubsetBitmaps(std::vector<uint8_t> &buf)
+{
+    const auto &table = s_sub.table;
+    size_t first = s_sub.next_glyph;
+    size_t end = first + 1;
+    size_t bytes = table[first].bitmap_size;
+    while (end < table.size() && table[end].bitmap_offset == table[end - 1].bitmap_offset + table[end - 1].bitmap_size &&
+           bytes + table[end].bitmap_size <= SUBSET_COPY_CHUNK)
+    {
+        bytes += table[end].bitmap_size;
+        ++end;
+    }
+    if (bytes > 0)
+    {
+        if (buf.size() < bytes)
+            buf.resize(bytes);
+        if (!read_source_font(table[first].bitmap_offset, buf.data(), (uint32_t)bytes))
+            return false;
+        if (s_sub.out.write(buf.data(), bytes) != bytes)
+            return false;
+    }
+    s_sub.next_glyph = end;
+    return true;
+}
+
+static bool finishSubsetWrite()
+{
+    uint8_t trailer[SUBSET_TRAILER_SIZE] = {0};
+    memcpy(trailer, SUBSET_TRAILER_MAGIC, 4);
+    trailer[4] = SUBSET_TRAILER_VERSION;
+    trailer[5] = s_sub.zh_conv_mode;
+    uint32_t src_size = (uint32_t)g_bin_font.fontFile.size();
+    uint32_t src_count = g_bin_font.char_count;
+    memcpy(trailer + 8, &src_size, 4);
+    memcpy(trailer + 12, &src_count, 4);
+    bool ok = s_sub.out.write(trailer, sizeof(trailer)) == sizeof(trailer);
+    s_sub.out.flush();
+    s_sub.out.close();
+    std::string tmp = SafeFS::tmpPathFor(s_sub.out_file);
+    if (!ok || !SafeFS::promoteTmpToFinal(tmp, s_sub.out_file))
+    {
+        SDW::SD.remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool backgroundBuildFontSubsetIncremental(BookHandle *bh, uint32_t budget_ms)
+{
+    if (!bh || bh->isClosing() || !subset_font_available())
+        return false;
+    if (s_sub.stage != SubsetStage::Idle &&
+        (s_sub.book_path != bh->filePath() || s_sub.font_epoch != bin_font_get_load_epoch()))
+        resetSubsetState();
+    if (s_sub.stage == SubsetStage::Done)
+        return false;
+
+    if (s_sub.stage == SubsetStage::Idle)
+    {
+        if (!prepareSubsetBuild(bh))
+        {
+            finishSubset();
+            return false;
+        }
+        return true;
+    }
+
+    unsigned long t0 = millis();
+    bool failed = false;
+
+    if (s_sub.stage == SubsetStage::Collect)
+    {
+        std::vector<uint16_t, PSRAMAllocator<uint16_t>> set;
+        while (s_sub.next_page < s_sub_pgg.size() && (millis() - t0) < budget_ms && !bh->isClosing())
+        {
+            if (!s_sub_pgg.read(s_sub.next_page, set))
+            {
+                failed = true;
+                break;
+            }
+            for (uint16_t cp : set)
+                markSeen(cp);
+            ++s_sub.next_page;
+        }
+        if (!failed && s_sub.next_page >= s_sub_pgg.size() && !beginSubsetWrite())
+            failed = true;
+    }
+    else if (s_sub.stage == SubsetStage::Write)
+    {
+        std::vector<uint8_t> buf;
+        while (s_sub.next_glyph < s_sub.table.size() && (millis() - t0) < budget_ms && !bh->isClosing())
+        {
+            if (!copySubsetBitmaps(buf))
+            {
+                failed = true;
+                break;
+            }
+        }
+        if (!failed && s_sub.next_glyph >= s_sub.table.size())
+        {
+            size_t glyphs = s_sub.table.size();
+            if (!finishSubsetWrite())
+            {
+                failed = true;
+            }
+            else
+            {
+                std::string book_path = s_sub.book_path;
+                finishSubset();
+#if DBG_FONT_SUBSET
+                Serial.printf("[SUBSET] %s: done, %u glyphs\n", book_path.c_str(), (unsigned)glyphs);
+#else
+                (void)glyphs;
+#endif
+                g_font_subset.attachForBook(book_path, true);
+            }
+        }
+    }
+
+    if (failed)
+    {
+#if DBG_FONT_SUBSET
+        Serial.printf("[SUBSET] %s: build failed, keep streaming from the full font\n", s_sub.book_path.c_str());
+#endif
+        finishSubset();
+    }
+    return true;
+}
+
+// ========== 阅读端覆盖层 ==========
+
+struct SubsetEntry
+{
+    uint32_t src_offset; // 原字体中的位图偏移
+    uint32_t sub_offset; // 子集文件中的位图偏移
+    uint32_t size;
+};
+
+struct FontSubsetOverlay::State
+{
+    File file;
+    ChunkedFontCache cache;
+    std::vector<SubsetEntry, PSRAMAllocator<SubsetEntry>> entries; // 按 src_offset 升序
+};
+
+FontSubsetOverlay::~FontSubsetOverlay()
+{
+    detach();
+}
+
+size_t FontSubsetOverlay::glyphCount() const
+{
+    return active_ && state_ ? state_->entries.size() : 0;
+}
+
+void FontSubsetOverlay::detach()
+{
+    if (!mutex_)
+        mutex_ = xSemaphoreCreateMutex();
+    bool locked = mutex_ && xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) == pdTRUE;
+    active_ = false;
+    state_.reset();
+    checked_path_.clear(); // 下次 attachForBook 重新检查
+    if (locked)
+        xSemaphoreGive(mutex_);
+}
+
+bool FontSubsetOverlay::attachForBook(const std::string &book_file_path, bool force)
+{
+    if (!subset_font_available())
+    {
+        if (active_)
+            detach();
+        return false;
+    }
+    uint32_t epoch = bin_font_get_load_epoch();
+    if (!force && checked_path_ == book_file_path && checked_epoch_ == epoch)
+        return active_;
+    detach();
+    checked_path_ = book_file_path;
+    checked_epoch_ = epoch;
+
+    std::string fn = getFontSubsetFileName(book_file_path);
+    if (!SDW::SD.exists(fn.c_str()))
+        return false;
+
+    std::unique_ptr<State> st(new State());
+    st->file = SDW::SD.open(fn.c_str(), "r");
+    if (!st->file)
+        return false;
+    size_t size = st->file.size();
+    if (size > FONT_SUBSET_MAX_BYTES ||
+        heap_caps_get_free_size(MALLOC_CAP_SPIRAM) < size + PAGE_STORE_PSRAM_MIN_FREE)
+    {
+#if DBG_FONT_SUBSET
+        Serial.printf("[SUBSET] %s: %u bytes does not fit in PSRAM, not attached\n", fn.c_str(), (unsigned)size);
+#endif
+        return false;
+    }
+
+    uint8_t hdr[SUBSET_FONT_HEADER_SIZE];
+    SubsetTrailer trailer;
+    if (st->file.read(hdr, sizeof(hdr)) != sizeof(hdr) || !read_trailer(st->file, trailer) ||
+        !trailer_matches_source(trailer) || !header_matches_source(hdr))
+        return false;
+    uint32_t count = 0;
+    memcpy(&count, hdr, 4);
+    size_t table_end = SUBSET_FONT_HEADER_SIZE + (size_t)count * SUBSET_CHAR_RECORD_SIZE;
+    if (count == 0 || table_end > size - SUBSET_TRAILER_SIZE)
+        return false;
+
+    // 逐项与原字体核对：同一码点的度量与位图位置必须一致，否则子集不是由这份字体生成的
+    std::vector<BinFontChar, PSRAMAllocator<BinFontChar>> table(count);
+    if (!st->file.seek(SUBSET_FONT_HEADER_SIZE) ||
+        st->file.read((uint8_t *)table.data(), count * SUBSET_CHAR_RECORD_SIZE) != count * SUBSET_CHAR_RECORD_SIZE)
+        return false;
+    st->entries.reserve(count);
+    for (const BinFontChar &rec : table)
+    {
+        const BinFontChar *fc = find_char(rec.unicode);
+        if (!fc || fc->bitmap_offset != rec.cached_bitmap || fc->bitmap_size != rec.bitmap_size ||
+            fc->width != rec.width || fc->bitmapW != rec.bitmapW || fc->bitmapH != rec.bitmapH ||
+            rec.bitmap_offset < table_end || rec.bitmap_offset + rec.bitmap_size > size - SUBSET_TRAILER_SIZE)
+        {
+#if DBG_FONT_SUBSET
+            Serial.printf("[SUBSET] %s: glyph U+%04X does not match the loaded font\n", fn.c_str(), rec.unicode);
+#endif
+            return false;
+        }
+        st->entries.push_back({rec.cached_bitmap, rec.bitmap_offset, rec.bitmap_size});
+    }
+    std::vector<BinFontChar, PSRAMAllocator<BinFontChar>>().swap(table);
+    std::sort(st->entries.begin(), st->entries.end(),
+              [](const SubsetEntry &a, const SubsetEntry &b) { return a.src_offset < b.src_offset; });
+
+    // 整个子集载入 PSRAM；任何一块失败都放弃（不回退到读子集文件）
+    if (!st->cache.load_entire_font_chunked(st->file, SUBSET_CACHE_CHUNK_KB) || !st->cache.is_fully_loaded())
+        return false;
+    st->file.close(); // 已全部在内存中，read_data 不再访问文件
+
+    if (!mutex_)
+        mutex_ = xSemaphoreCreateMutex();
+    if (!mutex_ || xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) != pdTRUE)
+        return false;
+    state_.swap(st);
+    active_ = true;
+    xSemaphoreGive(mutex_);
+
+#if DBG_FONT_SUBSET
+    Serial.printf("[SUBSET] attached %s: %u glyphs, %u bytes in PSRAM\n", fn.c_str(), (unsigned)count,
+                  (unsigned)size);
+#endif
+    return true;
+}
+
+bool FontSubsetOverlay::read(uint32_t src_offset, uint8_t *dest, uint32_t size)
+{
+    if (!active_ || !mutex_)
+        return false;
+    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(20)) != pdTRUE)
+        return false;
+    bool ok = false;
+    if (active_ && state_)
+    {
+        const auto &entries = state_->entries;
+        auto it = std::lower_bound(entries.begin(), entries.end(), src_offset,
+                                   [](const SubsetEntry &e, uint32_t off) { return e.src_offset < off; });
+        if (it != entries.end() && it->src_offset == src_offset && it->size == size)
+            ok = size == 0 || state_->cache.read_data(it->sub_offset, dest, size);
+    }
+    xSemaphoreGive(mutex_);
+    return ok;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+class BookHandle;
+
+// 每本书的子集字体（/bookmarks/<safe>.subset.bin）
+//
+// 分页完成后，后台索引循环按 .pgg 记录的全书码点（另加 ASCII 可见字符）从当前字体中抽出这些字形，
+// 写成与原字体同版本的 .bin（134 字节头 + 20 字节字符表 + 位图，load_bin_font 可直接加载）：
+//   - 位图字节原样拷贝（v2 1bit / v3 Huffman 都不重新编码）
+//   - 字符表的 cached_bitmap（保留字段）记录该字形在原字体中的位图偏移
+//   - 位图之后追加 16 字节尾部："RPSS" | u8 version | u8 zh_conv_mode | u16 reserved
+//                              | u32 source_font_size | u32 source_char_count
+//
+// 阅读时子集整体载入 PSRAM（ChunkedFontCache），作为原字体之上的覆盖层：
+// 按原字体位图偏移查表命中即从内存取位图，未命中（UI 字符串、繁简模式变化后新增的字等）仍从原字体流式读取。
+// 字形度量、换行结果与原字体完全一致，因此分页与 .page 不受影响。
+
+// /bookmarks/<safe>.subset.bin
+std::string getFontSubsetFileName(const std::string &book_file_path);
+
+// 删除子集字体（书籍删除时调用）
+bool clearFontSubsetForFile(const std::string &book_file_path);
+
+// 后台增量构建：在 budget_ms 内推进，返回是否做了有效工作。
+// 仅应在分页索引完成后由后台索引循环调用；只读 .pgg 与字体文件，不占用书籍文件锁。
+bool backgroundBuildFontSubsetIncremental(BookHandle *bh, uint32_t budget_ms);
+
+class FontSubsetOverlay
+{
+public:
+    FontSubsetOverlay() = default;
+    ~FontSubsetOverlay();
+    FontSubsetOverlay(const FontSubsetOverlay &) = delete;
+    FontSubsetOverlay &operator=(const FontSubsetOverlay &) = delete;
+
+    // 为该书挂载子集字体（存在且与当前字体一致时）。同一本书、同一字体下重复调用只检查一次，
+    // force=true 时重新检查（后台刚生成子集后使用）。
+    bool attachForBook(const std::string &book_file_path, bool force = false);
+    // 卸载并释放 PSRAM；之后的 attachForBook 会重新检查
+    void detach();
+
+    // 按原字体位图偏移读取；不在子集中或未挂载时返回 false，调用方改走原字体
+    bool read(uint32_t src_offset, uint8_t *dest, uint32_t size);
+
+    bool isActive() const { return active_; }
+    size_t glyphCount() const;
+
+private:
+    struct State;
+
+    std::unique_ptr<State> state_;
+    volatile bool active_ = false;
+    std::string checked_path_; // 最近一次检查过的书（无论是否挂载成功）
+    uint32_t checked_epoch_ = 0;
+    SemaphoreHandle_t mutex_ = nullptr;
+};
+
+extern FontSubsetOverlay g_font_subset;
@@ -0,0 +1,450 @@
+#include "glyph_atlas.h"
+#include "font_buffer.h"
+#include "font_subset.h"
+#include "text/bin_font_print.h"
+#include "SD/SDWrapper.h"
+#include "readpaper.h"
+#include "test/per_file_debug.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+GlyphAtlas g_glyph_atlas;
+
+// 位图区按 16 字节单元分配（ASCII 小字形也只占一两个单元）
+static const uint32_t ATLAS_CELL_BYTES = 16;
+
+struct GlyphAtlas::Entry
+{
+    CharGlyphInfo info; // bitmap_offset 为位图区内的字节偏移
+    uint16_t refs;
+    uint8_t referenced; // clock 访问位
+    uint8_t used;
+    uint32_t cells;
+};
+
+static void *atlas_alloc(size_t bytes)
+{
+    void *p = heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM);
+    if (!p)
+        p = calloc(1, bytes);
+    return p;
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    freeStorage();
+}
+
+bool GlyphAtlas::init()
+{
+    if (mutex_)
+        return true;
+    mutex_ = xSemaphoreCreateMutex();
+    if (!mutex_)
+    {
+        Serial.printf("[GlyphAtlas] Error: failed to create mutex\n");
+        return false;
+    }
+    return true;
+}
+
+bool GlyphAtlas::lock() const
+{
+    if (!mutex_)
+        return false;
+    return xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) == pdTRUE;
+}
+
+void GlyphAtlas::unlock() const
+{
+    if (mutex_)
+        xSemaphoreGive(mutex_);
+}
+
+bool GlyphAtlas::ensureStorage()
+{
+    if (arena_)
+        return true;
+
+    cell_count_ = GLYPH_ATLAS_BYTES / ATLAS_CELL_BYTES;
+    arena_ = static_cast<uint8_t *>(heap_caps_malloc(GLYPH_ATLAS_BYTES, MALLOC_CAP_SPIRAM));
+    slot_of_ = static_cast<uint16_t *>(atlas_alloc(65536 * sizeof(uint16_t)));
+    entries_ = static_cast<Entry *>(atlas_alloc(GLYPH_ATLAS_MAX_GLYPHS * sizeof(Entry)));
+    if (!arena_ || !slot_of_ || !entries_)
+    {
+        Serial.printf("[GlyphAtlas] Error: failed to allocate atlas (%u bytes)\n", (unsigned)GLYPH_ATLAS_BYTES);
+        freeStorage();
+        return false;
+    }
+    cell_used_.assign((cell_count_ + 31) / 32, 0);
+    free_ids_.clear();
+    free_ids_.reserve(GLYPH_ATLAS_MAX_GLYPHS);
+    for (uint32_t i = GLYPH_ATLAS_MAX_GLYPHS; i-- > 0;)
+        free_ids_.push_back((uint16_t)i);
+    cell_cursor_ = 0;
+    clock_hand_ = 0;
+    stats_ = {};
+    stats_.capacity_bytes = GLYPH_ATLAS_BYTES;
+    return true;
+}
+
+void GlyphAtlas::freeStorage()
+{
+    if (arena_)
+        heap_caps_free(arena_);
+    if (slot_of_)
+        free(slot_of_);
+    if (entries_)
+        free(entries_);
+    arena_ = nullptr;
+    slot_of_ = nullptr;
+    entries_ = nullptr;
+    std::vector<uint32_t>().swap(cell_used_);
+    std::vector<uint16_t>().swap(free_ids_);
+    cell_count_ = 0;
+}
+
+void GlyphAtlas::reset()
+{
+    bool locked = lock();
+    freeStorage();
+    ++generation_;
+    stats_ = {};
+    if (locked)
+        unlock();
+#if DBG_FONT_BUFFER
+    Serial.printf("[GlyphAtlas] Reset (generation=%u)\n", (unsigned)generation_);
+#endif
+}
+
+void GlyphAtlas::markCells(uint32_t first_cell, uint32_t cells, bool used)
+{
+    for (uint32_t c = first_cell; c < first_cell + cells; ++c)
+    {
+        if (used)
+            cell_used_[c >> 5] |= (1u << (c & 31));
+        else
+            cell_used_[c >> 5] &= ~(1u << (c & 31));
+    }
+}
+
+// next-fit：从上次分配处向后找连续空闲单元，到末尾后回到开头再找一遍
+bool GlyphAtlas::findRun(uint32_t cells, uint32_t &first_cell)
+{
+    if (cells == 0 || cells > cell_count_)
+        return false;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        uint32_t c = pass == 0 ? cell_cursor_ : 0;
+        uint32_t limit = pass == 0 ? cell_count_ : cell_cursor_ + cells;
+        if (limit > cell_count_)
+            limit = cell_count_;
+        uint32_t run = 0;
+        uint32_t run_start = c;
+        while (c < limit)
+        {
+            // 整字全满时一次跳过 32 个单元
+            if ((c & 31) == 0 && cell_used_[c >> 5] == 0xFFFFFFFFu)
+            {
+                run = 0;
+                c += 32;
+                continue;
+            }
+            if (cell_used_[c >> 5] & (1u << (c & 31)))
+            {
+                run = 0;
+            }
+            else
+            {
+                if (run == 0)
+                    run_start = c;
+                if (++run == cells)
+                {
+                    first_cell = run_start;
+                    cell_cursor_ = run_start + cells;
+                    if (cell_cursor_ >= cell_count_)
+                        cell_cursor_ = 0;
+                    return true;
+                }
+            }
+            ++c;
+        }
+    }
+    return false;
+}
+
+void GlyphAtlas::evict(uint16_t id)
+{
+    Entry &e = entries_[id];
+    if (e.cells > 0)
+        markCells(e.info.bitmap_offset / ATLAS_CELL_BYTES, e.cells, false);
+    slot_of_[e.info.unicode] = 0;
+    stats_.bytes_used -= e.info.bitmap_size;
+    stats_.glyphs--;
+    stats_.evictions++;
+    e.used = 0;
+    free_ids_.push_back(id);
+}
+
+// clock：跳过被钉住的字形；访问位置位的给第二次机会
+bool GlyphAtlas::evictOne()
+{
+    for (uint32_t step = 0; step < 2 * GLYPH_ATLAS_MAX_GLYPHS; ++step)
+    {
+        uint16_t id = (uint16_t)clock_hand_;
+        clock_hand_ = (clock_hand_ + 1) % GLYPH_ATLAS_MAX_GLYPHS;
+        Entry &e = entries_[id];
+        if (!e.used || e.refs > 0)
+            continue;
+        if (e.referenced)
+        {
+            e.referenced = 0;
+            continue;
+        }
+        evict(id);
+        return true;
+    }
+    return false;
+}
+
+bool GlyphAtlas::allocCells(uint32_t cells, uint32_t &first_cell)
+{
+    if (cells == 0)
+    {
+        first_cell = 0;
+        return true;
+    }
+    while (!findRun(cells, first_cell))
+    {
+        if (!evictOne())
+            return false;
+    }
+    markCells(first_cell, cells, true);
+    return true;
+}
+
+bool GlyphAtlas::allocEntry(uint16_t unicode, const BinFontChar &fc, uint16_t &id)
+{
+    // 条目号用尽时同样按 clock 淘汰
+    if (free_ids_.empty() && !evictOne())
+    {
+        stats_.alloc_failures++;
+        return false;
+    }
+    uint32_t cells = (fc.bitmap_size + ATLAS_CELL_BYTES - 1) / ATLAS_CELL_BYTES;
+    uint32_t first_cell = 0;
+    if (!allocCells(cells, first_cell))
+    {
+        stats_.alloc_failures++;
+        return false;
+    }
+
+    id = free_ids_.back();
+    free_ids_.pop_back();
+    Entry &e = entries_[id];
+    e.info.unicode = unicode;
+    e.info.width = fc.width;
+    e.info.bitmapW = fc.bitmapW;
+    e.info.bitmapH = fc.bitmapH;
+    e.info.x_offset = fc.x_offset;
+    e.info.y_offset = fc.y_offset;
+    e.info.bitmap_size = fc.bitmap_size;
+    e.info.bitmap_offset = first_cell * ATLAS_CELL_BYTES;
+    e.cells = cells;
+    e.refs = 0;
+    e.referenced = 1;
+    e.used = 1;
+    return true;
+}
+
+bool GlyphAtlas::insert(const BinFontChar &fc, const uint8_t *bitmap, uint32_t generation)
+{
+    if (!lock())
+        return false;
+    // 预取期间换过字体：位图属于旧字体，丢弃
+    if (generation != generation_ || !ensureStorage())
+    {
+        unlock();
+        return false;
+    }
+    if (slot_of_[fc.unicode])
+    {
+        unlock();
+        return true;
+    }
+    uint16_t id = 0;
+    if (!allocEntry(fc.unicode, fc, id))
+    {
+        unlock();
+        return false;
+    }
+    Entry &e = entries_[id];
+    if (fc.bitmap_size > 0)
+        memcpy(arena_ + e.info.bitmap_offset, bitmap, fc.bitmap_size);
+    slot_of_[fc.unicode] = id + 1;
+    stats_.glyphs++;
+    stats_.prefetched++;
+    stats_.bytes_used += fc.bitmap_size;
+    unlock();
+    return true;
+}
+
+const CharGlyphInfo *GlyphAtlas::acquire(uint16_t unicode, bool *loaded_from_sd)
+{
+    if (loaded_from_sd)
+        *loaded_from_sd = false;
+    if (!lock())
+        return nullptr;
+    if (!ensureStorage())
+    {
+        unlock();
+        return nullptr;
+    }
+
+    uint16_t slot = slot_of_[unicode];
+    if (slot)
+    {
+        Entry &e = entries_[slot - 1];
+        if (e.refs == 0)
+            stats_.pinned++;
+        if (e.refs < 0xFFFF)
+            e.refs++;
+        e.referenced = 1;
+        unlock();
+        return &e.info;
+    }
+
+    const BinFontChar *fc = find_char(unicode);
+    if (!fc || !g_bin_font.fontFile)
+    {
+        unlock();
+        return nullptr;
+    }
+
+    uint16_t id = 0;
+    if (!allocEntry(unicode, *fc, id))
+    {
+        unlock();
+        return nullptr;
+    }
+    Entry &e = entries_[id];
+    e.refs = 1;
+    uint32_t first_cell = e.info.bitmap_offset / ATLAS_CELL_BYTES;
+    uint32_t cells = e.cells;
+
+    if (fc->bitmap_size > 0 && g_font_subset.read(fc->bitmap_offset, arena_ + e.info.bitmap_offset, fc->bitmap_size))
+    {
+        stats_.subset_hits++;
+    }
+    else if (fc->bitmap_size > 0 && bin_font_read_hot(fc->bitmap_offset, arena_ + e.info.bitmap_offset, fc->bitmap_size))
+    {
+        stats_.hot_hits++;
+    }
+    else if (fc->bitmap_size > 0)
+    {
+        extern SemaphoreHandle_t bin_font_get_file_mutex();
+        SemaphoreHandle_t font_mutex = bin_font_get_file_mutex();
+        // 取不到字体文件锁时不能与 GlyphFetch 的合并读取共用文件句柄：本次查找失败，调用方走自己的回退路径
+        bool got_lock = font_mutex == nullptr || xSemaphoreTake(font_mutex, pdMS_TO_TICKS(100)) == pdTRUE;
+        size_t read_bytes = 0;
+        if (got_lock)
+        {
+            read_bytes = SDW::SD.readAtOffset(g_bin_font.fontFile, fc->bitmap_offset,
+                                              arena_ + e.info.bitmap_offset, fc->bitmap_size);
+            if (font_mutex)
+                xSemaphoreGive(font_mutex);
+        }
+        if (read_bytes != fc->bitmap_size)
+        {
+            Serial.printf("[GlyphAtlas] Warning: Failed to read glyph U+%04X (expected %u, got %u%s)\n",
+                          unicode, (unsigned)fc->bitmap_size, (unsigned)read_bytes, got_lock ? "" : ", font file busy");
+            if (cells > 0)
+                markCells(first_cell, cells, false);
+            e.used = 0;
+            free_ids_.push_back(id);
+            unlock();
+            return nullptr;
+        }
+        stats_.sd_loads++;
+        if (loaded_from_sd)
+            *loaded_from_sd = true;
+    }
+
+    slot_of_[unicode] = id + 1;
+    stats_.glyphs++;
+    stats_.pinned++;
+    stats_.bytes_used += fc->bitmap_size;
+    unlock();
+    return &e.info;
+}
+
+void GlyphAtlas::release(uint16_t unicode)
+{
+    if (!lock())
+        return;
+    if (slot_of_)
+    {
+        uint16_t slot = slot_of_[unicode];
+        if (slot)
+        {
+            Entry &e = entries_[slot - 1];
+            if (e.refs > 0 && --e.refs == 0)
+                stats_.pinned--;
+        }
+    }
+    unlock();
+}
+
+const CharGlyphInfo *GlyphAtlas::find(uint16_t unicode) const
+{
+    if (!lock())
+        return nullptr;
+    const CharGlyphInfo *info = nullptr;
+    uint16_t slot = slot_of_ ? slot_of_[unicode] : 0;
+    if (slot)
+    {
+        Entry &e = entries_[slot - 1];
+        e.referenced = 1;
+        info = &e.info;
+    }
+    unlock();
+    return info;
+}
+
+bool GlyphAtlas::copyBitmap(uint16_t unicode, uint8_t *out, size_t size) const
+{
+    if (!out || !lock())
+        return false;
+    bool ok = false;
+    uint16_t slot = slot_of_ ? slot_of_[unicode] : 0;
+    if (slot)
+    {
+        Entry &e = entries_[slot - 1];
+        if (e.info.bitmap_size == size)
+        {
+            // 持锁复制：GlyphFetch 的 insert/evictOne 同样持锁，复制期间单元不会被淘汰复用
+            if (size > 0)
+                memcpy(out, arena_ + e.info.bitmap_offset, size);
+            e.referenced = 1;
+            ok = true;
+        }
+    }
+    unlock();
+    return ok;
+}
+
+GlyphAtlas::Stats GlyphAtlas::getStats() const
+{
+    return stats_;
+}
+
+void GlyphAtlas::logStats() const
+{
+    Serial.printf("[GlyphAtlas] glyphs=%u pinned=%u bytes=%u/%u sd_loads=%u subset_hits=%u hot_hits=%u prefetched=%u evictions=%u alloc_failures=%u\n",
+                  (unsigned)stats_.glyphs, (unsigned)stats_.pinned, (unsigned)stats_.bytes_used,
+                  (unsigned)stats_.capacity_bytes, (unsigned)stats_.sd_loads, (unsigned)stats_.subset_hits,
+                  (unsigned)stats_.hot_hits, (unsigned)stats_.prefetched,
+                  (unsigned)stats_.evictions,
+                  (unsigned)stats_.alloc_failures);
+}
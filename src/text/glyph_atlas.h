@@ -0,0 +1,93 @@
+#pragma once
+// 全书共用的字形位图图集：每个码点在 PSRAM 中只存一份
+//
+// 页面窗口（5 页）与 UI（通用字符、书名、目录）只持有码点列表并对图集中的字形计数引用（钉住），
+// 不再各自复制位图。引用数为 0 的字形继续留在图集中供后续页面复用，空间不足时按 clock 淘汰。
+// 总容量由 GLYPH_ATLAS_BYTES / GLYPH_ATLAS_MAX_GLYPHS 限定。
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+struct CharGlyphInfo;
+struct BinFontChar;
+
+class GlyphAtlas
+{
+public:
+    GlyphAtlas() = default;
+    ~GlyphAtlas();
+    GlyphAtlas(const GlyphAtlas &) = delete;
+    GlyphAtlas &operator=(const GlyphAtlas &) = delete;
+
+    // 创建互斥锁。须在渲染任务与 GlyphFetch 任务启动前（setup 中）调用一次；之前的所有操作均失败返回
+    bool init();
+
+    // 取得并钉住一个字形（必要时从字体文件读取）。字体中没有该字、或图集已满且全部被钉住时返回 nullptr。
+    // loaded_from_sd 非空时告知本次是否读了 SD。
+    const CharGlyphInfo *acquire(uint16_t unicode, bool *loaded_from_sd = nullptr);
+    // 解除一次钉住；字形仍留在图集中，直到被淘汰
+    void release(uint16_t unicode);
+    // 放入一个已读好的字形但不钉住（GlyphFetchService 合并读取后调用）。已在图集中视为成功；
+    // generation 与当前不符（期间换过字体）或图集已满且全部被钉住时返回 false。
+    bool insert(const BinFontChar &fc, const uint8_t *bitmap, uint32_t generation);
+
+    // 查询已在图集中的字形（不钉住）。只有调用方自己钉住的字形，返回的指针才在 release 之前保持有效；
+    // 未钉住的字形随时可能被另一核上的 GlyphFetch 淘汰、其单元被复用。
+    const CharGlyphInfo *find(uint16_t unicode) const;
+    bool contains(uint16_t unicode) const { return find(unicode) != nullptr; }
+    // 在图集锁内把位图复制到 out（size 须与图集中记录的位图大小一致）。不在图集中时返回 false。
+    bool copyBitmap(uint16_t unicode, uint8_t *out, size_t size) const;
+
+    // 换字体/卸载字体时调用：丢弃全部字形并释放内存，此前的钉住记录全部作废（generation 递增）
+    void reset();
+    uint32_t generation() const { return generation_; }
+
+    struct Stats
+    {
+        uint32_t glyphs;
+        uint32_t pinned;
+        uint32_t bytes_used;
+        uint32_t capacity_bytes;
+        uint32_t sd_loads;
+        uint32_t subset_hits; // 从本书子集字体（PSRAM）取到的字形
+        uint32_t hot_hits;    // 从字频排列字体的常驻热区（PSRAM）取到的字形
+        uint32_t prefetched;  // 由 GlyphFetchService 合并读取后放入的字形
+        uint32_t evictions;
+        uint32_t alloc_failures;
+    };
+    Stats getStats() const;
+    void logStats() const;
+
+private:
+    struct Entry;
+
+    bool ensureStorage();
+    void freeStorage();
+    // 分配 cells 个连续单元，不足时按 clock 淘汰未钉住的字形
+    bool allocCells(uint32_t cells, uint32_t &first_cell);
+    // 取一个空闲条目并分配位图单元（refs=0，尚未登记到 slot_of_）
+    bool allocEntry(uint16_t unicode, const BinFontChar &fc, uint16_t &id);
+    bool findRun(uint32_t cells, uint32_t &first_cell);
+    void markCells(uint32_t first_cell, uint32_t cells, bool used);
+    bool evictOne();
+    void evict(uint16_t id);
+    bool lock() const;
+    void unlock() const;
+
+    uint8_t *arena_ = nullptr;     // 位图区（PSRAM）
+    uint16_t *slot_of_ = nullptr;  // 码点 -> 条目号 + 1（0 表示不在图集中）
+    Entry *entries_ = nullptr;
+    std::vector<uint16_t> free_ids_;
+    std::vector<uint32_t> cell_used_; // 位图区单元占用位
+    uint32_t cell_count_ = 0;
+    uint32_t cell_cursor_ = 0;        // next-fit 起点
+    uint32_t clock_hand_ = 0;
+    uint32_t generation_ = 1;
+    SemaphoreHandle_t mutex_ = nullptr;
+    Stats stats_{};
+};
+
+extern GlyphAtlas g_glyph_atlas;
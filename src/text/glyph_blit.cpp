@@ -0,0 +1,169 @@
+#include "glyph_blit.h"
+
+#include <cstring>
+
+void BlitPalette::lookupSlow(uint16_t rgb565)
+{
+    last_src = rgb565;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        if (src[i] == rgb565)
+        {
+            last_value = value[i];
+            last_opaque = opaque[i] != 0;
+            return;
+        }
+    }
+    uint8_t v = 0;
+    bool op = resolve ? resolve(ctx, rgb565, &v) : false;
+    if (count < sizeof(src) / sizeof(src[0]))
+    {
+        src[count] = rgb565;
+        value[count] = v;
+        opaque[count] = op ? 1 : 0;
+        ++count;
+    }
+    last_value = v;
+    last_opaque = op;
+}
+
+// 4bpp：掩码-或写入一个半字节
+static inline void put_nibble(uint8_t *row, int32_t px, uint8_t v, bool low_first)
+{
+    uint8_t shift = ((px & 1) != 0) == low_first ? 4 : 0;
+    uint8_t &b = row[px >> 1];
+    b = (uint8_t)((b & ~(0x0F << shift)) | (v << shift));
+}
+
+// 字形里的 span 大多只有几个像素，短 span 直接写，长 span 才调用 memset
+static inline void fill_bytes(uint8_t *p, uint8_t v, int32_t n)
+{
+    if (n > 16)
+    {
+        memset(p, v, n);
+        return;
+    }
+    while (n-- > 0)
+        *p++ = v;
+}
+
+static inline void fill_span_4bpp(uint8_t *row, int32_t px, int32_t n, uint8_t v, bool low_first)
+{
+    if (px & 1)
+    {
+        put_nibble(row, px, v, low_first);
+        ++px;
+        --n;
+    }
+    int32_t pairs = n >> 1;
+    if (pairs > 0)
+    {
+        fill_bytes(row + (px >> 1), (uint8_t)(v * 0x11), pairs);
+        px += pairs * 2;
+    }
+    if (n & 1)
+        put_nibble(row, px, v, low_first);
+}
+
+// 源位图的行访问：RGB565 逐像素，或 4bpp 覆盖度（偶数 x 在高半字节）
+struct Rgb565Rows
+{
+    const uint16_t *src;
+    int32_t stride;
+    struct Row
+    {
+        const uint16_t *p;
+        inline uint16_t operator[](int32_t i) const { return p[i]; }
+    };
+    inline Row row(int32_t sy) const { return Row{src + sy * stride}; }
+};
+
+struct Coverage4Rows
+{
+    const uint8_t *src;
+    int32_t stride;
+    struct Row
+    {
+        const uint8_t *p;
+        inline uint16_t operator[](int32_t i) const { return (i & 1) ? (p[i >> 1] & 0x0F) : (p[i >> 1] >> 4); }
+    };
+    inline Row row(int32_t sy) const { return Row{src + sy * stride}; }
+};
+
+template <typename Rows>
+static uint32_t blit_rows(const BlitSurface &surface, int32_t x, int32_t y, const Rows &rows, int32_t w, int32_t h,
+                          BlitPalette &palette)
+{
+    // 整个字形只裁剪一次
+    int32_t cx0 = x < 0 ? -x : 0;
+    int32_t cy0 = y < 0 ? -y : 0;
+    int32_t cx1 = x + w > surface.width ? surface.width - x : w;
+    int32_t cy1 = y + h > surface.height ? surface.height - y : h;
+    if (cx0 >= cx1 || cy0 >= cy1)
+        return 0;
+
+    uint32_t written = 0;
+    for (int32_t sy = cy0; sy < cy1; ++sy)
+    {
+        const typename Rows::Row s = rows.row(sy);
+        uint8_t *row = surface.pixels + (y + sy) * surface.stride;
+        int32_t i = cx0;
+        while (i < cx1)
+        {
+            // 同一源像素连续的一段作为一个 span
+            uint16_t c = s[i];
+            int32_t j = i + 1;
+            while (j < cx1 && s[j] == c)
+                ++j;
+            uint8_t v;
+            if (palette.lookup(c, &v))
+            {
+                int32_t n = j - i;
+                if (surface.bpp == 8)
+                    fill_bytes(row + x + i, v, n);
+                else
+                    fill_span_4bpp(row, x + i, n, v, surface.low_nibble_first);
+                written += n;
+            }
+            i = j;
+        }
+    }
+    return written;
+}
+
+uint32_t glyph_blit(const BlitSurface &surface, int32_t x, int32_t y, const uint16_t *src, int32_t w, int32_t h,
+                    int32_t src_stride, BlitPalette &palette)
+{
+    if (!surface.pixels || !src || w <= 0 || h <= 0)
+        return 0;
+    return blit_rows(surface, x, y, Rgb565Rows{src, src_stride}, w, h, palette);
+}
+
+uint32_t glyph_blit_coverage4(const BlitSurface &surface, int32_t x, int32_t y, const uint8_t *cov, int32_t w,
+                              int32_t h, int32_t cov_stride, BlitPalette &palette)
+{
+    if (!surface.pixels || !cov || w <= 0 || h <= 0)
+        return 0;
+    return blit_rows(surface, x, y, Coverage4Rows{cov, cov_stride}, w, h, palette);
+}
+
+void coverage4_rotate_cw(const uint8_t *src, int32_t w, int32_t h, uint8_t *dst, bool flip_h)
+{
+    const int32_t src_stride = (w + 1) / 2;
+    const int32_t dst_stride = (h + 1) / 2;
+    memset(dst, 0, (size_t)dst_stride * w);
+    for (int32_t y = 0; y < h; ++y)
+    {
+        const uint8_t *s = src + y * src_stride;
+        // 源第 y 行落到目标第 h-1-y 列（镜像时为第 y 列）
+        int32_t dx = flip_h ? y : h - 1 - y;
+        uint8_t shift = (dx & 1) ? 0 : 4;
+        uint8_t *d = dst + (dx >> 1);
+        for (int32_t x = 0; x < w; ++x, d += dst_stride)
+        {
+            uint8_t level = (x & 1) ? (s[x >> 1] & 0x0F) : (s[x >> 1] >> 4);
+            if (level)
+                *d |= (uint8_t)(level << shift);
+        }
+    }
+}
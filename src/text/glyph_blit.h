@@ -0,0 +1,65 @@
+#pragma once
+// 字形位图直接写入画布缓冲区（按行切成同色 span，4bpp/8bpp 快路径）
+//
+// 逐像素 drawPixel 每次都要做裁剪、颜色转换和虚函数分派；一页 CJK 正文是几万次调用。
+// 这里每个字形只裁剪一次，每行按相同源像素切成 span，不透明 span 用 memset / 掩码-或 写入打包像素，
+// 透明像素直接跳过。
+//
+// 本文件不依赖 M5GFX（主机基准 tools/blitbench 直接编译 glyph_blit.cpp）；
+// M5Canvas 适配层见 glyph_blit_canvas.h。
+
+#include <cstdint>
+
+// 打包像素缓冲区（与 LGFX_Sprite 的内存布局一致：行优先，4bpp 每字节两个像素）
+struct BlitSurface
+{
+    uint8_t *pixels = nullptr;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;            // 每行字节数
+    uint8_t bpp = 0;               // 4 或 8
+    bool low_nibble_first = false; // 4bpp：偶数 x 在低半字节（默认高半字节在前）
+};
+
+// 源像素（RGB565 或覆盖度）到画布原生值的映射；未命中时调用 resolve 并记住结果（最多 16 种，覆盖度 0..15 恰好放得下）
+struct BlitPalette
+{
+    // 返回 false 表示该源像素透明（跳过）；否则把原生值写入 *value
+    typedef bool (*ResolveFn)(void *ctx, uint16_t key, uint8_t *value);
+
+    ResolveFn resolve = nullptr;
+    void *ctx = nullptr;
+
+    uint8_t count = 0;
+    uint16_t src[16];
+    uint8_t value[16];
+    uint8_t opaque[16];
+
+    // 上一次命中的颜色（字形里相邻 span 多数就是前一种颜色或背景）
+    int32_t last_src = -1;
+    uint8_t last_value = 0;
+    bool last_opaque = false;
+
+    inline bool lookup(uint16_t rgb565, uint8_t *out)
+    {
+        if ((int32_t)rgb565 != last_src)
+            lookupSlow(rgb565);
+        *out = last_value;
+        return last_opaque;
+    }
+
+private:
+    void lookupSlow(uint16_t rgb565);
+};
+
+// 把 w x h 的源位图（行距 src_stride 个像素）画到 (x, y)；返回实际写入的像素数
+uint32_t glyph_blit(const BlitSurface &surface, int32_t x, int32_t y, const uint16_t *src, int32_t w, int32_t h,
+                    int32_t src_stride, BlitPalette &palette);
+
+// 同上，源为 4bpp 覆盖度（FontDecoder::decode_coverage4 的输出，行距 cov_stride 字节）；palette 以 0..15 为键
+uint32_t glyph_blit_coverage4(const BlitSurface &surface, int32_t x, int32_t y, const uint8_t *cov, int32_t w,
+                              int32_t h, int32_t cov_stride, BlitPalette &palette);
+
+// 4bpp 覆盖度顺时针旋转 90°（w x h -> h x w，竖排标点/西文），flip_h 时再左右镜像。
+// dst 至少 ((h + 1) / 2) * w 字节，行距 (h + 1) / 2。
+void coverage4_rotate_cw(const uint8_t *src, int32_t w, int32_t h, uint8_t *dst, bool flip_h);
@@ -0,0 +1,146 @@
+#include "glyph_blit_canvas.h"
+
+#include <cstddef>
+
+// 最近一次使用的画布格式（覆盖度配色最多用到 16 种颜色，原生值缓存按此设定）。原生像素值通过在 (0,0) 上 drawPixel 再读回得到（随后恢复该字节），
+// 因此与 M5GFX 内部的调色板/颜色转换完全一致，不需要在这里重复实现。
+struct CanvasBlitFormat
+{
+    M5Canvas *canvas = nullptr;
+    void *buffer = nullptr;
+    uint8_t depth = 0;
+    BlitSurface surface;
+    uint8_t count = 0;
+    uint16_t rgb[16];
+    uint8_t native[16];
+};
+
+static CanvasBlitFormat s_format;
+
+static uint8_t read_pixel0(const BlitSurface &s)
+{
+    uint8_t b = s.pixels[0];
+    if (s.bpp == 8)
+        return b;
+    return s.low_nibble_first ? (b & 0x0F) : (b >> 4);
+}
+
+static uint8_t probe_native(uint16_t rgb565)
+{
+    CanvasBlitFormat &f = s_format;
+    for (uint8_t i = 0; i < f.count; ++i)
+    {
+        if (f.rgb[i] == rgb565)
+            return f.native[i];
+    }
+    uint8_t saved = f.surface.pixels[0];
+    f.canvas->drawPixel(0, 0, rgb565);
+    uint8_t v = read_pixel0(f.surface);
+    f.surface.pixels[0] = saved;
+    if (f.count < sizeof(f.rgb) / sizeof(f.rgb[0]))
+    {
+        f.rgb[f.count] = rgb565;
+        f.native[f.count] = v;
+        ++f.count;
+    }
+    return v;
+}
+
+static bool prepare_format(M5Canvas *canvas)
+{
+    CanvasBlitFormat &f = s_format;
+    void *buffer = canvas->getBuffer();
+    uint8_t depth = (uint8_t)(canvas->getColorDepth() & 0xFF);
+    if (f.canvas == canvas && f.buffer == buffer && f.depth == depth)
+        return f.surface.pixels != nullptr;
+
+    f = CanvasBlitFormat();
+    f.canvas = canvas;
+    f.buffer = buffer;
+    f.depth = depth;
+    int32_t w = canvas->width();
+    int32_t h = canvas->height();
+    if (!buffer || (depth != 4 && depth != 8) || w <= 0 || h <= 0)
+        return false;
+    int32_t stride = (int32_t)(canvas->bufferLength() / (size_t)h);
+    if (stride * 8 < w * depth)
+        return false;
+
+    BlitSurface s;
+    s.pixels = static_cast<uint8_t *>(buffer);
+    s.width = w;
+    s.height = h;
+    s.stride = stride;
+    s.bpp = depth;
+    if (depth == 4)
+    {
+        // 黑白两色必然落在不同的调色值上：看 (0,0) 改动的是哪一半字节
+        uint8_t saved = s.pixels[0];
+        canvas->drawPixel(0, 0, (uint16_t)0x0000);
+        uint8_t a = s.pixels[0];
+        canvas->drawPixel(0, 0, (uint16_t)0xFFFF);
+        uint8_t diff = a ^ s.pixels[0];
+        s.pixels[0] = saved;
+        if (diff & 0xF0)
+            s.low_nibble_first = false;
+        else if (diff & 0x0F)
+            s.low_nibble_first = true;
+        else
+            return false;
+    }
+    f.surface = s;
+    return true;
+}
+
+static bool resolve_style(void *ctx, uint16_t rgb565, uint8_t *value)
+{
+    const GlyphBlitStyle &style = *static_cast<const GlyphBlitStyle *>(ctx);
+    if (rgb565 == style.key)
+    {
+        if (style.key_transparent)
+            return false;
+        *value = probe_native(style.key_color);
+        return true;
+    }
+    *value = probe_native(style.ink >= 0 ? (uint16_t)style.ink : rgb565);
+    return true;
+}
+
+bool glyph_blit_canvas(M5Canvas *canvas, int16_t x, int16_t y, const uint16_t *src, int16_t w, int16_t h,
+                       const GlyphBlitStyle &style)
+{
+    if (!canvas || !src || !prepare_format(canvas))
+        return false;
+    BlitPalette palette;
+    palette.resolve = resolve_style;
+    palette.ctx = const_cast<GlyphBlitStyle *>(&style);
+    glyph_blit(s_format.surface, x, y, src, w, h, w, palette);
+    return true;
+}
+
+bool glyph_blit_canvas_ready(M5Canvas *canvas)
+{
+    return canvas && prepare_format(canvas);
+}
+
+static bool resolve_coverage(void *ctx, uint16_t level, uint8_t *value)
+{
+    const CoverageBlitStyle &style = *static_cast<const CoverageBlitStyle *>(ctx);
+    level &= 0x0F;
+    if (style.transparent_mask & (1u << level))
+        return false;
+    *value = probe_native(style.color[level]);
+    return true;
+}
+
+bool glyph_blit_canvas_coverage4(M5Canvas *canvas, int16_t x, int16_t y, const uint8_t *cov, int16_t w, int16_t h,
+                                 const CoverageBlitStyle &style)
+{
+    if (!canvas || !cov || !prepare_format(canvas))
+        return false;
+    BlitPalette palette;
+    palette.resolve = resolve_coverage;
+    palette.ctx = const_cast<CoverageBlitStyle *>(&style);
+    glyph_blit_coverage4(s_format.surface, x, y, cov, w, h, (w + 1) / 2, palette);
+    return true;
+}
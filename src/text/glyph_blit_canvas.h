@@ -0,0 +1,31 @@
+#pragma once
+// glyph_blit 的 M5Canvas 适配层：从画布取缓冲区与像素格式，原生颜色值在画布上探测一次后缓存。
+// 画布深度不是 4/8bpp 时返回 false，调用方继续走原来的 drawPixel / pushImage。
+
+#include <M5Unified.h>
+#include "glyph_blit.h"
+
+// 画布适配层使用的配色规则
+struct GlyphBlitStyle
+{
+    uint16_t key;         // 背景像素值（V2 为 0xFFFF，V3 为解码时的背景色）
+    bool key_transparent; // true：背景像素跳过；false：画成 key_color
+    uint16_t key_color;
+    int32_t ink;          // >= 0：其余像素统一画成该颜色（V2 着色）；< 0：保持位图中的颜色（V3 灰度）
+};
+
+bool glyph_blit_canvas(M5Canvas *canvas, int16_t x, int16_t y, const uint16_t *src, int16_t w, int16_t h,
+                       const GlyphBlitStyle &style);
+
+// 4bpp 覆盖度位图的配色：level(0..15) -> RGB565；transparent_mask 第 n 位为 1 表示 level n 不写入
+struct CoverageBlitStyle
+{
+    uint16_t color[16];
+    uint16_t transparent_mask;
+};
+
+// 画布能否直接写缓冲区（调用方据此决定是否走覆盖度解码）
+bool glyph_blit_canvas_ready(M5Canvas *canvas);
+
+bool glyph_blit_canvas_coverage4(M5Canvas *canvas, int16_t x, int16_t y, const uint8_t *cov, int16_t w, int16_t h,
+                                 const CoverageBlitStyle &style);
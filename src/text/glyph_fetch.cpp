@@ -0,0 +1,255 @@
+#include "glyph_fetch.h"
+#include "glyph_atlas.h"
+#include "font_subset.h"
+#include "text/bin_font_print.h"
+#include "SD/SDWrapper.h"
+#include "readpaper.h"
+#include "tasks/task_priorities.h"
+#include "test/per_file_debug.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+GlyphFetchService g_glyph_fetch;
+
+extern SemaphoreHandle_t bin_font_get_file_mutex();
+
+bool GlyphFetchService::ensureStarted()
+{
+    if (!io_mutex_)
+    {
+        io_mutex_ = xSemaphoreCreateMutex();
+        if (!io_mutex_)
+            return false;
+    }
+    if (!scratch_)
+    {
+        scratch_ = static_cast<uint8_t *>(heap_caps_malloc(GLYPH_FETCH_MAX_READ, MALLOC_CAP_SPIRAM));
+        if (!scratch_)
+            return false;
+    }
+    return true;
+}
+
+// 只读 SD 的字形才值得合并；子集字体/热区中的字形直接从 PSRAM 复制进图集
+static bool glyph_from_psram(const BinFontChar &fc, uint8_t *dest)
+{
+    return g_font_subset.read(fc.bitmap_offset, dest, fc.bitmap_size) ||
+           bin_font_read_hot(fc.bitmap_offset, dest, fc.bitmap_size);
+}
+
+size_t GlyphFetchService::fetchMissing(const uint16_t *chars, size_t n, uint32_t epoch)
+{
+    if (g_using_progmem_font || !g_bin_font.fontFile)
+        return 0;
+
+    uint32_t generation = g_glyph_atlas.generation();
+    std::vector<BinFontChar, PSRAMAllocator<BinFontChar>> wanted;
+    size_t loaded = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (g_glyph_atlas.contains(chars[i]))
+            continue;
+        const BinFontChar *fc = find_char(chars[i]);
+        // 空位图的字形 acquire 时不读 SD，无需预取
+        if (!fc || fc->bitmap_size == 0 || fc->bitmap_size > GLYPH_FETCH_MAX_READ)
+            continue;
+        BinFontChar copy = *fc; // find_char 返回任务局部存储，立即复制
+        if (glyph_from_psram(copy, scratch_))
+        {
+            if (g_glyph_atlas.insert(copy, scratch_, generation))
+                ++loaded;
+            continue;
+        }
+        wanted.push_back(copy);
+    }
+    if (wanted.empty())
+        return loaded;
+
+    std::sort(wanted.begin(), wanted.end(),
+              [](const BinFontChar &a, const BinFontChar &b) { return a.bitmap_offset < b.bitmap_offset; });
+
+    SemaphoreHandle_t font_mutex = bin_font_get_file_mutex();
+    size_t i = 0;
+    while (i < wanted.size())
+    {
+        if (cancelling_ || bin_font_get_load_epoch() != epoch)
+            break;
+
+        // 合并：下一个字形与当前区间的间隙不超过 MAX_GAP，且总长不超过 MAX_READ
+        uint32_t run_start = wanted[i].bitmap_offset;
+        uint32_t run_end = run_start + wanted[i].bitmap_size;
+        size_t j = i + 1;
+        while (j < wanted.size())
+        {
+            uint32_t off = wanted[j].bitmap_offset;
+            uint32_t end = std::max(run_end, off + wanted[j].bitmap_size);
+            if (off > run_end + GLYPH_FETCH_MAX_GAP || end - run_start > GLYPH_FETCH_MAX_READ)
+                break;
+            run_end = end;
+            ++j;
+        }
+
+        // 与 load_glyph_bitmap_smart 一致：拿不到字体文件锁就不读（fontFile 的 seek/read 与渲染任务共享）
+        if (!font_mutex || xSemaphoreTake(font_mutex, pdMS_TO_TICKS(100)) != pdTRUE)
+        {
+#if DBG_GLYPH_FETCH
+            Serial.printf("[GlyphFetch] Font file lock busy, leaving %u glyphs to acquire\n",
+                          (unsigned)(wanted.size() - i));
+#endif
+            break; // 剩下的由 acquire 逐字读取
+        }
+        size_t len = run_end - run_start;
+        size_t got = SDW::SD.readAtOffset(g_bin_font.fontFile, run_start, scratch_, len);
+        xSemaphoreGive(font_mutex);
+        stats_.reads++;
+        stats_.bytes_read += got;
+        if (got != len)
+        {
+#if DBG_GLYPH_FETCH
+            Serial.printf("[GlyphFetch] Warning: read %u bytes @ %u, got %u\n", (unsigned)len, (unsigned)run_start,
+                          (unsigned)got);
+#endif
+            break; // 剩下的由 acquire 逐字读取
+        }
+
+        for (size_t k = i; k < j; ++k)
+        {
+            if (!g_glyph_atlas.insert(wanted[k], scratch_ + (wanted[k].bitmap_offset - run_start), generation))
+                return loaded; // 图集已满且全部钉住，或字体已更换
+            ++loaded;
+            stats_.glyphs++;
+            stats_.bytes_used += wanted[k].bitmap_size;
+        }
+        i = j;
+    }
+    return loaded;
+}
+
+size_t GlyphFetchService::countMissing(const CharList &chars, size_t limit) const
+{
+    size_t n = std::min(chars.size(), limit);
+    size_t missing = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (g_glyph_atlas.contains(chars[i]))
+            continue;
+        const BinFontChar *fc = find_char(chars[i]);
+        if (fc && fc->bitmap_size > 0)
+            ++missing;
+    }
+    return missing;
+}
+
+size_t GlyphFetchService::fetchNow(const CharList &chars, size_t limit)
+{
+    if (g_using_progmem_font || countMissing(chars, limit) == 0)
+        return 0;
+    if (!ensureStarted())
+        return 0;
+    if (xSemaphoreTake(io_mutex_, pdMS_TO_TICKS(2000)) != pdTRUE)
+        return 0; // 交给 acquire 逐字读取
+    size_t loaded = fetchMissing(chars.data(), std::min(chars.size(), limit), bin_font_get_load_epoch());
+    stats_.batches++;
+    xSemaphoreGive(io_mutex_);
+    return loaded;
+}
+
+bool GlyphFetchService::submit(const CharList &chars)
+{
+#if ENABLE_GLYPH_FETCH_TASK
+    if (g_using_progmem_font || chars.empty() || !ensureStarted())
+        return false;
+    if (!queue_)
+    {
+        queue_ = xQueueCreate(GLYPH_FETCH_QUEUE_LEN, sizeof(Batch *));
+        if (!queue_)
+            return false;
+    }
+    if (!task_)
+    {
+        // 放在核心0：与核心1上的排版/绘制并行，I/O 期间大部分时间在等 SD
+        if (xTaskCreatePinnedToCore(taskEntry, "GlyphFetch", 4096, this, PRIO_GLYPH_FETCH, &task_, 0) != pdPASS)
+        {
+            task_ = nullptr;
+            return false;
+        }
+    }
+
+    Batch *batch = new Batch();
+    batch->chars = chars;
+    batch->epoch = bin_font_get_load_epoch();
+    if (xQueueSend(queue_, &batch, 0) != pdTRUE)
+    {
+        delete batch;
+        stats_.dropped++;
+        return false;
+    }
+    return true;
+#else
+    (void)chars;
+    return false;
+#endif
+}
+
+void GlyphFetchService::cancel()
+{
+    if (!io_mutex_)
+        return;
+    cancelling_ = true;
+    if (queue_)
+    {
+        Batch *batch = nullptr;
+        while (xQueueReceive(queue_, &batch, 0) == pdTRUE)
+            delete batch;
+    }
+    // 等待正在执行的批次退出（其在每次读取前检查 cancelling_）。调用方随后会释放字体数据，不能超时放行
+    while (xSemaphoreTake(io_mutex_, pdMS_TO_TICKS(2000)) != pdTRUE)
+        Serial.printf("[GlyphFetch] Warning: waiting for the running batch to stop\n");
+    xSemaphoreGive(io_mutex_);
+    cancelling_ = false;
+}
+
+void GlyphFetchService::taskEntry(void *arg)
+{
+    static_cast<GlyphFetchService *>(arg)->taskLoop();
+}
+
+void GlyphFetchService::taskLoop()
+{
+    for (;;)
+    {
+        Batch *batch = nullptr;
+        if (xQueueReceive(queue_, &batch, portMAX_DELAY) != pdTRUE || !batch)
+            continue;
+        if (xSemaphoreTake(io_mutex_, portMAX_DELAY) == pdTRUE)
+        {
+            // 排队期间换过字体的批次直接丢弃
+            if (!cancelling_ && batch->epoch == bin_font_get_load_epoch())
+            {
+                uint32_t start_ms = millis();
+                size_t loaded = fetchMissing(batch->chars.data(), batch->chars.size(), batch->epoch);
+                stats_.batches++;
+                stats_.async_batches++;
+#if DBG_GLYPH_FETCH
+                Serial.printf("[GlyphFetch] async batch: %u chars, %u loaded, %ums\n",
+                              (unsigned)batch->chars.size(), (unsigned)loaded, (unsigned)(millis() - start_ms));
+#else
+                (void)loaded;
+                (void)start_ms;
+#endif
+            }
+            xSemaphoreGive(io_mutex_);
+        }
+        delete batch;
+    }
+}
+
+void GlyphFetchService::logStats() const
+{
+    Serial.printf("[GlyphFetch] batches=%u (async=%u) reads=%u glyphs=%u bytes_read=%u bytes_used=%u dropped=%u\n",
+                  (unsigned)stats_.batches, (unsigned)stats_.async_batches, (unsigned)stats_.reads,
+                  (unsigned)stats_.glyphs, (unsigned)stats_.bytes_read, (unsigned)stats_.bytes_used,
+                  (unsigned)stats_.dropped);
+}
@@ -0,0 +1,74 @@
+#pragma once
+// 字形合并读取服务：把一批码点中尚未常驻图集的字形按 bitmap_offset 排序，
+// 相邻（间隙不超过 GLYPH_FETCH_MAX_GAP）的区间合并成一次大块读取，读完后放入 GlyphAtlas（不钉住）。
+//
+// - fetchNow：同步执行，供构建当前页缓存时使用；全部常驻时直接返回，不等待 I/O 任务
+// - submit：交给专用 I/O 任务异步执行，供周边页预取使用；之后钉住这些页时不再读 SD
+//
+// 首次渲染一页时，几十次零散的小读取变为少数几次顺序大块读取。
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bin_font_print.h" // PSRAMAllocator
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+class GlyphFetchService
+{
+public:
+    using CharList = std::vector<uint16_t, PSRAMAllocator<uint16_t>>;
+
+    GlyphFetchService() = default;
+    GlyphFetchService(const GlyphFetchService &) = delete;
+    GlyphFetchService &operator=(const GlyphFetchService &) = delete;
+
+    // 同步补齐 chars 前 limit 个码点中不在图集里的字形；返回从 SD 读入的字形数。
+    // I/O 任务正在处理批次时先等它完成（那批字形多半就是本页要的），再只读仍缺的部分。
+    size_t fetchNow(const CharList &chars, size_t limit = SIZE_MAX);
+
+    // 异步：复制码点列表交给 I/O 任务；队列满或不可用时返回 false（调用方稍后按需同步读取即可）
+    bool submit(const CharList &chars);
+
+    // 图集中缺少的字形数（只数字体中存在、位图非空的字）
+    size_t countMissing(const CharList &chars, size_t limit = SIZE_MAX) const;
+
+    // 换字体/卸载字体前调用：丢弃排队的批次并等待正在执行的批次结束
+    void cancel();
+
+    struct Stats
+    {
+        uint32_t batches;      // 处理过的批次（同步 + 异步）
+        uint32_t async_batches;
+        uint32_t reads;        // SD 读取次数（合并后）
+        uint32_t glyphs;       // 读入的字形数
+        uint32_t bytes_read;   // 读取的字节（含合并带入的间隙）
+        uint32_t bytes_used;   // 其中属于所需字形的字节
+        uint32_t dropped;      // 队列满被丢弃的批次
+    };
+    Stats getStats() const { return stats_; }
+    void logStats() const;
+
+private:
+    struct Batch
+    {
+        CharList chars;
+        uint32_t epoch;
+    };
+
+    bool ensureStarted();
+    size_t fetchMissing(const uint16_t *chars, size_t n, uint32_t epoch);
+    static void taskEntry(void *arg);
+    void taskLoop();
+
+    QueueHandle_t queue_ = nullptr;
+    TaskHandle_t task_ = nullptr;
+    SemaphoreHandle_t io_mutex_ = nullptr; // 同一时刻只执行一个批次（同步或异步）
+    uint8_t *scratch_ = nullptr;           // GLYPH_FETCH_MAX_READ 字节（PSRAM）
+    volatile bool cancelling_ = false;
+    Stats stats_{};
+};
+
+extern GlyphFetchService g_glyph_fetch;
@@ -0,0 +1,175 @@
+#include "glyph_variants.h"
+#include "glyph_atlas.h"
+#include "readpaper.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+GlyphVariantCache g_glyph_variants;
+
+GlyphVariantCache::~GlyphVariantCache()
+{
+    clear();
+    free(entries_);
+}
+
+bool GlyphVariantCache::lock()
+{
+    if (!mutex_)
+    {
+        mutex_ = xSemaphoreCreateMutex();
+        if (!mutex_)
+            return false;
+    }
+    return xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) == pdTRUE;
+}
+
+void GlyphVariantCache::unlock()
+{
+    if (mutex_)
+        xSemaphoreGive(mutex_);
+}
+
+void GlyphVariantCache::freeEntry(Entry &e)
+{
+    if (e.variant)
+    {
+        stats_.entries--;
+        stats_.bytes -= (uint32_t)((e.w + 1) / 2) * e.h;
+    }
+    free(e.cov);
+    e = Entry{};
+}
+
+void GlyphVariantCache::syncGeneration()
+{
+    uint32_t gen = g_glyph_atlas.generation();
+    if (gen == generation_)
+        return;
+    if (entries_)
+    {
+        for (uint32_t i = 0; i < GLYPH_VARIANT_CACHE_ENTRIES; ++i)
+            freeEntry(entries_[i]);
+    }
+    generation_ = gen;
+}
+
+bool GlyphVariantCache::blit(uint16_t unicode, uint8_t variant, M5Canvas *canvas, int16_t x, int16_t y,
+                             const CoverageBlitStyle &style)
+{
+    if (!entries_ || !lock())
+        return false;
+    syncGeneration();
+    bool drawn = false;
+    for (uint32_t i = 0; i < GLYPH_VARIANT_CACHE_ENTRIES; ++i)
+    {
+        Entry &e = entries_[i];
+        if (e.variant == variant && e.unicode == unicode)
+        {
+            e.stamp = ++clock_;
+            drawn = glyph_blit_canvas_coverage4(canvas, x, y, e.cov, e.w, e.h, style);
+            break;
+        }
+    }
+    if (drawn)
+        stats_.hits++;
+    else
+        stats_.misses++;
+    unlock();
+    return drawn;
+}
+
+bool GlyphVariantCache::put(uint16_t unicode, uint8_t variant, const uint8_t *cov, uint8_t w, uint8_t h)
+{
+    if (!variant || !cov || w == 0 || h == 0)
+        return false;
+    uint8_t out_w = (variant & ROTATE_CW) ? h : w;
+    uint8_t out_h = (variant & ROTATE_CW) ? w : h;
+    size_t bytes = (size_t)((out_w + 1) / 2) * out_h;
+    uint8_t *buf = static_cast<uint8_t *>(heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM));
+    if (!buf)
+        return false;
+    if (variant & ROTATE_CW)
+    {
+        coverage4_rotate_cw(cov, w, h, buf, (variant & FLIP_H) != 0);
+    }
+    else
+    {
+        // 只镜像：逐行左右翻转
+        memset(buf, 0, bytes);
+        size_t stride = (size_t)((w + 1) / 2);
+        for (uint8_t y = 0; y < h; ++y)
+            for (uint8_t x = 0; x < w; ++x)
+            {
+                uint8_t b = cov[y * stride + x / 2];
+                uint8_t level = (x & 1) ? (b & 0x0F) : (b >> 4);
+                uint8_t dx = w - 1 - x;
+                buf[y * stride + dx / 2] |= (dx & 1) ? level : (uint8_t)(level << 4);
+            }
+    }
+
+    if (!lock())
+    {
+        free(buf);
+        return false;
+    }
+    if (!entries_)
+        entries_ = static_cast<Entry *>(calloc(GLYPH_VARIANT_CACHE_ENTRIES, sizeof(Entry)));
+    if (!entries_)
+    {
+        unlock();
+        free(buf);
+        return false;
+    }
+    syncGeneration();
+
+    // 已有则替换，否则取空槽或最久未用的槽
+    Entry *slot = nullptr;
+    for (uint32_t i = 0; i < GLYPH_VARIANT_CACHE_ENTRIES; ++i)
+    {
+        Entry &e = entries_[i];
+        if (e.variant == variant && e.unicode == unicode)
+        {
+            slot = &e;
+            break;
+        }
+        if (!slot || (slot->variant && (!e.variant || e.stamp < slot->stamp)))
+            slot = &e;
+    }
+    if (slot->variant && !(slot->variant == variant && slot->unicode == unicode))
+        stats_.evictions++;
+    freeEntry(*slot);
+    slot->unicode = unicode;
+    slot->variant = variant;
+    slot->w = out_w;
+    slot->h = out_h;
+    slot->cov = buf;
+    slot->stamp = ++clock_;
+    stats_.entries++;
+    stats_.bytes += (uint32_t)bytes;
+    unlock();
+    return true;
+}
+
+void GlyphVariantCache::clear()
+{
+    if (!lock())
+        return;
+    if (entries_)
+    {
+        for (uint32_t i = 0; i < GLYPH_VARIANT_CACHE_ENTRIES; ++i)
+            freeEntry(entries_[i]);
+    }
+    unlock();
+}
+
+GlyphVariantCache::Stats GlyphVariantCache::getStats() const
+{
+    return stats_;
+}
+
+void GlyphVariantCache::logStats() const
+{
+    Serial.printf("[GlyphVariants] entries=%u bytes=%u hits=%u misses=%u evictions=%u\n", (unsigned)stats_.entries,
+                  (unsigned)stats_.bytes, (unsigned)stats_.hits, (unsigned)stats_.misses, (unsigned)stats_.evictions);
+}
@@ -0,0 +1,68 @@
+#pragma once
+// 竖排字形变体缓存：标点与西文在竖排时顺时针旋转 90°（个别再左右镜像）。
+//
+// 旋转后的 4bpp 覆盖度按 (码点, 变体) 缓存在 PSRAM，同一字体下每个字形只读取、解码、旋转一次，
+// 之后直接写入画布，不再每次出现都分配临时位图做旋转。图集 generation 变化（换字体）时整体作废。
+// 容量 GLYPH_VARIANT_CACHE_ENTRIES，满时淘汰最久未用的。
+
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "glyph_blit_canvas.h"
+
+class GlyphVariantCache
+{
+public:
+    enum : uint8_t
+    {
+        ROTATE_CW = 0x01,
+        FLIP_H = 0x02
+    };
+
+    GlyphVariantCache() = default;
+    ~GlyphVariantCache();
+    GlyphVariantCache(const GlyphVariantCache &) = delete;
+    GlyphVariantCache &operator=(const GlyphVariantCache &) = delete;
+
+    // 已缓存时在锁内直接写入画布并返回 true；未缓存或画布不支持直接写入时返回 false
+    bool blit(uint16_t unicode, uint8_t variant, M5Canvas *canvas, int16_t x, int16_t y,
+              const CoverageBlitStyle &style);
+    // 由未变换的覆盖度（w x h，FontDecoder::decode_coverage4 输出）生成变体并缓存
+    bool put(uint16_t unicode, uint8_t variant, const uint8_t *cov, uint8_t w, uint8_t h);
+    void clear();
+
+    struct Stats
+    {
+        uint32_t entries;
+        uint32_t bytes;
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+    };
+    Stats getStats() const;
+    void logStats() const;
+
+private:
+    struct Entry
+    {
+        uint16_t unicode;
+        uint8_t variant; // 0 表示空槽
+        uint8_t w, h;    // 变换后的尺寸
+        uint8_t *cov;
+        uint32_t stamp;
+    };
+
+    bool lock();
+    void unlock();
+    // 调用方已持锁：字体变化后丢弃全部变体
+    void syncGeneration();
+    void freeEntry(Entry &e);
+
+    Entry *entries_ = nullptr;
+    uint32_t generation_ = 0;
+    uint32_t clock_ = 0;
+    SemaphoreHandle_t mutex_ = nullptr;
+    Stats stats_{};
+};
+
+extern GlyphVariantCache g_glyph_variants;
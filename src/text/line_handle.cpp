@@ -1,23 +1,8 @@
-#include <FS.h>
-#include <SPIFFS.h>
-#include "SD/SDWrapper.h"
 #include <stdint.h>
 #include <string>
-#include <vector>
 #include <cstring>
 #include <algorithm>
-#include <M5Unified.h>
 #include "readpaper.h"
-#include "readpaper.h"
-#include "papers3.h"
-#include "device/memory_pool.h"
-#include "device/chunked_font_cache.h"
-#include "test/per_file_debug.h"
-#include "tasks/display_push_task.h"
-#include "device/file_manager.h"
-#include "../text/zh_conv.h"
-// access per-book bookmark config
-#include "book_handle.h"
 #include "line_handle.h"
 #include "font_decoder.h"
 #include "bin_font_print.h"
@@ -0,0 +1,251 @@
+#include "lz_block.h"
+#include <cstring>
+
+static const uint8_t LZBOOK_MAGIC[4] = {'R', 'P', 'L', 'Z'};
+
+// LZ4 块格式的约束：最短匹配 4 字节；最后 5 字节必须是字面量；距块尾不足 12 字节处不再开始匹配
+static const size_t LZ_MIN_MATCH = 4;
+static const size_t LZ_LAST_LITERALS = 5;
+static const size_t LZ_MFLIMIT = 12;
+static const size_t LZ_MAX_OFFSET = 65535;
+static const unsigned LZ_HASH_BITS = 12;
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+}
+
+uint32_t LzBookHeader::raw_block_len(uint32_t i) const
+{
+    uint32_t start = i << block_shift;
+    if (start >= raw_size)
+        return 0;
+    uint32_t left = raw_size - start;
+    return left < block_size() ? left : block_size();
+}
+
+bool lz_book_has_magic(const uint8_t *p, size_t n)
+{
+    return n >= sizeof(LZBOOK_MAGIC) && memcmp(p, LZBOOK_MAGIC, sizeof(LZBOOK_MAGIC)) == 0;
+}
+
+bool lz_book_parse_header(const uint8_t *p, size_t n, LzBookHeader &out)
+{
+    if (n < LZBOOK_HEADER_BYTES || !lz_book_has_magic(p, n))
+        return false;
+    if (p[4] != LZBOOK_VERSION || p[5] != LZBOOK_CODEC_LZ4)
+        return false;
+    if (p[6] < LZBOOK_MIN_BLOCK_SHIFT || p[6] > LZBOOK_MAX_BLOCK_SHIFT)
+        return false;
+    out.block_shift = p[6];
+    out.raw_size = get_u32(p + 8);
+    out.raw_crc = get_u32(p + 12);
+    out.block_count = get_u32(p + 16);
+    uint64_t need = ((uint64_t)out.raw_size + out.block_size() - 1) >> out.block_shift;
+    return need == out.block_count;
+}
+
+bool lz_book_check_table(const LzBookHeader &h, const uint32_t *offsets, uint64_t file_size)
+{
+    if (offsets[0] != LZBOOK_HEADER_BYTES + h.table_bytes())
+        return false;
+    for (uint32_t i = 0; i < h.block_count; ++i)
+    {
+        if (offsets[i + 1] <= offsets[i])
+            return false;
+        if (offsets[i + 1] - offsets[i] > h.raw_block_len(i))
+            return false;
+    }
+    return offsets[h.block_count] == file_size;
+}
+
+size_t lz_block_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+// 长度超过 15 时的续长字节：255 串 + 余数
+static bool put_len(uint8_t *dst, size_t cap, size_t &op, size_t len)
+{
+    while (len >= 255)
+    {
+        if (op >= cap)
+            return false;
+        dst[op++] = 255;
+        len -= 255;
+    }
+    if (op >= cap)
+        return false;
+    dst[op++] = (uint8_t)len;
+    return true;
+}
+
+// 一个序列：字面量 [lit, lit+lit_len)，随后 match_len 字节的匹配（0 表示块尾只有字面量）
+static bool put_sequence(uint8_t *dst, size_t cap, size_t &op, const uint8_t *lit, size_t lit_len,
+                         size_t offset, size_t match_len)
+{
+    if (op >= cap)
+        return false;
+    size_t token = op++;
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    dst[token] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15 && !put_len(dst, cap, op, lit_len - 15))
+        return false;
+    if (lit_len > cap - op)
+        return false;
+    memcpy(dst + op, lit, lit_len);
+    op += lit_len;
+    if (!match_len)
+        return true;
+    if (cap - op < 2)
+        return false;
+    dst[op++] = (uint8_t)(offset & 0xFF);
+    dst[op++] = (uint8_t)(offset >> 8);
+    return ml < 15 || put_len(dst, cap, op, ml - 15);
+}
+
+size_t lz_block_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+    size_t op = 0;
+    size_t anchor = 0;
+    if (n > LZ_MFLIMIT)
+    {
+        // 表项存位置 + 1，0 表示空
+        std::vector<uint32_t> table(1u << LZ_HASH_BITS, 0);
+        const size_t match_start_limit = n - LZ_MFLIMIT;
+        const size_t match_end_limit = n - LZ_LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < match_start_limit)
+        {
+            uint32_t seq = get_u32(src + ip);
+            uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip + 1;
+            if (!ref || ip - (ref - 1) > LZ_MAX_OFFSET || get_u32(src + ref - 1) != seq)
+            {
+                ++ip;
+                continue;
+            }
+            ref -= 1;
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+            {
+                --ip;
+                --ref;
+            }
+            size_t len = LZ_MIN_MATCH;
+            while (ip + len < match_end_limit && src[ip + len] == src[ref + len])
+                ++len;
+            if (!put_sequence(dst, cap, op, src + anchor, ip - anchor, ip - ref, len))
+                return 0;
+            ip += len;
+            anchor = ip;
+        }
+    }
+    if (!put_sequence(dst, cap, op, src + anchor, n - anchor, 0, 0))
+        return 0;
+    return op;
+}
+
+// 续长字节；输入耗尽返回 false
+static bool get_len(const uint8_t *src, size_t n, size_t &ip, size_t &len)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= n)
+            return false;
+        b = src[ip++];
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+int lz_block_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < n)
+    {
+        uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !get_len(src, n, ip, lit))
+            return -1;
+        if (lit > n - ip || lit > cap - op)
+            return -1;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n)
+            break; // 最后一个序列只有字面量
+
+        if (n - ip < 2)
+            return -1;
+        size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return -1;
+        size_t len = token & 15;
+        if (len == 15 && !get_len(src, n, ip, len))
+            return -1;
+        len += LZ_MIN_MATCH;
+        if (len > cap - op)
+            return -1;
+        const uint8_t *from = dst + op - offset;
+        if (offset >= len)
+        {
+            memcpy(dst + op, from, len);
+        }
+        else
+        {
+            // 重叠引用（重复短串）：必须逐字节向前复制
+            for (size_t i = 0; i < len; ++i)
+                dst[op + i] = from[i];
+        }
+        op += len;
+    }
+    return (int)op;
+}
+
+bool lz_book_pack(const uint8_t *raw, size_t n, unsigned block_shift, uint32_t raw_crc, std::vector<uint8_t> &out)
+{
+    if (block_shift < LZBOOK_MIN_BLOCK_SHIFT || block_shift > LZBOOK_MAX_BLOCK_SHIFT || (uint64_t)n > 0xFFFFFFFFull)
+        return false;
+    LzBookHeader h;
+    h.block_shift = (uint8_t)block_shift;
+    h.raw_size = (uint32_t)n;
+    h.raw_crc = raw_crc;
+    h.block_count = (uint32_t)(((uint64_t)n + h.block_size() - 1) >> block_shift);
+
+    out.assign(LZBOOK_HEADER_BYTES + h.table_bytes(), 0);
+    memcpy(out.data(), LZBOOK_MAGIC, sizeof(LZBOOK_MAGIC));
+    out[4] = LZBOOK_VERSION;
+    out[5] = LZBOOK_CODEC_LZ4;
+    out[6] = h.block_shift;
+    put_u32(&out[8], h.raw_size);
+    put_u32(&out[12], h.raw_crc);
+    put_u32(&out[16], h.block_count);
+
+    std::vector<uint8_t> scratch(lz_block_bound(h.block_size()));
+    for (uint32_t i = 0; i < h.block_count; ++i)
+    {
+        put_u32(&out[LZBOOK_HEADER_BYTES + 4 * i], (uint32_t)out.size());
+        const uint8_t *block = raw + ((size_t)i << block_shift);
+        uint32_t len = h.raw_block_len(i);
+        size_t packed = lz_block_compress(block, len, scratch.data(), scratch.size());
+        if (packed == 0 || packed >= len)
+            out.insert(out.end(), block, block + len);
+        else
+            out.insert(out.end(), scratch.data(), scratch.data() + packed);
+        if ((uint64_t)out.size() > 0xFFFFFFFFull)
+            return false;
+    }
+    put_u32(&out[LZBOOK_HEADER_BYTES + 4 * h.block_count], (uint32_t)out.size());
+    return true;
+}
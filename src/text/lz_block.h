@@ -0,0 +1,54 @@
+#pragma once
+// 分块压缩书籍（RPLZ）：原文切成固定大小的块，每块独立按 LZ4 块格式压缩，文件头后是块偏移表。
+// 按解压后偏移读取只需定位并解开一块，分页、翻页、搜索看到的仍是原文偏移。
+//
+// 布局（小端）：
+//   0   "RPLZ"
+//   4   u8 版本(1) | u8 编码(1 = LZ4 块) | u8 块大小 log2(14..16) | u8 保留(0)
+//   8   u32 原文大小 | u32 原文 CRC-32（与 http_crc32 / zlib 同算法） | u32 块数 n
+//   20  u32 偏移[n + 1]：块 i 位于 [偏移[i], 偏移[i+1])，偏移[n] 为文件总长
+// 块的存储长度等于原文块长时为原样存放（压缩无收益的块）。
+//
+// 本文件不依赖 Arduino（主机打包工具 tools/lzbook 直接编译 lz_block.cpp）；设备端的 File 视图见 lz_book.h。
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr size_t LZBOOK_HEADER_BYTES = 20;
+constexpr uint8_t LZBOOK_VERSION = 1;
+constexpr uint8_t LZBOOK_CODEC_LZ4 = 1;
+constexpr unsigned LZBOOK_MIN_BLOCK_SHIFT = 14;
+constexpr unsigned LZBOOK_MAX_BLOCK_SHIFT = 16;
+constexpr unsigned LZBOOK_DEFAULT_BLOCK_SHIFT = 15; // 32KB
+
+struct LzBookHeader
+{
+    uint8_t block_shift = 0;
+    uint32_t raw_size = 0;
+    uint32_t raw_crc = 0;
+    uint32_t block_count = 0;
+
+    uint32_t block_size() const { return 1u << block_shift; }
+    // 第 i 块的原文长度（最后一块可能不满）
+    uint32_t raw_block_len(uint32_t i) const;
+    // 偏移表字节数，表紧跟文件头
+    size_t table_bytes() const { return 4 * ((size_t)block_count + 1); }
+};
+
+// 头部前 4 字节是否为 RPLZ
+bool lz_book_has_magic(const uint8_t *p, size_t n);
+// 解析并校验文件头（版本、编码、块大小、块数与原文大小一致）
+bool lz_book_parse_header(const uint8_t *p, size_t n, LzBookHeader &out);
+// 偏移表自洽：首项紧跟表尾、单调、每块存储长度不超过原文块长、末项等于文件长度
+bool lz_book_check_table(const LzBookHeader &h, const uint32_t *offsets, uint64_t file_size);
+
+// 压缩输出的最坏长度
+size_t lz_block_bound(size_t n);
+// LZ4 块格式（贪心匹配，64KB 窗口）；dst 放不下时返回 0
+size_t lz_block_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+// 解压到 dst；输入损坏（越界引用、长度不符）时返回 -1，否则返回输出字节数
+int lz_block_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+// 整本打包：raw_crc 由调用方按 CRC-32 计算后传入（设备与主机各有实现）
+bool lz_book_pack(const uint8_t *raw, size_t n, unsigned block_shift, uint32_t raw_crc, std::vector<uint8_t> &out);
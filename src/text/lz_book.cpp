@@ -0,0 +1,264 @@
+#include "lz_book.h"
+#include "lz_block.h"
+#include "readpaper.h"
+#include "globals.h"
+#include "test/per_file_debug.h"
+#include "SD/SDWrapper.h"
+#include <Arduino.h>
+#include <FSImpl.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// 解压视图：偏移表常驻，解开的块放在 PSRAM 的小 LRU 里，压缩数据先读入 comp_ 再解到块槽
+class LzBookFileImpl : public fs::FileImpl
+{
+public:
+    LzBookFileImpl(File raw, const LzBookHeader &h, std::vector<uint32_t> &&offsets)
+        : raw_(raw), hdr_(h), offsets_(std::move(offsets))
+    {
+    }
+
+    ~LzBookFileImpl() { close(); }
+
+    size_t write(const uint8_t *buf, size_t size)
+    {
+        (void)buf;
+        (void)size;
+        return 0;
+    }
+
+    size_t read(uint8_t *buf, size_t size)
+    {
+        size_t done = 0;
+        while (done < size && pos_ < hdr_.raw_size)
+        {
+            uint32_t index = (uint32_t)(pos_ >> hdr_.block_shift);
+            const Slot *slot = load(index);
+            if (!slot)
+                break;
+            size_t off = pos_ - ((size_t)index << hdr_.block_shift);
+            size_t n = slot->len - off;
+            if (n > size - done)
+                n = size - done;
+            memcpy(buf + done, slot->data + off, n);
+            done += n;
+            pos_ += n;
+        }
+        return done;
+    }
+
+    void flush() {}
+
+    bool seek(uint32_t pos, SeekMode mode)
+    {
+        size_t target = pos;
+        if (mode == SeekCur)
+            target = pos_ + pos;
+        else if (mode == SeekEnd)
+            target = (size_t)hdr_.raw_size + pos;
+        if (target > hdr_.raw_size)
+            return false;
+        pos_ = target;
+        return true;
+    }
+
+    size_t position() const { return pos_; }
+    size_t size() const { return hdr_.raw_size; }
+    bool setBufferSize(size_t size)
+    {
+        (void)size;
+        return true;
+    }
+
+    void close()
+    {
+        for (Slot &s : slots_)
+        {
+            if (s.data)
+                heap_caps_free(s.data);
+            s = Slot();
+        }
+        if (comp_)
+            heap_caps_free(comp_);
+        comp_ = nullptr;
+        if (raw_)
+            raw_.close();
+    }
+
+    time_t getLastWrite() { return raw_.getLastWrite(); }
+    const char *path() const { return raw_.path(); }
+    const char *name() const { return raw_.name(); }
+    boolean isDirectory(void) { return false; }
+    fs::FileImplPtr openNextFile(const char *mode)
+    {
+        (void)mode;
+        return fs::FileImplPtr();
+    }
+    boolean seekDir(long position)
+    {
+        (void)position;
+        return false;
+    }
+    String getNextFileName(void) { return String(); }
+    String getNextFileName(bool *isDir)
+    {
+        (void)isDir;
+        return String();
+    }
+    void rewindDirectory(void) {}
+    operator bool() { return (bool)raw_; }
+
+private:
+    struct Slot
+    {
+        uint8_t *data = nullptr;
+        uint32_t index = 0;
+        uint32_t len = 0;
+        uint32_t stamp = 0; // 0 表示空槽
+    };
+
+    // 取第 index 块的原文；缓存未命中时读卡并解压到最久未用的槽
+    const Slot *load(uint32_t index)
+    {
+        Slot *victim = &slots_[0];
+        for (Slot &s : slots_)
+        {
+            if (s.stamp && s.index == index)
+            {
+                s.stamp = ++clock_;
+                return &s;
+            }
+            if (s.stamp < victim->stamp)
+                victim = &s;
+        }
+
+        size_t bs = hdr_.block_size();
+        if (!victim->data)
+            victim->data = static_cast<uint8_t *>(heap_caps_malloc(bs, MALLOC_CAP_SPIRAM));
+        if (!comp_)
+            comp_ = static_cast<uint8_t *>(heap_caps_malloc(bs, MALLOC_CAP_SPIRAM));
+        if (!victim->data || !comp_)
+            return nullptr;
+
+        victim->stamp = 0;
+        uint32_t len = hdr_.raw_block_len(index);
+        uint32_t stored = offsets_[index + 1] - offsets_[index];
+        uint8_t *dst = stored == len ? victim->data : comp_; // 原样存放的块直接读进槽
+        if (!raw_.seek(offsets_[index]) || raw_.read(dst, stored) != stored)
+            return nullptr;
+        if (dst == comp_ && lz_block_decompress(comp_, stored, victim->data, len) != (int)len)
+        {
+#if DBG_BOOK_HANDLE
+            Serial.printf("[LZB] block %u corrupted: %s\n", (unsigned)index, raw_.path());
+#endif
+            return nullptr;
+        }
+        victim->index = index;
+        victim->len = len;
+        victim->stamp = ++clock_;
+        return victim;
+    }
+
+    File raw_;
+    LzBookHeader hdr_;
+    std::vector<uint32_t> offsets_;
+    Slot slots_[LZBOOK_CACHE_BLOCKS];
+    uint8_t *comp_ = nullptr;
+    uint32_t clock_ = 0;
+    size_t pos_ = 0;
+};
+
+// 读头与偏移表并校验；raw 的位置随之改变
+static bool read_header(File &raw, LzBookHeader &h, std::vector<uint32_t> *offsets)
+{
+    uint8_t head[LZBOOK_HEADER_BYTES];
+    if (!raw.seek(0) || raw.read(head, sizeof(head)) != sizeof(head) || !lz_book_parse_header(head, sizeof(head), h))
+        return false;
+    if (!offsets)
+        return true;
+    offsets->resize(h.block_count + 1);
+    size_t bytes = h.table_bytes();
+    return raw.read(reinterpret_cast<uint8_t *>(offsets->data()), bytes) == bytes &&
+           lz_book_check_table(h, offsets->data(), raw.size());
+}
+
+File lz_book_open(const char *path)
+{
+    File raw = SDW::SD.open(path, "r");
+    if (!raw || raw.isDirectory() || !lz_book_name(path))
+        return raw;
+
+    LzBookHeader h;
+    std::vector<uint32_t> offsets;
+    if (!read_header(raw, h, &offsets))
+    {
+#if DBG_BOOK_HANDLE
+        Serial.printf("[LZB] bad header or block table: %s\n", raw.path());
+#endif
+        raw.close();
+        return File();
+    }
+#if DBG_BOOK_HANDLE
+    Serial.printf("[LZB] %s: %u -> %u bytes, %u blocks of %u\n", raw.path(), (unsigned)h.raw_size,
+                  (unsigned)raw.size(), (unsigned)h.block_count, (unsigned)h.block_size());
+#endif
+    return File(std::make_shared<LzBookFileImpl>(raw, h, std::move(offsets)));
+}
+
+bool lz_book_name(const std::string &filename)
+{
+    static const char suffix[] = ".txt.lz";
+    const size_t n = sizeof(suffix) - 1;
+    if (filename.length() <= n)
+        return false;
+    for (size_t i = 0; i < n; ++i)
+    {
+        char c = filename[filename.length() - n + i];
+        if (c >= 'A' && c <= 'Z')
+            c += 32;
+        if (c != suffix[i])
+            return false;
+    }
+    return true;
+}
+
+std::string book_name_stem(const std::string &filename)
+{
+    if (lz_book_name(filename))
+        return filename.substr(0, filename.length() - 7);
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos || dot == 0)
+        return filename;
+    return filename.substr(0, dot);
+}
+
+bool lz_book_stat(const char *path, uint32_t &raw_size, uint32_t &raw_crc)
+{
+    if (g_disable_sd_access)
+        return false;
+    File f = SDW::SD.open(path, "r");
+    if (!f)
+        return false;
+    LzBookHeader h;
+    bool ok = read_header(f, h, nullptr);
+    f.close();
+    if (!ok)
+        return false;
+    raw_size = h.raw_size;
+    raw_crc = h.raw_crc;
+    return true;
+}
+
+bool lz_book_valid(const char *path)
+{
+    File f = SDW::SD.open(path, "r");
+    if (!f)
+        return false;
+    LzBookHeader h;
+    std::vector<uint32_t> offsets;
+    bool ok = read_header(f, h, &offsets);
+    f.close();
+    return ok;
+}
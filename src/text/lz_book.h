@@ -0,0 +1,23 @@
+#pragma once
+// 压缩书籍（RPLZ，格式见 lz_block.h）的透明读取。压缩书以 <名>.txt.lz 存放，只按文件名识别
+// （.txt 等其它文件打开时不读文件头），返回的 File 以原文为准：size()/position()/seek()/read() 都是解压后的偏移，
+// 因此 read_text_page、build_book_page_index、BookHandle 与 .page/.bm 里记录的位置不需要区分两种存放方式。
+// 解压块缓存在 PSRAM（LZBOOK_CACHE_BLOCKS 块），顺序读与页首回退都落在缓存内。只读。
+
+#include <FS.h>
+#include <cstdint>
+#include <string>
+
+// 文件名以 .txt.lz 结尾（不区分大小写）
+bool lz_book_name(const std::string &filename);
+// 书名：去掉 .txt.lz / .txt 等扩展名（.txt.lz 整个去掉，其它只去掉最后一个扩展名）
+std::string book_name_stem(const std::string &filename);
+
+// 打开 SD 上的书籍文件：.txt.lz 返回解压视图，头或偏移表损坏时返回空 File；其它文件原样打开
+File lz_book_open(const char *path);
+
+// 读取压缩书（.txt.lz）头部记录的原文大小与 CRC（/sync 比对内容用）；头损坏或打不开返回 false
+bool lz_book_stat(const char *path, uint32_t &raw_size, uint32_t &raw_crc);
+
+// 上传校验（目标名为 .txt.lz 时调用，path 可以是暂存文件）：头与偏移表自洽时返回 true
+bool lz_book_valid(const char *path);
@@ -0,0 +1,314 @@
+#include "page_glyphs.h"
+#include "../SD/SDWrapper.h"
+#include "test/per_file_debug.h"
+#include <Arduino.h>
+#include <esp_system.h>
+#include <cstring>
+
+static const uint8_t PGG_MAGIC[4] = {'B', 'P', 'G', 'G'};
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_varint(std::vector<uint8_t> &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static bool get_varint(const uint8_t *&p, const uint8_t *end, uint32_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7)
+    {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+struct PggHeader
+{
+    uint8_t zh_conv_mode = 0;
+    uint32_t font_tag = 0;
+    uint32_t nonce = 0;
+};
+
+static bool read_header(File &f, PggHeader &hdr)
+{
+    uint8_t buf[PAGE_GLYPH_HEADER_SIZE];
+    f.seek(0);
+    if (f.read(buf, sizeof(buf)) != sizeof(buf))
+        return false;
+    if (memcmp(buf, PGG_MAGIC, 4) != 0 || buf[4] != PAGE_GLYPH_FILE_VERSION)
+        return false;
+    hdr.zh_conv_mode = buf[5];
+    hdr.font_tag = get_u32(buf + 8);
+    hdr.nonce = get_u32(buf + 12);
+    return true;
+}
+
+// 从 offset 起逐条校验 chunk 头，对每一页回调 on_page(start, end)。
+// 遇到尚未写完的尾部（超出文件大小）正常停止；遇到不自洽的 chunk 时 corrupt 置位。
+// 返回扫描停止处的偏移（最后一个完整 chunk 之后）。
+template <typename OnPage>
+static size_t scan_chunks(File &f, size_t offset, size_t first_page, bool &corrupt, OnPage on_page)
+{
+    const size_t file_size = f.size();
+    std::vector<uint16_t> lens;
+    corrupt = false;
+    while (offset + PAGE_GLYPH_CHUNK_HEADER_SIZE <= file_size)
+    {
+        uint8_t hdr[PAGE_GLYPH_CHUNK_HEADER_SIZE];
+        f.seek(offset);
+        if (f.read(hdr, sizeof(hdr)) != sizeof(hdr))
+            break;
+        uint32_t chunk_first = get_u32(hdr);
+        uint16_t n = get_u16(hdr + 4);
+        uint32_t payload_bytes = get_u32(hdr + 8);
+        if (chunk_first != first_page || n == 0 || n > PAGE_GLYPH_CHUNK_MAX_PAGES)
+        {
+            corrupt = true;
+            break;
+        }
+        size_t lens_bytes = (size_t)n * 2;
+        size_t payload_start = offset + PAGE_GLYPH_CHUNK_HEADER_SIZE + lens_bytes;
+        if (payload_start + payload_bytes > file_size)
+            break; // 尾部仍在写入（或被截断），下次再看
+        lens.resize(n);
+        if (f.read((uint8_t *)lens.data(), lens_bytes) != lens_bytes)
+            break;
+        size_t sum = 0;
+        for (uint16_t i = 0; i < n; ++i)
+            sum += lens[i];
+        if (sum != payload_bytes)
+        {
+            corrupt = true;
+            break;
+        }
+        size_t pos = payload_start;
+        for (uint16_t i = 0; i < n; ++i)
+        {
+            on_page(pos, pos + lens[i]);
+            pos += lens[i];
+        }
+        first_page += n;
+        offset = payload_start + payload_bytes;
+    }
+    return offset;
+}
+
+void PageGlyphIndex::reset(const std::string &path)
+{
+    path_ = path;
+    header_ok_ = false;
+    zh_conv_mode_ = 0;
+    font_tag_ = 0;
+    nonce_ = 0;
+    corrupt_ = false;
+    scanned_bytes_ = 0;
+    bounds_.clear();
+}
+
+size_t PageGlyphIndex::refresh()
+{
+    if (path_.empty() || !SDW::SD.exists(path_.c_str()))
+    {
+        if (header_ok_)
+            reset(path_);
+        return 0;
+    }
+    File f = SDW::SD.open(path_.c_str(), "r");
+    if (!f)
+        return size();
+
+    PggHeader hdr;
+    if (!read_header(f, hdr))
+    {
+        f.close();
+        reset(path_);
+        return 0;
+    }
+    if (!header_ok_ || hdr.nonce != nonce_ || f.size() < scanned_bytes_)
+    {
+        // 首次打开或文件已被重建
+        reset(path_);
+        header_ok_ = true;
+        zh_conv_mode_ = hdr.zh_conv_mode;
+        font_tag_ = hdr.font_tag;
+        nonce_ = hdr.nonce;
+        scanned_bytes_ = PAGE_GLYPH_HEADER_SIZE;
+    }
+    if (!corrupt_ && f.size() > scanned_bytes_)
+    {
+        size_t before = size();
+        scanned_bytes_ = scan_chunks(f, scanned_bytes_, size(), corrupt_, [this](size_t s, size_t e) {
+            bounds_.push_back(s);
+            bounds_.push_back(e);
+        });
+#if DBG_FONT_BUFFER
+        Serial.printf("[PGG] refresh %s: pages %u -> %u%s\n", path_.c_str(), (unsigned)before,
+                      (unsigned)size(), corrupt_ ? " (corrupt tail)" : "");
+#else
+        (void)before;
+#endif
+    }
+    f.close();
+    return size();
+}
+
+bool PageGlyphIndex::read(size_t page, std::vector<uint16_t, PSRAMAllocator<uint16_t>> &out)
+{
+    out.clear();
+    if (!header_ok_ || page >= size())
+        return false;
+    size_t start = bounds_[page * 2];
+    size_t end = bounds_[page * 2 + 1];
+    if (end <= start || end - start > PAGE_GLYPH_PAGE_MAX_BYTES)
+        return false;
+
+    File f = SDW::SD.open(path_.c_str(), "r");
+    if (!f)
+        return false;
+    size_t len = end - start;
+    scratch_.resize(len);
+    bool ok = f.seek(start) && f.read(scratch_.data(), len) == len;
+    f.close();
+    if (!ok)
+        return false;
+
+    const uint8_t *p = scratch_.data();
+    const uint8_t *stop = p + len;
+    uint32_t n = 0;
+    if (!get_varint(p, stop, n) || n > len)
+        return false;
+    out.reserve(n);
+    uint32_t cp = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint32_t d = 0;
+        if (!get_varint(p, stop, d))
+            return false;
+        cp += d;
+        if (cp > 0xFFFF || (i > 0 && d == 0))
+            return false;
+        out.push_back((uint16_t)cp);
+    }
+    return true;
+}
+
+uint32_t PageGlyphIndex::currentFontTag()
+{
+    // FNV-1a：字体名 + 版本 + 基准字号
+    uint32_t h = 2166136261u;
+    auto mix = [&h](uint8_t b) {
+        h ^= b;
+        h *= 16777619u;
+    };
+    const char *name = get_current_font_name();
+    if (name)
+    {
+        for (const char *p = name; *p; ++p)
+            mix((uint8_t)*p);
+    }
+    mix(get_font_version());
+    mix(get_font_size_from_file());
+    return h;
+}
+
+bool PageGlyphIndex::writeHeader(File &f, uint8_t zh_conv_mode, uint32_t font_tag)
+{
+    uint8_t buf[PAGE_GLYPH_HEADER_SIZE] = {0};
+    memcpy(buf, PGG_MAGIC, 4);
+    buf[4] = PAGE_GLYPH_FILE_VERSION;
+    buf[5] = zh_conv_mode;
+    put_u32(buf + 8, font_tag);
+    put_u32(buf + 12, esp_random());
+    return f.write(buf, sizeof(buf)) == sizeof(buf);
+}
+
+bool PageGlyphIndex::appendChunk(File &f, uint32_t first_page, const PageGlyphSet *sets, size_t n)
+{
+    while (n > 0)
+    {
+        size_t take = n > PAGE_GLYPH_CHUNK_MAX_PAGES ? PAGE_GLYPH_CHUNK_MAX_PAGES : n;
+        std::vector<uint8_t> payload;
+        std::vector<uint8_t> head(PAGE_GLYPH_CHUNK_HEADER_SIZE + take * 2);
+        for (size_t i = 0; i < take; ++i)
+        {
+            size_t before = payload.size();
+            const PageGlyphSet &s = sets[i];
+            put_varint(payload, (uint32_t)s.size());
+            uint32_t prev = 0;
+            for (uint16_t cp : s)
+            {
+                put_varint(payload, cp - prev);
+                prev = cp;
+            }
+            size_t page_bytes = payload.size() - before;
+            if (page_bytes > PAGE_GLYPH_PAGE_MAX_BYTES)
+                return false;
+            put_u16(&head[PAGE_GLYPH_CHUNK_HEADER_SIZE + i * 2], (uint16_t)page_bytes);
+        }
+        put_u32(&head[0], first_page);
+        put_u16(&head[4], (uint16_t)take);
+        put_u32(&head[8], (uint32_t)payload.size());
+        if (f.write(head.data(), head.size()) != head.size())
+            return false;
+        if (!payload.empty() && f.write(payload.data(), payload.size()) != payload.size())
+            return false;
+        first_page += take;
+        sets += take;
+        n -= take;
+    }
+    return true;
+}
+
+bool PageGlyphIndex::countPages(const std::string &path, size_t &pages, uint8_t &zh_conv_mode, uint32_t &font_tag)
+{
+    pages = 0;
+    File f = SDW::SD.open(path.c_str(), "r");
+    if (!f)
+        return false;
+    PggHeader hdr;
+    if (!read_header(f, hdr))
+    {
+        f.close();
+        return false;
+    }
+    bool corrupt = false;
+    size_t end = scan_chunks(f, PAGE_GLYPH_HEADER_SIZE, 0, corrupt, [&pages](size_t, size_t) { ++pages; });
+    // 追加只能接在文件末尾：尾部残缺或不自洽都视为无效
+    bool ok = !corrupt && end == f.size();
+    f.close();
+    zh_conv_mode = hdr.zh_conv_mode;
+    font_tag = hdr.font_tag;
+    return ok;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <FS.h>
+#include "text/bin_font_print.h" // PSRAMAllocator
+#include "text/page_index.h"
+
+// 每页字形集合（.pgg）：后台分页时顺带记录每页用到的码点，字体缓存预取 N±2 页时直接查表，
+// 不必再读取、转码、繁简转换这几页的正文。与 .page 同生共灭（removeIndexFilesForBookForPath）。
+//
+// .pgg 格式（v1）：
+//   header(16B): "BPGG" | u8 version | u8 zh_conv_mode | u16 reserved | u32 font_tag | u32 nonce
+//     zh_conv_mode/font_tag 记录生成时的繁简模式与字体指纹（占位符替换依赖字体），与当前不符时不使用；
+//     nonce 每次新建文件时随机生成，阅读端据此发现文件已被重建。
+//   chunk*: u32 first_page | u16 n | u16 reserved | u32 payload_bytes | u16 len[n] | payload
+//     每页 payload 为排序去重后的 BMP 码点：首个为绝对值，其后为相邻差值，均为 varint。
+//     chunk 只追加（后台索引每批写一条），first_page 必须与已有页数连续。
+static const uint8_t PAGE_GLYPH_FILE_VERSION = 1;
+static const size_t PAGE_GLYPH_HEADER_SIZE = 16;
+static const size_t PAGE_GLYPH_CHUNK_HEADER_SIZE = 12;
+static const size_t PAGE_GLYPH_CHUNK_MAX_PAGES = 1024;
+static const size_t PAGE_GLYPH_PAGE_MAX_BYTES = 16 * 1024;
+
+// 单页码点集合（排序去重，不含换行）
+typedef std::vector<uint16_t> PageGlyphSet;
+
+// .pgg 阅读端：按页号取字形集合。文件随后台索引增长，refresh() 只扫描新增的 chunk 头。
+// 每页在文件中的 [起点, 终点) 成对存入 PagePositionStore（单调递增），常驻内存约 2~3 字节/页。
+class PageGlyphIndex
+{
+public:
+    PageGlyphIndex() = default;
+    PageGlyphIndex(const PageGlyphIndex &) = delete;
+    PageGlyphIndex &operator=(const PageGlyphIndex &) = delete;
+
+    // 绑定 .pgg 路径并丢弃已扫描的内容
+    void reset(const std::string &path);
+    // 扫描文件新增部分；文件被重建（nonce 变化）时从头扫描。返回可用页数
+    size_t refresh();
+    size_t size() const { return bounds_.size() / 2; }
+    // 文件头与当前繁简模式/字体一致时才可用
+    bool usable(uint8_t zh_conv_mode, uint32_t font_tag) const
+    {
+        return header_ok_ && zh_conv_mode_ == zh_conv_mode && font_tag_ == font_tag;
+    }
+    // 读取第 page 页的码点集合（升序）；超出已扫描范围或数据损坏返回 false
+    bool read(size_t page, std::vector<uint16_t, PSRAMAllocator<uint16_t>> &out);
+
+    // 当前字体的指纹（名称、版本、基准字号）
+    static uint32_t currentFontTag();
+    // 写文件头（新建文件时使用）
+    static bool writeHeader(File &f, uint8_t zh_conv_mode, uint32_t font_tag);
+    // 追加一条 chunk：sets[0..n) 依次为第 first_page.. 页
+    static bool appendChunk(File &f, uint32_t first_page, const PageGlyphSet *sets, size_t n);
+    // 只读扫描已有文件，返回完整 chunk 覆盖的页数；文件头无效返回 false（后台索引续建前校验用）
+    static bool countPages(const std::string &path, size_t &pages, uint8_t &zh_conv_mode, uint32_t &font_tag);
+
+private:
+    std::string path_;
+    bool header_ok_ = false;
+    uint8_t zh_conv_mode_ = 0;
+    uint32_t font_tag_ = 0;
+    uint32_t nonce_ = 0;
+    bool corrupt_ = false;     // 遇到不连续/不自洽的 chunk，直到文件重建前不再扫描
+    size_t scanned_bytes_ = 0; // 已扫描到的文件偏移（下一个 chunk 头）
+    PagePositionStore bounds_; // 2i: 第 i 页起点，2i+1: 终点
+    std::vector<uint8_t> scratch_;
+};
@@ -0,0 +1,616 @@
+#include "page_index.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+#include "readpaper.h"
+#include "../SD/SDWrapper.h"
+#include "test/per_file_debug.h"
+
+static inline uint32_t zigzagEncode(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t zigzagDecode(uint32_t z)
+{
+    return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+template <typename Vec>
+static inline void putVarint(Vec &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+// 从 p 读取一个 varint；越界或超长返回 false
+static inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift <= 28; shift += 7)
+    {
+        if (p >= end)
+            return false;
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// 溢出层：内存中已封口块的字节累计到该值后才写一次 SD
+static const size_t SPILL_CHUNK_BYTES = 2048;
+// 一个块的增量字节上限（63 个 varint，每个至多 5 字节）
+static const size_t MAX_BLOCK_BYTES = (PagePositionStore::PAGES_PER_BLOCK - 1) * 5;
+
+PagePositionStore::~PagePositionStore()
+{
+    if (spill_file_)
+        spill_file_.close();
+    if (spill_created_)
+        SDW::SD.remove(spill_path_.c_str());
+}
+
+void PagePositionStore::clear()
+{
+    blocks_.clear();
+    data_.clear();
+    count_ = 0;
+    last_ = 0;
+    spilled_ = 0;
+    spill_failed_ = false;
+    invalidateHot();
+    // 每次重新加载时按当时的 PSRAM 余量选层：没有 PSRAM 或余量不足就把块数据放到 SD。
+    // 溢出文件读失败过一次就不再使用 SD 层
+    sd_tier_ = !spill_path_.empty() && !spill_read_failed_.load() &&
+               heap_caps_get_free_size(MALLOC_CAP_SPIRAM) < PAGE_STORE_PSRAM_MIN_FREE;
+#if DBG_BOOK_HANDLE
+    if (sd_tier_)
+        Serial.printf("[PAGE] PSRAM 不足，页起点表使用 SD 溢出文件 %s\n", spill_path_.c_str());
+#endif
+}
+
+void PagePositionStore::spillSealedBlocks()
+{
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(spill_lock_);
+        if (!spill_file_)
+            spill_file_ = SDW::SD.open(spill_path_.c_str(), spill_created_ ? "r+" : "w+");
+        ok = spill_file_ && spill_file_.seek(spilled_) &&
+             spill_file_.write(data_.data(), data_.size()) == data_.size();
+        if (ok)
+            spill_file_.flush();
+    }
+    if (!ok)
+    {
+        // 写失败就退回纯内存，不再尝试
+        spill_failed_ = true;
+#if DBG_BOOK_HANDLE
+        Serial.printf("[PAGE] 写溢出文件失败，页起点表改为全部驻留内存\n");
+#endif
+        return;
+    }
+    spill_created_ = true;
+    spilled_ += data_.size();
+    data_.clear();
+}
+
+void PagePositionStore::dropBytesFrom(size_t off)
+{
+    if (off >= spilled_)
+    {
+        data_.resize(off - spilled_);
+    }
+    else
+    {
+        // 溢出文件中 off 之后的内容作废，下次溢出时从 off 处覆盖
+        data_.clear();
+        spilled_ = off;
+    }
+}
+
+void PagePositionStore::push_back(size_t pos)
+{
+    uint32_t p = (uint32_t)pos;
+    if (count_ % PAGES_PER_BLOCK == 0)
+    {
+        // 新块开始前，内存里全是已封口块的字节，正好整块写出
+        if (sd_tier_ && !spill_failed_ && data_.size() >= SPILL_CHUNK_BYTES)
+            spillSealedBlocks();
+        blocks_.push_back({p, (uint32_t)(spilled_ + data_.size())});
+    }
+    else
+    {
+        putVarint(data_, zigzagEncode((int32_t)(p - last_)));
+    }
+    last_ = p;
+    ++count_;
+}
+
+const uint8_t *PagePositionStore::blockBytes(size_t block, uint8_t *scratch, size_t &len) const
+{
+    size_t off = blocks_[block].byte_off;
+    len = blockEnd(block) - off;
+    if (off >= spilled_)
+        return data_.data() + (off - spilled_);
+
+    // 已溢出的块：封口时整块写出，不会跨越 spilled_
+    if (len > MAX_BLOCK_BYTES)
+        len = MAX_BLOCK_BYTES;
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(spill_lock_);
+        ok = spill_file_ && spill_file_.seek(off) && spill_file_.read(scratch, len) == (int)len;
+    }
+    if (!ok)
+    {
+        if (!spill_read_failed_.exchange(true))
+        {
+#if DBG_BOOK_HANDLE
+            Serial.printf("[PAGE] 读溢出文件失败（块 %u），需从 .page 重新加载\n", (unsigned)block);
+#endif
+        }
+        len = 0;
+        return nullptr;
+    }
+    return scratch;
+}
+
+size_t PagePositionStore::decodeBlockRaw(size_t block, uint32_t *out) const
+{
+    size_t n = std::min(PAGES_PER_BLOCK, count_ - block * PAGES_PER_BLOCK);
+    uint8_t scratch[MAX_BLOCK_BYTES];
+    size_t len = 0;
+    const uint8_t *p = blockBytes(block, scratch, len);
+    if (!p)
+        return 0;
+    const uint8_t *end = p + len;
+    uint32_t v = blocks_[block].first;
+    out[0] = v;
+    for (size_t j = 1; j < n; ++j)
+    {
+        uint32_t z;
+        if (!getVarint(p, end, z))
+            return j;
+        v += (uint32_t)zigzagDecode(z);
+        out[j] = v;
+    }
+    return n;
+}
+
+size_t PagePositionStore::decodeBlock(size_t block, uint32_t *out) const
+{
+    if (block >= blocks_.size())
+        return 0;
+    return decodeBlockRaw(block, out);
+}
+
+bool PagePositionStore::hotLookup(size_t block, size_t k, uint32_t &out) const
+{
+    // 多个任务可能同时查询（翻页、目录加载、后台索引）；抢不到就让调用方自己解码，不等待
+    if (hot_busy_.test_and_set(std::memory_order_acquire))
+        return false;
+    uint32_t gen = hot_gen_.load();
+    HotSlot *slot = nullptr;
+    for (size_t i = 0; i < HOT_BLOCKS; ++i)
+    {
+        if (hot_[i].block == block && hot_[i].gen == gen)
+        {
+            slot = &hot_[i];
+            break;
+        }
+    }
+    // 尾块在追加后会变长，缓存的项数不够时重新解码
+    if (!slot || k >= slot->n)
+    {
+        if (!slot)
+        {
+            // 优先用失效槽，否则淘汰最久未用的
+            slot = &hot_[0];
+            for (size_t i = 0; i < HOT_BLOCKS; ++i)
+            {
+                if (hot_[i].gen != gen)
+                {
+                    slot = &hot_[i];
+                    break;
+                }
+                if (hot_[i].stamp < slot->stamp)
+                    slot = &hot_[i];
+            }
+        }
+        slot->block = block;
+        slot->gen = gen;
+        slot->n = decodeBlockRaw(block, slot->vals);
+    }
+    slot->stamp = ++hot_clock_;
+    bool ok = k < slot->n;
+    if (ok)
+        out = slot->vals[k];
+    hot_busy_.clear(std::memory_order_release);
+    return ok;
+}
+
+void PagePositionStore::warm(size_t index) const
+{
+    if (index >= count_)
+        return;
+    size_t block = index / PAGES_PER_BLOCK;
+    uint32_t v;
+    hotLookup(block, 0, v);
+    // 再带上更可能被翻到的相邻块
+    if (index % PAGES_PER_BLOCK >= PAGES_PER_BLOCK / 2)
+    {
+        if (block + 1 < blocks_.size())
+            hotLookup(block + 1, 0, v);
+    }
+    else if (block > 0)
+    {
+        hotLookup(block - 1, 0, v);
+    }
+}
+
+bool PagePositionStore::tryAt(size_t index, size_t &out) const
+{
+    if (index >= count_)
+        return false;
+    size_t block = index / PAGES_PER_BLOCK;
+    size_t k = index % PAGES_PER_BLOCK;
+    if (k == 0)
+    {
+        out = blocks_[block].first;
+        return true;
+    }
+    uint32_t v;
+    if (hotLookup(block, k, v))
+    {
+        out = v;
+        return true;
+    }
+    uint32_t vals[PAGES_PER_BLOCK];
+    size_t n = decodeBlockRaw(block, vals);
+    if (k >= n)
+        return false;
+    out = vals[k];
+    return true;
+}
+
+size_t PagePositionStore::at(size_t index) const
+{
+    if (index >= count_)
+        return 0;
+    size_t v;
+    return tryAt(index, v) ? v : npos;
+}
+
+bool PagePositionStore::truncate(size_t n)
+{
+    if (n >= count_)
+        return true;
+    if (n == 0)
+    {
+        clear();
+        return true;
+    }
+    invalidateHot();
+    size_t block = n / PAGES_PER_BLOCK;
+    size_t keep = n % PAGES_PER_BLOCK;
+    if (keep == 0)
+    {
+        size_t last = 0;
+        if (!tryAt(n - 1, last))
+            return false;
+        size_t off = blocks_[block].byte_off;
+        blocks_.resize(block);
+        dropBytesFrom(off);
+        count_ = n;
+        last_ = (uint32_t)last;
+        return true;
+    }
+    // 块内截断：找到第 keep 项增量的结束位置
+    uint8_t scratch[MAX_BLOCK_BYTES];
+    size_t len = 0;
+    const uint8_t *base = blockBytes(block, scratch, len);
+    if (!base)
+        return false;
+    const uint8_t *p = base;
+    const uint8_t *end = base + len;
+    uint32_t v = blocks_[block].first;
+    for (size_t j = 1; j < keep; ++j)
+    {
+        uint32_t z;
+        if (!getVarint(p, end, z))
+            break;
+        v += (uint32_t)zigzagDecode(z);
+    }
+    size_t used = (size_t)(p - base);
+    size_t off = blocks_[block].byte_off;
+    if (off >= spilled_)
+    {
+        data_.resize(off - spilled_ + used);
+    }
+    else
+    {
+        // 截断点落在已溢出的块内：把该块保留的部分取回内存作为新的尾块
+        data_.assign(base, base + used);
+        spilled_ = off;
+    }
+    blocks_.resize(block + 1);
+    count_ = n;
+    last_ = v;
+    return true;
+}
+
+bool PagePositionStore::findLastAtOrBefore(size_t pos, size_t &out_index) const
+{
+    if (count_ == 0)
+        return false;
+    if (pos < blocks_[0].first)
+    {
+        out_index = 0;
+        return true;
+    }
+    // 块级二分：最后一个 first <= pos 的块
+    auto it = std::upper_bound(blocks_.begin(), blocks_.end(), (uint32_t)pos,
+                               [](uint32_t v, const BlockRef &b) { return v < b.first; });
+    size_t block = (size_t)(it - blocks_.begin()) - 1;
+
+    uint32_t vals[PAGES_PER_BLOCK];
+    size_t n = decodeBlockRaw(block, vals);
+    if (n == 0)
+        return false;
+    size_t k = (size_t)(std::upper_bound(vals, vals + n, (uint32_t)pos) - vals);
+    out_index = block * PAGES_PER_BLOCK + (k ? k - 1 : 0);
+    return true;
+}
+
+bool PagePositionStore::Cursor::load(size_t index)
+{
+    index_ = index;
+    if (index >= store_->size())
+    {
+        n_ = 0;
+        return false;
+    }
+    size_t block = index / PAGES_PER_BLOCK;
+    base_ = block * PAGES_PER_BLOCK;
+    n_ = store_->decodeBlockRaw(block, vals_);
+    return index_ - base_ < n_;
+}
+
+bool PagePositionStore::Cursor::seek(size_t index)
+{
+    if (index >= base_ && index - base_ < n_ && index < store_->size())
+    {
+        index_ = index;
+        return true;
+    }
+    return load(index);
+}
+
+bool PagePositionStore::Cursor::seekAtOrBefore(size_t pos)
+{
+    if (store_->empty())
+        return false;
+    const auto &blocks = store_->blocks_;
+    size_t block = 0;
+    if (pos >= blocks[0].first)
+    {
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), (uint32_t)pos,
+                                   [](uint32_t v, const BlockRef &b) { return v < b.first; });
+        block = (size_t)(it - blocks.begin()) - 1;
+    }
+    if (!seek(block * PAGES_PER_BLOCK))
+        return false;
+    size_t k = (size_t)(std::upper_bound(vals_, vals_ + n_, (uint32_t)pos) - vals_);
+    index_ = base_ + (k ? k - 1 : 0);
+    return true;
+}
+
+bool PagePositionStore::Cursor::skipTo(size_t pos)
+{
+    if (index_ == SIZE_MAX && !seek(0))
+        return false;
+    while (valid() && value() < pos)
+    {
+        if (!next())
+            return false;
+    }
+    return valid();
+}
+
+bool PagePositionStore::Cursor::next()
+{
+    if (index_ == SIZE_MAX)
+        return false;
+    return seek(index_ + 1);
+}
+
+bool PagePositionStore::Cursor::prev()
+{
+    if (index_ == SIZE_MAX || index_ == 0)
+        return false;
+    return seek(index_ - 1);
+}
+
+bool PagePositionStore::writePageFileHeader(File &f, uint32_t count)
+{
+    uint8_t hdr[PAGE_FILE_HEADER_SIZE] = {'B', 'P', 'G', '1', PAGE_FILE_VERSION_PACKED, 0, 0, 0};
+    memcpy(hdr + 8, &count, sizeof(count));
+    return f.write(hdr, sizeof(hdr)) == sizeof(hdr);
+}
+
+bool PagePositionStore::appendRecord(File &f, const uint32_t *offsets, size_t n)
+{
+    std::vector<uint8_t> rec;
+    while (n > 0)
+    {
+        size_t take = std::min(n, PAGE_RECORD_MAX_PAGES);
+        rec.assign(PAGE_RECORD_HEADER_SIZE, 0);
+        for (size_t i = 1; i < take; ++i)
+            putVarint(rec, zigzagEncode((int32_t)(offsets[i] - offsets[i - 1])));
+        uint16_t cnt = (uint16_t)take;
+        uint16_t payload = (uint16_t)(rec.size() - PAGE_RECORD_HEADER_SIZE);
+        memcpy(&rec[0], &offsets[0], 4);
+        memcpy(&rec[4], &cnt, 2);
+        memcpy(&rec[6], &payload, 2);
+        if (f.write(rec.data(), rec.size()) != rec.size())
+            return false;
+        offsets += take;
+        n -= take;
+    }
+    return true;
+}
+
+bool PagePositionStore::writePageFile(File &f) const
+{
+    if (!writePageFileHeader(f, (uint32_t)count_))
+        return false;
+    std::vector<uint32_t> chunk;
+    chunk.reserve(PAGE_RECORD_MAX_PAGES);
+    uint32_t vals[PAGES_PER_BLOCK];
+    for (size_t b = 0; b < blocks_.size(); ++b)
+    {
+        size_t n = decodeBlock(b, vals);
+        if (n == 0)
+            return false;
+        chunk.insert(chunk.end(), vals, vals + n);
+        if (chunk.size() + PAGES_PER_BLOCK > PAGE_RECORD_MAX_PAGES || b + 1 == blocks_.size())
+        {
+            if (!appendRecord(f, chunk.data(), chunk.size()))
+                return false;
+            chunk.clear();
+        }
+    }
+    return true;
+}
+
+bool PagePositionStore::loadFromPageFile(File &f, bool &needs_rewrite)
+{
+    clear();
+    needs_rewrite = false;
+
+    uint8_t hdr[PAGE_FILE_HEADER_SIZE];
+    if (!f.seek(0) || f.read(hdr, sizeof(hdr)) != (int)sizeof(hdr))
+        return false;
+    if (memcmp(hdr, "BPG1", 4) != 0)
+        return false;
+    uint8_t ver = hdr[4];
+    uint32_t count_field = 0;
+    memcpy(&count_field, hdr + 8, 4);
+    size_t file_size = f.size();
+    size_t remaining = file_size > PAGE_FILE_HEADER_SIZE ? file_size - PAGE_FILE_HEADER_SIZE : 0;
+
+    const size_t CHUNK = 1024;
+    if (ver == PAGE_FILE_VERSION_RAW)
+    {
+        // v1：count 字段可能滞后（增量写入后尚未修补），以文件大小为准
+        size_t actual = remaining / 4;
+#if DBG_BOOK_HANDLE
+        if (count_field != actual)
+            Serial.printf("[PAGE] v1 count字段异常 (field=%u, actual=%u)，从文件大小推断\n",
+                          (unsigned)count_field, (unsigned)actual);
+#endif
+        uint32_t buf[CHUNK / 4];
+        size_t done = 0;
+        while (done < actual)
+        {
+            size_t want = std::min(actual - done, (size_t)(CHUNK / 4));
+            if (f.read((uint8_t *)buf, want * 4) != (int)(want * 4))
+                break;
+            for (size_t i = 0; i < want; ++i)
+                push_back(buf[i]);
+            done += want;
+        }
+        needs_rewrite = true;
+        return true;
+    }
+    if (ver != PAGE_FILE_VERSION_PACKED)
+        return false;
+
+    // 流式解析：SD 层下整文件读入内存正是要避免的，缓冲只需容纳两条最长记录
+    const size_t BUF = 2 * (PAGE_RECORD_HEADER_SIZE + (PAGE_RECORD_MAX_PAGES - 1) * 5);
+    std::vector<uint8_t, PSRAMAllocator<uint8_t>> buf(BUF);
+    size_t have = 0;        // buf 中已读入的字节
+    size_t start = 0;       // buf 中尚未解析的起点
+    size_t left = remaining; // 文件中尚未读入的字节
+    bool read_error = false;
+    for (;;)
+    {
+        bool bad = false;
+        while (have - start >= PAGE_RECORD_HEADER_SIZE)
+        {
+            const uint8_t *p = buf.data() + start;
+            uint32_t first;
+            uint16_t n, payload;
+            memcpy(&first, p, 4);
+            memcpy(&n, p + 4, 2);
+            memcpy(&payload, p + 6, 2);
+            if (n == 0 || n > PAGE_RECORD_MAX_PAGES || payload > (size_t)(n - 1) * 5)
+            {
+                bad = true;
+                break;
+            }
+            if (have - start - PAGE_RECORD_HEADER_SIZE < payload)
+                break; // 记录不完整，先补数据
+            const uint8_t *q = p + PAGE_RECORD_HEADER_SIZE;
+            const uint8_t *rec_end = q + payload;
+            // 先完整校验本条记录，避免把半条写入的尾部混进内存表
+            const uint8_t *r = q;
+            bool ok = true;
+            for (uint16_t i = 1; i < n && ok; ++i)
+            {
+                uint32_t z;
+                ok = getVarint(r, rec_end, z);
+            }
+            if (!ok || r != rec_end)
+            {
+                bad = true;
+                break;
+            }
+            uint32_t v = first;
+            push_back(v);
+            r = q;
+            for (uint16_t i = 1; i < n; ++i)
+            {
+                uint32_t z;
+                getVarint(r, rec_end, z);
+                v += (uint32_t)zigzagDecode(z);
+                push_back(v);
+            }
+            start += PAGE_RECORD_HEADER_SIZE + payload;
+        }
+        if (bad || left == 0)
+            break;
+        memmove(buf.data(), buf.data() + start, have - start);
+        have -= start;
+        start = 0;
+        size_t want = std::min(BUF - have, left);
+        if (f.read(buf.data() + have, want) != (int)want)
+        {
+            read_error = true;
+            break;
+        }
+        have += want;
+        left -= want;
+    }
+    if (read_error)
+    {
+        needs_rewrite = true;
+        return !empty();
+    }
+    size_t tail = have - start + left;
+    if (tail > 0)
+    {
+        needs_rewrite = true;
+#if DBG_BOOK_HANDLE
+        Serial.printf("[PAGE] v2 尾部 %u 字节无效，已截断到 %u 页\n", (unsigned)tail, (unsigned)count_);
+#endif
+    }
+    return true;
+}
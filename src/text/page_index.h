@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <FS.h>
+#include "text/bin_font_print.h" // PSRAMAllocator
+
+// .page 文件格式
+//   header(12B): "BPG1" | u8 version | 3B reserved | u32 count（位于偏移 8，后台增量写入时原地修补）
+//   v1: u32 offsets[count]
+//   v2: record* —— 每条记录 u32 first | u16 n | u16 payload_len | payload
+//       payload 为其后 n-1 页相对前一页的 zigzag varint 增量。
+//       记录只追加（后台索引每批写一条），加载时逐条校验，遇到截断/损坏的尾部即停止并要求重写。
+static const uint8_t PAGE_FILE_VERSION_RAW = 1;
+static const uint8_t PAGE_FILE_VERSION_PACKED = 2;
+static const size_t PAGE_FILE_HEADER_SIZE = 12;
+static const size_t PAGE_RECORD_HEADER_SIZE = 8;
+static const size_t PAGE_RECORD_MAX_PAGES = 1024;
+
+// 紧凑的页起点表（分页 .page 与目录 .idx 共用）。三层存储：
+//   - 块索引：每 PAGES_PER_BLOCK 项一块，块首绝对值 + 块数据偏移，常驻内部 RAM（每块 8B）
+//   - 块数据：块内 zigzag varint 增量，默认放在 PSRAM；
+//             PSRAM 不足且设置了溢出文件时，已封口的块写入 SD 溢出文件，只保留尾块在内存
+//   - 热窗口：最近访问的 HOT_BLOCKS 个块的解码结果（内部 RAM），翻页/跳页附近的访问不再解码或读 SD
+// 接口保持与原 std::vector<size_t> 的常用子集一致（size/empty/[]/front/back/push_back/clear），
+// 顺序遍历与按位置定位请用 Cursor。
+// 溢出文件读失败时查询不会返回猜测值：at() 返回 npos、tryAt()/findLastAtOrBefore() 返回 false、
+// Cursor 变为无效，并置 readFailed()。调用方应从 .page 重新加载（此后 clear() 只选内存层）。
+class PagePositionStore
+{
+public:
+    static const size_t PAGES_PER_BLOCK = 64;
+    static const size_t HOT_BLOCKS = 4;
+    static const size_t npos = SIZE_MAX;
+
+    // 顺序/随机遍历游标：持有一个已解码块，块内移动不再访问底层存储。
+    // 目录、书签、随机跳转等按位置映射的代码共用这一套接口。
+    class Cursor
+    {
+    public:
+        explicit Cursor(const PagePositionStore &store) : store_(&store) {}
+        // 游标不跟踪表的修改：truncate/clear 之后需重新 seek
+        // 定位到第 index 项，越界返回 false
+        bool seek(size_t index);
+        // 定位到最后一个 <= pos 的项（pos 小于首项时定位到第 0 项），空表返回 false
+        bool seekAtOrBefore(size_t pos);
+        // 向后移动到第一个 >= pos 的项（只前进，适合单调递增的扫描），越过末尾返回 false
+        bool skipTo(size_t pos);
+        bool next();
+        bool prev();
+        bool valid() const { return index_ < store_->size() && index_ >= base_ && index_ - base_ < n_; }
+        size_t index() const { return index_; }
+        size_t value() const { return vals_[index_ - base_]; }
+
+    private:
+        bool load(size_t index);
+
+        const PagePositionStore *store_;
+        size_t index_ = SIZE_MAX;
+        size_t base_ = 0;
+        size_t n_ = 0;
+        uint32_t vals_[PAGES_PER_BLOCK];
+    };
+
+    PagePositionStore() = default;
+    ~PagePositionStore();
+    PagePositionStore(const PagePositionStore &) = delete;
+    PagePositionStore &operator=(const PagePositionStore &) = delete;
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    // 清空；同时按当前可用 PSRAM 重新选择块数据放在 PSRAM 还是 SD 溢出文件
+    void clear();
+    void push_back(size_t pos);
+    size_t operator[](size_t index) const { return at(index); }
+    // 越界返回 0；溢出文件读失败返回 npos
+    size_t at(size_t index) const;
+    bool tryAt(size_t index, size_t &out) const;
+    size_t front() const { return blocks_.empty() ? 0 : blocks_[0].first; }
+    size_t back() const { return last_; }
+    // 只保留前 n 项；截断点所在块读不出来时不做修改并返回 false
+    bool truncate(size_t n);
+
+    // 找到最大的 i 使 at(i) <= pos（要求单调递增）；pos 小于首项时返回 0；空表或读失败返回 false
+    bool findLastAtOrBefore(size_t pos, size_t &out_index) const;
+
+    // 解码第 block 块到 out（至多 PAGES_PER_BLOCK 项），返回项数；读失败返回 0
+    size_t decodeBlock(size_t block, uint32_t *out) const;
+    size_t blockCount() const { return blocks_.size(); }
+
+    // 预热 index 所在块及其相邻块到热窗口（跳页后调用，使随后的前后翻页命中）
+    void warm(size_t index) const;
+
+    // 设置 SD 溢出文件路径（为空则只用内存）。下一次 clear() 时生效。
+    void setSpillPath(const std::string &path) { spill_path_ = path; }
+    bool isSdBacked() const { return sd_tier_; }
+    // 曾有溢出文件读失败（此后的 clear() 不再选 SD 层）
+    bool readFailed() const { return spill_read_failed_.load(); }
+
+    // 约占用字节数（块索引 + 内存中的增量数据），以及已溢出到 SD 的字节数
+    size_t memoryBytes() const { return blocks_.size() * sizeof(BlockRef) + data_.size(); }
+    size_t spilledBytes() const { return spilled_; }
+
+    // 从已打开的 .page 读取（兼容 v1/v2）。needs_rewrite 置位表示文件是 v1 或尾部损坏，
+    // 调用方应在合适时机用 writePageFile 以 v2 重写。
+    bool loadFromPageFile(File &f, bool &needs_rewrite);
+    // 以 v2 格式写出完整文件（header + 记录）
+    bool writePageFile(File &f) const;
+
+    // 写 v2 文件头（新建文件时使用）
+    static bool writePageFileHeader(File &f, uint32_t count);
+    // 追加一条 v2 记录；n 超过 PAGE_RECORD_MAX_PAGES 时自动拆分
+    static bool appendRecord(File &f, const uint32_t *offsets, size_t n);
+
+private:
+    struct BlockRef
+    {
+        uint32_t first;    // 块首项的绝对值
+        uint32_t byte_off; // 块内增量在逻辑字节流中的起点（< spilled_ 的部分在 SD 溢出文件中）
+    };
+
+    struct HotSlot
+    {
+        size_t block = SIZE_MAX;
+        size_t n = 0;
+        uint32_t stamp = 0;
+        uint32_t gen = 0;
+        uint32_t vals[PAGES_PER_BLOCK];
+    };
+
+    size_t blockEnd(size_t block) const
+    {
+        return block + 1 < blocks_.size() ? blocks_[block + 1].byte_off : spilled_ + data_.size();
+    }
+    // 取得第 block 块的增量字节：内存中直接返回指针，已溢出的块读入 scratch；读失败返回 nullptr
+    const uint8_t *blockBytes(size_t block, uint8_t *scratch, size_t &len) const;
+    // 解码第 block 块，返回项数；读失败返回 0（正常块至少有块首一项）
+    size_t decodeBlockRaw(size_t block, uint32_t *out) const;
+    // 在热窗口中查找/填充第 block 块；热窗口正被其他任务占用时返回 false（调用方自行解码）
+    bool hotLookup(size_t block, size_t k, uint32_t &out) const;
+    // 截断/清空后使热窗口全部失效（只递增代数，不需要等待读者）
+    void invalidateHot() { hot_gen_.fetch_add(1); }
+    // 把内存中已封口块的字节追加到溢出文件
+    void spillSealedBlocks();
+    // 丢弃逻辑字节流中 off 之后的部分
+    void dropBytesFrom(size_t off);
+
+    std::vector<BlockRef> blocks_;
+    std::vector<uint8_t, PSRAMAllocator<uint8_t>> data_;
+    size_t count_ = 0;
+    uint32_t last_ = 0;
+
+    std::string spill_path_;
+    bool sd_tier_ = false;
+    bool spill_failed_ = false;
+    bool spill_created_ = false;
+    size_t spilled_ = 0; // 逻辑字节流中已写入溢出文件的前缀长度
+    // 溢出文件创建后一直打开（读写共用，查询可能来自多个任务，由 spill_lock_ 串行化 seek+read）
+    mutable File spill_file_;
+    mutable std::mutex spill_lock_;
+    mutable std::atomic<bool> spill_read_failed_{false};
+
+    mutable HotSlot hot_[HOT_BLOCKS];
+    mutable uint32_t hot_clock_ = 0;
+    mutable std::atomic_flag hot_busy_ = ATOMIC_FLAG_INIT;
+    std::atomic<uint32_t> hot_gen_{1};
+};
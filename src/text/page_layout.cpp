@@ -0,0 +1,105 @@
+#include "page_layout.h"
+#include <algorithm>
+
+void page_layout_analyze(PageLayout &layout)
+{
+    layout.glyphs.clear();
+
+    const std::string &text = layout.text;
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(text.data());
+    const uint8_t *end = p + text.size();
+
+    layout.glyphs.reserve(text.size() / 2);
+    while (p < end)
+    {
+        uint32_t unicode = 0;
+        int bytes = 0;
+
+        // 解析UTF-8字符
+        if (*p < 0x80)
+        {
+            unicode = *p;
+            bytes = 1;
+        }
+        else if ((*p & 0xE0) == 0xC0)
+        {
+            if (p + 1 < end)
+            {
+                unicode = ((*p & 0x1F) << 6) | (*(p + 1) & 0x3F);
+                bytes = 2;
+            }
+        }
+        else if ((*p & 0xF0) == 0xE0)
+        {
+            if (p + 2 < end)
+            {
+                unicode = ((*p & 0x0F) << 12) | ((*(p + 1) & 0x3F) << 6) | (*(p + 2) & 0x3F);
+                bytes = 3;
+            }
+        }
+        else if ((*p & 0xF8) == 0xF0)
+        {
+            // 4 bytes（只支持BMP，忽略）
+            bytes = 4;
+        }
+
+        if (bytes == 0)
+        {
+            // 解析失败，跳过
+            p++;
+            continue;
+        }
+        p += bytes;
+        // 只保留BMP字符（0x0000-0xFFFF），换行不占字形
+        if (unicode > 0 && unicode <= 0xFFFF && unicode != '\n')
+            layout.glyphs.push_back((uint16_t)unicode);
+    }
+
+    // 排序去重（一页至多千余字，比 unordered_set 省去逐字符的节点分配），便于后续二分查找
+    std::sort(layout.glyphs.begin(), layout.glyphs.end());
+    layout.glyphs.erase(std::unique(layout.glyphs.begin(), layout.glyphs.end()), layout.glyphs.end());
+    layout.glyphs.shrink_to_fit();
+}
+
+std::shared_ptr<const PageLayout> PageLayoutCache::find(const PageLayoutKey &key)
+{
+    for (Slot &s : slots_)
+    {
+        if (s.layout && s.key == key)
+        {
+            s.stamp = ++clock_;
+            ++hits_;
+            return s.layout;
+        }
+    }
+    ++misses_;
+    return nullptr;
+}
+
+void PageLayoutCache::put(const PageLayoutKey &key, std::shared_ptr<const PageLayout> layout)
+{
+    // 同 key 覆盖，否则用空槽或最久未用的槽（空槽 stamp 为 0）
+    Slot *victim = &slots_[0];
+    for (Slot &s : slots_)
+    {
+        if (s.layout && s.key == key)
+        {
+            victim = &s;
+            break;
+        }
+        if (s.stamp < victim->stamp)
+            victim = &s;
+    }
+    victim->key = key;
+    victim->layout = std::move(layout);
+    victim->stamp = ++clock_;
+}
+
+void PageLayoutCache::clear()
+{
+    for (Slot &s : slots_)
+    {
+        s.layout.reset();
+        s.stamp = 0;
+    }
+}
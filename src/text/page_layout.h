@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "text_handle.h"
+#include "text/bin_font_print.h" // PSRAMAllocator
+
+// 单页排版结果：一页文本只从 SD 读取、解码、繁简转换、分析一次，
+// 字形缓存构建（PageFontCache::build）、渲染（renderCurrentPage）与页摘要（current_digest）共用同一份。
+// 行内自动折行依赖绘制参数，仍由 bin_font_print 在绘制时完成；这里保存的是与绘制无关的部分。
+struct PageLayout
+{
+    size_t file_pos = 0;     // 本页起始位置
+    size_t page_end_pos = 0; // 本页结束位置（下次翻页的起点）
+    std::string text;        // 本页 UTF-8 文本（read_text_page 的输出）
+    // 本页用到的 BMP 码位（字体按码位索引字形），升序去重
+    std::vector<uint16_t, PSRAMAllocator<uint16_t>> glyphs;
+    size_t readable_chars = 0; // 非空白字符数（阅读统计）
+    std::string digest;        // 页摘要（前 DIGEST_NUM 个字符，书签/历史预览用）
+
+    TextPageResult toResult() const
+    {
+        TextPageResult r;
+        r.success = true;
+        r.file_pos = file_pos;
+        r.page_end_pos = page_end_pos;
+        r.page_text = text;
+        return r;
+    }
+};
+
+// 填充 glyphs（readable_chars/digest 由 BookHandle 按其规则填写）
+void page_layout_analyze(PageLayout &layout);
+
+// 决定一页排版结果是否仍然有效的全部输入
+struct PageLayoutKey
+{
+    size_t file_pos = 0;
+    size_t max_byte_pos = 0;
+    float font_size = 0.0f;
+    uint32_t font_epoch = 0; // bin_font_get_load_epoch()：换字体后缺字占位替换结果会变
+    uint8_t encoding = 0;
+    uint8_t zh_conv_mode = 0;
+    bool vertical = false;
+
+    bool operator==(const PageLayoutKey &o) const
+    {
+        return file_pos == o.file_pos && max_byte_pos == o.max_byte_pos && font_size == o.font_size &&
+               font_epoch == o.font_epoch && encoding == o.encoding && zh_conv_mode == o.zh_conv_mode &&
+               vertical == o.vertical;
+    }
+};
+
+// 最近使用的若干页排版结果（LRU）。由 BookHandle 持有，在文件锁内访问。
+class PageLayoutCache
+{
+public:
+    // 字体缓存窗口 5 页 + 翻页方向上再多留 2 页
+    static const size_t CAPACITY = 7;
+
+    std::shared_ptr<const PageLayout> find(const PageLayoutKey &key);
+    void put(const PageLayoutKey &key, std::shared_ptr<const PageLayout> layout);
+    void clear();
+
+    uint32_t hits() const { return hits_; }
+    uint32_t misses() const { return misses_; }
+
+private:
+    struct Slot
+    {
+        PageLayoutKey key;
+        std::shared_ptr<const PageLayout> layout;
+        uint32_t stamp = 0;
+    };
+
+    Slot slots_[CAPACITY];
+    uint32_t clock_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+};
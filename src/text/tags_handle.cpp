@@ -6,13 +6,36 @@
 #include <cctype>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include "../SD/SDWrapper.h"
 #include "device/safe_fs.h"
 #include "book_handle.h"
 #include "text/text_handle.h"
 
-// 最大条目数
-static const size_t MAX_TAG_LINES = 10;
+// .tags 二进制格式常量（见 tags_handle.h）
+static const char TAG_FILE_MAGIC[4] = {'R', 'P', 'T', 'G'};
+static const uint16_t TAG_FILE_VERSION = 1;
+static const size_t TAG_HEADER_SIZE = 64; // 与记录同长，槽位按 64B 对齐，不会跨 512B 扇区
+
+static const uint8_t TAG_FLAG_AUTO = 0x01;
+static const uint8_t TAG_FLAG_DELETED = 0x80; // 墓碑：槽位可复用
+
+// 墓碑数量超过该阈值且多于有效记录时整体压缩重写
+static const size_t TAG_COMPACT_MIN_TOMBSTONES = 16;
+
+#pragma pack(push, 1)
+struct TagRecord
+{
+    uint32_t position;
+    float percentage;
+    uint8_t flags;
+    uint8_t preview_len;
+    uint16_t reserved;
+    char preview[TAG_PREVIEW_MAX_BYTES];
+};
+#pragma pack(pop)
+static_assert(sizeof(TagRecord) == TAG_RECORD_SIZE, "TagRecord must stay 64 bytes");
+
 
 // 辅助：得到 tags 文件名，基于 getBookmarkFileName 的安全化规则
 static std::string getTagsFileName(const std::string &book_file_path)
@@ -220,430 +243,393 @@ static std::string makePreviewFromBook(const std::string &book_file_path, size_t
     return preview;
 }
 
-// 将 vector 写回 .tags 文件（覆盖写入），格式：pos:"preview":percentage
-static bool writeTagsFile(const std::string &tags_fn, const std::vector<TagEntry> &entries)
+static inline bool isLiveRecord(const TagRecord &r)
+{
+    return (r.flags & TAG_FLAG_DELETED) == 0;
+}
+
+// 填充一条记录；预览超过记录容量时按完整 UTF-8 码点截断
+static void fillTagRecord(TagRecord &r, size_t position, float percentage, const std::string &preview, bool is_auto)
 {
-    // use SafeFS to write atomically
-    bool result = SafeFS::safeWrite(tags_fn, [&](File &f)
+    memset(&r, 0, sizeof(r));
+    r.position = (uint32_t)position;
+    r.percentage = percentage;
+    r.flags = is_auto ? TAG_FLAG_AUTO : 0;
+    size_t n = std::min(preview.size(), TAG_PREVIEW_MAX_BYTES);
+    while (n > 0 && n < preview.size() && ((unsigned char)preview[n] & 0xC0) == 0x80)
+        --n;
+    memcpy(r.preview, preview.data(), n);
+    r.preview_len = (uint8_t)n;
+}
+
+static TagEntry tagRecordToEntry(const TagRecord &r)
+{
+    TagEntry te;
+    te.position = (size_t)r.position;
+    te.preview.assign(r.preview, std::min((size_t)r.preview_len, TAG_PREVIEW_MAX_BYTES));
+    te.percentage = r.percentage;
+    te.is_auto = (r.flags & TAG_FLAG_AUTO) != 0;
+    return te;
+}
+
+// 获取书籍文件大小（用于计算百分比），失败返回0
+static size_t getBookFileSize(const std::string &book_file_path)
+{
+    std::string path = book_file_path;
+    if (path.rfind("/sd", 0) == 0)
+        path = path.substr(3);
+    if (path.rfind("/spiffs", 0) == 0)
+        path = path.substr(7);
+
+    File tempf;
+    if (book_file_path.rfind("/spiffs", 0) == 0)
+        tempf = SPIFFS.open(path.c_str(), "r");
+    else
+        tempf = SDW::SD.open(path.c_str(), "r");
+    if (!tempf)
+        return 0;
+    size_t total = (size_t)tempf.size();
+    tempf.close();
+    return total;
+}
+
+// 解析旧文本格式的一行：[A:|M:]pos:"preview":percentage
+static bool parseLegacyTagLine(std::string s, TagEntry &te)
+{
+    bool is_auto = false;
+    if (s.size() >= 2 && (s[0] == 'A' || s[0] == 'M') && s[1] == ':')
+    {
+        is_auto = (s[0] == 'A');
+        s = s.substr(2);
+    }
+
+    size_t p1 = s.find(':');
+    if (p1 == std::string::npos)
+        return false;
+    std::string posstr = s.substr(0, p1);
+    size_t q1 = s.find('"', p1 + 1);
+    size_t q2 = std::string::npos;
+    if (q1 != std::string::npos)
+        q2 = s.find('"', q1 + 1);
+
+    std::string preview;
+    size_t p2 = p1 + 1;
+    if (q1 != std::string::npos && q2 != std::string::npos)
+    {
+        preview = s.substr(q1 + 1, q2 - (q1 + 1));
+        p2 = q2 + 1;
+    }
+
+    size_t p3 = s.find(':', p2);
+    std::string pctstr;
+    if (p3 != std::string::npos)
+        pctstr = s.substr(p3 + 1);
+    else if (p2 < s.size())
+        pctstr = s.substr(p2);
+
+    auto trim = [](std::string &t)
+    {
+        while (!t.empty() && isspace((unsigned char)t.front()))
+            t.erase(t.begin());
+        while (!t.empty() && isspace((unsigned char)t.back()))
+            t.pop_back();
+    };
+    trim(posstr);
+    trim(preview);
+    trim(pctstr);
+
+    te.position = (size_t)strtoull(posstr.c_str(), nullptr, 10);
+    te.preview = preview;
+    te.percentage = pctstr.empty() ? 0.0f : (float)atof(pctstr.c_str());
+    te.is_auto = is_auto;
+    return true;
+}
+
+// 整体重写 .tags（仅写入有效记录，同时完成墓碑压缩），使用 SafeFS 保证原子性
+static bool writeTagRecords(const std::string &tags_fn, const std::vector<TagRecord> &records)
+{
+    return SafeFS::safeWrite(tags_fn, [&](File &f)
                              {
-                                 char linebuf[256];
-                                 for (const auto &e : entries)
+                                 uint8_t header[TAG_HEADER_SIZE] = {0};
+                                 memcpy(header, TAG_FILE_MAGIC, sizeof(TAG_FILE_MAGIC));
+                                 header[4] = (uint8_t)(TAG_FILE_VERSION & 0xFF);
+                                 header[5] = (uint8_t)(TAG_FILE_VERSION >> 8);
+                                 header[6] = (uint8_t)(TAG_RECORD_SIZE & 0xFF);
+                                 header[7] = (uint8_t)(TAG_RECORD_SIZE >> 8);
+                                 if (f.write(header, sizeof(header)) != sizeof(header))
+                                     return false;
+                                 for (const auto &r : records)
                                  {
-                                     // sanitize preview: remove any '"' 字符
-                                     std::string pv = e.preview;
-                                     for (char &c : pv)
-                                     {
-                                         if (c == '"')
-                                             c = ' ';
-                                     }
-                                     // percentage with two decimals
-                                     float pct = e.percentage;
-                                     int n = snprintf(linebuf, sizeof(linebuf), "%zu:\"%s\":%.2f\n", e.position, pv.c_str(), pct);
-                                     if (n > 0)
-                                     {
-                                         // write marker prefix: 'A:' for auto, 'M:' for manual
-                                         char mark[2] = { e.is_auto ? 'A' : 'M', ':' };
-                                         f.write((const uint8_t *)mark, 2);
-                                         f.write((const uint8_t *)linebuf, (size_t)n);
-                                     }
+                                     if (!isLiveRecord(r))
+                                         continue;
+                                     if (f.write((const uint8_t *)&r, sizeof(r)) != sizeof(r))
+                                         return false;
                                  }
                                  return true;
                              });
-    
-    // 【调试日志】记录tags文件写入结果
-    if (result)
-    {
-        //Serial.printf("[Tags] writeTagsFile: 写入成功 (%zu tags)\n", entries.size());
-    }
-    else
-    {
-        //Serial.println("[Tags] writeTagsFile: 写入失败！");
-    }
-    
-    return result;
 }
 
-std::vector<TagEntry> loadTagsForFile(const std::string &book_file_path)
+// 原地写入单个槽位（slot == 记录数时即为追加）。头部与记录都是 64B，槽位不跨扇区边界，单次写入即可落盘。
+static bool writeTagSlot(const std::string &tags_fn, size_t slot, const TagRecord &rec)
 {
-    std::vector<TagEntry> out;
-    std::string tags_fn = getTagsFileName(book_file_path);
+    File f = SDW::SD.open(tags_fn.c_str(), "r+");
+    if (!f)
+        return false;
+    bool ok = f.seek(TAG_HEADER_SIZE + slot * TAG_RECORD_SIZE, SeekSet) &&
+              f.write((const uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+    f.flush();
+    f.close();
+    return ok;
+}
+
+// 读取 .tags 的全部槽位（含墓碑）。文件不存在时返回 true 且 records 为空。
+// 旧文本格式会在此处一次性迁移为二进制格式。
+static bool readTagRecords(const std::string &book_file_path, const std::string &tags_fn, std::vector<TagRecord> &records)
+{
+    records.clear();
     SafeFS::restoreFromTmpIfNeeded(tags_fn);
     if (!SDW::SD.exists(tags_fn.c_str()))
-    {
-        // 【调试日志】文件不存在（正常情况，不需要警告）
-        return out; // 文件不存在返回空
-    }
+        return true;
 
     File f = SDW::SD.open(tags_fn.c_str(), "r");
     if (!f)
+        return false;
+
+    size_t fsize = (size_t)f.size();
+    uint8_t header[TAG_HEADER_SIZE];
+    bool is_binary = fsize >= TAG_HEADER_SIZE &&
+                     f.read(header, TAG_HEADER_SIZE) == TAG_HEADER_SIZE &&
+                     memcmp(header, TAG_FILE_MAGIC, sizeof(TAG_FILE_MAGIC)) == 0;
+    if (is_binary)
     {
-//        Serial.printf("[Tags] loadTagsForFile: 警告 - 无法打开tags文件 %s\n", tags_fn.c_str());
-        return out;
+        uint16_t version = (uint16_t)(header[4] | (header[5] << 8));
+        uint16_t rec_size = (uint16_t)(header[6] | (header[7] << 8));
+        if (version != TAG_FILE_VERSION || rec_size != TAG_RECORD_SIZE)
+        {
+            f.close();
+            return false;
+        }
+        size_t count = (fsize - TAG_HEADER_SIZE) / TAG_RECORD_SIZE;
+        records.resize(count);
+        if (count > 0)
+        {
+            size_t got = f.read((uint8_t *)records.data(), count * TAG_RECORD_SIZE);
+            records.resize(got / TAG_RECORD_SIZE);
+        }
+        f.close();
+        return true;
     }
 
-    std::vector<TagEntry> parsed;
+    // 旧文本格式：逐行解析后迁移（同时按当前书籍大小重算百分比）
+    f.seek(0, SeekSet);
+    std::vector<TagEntry> legacy;
     while (f.available())
     {
         String line = f.readStringUntil('\n');
         line.trim();
         if (line.length() == 0)
             continue;
-        std::string s = std::string(line.c_str());
-        bool is_auto = false;
-        if (s.size() >= 2 && (s[0] == 'A' || s[0] == 'M') && s[1] == ':')
-        {
-            is_auto = (s[0] == 'A');
-            s = s.substr(2);
-        }
-        else
-        {
-            // 【警告】没有A:/M:前缀的行（旧格式或格式错误）
-          //  Serial.printf("[Tags] loadTagsForFile: 警告 - 行没有A:/M:前缀，默认为manual: %s\n", s.c_str());
-        }
-
-        // parse remaining as pos:"preview":percentage
-        size_t p1 = s.find(':');
-        if (p1 == std::string::npos)
-            continue;
-        std::string posstr = s.substr(0, p1);
-        size_t q1 = s.find('"', p1 + 1);
-        size_t q2 = std::string::npos;
-        if (q1 != std::string::npos)
-            q2 = s.find('"', q1 + 1);
-
-        std::string preview;
-        size_t p2 = p1 + 1;
-        if (q1 != std::string::npos && q2 != std::string::npos)
-        {
-            preview = s.substr(q1 + 1, q2 - (q1 + 1));
-            p2 = q2 + 1;
-        }
-
-        size_t p3 = s.find(':', p2);
-        std::string pctstr;
-        if (p3 != std::string::npos)
-            pctstr = s.substr(p3 + 1);
-        else
-        {
-            if (p2 < s.size())
-                pctstr = s.substr(p2);
-        }
-
-        auto trim = [](std::string &t)
-        {
-            while (!t.empty() && isspace((unsigned char)t.front()))
-                t.erase(t.begin());
-            while (!t.empty() && isspace((unsigned char)t.back()))
-                t.pop_back();
-        };
-        trim(posstr);
-        trim(preview);
-        trim(pctstr);
-
-        unsigned long long posv = strtoull(posstr.c_str(), nullptr, 10);
-        float pctv = 0.0f;
-        if (!pctstr.empty())
-            pctv = (float)atof(pctstr.c_str());
-
         TagEntry te;
-        te.position = (size_t)posv;
-        te.preview = preview;
-        te.percentage = pctv;
-        te.is_auto = is_auto;
-        parsed.push_back(te);
+        if (parseLegacyTagLine(std::string(line.c_str()), te))
+            legacy.push_back(te);
     }
     f.close();
 
-    // separate auto and manual entries
-    TagEntry auto_entry; bool have_auto = false;
-    std::vector<TagEntry> manual;
-    for (const auto &e : parsed)
+    size_t total = getBookFileSize(book_file_path);
+    for (const auto &e : legacy)
     {
-        if (e.is_auto)
-        {
-            auto_entry = e; have_auto = true;
-        }
-        else
-            manual.push_back(e);
-    }
-
-    std::sort(manual.begin(), manual.end(), [](const TagEntry &a, const TagEntry &b)
-              { return a.position < b.position; });
-    if (manual.size() > 0 && manual.size() > (MAX_TAG_LINES > 0 ? (MAX_TAG_LINES - 1) : 0))
-        manual.resize((MAX_TAG_LINES > 0) ? (MAX_TAG_LINES - 1) : 0);
-
-    if (have_auto)
-        out.push_back(auto_entry);
-    for (const auto &m : manual)
-        out.push_back(m);
-
-    // ReCompute percentage based on actual book file size
-    size_t total = 0;
-    std::string path = book_file_path;
-    File tempf;
-    if (path.rfind("/sd", 0) == 0)
-        path = path.substr(3);
-    if (path.rfind("/spiffs", 0) == 0)
-        path = path.substr(7);
-    if (book_file_path.rfind("/spiffs", 0) == 0)
-        tempf = SPIFFS.open(path.c_str(), "r");
-    else
-        tempf = SDW::SD.open(path.c_str(), "r");
-    if (tempf)
-    {
-        tempf.seek(0, SeekEnd);
-        total = (size_t)tempf.position();
-        tempf.close();
+        float pct = total > 0 ? (float)((double)e.position * 100.0 / (double)total) : e.percentage;
+        TagRecord r;
+        fillTagRecord(r, e.position, pct, e.preview, e.is_auto);
+        records.push_back(r);
     }
+    if (records.empty())
+        return SDW::SD.remove(tags_fn.c_str());
+    return writeTagRecords(tags_fn, records);
+}
 
-    if (total > 0)
+// 按显示顺序（auto 在前，手动标签按位置升序）返回有效槽位下标
+static std::vector<size_t> orderedLiveSlots(const std::vector<TagRecord> &records)
+{
+    std::vector<size_t> manual;
+    size_t auto_slot = SIZE_MAX;
+    for (size_t i = 0; i < records.size(); ++i)
     {
-        for (auto &e : out)
+        const TagRecord &r = records[i];
+        if (!isLiveRecord(r))
+            continue;
+        if (r.flags & TAG_FLAG_AUTO)
         {
-            e.percentage = (float)((double)e.position * 100.0 / (double)total);
+            if (auto_slot == SIZE_MAX || r.position >= records[auto_slot].position)
+                auto_slot = i;
+        }
+        else
+        {
+            manual.push_back(i);
         }
     }
-    
-    // 【调试日志】记录加载的tags数量
-    if (!out.empty())
-    {
-//        Serial.printf("[Tags] loadTagsForFile: 成功加载 %zu 个tags (文件: %s, 书籍大小: %zu bytes)\n", 
- //                    out.size(), tags_fn.c_str(), total);
-    }
-    
-    return out;
+    std::sort(manual.begin(), manual.end(), [&](size_t a, size_t b)
+              { return records[a].position < records[b].position; });
+
+    std::vector<size_t> order;
+    order.reserve(manual.size() + 1);
+    if (auto_slot != SIZE_MAX)
+        order.push_back(auto_slot);
+    order.insert(order.end(), manual.begin(), manual.end());
+    return order;
 }
 
-bool insertTagForFile(const std::string &book_file_path, size_t position)
+// 插入/更新一条标签：同位置手动标签或已有 auto 标签原地覆盖，否则复用墓碑槽位或追加。
+// preview_override 为 nullptr 时从书籍文件读取预览。
+static bool storeTag(const std::string &book_file_path, size_t position, const std::string *preview_override, bool is_auto)
 {
     if (position == (size_t)-1)
         return false;
+    if (!ensureBookmarksFolder())
+        return false;
 
     std::string tags_fn = getTagsFileName(book_file_path);
-    if (!ensureBookmarksFolder())
+    std::vector<TagRecord> records;
+    if (!readTagRecords(book_file_path, tags_fn, records))
         return false;
 
-    // load existing and split into auto/manual
-    std::vector<TagEntry> entries = loadTagsForFile(book_file_path);
-    TagEntry auto_entry; bool have_auto = false; std::vector<TagEntry> manual;
-    for (const auto &e : entries)
+    size_t target = SIZE_MAX;
+    size_t free_slot = SIZE_MAX;
+    size_t earliest = SIZE_MAX;
+    size_t live_manual = 0;
+    for (size_t i = 0; i < records.size(); ++i)
     {
-        if (e.is_auto) { auto_entry = e; have_auto = true; }
-        else manual.push_back(e);
+        const TagRecord &r = records[i];
+        if (!isLiveRecord(r))
+        {
+            if (free_slot == SIZE_MAX)
+                free_slot = i;
+            continue;
+        }
+        bool r_auto = (r.flags & TAG_FLAG_AUTO) != 0;
+        if (is_auto)
+        {
+            if (r_auto)
+                target = i;
+            continue;
+        }
+        if (r_auto)
+            continue;
+        ++live_manual;
+        if (r.position == position)
+            target = i;
+        if (earliest == SIZE_MAX || r.position < records[earliest].position)
+            earliest = i;
     }
 
-    // compute preview and percentage
-    size_t total = 0;
-    std::string path = book_file_path;
-    File tempf;
-    if (path.rfind("/sd", 0) == 0)
-        path = path.substr(3);
-    if (path.rfind("/spiffs", 0) == 0)
-        path = path.substr(7);
-    if (book_file_path.rfind("/spiffs", 0) == 0)
-        tempf = SPIFFS.open(path.c_str(), "r");
-    else
-        tempf = SDW::SD.open(path.c_str(), "r");
-    if (tempf)
+    // 【最大进度保护】auto tag 仅记录用户阅读的最远进度
+    // 如果新位置比现有 auto tag 位置小，不更新（保护最大进度）
+    if (is_auto && target != SIZE_MAX && position < records[target].position)
+        return true; // 返回成功，但不更新
+
+    if (target == SIZE_MAX)
     {
-        tempf.seek(0, SeekEnd);
-        total = (size_t)tempf.position();
-        tempf.close();
+        if (!is_auto && live_manual >= MAX_MANUAL_TAGS && earliest != SIZE_MAX)
+            target = earliest; // 手动区已满，淘汰最靠前的一条
+        else if (free_slot != SIZE_MAX)
+            target = free_slot;
+        else
+            target = records.size();
     }
 
-    TagEntry newe;
-    newe.position = position;
-    newe.preview = makePreviewFromBook(book_file_path, position);
-    if (total > 0)
-        newe.percentage = (float)((double)position * 100.0 / (double)total);
-    else
-        newe.percentage = 0.0f;
-    newe.is_auto = false;
+    size_t total = getBookFileSize(book_file_path);
+    float pct = total > 0 ? (float)((double)position * 100.0 / (double)total) : 0.0f;
+    std::string preview = preview_override ? *preview_override : makePreviewFromBook(book_file_path, position);
 
-    // remove any existing manual with same position
-    manual.erase(std::remove_if(manual.begin(), manual.end(), [&](const TagEntry &t)
-                                { return t.position == position; }),
-                 manual.end());
+    TagRecord rec;
+    fillTagRecord(rec, position, pct, preview, is_auto);
 
-    // If manual area is full (MAX_TAG_LINES-1), evict the earliest manual entry
-    if (manual.size() >= (MAX_TAG_LINES > 0 ? (MAX_TAG_LINES - 1) : 0))
-    {
-        if (!manual.empty()) manual.erase(manual.begin());
-    }
+    if (records.empty())
+        return writeTagRecords(tags_fn, std::vector<TagRecord>(1, rec));
+    return writeTagSlot(tags_fn, target, rec);
+}
 
-    manual.push_back(newe);
-    std::sort(manual.begin(), manual.end(), [](const TagEntry &a, const TagEntry &b)
-              { return a.position < b.position; });
+// 将指定槽位标记为墓碑；全部删除时移除文件，墓碑过多时压缩重写
+static bool tombstoneTagSlots(const std::string &tags_fn, std::vector<TagRecord> &records, const std::vector<size_t> &slots)
+{
+    for (size_t slot : slots)
+        records[slot].flags |= TAG_FLAG_DELETED;
 
-    std::vector<TagEntry> combined;
-    if (have_auto) combined.push_back(auto_entry);
-    for (const auto &m : manual) combined.push_back(m);
-    if (combined.size() > MAX_TAG_LINES) combined.resize(MAX_TAG_LINES);
+    size_t live = (size_t)std::count_if(records.begin(), records.end(), isLiveRecord);
+    size_t tombstones = records.size() - live;
+    if (live == 0)
+        return SDW::SD.remove(tags_fn.c_str());
+    if (tombstones >= TAG_COMPACT_MIN_TOMBSTONES && tombstones > live)
+        return writeTagRecords(tags_fn, records);
 
-    return writeTagsFile(tags_fn, combined);
+    bool ok = true;
+    for (size_t slot : slots)
+        ok = writeTagSlot(tags_fn, slot, records[slot]) && ok;
+    return ok;
 }
 
-// Overload: insert tag using caller-provided preview (UTF-8), avoid extra file IO
-bool insertTagForFile(const std::string &book_file_path, size_t position, const std::string &preview_override)
+// ---------------- TagIndex ----------------
+
+void TagIndex::clear()
 {
-    if (position == (size_t)-1)
-        return false;
+    entries_.clear();
+    has_auto_ = false;
+}
 
-    std::string tags_fn = getTagsFileName(book_file_path);
-    if (!ensureBookmarksFolder())
+bool TagIndex::load(const std::string &book_file_path)
+{
+    clear();
+    std::vector<TagRecord> records;
+    if (!readTagRecords(book_file_path, getTagsFileName(book_file_path), records))
         return false;
 
-    // load existing and split auto/manual
-    std::vector<TagEntry> entries = loadTagsForFile(book_file_path);
-    TagEntry auto_entry; bool have_auto = false; std::vector<TagEntry> manual;
-    for (const auto &e : entries)
-    {
-        if (e.is_auto) { auto_entry = e; have_auto = true; } else manual.push_back(e);
-    }
-
-    // compute percentage using file size
-    size_t total = 0;
-    std::string path = book_file_path;
-    File tempf;
-    if (path.rfind("/sd", 0) == 0)
-        path = path.substr(3);
-    if (path.rfind("/spiffs", 0) == 0)
-        path = path.substr(7);
-    if (book_file_path.rfind("/spiffs", 0) == 0)
-        tempf = SPIFFS.open(path.c_str(), "r");
-    else
-        tempf = SDW::SD.open(path.c_str(), "r");
-    if (tempf)
-    {
-        tempf.seek(0, SeekEnd);
-        total = (size_t)tempf.position();
-        tempf.close();
-    }
-
-    TagEntry newe;
-    newe.position = position;
-    newe.preview = preview_override; // assume UTF-8 and already trimmed/normalized by caller
-    if (total > 0)
-        newe.percentage = (float)((double)position * 100.0 / (double)total);
-    else
-        newe.percentage = 0.0f;
-    newe.is_auto = false;
+    std::vector<size_t> order = orderedLiveSlots(records);
+    entries_.reserve(order.size());
+    for (size_t slot : order)
+        entries_.push_back(tagRecordToEntry(records[slot]));
+    has_auto_ = !entries_.empty() && entries_[0].is_auto;
+    return true;
+}
 
-    // remove any existing manual with same position
-    manual.erase(std::remove_if(manual.begin(), manual.end(), [&](const TagEntry &t)
-                                { return t.position == position; }),
-                 manual.end());
+const TagEntry *TagIndex::findManualInRange(size_t start, size_t end) const
+{
+    auto it = std::lower_bound(manualBegin(), entries_.end(), start,
+                               [](const TagEntry &t, size_t pos)
+                               { return t.position < pos; });
+    if (it == entries_.end() || it->position >= end)
+        return nullptr;
+    return &*it;
+}
 
-    // If manual area is full, evict earliest manual
-    if (manual.size() >= (MAX_TAG_LINES > 0 ? (MAX_TAG_LINES - 1) : 0))
-    {
-        if (!manual.empty()) manual.erase(manual.begin());
-    }
+// ---------------- 文件级接口 ----------------
 
-    manual.push_back(newe);
-    std::sort(manual.begin(), manual.end(), [](const TagEntry &a, const TagEntry &b)
-              { return a.position < b.position; });
+std::vector<TagEntry> loadTagsForFile(const std::string &book_file_path)
+{
+    TagIndex index;
+    index.load(book_file_path);
+    return index.entries();
+}
 
-    std::vector<TagEntry> combined;
-    if (have_auto) combined.push_back(auto_entry);
-    for (const auto &m : manual) combined.push_back(m);
-    if (combined.size() > MAX_TAG_LINES) combined.resize(MAX_TAG_LINES);
+bool insertTagForFile(const std::string &book_file_path, size_t position)
+{
+    return storeTag(book_file_path, position, nullptr, false);
+}
 
-    return writeTagsFile(tags_fn, combined);
+// Overload: insert tag using caller-provided preview (UTF-8), avoid extra file IO
+bool insertTagForFile(const std::string &book_file_path, size_t position, const std::string &preview_override)
+{
+    return storeTag(book_file_path, position, &preview_override, false);
 }
 
 // Insert or update automatic slot0 tag. Replaces existing auto tag if any.
 bool insertAutoTagForFile(const std::string &book_file_path, size_t position)
 {
-    if (position == (size_t)-1)
-        return false;
-    std::string tags_fn = getTagsFileName(book_file_path);
-    if (!ensureBookmarksFolder())
-        return false;
-
-    std::vector<TagEntry> entries = loadTagsForFile(book_file_path);
-    TagEntry auto_entry; bool have_auto = false; std::vector<TagEntry> manual;
-    for (const auto &e : entries)
-    {
-        if (e.is_auto) { auto_entry = e; have_auto = true; }
-        else manual.push_back(e);
-    }
-    
-    // 【最大进度保护】auto tag 仅记录用户阅读的最远进度
-    // 如果新位置比现有 auto tag 位置小，不更新（保护最大进度）
-    if (have_auto && position < auto_entry.position)
-    {
-//        Serial.printf("[Tags] insertAutoTagForFile: 保护最大进度，不更新 auto tag (new=%zu < existing=%zu)\n",position, auto_entry.position);
-        return true; // 返回成功，但不更新
-    }
-
-    // compute percentage
-    size_t total = 0; std::string path = book_file_path; File tempf;
-    if (path.rfind("/sd", 0) == 0) path = path.substr(3);
-    if (path.rfind("/spiffs", 0) == 0) path = path.substr(7);
-    if (book_file_path.rfind("/spiffs", 0) == 0) tempf = SPIFFS.open(path.c_str(), "r"); else tempf = SDW::SD.open(path.c_str(), "r");
-    if (tempf) { tempf.seek(0, SeekEnd); total = (size_t)tempf.position(); tempf.close(); }
-
-    TagEntry newe; newe.position = position; newe.preview = makePreviewFromBook(book_file_path, position); if (total > 0) newe.percentage = (float)((double)position * 100.0 / (double)total); else newe.percentage = 0.0f; newe.is_auto = true;
-
-    // replace auto
-    have_auto = true; auto_entry = newe;
-    
-    //Serial.printf("[Tags] insertAutoTagForFile: 更新auto tag, new_pos=%zu (old_pos=%s)\n",position, have_auto ? "exists" : "none");
-
-    std::sort(manual.begin(), manual.end(), [](const TagEntry &a, const TagEntry &b){ return a.position < b.position; });
-    if (manual.size() > 0 && manual.size() > (MAX_TAG_LINES > 0 ? (MAX_TAG_LINES - 1) : 0)) manual.resize((MAX_TAG_LINES > 0) ? (MAX_TAG_LINES - 1) : 0);
-
-    std::vector<TagEntry> combined;
-    if (have_auto) combined.push_back(auto_entry);
-    for (const auto &m : manual) combined.push_back(m);
-    if (combined.size() > MAX_TAG_LINES) combined.resize(MAX_TAG_LINES);
-    
-    // 【调试日志】记录即将写入的tags信息
-    //Serial.printf("[Tags] insertAutoTagForFile: 准备写入 %zu 个tags (auto=%s, manual=%zu, 调用者: insertAutoTagForFile)\n", combined.size(), have_auto ? "yes" : "no", manual.size());
-    
-    return writeTagsFile(tags_fn, combined);
+    return storeTag(book_file_path, position, nullptr, true);
 }
 
 bool insertAutoTagForFile(const std::string &book_file_path, size_t position, const std::string &preview_override)
 {
-    if (position == (size_t)-1)
-        return false;
-    std::string tags_fn = getTagsFileName(book_file_path);
-    if (!ensureBookmarksFolder())
-        return false;
-
-    std::vector<TagEntry> entries = loadTagsForFile(book_file_path);
-    TagEntry auto_entry; bool have_auto = false; std::vector<TagEntry> manual;
-    for (const auto &e : entries)
-    {
-        if (e.is_auto) { auto_entry = e; have_auto = true; }
-        else manual.push_back(e);
-    }
-    
-    // 【最大进度保护】auto tag 仅记录用户阅读的最远进度
-    // 如果新位置比现有 auto tag 位置小，不更新（保护最大进度）
-    if (have_auto && position < auto_entry.position)
-    {
-        return true; // 返回成功，但不更新
-    }
-
-    // compute percentage
-    size_t total = 0; std::string path = book_file_path; File tempf;
-    if (path.rfind("/sd", 0) == 0) path = path.substr(3);
-    if (path.rfind("/spiffs", 0) == 0) path = path.substr(7);
-    if (book_file_path.rfind("/spiffs", 0) == 0) tempf = SPIFFS.open(path.c_str(), "r"); else tempf = SDW::SD.open(path.c_str(), "r");
-    if (tempf) { tempf.seek(0, SeekEnd); total = (size_t)tempf.position(); tempf.close(); }
-
-    TagEntry newe; newe.position = position; newe.preview = preview_override; if (total > 0) newe.percentage = (float)((double)position * 100.0 / (double)total); else newe.percentage = 0.0f; newe.is_auto = true;
-
-    have_auto = true; auto_entry = newe;
-
-    std::sort(manual.begin(), manual.end(), [](const TagEntry &a, const TagEntry &b){ return a.position < b.position; });
-    if (manual.size() > 0 && manual.size() > (MAX_TAG_LINES > 0 ? (MAX_TAG_LINES - 1) : 0)) manual.resize((MAX_TAG_LINES > 0) ? (MAX_TAG_LINES - 1) : 0);
-
-    std::vector<TagEntry> combined; if (have_auto) combined.push_back(auto_entry); for (const auto &m : manual) combined.push_back(m); if (combined.size() > MAX_TAG_LINES) combined.resize(MAX_TAG_LINES);
-    return writeTagsFile(tags_fn, combined);
+    return storeTag(book_file_path, position, &preview_override, true);
 }
 
 bool deleteTagForFileByPosition(const std::string &book_file_path, size_t position)
@@ -651,19 +637,19 @@ bool deleteTagForFileByPosition(const std::string &book_file_path, size_t positi
     std::string tags_fn = getTagsFileName(book_file_path);
     if (!SDW::SD.exists(tags_fn.c_str()))
         return false;
-    std::vector<TagEntry> entries = loadTagsForFile(book_file_path);
-    size_t before = entries.size();
-    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const TagEntry &t)
-                                 { return t.position == position; }),
-                  entries.end());
-    if (entries.size() == before)
-        return false; // nothing removed
-    // write updated file (if now empty remove file)
-    if (entries.empty())
+    std::vector<TagRecord> records;
+    if (!readTagRecords(book_file_path, tags_fn, records))
+        return false;
+
+    std::vector<size_t> slots;
+    for (size_t i = 0; i < records.size(); ++i)
     {
-        return SDW::SD.remove(tags_fn.c_str());
+        if (isLiveRecord(records[i]) && records[i].position == position)
+            slots.push_back(i);
     }
-    return writeTagsFile(tags_fn, entries);
+    if (slots.empty())
+        return false; // nothing removed
+    return tombstoneTagSlots(tags_fn, records, slots);
 }
 
 bool deleteTagForFileByIndex(const std::string &book_file_path, size_t index)
@@ -671,15 +657,14 @@ bool deleteTagForFileByIndex(const std::string &book_file_path, size_t index)
     std::string tags_fn = getTagsFileName(book_file_path);
     if (!SDW::SD.exists(tags_fn.c_str()))
         return false;
-    std::vector<TagEntry> entries = loadTagsForFile(book_file_path);
-    if (index >= entries.size())
+    std::vector<TagRecord> records;
+    if (!readTagRecords(book_file_path, tags_fn, records))
         return false;
-    entries.erase(entries.begin() + index);
-    if (entries.empty())
-    {
-        return SDW::SD.remove(tags_fn.c_str());
-    }
-    return writeTagsFile(tags_fn, entries);
+
+    std::vector<size_t> order = orderedLiveSlots(records);
+    if (index >= order.size())
+        return false;
+    return tombstoneTagSlots(tags_fn, records, std::vector<size_t>(1, order[index]));
 }
 
 bool clearTagsForFile(const std::string &book_file_path)
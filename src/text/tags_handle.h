@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 
 // 简单的书签标签条目
 struct TagEntry
@@ -13,24 +14,61 @@ struct TagEntry
     bool is_auto = false;  // 若为 true 则表示这是自动生成的 slot0 标签
 };
 
+// .tags 二进制格式（v1）：
+//   header(64B): "RPTG" | uint16 version | uint16 record_size | 56B reserved（与记录同长，槽位按 64B 对齐）
+//   record(64B)*N: uint32 position | float percentage | uint8 flags | uint8 preview_len | 2B reserved | preview[52]
+// 记录在文件中不排序；插入为追加或复用已删除槽位，删除只打墓碑标记，因此单次编辑只写一个 64B 记录。
+// 排序由内存中的 TagIndex 完成。旧的文本格式 (A:/M:pos:"preview":pct) 在首次读取时自动迁移。
+static const size_t TAG_RECORD_SIZE = 64;
+static const size_t TAG_PREVIEW_MAX_BYTES = 52;
+
+// 手动书签上限（仅作为防止 .tags 无限增长的安全阀，超过后淘汰最靠前的一条）
+static const size_t MAX_MANUAL_TAGS = 256;
+
+// 书签内存索引：auto 标签（若有）位于索引0，其后为按 position 升序的手动标签。
+// 由 BookHandle 持有，阅读界面据此做 O(log n) 的区间查询，无需访问 SD。
+class TagIndex
+{
+public:
+    // 从同名 .tags 文件加载（文件不存在时为空）
+    bool load(const std::string &book_file_path);
+    void clear();
+
+    // auto 在前、手动标签按位置升序
+    const std::vector<TagEntry> &entries() const { return entries_; }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    size_t manualCount() const { return entries_.size() - (has_auto_ ? 1 : 0); }
+    const TagEntry *autoTag() const { return has_auto_ ? &entries_[0] : nullptr; }
+
+    // 返回位于 [start, end) 内位置最小的手动标签，没有则返回 nullptr
+    const TagEntry *findManualInRange(size_t start, size_t end) const;
+
+private:
+    std::vector<TagEntry>::const_iterator manualBegin() const { return entries_.begin() + (has_auto_ ? 1 : 0); }
+
+    std::vector<TagEntry> entries_;
+    bool has_auto_ = false;
+};
+
 // 读取同名书籍的 .tags 文件，若文件不存在返回空向量
 std::vector<TagEntry> loadTagsForFile(const std::string &book_file_path);
 
-// 在 .tags 中插入一条（若已存在相同位置则更新），按 position 升序排序，最多保留 10 条
+// 在 .tags 中插入一条（若已存在相同位置则更新），超过 MAX_MANUAL_TAGS 时淘汰最靠前的一条
 // 返回是否成功写入到 SD
 bool insertTagForFile(const std::string &book_file_path, size_t position);
 // 插入 tag 并使用外部提供的预览字符串（避免再次从文件读取）。
 bool insertTagForFile(const std::string &book_file_path, size_t position, const std::string &preview_override);
 
 // 插入/更新自动 slot0 标签（覆盖 slot0）。自动标签与手动标签分开管理：
-// 自动标签位于返回的 tags 向量的索引0（若存在），手动标签使用 slot1-slot9。
+// 自动标签位于返回的 tags 向量的索引0（若存在），其后为手动标签。
 bool insertAutoTagForFile(const std::string &book_file_path, size_t position);
 bool insertAutoTagForFile(const std::string &book_file_path, size_t position, const std::string &preview_override);
 
 // 按位置删除匹配的 tag（exact match），返回是否有改动并成功写入
 bool deleteTagForFileByPosition(const std::string &book_file_path, size_t position);
 
-// 按索引删除（0-based，按文件中当前顺序），返回是否有改动并成功写入
+// 按索引删除（0-based，按 loadTagsForFile 返回的顺序），返回是否有改动并成功写入
 bool deleteTagForFileByIndex(const std::string &book_file_path, size_t index);
 
 // 删除同名 .tags 文件（清空全部）
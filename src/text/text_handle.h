@@ -68,11 +68,14 @@ struct BuildIndexResult {
 // - file: 已打开的文件句柄（caller 负责 open/close）
 // - max_pages: 若>0，则最多返回该数量的 page positions（用于增量生成）
 // - start_offset: 从文件的该原始字节偏移开始生成索引（默认0）
+// - page_glyphs: 若非空，为每个已完整分页的页（从 start_offset 那页起，含到达 EOF 的末页）
+//   追加一份排序去重的码点集合；未分完的最后一个页起点不输出
 BuildIndexResult build_book_page_index(File &file, const std::string &file_path,
                                        int16_t area_width, int16_t area_height, float font_size,
                                        TextEncoding encoding = TextEncoding::AUTO_DETECT,
                                        size_t max_pages = 0, size_t start_offset = 0, bool vertical = false,
-                                       BookHandle* bh = nullptr);
+                                       BookHandle* bh = nullptr,
+                                       std::vector<std::vector<uint16_t>> *page_glyphs = nullptr);
 
 // 编码检测和转换函数
 TextEncoding detect_text_encoding(const uint8_t* buffer, size_t size);
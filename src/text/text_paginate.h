@@ -0,0 +1,52 @@
+#pragma once
+// 分页核心：整书分页只依赖文本字节、字体度量（bin_font_* / g_line_height）、显示区域、
+// 竖排标志与繁简转换模式，不依赖 BookHandle、全局配置或 SD 路径。
+// 固件的 build_book_page_index 与主机端预索引工具（tools/preindex）编译同一份实现，
+// 因此主机生成的 .page 与设备后台索引逐字节一致。
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <FS.h>
+#include "text_handle.h"
+
+class PagePositionStore;
+
+struct PaginateOptions
+{
+    int16_t area_width = 0;
+    int16_t area_height = 0;
+    float font_size = 0;                       // 0 表示使用字体文件的基础尺寸
+    TextEncoding encoding = TextEncoding::UTF8; // 已检测的编码（不接受 AUTO_DETECT）
+    bool vertical = false;
+    uint8_t zh_conv_mode = 0;                  // 繁简转换模式；0 只做缺字占位替换（与渲染一致）
+    const PagePositionStore *breaks = nullptr; // 目录条目起点（.idx），分页在这些位置强制换页
+    std::function<bool()> should_stop;         // 每行检查一次，返回 true 时提前返回（reached_eof=false）
+};
+
+// 分页设置指纹：字体（字族、版本、字符数、基础字号）、行高、显示区域、竖排、繁简转换模式与编码，
+// 例如 "font=FZSKBXKJW/v2/n7506/32px lh=37 area=520x880 vertical=0 zh=0 enc=utf8"。
+// tools/preindex 把它写进 .complete 的 "settings " 行，设备接收或打开预索引时与自己的设置比对，不一致即不采用。
+// font_size 为 0 时取字体文件的基础尺寸；目录 .idx 的断页位置不计入（两端读的是同一个文件）
+static const char PAGINATE_SETTINGS_PREFIX[] = "settings ";
+std::string paginate_fingerprint(const PaginateOptions &opt, const char *font_family, uint8_t font_version,
+                                 uint32_t char_count);
+
+// 从 file 的 start_offset 起分页，语义与 build_book_page_index 相同（见 text_handle.h）
+BuildIndexResult paginate_book(File &file, const PaginateOptions &opt, size_t max_pages, size_t start_offset,
+                               std::vector<std::vector<uint16_t>> *page_glyphs = nullptr);
+
+// 每页行数（竖排为列数）与每行可用宽度（竖排为列高），与渲染端保持一致
+void paginate_page_geometry(int16_t area_width, int16_t area_height, float font_size, bool vertical,
+                            int &max_lines, int &max_width);
+
+// 解析目录 .idx（#index#, #title#, #byte_pos#, #percent#,）中的字节位置，排序后写入 out
+bool parse_idx_positions(File &idx_file, PagePositionStore &out);
+
+// 读取一行原始内容（含换行符），返回原始字节长度；文件指针停在下一行开头
+bool read_raw_line(File &f, std::string &out_raw, size_t &out_raw_bytes);
+
+// 将转换后（UTF-8）的位置映射回原始字节已消费量（GBK 双字节、无效字节占位）
+size_t map_converted_pos_to_raw_consumed(const std::string &raw, TextEncoding enc, size_t converted_pos);
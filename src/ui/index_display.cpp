@@ -10,6 +10,40 @@
 
 extern M5Canvas *g_canvas;
 
+// 每页显示的书签条数（与 state_index_display 的触摸映射一致）
+static const int TAG_ROWS = 10;
+static int tag_current_page = 0;
+
+static int tag_total_pages()
+{
+    if (!g_current_book)
+        return 0;
+    size_t total = g_current_book->getCachedTags().size();
+    return (int)((total + TAG_ROWS - 1) / TAG_ROWS);
+}
+
+void tag_next_page()
+{
+    if (tag_current_page + 1 < tag_total_pages())
+        tag_current_page++;
+}
+
+void tag_prev_page()
+{
+    if (tag_current_page > 0)
+        tag_current_page--;
+}
+
+void tag_reset_page()
+{
+    tag_current_page = 0;
+}
+
+int tag_get_current_page()
+{
+    return tag_current_page;
+}
+
 // Draw a left-side 360x800 tag list, 10 rows (each 80px high).
 // Each row shows: <摘要> <百分比>
 void show_tag_ui(M5Canvas *canvas, int8_t paging)
@@ -29,27 +63,32 @@ void show_tag_ui(M5Canvas *canvas, int8_t paging)
     const int16_t deltay = 32; // leave small top margin
     const int16_t w = 450;
     const int16_t h = 960;
-    const int rows = 10;
+    const int rows = TAG_ROWS;
     const int row_h = h * 0.9 / rows; // 80
 
     // background
     target->fillRect(x, y, w, h, TFT_WHITE);
     target->fillRect(x + w, y, 540 - w, h, TFT_BLACK);
 
-    // Load tags for current book
-    std::vector<TagEntry> tags;
-    if (g_current_book)
-    {
-        tags = loadTagsForFile(g_current_book->filePath());
-    }
+    // Tags come from the BookHandle-owned sorted index (no SD access here)
+    static const std::vector<TagEntry> no_tags;
+    const std::vector<TagEntry> &tags = g_current_book ? g_current_book->getCachedTags() : no_tags;
 
-    // Draw up to 10 entries
+    // Full redraw (entering from reading/menu) starts from the first page
+    if (paging == 0)
+        tag_current_page = 0;
+    int total_pages = tag_total_pages();
+    if (tag_current_page >= total_pages)
+        tag_current_page = total_pages > 0 ? total_pages - 1 : 0;
+    size_t first = (size_t)tag_current_page * rows;
+
+    // Draw one page of entries
     for (int i = 0; i < rows; ++i)
     {
         int16_t ry = y + i * row_h + deltay; // inner padding
-        if (i < (int)tags.size())
+        if (first + i < tags.size())
         {
-            const TagEntry &te = tags[i];
+            const TagEntry &te = tags[first + i];
             // determine if this tag's position is already indexed
             bool available = true;
             if (g_current_book)
@@ -73,7 +112,7 @@ void show_tag_ui(M5Canvas *canvas, int8_t paging)
             // percentage aligned to right column
             bin_font_print(pctbuf, 24, text_color, 120, x + 350, ry, true, target, TEXT_ALIGN_LEFT, 120);
 
-            if (i == 0)
+            if (te.is_auto)
                 bin_font_print("Auto", 14, 0, 60, 17, ry - 5, true, target, TEXT_ALIGN_LEFT, 60);
             else
             {
@@ -117,6 +156,17 @@ void show_tag_ui(M5Canvas *canvas, int8_t paging)
     canvas->fillTriangle(450 + 35, 75, 460 + 35, 70, 470 + 35, 75, TFT_BLACK);
     canvas->fillCircle(460 + 35, 50, 3, TFT_BLACK);
 
+    // Pagination (only when tags exceed one page)
+    if (total_pages > 1)
+    {
+        canvas->drawLine(235, 920, 225, 960, TFT_BLACK);
+        canvas->drawLine(240, 920, 230, 960, TFT_BLACK);
+        // Previous Page
+        canvas->fillTriangle(120, 950, 160, 950, 140, 930, TFT_BLACK);
+        // Next Page
+        canvas->fillTriangle(304, 930, 344, 930, 324, 950, TFT_BLACK);
+    }
+
     // push to display if using global canvas
     if (!canvas && g_canvas)
     {
@@ -127,7 +177,11 @@ void show_tag_ui(M5Canvas *canvas, int8_t paging)
     }
     else
     {
-        if (paging == 2)
+        if (paging == 1)
+        {
+            bin_font_flush_canvas(false, false, false, NOEFFECT, 0, 40, 450, 880);
+        }
+        else if (paging == 2)
         {
             bin_font_flush_canvas(false,false,false,NOEFFECT,0,0,450,960);
         }
@@ -4,5 +4,11 @@
 
 // 显示当前书籍的 tag 列表（左侧 360x800 区域，10 行）
 // 如果 canvas 为 nullptr，则使用全局 g_canvas
-// paging : 0 - 全屏刷， 2- 刷列表部分（用于书签目录跳转）
+// paging : 0 - 全屏刷（回到第一页）， 1-刷列表条目部分（翻页） 2- 刷列表部分（用于书签目录跳转）
 void show_tag_ui(M5Canvas *canvas = nullptr, int8_t paging = 0);
+
+// 书签列表翻页（书签数超过一页时使用）
+void tag_next_page();
+void tag_prev_page();
+void tag_reset_page();
+int tag_get_current_page();
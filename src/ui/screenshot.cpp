@@ -110,6 +110,7 @@ namespace PNGEncoder
 #include "ui/ui_canvas_image.h"
 // 需要检查当前系统状态以避免在 IDLE 状态启用背景
 #include "tasks/state_machine_task.h"
+#include "device/dir_index.h"
 
 bool screenShot()
 {
@@ -688,6 +689,7 @@ bool screenShot()
     size_t total_size = file.size();
     file.close();
     (void)total_size;
+    DirIndex::invalidate(filename);
 
 #if DBG_SCREENSHOT
     Serial.printf("[SCREENSHOT] 截图成功: %s (%d bytes)\n", filename, total_size);
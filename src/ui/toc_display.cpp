@@ -2,6 +2,7 @@
 #include "ui_canvas_utils.h"
 #include "current_book.h"
 #include "text/bin_font_print.h"
+#include "text/page_index.h"
 #include "text/font_buffer.h"
 #include "device/ui_display.h"
 #include "globals.h"
@@ -41,8 +42,9 @@ struct TocPageCache
     size_t file_size = 0;
     bool ready = false;
     std::vector<size_t, PSRAMAllocator<size_t>> page_offsets;
-    // Cache entry positions for quick lookup (存放在 PSRAM)
-    std::vector<size_t, PSRAMAllocator<size_t>> entry_positions;
+    // Cache entry positions for quick lookup (PagePositionStore，块数据在 PSRAM)。
+    // 当前书籍已加载 .idx 时不再复制，直接使用 BookHandle 的 idx 位置表。
+    PagePositionStore entry_positions;
     int cached_page = -1;
     std::vector<TocEntry, PSRAMAllocator<TocEntry>> cached_entries;
 };
@@ -52,6 +54,14 @@ static TocPageCache g_toc_cache;
 static bool g_toc_page_loading = false;
 static int g_toc_page_loading_index = -1;
 
+// 当前可用的目录位置表：优先使用当前书籍已加载的位置表，避免重复缓存
+static const PagePositionStore &toc_positions()
+{
+    if (g_current_book && g_current_book->filePath() == g_toc_cache.book_path && g_current_book->isIdxCached())
+        return g_current_book->getIdxPositions();
+    return g_toc_cache.entry_positions;
+}
+
 static void invalidate_toc_cache()
 {
     g_toc_cache.book_path.clear();
@@ -126,7 +136,7 @@ static bool ensure_toc_cache(const std::string &book_file_path)
     // prefer using it to populate TOC positions to avoid scanning the .idx file.
     if (g_current_book && g_current_book->filePath() == book_file_path && g_current_book->isIdxCached())
     {
-        const std::vector<size_t> &idx = g_current_book->getIdxPositions();
+        const PagePositionStore &idx = g_current_book->getIdxPositions();
         if (!idx.empty())
         {
             g_toc_cache.book_path = book_file_path;
@@ -135,9 +145,9 @@ static bool ensure_toc_cache(const std::string &book_file_path)
             g_toc_cache.page_offsets.clear();
             g_toc_cache.entry_positions.clear();
 
-            g_toc_cache.entry_positions.assign(idx.begin(), idx.end());
-            for (size_t i = 0; i < idx.size(); i += TOC_ROWS)
-                g_toc_cache.page_offsets.push_back(idx[i]);
+            PagePositionStore::Cursor cur(idx);
+            for (bool ok = cur.seek(0); ok; ok = cur.seek(cur.index() + TOC_ROWS))
+                g_toc_cache.page_offsets.push_back(cur.value());
 
             g_toc_cache.total_entries = idx.size();
             g_toc_cache.ready = true;
@@ -536,25 +546,15 @@ void toc_jump_to_position(const std::string &book_file_path, size_t file_pos)
     if (!ensure_toc_cache(book_file_path))
         return;
 
-    if (g_toc_cache.total_entries == 0 || g_toc_cache.entry_positions.empty())
+    const PagePositionStore &positions = toc_positions();
+    if (g_toc_cache.total_entries == 0 || positions.empty())
         return;
     // Reset last-entry record until we compute it below
     toc_last_entry_valid = false;
 
-    // Find the entry with the largest position <= file_pos.
-    // Use binary search on the cached in-memory positions for speed.
+    // Find the entry with the largest position <= file_pos (block binary search in the store).
     size_t best_entry_index = 0;
-    auto &positions = g_toc_cache.entry_positions;
-    auto it = std::upper_bound(positions.begin(), positions.end(), file_pos);
-    if (it == positions.begin())
-    {
-        best_entry_index = 0;
-    }
-    else
-    {
-        --it;
-        best_entry_index = static_cast<size_t>(it - positions.begin());
-    }
+    positions.findLastAtOrBefore(file_pos, best_entry_index);
 
     // Calculate which page this entry is on
     if (g_toc_cache.rows_per_page > 0)
@@ -593,22 +593,13 @@ bool find_toc_entry_for_position(const std::string &book_file_path, size_t file_
     if (!ensure_toc_cache(book_file_path))
         return false;
 
-    if (g_toc_cache.entry_positions.empty() || g_toc_cache.total_entries == 0)
+    const PagePositionStore &positions = toc_positions();
+    if (positions.empty() || g_toc_cache.total_entries == 0)
         return false;
 
-    // Use upper_bound to find first element > file_pos, then step back
-    auto &positions = g_toc_cache.entry_positions;
+    // Largest entry whose position <= file_pos
     size_t best_entry = 0;
-    auto it = std::upper_bound(positions.begin(), positions.end(), file_pos);
-    if (it == positions.begin())
-    {
-        best_entry = 0;
-    }
-    else
-    {
-        --it;
-        best_entry = static_cast<size_t>(it - positions.begin());
-    }
+    positions.findLastAtOrBefore(file_pos, best_entry);
 
     out_entry_index = best_entry;
 
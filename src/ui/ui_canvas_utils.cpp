@@ -9,6 +9,7 @@
 #include <M5Unified.h>
 #include "ui_canvas_image.h"
 #include "text/book_handle.h"
+#include "text/lz_book.h"
 #include <SD.h>
 #include "../SD/SDWrapper.h"
 #include "text/font_buffer.h"
@@ -200,10 +201,8 @@ bool show_reading_menu(M5Canvas *canvas, bool refresh, readingMenuArea area)
     // 去掉路径，只保留文件名
     size_t pos = path.find_last_of("/\\");
     std::string name = (pos == std::string::npos) ? path : path.substr(pos + 1);
-    // 去掉扩展名
-    size_t dot = name.find_last_of('.');
-    if (dot != std::string::npos)
-        name = name.substr(0, dot);
+    // 去掉扩展名（.txt.lz 整个去掉）
+    name = book_name_stem(name);
     // 对书名做特殊短化以便区分同系列多卷（use public helper）
     name = shorten_book_name(name, 12);
     // 拼接页码信息
@@ -1016,10 +1015,8 @@ bool show_main_menu(M5Canvas *canvas, bool refresh, int selected, int current_pa
                     // extract basename (remove folders)
                     size_t pos = s.find_last_of("/\\");
                     std::string name = (pos == std::string::npos) ? s : s.substr(pos + 1);
-                    // remove extension
-                    size_t dot = name.find_last_of('.');
-                    if (dot != std::string::npos)
-                        name = name.substr(0, dot);
+                    // remove extension (.txt.lz as a whole)
+                    name = book_name_stem(name);
                     history_files.push_back(name);
                 }
                 // File will be automatically closed when hf goes out of scope
@@ -1287,9 +1284,7 @@ std::string get_cached_book_name(int page, int index)
                 std::string s = std::string(line.c_str());
                 size_t pos = s.find_last_of("/\\");
                 std::string name = (pos == std::string::npos) ? s : s.substr(pos + 1);
-                size_t dot = name.find_last_of('.');
-                if (dot != std::string::npos)
-                    name = name.substr(0, dot);
+                name = book_name_stem(name);
                 // File will be automatically closed when hf goes out of scope
                 return name;
             }
@@ -1353,8 +1348,8 @@ std::string get_selected_book_fullpath(int page, int index)
     std::string name = get_cached_book_name(page, index);
     if (name.empty())
         return std::string();
-    // 统一返回 /sd/book/<name>.txt 格式
-    return std::string("/sd/book/") + name + ".txt";
+    // 统一返回 /sd/book/<name>.txt 格式（只有压缩存放的 <name>.txt.lz 时返回它）
+    return std::string("/sd") + BookFileManager::bookPath(name);
 }
 
 bool show_wire_connect(M5Canvas *canvas, bool refresh)
@@ -0,0 +1,479 @@
+// blitbench：glyph_blit 与逐像素 drawPixel 的主机端对比（字形/秒）
+//
+// 在 540x960 的合成帧缓冲（4bpp 灰度调色 / 8bpp RGB332，布局与 LGFX_Sprite 相同）上排一整页 CJK 大小的字形，
+// 逐像素路径按 LGFXBase::drawPixel 对 sprite 的调用链建模：裁剪 -> 经函数指针的颜色转换 ->
+// startWrite / writeFillRectPreclipped(x, y, 1, 1) / endWrite 三次虚函数调用 -> 打包写入。
+// 两条路径画出的帧缓冲必须逐字节一致（--check 只做一致性校验，供 ctest 使用）。
+//
+// 第二部分比较整页（V3 编码字形，含解码）的横排与竖排渲染耗时：竖排中标点/西文需要旋转，
+// 旧路径每次出现都解码为 RGB565、分配临时位图旋转再复制，新路径从旋转变体缓存直接写入。
+// 三种页面写出的像素也相互校验（旋转部分与逐次旋转的结果一致）。
+//
+//   blitbench [--iters N] [--check]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <M5Unified.h>
+#include "text/font_color_mapper.h"
+#include "text/font_decoder.h"
+#include "text/glyph_blit.h"
+
+// font_decoder.cpp 的 draw_bitmap_transparent 引用该画布；基准只用解码函数
+M5Canvas *g_canvas = nullptr;
+
+static const int FB_W = 540;
+static const int FB_H = 960;
+static const int GLYPH = 32;     // 字形边长（正文常用字号）
+static const int GLYPH_COUNT = 128;
+
+static const uint16_t C_WHITE = 0xFFFF;
+static const uint16_t C_BLACK = 0x0000;
+static const uint16_t C_GRAY = 0x8430;
+
+// RGB565 -> 原生值：4bpp 取 16 级灰度，8bpp 取 RGB332
+static uint8_t to_native(uint16_t c, int bpp)
+{
+    int r = (c >> 11) & 0x1F, g = (c >> 5) & 0x3F, b = c & 0x1F;
+    if (bpp == 4)
+    {
+        int lum = (r * 255 / 31 * 77 + g * 255 / 63 * 151 + b * 255 / 31 * 28) >> 8;
+        return (uint8_t)(lum >> 4);
+    }
+    return (uint8_t)(((r >> 2) << 5) | ((g >> 3) << 2) | (b >> 3));
+}
+
+// 模拟 M5GFX 的逐像素接口（LGFXBase -> Panel_Sprite）
+typedef uint8_t (*ConvertFn)(uint16_t rgb565);
+static uint8_t convert_4bpp(uint16_t c) { return to_native(c, 4); }
+static uint8_t convert_8bpp(uint16_t c) { return to_native(c, 8); }
+
+class PixelPanel
+{
+public:
+    virtual ~PixelPanel() = default;
+    virtual void startWrite() = 0;
+    virtual void endWrite() = 0;
+    virtual void writeFillRectPreclipped(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t v) = 0;
+};
+
+class PackedPanel : public PixelPanel
+{
+public:
+    PackedPanel(uint8_t *buf, int bpp) : buf_(buf), bpp_(bpp), stride_(FB_W * bpp / 8) {}
+    void startWrite() override { ++transaction_; }
+    void endWrite() override { --transaction_; }
+    void writeFillRectPreclipped(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t v) override
+    {
+        for (int32_t yy = y; yy < y + h; ++yy)
+        {
+            uint8_t *row = buf_ + yy * stride_;
+            for (int32_t xx = x; xx < x + w; ++xx)
+            {
+                if (bpp_ == 8)
+                {
+                    row[xx] = v;
+                    continue;
+                }
+                uint8_t shift = (xx & 1) ? 0 : 4;
+                row[xx >> 1] = (uint8_t)((row[xx >> 1] & ~(0x0F << shift)) | (v << shift));
+            }
+        }
+    }
+
+private:
+    uint8_t *buf_;
+    int bpp_;
+    int stride_;
+    int transaction_ = 0;
+};
+
+class PixelSink
+{
+public:
+    PixelSink(PixelPanel *panel, ConvertFn convert) : panel_(panel), convert_(convert) {}
+    void drawPixel(int32_t x, int32_t y, uint16_t rgb565)
+    {
+        if (x < 0 || y < 0 || x >= FB_W || y >= FB_H)
+            return;
+        uint8_t v = convert_(rgb565);
+        panel_->startWrite();
+        panel_->writeFillRectPreclipped(x, y, 1, 1, v);
+        panel_->endWrite();
+    }
+
+private:
+    PixelPanel *panel_;
+    ConvertFn convert_;
+};
+
+// 合成字形：若干横竖笔画，笔画边缘为灰（与 V3 解码结果同样只有三种颜色）
+static std::vector<std::vector<uint16_t>> make_glyphs()
+{
+    std::vector<std::vector<uint16_t>> glyphs(GLYPH_COUNT);
+    uint32_t seed = 12345;
+    auto rnd = [&](int n) {
+        seed = seed * 1103515245u + 12345u;
+        return (int)((seed >> 16) % (uint32_t)n);
+    };
+    for (auto &g : glyphs)
+    {
+        g.assign(GLYPH * GLYPH, C_WHITE);
+        int strokes = 4 + rnd(6);
+        for (int s = 0; s < strokes; ++s)
+        {
+            bool horizontal = rnd(2) == 0;
+            int pos = 2 + rnd(GLYPH - 4);
+            int a = rnd(GLYPH / 2), b = GLYPH / 2 + rnd(GLYPH / 2);
+            int thick = 2 + rnd(2);
+            for (int t = -1; t <= thick; ++t)
+            {
+                for (int k = a; k < b; ++k)
+                {
+                    int x = horizontal ? k : pos + t, y = horizontal ? pos + t : k;
+                    if (x < 0 || y < 0 || x >= GLYPH || y >= GLYPH)
+                        continue;
+                    uint16_t &p = g[y * GLYPH + x];
+                    bool edge = t < 0 || t == thick;
+                    if (!edge)
+                        p = C_BLACK;
+                    else if (p == C_WHITE)
+                        p = C_GRAY;
+                }
+            }
+        }
+    }
+    return glyphs;
+}
+
+struct PageLayout
+{
+    std::vector<int> x, y, id;
+};
+
+// 一页正文：每行 15 字、24 行，起点略微错开奇偶列以覆盖 4bpp 的半字节对齐
+static PageLayout make_page()
+{
+    PageLayout page;
+    int n = 0;
+    for (int row = 0; row < 24; ++row)
+        for (int col = 0; col < 15; ++col, ++n)
+        {
+            page.x.push_back(11 + col * (GLYPH + 3));
+            page.y.push_back(20 + row * (GLYPH + 7));
+            page.id.push_back(n % GLYPH_COUNT);
+        }
+    // 越界的字形检验裁剪
+    page.x.push_back(FB_W - GLYPH / 2);
+    page.y.push_back(FB_H - GLYPH / 3);
+    page.id.push_back(1);
+    page.x.push_back(-GLYPH / 2);
+    page.y.push_back(-3);
+    page.id.push_back(2);
+    return page;
+}
+
+struct Ctx
+{
+    int bpp;
+};
+
+static bool resolve(void *ctx, uint16_t c, uint8_t *v)
+{
+    if (c == C_WHITE)
+        return false; // 透明背景
+    *v = to_native(c, static_cast<Ctx *>(ctx)->bpp);
+    return true;
+}
+
+static void draw_page_pixels(PixelSink &sink, const PageLayout &page, const std::vector<std::vector<uint16_t>> &glyphs)
+{
+    for (size_t i = 0; i < page.id.size(); ++i)
+    {
+        const uint16_t *g = glyphs[page.id[i]].data();
+        for (int py = 0; py < GLYPH; ++py)
+            for (int px = 0; px < GLYPH; ++px)
+            {
+                uint16_t p = g[py * GLYPH + px];
+                if (p != C_WHITE)
+                    sink.drawPixel(page.x[i] + px, page.y[i] + py, p);
+            }
+    }
+}
+
+static void draw_page_blit(const BlitSurface &s, const PageLayout &page, const std::vector<std::vector<uint16_t>> &glyphs,
+                           Ctx &ctx)
+{
+    for (size_t i = 0; i < page.id.size(); ++i)
+    {
+        // 与固件一致：每个字形一个新调色表（颜色在首次出现时解析）
+        BlitPalette pal;
+        pal.resolve = resolve;
+        pal.ctx = &ctx;
+        glyph_blit(s, page.x[i], page.y[i], glyphs[page.id[i]].data(), GLYPH, GLYPH, GLYPH, pal);
+    }
+}
+
+// ---- 整页：V3 编码字形，含解码 ----
+
+// V3 编码：0=白，10=灰，11=黑（高位在前，末字节补 0）
+static std::vector<uint8_t> encode_v3(const std::vector<uint16_t> &g)
+{
+    std::vector<uint8_t> out;
+    uint32_t acc = 0;
+    int nbits = 0;
+    auto put = [&](uint32_t bits, int len) {
+        acc = (acc << len) | bits;
+        nbits += len;
+        if (nbits >= 8)
+        {
+            out.push_back((uint8_t)(acc >> (nbits - 8)));
+            nbits -= 8;
+        }
+    };
+    for (uint16_t p : g)
+    {
+        if (p == C_WHITE)
+            put(0, 1);
+        else if (p == C_GRAY)
+            put(2, 2);
+        else
+            put(3, 2);
+    }
+    if (nbits > 0)
+        out.push_back((uint8_t)(acc << (8 - nbits)));
+    return out;
+}
+
+struct PageGlyph
+{
+    int x, y, id;
+    bool rotated;
+};
+
+// 竖排一页：12 列、每列 27 字；约每 6 字一个需要旋转的字形（取自 16 个不同的标点/西文）
+static std::vector<PageGlyph> make_vertical_page()
+{
+    std::vector<PageGlyph> page;
+    int n = 0;
+    for (int col = 0; col < 12; ++col)
+        for (int row = 0; row < 27; ++row, ++n)
+        {
+            bool rotated = n % 6 == 5;
+            page.push_back({FB_W - 50 - col * (GLYPH + 10), 12 + row * (GLYPH + 3),
+                            rotated ? (n / 6) % 16 : 16 + n % (GLYPH_COUNT - 16), rotated});
+        }
+    return page;
+}
+
+static std::vector<PageGlyph> make_horizontal_page()
+{
+    std::vector<PageGlyph> page;
+    PageLayout p = make_page();
+    for (size_t i = 0; i < p.id.size(); ++i)
+        page.push_back({p.x[i], p.y[i], 16 + p.id[i] % (GLYPH_COUNT - 16), false});
+    return page;
+}
+
+struct CoverageCtx
+{
+    int bpp;
+};
+
+static bool resolve_level(void *ctx, uint16_t level, uint8_t *v)
+{
+    if (level == 0)
+        return false;
+    uint16_t c = level == FontDecoder::COVERAGE_V3_GRAY ? C_GRAY : C_BLACK;
+    *v = to_native(c, static_cast<CoverageCtx *>(ctx)->bpp);
+    return true;
+}
+
+// 旧竖排路径（旋转部分）：解码 RGB565 -> 分配临时位图旋转 -> 复制到独立缓冲 -> 写入
+static void draw_rotated_legacy(const BlitSurface &s, const PageGlyph &g, const std::vector<uint8_t> &raw, Ctx &ctx)
+{
+    std::vector<uint16_t> bitmap(GLYPH * GLYPH);
+    FontDecoder::decode_bitmap_v3(raw.data(), raw.size(), bitmap.data(), GLYPH, GLYPH, false, false);
+    uint16_t *temp = new uint16_t[GLYPH * GLYPH];
+    memcpy(temp, bitmap.data(), GLYPH * GLYPH * sizeof(uint16_t));
+    for (int y = 0; y < GLYPH; ++y)
+        for (int x = 0; x < GLYPH; ++x)
+            bitmap[x * GLYPH + (GLYPH - 1 - y)] = temp[y * GLYPH + x];
+    delete[] temp;
+    uint16_t *local = new uint16_t[GLYPH * GLYPH];
+    memcpy(local, bitmap.data(), GLYPH * GLYPH * sizeof(uint16_t));
+    BlitPalette pal;
+    pal.resolve = resolve;
+    pal.ctx = &ctx;
+    glyph_blit(s, g.x, g.y, local, GLYPH, GLYPH, GLYPH, pal);
+    delete[] local;
+}
+
+static void draw_coverage(const BlitSurface &s, int x, int y, const uint8_t *cov, CoverageCtx &ctx)
+{
+    BlitPalette pal;
+    pal.resolve = resolve_level;
+    pal.ctx = &ctx;
+    glyph_blit_coverage4(s, x, y, cov, GLYPH, GLYPH, (GLYPH + 1) / 2, pal);
+}
+
+static int run_page_bench(const std::vector<std::vector<uint16_t>> &glyphs, int iters, bool check_only)
+{
+    std::vector<std::vector<uint8_t>> raw;
+    for (const auto &g : glyphs)
+        raw.push_back(encode_v3(g));
+    std::vector<PageGlyph> hpage = make_horizontal_page(), vpage = make_vertical_page();
+    const size_t cov_bytes = FontDecoder::coverage4_size(GLYPH, GLYPH);
+    int failures = 0;
+
+    for (int bpp : {4, 8})
+    {
+        size_t bytes = (size_t)FB_W * bpp / 8 * FB_H;
+        std::vector<uint8_t> fb_h(bytes, 0), fb_old(bytes, 0), fb_new(bytes, 0);
+        auto surface = [&](std::vector<uint8_t> &fb) {
+            BlitSurface s;
+            s.pixels = fb.data();
+            s.width = FB_W;
+            s.height = FB_H;
+            s.stride = FB_W * bpp / 8;
+            s.bpp = (uint8_t)bpp;
+            return s;
+        };
+        BlitSurface sh = surface(fb_h), so = surface(fb_old), sn = surface(fb_new);
+        Ctx ctx{bpp};
+        CoverageCtx cctx{bpp};
+        std::vector<uint8_t> cov(cov_bytes);
+        // 变体缓存：首次出现时解码并旋转（计入第一轮耗时）
+        std::vector<std::vector<uint8_t>> variants(GLYPH_COUNT);
+
+        using clock = std::chrono::steady_clock;
+        auto t0 = clock::now();
+        for (int it = 0; it < iters; ++it)
+            for (const PageGlyph &g : hpage)
+            {
+                FontDecoder::decode_coverage4(FontDecoder::CODEC_V3, raw[g.id].data(), raw[g.id].size(), cov.data(),
+                                              GLYPH, GLYPH);
+                draw_coverage(sh, g.x, g.y, cov.data(), cctx);
+            }
+        auto t1 = clock::now();
+        for (int it = 0; it < iters; ++it)
+            for (const PageGlyph &g : vpage)
+            {
+                if (g.rotated)
+                {
+                    draw_rotated_legacy(so, g, raw[g.id], ctx);
+                    continue;
+                }
+                FontDecoder::decode_coverage4(FontDecoder::CODEC_V3, raw[g.id].data(), raw[g.id].size(), cov.data(),
+                                              GLYPH, GLYPH);
+                draw_coverage(so, g.x, g.y, cov.data(), cctx);
+            }
+        auto t2 = clock::now();
+        for (int it = 0; it < iters; ++it)
+            for (const PageGlyph &g : vpage)
+            {
+                std::vector<uint8_t> *v = g.rotated ? &variants[g.id] : nullptr;
+                if (!v || v->empty())
+                    FontDecoder::decode_coverage4(FontDecoder::CODEC_V3, raw[g.id].data(), raw[g.id].size(),
+                                                  cov.data(), GLYPH, GLYPH);
+                if (!v)
+                {
+                    draw_coverage(sn, g.x, g.y, cov.data(), cctx);
+                    continue;
+                }
+                if (v->empty())
+                {
+                    v->resize(cov_bytes);
+                    coverage4_rotate_cw(cov.data(), GLYPH, GLYPH, v->data(), false);
+                }
+                draw_coverage(sn, g.x, g.y, v->data(), cctx);
+            }
+        auto t3 = clock::now();
+
+        bool same = fb_old == fb_new;
+        if (!same)
+            ++failures;
+        if (check_only)
+        {
+            printf("%dbpp vertical page: %s\n", bpp, same ? "identical" : "MISMATCH");
+            continue;
+        }
+        auto ms = [&](clock::time_point a, clock::time_point b) {
+            return std::chrono::duration<double, std::milli>(b - a).count() / iters;
+        };
+        printf("%dbpp  page ms: horizontal %.3f (%u glyphs)   vertical %u glyphs: rotate each %.3f, cached variants %.3f  %s\n",
+               bpp, ms(t0, t1), (unsigned)hpage.size(), (unsigned)vpage.size(), ms(t1, t2), ms(t2, t3),
+               same ? "identical" : "MISMATCH");
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int iters = 1000;
+    bool check_only = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--iters" && i + 1 < argc)
+            iters = atoi(argv[++i]);
+        else if (a == "--check")
+            check_only = true;
+        else
+        {
+            fprintf(stderr, "usage: blitbench [--iters N] [--check]\n");
+            return 1;
+        }
+    }
+    if (check_only)
+        iters = 1;
+
+    auto glyphs = make_glyphs();
+    PageLayout page = make_page();
+    int failures = 0;
+
+    for (int bpp : {4, 8})
+    {
+        size_t bytes = (size_t)FB_W * bpp / 8 * FB_H;
+        std::vector<uint8_t> fb_ref(bytes, 0x5A), fb_blit(bytes, 0x5A);
+
+        PackedPanel panel(fb_ref.data(), bpp);
+        PixelSink sink(&panel, bpp == 4 ? convert_4bpp : convert_8bpp);
+        BlitSurface s;
+        s.pixels = fb_blit.data();
+        s.width = FB_W;
+        s.height = FB_H;
+        s.stride = FB_W * bpp / 8;
+        s.bpp = (uint8_t)bpp;
+        Ctx ctx{bpp};
+
+        using clock = std::chrono::steady_clock;
+        auto t0 = clock::now();
+        for (int it = 0; it < iters; ++it)
+            draw_page_pixels(sink, page, glyphs);
+        auto t1 = clock::now();
+        for (int it = 0; it < iters; ++it)
+            draw_page_blit(s, page, glyphs, ctx);
+        auto t2 = clock::now();
+
+        bool same = fb_ref == fb_blit;
+        if (!same)
+            ++failures;
+        double glyph_total = (double)page.id.size() * iters;
+        double sec_px = std::chrono::duration<double>(t1 - t0).count();
+        double sec_blit = std::chrono::duration<double>(t2 - t1).count();
+        if (check_only)
+        {
+            printf("%dbpp: %s\n", bpp, same ? "identical" : "MISMATCH");
+            continue;
+        }
+        printf("%dbpp  drawPixel: %10.0f glyphs/s   glyph_blit: %10.0f glyphs/s   (x%.1f)  %s\n", bpp,
+               glyph_total / sec_px, glyph_total / sec_blit, sec_px / sec_blit, same ? "identical" : "MISMATCH");
+    }
+    failures += run_page_bench(glyphs, iters, check_only);
+    return failures == 0 ? 0 : 2;
+}
@@ -19,8 +19,40 @@ def load_positions(path):
         raise ValueError('empty pos/page file')
 
     # Detect device .page binary header (magic 'BPG1')
+    if n >= 12 and data[0:4] == b'BPG1' and data[4] == 2:
+        # v2: magic(4) ver(1) reserved(3) count(uint32) + records
+        # record: first(uint32) n(uint16) payload_len(uint16) payload(zigzag varint deltas * (n-1))
+        positions = []
+        p = 12
+        while p + 8 <= n:
+            first, cnt, plen = struct.unpack_from('<IHH', data, p)
+            q = p + 8
+            if cnt == 0 or q + plen > n:
+                break
+            vals = [first]
+            r = q
+            for _ in range(cnt - 1):
+                z = 0
+                shift = 0
+                while r < q + plen:
+                    b = data[r]
+                    r += 1
+                    z |= (b & 0x7F) << shift
+                    shift += 7
+                    if not b & 0x80:
+                        break
+                d = (z >> 1) ^ -(z & 1)
+                vals.append((vals[-1] + d) & 0xFFFFFFFF)
+            if r != q + plen:
+                break
+            positions.extend(vals)
+            p = q + plen
+        if p != n:
+            print(f'warning: {n - p} trailing bytes ignored (torn record)', file=sys.stderr)
+        return positions
+
     if n >= 12 and data[0:4] == b'BPG1':
-        # Format: magic(4) ver(1) reserved(3) count(uint32) offsets[count] (uint32 little-endian)
+        # v1: magic(4) ver(1) reserved(3) count(uint32) offsets[count] (uint32 little-endian)
         ver = data[4]
         # count at offset 8
         count = struct.unpack_from('<I', data, 8)[0]
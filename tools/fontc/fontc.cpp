@@ -0,0 +1,626 @@
+// fontc —— ReadPaper 主机端字体编译器
+//
+// 把 TTF/OTF 栅格化为设备使用的 .bin（load_bin_font / detect_font_format 解析的格式）：
+//   header(134) = u32 char_count | u8 font_size | u8 version | char[64] family | char[64] style
+//   char table  = char_count × 20 字节（按码点升序）
+//   bitmaps
+// V2 与 generate_1bit_font_bin.py 使用相同的平滑/二值化/裁剪规则（同一 FreeType 版本、同一字符集下应逐字节一致）；
+// 栅格化按线程拆分，每个线程持有独立的 FT_Face，用工作窃取平衡 ASCII 与 CJK 的耗时差异。
+//
+// 用法见 usage() 与 tools/README.md。
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_SFNT_NAMES_H
+#include FT_TRUETYPE_IDS_H
+
+#include "rasterizer.h"
+#include "verify.h"
+#include "work_pool.h"
+
+static const size_t FONT_HEADER_SIZE = 134;
+static const size_t CHAR_RECORD_SIZE = 20;
+static const size_t GLYPHS_PER_TASK = 64;
+
+enum class BitmapLayout
+{
+    Codepoint, // 位图按码点顺序（与 Python 版相同）
+    Frequency, // 位图按语料字频降序排列，常用字集中在文件前部
+};
+
+struct Options
+{
+    std::string font;
+    std::string out;
+    RasterOptions raster;
+    std::string charset_json = "webapp/extension/assets/charset_default.json";
+    std::vector<std::string> chars_text;
+    bool ascii_only = false;
+    BitmapLayout layout = BitmapLayout::Codepoint;
+    std::vector<std::string> freq_files;
+    unsigned threads = 0;
+    bool verify = false;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+            "用法: fontc [选项] font.ttf out.bin\n"
+            "  --size N              字体像素高度（默认 32）\n"
+            "  --format v2|v3        v2=1bit（默认），v3=2bit Huffman 灰度\n"
+            "  --white N             V2 白色阈值 0-255（默认 80，越低越细）\n"
+            "  --no-smooth, --fast   V2 关闭边缘平滑\n"
+            "  --v3-gray N           V3 灰色覆盖率阈值（默认 48）\n"
+            "  --v3-black N          V3 黑色覆盖率阈值（默认 144）\n"
+            "  --charset FILE.json   字符集（默认 webapp/extension/assets/charset_default.json，\n"
+            "                        即 generate_1bit_font_bin.py 导出的 GBK+繁体集合）\n"
+            "  --chars FILE          追加 UTF-8 文本中出现的全部字符（可重复）\n"
+            "  --ascii-only          仅 ASCII（忽略 --charset）\n"
+            "  --keep-placeholder    缺字时保留占位符（U+25A1 或方框）\n"
+            "  --layout codepoint|frequency\n"
+            "                        位图排列：码点顺序（默认）或按 --freq 语料字频降序\n"
+            "  --freq FILE           字频语料（UTF-8 文本，可重复）\n"
+            "  -j N                  线程数（默认为 CPU 核数）\n"
+            "  --verify              写出后用固件 FontDecoder 往返校验每个字形\n");
+}
+
+// ========== 字符集 ==========
+
+static bool read_file(const std::string &path, std::string &out)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    out = ss.str();
+    return true;
+}
+
+// 只解析 {"chars": [32, 33, ...]}，与 Python 版导出的格式对应
+static bool load_charset_json(const std::string &path, std::vector<uint32_t> &cps)
+{
+    std::string text;
+    if (!read_file(path, text))
+        return false;
+    size_t key = text.find("\"chars\"");
+    if (key == std::string::npos)
+        return false;
+    size_t p = text.find('[', key);
+    size_t end = text.find(']', p);
+    if (p == std::string::npos || end == std::string::npos)
+        return false;
+    while (++p < end)
+    {
+        if (text[p] < '0' || text[p] > '9')
+            continue;
+        uint32_t v = 0;
+        while (p < end && text[p] >= '0' && text[p] <= '9')
+            v = v * 10 + (uint32_t)(text[p++] - '0');
+        cps.push_back(v);
+    }
+    return true;
+}
+
+// UTF-8 解码（非法字节跳过）
+static void utf8_for_each(const std::string &s, const std::function<void(uint32_t)> &fn)
+{
+    const unsigned char *p = (const unsigned char *)s.data();
+    const unsigned char *end = p + s.size();
+    while (p < end)
+    {
+        uint32_t c = *p;
+        int extra = c < 0x80 ? 0 : (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : (c & 0xF8) == 0xF0 ? 3 : -1;
+        if (extra < 0 || end - p <= extra)
+        {
+            ++p;
+            continue;
+        }
+        c &= extra == 0 ? 0x7F : (0x3F >> extra);
+        int i = 1;
+        for (; i <= extra && (p[i] & 0xC0) == 0x80; ++i)
+            c = (c << 6) | (p[i] & 0x3F);
+        if (i <= extra)
+        {
+            ++p;
+            continue;
+        }
+        p += extra + 1;
+        fn(c);
+    }
+}
+
+static void append_utf8(std::string &out, uint32_t c)
+{
+    if (c < 0x80)
+        out += (char)c;
+    else if (c < 0x800)
+    {
+        out += (char)(0xC0 | (c >> 6));
+        out += (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+        out += (char)(0xE0 | (c >> 12));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xF0 | (c >> 18));
+        out += (char)(0x80 | ((c >> 12) & 0x3F));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+    }
+}
+
+// ========== 字体名（对应 Python 版的 pick_name） ==========
+
+// Mac Roman 0x80-0xFF
+static const uint16_t MAC_ROMAN_HIGH[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1, 0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7,
+    0x00E9, 0x00E8, 0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3, 0x00F2, 0x00F4, 0x00F6, 0x00F5,
+    0x00FA, 0x00F9, 0x00FB, 0x00FC, 0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF, 0x00AE, 0x00A9,
+    0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8, 0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8, 0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248,
+    0x2206, 0x00AB, 0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153, 0x2013, 0x2014, 0x201C, 0x201D,
+    0x2018, 0x2019, 0x00F7, 0x25CA, 0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02, 0x2021, 0x00B7,
+    0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1, 0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC, 0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD,
+    0x02DB, 0x02C7};
+
+static bool decode_sfnt_name(const FT_SfntName &n, std::string &out)
+{
+    out.clear();
+    if (n.platform_id == TT_PLATFORM_APPLE_UNICODE || n.platform_id == TT_PLATFORM_MICROSOFT)
+    {
+        // UTF-16BE（含代理对）
+        for (FT_UInt i = 0; i + 1 < n.string_len; i += 2)
+        {
+            uint32_t c = ((uint32_t)n.string[i] << 8) | n.string[i + 1];
+            if (c >= 0xD800 && c < 0xDC00 && i + 3 < n.string_len)
+            {
+                uint32_t lo = ((uint32_t)n.string[i + 2] << 8) | n.string[i + 3];
+                if (lo >= 0xDC00 && lo < 0xE000)
+                {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+                    i += 2;
+                }
+            }
+            append_utf8(out, c);
+        }
+        return true;
+    }
+    if (n.platform_id == TT_PLATFORM_MACINTOSH && n.encoding_id == TT_MAC_ID_ROMAN)
+    {
+        for (FT_UInt i = 0; i < n.string_len; ++i)
+            append_utf8(out, n.string[i] < 0x80 ? n.string[i] : MAC_ROMAN_HIGH[n.string[i] - 0x80]);
+        return true;
+    }
+    return false; // 其他 Mac 编码（GB2312/Big5 等）不解码
+}
+
+// 优先级：含中文（文本含 CJK 或 Windows 中文 langID）> Windows 平台 > Unicode 平台 > 其他，同级取表中靠前者
+static std::string pick_name(FT_Face face, std::initializer_list<FT_UShort> name_ids)
+{
+    struct Candidate
+    {
+        bool chinese;
+        int plat_prio;
+        int platform;
+        std::string text;
+    };
+    std::vector<Candidate> cands;
+    FT_UInt count = FT_Get_Sfnt_Name_Count(face);
+    for (FT_UInt i = 0; i < count; ++i)
+    {
+        FT_SfntName n;
+        if (FT_Get_Sfnt_Name(face, i, &n) != 0)
+            continue;
+        if (std::find(name_ids.begin(), name_ids.end(), n.name_id) == name_ids.end())
+            continue;
+        Candidate c;
+        if (!decode_sfnt_name(n, c.text))
+            continue;
+        bool cjk = false;
+        utf8_for_each(c.text, [&](uint32_t cp) { cjk = cjk || (cp >= 0x4E00 && cp <= 0x9FFF); });
+        c.chinese = cjk || n.language_id == 0x0804 || n.language_id == 0x0404 || n.language_id == 0x0C04;
+        c.plat_prio = n.platform_id == TT_PLATFORM_MICROSOFT ? 2 : n.platform_id == TT_PLATFORM_APPLE_UNICODE ? 1 : 0;
+        c.platform = n.platform_id;
+        cands.push_back(std::move(c));
+    }
+    if (cands.empty())
+        return std::string();
+    std::stable_sort(cands.begin(), cands.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.chinese != b.chinese)
+            return a.chinese;
+        if (a.plat_prio != b.plat_prio)
+            return a.plat_prio > b.plat_prio;
+        return a.platform < b.platform;
+    });
+    return cands.front().text;
+}
+
+// UTF-8 安全截断
+static std::string utf8_truncate(const std::string &s, size_t max_bytes)
+{
+    if (s.size() <= max_bytes)
+        return s;
+    size_t cut = max_bytes;
+    while (cut > 0 && ((unsigned char)s[cut] & 0xC0) == 0x80)
+        --cut;
+    return s.substr(0, cut);
+}
+
+// ========== 参数 ==========
+
+static bool parse_int(const char *s, int &out)
+{
+    char *end = nullptr;
+    long v = strtol(s, &end, 10);
+    if (!end || *end)
+        return false;
+    out = (int)v;
+    return true;
+}
+
+static bool parse_args(int argc, char **argv, Options &opt)
+{
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        auto need = [&](const char *name) -> const char * {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "❌ %s 需要参数\n", name);
+                return nullptr;
+            }
+            return argv[++i];
+        };
+        const char *v = nullptr;
+        int iv = 0;
+        if (a == "--size" || a == "--white" || a == "--v3-gray" || a == "--v3-black" || a == "-j")
+        {
+            if (!(v = need(a.c_str())) || !parse_int(v, iv))
+                return false;
+            if (a == "--size")
+                opt.raster.size = iv;
+            else if (a == "--white")
+                opt.raster.white = iv;
+            else if (a == "--v3-gray")
+                opt.raster.v3_gray = iv;
+            else if (a == "--v3-black")
+                opt.raster.v3_black = iv;
+            else
+                opt.threads = (unsigned)std::max(1, iv);
+        }
+        else if (a == "--format")
+        {
+            if (!(v = need("--format")))
+                return false;
+            if (!strcmp(v, "v2") || !strcmp(v, "2"))
+                opt.raster.format = GlyphFormat::V2_1BIT;
+            else if (!strcmp(v, "v3") || !strcmp(v, "3"))
+                opt.raster.format = GlyphFormat::V3_HUFFMAN;
+            else
+                return false;
+        }
+        else if (a == "--layout")
+        {
+            if (!(v = need("--layout")))
+                return false;
+            if (!strcmp(v, "codepoint"))
+                opt.layout = BitmapLayout::Codepoint;
+            else if (!strcmp(v, "frequency"))
+                opt.layout = BitmapLayout::Frequency;
+            else
+                return false;
+        }
+        else if (a == "--charset")
+        {
+            if (!(v = need("--charset")))
+                return false;
+            opt.charset_json = v;
+        }
+        else if (a == "--chars")
+        {
+            if (!(v = need("--chars")))
+                return false;
+            opt.chars_text.push_back(v);
+        }
+        else if (a == "--freq")
+        {
+            if (!(v = need("--freq")))
+                return false;
+            opt.freq_files.push_back(v);
+        }
+        else if (a == "--no-smooth" || a == "--fast")
+            opt.raster.smoothing = false;
+        else if (a == "--ascii-only")
+            opt.ascii_only = true;
+        else if (a == "--keep-placeholder")
+            opt.raster.keep_placeholder = true;
+        else if (a == "--verify")
+            opt.verify = true;
+        else if (a == "-h" || a == "--help")
+            return false;
+        else if (!a.empty() && a[0] == '-')
+        {
+            fprintf(stderr, "❌ 未知选项: %s\n", a.c_str());
+            return false;
+        }
+        else
+            positional.push_back(a);
+    }
+    if (positional.size() != 2)
+        return false;
+    opt.font = positional[0];
+    opt.out = positional[1];
+    return true;
+}
+
+// ========== 主流程 ==========
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt))
+    {
+        usage();
+        return 1;
+    }
+    RasterOptions &ro = opt.raster;
+    // 范围与固件 detect_font_format 一致
+    bool v2 = ro.format == GlyphFormat::V2_1BIT;
+    if (v2 ? (ro.size < 20 || ro.size > 50) : (ro.size < 8 || ro.size > 200))
+    {
+        fprintf(stderr, "❌ 字体大小超出设备支持范围（V2: 20-50, V3: 8-200）\n");
+        return 1;
+    }
+    if (ro.white < 0 || ro.white > 255 || ro.v3_gray < 1 || ro.v3_black < ro.v3_gray || ro.v3_black > 255)
+    {
+        fprintf(stderr, "❌ 阈值无效\n");
+        return 1;
+    }
+    if (opt.layout == BitmapLayout::Frequency && opt.freq_files.empty())
+    {
+        fprintf(stderr, "❌ --layout frequency 需要至少一个 --freq 语料文件\n");
+        return 1;
+    }
+    if (opt.threads == 0)
+        opt.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // 字符集：ASCII 可打印 + 特殊字符，再并上字符集文件与文本
+    std::vector<uint32_t> cps;
+    for (uint32_t c = 0x20; c < 0x7F; ++c)
+        cps.push_back(c);
+    cps.push_back(0x2022);
+    cps.push_back(0x25A1);
+    cps.push_back(0xFEFF);
+    if (!opt.ascii_only && !opt.charset_json.empty() && !load_charset_json(opt.charset_json, cps))
+    {
+        fprintf(stderr, "❌ 无法读取字符集: %s（可用 --charset 指定，或 --ascii-only）\n", opt.charset_json.c_str());
+        return 1;
+    }
+    for (const std::string &path : opt.chars_text)
+    {
+        std::string text;
+        if (!read_file(path, text))
+        {
+            fprintf(stderr, "❌ 无法读取: %s\n", path.c_str());
+            return 1;
+        }
+        utf8_for_each(text, [&](uint32_t c) { cps.push_back(c); });
+    }
+    // 设备字符表只有 16 位码点
+    cps.erase(std::remove_if(cps.begin(), cps.end(), [](uint32_t c) { return c > 0xFFFF; }), cps.end());
+    std::sort(cps.begin(), cps.end());
+    cps.erase(std::unique(cps.begin(), cps.end()), cps.end());
+
+    // 每个线程一个 FreeType 实例
+    std::vector<std::unique_ptr<GlyphRasterizer>> rasterizers(opt.threads);
+    for (auto &r : rasterizers)
+    {
+        r.reset(new GlyphRasterizer());
+        std::string err;
+        if (!r->open(opt.font, ro, err))
+        {
+            fprintf(stderr, "❌ 无法加载字体文件: %s\n", err.c_str());
+            return 1;
+        }
+    }
+    FT_Face face0 = rasterizers[0]->face();
+    std::string family = pick_name(face0, {16, 1});
+    std::string style = pick_name(face0, {17, 2});
+    if (family.empty())
+        family = face0->family_name ? face0->family_name : "Unknown";
+    if (style.empty())
+        style = face0->style_name ? face0->style_name : "Regular";
+
+    printf("🚀 fontc: %s -> %s\n", opt.font.c_str(), opt.out.c_str());
+    printf("📐 %dpx, V%d, %s, %u 线程, 字符集 %zu 个\n", ro.size, (int)ro.format,
+           v2 ? (ro.smoothing ? "边缘平滑" : "无平滑") : "2bit 灰度", opt.threads, cps.size());
+    printf("🔤 字体族名: %s / 样式: %s\n", family.c_str(), style.c_str());
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<GlyphRecord> rendered(cps.size());
+    WorkStealingPool pool(opt.threads);
+    pool.parallelFor(cps.size(), GLYPHS_PER_TASK, [&](unsigned worker, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            rendered[i] = rasterizers[worker]->render(cps[i], opt.verify);
+    });
+    double raster_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // 按码点合并：控制字符 0x00-0x1F 为空条目，其余取已渲染的字形
+    std::map<uint32_t, GlyphRecord> by_cp;
+    size_t missing = 0;
+    for (GlyphRecord &g : rendered)
+    {
+        if (!g.present)
+        {
+            ++missing;
+            continue;
+        }
+        if (g.codepoint >= 0x20)
+            by_cp[g.codepoint] = std::move(g);
+    }
+    // 字体名中的字符也要在表里，否则设备上显示为方框（缺字仍跳过）
+    for (const std::string *name : {&family, &style})
+    {
+        utf8_for_each(*name, [&](uint32_t c) {
+            if (c < 0x20 || c > 0xFFFF || by_cp.count(c))
+                return;
+            GlyphRecord g = rasterizers[0]->render(c, opt.verify);
+            if (g.present)
+                by_cp[c] = std::move(g);
+        });
+    }
+    // 字符表首条恒为 U+0000 的空条目：字频布局的热区长度只写在这一条的保留字段里，
+    // 固件也只在首条且码点为 0 时读取（不论字符集从哪里开始）
+    std::vector<GlyphRecord> glyphs;
+    glyphs.reserve(0x20 + by_cp.size());
+    for (uint32_t c = 0; c < 0x20; ++c)
+    {
+        GlyphRecord g;
+        g.present = true;
+        g.codepoint = c;
+        glyphs.push_back(g);
+    }
+    for (auto &kv : by_cp)
+        glyphs.push_back(std::move(kv.second));
+    if (glyphs.front().codepoint != 0 || !glyphs.front().bitmap.empty())
+    {
+        fprintf(stderr, "❌ 内部错误：字符表首条不是 U+0000 空条目\n");
+        return 1;
+    }
+
+    // 位图排列顺序：字符表始终按码点升序（find_char 二分查找），位图区可以任意排列
+    std::vector<size_t> order(glyphs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    uint32_t hot_bytes = 0; // 语料中出现过的字形位图总长（排在位图区最前）
+    if (opt.layout == BitmapLayout::Frequency)
+    {
+        std::vector<uint64_t> freq(0x10000, 0);
+        for (const std::string &path : opt.freq_files)
+        {
+            std::string text;
+            if (!read_file(path, text))
+            {
+                fprintf(stderr, "❌ 无法读取语料: %s\n", path.c_str());
+                return 1;
+            }
+            utf8_for_each(text, [&](uint32_t c) {
+                if (c <= 0xFFFF)
+                    freq[c]++;
+            });
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return freq[glyphs[a].codepoint] > freq[glyphs[b].codepoint];
+        });
+        for (const GlyphRecord &g : glyphs)
+            if (freq[g.codepoint] > 0)
+                hot_bytes += (uint32_t)g.bitmap.size();
+    }
+    std::vector<uint32_t> offsets(glyphs.size(), 0);
+    uint32_t cursor = (uint32_t)(FONT_HEADER_SIZE + glyphs.size() * CHAR_RECORD_SIZE);
+    for (size_t idx : order)
+    {
+        offsets[idx] = cursor;
+        cursor += (uint32_t)glyphs[idx].bitmap.size();
+    }
+
+    // 写文件
+    std::vector<uint8_t> header(FONT_HEADER_SIZE, 0);
+    uint32_t count = (uint32_t)glyphs.size();
+    memcpy(header.data(), &count, 4);
+    header[4] = (uint8_t)ro.size;
+    header[5] = (uint8_t)ro.format;
+    std::string fam = utf8_truncate(family, 63), sty = utf8_truncate(style, 63);
+    memcpy(header.data() + 6, fam.data(), fam.size());
+    memcpy(header.data() + 70, sty.data(), sty.size());
+    // 样式名最多 63 字节，第 133 字节恒为 NUL：字频布局在此置标志，旧固件读到的样式名不变
+    if (opt.layout == BitmapLayout::Frequency)
+        header[133] = FONT_LAYOUT_FLAG_FREQUENCY;
+
+    std::vector<uint8_t> table(glyphs.size() * CHAR_RECORD_SIZE, 0);
+    size_t bitmap_bytes = 0;
+    for (size_t i = 0; i < glyphs.size(); ++i)
+    {
+        const GlyphRecord &g = glyphs[i];
+        uint8_t *rec = table.data() + i * CHAR_RECORD_SIZE;
+        uint16_t cp = (uint16_t)g.codepoint;
+        uint32_t size = (uint32_t)g.bitmap.size();
+        memcpy(rec, &cp, 2);
+        memcpy(rec + 2, &g.advance, 2);
+        rec[4] = g.bw;
+        rec[5] = g.bh;
+        rec[6] = (uint8_t)g.x_offset;
+        rec[7] = (uint8_t)g.y_offset;
+        memcpy(rec + 8, &offsets[i], 4);
+        memcpy(rec + 12, &size, 4);
+        // U+0000 条目的保留字段（固件原本忽略）：字频布局下记录热区字节数，供固件常驻 PSRAM
+        if (cp == 0 && i == 0 && opt.layout == BitmapLayout::Frequency)
+            memcpy(rec + 16, &hot_bytes, 4);
+        bitmap_bytes += size;
+    }
+
+    FILE *f = fopen(opt.out.c_str(), "wb");
+    if (!f)
+    {
+        fprintf(stderr, "❌ 无法写入: %s\n", opt.out.c_str());
+        return 1;
+    }
+    bool ok = fwrite(header.data(), 1, header.size(), f) == header.size() &&
+              fwrite(table.data(), 1, table.size(), f) == table.size();
+    for (size_t k = 0; ok && k < order.size(); ++k)
+    {
+        const std::vector<uint8_t> &bmp = glyphs[order[k]].bitmap;
+        ok = bmp.empty() || fwrite(bmp.data(), 1, bmp.size(), f) == bmp.size();
+    }
+    ok = (fclose(f) == 0) && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "❌ 写入失败: %s\n", opt.out.c_str());
+        return 1;
+    }
+
+    double total_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    size_t total = FONT_HEADER_SIZE + table.size() + bitmap_bytes;
+    printf("\n📊 文件统计:\n");
+    printf("  Header: %zu bytes\n", FONT_HEADER_SIZE);
+    printf("  字符表: %zu bytes (%zu 个字符, 缺字跳过 %zu)\n", table.size(), glyphs.size(), missing);
+    printf("  位图数据: %zu bytes%s\n", bitmap_bytes, opt.layout == BitmapLayout::Frequency ? "（按字频排列）" : "");
+    if (opt.layout == BitmapLayout::Frequency)
+        printf("  热区: %u bytes（语料中出现的字形，固件流式加载时常驻 PSRAM）\n", hot_bytes);
+    printf("  总计: %zu bytes\n", total);
+    printf("⏱️ 栅格化 %.2fs，总计 %.2fs\n", raster_s, total_s);
+
+    if (opt.verify)
+    {
+        std::string err;
+        uint8_t layout_flags = opt.layout == BitmapLayout::Frequency ? FONT_LAYOUT_FLAG_FREQUENCY : 0;
+        if (!verify_font_file(opt.out, glyphs, ro.format, ro.size, layout_flags, hot_bytes, err))
+        {
+            fprintf(stderr, "❌ 往返校验失败: %s\n", err.c_str());
+            return 2;
+        }
+        printf("✅ 往返校验通过：%zu 个字形经 FontDecoder 解码与编码前一致\n", glyphs.size());
+    }
+    return 0;
+}
@@ -0,0 +1,2 @@
+#pragma once
+// 主机端替身：font_decoder.h 只需要该头文件存在
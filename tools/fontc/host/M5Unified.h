@@ -0,0 +1,17 @@
+#pragma once
+// 主机端最小替身：只提供 font_decoder.cpp / font_color_mapper.cpp / glyph_blit_canvas.cpp / readpaper.h 用到的部分
+#include <cstdint>
+
+#define TFT_LIGHTGREY 0xD69A
+
+class M5Canvas
+{
+public:
+    int32_t width() const { return 0; }
+    int32_t height() const { return 0; }
+    void drawPixel(int32_t, int32_t, uint16_t) {}
+    // 无缓冲区：glyph_blit_canvas 返回 false
+    void *getBuffer() const { return nullptr; }
+    uint32_t bufferLength() const { return 0; }
+    uint16_t getColorDepth() const { return 16; }
+};
@@ -0,0 +1,2 @@
+#pragma once
+// 主机端替身：device/memory_pool.h 只用到 TaskHandle_t
@@ -0,0 +1,302 @@
+#include "rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// ========== V2：与 generate_1bit_font_bin.py 一致的平滑与打包 ==========
+
+// detect_edges_precise(threshold=100)：3x3 邻域方差大于阈值的内部像素
+// 方差用整数精确计算（81*var = 9*Σx² - (Σx)²），避免浮点累加顺序带来的差异
+static std::vector<uint8_t> detect_edges(const std::vector<uint8_t> &img, int w, int h, int threshold)
+{
+    std::vector<uint8_t> edges(img.size(), 0);
+    if (w < 3 || h < 3)
+        return edges;
+    for (int y = 1; y < h - 1; ++y)
+    {
+        for (int x = 1; x < w - 1; ++x)
+        {
+            int64_t sum = 0, sq = 0;
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    int v = img[(y + dy) * w + (x + dx)];
+                    sum += v;
+                    sq += v * v;
+                }
+            if (9 * sq - sum * sum > (int64_t)threshold * 81)
+                edges[y * w + x] = 1;
+        }
+    }
+    return edges;
+}
+
+// apply_selective_smoothing(sigma=0.4)：按行优先顺序原地处理边缘像素，
+// 后处理的像素会看到前面已修改的邻居（与 Python 版相同）；混合运算保持 float32
+static std::vector<uint8_t> smooth_edges(const std::vector<uint8_t> &img, const std::vector<uint8_t> &edges, int w, int h)
+{
+    if (w < 3 || h < 3)
+        return img;
+    std::vector<float> result(img.begin(), img.end());
+    for (int y = 1; y < h - 1; ++y)
+    {
+        for (int x = 1; x < w - 1; ++x)
+        {
+            if (!edges[y * w + x])
+                continue;
+            float center = result[y * w + x];
+            float nb[9];
+            int k = 0;
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx)
+                    nb[k++] = result[(y + dy) * w + (x + dx)];
+            std::nth_element(nb, nb + 4, nb + 9);
+            float median = nb[4];
+            if (std::fabs(center - median) > 50.0f)
+            {
+                volatile float a = center * 0.7f; // 逐步舍入到 float32，与 NumPy 相同
+                volatile float b = median * 0.3f;
+                result[y * w + x] = a + b;
+            }
+        }
+    }
+    std::vector<uint8_t> out(img.size());
+    for (size_t i = 0; i < out.size(); ++i)
+        out[i] = (uint8_t)(int)result[i];
+    return out;
+}
+
+// pack_1bit_bitmap：值低于阈值记 1（解码为白），每行补齐到字节
+static std::vector<uint8_t> pack_1bit(const std::vector<uint8_t> &img, int w, int h, int threshold, bool smoothing,
+                                      std::vector<uint8_t> *pixels)
+{
+    if (img.empty())
+        return {};
+    const std::vector<uint8_t> *src = &img;
+    std::vector<uint8_t> edges, processed;
+    bool any_edge = false;
+    if (smoothing)
+    {
+        edges = detect_edges(img, w, h, 100);
+        any_edge = std::find(edges.begin(), edges.end(), 1) != edges.end();
+        if (any_edge)
+        {
+            processed = smooth_edges(img, edges, w, h);
+            src = &processed;
+        }
+    }
+    const double edge_threshold = threshold * 0.95;
+
+    int bytes_per_row = (w + 7) / 8;
+    std::vector<uint8_t> out((size_t)bytes_per_row * h, 0);
+    if (pixels)
+        pixels->assign((size_t)w * h, PX_BLACK);
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            int v = (*src)[y * w + x];
+            bool bit = any_edge && edges[y * w + x] ? (v < edge_threshold) : (v < threshold);
+            if (bit)
+            {
+                out[y * bytes_per_row + x / 8] |= (uint8_t)(1u << (7 - (x % 8)));
+                if (pixels)
+                    (*pixels)[y * w + x] = PX_WHITE;
+            }
+        }
+    }
+    return out;
+}
+
+// ========== V3：2bit Huffman ==========
+
+static std::vector<uint8_t> pack_v3(const std::vector<uint8_t> &img, int gray, int black, std::vector<uint8_t> *pixels)
+{
+    std::vector<uint8_t> out;
+    uint8_t cur = 0;
+    int bit = 7;
+    auto put = [&](int b) {
+        if (b)
+            cur |= (uint8_t)(1u << bit);
+        if (--bit < 0)
+        {
+            out.push_back(cur);
+            cur = 0;
+            bit = 7;
+        }
+    };
+    if (pixels)
+        pixels->resize(img.size());
+    for (size_t i = 0; i < img.size(); ++i)
+    {
+        uint8_t px;
+        if (img[i] >= black)
+        {
+            put(1);
+            put(1);
+            px = PX_BLACK;
+        }
+        else if (img[i] >= gray)
+        {
+            put(1);
+            put(0);
+            px = PX_GRAY;
+        }
+        else
+        {
+            put(0);
+            px = PX_WHITE;
+        }
+        if (pixels)
+            (*pixels)[i] = px;
+    }
+    if (bit != 7)
+        out.push_back(cur);
+    return out;
+}
+
+static int8_t clip_int8(long v)
+{
+    return (int8_t)std::max(-128L, std::min(127L, v));
+}
+
+// ========== GlyphRasterizer ==========
+
+GlyphRasterizer::~GlyphRasterizer()
+{
+    if (face_)
+        FT_Done_Face(face_);
+    if (lib_)
+        FT_Done_FreeType(lib_);
+}
+
+bool GlyphRasterizer::open(const std::string &font_path, const RasterOptions &opt, std::string &err)
+{
+    opt_ = opt;
+    if (FT_Init_FreeType(&lib_) != 0)
+    {
+        err = "FT_Init_FreeType failed";
+        return false;
+    }
+    if (FT_New_Face(lib_, font_path.c_str(), 0, &face_) != 0)
+    {
+        err = "cannot open font: " + font_path;
+        return false;
+    }
+    if (FT_Set_Pixel_Sizes(face_, 0, (FT_UInt)opt.size) != 0)
+    {
+        err = "FT_Set_Pixel_Sizes failed";
+        return false;
+    }
+    ascender_ = (int)(face_->size->metrics.ascender >> 6);
+    return true;
+}
+
+GlyphRecord GlyphRasterizer::encode(uint32_t codepoint, const uint8_t *cov, int pitch, int w, int h,
+                                    long advance, long bearing_x, int bitmap_top, bool keep_pixels) const
+{
+    GlyphRecord g;
+    g.present = true;
+    g.codepoint = codepoint;
+    g.advance = (uint16_t)(advance & 0xFFFF);
+    g.x_offset = clip_int8(bearing_x);
+    g.y_offset = clip_int8(ascender_ - bitmap_top);
+    if (!cov || w <= 0 || h <= 0)
+        return g;
+
+    // 裁剪到有内容的行列：V2 沿用 Python 的判定（值 < 255 - white），V3 取覆盖率 >= 灰阈值
+    auto has_content = [&](uint8_t v) {
+        return opt_.format == GlyphFormat::V2_1BIT ? v < 255 - opt_.white : v >= opt_.v3_gray;
+    };
+    int min_x = w, max_x = -1, min_y = h, max_y = -1;
+    for (int y = 0; y < h; ++y)
+    {
+        const uint8_t *row = cov + (ptrdiff_t)y * pitch;
+        for (int x = 0; x < w; ++x)
+        {
+            if (!has_content(row[x]))
+                continue;
+            min_x = std::min(min_x, x);
+            max_x = std::max(max_x, x);
+            min_y = std::min(min_y, y);
+            max_y = std::max(max_y, y);
+        }
+    }
+    if (max_x < 0)
+        return g;
+
+    int cw = max_x - min_x + 1;
+    int ch = max_y - min_y + 1;
+    std::vector<uint8_t> cropped((size_t)cw * ch);
+    for (int y = 0; y < ch; ++y)
+        std::copy(cov + (ptrdiff_t)(y + min_y) * pitch + min_x, cov + (ptrdiff_t)(y + min_y) * pitch + min_x + cw,
+                  cropped.begin() + (size_t)y * cw);
+
+    std::vector<uint8_t> *pixels = keep_pixels ? &g.pixels : nullptr;
+    if (opt_.format == GlyphFormat::V2_1BIT)
+        g.bitmap = pack_1bit(cropped, cw, ch, opt_.white, opt_.smoothing, pixels);
+    else
+        g.bitmap = pack_v3(cropped, opt_.v3_gray, opt_.v3_black, pixels);
+    g.bw = (uint8_t)(cw & 0xFF);
+    g.bh = (uint8_t)(ch & 0xFF);
+    g.x_offset = clip_int8(bearing_x + min_x);
+    g.y_offset = clip_int8(ascender_ - bitmap_top + min_y);
+    return g;
+}
+
+GlyphRecord GlyphRasterizer::render(uint32_t codepoint, bool keep_pixels)
+{
+    GlyphRecord g;
+    g.codepoint = codepoint;
+
+    // 控制字符与 BOM：保留空条目
+    if (codepoint < 0x20 || codepoint == 0xFEFF)
+    {
+        g.present = true;
+        return g;
+    }
+
+    FT_ULong load_cp = codepoint;
+    if (FT_Get_Char_Index(face_, codepoint) == 0)
+    {
+        if (!opt_.keep_placeholder)
+            return g;
+        if (FT_Get_Char_Index(face_, 0x25A1) == 0)
+        {
+            // 字体连 □ 都没有：生成方框（取值方式与 Python 版相同）
+            int n = opt_.size;
+            int border = std::max(1, n / 12);
+            std::vector<uint8_t> box((size_t)n * n, 255);
+            for (int y = 0; y < n; ++y)
+                for (int x = 0; x < n; ++x)
+                    if (y < border || y >= n - border || x < border || x >= n - border)
+                        box[(size_t)y * n + x] = 0;
+            g.present = true;
+            g.bw = (uint8_t)n;
+            g.bh = (uint8_t)n;
+            g.advance = (uint16_t)(int)(n * 0.6);
+            g.y_offset = clip_int8(ascender_ - n / 2);
+            std::vector<uint8_t> *pixels = keep_pixels ? &g.pixels : nullptr;
+            if (opt_.format == GlyphFormat::V2_1BIT)
+                g.bitmap = pack_1bit(box, n, n, opt_.white, false, pixels);
+            else
+                g.bitmap = pack_v3(box, opt_.v3_gray, opt_.v3_black, pixels);
+            return g;
+        }
+        load_cp = 0x25A1;
+    }
+
+    if (FT_Load_Char(face_, load_cp, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL) != 0)
+        return g;
+
+    FT_GlyphSlot slot = face_->glyph;
+    const FT_Bitmap &bm = slot->bitmap;
+    const FT_Glyph_Metrics &m = slot->metrics;
+    long advance = m.horiAdvance >> 6;
+    long bearing_x = m.horiBearingX >> 6;
+    if (!bm.buffer || bm.width == 0 || bm.rows == 0)
+        return encode(codepoint, nullptr, 0, 0, 0, advance, bearing_x, slot->bitmap_top, keep_pixels);
+    return encode(codepoint, bm.buffer, bm.pitch, (int)bm.width, (int)bm.rows, advance, bearing_x, slot->bitmap_top,
+                  keep_pixels);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// 输出格式（与 detect_font_format 的 version 字节一致）
+enum class GlyphFormat : uint8_t
+{
+    V2_1BIT = 2,    // 1bit 打包，每行补齐到字节（1=白, 0=黑）
+    V3_HUFFMAN = 3, // 2bit Huffman：0=白, 10=灰, 11=黑
+};
+
+// 头部第 133 字节的布局标志（与 src/text/bin_font_print.h 的定义一致）
+#define FONT_LAYOUT_FLAG_FREQUENCY 0x01
+
+struct RasterOptions
+{
+    int size = 32;                 // 像素高度
+    int white = 80;                // V2 白色阈值（与 generate_1bit_font_bin.py --white 相同）
+    bool smoothing = true;         // V2 边缘平滑（与 Python 版算法一致）
+    bool keep_placeholder = false; // 缺字时用 U+25A1 或方框代替，否则跳过
+    GlyphFormat format = GlyphFormat::V2_1BIT;
+    int v3_gray = 48;              // V3：覆盖率 >= gray 为灰
+    int v3_black = 144;            // V3：覆盖率 >= black 为黑
+};
+
+// 解码后的像素类别（用于往返校验）
+enum : uint8_t
+{
+    PX_WHITE = 0,
+    PX_BLACK = 1,
+    PX_GRAY = 2,
+};
+
+struct GlyphRecord
+{
+    bool present = false; // 字体中没有该字且未要求占位时为 false
+    uint32_t codepoint = 0;
+    uint16_t advance = 0;
+    uint8_t bw = 0;
+    uint8_t bh = 0;
+    int8_t x_offset = 0;
+    int8_t y_offset = 0;
+    std::vector<uint8_t> bitmap; // 已编码的位图字节
+    std::vector<uint8_t> pixels; // bw*bh 个 PX_* 值（仅 --verify 时保留）
+};
+
+// 每个线程一个实例：FreeType 的 FT_Face 不可跨线程共享
+class GlyphRasterizer
+{
+public:
+    GlyphRasterizer() = default;
+    ~GlyphRasterizer();
+    GlyphRasterizer(const GlyphRasterizer &) = delete;
+    GlyphRasterizer &operator=(const GlyphRasterizer &) = delete;
+
+    bool open(const std::string &font_path, const RasterOptions &opt, std::string &err);
+
+    // 与 generate_1bit_font_bin.py 的 process_char 等价（V2 使用相同的裁剪/平滑/阈值规则）
+    GlyphRecord render(uint32_t codepoint, bool keep_pixels);
+
+    FT_Face face() const { return face_; }
+    int ascender() const { return ascender_; }
+
+private:
+    GlyphRecord encode(uint32_t codepoint, const uint8_t *cov, int pitch, int w, int h,
+                       long advance, long bearing_x, int bitmap_top, bool keep_pixels) const;
+
+    FT_Library lib_ = nullptr;
+    FT_Face face_ = nullptr;
+    RasterOptions opt_;
+    int ascender_ = 0;
+};
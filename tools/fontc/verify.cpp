@@ -0,0 +1,200 @@
+#include "verify.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <M5Unified.h>
+#include "text/font_decoder.h"
+#include "text/font_color_mapper.h"
+
+// font_decoder.cpp 的 draw_bitmap_transparent 引用该画布；校验只用解码函数
+M5Canvas *g_canvas = nullptr;
+
+static const size_t FONT_HEADER_SIZE = 134;
+static const size_t CHAR_RECORD_SIZE = 20;
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static bool fail(std::string &err, const char *fmt, unsigned a = 0, unsigned b = 0, unsigned c = 0)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), fmt, a, b, c);
+    err = buf;
+    return false;
+}
+
+// 旧版 V2 霍夫曼格式（0 / 10 / 11xxxx）fontc 不再生成：用确定性的合成码流比对逐位解码与查表解码
+static bool check_legacy_huffman(std::string &err)
+{
+    uint32_t seed = 2024;
+    for (int round = 0; round < 64; ++round)
+    {
+        int w = 1 + round % 37, h = 1 + round % 23;
+        std::vector<uint8_t> levels((size_t)w * h), raw;
+        uint32_t acc = 0;
+        int nbits = 0;
+        auto put = [&](uint32_t bits, int len) {
+            acc = (acc << len) | bits;
+            nbits += len;
+            while (nbits >= 8)
+            {
+                raw.push_back((uint8_t)(acc >> (nbits - 8)));
+                nbits -= 8;
+            }
+        };
+        for (auto &lv : levels)
+        {
+            seed = seed * 1103515245u + 12345u;
+            uint32_t r = (seed >> 16) % 16;
+            lv = r < 8 ? 0 : r < 11 ? 15 : (uint8_t)(r - 1);
+            if (lv == 0)
+                put(0, 1);
+            else if (lv == 15)
+                put(2, 2);
+            else
+                put(0x30 | lv, 6);
+        }
+        if (nbits > 0)
+            raw.push_back((uint8_t)(acc << (8 - nbits)));
+
+        std::vector<uint16_t> rgb((size_t)w * h);
+        std::vector<uint8_t> cov(FontDecoder::coverage4_size(w, h));
+        FontDecoder::decode_bitmap(raw.data(), raw.size(), rgb.data(), w, h);
+        FontDecoder::decode_coverage4(FontDecoder::CODEC_V2_HUFFMAN, raw.data(), raw.size(), cov.data(), w, h);
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+            {
+                uint8_t b = cov[(size_t)y * ((w + 1) / 2) + x / 2];
+                uint8_t lv = (x & 1) ? (b & 0x0F) : (b >> 4);
+                uint8_t g = (15 - lv) * 17;
+                uint16_t expect = (g >> 3) << 11 | (g >> 2) << 5 | (g >> 3);
+                if (lv != levels[(size_t)y * w + x] || rgb[(size_t)y * w + x] != expect)
+                    return fail(err, "legacy huffman coverage mismatch (round %u, pixel %u, level %u)", round,
+                                y * w + x, lv);
+            }
+    }
+    return true;
+}
+
+bool verify_font_file(const std::string &path, const std::vector<GlyphRecord> &glyphs, GlyphFormat format,
+                      int font_size, uint8_t layout_flags, uint32_t hot_bytes, std::string &err)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        err = "cannot reopen " + path;
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    if (data.size() < FONT_HEADER_SIZE)
+        return fail(err, "file shorter than header (%u bytes)", (unsigned)data.size());
+    uint32_t count = rd32(data.data());
+    if (count != glyphs.size())
+        return fail(err, "char_count %u, expected %u", count, (unsigned)glyphs.size());
+    if (data[4] != font_size || data[5] != (uint8_t)format)
+        return fail(err, "header size/version %u/%u mismatch", data[4], data[5]);
+    size_t table_end = FONT_HEADER_SIZE + (size_t)count * CHAR_RECORD_SIZE;
+    if (table_end > data.size())
+        return fail(err, "char table truncated");
+    if (data[FONT_HEADER_SIZE - 1] != layout_flags)
+        return fail(err, "layout flags 0x%02X, expected 0x%02X", data[FONT_HEADER_SIZE - 1], layout_flags);
+    if (layout_flags & FONT_LAYOUT_FLAG_FREQUENCY)
+    {
+        // 固件只从 U+0000 条目读取热区长度，且热区必须落在位图区内
+        const uint8_t *rec0 = data.data() + FONT_HEADER_SIZE;
+        uint32_t hot = count > 0 ? rd32(rec0 + 16) : 0;
+        if (count == 0 || rd16(rec0) != 0)
+            return fail(err, "frequency layout requires U+0000 as the first record");
+        if (hot != hot_bytes || table_end + (uint64_t)hot > data.size())
+            return fail(err, "hot prefix %u bytes, expected %u (bitmap area %u)", hot, hot_bytes,
+                        (unsigned)(data.size() - table_end));
+    }
+
+    // V3 解码输出的颜色由固件的颜色映射决定（浅色模式、不透明）
+    uint16_t expect_color[3];
+    if (format == GlyphFormat::V2_1BIT)
+    {
+        expect_color[PX_WHITE] = 0xFFFF;
+        expect_color[PX_BLACK] = 0x0000;
+        expect_color[PX_GRAY] = 0xFFFF; // V2 无灰
+    }
+    else
+    {
+        expect_color[PX_WHITE] = FontColorMapper::map_v3_color(FontColorMapper::PIXEL_WHITE, false, false);
+        expect_color[PX_BLACK] = FontColorMapper::map_v3_color(FontColorMapper::PIXEL_BLACK, false, false);
+        expect_color[PX_GRAY] = FontColorMapper::map_v3_color(FontColorMapper::PIXEL_GRAY, false, false);
+    }
+
+    if (!check_legacy_huffman(err))
+        return false;
+
+    // 覆盖度解码（固件无缩放绘制路径）应得到的深度
+    const uint8_t expect_level[3] = {0, 15, FontDecoder::COVERAGE_V3_GRAY};
+    const FontDecoder::CoverageCodec codec =
+        format == GlyphFormat::V2_1BIT ? FontDecoder::CODEC_V2_1BIT : FontDecoder::CODEC_V3;
+
+    std::vector<uint16_t> decoded;
+    std::vector<uint8_t> coverage;
+    uint32_t prev_cp = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t *rec = data.data() + FONT_HEADER_SIZE + (size_t)i * CHAR_RECORD_SIZE;
+        const GlyphRecord &g = glyphs[i];
+        uint16_t cp = rd16(rec);
+        uint16_t width = rd16(rec + 2);
+        uint8_t bw = rec[4], bh = rec[5];
+        int8_t xo = (int8_t)rec[6], yo = (int8_t)rec[7];
+        uint32_t off = rd32(rec + 8);
+        uint32_t size = rd32(rec + 12);
+
+        // find_char 依赖字符表按码点严格升序
+        if (i > 0 && cp <= prev_cp)
+            return fail(err, "char table not sorted at #%u (U+%04X after U+%04X)", i, cp, prev_cp);
+        prev_cp = cp;
+        if (cp != (g.codepoint & 0xFFFF) || width != g.advance || bw != g.bw || bh != g.bh || xo != g.x_offset ||
+            yo != g.y_offset || size != g.bitmap.size())
+            return fail(err, "record #%u (U+%04X) does not match the compiled glyph", i, cp);
+        if (size > 0 && (off < table_end || off + (uint64_t)size > data.size()))
+            return fail(err, "bitmap of U+%04X out of range (offset %u size %u)", cp, off, size);
+        if (size > 0 && memcmp(data.data() + off, g.bitmap.data(), size) != 0)
+            return fail(err, "bitmap bytes of U+%04X differ", cp);
+
+        if (g.pixels.empty() || bw == 0 || bh == 0)
+            continue;
+        decoded.assign((size_t)bw * bh, 0);
+        if (format == GlyphFormat::V2_1BIT)
+            FontDecoder::decode_bitmap_1bit(data.data() + off, size, decoded.data(), bw, bh);
+        else
+            FontDecoder::decode_bitmap_v3(data.data() + off, size, decoded.data(), bw, bh, false, false);
+        for (size_t p = 0; p < decoded.size(); ++p)
+        {
+            if (decoded[p] != expect_color[g.pixels[p]])
+                return fail(err, "U+%04X pixel %u decodes to 0x%04X", cp, (unsigned)p, decoded[p]);
+        }
+        coverage.assign(FontDecoder::coverage4_size(bw, bh), 0xAA);
+        FontDecoder::decode_coverage4(codec, data.data() + off, size, coverage.data(), bw, bh);
+        for (size_t p = 0; p < decoded.size(); ++p)
+        {
+            size_t x = p % bw, y = p / bw;
+            uint8_t b = coverage[y * ((bw + 1) / 2) + x / 2];
+            uint8_t lv = (x & 1) ? (b & 0x0F) : (b >> 4);
+            if (lv != expect_level[g.pixels[p]])
+                return fail(err, "U+%04X pixel %u coverage level %u", cp, (unsigned)p, lv);
+        }
+    }
+    return true;
+}
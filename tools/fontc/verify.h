@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "rasterizer.h"
+
+// 往返校验：读回刚写出的 .bin，检查头部/字符表结构，
+// 再用固件的 FontDecoder（src/text/font_decoder.cpp，主机编译）解码每个字形，
+// 与编码前的像素逐一比对。glyphs 须为写入文件的条目（按码点升序，含 pixels）。
+// layout_flags/hot_bytes：期望的头部布局标志与 U+0000 条目记录的热区字节数（码点布局均为 0）。
+bool verify_font_file(const std::string &path, const std::vector<GlyphRecord> &glyphs, GlyphFormat format,
+                      int font_size, uint8_t layout_flags, uint32_t hot_bytes, std::string &err);
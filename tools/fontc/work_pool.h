@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// 工作窃取线程池（仅用于主机端工具）
+//
+// parallelFor 把 [0, n) 切成 chunk 大小的任务，按连续区段预分给各线程：
+//   - 线程从自己队列的尾部取任务（局部性好，相邻码点的字形往往走同一段 glyf/CFF 数据）
+//   - 自己队列空了就从其他线程队列的头部窃取（CJK 字形比 ASCII 慢得多，静态平分会严重失衡）
+// 任务执行期间不会产生新任务，因此所有队列都空即可结束。
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(unsigned threads)
+        : threads_(threads == 0 ? 1 : threads)
+    {
+    }
+
+    unsigned threadCount() const { return threads_; }
+
+    // fn(worker, begin, end)：worker 为线程序号（0..threadCount()-1），可用于索引线程私有资源
+    void parallelFor(size_t n, size_t chunk, const std::function<void(unsigned, size_t, size_t)> &fn)
+    {
+        if (n == 0)
+            return;
+        if (chunk == 0)
+            chunk = 1;
+
+        std::vector<Queue> queues(threads_);
+        size_t tasks = (n + chunk - 1) / chunk;
+        size_t per_worker = (tasks + threads_ - 1) / threads_;
+        for (size_t t = 0; t < tasks; ++t)
+        {
+            size_t begin = t * chunk;
+            queues[std::min<size_t>(t / per_worker, threads_ - 1)].items.emplace_back(begin, std::min(n, begin + chunk));
+        }
+
+        auto worker = [&](unsigned id) {
+            std::pair<size_t, size_t> task;
+            while (popLocal(queues[id], task) || steal(queues, id, task))
+                fn(id, task.first, task.second);
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < threads_; ++i)
+            pool.emplace_back(worker, i);
+        worker(0);
+        for (auto &t : pool)
+            t.join();
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::pair<size_t, size_t>> items;
+    };
+
+    static bool popLocal(Queue &q, std::pair<size_t, size_t> &task)
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.items.empty())
+            return false;
+        task = q.items.back();
+        q.items.pop_back();
+        return true;
+    }
+
+    bool steal(std::vector<Queue> &queues, unsigned self, std::pair<size_t, size_t> &task)
+    {
+        for (unsigned k = 1; k < threads_; ++k)
+        {
+            Queue &victim = queues[(self + k) % threads_];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.items.empty())
+                continue;
+            task = victim.items.front();
+            victim.items.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    unsigned threads_;
+};
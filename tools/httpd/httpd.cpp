@@ -0,0 +1,938 @@
+// httpd_host：在 Linux 上运行固件的 HTTP 内核（src/api/http_core.cpp），用于本地压测与回归
+//
+//   httpd_host --serve DIR [--port N]   用 POSIX socket 提供 /heartbeat、/list、/download、/upload、/delete，
+//                                       与设备的端点形状一致，可直接用 curl / ab / wrk 或 webapp 压测
+//   httpd_host --bench [--clients N]    进程内起服务器：N 个客户端并发下载，同时测量小请求延迟
+//   httpd_host --check                  ctest 用：keep-alive、定长/chunked/Range 下载、multipart 与原始请求体
+//                                       流式解析，流式 JSON（转义、溢出、逐项输出的目录列表），
+//                                       以及慢速上传/下载进行中其它请求不被阻塞
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "api/http_core.h"
+#include "api/http_json.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// ---------------------------------------------------------------------------
+// 服务端：与设备端点形状一致的最小实现（文件放在 root 目录下）
+
+class FileSource : public HttpBodySource
+{
+public:
+    FileSource(FILE *f, long long limit = -1) : f_(f), remaining_(limit) {}
+    ~FileSource() override { fclose(f_); }
+    int read(uint8_t *buf, size_t cap) override
+    {
+        if (remaining_ >= 0 && (long long)cap > remaining_)
+            cap = (size_t)remaining_;
+        int n = cap ? (int)fread(buf, 1, cap, f_) : 0;
+        if (n > 0 && remaining_ >= 0)
+            remaining_ -= n;
+        return n;
+    }
+
+private:
+    FILE *f_;
+    long long remaining_;
+};
+
+// 计数生成器：用 chunked 编码输出 count 行文本
+class CounterSource : public HttpBodySource
+{
+public:
+    explicit CounterSource(int count) : count_(count) {}
+    int read(uint8_t *buf, size_t cap) override
+    {
+        if (i_ >= count_ || cap < 32)
+            return 0;
+        return snprintf(reinterpret_cast<char *>(buf), cap, "line %d\n", i_++);
+    }
+
+private:
+    int count_;
+    int i_ = 0;
+};
+
+struct UploadSession : HttpRequestContext
+{
+    FILE *f = nullptr;
+    std::string tmp, path;
+    ~UploadSession() override
+    {
+        if (f)
+        {
+            fclose(f);
+            remove(tmp.c_str());
+        }
+    }
+};
+
+struct CrcSession : HttpRequestContext
+{
+    uint32_t crc = 0;
+};
+
+static bool safe_name(const std::string &p)
+{
+    return !p.empty() && p.find("..") == std::string::npos;
+}
+
+static void register_routes(HttpServerCore &server, const std::string &root)
+{
+    server.on("/heartbeat", HTTP_M_GET, [](HttpRequest &, HttpResponse &res) {
+        res.setHeader("Access-Control-Allow-Origin", "*");
+        res.send(200, "application/json", "{\"status\":\"ok\",\"hw\":\"host\",\"firmware\":\"ReadPaper\",\"version\":\"host\"}");
+    });
+
+    // 与设备 /list 相同：目录项在 HTTP 内核拉取响应体时逐项写出（chunked）
+    server.on("/list", HTTP_M_GET, [root](HttpRequest &, HttpResponse &res) {
+        std::shared_ptr<DIR> dir(opendir(root.c_str()), [](DIR *d) {
+            if (d)
+                closedir(d);
+        });
+        bool started = false;
+        auto step = [root, dir, started](HttpJsonWriter &w) mutable {
+            if (!started)
+            {
+                started = true;
+                w.beginArray();
+                return true;
+            }
+            while (dir)
+            {
+                struct dirent *e = readdir(dir.get());
+                if (!e)
+                    break;
+                if (e->d_name[0] == '.')
+                    continue;
+                struct stat st;
+                std::string full = root + "/" + e->d_name;
+                if (stat(full.c_str(), &st) != 0)
+                    continue;
+                w.beginObject();
+                w.field("name", e->d_name);
+                w.field("type", S_ISDIR(st.st_mode) ? "dir" : "file");
+                w.field("size", (long long)st.st_size);
+                w.field("path", std::string("/") + e->d_name);
+                w.endObject();
+                return true;
+            }
+            w.endArray();
+            return false;
+        };
+        res.stream(200, "application/json", std::unique_ptr<HttpBodySource>(new HttpJsonSource(step)), -1);
+    });
+
+    // 分段工作的生成器（对照设备 /api/search、/sync）：每步占用 ms 毫秒且不写出内容，共 slices 步后才输出结果
+    server.on("/work", HTTP_M_GET, [](HttpRequest &req, HttpResponse &res) {
+        int slices = atoi(req.arg("slices").c_str());
+        int ms = atoi(req.arg("ms").c_str());
+        int done = 0;
+        auto step = [slices, ms, done](HttpJsonWriter &w) mutable {
+            if (done < slices)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+                done++;
+                return true;
+            }
+            w.beginObject();
+            w.field("slices", done);
+            w.endObject();
+            return false;
+        };
+        res.stream(200, "application/json", std::unique_ptr<HttpBodySource>(new HttpJsonSource(step)), -1);
+    });
+
+    server.on("/download", HTTP_M_GET, [root](HttpRequest &req, HttpResponse &res) {
+        const std::string &path = req.arg("path");
+        if (!safe_name(path))
+        {
+            res.send(400, "application/json", "{\"ok\":false,\"message\":\"Missing path parameter\"}");
+            return;
+        }
+        std::string full = root + path;
+        FILE *f = fopen(full.c_str(), "rb");
+        struct stat st;
+        if (!f || stat(full.c_str(), &st) != 0 || S_ISDIR(st.st_mode))
+        {
+            if (f)
+                fclose(f);
+            res.send(404, "application/json", "{\"ok\":false,\"message\":\"File not found\"}");
+            return;
+        }
+        res.setHeader("Accept-Ranges", "bytes");
+        int64_t first = 0, last = 0;
+        int range = http_parse_range(req.header("range"), st.st_size, &first, &last);
+        if (range < 0)
+        {
+            fclose(f);
+            res.setHeader("Content-Range", "bytes */" + std::to_string((long long)st.st_size));
+            res.send(416, "application/json", "{\"ok\":false,\"message\":\"Range not satisfiable\"}");
+            return;
+        }
+        if (range > 0 && fseek(f, (long)first, SEEK_SET) == 0)
+        {
+            res.setHeader("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                                               std::to_string((long long)st.st_size));
+            res.stream(206, "application/octet-stream", std::unique_ptr<HttpBodySource>(new FileSource(f, last - first + 1)),
+                       last - first + 1);
+            return;
+        }
+        res.stream(200, "application/octet-stream", std::unique_ptr<HttpBodySource>(new FileSource(f)), st.st_size);
+    });
+
+    // 原始请求体（非 multipart）走上传回调：返回长度与 CRC32，对照设备 /upload/chunk 的校验方式
+    server.on("/crc", HTTP_M_PUT | HTTP_M_POST,
+        [](HttpRequest &, HttpResponse &res) { res.send(200, "text/plain", "0 00000000"); },
+        [](HttpRequest &req, HttpResponse &res, HttpUpload &up) {
+            if (up.status == HTTP_UPLOAD_START)
+                req.context.reset(new CrcSession());
+            CrcSession *s = static_cast<CrcSession *>(req.context.get());
+            if (up.status == HTTP_UPLOAD_WRITE)
+                s->crc = http_crc32(s->crc, up.buf, up.currentSize);
+            else if (up.status == HTTP_UPLOAD_END)
+            {
+                char out[32];
+                snprintf(out, sizeof(out), "%zu %08x", up.totalSize, (unsigned)s->crc);
+                res.send(200, "text/plain", out);
+            }
+        });
+
+    server.on("/stream", HTTP_M_GET, [](HttpRequest &req, HttpResponse &res) {
+        int n = atoi(req.arg("lines").c_str());
+        res.stream(200, "text/plain", std::unique_ptr<HttpBodySource>(new CounterSource(n)));
+    });
+
+    server.on("/delete", HTTP_M_GET | HTTP_M_POST, [root](HttpRequest &req, HttpResponse &res) {
+        const std::string &path = req.arg("path");
+        if (safe_name(path) && remove((root + path).c_str()) == 0)
+            res.send(200, "application/json", "{\"ok\":true,\"message\":\"File deleted successfully\"}");
+        else
+            res.send(500, "application/json", "{\"ok\":false,\"message\":\"Failed to delete file\"}");
+    });
+
+    server.on("/upload", HTTP_M_POST,
+        [](HttpRequest &req, HttpResponse &res) {
+            res.setHeader("Access-Control-Allow-Origin", "*");
+            if (req.context)
+                res.send(200, "application/json", "{\"ok\":true,\"message\":\"File uploaded successfully\"}");
+            else
+                res.send(400, "application/json", "{\"ok\":false,\"message\":\"No file\"}");
+        },
+        [root](HttpRequest &req, HttpResponse &res, HttpUpload &up) {
+            if (up.status == HTTP_UPLOAD_START)
+            {
+                std::string name = up.filename.empty() ? req.arg("name") : up.filename;
+                if (!safe_name(name) || name.find('/') != std::string::npos)
+                {
+                    res.send(400, "application/json", "{\"ok\":false,\"message\":\"Bad file name\"}");
+                    return;
+                }
+                UploadSession *s = new UploadSession();
+                req.context.reset(s);
+                s->path = root + "/" + name;
+                s->tmp = s->path + ".tmp";
+                s->f = fopen(s->tmp.c_str(), "wb");
+                if (!s->f)
+                    res.send(500, "application/json", "{\"ok\":false,\"message\":\"Failed to create file\"}");
+                return;
+            }
+            UploadSession *s = static_cast<UploadSession *>(req.context.get());
+            if (!s || !s->f)
+                return;
+            if (up.status == HTTP_UPLOAD_WRITE)
+            {
+                if (fwrite(up.buf, 1, up.currentSize, s->f) != up.currentSize)
+                    res.send(500, "application/json", "{\"ok\":false,\"message\":\"Write failed\"}");
+            }
+            else if (up.status == HTTP_UPLOAD_END)
+            {
+                fclose(s->f);
+                s->f = nullptr;
+                rename(s->tmp.c_str(), s->path.c_str());
+            }
+            else if (up.status == HTTP_UPLOAD_ABORTED)
+            {
+                fclose(s->f);
+                s->f = nullptr;
+                remove(s->tmp.c_str());
+            }
+        });
+
+    server.onNotFound([](HttpRequest &req, HttpResponse &res) {
+        res.send(404, "text/plain", "File Not Found\n\nURI: " + req.path + "\n");
+    });
+}
+
+class ServerThread
+{
+public:
+    bool start(const std::string &root, uint16_t port, uint8_t max_conn)
+    {
+        register_routes(server_, root);
+        HttpServerCore::Config cfg;
+        cfg.port = port;
+        cfg.max_connections = max_conn;
+        cfg.idle_timeout_ms = 2000;
+        if (!server_.begin(cfg))
+            return false;
+        thread_ = std::thread([this]() {
+            while (!stop_)
+                server_.poll(20);
+        });
+        return true;
+    }
+    void stop()
+    {
+        stop_ = true;
+        if (thread_.joinable())
+            thread_.join();
+        server_.end();
+    }
+    uint16_t port() const { return server_.port(); }
+    const HttpServerCore::Stats &stats() const { return server_.stats(); }
+
+private:
+    HttpServerCore server_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+};
+
+// ---------------------------------------------------------------------------
+// 客户端（阻塞 socket）
+
+struct Reply
+{
+    int status = 0;
+    std::string headers;
+    std::string body;
+    bool ok = false;
+};
+
+static int connect_local(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    struct timeval tv = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return fd;
+}
+
+static bool send_all(int fd, const void *data, size_t len)
+{
+    const char *p = static_cast<const char *>(data);
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// 读取一个响应；carry 保存同一连接上已读入的后续字节（流水线）；
+// read_delay_us > 0 时模拟慢速客户端（每读 16KB 停顿一次）
+static Reply read_reply(int fd, std::string &carry, int read_delay_us = 0)
+{
+    Reply r;
+    std::string buf;
+    buf.swap(carry);
+    char tmp[16384];
+    size_t head_end;
+    for (;;)
+    {
+        head_end = buf.find("\r\n\r\n");
+        if (head_end != std::string::npos)
+            break;
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return r;
+        buf.append(tmp, (size_t)n);
+    }
+    r.headers = buf.substr(0, head_end + 4);
+    buf.erase(0, head_end + 4);
+    r.status = atoi(r.headers.c_str() + 9);
+
+    std::string lower = r.headers;
+    for (char &c : lower)
+        c = (char)tolower((unsigned char)c);
+    long long length = -1;
+    size_t cl = lower.find("content-length:");
+    if (cl != std::string::npos)
+        length = atoll(lower.c_str() + cl + 15);
+    bool chunked = lower.find("transfer-encoding: chunked") != std::string::npos;
+
+    auto fill = [&](size_t want) -> bool {
+        while (buf.size() < want)
+        {
+            if (read_delay_us > 0)
+                usleep(read_delay_us);
+            ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+            if (n <= 0)
+                return false;
+            buf.append(tmp, (size_t)n);
+        }
+        return true;
+    };
+
+    if (chunked)
+    {
+        for (;;)
+        {
+            size_t eol;
+            while ((eol = buf.find("\r\n")) == std::string::npos)
+                if (!fill(buf.size() + 1))
+                    return r;
+            size_t n = strtoul(buf.c_str(), nullptr, 16);
+            buf.erase(0, eol + 2);
+            if (!fill(n + 2))
+                return r;
+            r.body.append(buf, 0, n);
+            buf.erase(0, n + 2);
+            if (n == 0)
+                break;
+        }
+    }
+    else if (length >= 0)
+    {
+        if (!fill((size_t)length))
+            return r;
+        r.body = buf.substr(0, (size_t)length);
+        buf.erase(0, (size_t)length);
+    }
+    carry.swap(buf);
+    r.ok = true;
+    return r;
+}
+
+static Reply read_reply(int fd, int read_delay_us = 0)
+{
+    std::string carry;
+    return read_reply(fd, carry, read_delay_us);
+}
+
+static Reply get(int fd, const std::string &target, bool keep_alive = true, int read_delay_us = 0)
+{
+    std::string req = "GET " + target + " HTTP/1.1\r\nHost: local\r\n";
+    if (!keep_alive)
+        req += "Connection: close\r\n";
+    req += "\r\n";
+    if (!send_all(fd, req.data(), req.size()))
+        return Reply();
+    return read_reply(fd, read_delay_us);
+}
+
+static std::string multipart_body(const std::string &boundary, const std::string &filename, const std::string &data)
+{
+    std::string body = "--" + boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"note\"\r\n\r\nhello\r\n";
+    body += "--" + boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"file\"; filename=\"" + filename + "\"\r\n";
+    body += "Content-Type: application/octet-stream\r\n\r\n";
+    body += data;
+    body += "\r\n--" + boundary + "--\r\n";
+    return body;
+}
+
+// 分片发送请求体；piece_delay_us 模拟慢速上传
+static Reply post_upload(uint16_t port, const std::string &filename, const std::string &data,
+                         size_t piece, int piece_delay_us)
+{
+    const std::string boundary = "----rpBoundary7MA4YWxkTrZu0gW";
+    std::string body = multipart_body(boundary, filename, data);
+    std::string head = "POST /upload?tab=book HTTP/1.1\r\nHost: local\r\n";
+    head += "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n";
+    head += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    int fd = connect_local(port);
+    Reply r;
+    if (fd < 0)
+        return r;
+    bool ok = send_all(fd, head.data(), head.size());
+    for (size_t off = 0; ok && off < body.size(); off += piece)
+    {
+        ok = send_all(fd, body.data() + off, std::min(piece, body.size() - off));
+        if (piece_delay_us > 0)
+            usleep(piece_delay_us);
+    }
+    if (ok)
+        r = read_reply(fd);
+    close(fd);
+    return r;
+}
+
+static std::string random_bytes(size_t n, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::string s(n, '\0');
+    for (size_t i = 0; i < n; ++i)
+        s[i] = (char)(rng() & 0xFF);
+    return s;
+}
+
+static bool read_file(const std::string &path, std::string &out)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    out.clear();
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+static bool write_file(const std::string &path, const std::string &data)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+static std::string make_temp_root()
+{
+    char tmpl[] = "/tmp/httpd_host.XXXXXX";
+    const char *d = mkdtemp(tmpl);
+    return d ? std::string(d) : std::string();
+}
+
+static void remove_tree(const std::string &root)
+{
+    DIR *d = opendir(root.c_str());
+    while (d)
+    {
+        struct dirent *e = readdir(d);
+        if (!e)
+            break;
+        if (strcmp(e->d_name, ".") && strcmp(e->d_name, ".."))
+            remove((root + "/" + e->d_name).c_str());
+    }
+    if (d)
+        closedir(d);
+    rmdir(root.c_str());
+}
+
+// 在 busy 为真期间反复请求 /heartbeat，记录最大延迟
+static void probe_latency(uint16_t port, const std::atomic<bool> &busy, std::vector<double> &lat)
+{
+    while (busy)
+    {
+        int fd = connect_local(port);
+        if (fd < 0)
+            break;
+        auto t0 = Clock::now();
+        Reply r = get(fd, "/heartbeat", false);
+        lat.push_back(r.ok && r.status == 200 ? ms_since(t0) : 1e9);
+        close(fd);
+        usleep(5000);
+    }
+}
+
+#define CHECK(cond, ...)                         \
+    do                                           \
+    {                                            \
+        if (!(cond))                             \
+        {                                        \
+            fprintf(stderr, "FAIL: " __VA_ARGS__); \
+            fprintf(stderr, "\n");               \
+            failures++;                          \
+        }                                        \
+    } while (0)
+
+static int run_check()
+{
+    int failures = 0;
+    std::string root = make_temp_root();
+    const std::string big = random_bytes(4 * 1024 * 1024, 1);
+    write_file(root + "/big.bin", big);
+
+    ServerThread srv;
+    if (!srv.start(root, 0, 4))
+    {
+        fprintf(stderr, "server start failed\n");
+        return 1;
+    }
+    uint16_t port = srv.port();
+
+    // 1) keep-alive：同一连接上连续三个请求（含一次 404）
+    {
+        int fd = connect_local(port);
+        Reply a = get(fd, "/heartbeat");
+        Reply b = get(fd, "/nope");
+        Reply c = get(fd, "/heartbeat");
+        CHECK(a.ok && a.status == 200 && a.body.find("\"status\":\"ok\"") != std::string::npos, "heartbeat");
+        CHECK(b.ok && b.status == 404, "not found on keep-alive connection");
+        CHECK(c.ok && c.status == 200, "third request on same connection");
+        close(fd);
+    }
+
+    // 2) 流水线：两个请求一次发出
+    {
+        int fd = connect_local(port);
+        std::string two = "GET /heartbeat HTTP/1.1\r\nHost: x\r\n\r\nGET /stream?lines=3 HTTP/1.1\r\nHost: x\r\n\r\n";
+        send_all(fd, two.data(), two.size());
+        std::string carry;
+        Reply a = read_reply(fd, carry);
+        Reply b = read_reply(fd, carry);
+        CHECK(a.ok && a.status == 200, "pipelined first");
+        CHECK(b.ok && b.body == "line 0\nline 1\nline 2\n", "pipelined chunked second");
+        close(fd);
+    }
+
+    // 3) 定长文件下载与 chunked 生成器
+    {
+        int fd = connect_local(port);
+        Reply r = get(fd, "/download?path=/big.bin");
+        CHECK(r.ok && r.status == 200 && r.body == big, "download 4MB identical");
+        Reply s = get(fd, "/stream?lines=20000");
+        std::string expect;
+        for (int i = 0; i < 20000; ++i)
+            expect += "line " + std::to_string(i) + "\n";
+        CHECK(s.ok && s.body == expect, "chunked stream identical");
+        Reply h = get(fd, "/download?path=/missing.bin");
+        CHECK(h.ok && h.status == 404, "download missing -> 404");
+        close(fd);
+    }
+
+    // 4) multipart：数据中夹带分隔符前缀，按奇数大小分片发送
+    {
+        std::string data = random_bytes(1 << 20, 2);
+        const char *traps[] = {"\r\n--", "\r\n------rpBoundary7MA4YWxkTrZu0g", "\r\r\n--", "\r\n-\r\n--"};
+        for (int i = 0; i < 64; ++i)
+        {
+            const char *t = traps[i % 4];
+            data.replace((size_t)i * 16000 + 7, strlen(t), t);
+        }
+        Reply r = post_upload(port, "mp.bin", data, 1237, 0);
+        std::string got;
+        CHECK(r.ok && r.status == 200, "multipart upload status %d", r.status);
+        CHECK(read_file(root + "/mp.bin", got) && got == data, "multipart content identical");
+
+        Reply e = post_upload(port, "empty.bin", std::string(), 7, 0);
+        CHECK(e.ok && e.status == 200 && read_file(root + "/empty.bin", got) && got.empty(), "empty file upload");
+    }
+
+    // 5) 请求体超限（无上传回调的路由）：提前 413 且客户端能读到响应
+    {
+        int fd = connect_local(port);
+        std::string head = "POST /delete HTTP/1.1\r\nHost: x\r\nContent-Length: 1000000\r\n\r\n";
+        send_all(fd, head.data(), head.size());
+        Reply r = read_reply(fd);
+        CHECK(r.ok && r.status == 413, "oversized inline body -> 413 (got %d)", r.status);
+        close(fd);
+    }
+
+    // 6) 慢速上传 + 慢速下载进行中，其它请求不排队
+    {
+        std::atomic<bool> busy{true};
+        std::vector<double> lat;
+        std::string slow_data = random_bytes(2 * 1024 * 1024, 3);
+        Reply up, down;
+        std::thread uploader([&]() { up = post_upload(port, "slow.bin", slow_data, 32 * 1024, 15000); });
+        std::thread downloader([&]() {
+            int fd = connect_local(port);
+            down = get(fd, "/download?path=/big.bin", false, 3000);
+            close(fd);
+        });
+        std::thread prober([&]() { probe_latency(port, busy, lat); });
+        uploader.join();
+        downloader.join();
+        busy = false;
+        prober.join();
+
+        std::string got;
+        CHECK(up.ok && up.status == 200 && read_file(root + "/slow.bin", got) && got == slow_data, "slow upload identical");
+        CHECK(down.ok && down.body == big, "slow download identical");
+        double worst = lat.empty() ? 1e9 : *std::max_element(lat.begin(), lat.end());
+        CHECK(lat.size() >= 20, "latency probes ran (%zu)", lat.size());
+        CHECK(worst < 250.0, "heartbeat worst latency during transfers %.1f ms", worst);
+        printf("concurrent: %zu heartbeats during slow transfers, worst %.1f ms\n", lat.size(), worst);
+    }
+
+    // 7) 中途断开的上传：临时文件被清理，服务器继续工作
+    {
+        int fd = connect_local(port);
+        std::string head = "POST /upload HTTP/1.1\r\nHost: x\r\nContent-Type: multipart/form-data; boundary=zz\r\nContent-Length: 100000\r\n\r\n";
+        head += "--zz\r\nContent-Disposition: form-data; name=\"file\"; filename=\"cut.bin\"\r\n\r\npartial";
+        send_all(fd, head.data(), head.size());
+        usleep(50000);
+        close(fd);
+        usleep(100000);
+        struct stat st;
+        CHECK(stat((root + "/cut.bin.tmp").c_str(), &st) != 0 && stat((root + "/cut.bin").c_str(), &st) != 0,
+              "aborted upload cleaned up");
+        int fd2 = connect_local(port);
+        Reply r = get(fd2, "/heartbeat");
+        CHECK(r.ok && r.status == 200, "server alive after aborted upload");
+        close(fd2);
+    }
+
+    // 8) Range 下载与 CRC32
+    {
+        int64_t a = 0, z = 0;
+        CHECK(http_parse_range("bytes=0-99", 1000, &a, &z) == 1 && a == 0 && z == 99, "range a-b");
+        CHECK(http_parse_range("bytes=990-", 1000, &a, &z) == 1 && a == 990 && z == 999, "range a-");
+        CHECK(http_parse_range("bytes=-10", 1000, &a, &z) == 1 && a == 990 && z == 999, "range suffix");
+        CHECK(http_parse_range("bytes=-5000", 1000, &a, &z) == 1 && a == 0 && z == 999, "range suffix longer than file");
+        CHECK(http_parse_range("bytes=500-5000", 1000, &a, &z) == 1 && a == 500 && z == 999, "range end clamped");
+        CHECK(http_parse_range("bytes=1000-", 1000, &a, &z) == -1, "range past end -> 416");
+        CHECK(http_parse_range("bytes=0-1,5-6", 1000, &a, &z) == 0, "multi-range ignored");
+        CHECK(http_parse_range("items=0-1", 1000, &a, &z) == 0 && http_parse_range("bytes=9-1", 1000, &a, &z) == 0,
+              "invalid range ignored");
+        CHECK(http_crc32(0, reinterpret_cast<const uint8_t *>("123456789"), 9) == 0xCBF43926u, "crc32 check value");
+        uint32_t split = http_crc32(http_crc32(0, reinterpret_cast<const uint8_t *>("1234"), 4),
+                                    reinterpret_cast<const uint8_t *>("56789"), 5);
+        CHECK(split == 0xCBF43926u, "crc32 chained");
+
+        int fd = connect_local(port);
+        auto ranged = [&](const char *range) {
+            std::string req = "GET /download?path=/big.bin HTTP/1.1\r\nHost: x\r\nRange: " + std::string(range) + "\r\n\r\n";
+            send_all(fd, req.data(), req.size());
+            return read_reply(fd);
+        };
+        Reply r = ranged("bytes=1000-1999");
+        CHECK(r.ok && r.status == 206 && r.body == big.substr(1000, 1000) &&
+                  r.headers.find("Content-Range: bytes 1000-1999/4194304") != std::string::npos,
+              "206 partial download");
+        r = ranged("bytes=4194000-");
+        CHECK(r.ok && r.status == 206 && r.body == big.substr(4194000), "206 open-ended tail");
+        r = ranged("bytes=5000000-");
+        CHECK(r.ok && r.status == 416 && r.headers.find("Content-Range: bytes */4194304") != std::string::npos, "416");
+        r = ranged("bytes=0-0,10-20");
+        CHECK(r.ok && r.status == 200 && r.body == big, "multi-range falls back to 200");
+        close(fd);
+
+        // 原始请求体 + 流式 CRC（分片到达）
+        std::string data = random_bytes(300000, 5);
+        std::string head = "PUT /crc HTTP/1.1\r\nHost: x\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+                           std::to_string(data.size()) + "\r\n\r\n";
+        fd = connect_local(port);
+        send_all(fd, head.data(), head.size());
+        for (size_t off = 0; off < data.size(); off += 4099)
+            send_all(fd, data.data() + off, std::min<size_t>(4099, data.size() - off));
+        r = read_reply(fd);
+        char expect[32];
+        snprintf(expect, sizeof(expect), "%zu %08x", data.size(),
+                 (unsigned)http_crc32(0, reinterpret_cast<const uint8_t *>(data.data()), data.size()));
+        CHECK(r.ok && r.status == 200 && r.body == expect, "raw body crc (%s vs %s)", r.body.c_str(), expect);
+        close(fd);
+    }
+
+    // 9) 流式 JSON：转义、嵌套逗号、超过暂存缓冲的单个值；目录列表逐项输出
+    {
+        HttpJsonWriter w;
+        w.beginObject();
+        w.field("s", "q\"b\\n\n\x01\xe4\xb8\xad");
+        w.key("a");
+        w.beginArray();
+        w.value(1);
+        w.beginObject();
+        w.endObject();
+        w.value(-7LL);
+        w.value(true);
+        w.null();
+        w.endArray();
+        std::string long_value(HTTP_JSON_STAGE_SIZE * 3 + 17, 'x');
+        w.field("long", long_value);
+        w.endObject();
+        std::string got;
+        uint8_t buf[100];
+        size_t n;
+        while ((n = w.drain(buf, sizeof(buf))) > 0)
+            got.append(reinterpret_cast<char *>(buf), n);
+        std::string expect = "{\"s\":\"q\\\"b\\\\n\\n\\u0001\xe4\xb8\xad\",\"a\":[1,{},-7,true,null],\"long\":\"" +
+                             long_value + "\"}";
+        CHECK(got == expect, "json writer output: %s", got.substr(0, 120).c_str());
+        CHECK(w.pending() == 0, "json writer drained");
+
+        mkdir((root + "/many").c_str(), 0755);
+        const int files = 3000;
+        for (int i = 0; i < files; ++i)
+            write_file(root + "/many/f" + std::to_string(i) + ".txt", "x");
+        write_file(root + "/many/a\"b\\c.txt", "yy");
+        ServerThread list_srv;
+        if (list_srv.start(root + "/many", 0, 2))
+        {
+            int fd = connect_local(list_srv.port());
+            Reply r = get(fd, "/list");
+            size_t items = 0;
+            for (size_t p = 0; (p = r.body.find("{\"name\":", p)) != std::string::npos; ++p)
+                items++;
+            CHECK(r.ok && r.status == 200 && r.headers.find("chunked") != std::string::npos, "list chunked");
+            CHECK(items == files + 1 && r.body.front() == '[' && r.body.back() == ']', "list items %zu", items);
+            CHECK(r.body.find("\"name\":\"a\\\"b\\\\c.txt\",\"type\":\"file\",\"size\":2") != std::string::npos,
+                  "list escapes names");
+            close(fd);
+            list_srv.stop();
+        }
+        else
+        {
+            CHECK(false, "list server start");
+        }
+    }
+
+    // 10) 分段生成器让出 HTTP 任务：长时间工作期间其它请求照常应答
+    {
+        std::atomic<bool> busy{true};
+        std::vector<double> lat;
+        Reply w;
+        std::thread worker([&]() {
+            int fd = connect_local(port);
+            w = get(fd, "/work?slices=40&ms=30");
+            close(fd);
+        });
+        std::thread prober([&]() { probe_latency(port, busy, lat); });
+        worker.join();
+        busy = false;
+        prober.join();
+        double worst = lat.empty() ? 1e9 : *std::max_element(lat.begin(), lat.end());
+        CHECK(w.ok && w.status == 200 && w.body == "{\"slices\":40}", "yielding generator result: %s", w.body.c_str());
+        CHECK(lat.size() >= 10, "latency probes during yielding generator (%zu)", lat.size());
+        CHECK(worst < 250.0, "heartbeat worst latency during yielding generator %.1f ms", worst);
+        printf("yielding: %zu heartbeats during 40 x 30 ms slices, worst %.1f ms\n", lat.size(), worst);
+    }
+
+    const HttpServerCore::Stats &st = srv.stats();
+    printf("server: accepted=%u requests=%u peak_active=%u timeouts=%u errors=%u in=%llu out=%llu\n",
+           st.accepted, st.requests, st.peak_active, st.timeouts, st.errors,
+           (unsigned long long)st.bytes_in, (unsigned long long)st.bytes_out);
+    srv.stop();
+    remove_tree(root);
+    printf(failures ? "httpd_host --check: %d failure(s)\n" : "httpd_host --check: OK\n", failures);
+    return failures ? 1 : 0;
+}
+
+// 压测：clients 个并发下载 + 一个探测线程测小请求延迟（中位数 / p99 / 最大值）
+static int run_bench(int clients, int rounds)
+{
+    std::string root = make_temp_root();
+    const std::string big = random_bytes(8 * 1024 * 1024, 4);
+    write_file(root + "/big.bin", big);
+    ServerThread srv;
+    if (!srv.start(root, 0, 6))
+        return 1;
+    uint16_t port = srv.port();
+
+    std::atomic<bool> busy{true};
+    std::vector<double> lat;
+    std::atomic<uint64_t> bytes{0};
+    auto t0 = Clock::now();
+    std::vector<std::thread> th;
+    for (int i = 0; i < clients; ++i)
+    {
+        th.emplace_back([&]() {
+            int fd = connect_local(port);
+            for (int k = 0; k < rounds; ++k)
+            {
+                Reply r = get(fd, "/download?path=/big.bin");
+                bytes += r.body.size();
+            }
+            close(fd);
+        });
+    }
+    std::thread prober([&]() { probe_latency(port, busy, lat); });
+    for (auto &t : th)
+        t.join();
+    double secs = ms_since(t0) / 1000.0;
+    busy = false;
+    prober.join();
+    srv.stop();
+    remove_tree(root);
+
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) { return lat.empty() ? 0.0 : lat[std::min(lat.size() - 1, (size_t)(p * lat.size()))]; };
+    printf("%d clients x %d downloads of 8MB: %.1f MB/s\n", clients, rounds, bytes / secs / (1024.0 * 1024.0));
+    printf("heartbeat latency under load: n=%zu p50=%.2f ms p99=%.2f ms max=%.2f ms\n",
+           lat.size(), pct(0.5), pct(0.99), lat.empty() ? 0.0 : lat.back());
+    return 0;
+}
+
+static int run_serve(const std::string &root, uint16_t port)
+{
+    HttpServerCore server;
+    register_routes(server, root);
+    HttpServerCore::Config cfg;
+    cfg.port = port;
+    if (!server.begin(cfg))
+    {
+        fprintf(stderr, "cannot listen on port %u\n", port);
+        return 1;
+    }
+    printf("serving %s on http://127.0.0.1:%u\n", root.c_str(), server.port());
+    for (;;)
+        server.poll(100);
+}
+
+int main(int argc, char **argv)
+{
+    std::string mode, root;
+    uint16_t port = 8080;
+    int clients = 4, rounds = 8;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--check" || a == "--bench")
+            mode = a;
+        else if (a == "--serve" && i + 1 < argc)
+        {
+            mode = a;
+            root = argv[++i];
+        }
+        else if (a == "--port" && i + 1 < argc)
+            port = (uint16_t)atoi(argv[++i]);
+        else if (a == "--clients" && i + 1 < argc)
+            clients = atoi(argv[++i]);
+        else if (a == "--rounds" && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else
+            mode.clear();
+    }
+    if (mode == "--check")
+        return run_check();
+    if (mode == "--bench")
+        return run_bench(clients, rounds);
+    if (mode == "--serve")
+        return run_serve(root, port);
+    fprintf(stderr, "usage: httpd_host --check | --bench [--clients N] [--rounds N] | --serve DIR [--port N]\n");
+    return 2;
+}
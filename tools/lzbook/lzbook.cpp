@@ -0,0 +1,381 @@
+// lzbook：把 .txt 书籍打包成分块压缩格式（RPLZ，见 src/text/lz_block.h），或解包还原
+//
+// 压缩编码与固件编译同一份实现（src/text/lz_block.cpp），设备端按文件头识别压缩书，
+// 以解压后的偏移读取（src/text/lz_book.cpp），书签、.page 索引与原文件通用。
+// 中文小说一般压到原来的 1/2 ~ 1/3，SD 读取量与上传时间随之减少。
+//
+//   lzbook pack [--block-kb 16|32|64] <book.txt> [out]   默认输出 <book.txt>.lz
+//   lzbook unpack <book.txt.lz> [out]                     校验原文 CRC；默认输出去掉 .lz
+//   lzbook info <file>                                    打印文件头与压缩率
+//   lzbook --check [book.txt ...]                         自检（ctest）
+//
+// .txt.lz 可以直接经 Wi-Fi 上传到书籍页，也可以复制到 SD 卡 /book/，都保留 .txt.lz 文件名。
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "text/lz_block.h"
+
+static uint32_t crc32(const uint8_t *p, size_t n, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    if (!table[1])
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static bool read_file(const std::string &path, std::vector<uint8_t> &out)
+{
+    FILE *fp = std::fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+    out.clear();
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), fp)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    bool ok = !std::ferror(fp);
+    std::fclose(fp);
+    return ok;
+}
+
+static bool write_file(const std::string &path, const std::vector<uint8_t> &data)
+{
+    FILE *fp = std::fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+    bool ok = std::fwrite(data.data(), 1, data.size(), fp) == data.size();
+    ok = (std::fclose(fp) == 0) && ok;
+    return ok;
+}
+
+// 读取整个压缩文件的头与偏移表
+static bool parse(const std::vector<uint8_t> &file, LzBookHeader &h, std::vector<uint32_t> &offsets)
+{
+    if (!lz_book_parse_header(file.data(), file.size(), h))
+        return false;
+    if (file.size() < LZBOOK_HEADER_BYTES + h.table_bytes())
+        return false;
+    offsets.resize(h.block_count + 1);
+    std::memcpy(offsets.data(), file.data() + LZBOOK_HEADER_BYTES, h.table_bytes());
+    return lz_book_check_table(h, offsets.data(), file.size());
+}
+
+// 与设备端 LzBookFileImpl::load 相同：存储长度等于原文块长为原样存放，否则解压
+static bool read_block(const std::vector<uint8_t> &file, const LzBookHeader &h, const std::vector<uint32_t> &offsets,
+                       uint32_t i, std::vector<uint8_t> &out)
+{
+    uint32_t len = h.raw_block_len(i);
+    uint32_t stored = offsets[i + 1] - offsets[i];
+    out.resize(len);
+    if (stored == len)
+    {
+        std::memcpy(out.data(), file.data() + offsets[i], len);
+        return true;
+    }
+    return lz_block_decompress(file.data() + offsets[i], stored, out.data(), len) == (int)len;
+}
+
+static bool unpack(const std::vector<uint8_t> &file, std::vector<uint8_t> &raw, std::string &err)
+{
+    LzBookHeader h;
+    std::vector<uint32_t> offsets;
+    if (!parse(file, h, offsets))
+    {
+        err = "not an RPLZ file or block table corrupted";
+        return false;
+    }
+    raw.clear();
+    raw.reserve(h.raw_size);
+    std::vector<uint8_t> block;
+    for (uint32_t i = 0; i < h.block_count; ++i)
+    {
+        if (!read_block(file, h, offsets, i, block))
+        {
+            err = "block " + std::to_string(i) + " corrupted";
+            return false;
+        }
+        raw.insert(raw.end(), block.begin(), block.end());
+    }
+    if (crc32(raw.data(), raw.size()) != h.raw_crc)
+    {
+        err = "CRC mismatch";
+        return false;
+    }
+    return true;
+}
+
+static bool pack(const std::vector<uint8_t> &raw, unsigned shift, std::vector<uint8_t> &out)
+{
+    return lz_book_pack(raw.data(), raw.size(), shift, crc32(raw.data(), raw.size()), out);
+}
+
+static int usage()
+{
+    std::fprintf(stderr, "usage: lzbook pack [--block-kb 16|32|64] <book.txt> [out]\n"
+                         "       lzbook unpack <book.txt.lz> [out]\n"
+                         "       lzbook info <file>\n"
+                         "       lzbook --check [book.txt ...]\n");
+    return 2;
+}
+
+static int cmd_pack(int argc, char **argv)
+{
+    unsigned shift = LZBOOK_DEFAULT_BLOCK_SHIFT;
+    std::vector<std::string> pos;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--block-kb") && i + 1 < argc)
+        {
+            int kb = std::atoi(argv[++i]);
+            shift = kb == 16 ? 14 : kb == 32 ? 15 : kb == 64 ? 16 : 0;
+            if (!shift)
+                return usage();
+        }
+        else
+        {
+            pos.push_back(argv[i]);
+        }
+    }
+    if (pos.empty() || pos.size() > 2)
+        return usage();
+    std::string out_path = pos.size() > 1 ? pos[1] : pos[0] + ".lz";
+
+    std::vector<uint8_t> raw, packed;
+    if (!read_file(pos[0], raw))
+    {
+        std::fprintf(stderr, "lzbook: cannot read %s\n", pos[0].c_str());
+        return 1;
+    }
+    if (!pack(raw, shift, packed) || !write_file(out_path, packed))
+    {
+        std::fprintf(stderr, "lzbook: cannot write %s\n", out_path.c_str());
+        return 1;
+    }
+    std::printf("%s: %zu -> %zu bytes (%.1f%%), %u KB blocks\n", out_path.c_str(), raw.size(), packed.size(),
+                raw.empty() ? 100.0 : 100.0 * packed.size() / raw.size(), (1u << shift) / 1024);
+    return 0;
+}
+
+static int cmd_unpack(int argc, char **argv)
+{
+    if (argc < 1 || argc > 2)
+        return usage();
+    std::string in = argv[0];
+    std::string out_path = argc > 1 ? argv[1] : in;
+    if (argc == 1)
+    {
+        if (out_path.size() > 3 && out_path.compare(out_path.size() - 3, 3, ".lz") == 0)
+            out_path.resize(out_path.size() - 3);
+        else
+            out_path += ".txt";
+    }
+    std::vector<uint8_t> file, raw;
+    std::string err;
+    if (!read_file(in, file))
+    {
+        std::fprintf(stderr, "lzbook: cannot read %s\n", in.c_str());
+        return 1;
+    }
+    if (!unpack(file, raw, err))
+    {
+        std::fprintf(stderr, "lzbook: %s: %s\n", in.c_str(), err.c_str());
+        return 1;
+    }
+    if (!write_file(out_path, raw))
+    {
+        std::fprintf(stderr, "lzbook: cannot write %s\n", out_path.c_str());
+        return 1;
+    }
+    std::printf("%s: %zu bytes\n", out_path.c_str(), raw.size());
+    return 0;
+}
+
+static int cmd_info(int argc, char **argv)
+{
+    if (argc != 1)
+        return usage();
+    std::vector<uint8_t> file;
+    LzBookHeader h;
+    std::vector<uint32_t> offsets;
+    if (!read_file(argv[0], file) || !parse(file, h, offsets))
+    {
+        std::fprintf(stderr, "lzbook: %s is not a valid RPLZ file\n", argv[0]);
+        return 1;
+    }
+    uint32_t stored_raw = 0;
+    for (uint32_t i = 0; i < h.block_count; ++i)
+        stored_raw += (offsets[i + 1] - offsets[i] == h.raw_block_len(i));
+    std::printf("raw %u bytes, crc %08x, %u blocks of %u KB (%u stored uncompressed), file %zu bytes (%.1f%%)\n",
+                (unsigned)h.raw_size, (unsigned)h.raw_crc, (unsigned)h.block_count, (unsigned)h.block_size() / 1024,
+                (unsigned)stored_raw, file.size(), h.raw_size ? 100.0 * file.size() / h.raw_size : 100.0);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// 自检
+
+static int g_failures = 0;
+
+static void expect(bool cond, const char *what, const std::string &ctx)
+{
+    if (!cond)
+    {
+        std::fprintf(stderr, "FAIL %s (%s)\n", what, ctx.c_str());
+        ++g_failures;
+    }
+}
+
+// 打包 -> 解包一致；按设备的方式随机定位读取（跨块、块尾、文件尾）与原文一致
+static void check_roundtrip(const std::vector<uint8_t> &raw, unsigned shift, const std::string &name)
+{
+    std::string ctx = name + ", " + std::to_string((1u << shift) / 1024) + " KB blocks";
+    std::vector<uint8_t> packed, back;
+    std::string err;
+    expect(pack(raw, shift, packed), "pack", ctx);
+    expect(unpack(packed, back, err) && back == raw, "unpack round trip", ctx + " " + err);
+
+    LzBookHeader h;
+    std::vector<uint32_t> offsets;
+    if (!parse(packed, h, offsets))
+    {
+        expect(false, "parse", ctx);
+        return;
+    }
+    std::mt19937 rng(shift);
+    std::vector<uint8_t> block;
+    for (int n = 0; n < 200 && !raw.empty(); ++n)
+    {
+        size_t pos = rng() % raw.size();
+        if (n % 4 == 0)
+            pos = (pos >> shift << shift) - (pos >= (1u << shift) ? 3 : 0); // 块边界附近
+        size_t len = std::min<size_t>(rng() % 9000 + 1, raw.size() - pos);
+        std::vector<uint8_t> got;
+        while (got.size() < len)
+        {
+            size_t at = pos + got.size();
+            uint32_t i = (uint32_t)(at >> shift);
+            if (!read_block(packed, h, offsets, i, block))
+                break;
+            size_t off = at - ((size_t)i << shift);
+            size_t take = std::min(len - got.size(), block.size() - off);
+            got.insert(got.end(), block.begin() + off, block.begin() + off + take);
+        }
+        if (!std::equal(got.begin(), got.end(), raw.begin() + pos) || got.size() != len)
+        {
+            expect(false, "random access", ctx + " at " + std::to_string(pos));
+            break;
+        }
+    }
+}
+
+// 截断与随机改写过的压缩数据不能越界（只要求不崩溃并给出失败或某个输出）
+static void check_corruption(const std::vector<uint8_t> &raw)
+{
+    size_t len = std::min<size_t>(raw.size(), 1u << 15);
+    std::vector<uint8_t> comp(lz_block_bound(len)), out(len);
+    size_t n = lz_block_compress(raw.data(), len, comp.data(), comp.size());
+    expect(n > 0, "compress sample", "corruption");
+    std::mt19937 rng(7);
+    for (int t = 0; t < 2000 && n > 0; ++t)
+    {
+        std::vector<uint8_t> bad(comp.begin(), comp.begin() + n);
+        if (t % 3 == 0)
+            bad.resize(rng() % n);
+        for (int k = 0; k < 4 && !bad.empty(); ++k)
+            bad[rng() % bad.size()] = (uint8_t)rng();
+        int r = lz_block_decompress(bad.data(), bad.size(), out.data(), out.size());
+        expect(r <= (int)out.size(), "decompress stays in bounds", "corruption");
+    }
+    std::vector<uint8_t> packed;
+    pack(raw, LZBOOK_DEFAULT_BLOCK_SHIFT, packed);
+    LzBookHeader h;
+    std::vector<uint32_t> offsets;
+    if (packed.size() > LZBOOK_HEADER_BYTES + 8 && parse(packed, h, offsets))
+    {
+        std::vector<uint8_t> cut(packed.begin(), packed.end() - 1);
+        expect(!parse(cut, h, offsets), "truncated file rejected", "corruption");
+        std::vector<uint8_t> swapped = packed;
+        std::memset(swapped.data() + LZBOOK_HEADER_BYTES, 0xFF, 4);
+        expect(!parse(swapped, h, offsets), "bad block table rejected", "corruption");
+    }
+}
+
+static int cmd_check(int argc, char **argv)
+{
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> samples;
+    samples.push_back({"empty", {}});
+    samples.push_back({"tiny", {'a', 'b', 'c'}});
+    std::vector<uint8_t> rep(200000, 'x');
+    samples.push_back({"repeat", rep});
+    std::vector<uint8_t> noise(150000);
+    std::mt19937 rng(1);
+    for (uint8_t &b : noise)
+        b = (uint8_t)rng();
+    samples.push_back({"noise", noise});
+    for (int i = 0; i < argc; ++i)
+    {
+        std::vector<uint8_t> data;
+        if (!read_file(argv[i], data))
+        {
+            std::fprintf(stderr, "lzbook: cannot read %s\n", argv[i]);
+            return 1;
+        }
+        // 短样本重复几遍，凑够多个块
+        std::vector<uint8_t> book;
+        while (book.size() < 300000 && !data.empty())
+            book.insert(book.end(), data.begin(), data.end());
+        samples.push_back({argv[i], book});
+    }
+
+    for (const auto &s : samples)
+        for (unsigned shift = LZBOOK_MIN_BLOCK_SHIFT; shift <= LZBOOK_MAX_BLOCK_SHIFT; ++shift)
+            check_roundtrip(s.second, shift, s.first);
+    check_corruption(samples.back().second);
+
+    for (const auto &s : samples)
+    {
+        std::vector<uint8_t> packed;
+        pack(s.second, LZBOOK_DEFAULT_BLOCK_SHIFT, packed);
+        std::printf("%-24s %9zu -> %9zu bytes (%.1f%%)\n", s.first.c_str(), s.second.size(), packed.size(),
+                    s.second.empty() ? 100.0 : 100.0 * packed.size() / s.second.size());
+    }
+    if (g_failures)
+    {
+        std::fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        return usage();
+    std::string cmd = argv[1];
+    if (cmd == "pack")
+        return cmd_pack(argc - 2, argv + 2);
+    if (cmd == "unpack")
+        return cmd_unpack(argc - 2, argv + 2);
+    if (cmd == "info")
+        return cmd_info(argc - 2, argv + 2);
+    if (cmd == "--check")
+        return cmd_check(argc - 2, argv + 2);
+    return usage();
+}
@@ -0,0 +1,61 @@
+#pragma once
+// 主机端替身：只提供分页核心、繁简转换、GBK 表与页索引用到的 Arduino 接口
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+class String : public std::string
+{
+public:
+    using std::string::string;
+    String() = default;
+    String(const std::string &s) : std::string(s) {}
+    int toInt() const { return std::atoi(c_str()); }
+    float toFloat() const { return (float)std::atof(c_str()); }
+    bool startsWith(const char *p) const { return rfind(p, 0) == 0; }
+};
+
+// 日志只在 --verbose 时输出到 stderr（固件各文件的 DBG_* 宏默认关闭，这里只剩少量常开日志）
+class HostSerial
+{
+public:
+    bool enabled = false;
+    int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+    {
+        if (!enabled)
+            return 0;
+        va_list ap;
+        va_start(ap, fmt);
+        int n = std::vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        return n;
+    }
+    void println(const char *s = "") { printf("%s\n", s); }
+    void print(const char *s) { printf("%s", s); }
+};
+extern HostSerial Serial;
+
+class HostEsp
+{
+public:
+    uint32_t getFreeHeap() const { return 8u * 1024 * 1024; }
+};
+extern HostEsp ESP;
+
+inline unsigned long millis()
+{
+    using namespace std::chrono;
+    static const auto t0 = steady_clock::now();
+    return (unsigned long)duration_cast<milliseconds>(steady_clock::now() - t0).count();
+}
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
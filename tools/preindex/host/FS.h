@@ -0,0 +1,88 @@
+#pragma once
+// 主机端替身：fs::File 以 stdio FILE* 实现，覆盖分页核心与页索引用到的接口
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+namespace fs
+{
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File
+{
+public:
+    File() = default;
+    explicit File(FILE *fp) : fp_(fp, &std::fclose) {}
+
+    static File open(const char *path, const char *mode)
+    {
+        FILE *fp = std::fopen(path, mode);
+        return fp ? File(fp) : File();
+    }
+
+    explicit operator bool() const { return fp_ != nullptr; }
+
+    size_t read(uint8_t *buf, size_t len) { return fp_ ? std::fread(buf, 1, len, fp_.get()) : 0; }
+    int read()
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    size_t readBytes(char *buf, size_t len) { return read(reinterpret_cast<uint8_t *>(buf), len); }
+    int peek()
+    {
+        if (!fp_)
+            return -1;
+        int c = std::fgetc(fp_.get());
+        if (c != EOF)
+            std::ungetc(c, fp_.get());
+        return c == EOF ? -1 : c;
+    }
+    size_t write(const uint8_t *buf, size_t len) { return fp_ ? std::fwrite(buf, 1, len, fp_.get()) : 0; }
+    size_t write(uint8_t c) { return write(&c, 1); }
+
+    bool seek(uint32_t pos, SeekMode mode = SeekSet)
+    {
+        static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+        return fp_ && std::fseek(fp_.get(), (long)pos, whence[mode]) == 0;
+    }
+    size_t position() const { return fp_ ? (size_t)std::ftell(fp_.get()) : 0; }
+    size_t size() const
+    {
+        if (!fp_)
+            return 0;
+        long cur = std::ftell(fp_.get());
+        std::fseek(fp_.get(), 0, SEEK_END);
+        long end = std::ftell(fp_.get());
+        std::fseek(fp_.get(), cur, SEEK_SET);
+        return (size_t)end;
+    }
+    int available() const
+    {
+        size_t sz = size(), pos = position();
+        return pos < sz ? (int)(sz - pos) : 0;
+    }
+    void flush()
+    {
+        if (fp_)
+            std::fflush(fp_.get());
+    }
+    void close() { fp_.reset(); }
+
+private:
+    // 与设备端 File 一样按值复制、共享同一句柄
+    std::shared_ptr<FILE> fp_;
+};
+} // namespace fs
+
+using fs::File;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekSet;
+using fs::SeekMode;
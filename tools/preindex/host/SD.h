@@ -0,0 +1,3 @@
+#pragma once
+// 主机端替身：SDWrapper.h 只需要该头文件存在
+#include <FS.h>
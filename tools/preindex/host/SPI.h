@@ -0,0 +1,6 @@
+#pragma once
+// 主机端替身：SDWrapper.h 的 begin() 默认参数需要 SPIClass / SPI
+class SPIClass
+{
+};
+extern SPIClass SPI;
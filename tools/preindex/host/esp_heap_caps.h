@@ -0,0 +1,14 @@
+#pragma once
+// 主机端替身：PSRAMAllocator 与页索引的 PSRAM 余量判断
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+
+inline void *heap_caps_malloc(size_t size, uint32_t) { return std::malloc(size); }
+inline void heap_caps_free(void *p) { std::free(p); }
+inline size_t heap_caps_get_free_size(uint32_t) { return (size_t)64 * 1024 * 1024; }
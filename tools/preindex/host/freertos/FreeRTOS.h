@@ -0,0 +1,11 @@
+#pragma once
+// 主机端替身：分页循环只用到让步与延时
+#include <cstdint>
+#include <thread>
+
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
@@ -0,0 +1,6 @@
+#pragma once
+#include "FreeRTOS.h"
+
+// 主机上分页不需要让出 CPU；vTaskDelay 直接返回，避免每批页固定休眠拖慢整书索引
+inline void taskYIELD() {}
+inline void vTaskDelay(TickType_t) {}
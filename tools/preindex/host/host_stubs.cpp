@@ -0,0 +1,62 @@
+// 主机端替身的全局对象与 SDWrapper（页索引的 SD 溢出文件用到；映射到当前目录下的同名路径）
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <SPI.h>
+#include "SD/SDWrapper.h"
+#include <cstdio>
+#include <sys/stat.h>
+
+HostSerial Serial;
+HostEsp ESP;
+SPIClass SPI;
+// font_decoder.cpp（分页只用其中的 utf8_decode）引用的全局画布
+M5Canvas *g_canvas = nullptr;
+
+namespace SDW
+{
+SDWrapper SD;
+
+static std::string host_path(const char *path)
+{
+    return std::string(".") + path;
+}
+
+SDWrapper::SDWrapper() : iface_(IF_SDMMC), initialized_(true), dma_pool_{}, dma_pool_in_use_{} {}
+
+bool SDWrapper::exists(const char *path)
+{
+    struct stat st;
+    return stat(host_path(path).c_str(), &st) == 0;
+}
+
+bool SDWrapper::mkdir(const char *path)
+{
+    return ::mkdir(host_path(path).c_str(), 0755) == 0;
+}
+
+bool SDWrapper::remove(const char *path)
+{
+    return std::remove(host_path(path).c_str()) == 0;
+}
+
+bool SDWrapper::rename(const char *oldPath, const char *newPath)
+{
+    return std::rename(host_path(oldPath).c_str(), host_path(newPath).c_str()) == 0;
+}
+
+File SDWrapper::open(const char *path, const char *mode, const bool create)
+{
+    (void)create;
+    std::string m = mode;
+    if (m == "r" || m == "w" || m == "a")
+        m += "b";
+    else if (m == "r+")
+        m = "r+b";
+    return File::open(host_path(path).c_str(), m.c_str());
+}
+
+File SDWrapper::open(const char *path)
+{
+    return open(path, "r", false);
+}
+} // namespace SDW
@@ -0,0 +1,142 @@
+#include "host_font.h"
+#include "text/bin_font_print.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+int16_t g_line_height = 0;
+
+namespace
+{
+const size_t HEADER_SIZE = 134; // char_count(4) + font_size(1) + version(1) + family(64) + style(64)
+const size_t ENTRY_SIZE = 20;   // 文件中的字符表条目（不含 BinFontChar 末尾的保留字段）
+
+std::vector<BinFontChar> s_chars;
+uint8_t s_font_size = 0;
+uint8_t s_version = 0;
+char s_family[65] = {0};
+
+uint16_t rd16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+uint32_t rd32(const uint8_t *p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+} // namespace
+
+bool host_font_load(const char *path, std::string &err)
+{
+    FILE *fp = std::fopen(path, "rb");
+    if (!fp)
+    {
+        err = std::string("cannot open font ") + path;
+        return false;
+    }
+    uint8_t hdr[HEADER_SIZE];
+    if (std::fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr))
+    {
+        std::fclose(fp);
+        err = "font header truncated";
+        return false;
+    }
+    uint32_t count = rd32(hdr);
+    s_font_size = hdr[4];
+    s_version = hdr[5];
+    std::memcpy(s_family, hdr + 6, 64);
+    s_family[64] = 0;
+    if (count == 0 || count > 65536 || s_font_size == 0)
+    {
+        std::fclose(fp);
+        err = "not a ReadPaper .bin font";
+        return false;
+    }
+
+    std::vector<uint8_t> table(count * ENTRY_SIZE);
+    bool ok = std::fread(table.data(), 1, table.size(), fp) == table.size();
+    std::fclose(fp);
+    if (!ok)
+    {
+        err = "font character table truncated";
+        return false;
+    }
+
+    s_chars.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t *e = &table[i * ENTRY_SIZE];
+        BinFontChar &c = s_chars[i];
+        c.unicode = rd16(e);
+        c.width = rd16(e + 2);
+        c.bitmapW = e[4];
+        c.bitmapH = e[5];
+        c.x_offset = (int8_t)e[6];
+        c.y_offset = (int8_t)e[7];
+        c.bitmap_offset = rd32(e + 8);
+        c.bitmap_size = rd32(e + 12);
+        c.cached_bitmap = 0;
+    }
+    g_line_height = s_font_size + LINE_MARGIN;
+    return true;
+}
+
+const char *host_font_family() { return s_family; }
+uint8_t host_font_version() { return s_version; }
+uint32_t host_font_char_count() { return (uint32_t)s_chars.size(); }
+
+// ---- 与 bin_font_print.cpp 相同语义的度量查询（字符表按码点有序，二分查找） ----
+
+const BinFontChar *find_char(uint32_t unicode)
+{
+    if (unicode > 0xFFFF)
+        return nullptr;
+    uint16_t unicode16 = (uint16_t)unicode;
+    auto it = std::lower_bound(s_chars.begin(), s_chars.end(), unicode16,
+                               [](const BinFontChar &c, uint16_t u) { return c.unicode < u; });
+    if (it != s_chars.end() && it->unicode == unicode16)
+        return &(*it);
+    return nullptr;
+}
+
+bool bin_font_has_glyph(uint32_t unicode)
+{
+    return find_char(unicode) != nullptr;
+}
+
+int16_t bin_font_get_glyph_width(uint32_t unicode)
+{
+    const BinFontChar *g = find_char(unicode);
+    if (!g)
+        return (int16_t)(s_font_size / 2);
+    return (int16_t)g->width;
+}
+
+int16_t bin_font_get_glyph_bitmapW(uint32_t unicode)
+{
+    const BinFontChar *g = find_char(unicode);
+    if (!g)
+        return (int16_t)(s_font_size / 2);
+    return (int16_t)g->bitmapW;
+}
+
+int16_t bin_font_get_glyph_bitmapH(uint32_t unicode)
+{
+    const BinFontChar *g = find_char(unicode);
+    if (!g)
+        return (int16_t)s_font_size;
+    return (int16_t)g->bitmapH;
+}
+
+uint32_t bin_font_get_glyph_bitmap_size(uint32_t unicode)
+{
+    const BinFontChar *g = find_char(unicode);
+    if (!g)
+        return 0;
+    return g->bitmap_size;
+}
+
+uint8_t bin_font_get_font_size()
+{
+    return s_font_size;
+}
+
+uint8_t get_font_size_from_file()
+{
+    return s_font_size;
+}
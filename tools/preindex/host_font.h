@@ -0,0 +1,12 @@
+#pragma once
+// 主机端字体度量：读取 .bin 字体的头部与字符表，提供分页用到的 bin_font_* 查询
+// （固件 bin_font_print.cpp 中同名函数的缓存模式实现，不加载位图）
+#include <cstdint>
+#include <string>
+
+// 加载字体并设置 g_line_height（基础字号 + LINE_MARGIN），与设备加载字体后一致
+bool host_font_load(const char *path, std::string &err);
+
+const char *host_font_family();
+uint8_t host_font_version();
+uint32_t host_font_char_count();
@@ -0,0 +1,539 @@
+// preindex：在主机上为书籍生成分页索引（.page + .complete），上传后设备打开即是已完成索引的状态
+//
+// 分页只取决于文本字节、字体度量（各字形宽度、基础字号决定的 g_line_height）、显示区域、竖排标志、
+// 繁简转换模式和目录 .idx 的强制换页位置。本工具编译固件同一份分页实现（src/text/text_paginate.cpp、
+// line_handle.cpp、zh_conv.cpp、page_index.cpp），字体度量从 .bin 的字符表读取，
+// 并按 background_index_task.cpp 的方式写文件：页头（页数）+ 首页记录 {0} + 每批 16 页一条 v2 记录，
+// 完成后写 "complete" 标记，并附一行分页设置指纹（paginate_fingerprint）：设备只采用与自己当前设置一致的预索引。
+// 输出目录下的相对路径与 SD 卡一致（bookmarks/<净化后的书籍路径>.page）。
+//
+//   preindex [选项] <book.txt> <font.bin>
+//     --out DIR          输出根目录（默认当前目录），写入 DIR/bookmarks/
+//     --book-path PATH   设备上的书籍路径（默认 /sd/book/<文件名>），决定索引文件名
+//     --idx FILE         目录文件（默认使用书籍同目录的同名 .idx，存在时）
+//     --encoding E       utf8 / gbk（默认与设备相同，检测开头 1KB）
+//     --zh-conv N        繁简转换模式 0/1/2（默认 0：新书默认“保留原文”；关闭后用设备的繁简设置，通常为 1）
+//     --vertical         竖排
+//     --area WxH         显示区域（默认 PAPER_S3_WIDTH/HEIGHT 减去页边距）
+//     --verbose          输出固件分页代码的日志
+//   preindex --check <font.bin> <book.txt>   自检（ctest）
+
+#include <Arduino.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "host_font.h"
+#include "readpaper.h"
+#include "text/gbk_unicode_table.h"
+#include "text/page_index.h"
+#include "text/text_handle.h"
+#include "text/text_paginate.h"
+
+// 与 background_index_task.cpp 的每批页数一致：记录边界相同，生成的 .page 与设备逐字节一致
+static const size_t CHUNK_PAGES = 16;
+
+struct Options
+{
+    std::string book;
+    std::string font;
+    std::string out = ".";
+    std::string book_path;
+    std::string idx;
+    TextEncoding encoding = TextEncoding::AUTO_DETECT;
+    int zh_conv = 0;
+    bool vertical = false;
+    int16_t area_w = PAPER_S3_WIDTH - MARGIN_LEFT - MARGIN_RIGHT;
+    int16_t area_h = PAPER_S3_HEIGHT - MARGIN_TOP - MARGIN_BOTTOM;
+};
+
+// 与 book_handle.cpp 的 make_sanitized_base 相同
+static std::string sanitized_base(const std::string &book_file_path)
+{
+    std::string safe = book_file_path;
+    for (char &c : safe)
+    {
+        if (c == '/' || c == '\\' || c == ':' || c == '?' || c == '*' || c == '<' || c == '>' || c == '|')
+            c = '_';
+    }
+    size_t dot = safe.find_last_of('.');
+    if (dot != std::string::npos)
+        safe = safe.substr(0, dot);
+    return safe;
+}
+
+static std::string base_name(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static std::string replace_ext(const std::string &path, const char *ext)
+{
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + ext;
+    return path.substr(0, dot) + ext;
+}
+
+static bool file_exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+struct IndexResult
+{
+    std::vector<uint32_t> first; // 首条记录（{0}）
+    std::vector<std::vector<uint32_t>> batches;
+    size_t pages = 0;
+    TextEncoding encoding = TextEncoding::UTF8;
+    std::string settings; // 分页设置指纹，写进 .complete
+};
+
+// 与后台索引任务相同的批次循环：每批从上一批最后一个页起点开始，新页起点（去掉重复的起点）作为一条记录
+static bool index_book(const Options &o, IndexResult &out, std::string &err)
+{
+    File book = File::open(o.book.c_str(), "rb");
+    if (!book)
+    {
+        err = "cannot open book " + o.book;
+        return false;
+    }
+    size_t file_size = book.size();
+
+    TextEncoding enc = o.encoding;
+    if (enc == TextEncoding::AUTO_DETECT)
+    {
+        uint8_t buf[1024];
+        size_t n = book.readBytes((char *)buf, sizeof(buf));
+        enc = detect_text_encoding(buf, n);
+        book.seek(0);
+    }
+    out.encoding = enc;
+
+    PagePositionStore breaks;
+    std::string idx = o.idx.empty() ? replace_ext(o.book, ".idx") : o.idx;
+    if (file_exists(idx))
+    {
+        File f = File::open(idx.c_str(), "rb");
+        if (f && parse_idx_positions(f, breaks))
+            std::fprintf(stderr, "preindex: %zu TOC entries from %s\n", breaks.size(), idx.c_str());
+    }
+    else if (!o.idx.empty())
+    {
+        err = "cannot open idx " + o.idx;
+        return false;
+    }
+
+    PaginateOptions opt;
+    opt.area_width = o.area_w;
+    opt.area_height = o.area_h;
+    opt.font_size = (float)get_font_size_from_file();
+    opt.encoding = enc;
+    opt.vertical = o.vertical;
+    opt.zh_conv_mode = (uint8_t)o.zh_conv;
+    opt.breaks = breaks.empty() ? nullptr : &breaks;
+    out.settings = paginate_fingerprint(opt, host_font_family(), host_font_version(), host_font_char_count());
+
+    out.first.assign(1, 0);
+    out.batches.clear();
+    out.pages = 1;
+    size_t start_pos = 0;
+    int no_progress = 0;
+    while (start_pos < file_size)
+    {
+        BuildIndexResult br = paginate_book(book, opt, CHUNK_PAGES, start_pos);
+        if (br.pages.empty())
+            break;
+        std::vector<uint32_t> offsets;
+        for (size_t i = 1; i < br.pages.size(); ++i)
+            offsets.push_back((uint32_t)br.pages[i]);
+        if (!offsets.empty())
+        {
+            out.pages += offsets.size();
+            out.batches.push_back(std::move(offsets));
+        }
+        size_t last_pos = br.pages.back();
+        if (br.reached_eof && last_pos <= file_size)
+            break;
+        // 与后台任务相同的兜底：连续 10 批没有前进即视为完成
+        if (last_pos <= start_pos)
+        {
+            if (++no_progress >= 10)
+                break;
+        }
+        else
+        {
+            no_progress = 0;
+        }
+        start_pos = last_pos;
+    }
+    return true;
+}
+
+static bool write_page_file(const std::string &path, const IndexResult &r)
+{
+    std::string tmp = path + ".tmp";
+    File f = File::open(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    // 设备先写占位页数 0，完成时回填；这里直接写最终值，文件内容相同
+    bool ok = PagePositionStore::writePageFileHeader(f, (uint32_t)r.pages) &&
+              PagePositionStore::appendRecord(f, r.first.data(), r.first.size());
+    for (const auto &b : r.batches)
+        ok = ok && PagePositionStore::appendRecord(f, b.data(), b.size());
+    f.close();
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool write_complete_marker(const std::string &path, const std::string &settings)
+{
+    FILE *fp = std::fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+    // 设备端 cm.println("complete")；第二行只有预索引才有，设备上传与打开时据此核对设置
+    bool ok = std::fputs("complete\r\n", fp) >= 0 &&
+              std::fprintf(fp, "%s%s\r\n", PAGINATE_SETTINGS_PREFIX, settings.c_str()) > 0;
+    return std::fclose(fp) == 0 && ok;
+}
+
+static int run(const Options &o)
+{
+    std::string err;
+    if (!host_font_load(o.font.c_str(), err))
+    {
+        std::fprintf(stderr, "preindex: %s\n", err.c_str());
+        return 1;
+    }
+
+    IndexResult r;
+    if (!index_book(o, r, err))
+    {
+        std::fprintf(stderr, "preindex: %s\n", err.c_str());
+        return 1;
+    }
+
+    std::string book_path = o.book_path.empty() ? "/sd/book/" + base_name(o.book) : o.book_path;
+    std::string dir = o.out + "/bookmarks";
+    ::mkdir(o.out.c_str(), 0755);
+    ::mkdir(dir.c_str(), 0755);
+    std::string stem = dir + "/" + sanitized_base(book_path);
+    if (!write_page_file(stem + ".page", r) || !write_complete_marker(stem + ".complete", r.settings))
+    {
+        std::fprintf(stderr, "preindex: cannot write %s.page/.complete\n", stem.c_str());
+        return 1;
+    }
+
+    std::printf("%s: %zu pages\n  settings: %s\n  -> %s.page\n  -> %s.complete\n", book_path.c_str(), r.pages,
+                r.settings.c_str(), stem.c_str(), stem.c_str());
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// 自检：批次循环与一次整书分页结果一致、.page 能被设备的加载代码读回、目录位置强制换页、
+// GBK 与 UTF-8 两种编码的同一文本页数相同
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                   \
+    do                                                     \
+    {                                                      \
+        if (!(cond))                                       \
+        {                                                  \
+            std::fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            std::fprintf(stderr, __VA_ARGS__);             \
+            std::fprintf(stderr, "\n");                    \
+            s_failures++;                                  \
+        }                                                  \
+    } while (0)
+
+static bool write_text(const std::string &path, const std::string &text)
+{
+    FILE *fp = std::fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+    std::fwrite(text.data(), 1, text.size(), fp);
+    return std::fclose(fp) == 0;
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::string s;
+    FILE *fp = std::fopen(path.c_str(), "rb");
+    if (!fp)
+        return s;
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), fp)) > 0)
+        s.append(buf, n);
+    std::fclose(fp);
+    return s;
+}
+
+static std::vector<size_t> flatten(const IndexResult &r)
+{
+    std::vector<size_t> v(r.first.begin(), r.first.end());
+    for (const auto &b : r.batches)
+        v.insert(v.end(), b.begin(), b.end());
+    return v;
+}
+
+static void check_book(const Options &base, const std::string &book, bool vertical)
+{
+    Options o = base;
+    o.book = book;
+    o.vertical = vertical;
+    IndexResult r;
+    std::string err;
+    CHECK(index_book(o, r, err), "index %s: %s", book.c_str(), err.c_str());
+    std::vector<size_t> pages = flatten(r);
+    size_t size = read_file(book).size();
+    CHECK(pages.size() == r.pages && pages.size() >= 2, "%s: page count %zu", book.c_str(), pages.size());
+    for (size_t i = 1; i < pages.size(); ++i)
+        CHECK(pages[i] > pages[i - 1] && pages[i] < size, "%s: page %zu offset %zu (prev %zu, size %zu)",
+              book.c_str(), i, pages[i], pages[i - 1], size);
+
+    // 批次循环与一次分完整书的结果一致
+    File f = File::open(book.c_str(), "rb");
+    PaginateOptions opt;
+    opt.area_width = o.area_w;
+    opt.area_height = o.area_h;
+    opt.font_size = (float)get_font_size_from_file();
+    opt.encoding = r.encoding;
+    opt.vertical = vertical;
+    opt.zh_conv_mode = (uint8_t)o.zh_conv;
+    PagePositionStore breaks;
+    File idx = File::open(replace_ext(book, ".idx").c_str(), "rb");
+    if (idx && parse_idx_positions(idx, breaks))
+        opt.breaks = &breaks;
+    BuildIndexResult whole = paginate_book(f, opt, 0, 0);
+    CHECK(whole.reached_eof, "%s: single pass did not reach EOF", book.c_str());
+    CHECK(whole.pages == pages, "%s: batched %zu pages != single pass %zu pages", book.c_str(), pages.size(), whole.pages.size());
+
+    // 目录位置都是页起点
+    for (size_t i = 0; i < breaks.size(); ++i)
+    {
+        bool found = false;
+        for (size_t p : pages)
+            found = found || p == breaks[i];
+        CHECK(found, "%s: TOC entry at %zu is not a page start", book.c_str(), breaks[i]);
+    }
+
+    // 设备端读回：页数与页起点一致，且无需重写
+    std::string page_path = book + ".check.page";
+    CHECK(write_page_file(page_path, r), "write %s", page_path.c_str());
+    File pf = File::open(page_path.c_str(), "rb");
+    PagePositionStore loaded;
+    bool needs_rewrite = true;
+    CHECK(loaded.loadFromPageFile(pf, needs_rewrite), "%s: loadFromPageFile failed", page_path.c_str());
+    CHECK(!needs_rewrite, "%s: loader asks for rewrite", page_path.c_str());
+    CHECK(loaded.size() == pages.size(), "%s: loaded %zu pages, wrote %zu", page_path.c_str(), loaded.size(), pages.size());
+    for (size_t i = 0; i < loaded.size() && i < pages.size(); ++i)
+        CHECK(loaded[i] == pages[i], "%s: page %zu loaded %zu wrote %zu", page_path.c_str(), i, loaded[i], pages[i]);
+    pf.close();
+    std::remove(page_path.c_str());
+
+    std::printf("  %-40s %s %5zu pages\n", base_name(book).c_str(), vertical ? "vertical  " : "horizontal", pages.size());
+}
+
+static int run_check(const std::string &font, const std::string &sample)
+{
+    std::string err;
+    if (!host_font_load(font.c_str(), err))
+    {
+        std::fprintf(stderr, "preindex --check: %s\n", err.c_str());
+        return 1;
+    }
+
+    char dir_tmpl[] = "/tmp/preindex_check_XXXXXX";
+    if (!mkdtemp(dir_tmpl))
+        return 1;
+    std::string dir = dir_tmpl;
+
+    // 合成书：长段落、空行、半角/全角混排、超长无空格串，带目录 .idx（强制换页位置不在页首）
+    std::string sample_text = read_file(sample);
+    std::string text;
+    std::string idx;
+    const char *para = "　　山不在高，有仙则名。水不在深，有龙则灵。斯是陋室，惟吾德馨。苔痕上阶绿，草色入帘青。"
+                       "谈笑有鸿儒，往来无白丁。可以调素琴，阅金经。无丝竹之乱耳，无案牍之劳形。ReadPaper e-ink reader, "
+                       "page index built on the host.\n";
+    for (int ch = 1; ch <= 12; ++ch)
+    {
+        char title[64];
+        std::snprintf(title, sizeof(title), "第%d章 测试\n", ch);
+        char line[128];
+        std::snprintf(line, sizeof(line), "#%d#, #第%d章#, #%zu#, #0#,\n", ch, ch, text.size());
+        idx += line;
+        text += title;
+        for (int i = 0; i < 3 + ch % 5; ++i)
+            text += para;
+        text += "\n\n";
+        if (ch % 4 == 0)
+            text += std::string(700, 'x') + "\n";
+    }
+    // GBK 副本只含合成部分（示例书里有 GBK 之外的符号）
+    std::string gbk_book = dir + "/sample_gbk.txt";
+    std::string gbk_text = convert_utf8_to_gbk(text);
+    std::string plain_text = text;
+    CHECK(write_text(gbk_book, gbk_text), "write GBK book");
+    text += sample_text;
+
+    std::string utf8_book = dir + "/sample.txt";
+    CHECK(write_text(utf8_book, text) && write_text(dir + "/sample.idx", idx), "write sample book");
+
+    Options base;
+    base.font = font;
+    std::printf("preindex check (font %s %upx)\n", host_font_family(), (unsigned)get_font_size_from_file());
+    check_book(base, utf8_book, false);
+    check_book(base, utf8_book, true);
+    check_book(base, sample, false);
+
+    // GBK 与 UTF-8：同一文本页数相同
+    CHECK(convert_gbk_to_utf8_lookup(gbk_text) == plain_text, "GBK round trip");
+    {
+        std::string plain_book = dir + "/plain.txt"; // 与 GBK 书一样没有 .idx
+        CHECK(write_text(plain_book, plain_text), "write plain book");
+        Options o = base;
+        IndexResult ru, rg;
+        o.book = plain_book;
+        index_book(o, ru, err);
+        o.book = gbk_book;
+        index_book(o, rg, err);
+        CHECK(rg.encoding == TextEncoding::GBK, "GBK book detected as %d", (int)rg.encoding);
+        CHECK(ru.pages == rg.pages, "GBK %zu pages != UTF-8 %zu pages", rg.pages, ru.pages);
+        check_book(base, gbk_book, false);
+    }
+
+    // 输出文件名与内容
+    Options o = base;
+    o.book = utf8_book;
+    o.out = dir + "/out";
+    o.book_path = "/sd/book/sample.txt";
+    CHECK(run(o) == 0, "run failed");
+    {
+        PaginateOptions opt;
+        opt.area_width = o.area_w;
+        opt.area_height = o.area_h;
+        opt.font_size = (float)get_font_size_from_file();
+        std::string fp = paginate_fingerprint(opt, host_font_family(), host_font_version(), host_font_char_count());
+        std::string marker = read_file(dir + "/out/bookmarks/_sd_book_sample.complete");
+        CHECK(marker == "complete\r\n" + std::string(PAGINATE_SETTINGS_PREFIX) + fp + "\r\n", "complete marker content: %s",
+              marker.c_str());
+        // 任何一项分页设置不同，指纹都不同
+        PaginateOptions v = opt;
+        v.vertical = true;
+        PaginateOptions a = opt;
+        a.area_height -= 1;
+        PaginateOptions z = opt;
+        z.zh_conv_mode = 1;
+        PaginateOptions g = opt;
+        g.encoding = TextEncoding::GBK;
+        for (const PaginateOptions *p : {&v, &a, &z, &g})
+            CHECK(paginate_fingerprint(*p, host_font_family(), host_font_version(), host_font_char_count()) != fp,
+                  "fingerprint ignores a setting");
+        CHECK(paginate_fingerprint(opt, host_font_family(), host_font_version(), host_font_char_count() + 1) != fp,
+              "fingerprint ignores the font");
+    }
+    std::string page = read_file(dir + "/out/bookmarks/_sd_book_sample.page");
+    CHECK(page.size() > PAGE_FILE_HEADER_SIZE && page.compare(0, 4, "BPG1") == 0 && page[4] == PAGE_FILE_VERSION_PACKED,
+          ".page header");
+
+    std::string cleanup = "rm -rf '" + dir + "'";
+    if (s_failures == 0 && std::system(cleanup.c_str()) != 0)
+        std::fprintf(stderr, "could not remove %s\n", dir.c_str());
+    std::printf(s_failures ? "%d failure(s), files kept in %s\n" : "ok\n", s_failures, dir.c_str());
+    return s_failures ? 1 : 0;
+}
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: preindex [--out DIR] [--book-path /sd/book/NAME] [--idx FILE] [--encoding utf8|gbk]\n"
+                 "                [--zh-conv 0|1|2] [--vertical] [--area WxH] [--verbose] <book.txt> <font.bin>\n"
+                 "       preindex --check <font.bin> <book.txt>\n");
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    bool check = false;
+    std::vector<std::string> pos;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        bool has_val = i + 1 < argc;
+        if (a == "--check")
+            check = true;
+        else if (a == "--verbose")
+            Serial.enabled = true;
+        else if (a == "--vertical")
+            o.vertical = true;
+        else if (a == "--out" && has_val)
+            o.out = argv[++i];
+        else if (a == "--book-path" && has_val)
+            o.book_path = argv[++i];
+        else if (a == "--idx" && has_val)
+            o.idx = argv[++i];
+        else if (a == "--zh-conv" && has_val)
+            o.zh_conv = std::atoi(argv[++i]);
+        else if (a == "--encoding" && has_val)
+        {
+            std::string e = argv[++i];
+            if (e == "utf8" || e == "utf-8")
+                o.encoding = TextEncoding::UTF8;
+            else if (e == "gbk")
+                o.encoding = TextEncoding::GBK;
+            else
+            {
+                usage();
+                return 2;
+            }
+        }
+        else if (a == "--area" && has_val)
+        {
+            int w = 0, h = 0;
+            if (std::sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+            {
+                usage();
+                return 2;
+            }
+            o.area_w = (int16_t)w;
+            o.area_h = (int16_t)h;
+        }
+        else if (!a.empty() && a[0] == '-')
+        {
+            usage();
+            return 2;
+        }
+        else
+            pos.push_back(a);
+    }
+
+    if (check)
+    {
+        if (pos.size() != 2)
+        {
+            usage();
+            return 2;
+        }
+        return run_check(pos[0], pos[1]);
+    }
+    if (pos.size() != 2 || o.zh_conv < 0 || o.zh_conv > 2)
+    {
+        usage();
+        return 2;
+    }
+    o.book = pos[0];
+    o.font = pos[1];
+    return run(o);
+}
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+web_assets.py - 为 SPIFFS 镜像生成预压缩的网页资源
+
+设备 Wi-Fi 传输页面（/ -> template.html）每次打开都要经软 AP 重发约 65KB。
+本脚本在构建 SPIFFS 镜像前把 data/ 复制到构建目录，并为网页资源额外生成：
+  <名>.gz    gzip -9 压缩（mtime 置 0，内容不变则字节不变）
+  <名>.etag  压缩内容 SHA-256 的前 16 位十六进制，设备作为 ETag 发出
+template.html 中的 <span id="curver"></span> 先按 data/version 的最后一个非空行填好（与设备端运行时替换一致）。
+原文件保留，供不接受 gzip 的客户端使用。设备端见 wifi_hotspot_manager.cpp 的 serve_precompressed。
+
+用法：
+  PlatformIO：platformio.ini 中 extra_scripts = pre:tools/web_assets.py，
+              执行 buildfs / uploadfs 时自动生成到 .pio/build/<env>/data 并以之作为镜像目录
+  手动：      python tools/web_assets.py [data 目录] [输出目录]
+"""
+
+import gzip
+import hashlib
+import os
+import shutil
+import sys
+
+# 需要预压缩的资源（相对 data/）
+GZIP_ASSETS = ("template.html",)
+VERSION_PLACEHOLDER = '<span id="curver"></span>'
+
+
+def read_version(data_dir):
+    """data/version 的最后一个非空行（设备 generateWebPage 的取法）"""
+    path = os.path.join(data_dir, "version")
+    if not os.path.exists(path):
+        return ""
+    version = ""
+    with open(path, "r", encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                version = line
+    return version
+
+
+def mirror(src, dst):
+    """把 src 同步到 dst：只复制有变化的文件，删除 src 中已不存在的文件"""
+    os.makedirs(dst, exist_ok=True)
+    keep = set()
+    for root, _dirs, files in os.walk(src):
+        rel = os.path.relpath(root, src)
+        out_root = os.path.normpath(os.path.join(dst, rel))
+        os.makedirs(out_root, exist_ok=True)
+        for name in files:
+            s = os.path.join(root, name)
+            d = os.path.join(out_root, name)
+            keep.add(os.path.normpath(d))
+            if (not os.path.exists(d) or os.path.getsize(d) != os.path.getsize(s)
+                    or os.path.getmtime(d) < os.path.getmtime(s)):
+                shutil.copy2(s, d)
+    return keep
+
+
+def build(data_dir, out_dir):
+    keep = mirror(data_dir, out_dir)
+    version = read_version(data_dir)
+    for name in GZIP_ASSETS:
+        src = os.path.join(data_dir, name)
+        if not os.path.exists(src):
+            continue
+        with open(src, "rb") as f:
+            raw = f.read()
+        if version and name == "template.html":
+            raw = raw.replace(VERSION_PLACEHOLDER.encode(),
+                              ('<span id="curver">%s</span>' % version).encode("utf-8"))
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = hashlib.sha256(packed).hexdigest()[:16]
+        gz_path = os.path.join(out_dir, name + ".gz")
+        etag_path = os.path.join(out_dir, name + ".etag")
+        with open(gz_path, "wb") as f:
+            f.write(packed)
+        with open(etag_path, "w", encoding="ascii", newline="\n") as f:
+            f.write(etag + "\n")
+        keep.update((os.path.normpath(gz_path), os.path.normpath(etag_path)))
+        print("web_assets: %s %d -> %d bytes, etag %s" % (name, len(raw), len(packed), etag))
+
+    # 输出目录里多余的旧文件（例如 data/ 中已删除的资源）一并清掉，镜像内容与 data/ 保持一致
+    for root, _dirs, files in os.walk(out_dir):
+        for name in files:
+            p = os.path.normpath(os.path.join(root, name))
+            if p not in keep:
+                os.remove(p)
+
+
+def _platformio():
+    Import("env")  # noqa: F821  (PlatformIO 注入)
+    from SCons.Script import COMMAND_LINE_TARGETS  # noqa: E402
+
+    fs_targets = {"buildfs", "uploadfs", "uploadfsota"}
+    if not fs_targets.intersection(COMMAND_LINE_TARGETS):
+        return
+    data_dir = env.subst("$PROJECT_DATA_DIR")  # noqa: F821
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "data")  # noqa: F821
+    build(data_dir, out_dir)
+    env.Replace(PROJECT_DATA_DIR=out_dir)  # noqa: F821
+
+
+if __name__ == "__main__":
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    src = sys.argv[1] if len(sys.argv) > 1 else os.path.join(root, "data")
+    dst = sys.argv[2] if len(sys.argv) > 2 else os.path.join(root, ".pio", "web_assets")
+    build(src, dst)
+else:
+    _platformio()
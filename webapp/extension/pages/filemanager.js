@@ -25,6 +25,10 @@
   const btnUpload = el('btnUpload');
   const btnSelect = el('btnSelect');
   const fileInput = el('fileInput');
+  const folderInput = el('folderInput');
+  const btnSyncFolder = el('btnSyncFolder');
+  const compressLabel = el('compressLabel');
+  const compressBooks = el('compressBooks');
   const uploadStatus = el('uploadStatus');
   const uploadTitle = el('uploadTitle');
   const hint = el('hint');
@@ -278,6 +282,7 @@
     // 对于 screenshot tab，隐藏常规上传区域，显示截图背景设置盒子
     if(uploadBox){ if(cat === 'screenshot') uploadBox.style.display = 'none'; else uploadBox.style.display = 'block'; }
     if(scbackBox){ if(cat === 'screenshot') scbackBox.style.display = 'block'; else scbackBox.style.display = 'none'; }
+    if(compressLabel) compressLabel.style.display = cat === 'book' ? '' : 'none';
     
     loadList();
   }
@@ -578,6 +583,20 @@
   };
 
   btnSelect.onclick = ()=> fileInput.click();
+  if(btnSyncFolder) btnSyncFolder.onclick = ()=> folderInput.click();
+  if(compressBooks){
+    compressBooks.checked = localStorage.getItem('rp_compress_books') === '1';
+    compressBooks.onchange = ()=> localStorage.setItem('rp_compress_books', compressBooks.checked ? '1' : '0');
+  }
+  if(folderInput) folderInput.onchange = async ()=>{
+    const files = Array.from(folderInput.files||[]);
+    folderInput.value = '';
+    if(files.length === 0) return;
+    btnSyncFolder.disabled = true;
+    try{ await syncFolder(files); }
+    catch(e){ uploadStatus.textContent=''; toast('同步失败: '+e.message,'error',5000); }
+    finally{ btnSyncFolder.disabled = false; }
+  };
   fileInput.onchange = ()=>{
     selectedFiles = Array.from(fileInput.files||[]);
     if(selectedFiles.length){ btnUpload.textContent = '上传 '+selectedFiles.length+' 个文件'; btnUpload.disabled=false; }
@@ -657,7 +676,9 @@
     const f = selectedFiles[i];
     uploadStatus.textContent = `正在上传 ${f.name} (${formatSize(f.size)}) ${i+1}/${selectedFiles.length}`;
     try {
-      await performUpload(f, p=>{ uploadStatus.textContent = `上传 ${f.name}: ${p.toFixed(1)}% (${i+1}/${selectedFiles.length})`; });
+      const body = await maybePackBook(f);
+      if(body !== f) uploadStatus.textContent = `正在上传 ${f.name} (压缩 ${formatSize(f.size)} → ${formatSize(body.size)}) ${i+1}/${selectedFiles.length}`;
+      await performUpload(body, p=>{ uploadStatus.textContent = `上传 ${f.name}: ${p.toFixed(1)}% (${i+1}/${selectedFiles.length})`; });
       // 单个文件上传成功，不显示 toast，避免干扰
       // 增加短延迟以给服务器/文件系统留够时间完成后处理（rename/刷新缓存等）
       await new Promise(r=>setTimeout(r, 300));
@@ -669,6 +690,229 @@
     }
   }
 
+  // 断点续传上传：/upload/init 取得上传 ID 与设备已确认的偏移，按块 PUT /upload/chunk（附 CRC32），最后 /upload/commit。
+  // 网络中断后从设备确认的偏移继续，不再整文件重传；旧固件没有这些接口（init 返回 404）时回退到整文件 POST /upload。
+  const RESUMABLE_MIN_SIZE = 1024 * 1024;
+  const RESUMABLE_MAX_FAILURES = 8;
+  const CRC_TABLE = (()=>{
+    const t = new Uint32Array(256);
+    for(let n=0;n<256;n++){ let c=n; for(let k=0;k<8;k++) c = (c & 1) ? (0xEDB88320 ^ (c >>> 1)) : (c >>> 1); t[n] = c >>> 0; }
+    return t;
+  })();
+  // prev 为前一段的结果，可分段累计（与设备端 http_crc32 一致）
+  function crc32(bytes, prev=0){
+    let c = (prev ^ 0xFFFFFFFF) >>> 0;
+    for(let i=0;i<bytes.length;i++) c = CRC_TABLE[(c ^ bytes[i]) & 0xFF] ^ (c >>> 8);
+    return (c ^ 0xFFFFFFFF) >>> 0;
+  }
+
+  // 书库同步：本地文件夹（只取第一层文件）算出 大小 + CRC32 清单提交 /sync，设备回答缺失或不同的文件，
+  // 只把这些文件交给 uploadSequential。设备散列时间用完时返回 pending，把这些行再提交直到比对完。
+  const SYNC_CRC_SLICE = 4 * 1024 * 1024;
+  const SYNC_MAX_ROUNDS = 20;
+
+  async function fileCrc32(file){
+    let c = 0;
+    for(let off=0; off<file.size; off+=SYNC_CRC_SLICE){
+      c = crc32(new Uint8Array(await file.slice(off, off + SYNC_CRC_SLICE).arrayBuffer()), c);
+    }
+    return c;
+  }
+
+  async function postSyncManifest(tab, lines){
+    const r = await fetch(`${API_BASE}/sync?tab=${encodeURIComponent(tab)}`, {
+      method: 'POST', headers: { 'Content-Type': 'text/plain' }, body: lines.join('\n') + '\n'
+    });
+    if(r.status === 404 || r.status === 405) return null;
+    const j = await r.json();
+    if(!r.ok || !j.ok) throw new Error(j.message || ('HTTP '+r.status));
+    return j;
+  }
+
+  async function syncFolder(files){
+    const tab = currentCat;
+    const local = files.filter(f=>(f.webkitRelativePath||f.name).split('/').length <= 2 && !/[\\/]|\.\./.test(f.name));
+    if(local.length === 0){ toast('文件夹中没有可同步的文件','error'); return; }
+
+    const lines = new Map(); // 小写文件名 -> 清单行
+    const byName = new Map();
+    for(let i=0;i<local.length;i++){
+      const f = local[i];
+      uploadStatus.textContent = `计算校验 ${f.name} (${i+1}/${local.length})`;
+      lines.set(f.name.toLowerCase(), `${f.size}\t${(await fileCrc32(f)).toString(16)}\t${f.name}`);
+      byName.set(f.name.toLowerCase(), f);
+    }
+
+    let todo = [];
+    let unchanged = 0;
+    let round = Array.from(lines.values());
+    for(let n=0; round.length && n<SYNC_MAX_ROUNDS; n++){
+      uploadStatus.textContent = n === 0 ? `与设备比对 ${round.length} 个文件...` : `设备仍在校验 ${round.length} 个文件...`;
+      const j = await postSyncManifest(tab, round);
+      if(j === null){ todo = local; toast('设备不支持同步，将上传全部文件','info',3000); break; }
+      unchanged += j.unchanged || 0;
+      todo.push(...[...(j.missing||[]), ...(j.changed||[])].map(name=>byName.get(name.toLowerCase())).filter(Boolean));
+      round = (j.pending||[]).map(name=>lines.get(name.toLowerCase())).filter(Boolean);
+    }
+    if(round.length) todo.push(...round.map(l=>byName.get(l.split('\t')[2].toLowerCase())).filter(Boolean));
+
+    if(todo.length === 0){
+      uploadStatus.textContent = '';
+      toast(`已同步：${unchanged} 个文件均与设备一致`,'success');
+      return;
+    }
+    toast(`${unchanged} 个文件已是最新，需上传 ${todo.length} 个`,'info',3000);
+    selectedFiles = todo;
+    btnUpload.disabled = true; btnUpload.textContent='上传中...';
+    uploadSequential(0);
+  }
+
+  // 压缩上传：书籍 .txt 在浏览器里按 RPLZ 格式（见 src/text/lz_block.h）切成 32KB 块，逐块 LZ4 压缩后再传，
+  // 以 <名>.txt.lz 存放。设备按文件头识别、按原文偏移读取；头部记下原文大小与 CRC32，/sync 照旧按原文比对。
+  const LZBOOK_BLOCK_SHIFT = 15;
+
+  // LZ4 块格式，贪心匹配（与 src/text/lz_block.cpp 相同）；dst 至少 n + n/255 + 16 字节
+  function lzCompressBlock(src, start, n, dst){
+    const end = start + n;
+    let op = 0, anchor = start;
+    const putLen = l=>{ while(l >= 255){ dst[op++] = 255; l -= 255; } dst[op++] = l; };
+    const sequence = (litLen, offset, matchLen)=>{
+      const ml = matchLen ? matchLen - 4 : 0;
+      dst[op++] = ((litLen < 15 ? litLen : 15) << 4) | (ml < 15 ? ml : 15);
+      if(litLen >= 15) putLen(litLen - 15);
+      dst.set(src.subarray(anchor, anchor + litLen), op); op += litLen;
+      if(!matchLen) return;
+      dst[op++] = offset & 0xFF; dst[op++] = offset >> 8;
+      if(ml >= 15) putLen(ml - 15);
+    };
+    if(n > 12){
+      const table = new Int32Array(4096); // 位置 + 1，0 为空
+      const r32 = p=>(src[p] | (src[p+1] << 8) | (src[p+2] << 16) | (src[p+3] << 24)) >>> 0;
+      const limit = end - 12, matchEnd = end - 5;
+      let ip = start;
+      while(ip < limit){
+        const seq = r32(ip);
+        const h = Math.imul(seq, 2654435761) >>> 20;
+        const slot = table[h];
+        table[h] = ip - start + 1;
+        let ref = start + slot - 1;
+        if(!slot || ip - ref > 65535 || r32(ref) !== seq){ ip++; continue; }
+        while(ip > anchor && ref > start && src[ip-1] === src[ref-1]){ ip--; ref--; }
+        let len = 4;
+        while(ip + len < matchEnd && src[ip+len] === src[ref+len]) len++;
+        sequence(ip - anchor, ip - ref, len);
+        ip += len; anchor = ip;
+      }
+    }
+    sequence(end - anchor, 0, 0);
+    return op;
+  }
+
+  function packBook(raw){
+    const bs = 1 << LZBOOK_BLOCK_SHIFT;
+    const count = Math.ceil(raw.length / bs);
+    const head = 20 + 4 * (count + 1);
+    const out = new Uint8Array(head + raw.length); // 压缩无收益的块原样存放，总长不会超过原文
+    const dv = new DataView(out.buffer);
+    out.set([0x52, 0x50, 0x4C, 0x5A, 1, 1, LZBOOK_BLOCK_SHIFT, 0]);
+    dv.setUint32(8, raw.length, true);
+    dv.setUint32(12, crc32(raw), true);
+    dv.setUint32(16, count, true);
+    const scratch = new Uint8Array(bs + Math.ceil(bs / 255) + 16);
+    let op = head;
+    for(let i=0;i<count;i++){
+      dv.setUint32(20 + 4 * i, op, true);
+      const s = i * bs, len = Math.min(bs, raw.length - s);
+      const n = lzCompressBlock(raw, s, len, scratch);
+      if(n > 0 && n < len){ out.set(scratch.subarray(0, n), op); op += n; }
+      else { out.set(raw.subarray(s, s + len), op); op += len; }
+    }
+    dv.setUint32(20 + 4 * count, op, true);
+    return out.subarray(0, op);
+  }
+
+  // 勾选“压缩”且是书籍 .txt 时返回压缩后的 File（<名>.txt.lz）；已是 RPLZ 或压缩无收益时原样返回
+  async function maybePackBook(file){
+    if(currentCat !== 'book' || !compressBooks || !compressBooks.checked || !/\.txt$/i.test(file.name)) return file;
+    const raw = new Uint8Array(await file.arrayBuffer());
+    if(raw.length >= 4 && raw[0] === 0x52 && raw[1] === 0x50 && raw[2] === 0x4C && raw[3] === 0x5A) return file;
+    const packed = packBook(raw);
+    if(packed.length >= raw.length) return file;
+    return new File([packed], file.name + '.lz', { type: 'application/octet-stream', lastModified: file.lastModified });
+  }
+
+  async function resumableCall(method, path){
+    const r = await fetch(`${API_BASE}${path}`, { method });
+    let body = {};
+    try{ body = await r.json(); }catch(_){ /* 旧固件返回纯文本 404 */ }
+    return { status: r.status, body };
+  }
+
+  function putChunk(id, offset, bytes, onSent){
+    return new Promise((resolve,reject)=>{
+      const xhr = new XMLHttpRequest();
+      xhr.open('PUT', `${API_BASE}/upload/chunk?id=${id}&offset=${offset}&crc=${crc32(bytes).toString(16)}`);
+      xhr.setRequestHeader('Content-Type','application/octet-stream');
+      xhr.upload.onprogress = e=>{ if(e.lengthComputable && onSent) onSent(e.loaded); };
+      xhr.onerror=()=>reject(new Error('network'));
+      xhr.ontimeout=()=>reject(new Error('timeout'));
+      xhr.onload=()=>{ let body={}; try{ body=JSON.parse(xhr.responseText||'{}'); }catch(_){} resolve({ status: xhr.status, body }); };
+      xhr.timeout = 60000;
+      xhr.send(bytes);
+    });
+  }
+
+  // 返回 null 表示设备不支持断点续传，由调用方回退到整文件上传
+  async function performResumableUpload(file, tab, onProgress){
+    const q = `tab=${encodeURIComponent(tab)}&name=${encodeURIComponent(file.name)}&size=${file.size}&mtime=${file.lastModified||0}`;
+    const init = await resumableCall('POST', `/upload/init?${q}`);
+    if(init.status === 404 || init.status === 405) return null;
+    if(init.status !== 200 || !init.body.ok) throw new Error(init.body.message || ('HTTP '+init.status));
+
+    const id = init.body.id;
+    const chunkSize = init.body.chunk || 256 * 1024;
+    let offset = init.body.offset || 0;
+    let failures = 0;
+    if(offset > 0) toast(`从 ${formatSize(offset)} 处继续上传 ${file.name}`, 'info', 2000);
+
+    while(offset < file.size){
+      const end = Math.min(offset + chunkSize, file.size);
+      const bytes = new Uint8Array(await file.slice(offset, end).arrayBuffer());
+      const base = offset;
+      let r = null;
+      try{
+        r = await putChunk(id, offset, bytes, sent=>{ if(onProgress) onProgress((base + sent) / file.size * 100); });
+      }catch(err){
+        // 断网/超时：退避后向设备查询已确认的偏移
+        if(++failures > RESUMABLE_MAX_FAILURES) throw err;
+        await new Promise(res=>setTimeout(res, Math.min(8000, 500 * Math.pow(2, failures - 1))));
+        try{
+          const s = await resumableCall('GET', `/upload/status?id=${id}`);
+          if(s.status === 200 && s.body.ok) offset = s.body.offset;
+        }catch(_){ /* 仍未连上，下一轮再试 */ }
+        continue;
+      }
+      if(r.status === 200 && r.body.ok){ offset = r.body.offset; failures = 0; continue; }
+      // 503 设备写卡跟不上：本块未写入，按 Retry-After 稍等后重发同一块
+      if(r.status === 503 && ++failures <= RESUMABLE_MAX_FAILURES){
+        await new Promise(res=>setTimeout(res, 1000 * failures));
+        if(typeof r.body.offset === 'number') offset = r.body.offset;
+        continue;
+      }
+      // 409 偏移不一致 / 422 CRC 错误：以设备确认的偏移为准重发
+      if((r.status === 409 || r.status === 422) && typeof r.body.offset === 'number' && ++failures <= RESUMABLE_MAX_FAILURES){
+        offset = r.body.offset;
+        continue;
+      }
+      throw new Error(r.body.message || ('HTTP '+r.status));
+    }
+
+    const c = await resumableCall('POST', `/upload/commit?id=${id}`);
+    if(c.status !== 200 || !c.body.ok) throw new Error(c.body.message || ('HTTP '+c.status));
+    if(onProgress) onProgress(100);
+    return c.body.message || 'OK';
+  }
+
   function performUpload(file,onProgress){
     // Implement automatic retry with exponential backoff to match original template.html behaviour.
     const maxRetries = 2; // same as template.html
@@ -676,6 +920,10 @@
     const currentTab = currentCat;
 
     return (async function(){
+      if(file.size >= RESUMABLE_MIN_SIZE){
+        const res = await performResumableUpload(file, currentTab, onProgress);
+        if(res !== null) return res;
+      }
       for(let attempt=0; attempt<=maxRetries; attempt++){
         try{
           const res = await new Promise((resolve,reject)=>{